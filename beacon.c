@@ -40,6 +40,12 @@ module_param(enable_short_bcn_as_dtim_override, int, 0644);
 MODULE_PARM_DESC(enable_short_bcn_as_dtim_override,
 		 "Override enable for short beacon to be the DTIM beacon (experimental)");
 
+static bool beacon_template __read_mostly;
+module_param(beacon_template, bool, 0644);
+MODULE_PARM_DESC(beacon_template,
+		 "Reuse the converted S1G beacon while its contents are unchanged, only updating "
+		 "the TIM and timestamps");
+
 static unsigned long beacon_irqs_enabled;
 static bool enable_short_bcn_as_dtim;
 
@@ -135,6 +141,211 @@ static void morse_beacon_fill_tx_info(struct morse *mors, struct morse_skb_tx_in
 		tx_info->flags |= cpu_to_le32(MORSE_TX_CONF_FLAGS_IMMEDIATE_REPORT);
 }
 
+void morse_beacon_template_invalidate(struct morse_vif *mors_vif)
+{
+	atomic_inc(&mors_vif->bcn_template_gen);
+}
+
+static void morse_beacon_template_free(struct morse_beacon_template *tmpl)
+{
+	kfree(tmpl->src);
+	kfree(tmpl->s1g);
+	memset(tmpl, 0, sizeof(*tmpl));
+}
+
+/*
+ * Beacon templates are only used where the S1G beacon is fully determined by the 11n beacon IEs
+ * and the inputs captured in the template key. Page slicing, MBSSID and channel switches all
+ * change the beacon in ways that are not captured.
+ */
+static bool morse_beacon_template_allowed(struct morse *mors, struct morse_vif *mors_vif,
+					  struct ieee80211_vif *vif, const u8 *tim_ie)
+{
+	return READ_ONCE(beacon_template) && tim_ie && vif->type == NL80211_IFTYPE_AP &&
+	       mors_vif->ap && !mors_vif->page_slicing_info.enabled &&
+	       !mors_vif->ecsa_chan_configured && !mors_vif->mask_ecsa_info_in_beacon &&
+	       !mors_vif->chan_switch_in_progress && !morse_mbssid_ie_enabled(mors);
+}
+
+static void morse_beacon_template_fill_key(struct morse_vif *mors_vif, struct ieee80211_vif *vif,
+					   const struct ieee80211_mgmt *beacon_mgmt,
+					   struct morse_beacon_template_key *key)
+{
+	/* Zero any padding so keys can be compared with memcmp */
+	memset(key, 0, sizeof(*key));
+	key->gen = atomic_read(&mors_vif->bcn_template_gen);
+	memcpy(key->bssid, beacon_mgmt->bssid, ETH_ALEN);
+	key->beacon_int = beacon_mgmt->u.beacon.beacon_int;
+	key->capab_info = beacon_mgmt->u.beacon.capab_info;
+	key->dtim_period = vif->bss_conf.dtim_period;
+	key->change_seq = mors_vif->s1g_bcn_change_seq;
+	key->sta_type = mors_vif->custom_configs->sta_type;
+	key->enable_ampdu = mors_vif->custom_configs->enable_ampdu;
+	key->enable_trav_pilot = mors_vif->custom_configs->enable_trav_pilot;
+	key->enable_sgi_rc = mors_vif->custom_configs->enable_sgi_rc;
+	key->cac_enabled = mors_vif->cac.enabled;
+	key->cac_threshold = mors_vif->cac.threshold_value;
+	memcpy(&key->channel_info, &mors_vif->custom_configs->channel_info,
+	       sizeof(key->channel_info));
+}
+
+/* Check whether a template was built from exactly these inputs */
+static bool morse_beacon_template_match(const struct morse_beacon_template *tmpl,
+					const struct morse_beacon_template_key *key,
+					const u8 *ies, int ies_len, const u8 *tim_ie,
+					const u8 *rps_ie, u8 rps_ie_size)
+{
+	const u16 pre_tim_len = tim_ie - ies;
+	const u8 *post_tim = tim_ie + 2 + tim_ie[1];
+	const u16 post_tim_len = (ies + ies_len) - post_tim;
+
+	if (!tmpl->s1g || memcmp(&tmpl->key, key, sizeof(*key)) != 0)
+		return false;
+
+	if (tmpl->src_pre_tim_len != pre_tim_len || tmpl->src_post_tim_len != post_tim_len ||
+	    tmpl->src_rps_len != rps_ie_size)
+		return false;
+
+	return memcmp(tmpl->src, ies, pre_tim_len) == 0 &&
+	       memcmp(tmpl->src + pre_tim_len, post_tim, post_tim_len) == 0 &&
+	       memcmp(tmpl->src + pre_tim_len + post_tim_len, rps_ie, rps_ie_size) == 0;
+}
+
+/* Record the inputs of a new template, before the 11n beacon is converted in place */
+static void morse_beacon_template_set_src(struct morse_beacon_template *tmpl,
+					  const struct morse_beacon_template_key *key,
+					  const u8 *ies, int ies_len, const u8 *tim_ie,
+					  const u8 *rps_ie, u8 rps_ie_size)
+{
+	const u16 pre_tim_len = tim_ie - ies;
+	const u8 *post_tim = tim_ie + 2 + tim_ie[1];
+	const u16 post_tim_len = (ies + ies_len) - post_tim;
+
+	morse_beacon_template_free(tmpl);
+
+	tmpl->src = kmalloc(pre_tim_len + post_tim_len + rps_ie_size, GFP_ATOMIC);
+	if (!tmpl->src)
+		return;
+
+	memcpy(tmpl->src, ies, pre_tim_len);
+	memcpy(tmpl->src + pre_tim_len, post_tim, post_tim_len);
+	memcpy(tmpl->src + pre_tim_len + post_tim_len, rps_ie, rps_ie_size);
+	tmpl->src_pre_tim_len = pre_tim_len;
+	tmpl->src_post_tim_len = post_tim_len;
+	tmpl->src_rps_len = rps_ie_size;
+	tmpl->key = *key;
+}
+
+/* Save the converted S1G beacon into the template, cutting out the TIM element */
+static void morse_beacon_template_set_s1g(struct morse_beacon_template *tmpl,
+					  const struct sk_buff *beacon, int s1g_hdr_length)
+{
+	const u8 *ies = beacon->data + s1g_hdr_length;
+	const u8 *end = beacon->data + beacon->len;
+	const u8 *tim = NULL;
+	const u8 *compat = NULL;
+	const u8 *pos;
+	u16 tim_len;
+
+	if (!tmpl->src)
+		return;
+
+	for (pos = ies; pos + 2 <= end && pos + 2 + pos[1] <= end; pos += 2 + pos[1]) {
+		if (pos[0] == WLAN_EID_TIM)
+			tim = pos;
+		else if (pos[0] == WLAN_EID_S1G_BCN_COMPAT &&
+			 pos[1] >= sizeof(struct dot11ah_s1g_bcn_compat_ie))
+			compat = pos;
+	}
+
+	if (!tim)
+		return;
+
+	tim_len = 2 + tim[1];
+	tmpl->s1g_len = beacon->len - tim_len;
+	tmpl->s1g = kmalloc(tmpl->s1g_len, GFP_ATOMIC);
+	if (!tmpl->s1g)
+		return;
+
+	tmpl->tim_offset = tim - beacon->data;
+	memcpy(tmpl->s1g, beacon->data, tmpl->tim_offset);
+	memcpy(tmpl->s1g + tmpl->tim_offset, tim + tim_len, end - (tim + tim_len));
+
+	tmpl->compat_tsf_offset = 0;
+	if (compat) {
+		tmpl->compat_tsf_offset = (compat - beacon->data) + 2 +
+			offsetof(struct dot11ah_s1g_bcn_compat_ie, tsf_completion);
+		if (compat > tim)
+			tmpl->compat_tsf_offset -= tim_len;
+	}
+}
+
+/*
+ * Replace the contents of the 11n beacon from mac80211 with the S1G beacon template, patching
+ * in the TIM and timestamps.
+ *
+ * Return: 0 on success, else error code (beacon is freed on error)
+ */
+static int morse_beacon_template_apply(struct morse *mors, struct morse_vif *mors_vif,
+				       struct ieee80211_vif *vif,
+				       const struct morse_beacon_template *tmpl,
+				       struct sk_buff **beacon, const u8 *tim_ie)
+{
+	struct dot11ah_s1g_tim_ie s1g_tim;
+	struct ieee80211_ext *s1g_beacon;
+	u16 tsf_offset = tmpl->compat_tsf_offset;
+	int tim_len;
+	u32 len;
+	u8 *pos;
+
+	tim_len = morse_dot11ah_build_s1g_tim(vif, &s1g_tim,
+					      (const struct ieee80211_tim_ie *)(tim_ie + 2),
+					      tim_ie[1], S1G_TIM_PAGE_SLICE_ENTIRE_PAGE, 0);
+	len = tmpl->s1g_len + 2 + tim_len;
+
+	if (((*beacon)->len + skb_tailroom(*beacon)) < len) {
+		struct sk_buff *skb2;
+
+		MORSE_PAGE_STAT_INC(mors, tx_s1g_copy);
+		skb2 = skb_copy_expand(*beacon, skb_headroom(*beacon), len - (*beacon)->len,
+				       GFP_ATOMIC);
+		if (!skb2) {
+			kfree_skb(*beacon);
+			*beacon = NULL;
+			return -ENOMEM;
+		}
+
+		/* Just say we transmitted it */
+		MORSE_IEEE80211_TX_STATUS(mors->hw, *beacon);
+		*beacon = skb2;
+	}
+
+	skb_trim(*beacon, 0);
+	pos = skb_put(*beacon, len);
+	memcpy(pos, tmpl->s1g, tmpl->tim_offset);
+	pos += tmpl->tim_offset;
+	*pos++ = WLAN_EID_TIM;
+	*pos++ = tim_len;
+	memcpy(pos, &s1g_tim, tim_len);
+	pos += tim_len;
+	memcpy(pos, tmpl->s1g + tmpl->tim_offset, tmpl->s1g_len - tmpl->tim_offset);
+
+	s1g_beacon = (struct ieee80211_ext *)(*beacon)->data;
+	s1g_beacon->u.s1g_beacon.timestamp =
+	    cpu_to_le32(LOWER_32_BITS(morse_mac_generate_timestamp_for_frame(mors_vif)));
+
+	if (tsf_offset) {
+		u64 now_usecs = jiffies_to_usecs((get_jiffies_64() - mors_vif->epoch));
+		__le32 tsf_completion = cpu_to_le32(UPPER_32_BITS(now_usecs));
+
+		if (tsf_offset >= tmpl->tim_offset)
+			tsf_offset += 2 + tim_len;
+		memcpy((*beacon)->data + tsf_offset, &tsf_completion, sizeof(tsf_completion));
+	}
+
+	return 0;
+}
+
 static void morse_beacon_tasklet(unsigned long data)
 {
 	struct morse_skbq *mq;
@@ -145,6 +356,7 @@ static void morse_beacon_tasklet(unsigned long data)
 	struct morse *mors;
 	struct morse_skb_tx_info tx_info = { 0 };
 	u8 rps_ie_size;
+	u8 rps_ie[MORSE_RAW_RPS_IE_MAX_LEN];
 	const u8 *tim_ie;
 	bool short_beacon;
 	int tx_bw_mhz;
@@ -161,6 +373,8 @@ static void morse_beacon_tasklet(unsigned long data)
 	bool fw_reports_tx_beacon_comp;
 	int num_bcn_vifs;
 	uint long_beacon_dtim_count;
+	struct morse_beacon_template *tmpl = NULL;
+	struct morse_beacon_template_key tmpl_key;
 
 	if (!mors_vif || !mors_vif->custom_configs)
 		return;
@@ -205,10 +419,6 @@ static void morse_beacon_tasklet(unsigned long data)
 		MORSE_BEACON_DBG(mors, "%s: number of beacons awaiting tx status: %u\n",
 						__func__, morse_skbq_pending_count(mq));
 
-	ies_mask = morse_dot11ah_ies_mask_alloc();
-	if (!ies_mask)
-		return;
-
 	short_beacon = (mors_vif->dtim_count != long_beacon_dtim_count);
 
 #if KERNEL_VERSION(6, 0, 0) > MAC80211_VERSION_CODE
@@ -220,7 +430,7 @@ static void morse_beacon_tasklet(unsigned long data)
 
 	if (!beacon) {
 		MORSE_BEACON_ERR_RATELIMITED(mors, "%s: ieee80211_beacon_get failed\n", __func__);
-		goto exit;
+		return;
 	}
 
 	beacon_mgmt = (struct ieee80211_mgmt *)beacon->data;
@@ -247,6 +457,28 @@ static void morse_beacon_tasklet(unsigned long data)
 		short_beacon = false;
 
 	s1g_beacon_ies = morse_mac_get_ie_pos(beacon, &s1g_ies_length, &s1g_hdr_length, false);
+	rps_ie_size = morse_raw_get_rps_ie(mors_vif, rps_ie);
+
+	if (s1g_beacon_ies && morse_beacon_template_allowed(mors, mors_vif, vif, tim_ie)) {
+		tmpl = &mors_vif->bcn_template[short_beacon];
+		morse_beacon_template_fill_key(mors_vif, vif, beacon_mgmt, &tmpl_key);
+
+		if (morse_beacon_template_match(tmpl, &tmpl_key, s1g_beacon_ies, s1g_ies_length,
+						tim_ie, rps_ie, rps_ie_size)) {
+			if (morse_beacon_template_apply(mors, mors_vif, vif, tmpl, &beacon, tim_ie))
+				return;
+			goto send;
+		}
+
+		morse_beacon_template_set_src(tmpl, &tmpl_key, s1g_beacon_ies, s1g_ies_length,
+					      tim_ie, rps_ie, rps_ie_size);
+	}
+
+	ies_mask = morse_dot11ah_ies_mask_alloc();
+	if (!ies_mask) {
+		kfree_skb(beacon);
+		return;
+	}
 
 	/* Parse out the original IEs so we can mess with them */
 	if (morse_dot11ah_parse_ies(s1g_beacon_ies, s1g_ies_length, ies_mask) < 0) {
@@ -259,11 +491,8 @@ static void morse_beacon_tasklet(unsigned long data)
 	/* Insert RPS IE if RAW is enabled. We will place it at the end and it
 	 * will be reordered by the 11n to s1g layer.
 	 */
-	rps_ie_size = morse_raw_get_rps_ie_size(mors_vif);
 	if (rps_ie_size != 0)
-		morse_dot11ah_insert_element(ies_mask,
-					     WLAN_EID_S1G_RPS,
-					     morse_raw_get_rps_ie(mors_vif), rps_ie_size);
+		morse_dot11ah_insert_element(ies_mask, WLAN_EID_S1G_RPS, rps_ie, rps_ie_size);
 
 	morse_cac_insert_ie(ies_mask, vif, beacon_mgmt->frame_control);
 
@@ -341,6 +570,7 @@ static void morse_beacon_tasklet(unsigned long data)
 	if ((beacon->len + skb_tailroom(beacon)) < (s1g_hdr_length + s1g_ies_length)) {
 		struct sk_buff *skb2;
 
+		MORSE_PAGE_STAT_INC(mors, tx_s1g_copy);
 		skb2 = skb_copy_expand(beacon, skb_headroom(beacon),
 				       (s1g_hdr_length + s1g_ies_length) - beacon->len, GFP_ATOMIC);
 
@@ -363,6 +593,10 @@ static void morse_beacon_tasklet(unsigned long data)
 
 	spin_unlock_bh(&mors_vif->vendor_ie.lock);
 
+	if (tmpl)
+		morse_beacon_template_set_s1g(tmpl, beacon, s1g_hdr_length);
+
+send:
 	if (vif->bss_conf.dtim_period)
 		mors_vif->dtim_count = (mors_vif->dtim_count + 1) % vif->bss_conf.dtim_period;
 	else
@@ -472,4 +706,7 @@ void morse_beacon_finish(struct morse_vif *mors_vif)
 	morse_beacon_irq_enable(mors_vif, false);
 	tasklet_kill(&mors_vif->beacon_tasklet);
 	atomic_dec(&mors->num_bcn_vifs);
+
+	morse_beacon_template_free(&mors_vif->bcn_template[0]);
+	morse_beacon_template_free(&mors_vif->bcn_template[1]);
 }
@@ -8,13 +8,19 @@
  *
  */
 #include <linux/skbuff.h>
+#include <linux/uio.h>
+#include <linux/ktime.h>
 
 #include "morse.h"
+#include "hw_trace.h"
+
+struct seq_file;
 
 /**
  * struct morse_bus_ops - bus callback operations.
  *
  * @morse_dm_write: direct memory write.
+ * @morse_dm_writev: optional, gather several buffers into one direct memory write.
  * @morse_dm_read: direct memory read.
  * @morse_req32_write: word memory write.
  * @morse_reg32_read: word memory read.
@@ -27,6 +33,7 @@
 struct morse_bus_ops {
 	int (*dm_read)(struct morse *mors, u32 addr, u8 *data, int len);
 	int (*dm_write)(struct morse *mors, u32 addr, const u8 *data, int len);
+	int (*dm_writev)(struct morse *mors, u32 addr, const struct kvec *vec, int cnt);
 	int (*reg32_read)(struct morse *mors, u32 addr, u32 *data);
 	int (*reg32_write)(struct morse *mors, u32 addr, u32 data);
 	int (*skb_tx)(struct morse *mors, struct sk_buff *skb, u8 channel);
@@ -39,30 +46,150 @@ struct morse_bus_ops {
 	unsigned int bulk_alignment;
 };
 
+extern bool enable_bus_stats;
+
+/**
+ * morse_bus_stats_record() - Account one timed bus operation.
+ *
+ * @mors: Morse chip instance
+ * @op: The operation
+ * @len: Bytes transferred, 0 for claim/hold
+ * @start_ns: Start time from morse_bus_stats_start()
+ * @ret: Result of the operation, negative on error
+ */
+void morse_bus_stats_record(struct morse *mors, enum morse_bus_stat_op op, unsigned int len,
+			    u64 start_ns, int ret);
+
+/** Start timing a bus operation, returns 0 when bus statistics are off */
+static inline u64 morse_bus_stats_start(void)
+{
+	return unlikely(enable_bus_stats) ? ktime_get_ns() : 0;
+}
+
+static inline void morse_bus_stats_end(struct morse *mors, enum morse_bus_stat_op op,
+				       unsigned int len, u64 start_ns, int ret)
+{
+	if (unlikely(start_ns))
+		morse_bus_stats_record(mors, op, len, start_ns, ret);
+}
+
 /** Default TX alignment for bus's which don't care.
  *  mac80211 will give us SKBs aligned to the 2 byte boundary, so 2 is effectively a noop
  */
 #define MORSE_DEFAULT_BULK_ALIGNMENT	(2)
 
+#ifdef CONFIG_MORSE_SINGLE_BUS
+#if (defined(CONFIG_MORSE_SDIO) + defined(CONFIG_MORSE_SPI) + defined(CONFIG_MORSE_USB)) != 1
+#error "CONFIG_MORSE_SINGLE_BUS requires exactly one of SDIO, SPI or USB to be enabled"
+#endif
+#ifdef CONFIG_MORSE_EMU
+#error "CONFIG_MORSE_SINGLE_BUS cannot be used with the emulated bus"
+#endif
+
+/*
+ * With a single bus compiled in there is only ever one bus_ops table, so the per register
+ * and per page accessors are bound at build time rather than dispatched through
+ * mors->bus_ops. Each bus driver provides these with MORSE_BUS_DIRECT_OPS(), which lets the
+ * compiler fold its static implementations straight into them.
+ */
+int morse_bus_direct_dm_read(struct morse *mors, u32 addr, u8 *data, int len);
+int morse_bus_direct_dm_write(struct morse *mors, u32 addr, const u8 *data, int len);
+int morse_bus_direct_reg32_read(struct morse *mors, u32 addr, u32 *data);
+int morse_bus_direct_reg32_write(struct morse *mors, u32 addr, u32 data);
+void morse_bus_direct_claim(struct morse *mors);
+void morse_bus_direct_release(struct morse *mors);
+
+#define MORSE_BUS_DIRECT_OPS(_dm_read, _dm_write, _reg32_read, _reg32_write, _claim, _release) \
+int morse_bus_direct_dm_read(struct morse *mors, u32 addr, u8 *data, int len) \
+{ return _dm_read(mors, addr, data, len); } \
+int morse_bus_direct_dm_write(struct morse *mors, u32 addr, const u8 *data, int len) \
+{ return _dm_write(mors, addr, data, len); } \
+int morse_bus_direct_reg32_read(struct morse *mors, u32 addr, u32 *data) \
+{ return _reg32_read(mors, addr, data); } \
+int morse_bus_direct_reg32_write(struct morse *mors, u32 addr, u32 data) \
+{ return _reg32_write(mors, addr, data); } \
+void morse_bus_direct_claim(struct morse *mors) \
+{ _claim(mors); } \
+void morse_bus_direct_release(struct morse *mors) \
+{ _release(mors); }
+
+#define MORSE_BUS_CALL(mors, op, ...)	morse_bus_direct_##op(mors, ##__VA_ARGS__)
+#else
+#define MORSE_BUS_DIRECT_OPS(...)
+#define MORSE_BUS_CALL(mors, op, ...)	((mors)->bus_ops->op(mors, ##__VA_ARGS__))
+#endif
+
 static inline int morse_dm_write(struct morse *mors, u32 addr, const u8 *data, int len)
 {
-	return mors->bus_ops->dm_write(mors, addr, data, len);
+	u64 start = morse_bus_stats_start();
+	int ret;
+
+	morse_hw_trace_point(MORSE_HWT_BUS_XFER, true);
+	ret = MORSE_BUS_CALL(mors, dm_write, addr, data, len);
+	morse_hw_trace_point(MORSE_HWT_BUS_XFER, false);
+
+	morse_bus_stats_end(mors, MORSE_BUS_STAT_DM_WRITE, len, start, ret);
+	return ret;
+}
+
+static inline bool morse_bus_can_writev(struct morse *mors)
+{
+	return !!mors->bus_ops->dm_writev;
+}
+
+/*
+ * morse_dm_writev - write @cnt buffers to consecutive chip memory starting at @addr in a
+ * single bus transaction. Returns -EOPNOTSUPP, having written nothing, if the bus cannot
+ * gather the request; the caller should then fall back to morse_dm_write().
+ */
+static inline int morse_dm_writev(struct morse *mors, u32 addr, const struct kvec *vec, int cnt)
+{
+	u64 start;
+	int ret;
+
+	if (!mors->bus_ops->dm_writev)
+		return -EOPNOTSUPP;
+
+	start = morse_bus_stats_start();
+	morse_hw_trace_point(MORSE_HWT_BUS_XFER, true);
+	ret = mors->bus_ops->dm_writev(mors, addr, vec, cnt);
+	morse_hw_trace_point(MORSE_HWT_BUS_XFER, false);
+	if (unlikely(start) && ret != -EOPNOTSUPP)
+		morse_bus_stats_record(mors, MORSE_BUS_STAT_DM_WRITE, iov_length(vec, cnt),
+				       start, ret);
+	return ret;
 }
 
 /* morse_dm_read - len must be rounded up to the nearest 4-byte boundary */
 static inline int morse_dm_read(struct morse *mors, u32 addr, u8 *data, int len)
 {
-	return mors->bus_ops->dm_read(mors, addr, data, len);
+	u64 start = morse_bus_stats_start();
+	int ret;
+
+	morse_hw_trace_point(MORSE_HWT_BUS_XFER, true);
+	ret = MORSE_BUS_CALL(mors, dm_read, addr, data, len);
+	morse_hw_trace_point(MORSE_HWT_BUS_XFER, false);
+
+	morse_bus_stats_end(mors, MORSE_BUS_STAT_DM_READ, len, start, ret);
+	return ret;
 }
 
 static inline int morse_reg32_write(struct morse *mors, u32 addr, u32 data)
 {
-	return mors->bus_ops->reg32_write(mors, addr, data);
+	u64 start = morse_bus_stats_start();
+	int ret = MORSE_BUS_CALL(mors, reg32_write, addr, data);
+
+	morse_bus_stats_end(mors, MORSE_BUS_STAT_REG32_WRITE, sizeof(data), start, ret);
+	return ret;
 }
 
 static inline int morse_reg32_read(struct morse *mors, u32 addr, u32 *data)
 {
-	return mors->bus_ops->reg32_read(mors, addr, data);
+	u64 start = morse_bus_stats_start();
+	int ret = MORSE_BUS_CALL(mors, reg32_read, addr, data);
+
+	morse_bus_stats_end(mors, MORSE_BUS_STAT_REG32_READ, sizeof(*data), start, ret);
+	return ret;
 }
 
 static inline void morse_set_bus_enable(struct morse *mors, bool enable)
@@ -72,12 +199,24 @@ static inline void morse_set_bus_enable(struct morse *mors, bool enable)
 
 static inline void morse_claim_bus(struct morse *mors)
 {
-	mors->bus_ops->claim(mors);
+	u64 start = morse_bus_stats_start();
+
+	MORSE_BUS_CALL(mors, claim);
+	if (unlikely(start)) {
+		morse_bus_stats_record(mors, MORSE_BUS_STAT_CLAIM, 0, start, 0);
+		mors->debug.bus_claimed_ns = ktime_get_ns();
+	}
 }
 
 static inline void morse_release_bus(struct morse *mors)
 {
-	mors->bus_ops->release(mors);
+	/* Still holding the bus, so bus_claimed_ns is ours */
+	if (unlikely(mors->debug.bus_claimed_ns)) {
+		morse_bus_stats_record(mors, MORSE_BUS_STAT_HOLD, 0,
+				       mors->debug.bus_claimed_ns, 0);
+		mors->debug.bus_claimed_ns = 0;
+	}
+	MORSE_BUS_CALL(mors, release);
 }
 
 static inline int morse_bus_reset(struct morse *mors)
@@ -93,12 +232,61 @@ static inline void morse_bus_set_irq(struct morse *mors, bool enable)
 int morse_bus_test(struct morse *mors, const char *bus_name);
 void morse_bus_throughput_profiler(struct morse *mors);
 
+/**
+ * Profile the bus by sweeping transfer size, host buffer alignment and access width
+ * (32 bit register vs bulk data memory) through the bus_ops backend in use.
+ *
+ * One line is written per combination with the operation, size, alignment, calls, errors,
+ * throughput (MB/s) and per call latency min/p50/p90/p99/max (ns). Bulk writes overwrite
+ * chip data memory, so the chip must be restarted afterwards.
+ *
+ * @mors: Morse chip instance
+ * @rounds: Number of calls to time for each combination
+ * @out: Buffer to format the results into
+ * @size: Size of @out
+ *
+ * @return: Number of bytes written to @out, else error code
+ */
+int morse_bus_profile(struct morse *mors, u32 rounds, char *out, size_t size);
+
+/**
+ * morse_bus_bench_sort_u32() - Sort benchmark samples into ascending order
+ *
+ * @vals: Samples to sort in place
+ * @num: Number of samples
+ */
+void morse_bus_bench_sort_u32(u32 *vals, u32 num);
+
+/**
+ * morse_bus_bench_percentile() - Look up a percentile of sorted benchmark samples
+ *
+ * @sorted: Samples sorted by morse_bus_bench_sort_u32()
+ * @num: Number of samples, must be non-zero
+ * @permille: Percentile to return, in tenths of a percent
+ *
+ * @return: The sample at @permille
+ */
+u32 morse_bus_bench_percentile(const u32 *sorted, u32 num, u32 permille);
+
+/**
+ * morse_bus_bench_show_rate() - Print the packet rate and goodput of a benchmark run
+ *
+ * @file: seq file to print to
+ * @name: Direction the rate is for
+ * @cnt: Packets transferred
+ * @len: Length of each packet in bytes
+ * @time_taken_msec: Duration of the run, must be non-zero
+ */
+void morse_bus_bench_show_rate(struct seq_file *file, const char *name, u32 cnt, u32 len,
+			       unsigned long time_taken_msec);
+
 int morse_skb_tx(struct morse *mors, struct sk_buff *skb, u8 channel);
 
 enum morse_host_bus_type {
 	MORSE_HOST_BUS_TYPE_SDIO,
 	MORSE_HOST_BUS_TYPE_SPI,
 	MORSE_HOST_BUS_TYPE_USB,
+	MORSE_HOST_BUS_TYPE_EMU,
 };
 
 #endif /* !_MORSE_BUS_H_ */
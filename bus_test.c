@@ -7,11 +7,43 @@
 #include <linux/math64.h>
 #include <linux/ip.h>
 #include <linux/udp.h>
+#include <linux/sort.h>
+#include <linux/seq_file.h>
 
 #include "morse.h"
 #include "bus.h"
 #include "debug.h"
 
+static int morse_bus_bench_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a;
+	u32 y = *(const u32 *)b;
+
+	return (x > y) - (x < y);
+}
+
+void morse_bus_bench_sort_u32(u32 *vals, u32 num)
+{
+	sort(vals, num, sizeof(*vals), morse_bus_bench_cmp_u32, NULL);
+}
+
+u32 morse_bus_bench_percentile(const u32 *sorted, u32 num, u32 permille)
+{
+	u32 idx = div_u64((u64)num * permille, 1000);
+
+	return sorted[min(idx, num - 1)];
+}
+
+void morse_bus_bench_show_rate(struct seq_file *file, const char *name, u32 cnt, u32 len,
+			       unsigned long time_taken_msec)
+{
+	seq_printf(file, "%s:\n", name);
+	seq_printf(file, "\tpackets per sec: %llu\n",
+		   div_u64((u64)cnt * MSEC_PER_SEC, time_taken_msec));
+	seq_printf(file, "\tgoodput (kbit): %llu\n",
+		   div_u64((u64)cnt * len * 8, time_taken_msec));
+}
+
 #ifdef CONFIG_MORSE_ENABLE_TEST_MODES
 
 #define BUS_TEST_MAX_BLOCK_SIZE	(64 * 1024)
@@ -420,6 +452,150 @@ exit:
 	kfree(send_buffer);
 }
 
+/* Sweep of the debugfs bus profiler */
+#define BUS_PROFILE_SIZE_LIST	{4, 32, 64, 128, 256, 512, 1024, 1536, 2048, \
+				4 * 1024, 8 * 1024, 16 * 1024}
+#define BUS_PROFILE_MAX_ALIGN	(4)
+#define BUS_PROFILE_MAX_ROUNDS	(1024)
+
+enum {
+	BUS_PROFILE_OP_RD32,
+	BUS_PROFILE_OP_WR32,
+	BUS_PROFILE_OP_RDBULK,
+	BUS_PROFILE_OP_WRBULK,
+};
+
+static const char * const bus_profile_op_strings[] = {
+	[BUS_PROFILE_OP_RD32] = "rd32",
+	[BUS_PROFILE_OP_WR32] = "wr32",
+	[BUS_PROFILE_OP_RDBULK] = "rdbulk",
+	[BUS_PROFILE_OP_WRBULK] = "wrbulk",
+};
+
+/* Time @rounds calls of one bus operation, recording per call latency (ns) into @times */
+static int morse_bus_profile_op(struct morse *mors, int op, u8 *buf, u32 size, u32 rounds,
+				u32 *times)
+{
+	u32 dm_addr = mors->cfg->regs->pager_base_address;
+	u32 reg_write_val = 0xdeadbeef;
+	u32 reg_read_val;
+	ktime_t start_ktime;
+	int errors = 0;
+	int ret = 0;
+	u32 j;
+
+	for (j = 0; j < rounds; j++) {
+		start_ktime = ktime_get();
+		switch (op) {
+		case BUS_PROFILE_OP_RD32:
+			ret = mors->bus_ops->reg32_read(mors, MORSE_REG_CHIP_ID(mors),
+							&reg_read_val);
+			break;
+		case BUS_PROFILE_OP_WR32:
+			ret = mors->bus_ops->reg32_write(mors, dm_addr, reg_write_val);
+			break;
+		case BUS_PROFILE_OP_RDBULK:
+			ret = mors->bus_ops->dm_read(mors, dm_addr, buf, size);
+			break;
+		case BUS_PROFILE_OP_WRBULK:
+			ret = mors->bus_ops->dm_write(mors, dm_addr, buf, size);
+			break;
+		}
+		times[j] = min_t(s64, ktime_to_ns(ktime_sub(ktime_get(), start_ktime)), U32_MAX);
+		if (ret)
+			errors++;
+	}
+
+	return errors;
+}
+
+/* Format one result row, see morse_bus_profile() for the columns */
+static int morse_bus_profile_row(char *out, size_t space, int op, u32 size, u32 align,
+				 u32 rounds, int errors, u32 *times)
+{
+	u64 total_ns = 0;
+	u64 mbps_x1000;
+	u32 j;
+
+	for (j = 0; j < rounds; j++)
+		total_ns += times[j];
+
+	/* bytes per ns * 1e9 / 1e6 = MB/s, kept to three decimal places */
+	mbps_x1000 = total_ns ? div64_u64((u64)size * rounds * 1000000, total_ns) : 0;
+
+	morse_bus_bench_sort_u32(times, rounds);
+
+	return scnprintf(out, space, "%s %u %u %u %d %llu.%03llu %u %u %u %u %u\n",
+			 bus_profile_op_strings[op], size, align, rounds, errors,
+			 div_u64(mbps_x1000, 1000), mbps_x1000 % 1000,
+			 times[0],
+			 morse_bus_bench_percentile(times, rounds, 500),
+			 morse_bus_bench_percentile(times, rounds, 900),
+			 morse_bus_bench_percentile(times, rounds, 990),
+			 times[rounds - 1]);
+}
+
+int morse_bus_profile(struct morse *mors, u32 rounds, char *out, size_t size)
+{
+	const u32 size_list[] = BUS_PROFILE_SIZE_LIST;
+	const u32 max_size = size_list[ARRAY_SIZE(size_list) - 1];
+	int ops[] = { BUS_PROFILE_OP_RDBULK, BUS_PROFILE_OP_WRBULK };
+	u32 *times;
+	u8 *buffer;
+	int count = 0;
+	int errors;
+	int i, op;
+	u32 align;
+	u8 val;
+
+	if (!rounds || rounds > BUS_PROFILE_MAX_ROUNDS)
+		return -EINVAL;
+
+	buffer = kmalloc(max_size + BUS_PROFILE_MAX_ALIGN, GFP_KERNEL);
+	times = kmalloc_array(rounds, sizeof(*times), GFP_KERNEL);
+	if (!buffer || !times) {
+		count = -ENOMEM;
+		goto exit;
+	}
+
+	/* Fill the buffer with changing data, increment by 0x11 so we have a predictable pattern */
+	for (i = 0, val = 0; i < max_size + BUS_PROFILE_MAX_ALIGN; i++, val += 0x11)
+		buffer[i] = val;
+
+	count += scnprintf(out + count, size - count,
+			   "# op size align calls errors mbps min_ns p50_ns p90_ns p99_ns max_ns\n");
+
+	morse_claim_bus(mors);
+
+	for (op = BUS_PROFILE_OP_RD32; op <= BUS_PROFILE_OP_WR32; op++) {
+		errors = morse_bus_profile_op(mors, op, NULL, sizeof(u32), rounds, times);
+		count += morse_bus_profile_row(out + count, size - count, op, sizeof(u32), 0,
+					       rounds, errors, times);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ops); i++) {
+		int size_idx;
+
+		for (size_idx = 0; size_idx < ARRAY_SIZE(size_list); size_idx++) {
+			/* Offset the host buffer to exercise the bus drivers' alignment handling */
+			for (align = 0; align < BUS_PROFILE_MAX_ALIGN; align++) {
+				errors = morse_bus_profile_op(mors, ops[i], buffer + align,
+							      size_list[size_idx], rounds, times);
+				count += morse_bus_profile_row(out + count, size - count, ops[i],
+							       size_list[size_idx], align, rounds,
+							       errors, times);
+			}
+		}
+	}
+
+	morse_release_bus(mors);
+
+exit:
+	kfree(times);
+	kfree(buffer);
+	return count;
+}
+
 void morse_bus_throughput_profiler(struct morse *mors)
 {
 	const char *mm610x_hw_str =  "MM610";
@@ -2,8 +2,12 @@
  * Copyright 2024 Morse Micro
  */
 #include <linux/string.h>
+#include <linux/slab.h>
 #include <linux/ktime.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
 #include "bus_trace.h"
+#include "trace.h"
 
 static const char *trace_id_to_string(enum bus_trace_event_id id)
 {
@@ -35,38 +39,107 @@ static const char *trace_id_to_string(enum bus_trace_event_id id)
 
 void bus_trace_dump(const struct bus_trace *trace, ktime_t reference)
 {
-	unsigned int count;
-	unsigned int i = trace->trace_index; /* start at oldest */
+	struct {
+		unsigned int next;
+		unsigned int left;
+	} *cursor;
+	int cpu;
 
-	for (count = 0; count < ARRAY_SIZE(trace->events); count++) {
-		const struct bus_trace_event *event = &trace->events[i];
+	if (!trace->rings)
+		return;
 
-		pr_info("[%9llu] fn[%d] %-14s : 0x%08x (%4d)",
+	cursor = kcalloc(nr_cpu_ids, sizeof(*cursor), GFP_ATOMIC);
+	if (!cursor)
+		return;
+
+	/* Start each ring at its oldest event */
+	for_each_possible_cpu(cpu) {
+		unsigned int index = READ_ONCE(per_cpu_ptr(trace->rings, cpu)->trace_index);
+
+		cursor[cpu].left = min_t(unsigned int, index, BUS_TRACE_DEPTH);
+		cursor[cpu].next = index - cursor[cpu].left;
+	}
+
+	/* Each ring is in time order, so repeatedly print the oldest of their heads */
+	for (;;) {
+		const struct bus_trace_event *event = NULL;
+		int event_cpu = -1;
+
+		for_each_possible_cpu(cpu) {
+			const struct bus_trace_event *head;
+
+			if (!cursor[cpu].left)
+				continue;
+
+			head = &per_cpu_ptr(trace->rings, cpu)->events[cursor[cpu].next %
+								       BUS_TRACE_DEPTH];
+			if (!event || ktime_before(head->ts, event->ts)) {
+				event = head;
+				event_cpu = cpu;
+			}
+		}
+
+		if (!event)
+			break;
+
+		cursor[event_cpu].next++;
+		cursor[event_cpu].left--;
+
+		pr_info("[%9llu] cpu%d fn[%d] %-14s : 0x%08x (%4d)",
 			ktime_to_us(ktime_sub(reference, event->ts)),
+			event_cpu,
 			event->fn,
 			trace_id_to_string(event->id),
 			event->address,
 			event->len);
-
-		i = (i + 1) % ARRAY_SIZE(trace->events);
 	}
+
+	kfree(cursor);
+}
+
+static void bus_trace_ring_log(struct bus_trace *trace, enum bus_trace_event_id id,
+			       unsigned int fn, unsigned int address, unsigned int len)
+{
+	struct bus_trace_event *event;
+	unsigned int index;
+
+	if (!trace->rings)
+		return;
+
+	/*
+	 * Claiming the slot with a this_cpu operation keeps it unique even if an
+	 * interrupt on this CPU logs in the middle of a write.
+	 */
+	preempt_disable();
+	index = this_cpu_inc_return(trace->rings->trace_index) - 1;
+	event = &this_cpu_ptr(trace->rings)->events[index % BUS_TRACE_DEPTH];
+	event->ts = ktime_get_boottime();
+	event->id = id;
+	event->fn = fn;
+	event->address = address;
+	event->len = len;
+	preempt_enable();
 }
 
 void bus_trace_log(struct bus_trace *trace, enum bus_trace_event_id id,
 		   unsigned int fn, unsigned int address, unsigned int len)
 {
-	unsigned int index = trace->trace_index;
-
-	trace->events[index].ts = ktime_get_boottime();
-	trace->events[index].id = id;
-	trace->events[index].fn = fn;
-	trace->events[index].address = address;
-	trace->events[index].len = len;
-	trace->trace_index = (index + 1) % ARRAY_SIZE(trace->events);
+	trace_morse_bus_event(trace->mors, id, fn, address, len);
+	bus_trace_ring_log(trace, id, fn, address, len);
+}
+
+void bus_trace_init(struct bus_trace *trace, const struct morse *mors)
+{
+	trace->mors = mors;
+	BUILD_BUG_ON(!is_power_of_2(BUS_TRACE_DEPTH));
+	trace->rings = alloc_percpu(struct bus_trace_ring);
+	if (!trace->rings)
+		pr_warn("%s: no memory for the bus trace ring, only tracepoints will log\n",
+			__func__);
 }
 
-void bus_trace_init(struct bus_trace *trace)
+void bus_trace_deinit(struct bus_trace *trace)
 {
-	trace->trace_index = 0;
-	memset(&trace->events, 0,  sizeof(trace->events));
+	free_percpu(trace->rings);
+	trace->rings = NULL;
 }
@@ -7,6 +7,8 @@
 #include <linux/types.h>
 #include <linux/ktime.h>
 
+struct morse;
+
 enum bus_trace_event_id {
 	BUS_TRACE_EVENT_ID_SET_REG_BASE_ADDRESS,
 	BUS_TRACE_EVENT_ID_SET_BULK_BASE_ADDRESS,
@@ -29,21 +31,43 @@ struct bus_trace_event {
 	unsigned int len;
 };
 
-struct bus_trace {
+/* One ring per CPU, written without locks by the CPU that owns it */
+struct bus_trace_ring {
 	unsigned int trace_index;
 	struct bus_trace_event events[BUS_TRACE_DEPTH];
 };
 
+struct bus_trace {
+	const struct morse *mors;
+	struct bus_trace_ring __percpu *rings;
+};
+#else
+struct bus_trace {
+	const struct morse *mors;
+};
+#endif
+
+#ifdef CONFIG_MORSE_BUS_TRACE
 /**
  * bus_trace_init() - Initialise a bus trace event log.
  *
  * @trace: The bus trace to initialise.
+ * @mors: The device the bus belongs to, named in exported trace events.
  */
-void bus_trace_init(struct bus_trace *trace);
+void bus_trace_init(struct bus_trace *trace, const struct morse *mors);
+
+/**
+ * bus_trace_deinit() - Free a bus trace event log.
+ *
+ * @trace: The bus trace to free.
+ */
+void bus_trace_deinit(struct bus_trace *trace);
 
 /**
  * bus_trace_log() - Log a trace event for the bus.
  *
+ * The event is offered to the morse_bus_event tracepoint and kept in the calling CPU's ring.
+ *
  * @trace: The trace to log the event on.
  * @id: Event trace id.
  * @fn: Bus function in use.
@@ -54,16 +78,29 @@ void bus_trace_log(struct bus_trace *trace, enum bus_trace_event_id id,
 		   unsigned int fn, unsigned int address, unsigned int len);
 
 /**
- * bus_trace_dump() - Print trace event log.
+ * bus_trace_dump() - Print trace event log, merged across CPUs in time order.
  *
  * @trace: The trace event log to dump.
  * @reference: Current kernel boot time reference.
  */
 void bus_trace_dump(const struct bus_trace *trace, ktime_t reference);
 #else
-struct bus_trace {};
-#define bus_trace_init(...)
-#define bus_trace_log(...)
+static inline void bus_trace_init(struct bus_trace *trace, const struct morse *mors)
+{
+	trace->mors = mors;
+}
+
+static inline void bus_trace_deinit(struct bus_trace *trace)
+{
+}
+
+/*
+ * Without the ring, logging is only the tracepoint's static branch, kept inline at the call
+ * site. Callers include trace.h for it.
+ */
+#define bus_trace_log(trace, id, fn, address, len) \
+	trace_morse_bus_event((trace)->mors, id, fn, address, len)
+
 #define bus_trace_dump(...)
 #endif
 
@@ -24,6 +24,9 @@
 #define MORSE_CAC_CHECK_INTERVAL_MS	100
 #define MORSE_CAC_CHECK_PERIOD_MS	1000
 
+/* The rate window spans a check period, so its count is in frames per second */
+#define MORSE_CAC_ARFS_SLOT_MS		(MORSE_CAC_CHECK_PERIOD_MS / CAC_ARFS_WINDOW_SLOTS)
+
 struct cac_threshold_change_rules cac_threshold_change_rules_default = {
 	6,
 	{
@@ -38,17 +41,52 @@ struct cac_threshold_change_rules cac_threshold_change_rules_default = {
 	}
 };
 
-void morse_cac_count_auth(const struct ieee80211_vif *vif, const struct ieee80211_mgmt *hdr)
+static unsigned long cac_arfs_slot(unsigned long time)
 {
-	struct morse_vif *mors_vif = (struct morse_vif *)vif->drv_priv;
-	struct morse_cac *cac = &mors_vif->cac;
-	const u16 auth_transaction = le16_to_cpu(hdr->u.auth.auth_transaction);
+	return time / max(msecs_to_jiffies(MORSE_CAC_ARFS_SLOT_MS), 1UL);
+}
 
-	/* Ignore SAE auth that is already in progress */
-	if (auth_transaction != 1)
-		return;
+static unsigned long cac_arfs_slot_now(void)
+{
+	return cac_arfs_slot(jiffies);
+}
 
-	cac->arfs++;
+static void cac_arfs_add(struct morse_cac *cac)
+{
+	unsigned long now = cac_arfs_slot_now();
+	int i = now % CAC_ARFS_WINDOW_SLOTS;
+	unsigned long slot = READ_ONCE(cac->arfs_window.slot[i]);
+
+	/*
+	 * Claim the slot for this slot number. A frame counted by another CPU between the claim
+	 * and the clear may be lost, which is fine for a rate estimate.
+	 */
+	if (slot != now && cmpxchg(&cac->arfs_window.slot[i], slot, now) == slot)
+		atomic_set(&cac->arfs_window.count[i], 0);
+
+	atomic_inc(&cac->arfs_window.count[i]);
+}
+
+/*
+ * Authentication request frames received within the last MORSE_CAC_CHECK_PERIOD_MS. Like the
+ * checking period, the count restarts when the threshold is changed, so one surge is only
+ * acted on again if it carries on.
+ */
+static u32 cac_arfs_rate(struct morse_cac *cac)
+{
+	unsigned long now = cac_arfs_slot_now();
+	unsigned long since = cac_arfs_slot(READ_ONCE(cac->last_change));
+	u32 arfs = 0;
+	int i;
+
+	for (i = 0; i < CAC_ARFS_WINDOW_SLOTS; i++) {
+		unsigned long slot = READ_ONCE(cac->arfs_window.slot[i]);
+
+		if (now - slot < CAC_ARFS_WINDOW_SLOTS && (long)(slot - since) >= 0)
+			arfs += atomic_read(&cac->arfs_window.count[i]);
+	}
+
+	return arfs;
 }
 
 static void cac_threshold_change(struct morse_cac *cac, int diff)
@@ -61,6 +99,8 @@ static void cac_threshold_change(struct morse_cac *cac, int diff)
 		cac->threshold_value = CAC_THRESHOLD_MAX;
 	else
 		cac->threshold_value = threshold_value;
+
+	WRITE_ONCE(cac->last_change, jiffies);
 }
 
 #undef MORSE_CAC_TEST
@@ -72,40 +112,42 @@ static void cac_threshold_change(struct morse_cac *cac, int diff)
 #define CAC_TEST_ARFS_MAX	(20)	/* Max random ARFS value */
 
 /* Set ARFS to a random value */
-void cac_test(struct morse_cac *cac)
+void cac_test(struct morse_cac *cac, u32 *arfs)
 {
 	struct morse *mors = cac->mors;
 	static int cnt;
+	static u32 test_arfs;
 
 	cnt++;
 	if ((cnt % CAC_TEST_PERIOD) == 0) {
 		u16 random;
 
 		get_random_bytes(&random, sizeof(random));
-		cac->arfs = random % CAC_TEST_ARFS_MAX;
-		MORSE_CAC_INFO(mors, "CAC: TEST set ARFS to %u\n", cac->arfs);
+		test_arfs = random % CAC_TEST_ARFS_MAX;
+		MORSE_CAC_INFO(mors, "CAC: TEST set ARFS to %u\n", test_arfs);
 	}
+	*arfs = test_arfs;
 }
 
 #else
-#define cac_test(_cac)
+#define cac_test(_cac, _arfs)
 #endif
 
 /**
  * @brief Adjust the CAC threshold based on frequency of Rx authentication frames
  *
- * If the number of authentication frames received within the checking interval
+ * If the number of authentication frames received within the last second (@arfs)
  * exceeds predefined thresholds, reduce the CAC threshold in order to reduce the
  * number of stations that are allowed to start association.
  *
- * This check is performed many times per second in order to react quickly to a
- * surge in associations (E.g. after an AP or network restart). If the threshold
- * is increased, the checking period is restarted.
+ * This check is performed as authentication frames arrive, as well as many times per
+ * second, in order to react quickly to a surge in associations (E.g. after an AP or
+ * network restart). If the threshold is changed, the checking period is restarted.
  *
  * If the end of the checking period is reached and only a small number of stations
  * have associated, the CAC threshold is increased (relaxed).
  */
-static int cac_set_threshold_change(struct morse_cac *cac, bool end_of_period)
+static int cac_set_threshold_change(struct morse_cac *cac, u32 arfs, bool end_of_period)
 {
 	struct morse *mors = cac->mors;
 	int i;
@@ -118,7 +160,7 @@ static int cac_set_threshold_change(struct morse_cac *cac, bool end_of_period)
 
 		if (rule->threshold_change < 0) {
 			/* Process rule to decrease threshold */
-			if (cac->arfs > rule->arfs) {
+			if (arfs > rule->arfs) {
 				/* Decrease threshold */
 				return rule->threshold_change;
 			}
@@ -130,7 +172,7 @@ static int cac_set_threshold_change(struct morse_cac *cac, bool end_of_period)
 			if (!end_of_period)
 				/* Only increase at the end of a sample period */
 				return 0;
-			if (cac->arfs < rule->arfs) {
+			if (arfs < rule->arfs) {
 				/* Increase threshold */
 				return rule->threshold_change;
 			}
@@ -140,26 +182,20 @@ static int cac_set_threshold_change(struct morse_cac *cac, bool end_of_period)
 	return 0;
 }
 
-static void cac_timer_work(struct morse_cac *cac)
+/* Re-evaluate the threshold against the current rate. Must be called with the lock held. */
+static void cac_check(struct morse_cac *cac, bool end_of_period)
 {
 	struct morse *mors = cac->mors;
 	int threshold_change = 0;
-	bool end_of_period = false;
+	u32 arfs = cac_arfs_rate(cac);
 
-	if (!cac->enabled)
-		return;
-
-	cac_test(cac);
-
-	cac->cac_period_used += MORSE_CAC_CHECK_INTERVAL_MS;
-	if (cac->cac_period_used >= MORSE_CAC_CHECK_PERIOD_MS)
-		end_of_period = true;
+	cac_test(cac, &arfs);
 
 	/* Check if the threshold needs to be tighted or relaxed and set. */
-	if (cac->arfs != 0 || cac->threshold_value != CAC_THRESHOLD_MAX) {
+	if (arfs != 0 || cac->threshold_value != CAC_THRESHOLD_MAX) {
 		MORSE_CAC_DBG(mors, "CAC: Check ARFS=%u threshold=%u end=%u\n",
-			      cac->arfs, cac->threshold_value, end_of_period);
-		threshold_change = cac_set_threshold_change(cac, end_of_period);
+			      arfs, cac->threshold_value, end_of_period);
+		threshold_change = cac_set_threshold_change(cac, arfs, end_of_period);
 		if (threshold_change != 0) {
 			cac_threshold_change(cac, threshold_change);
 			MORSE_CAC_INFO(mors, "CAC: Set threshold %u (period=%u)\n",
@@ -168,10 +204,52 @@ static void cac_timer_work(struct morse_cac *cac)
 		}
 	}
 
-	if (end_of_period) {
+	if (end_of_period)
 		cac->cac_period_used = 0;
-		cac->arfs = 0;
-	}
+}
+
+void morse_cac_count_auth(const struct ieee80211_vif *vif, const struct ieee80211_mgmt *hdr)
+{
+	struct morse_vif *mors_vif = (struct morse_vif *)vif->drv_priv;
+	struct morse_cac *cac = &mors_vif->cac;
+	const u16 auth_transaction = le16_to_cpu(hdr->u.auth.auth_transaction);
+
+	/* Ignore SAE auth that is already in progress */
+	if (auth_transaction != 1)
+		return;
+
+	cac_arfs_add(cac);
+
+	/*
+	 * Tighten the threshold as soon as a surge is seen, so the next beacon carries it, rather
+	 * than at the next check. Changes are still spaced by a check interval so a single surge
+	 * does not close the threshold in one go. If the timer holds the lock it is checking.
+	 */
+	if (time_before(jiffies, READ_ONCE(cac->last_change) +
+			msecs_to_jiffies(MORSE_CAC_CHECK_INTERVAL_MS)))
+		return;
+
+	if (!spin_trylock_bh(&cac->lock))
+		return;
+
+	if (cac->enabled)
+		cac_check(cac, false);
+
+	spin_unlock_bh(&cac->lock);
+}
+
+static void cac_timer_work(struct morse_cac *cac)
+{
+	bool end_of_period = false;
+
+	if (!cac->enabled)
+		return;
+
+	cac->cac_period_used += MORSE_CAC_CHECK_INTERVAL_MS;
+	if (cac->cac_period_used >= MORSE_CAC_CHECK_PERIOD_MS)
+		end_of_period = true;
+
+	cac_check(cac, end_of_period);
 
 	mod_timer(&cac->timer, jiffies + msecs_to_jiffies(MORSE_CAC_CHECK_INTERVAL_MS));
 }
@@ -296,6 +374,9 @@ int morse_cac_init(struct morse *mors, struct morse_vif *mors_vif)
 	timer_setup(&cac->timer, cac_timer, 0);
 #endif
 
+	memset(&cac->arfs_window, 0, sizeof(cac->arfs_window));
+	cac->last_change = jiffies - msecs_to_jiffies(MORSE_CAC_CHECK_INTERVAL_MS);
+	cac->cac_period_used = 0;
 	mod_timer(&cac->timer, jiffies + msecs_to_jiffies(MORSE_CAC_CHECK_INTERVAL_MS));
 	cac->threshold_value = CAC_THRESHOLD_MAX;
 	morse_cac_cfg_threshold_rules_default(mors, mors_vif);
@@ -22,6 +22,9 @@
 
 #define CAC_CFG_CHANGE_RULE_MAX		(8)
 
+/** Slots of the sliding window that authentication request frames per second are counted in */
+#define CAC_ARFS_WINDOW_SLOTS		(10)
+
 struct morse_vif;
 
 enum cac_command {
@@ -79,9 +82,19 @@ struct morse_cac {
 	u16 threshold_value;
 
 	/**
-	 * Authentication request frames received.
+	 * Authentication request frames received over the last second, counted per slot of a
+	 * sliding window. Updated from the RX path without the lock: the first frame in a slot
+	 * claims it for the current slot number and clears its old count.
 	 */
-	u16 arfs;
+	struct {
+		atomic_t count[CAC_ARFS_WINDOW_SLOTS];
+		unsigned long slot[CAC_ARFS_WINDOW_SLOTS];
+	} arfs_window;
+
+	/**
+	 * When the threshold was last changed (jiffies)
+	 */
+	unsigned long last_change;
 };
 
 /** Convert a threshold percentage into a raw value */
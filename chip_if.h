@@ -7,6 +7,8 @@
 #ifndef _MORSE_CHIP_IF_H_
 #define _MORSE_CHIP_IF_H_
 
+#include <linux/hrtimer.h>
+
 #include "pageset.h"
 #include "pager_if_hw.h"
 #include "pager_if_sw.h"
@@ -45,6 +47,24 @@ enum morse_chip_if_event_flags {
 	MORSE_YAPS_STATUS_REG_READ_PEND,
 };
 
+/* Event flags handled by each chip_if worker when chip_if_split_work is enabled */
+#define MORSE_CHIP_IF_RX_EVENTS		(BIT(MORSE_RX_PEND) | BIT(MORSE_YAPS_STATUS_REG_READ_PEND))
+#define MORSE_CHIP_IF_CMD_EVENTS	(BIT(MORSE_TX_COMMAND_PEND) | BIT(MORSE_TX_BEACON_PEND) | \
+					 BIT(MORSE_TX_MGMT_PEND))
+#define MORSE_CHIP_IF_TX_EVENTS		(BIT(MORSE_PAGE_RETURN_PEND) | BIT(MORSE_TX_DATA_PEND) | \
+					 BIT(MORSE_TX_PACKET_FREED_UP_PEND) | \
+					 BIT(MORSE_DATA_TRAFFIC_PAUSE_PEND) | \
+					 BIT(MORSE_DATA_TRAFFIC_RESUME_PEND))
+#define MORSE_CHIP_IF_ALL_EVENTS	(MORSE_CHIP_IF_RX_EVENTS | MORSE_CHIP_IF_CMD_EVENTS | \
+					 MORSE_CHIP_IF_TX_EVENTS)
+
+/* Test and clear an event flag, if it is one of the events being handled */
+static inline bool morse_chip_if_test_and_clear_event(int bit, unsigned long events,
+						      unsigned long *flags)
+{
+	return (events & BIT(bit)) && test_and_clear_bit(bit, flags);
+}
+
 struct chip_if_ops {
 	/**
 	 * Initialises the chip interface
@@ -126,6 +146,13 @@ struct chip_if_ops {
 	 */
 	int (*chip_if_handle_irq)(struct morse *mors, u32 status);
 
+	/**
+	 * Handles pending chip_if events. Called from the chip_if work items.
+	 * @mors: Morse object
+	 * @events: Mask of the events (BIT(enum morse_chip_if_event_flags)) to handle
+	 */
+	void (*chip_if_handle_events)(struct morse *mors, unsigned long events);
+
 	/**
 	 * Counts the total number of TX SKBs across all the queue types
 	 * contained in the chip interface object. It includes the SKBs yet to
@@ -147,6 +174,25 @@ struct chip_if_ops {
 	int (*skbq_get_tx_status_pending_count)(struct morse *mors);
 };
 
+/**
+ * struct morse_irq_coalesce - State for deferring chip_if work wakeups from the IRQ handler
+ *
+ * @mors: Morse chip instance
+ * @timer: Ends the coalescing window
+ * @last_irq: Time of the previous chip_if interrupt, used to detect load
+ * @irqs: Number of interrupts absorbed in the current window
+ * @masked_bits: chip_if interrupt enable bits cleared for the current window
+ * @unmask_pending: The window has ended and @masked_bits must be restored
+ */
+struct morse_irq_coalesce {
+	struct morse *mors;
+	struct hrtimer timer;
+	ktime_t last_irq;
+	atomic_t irqs;
+	u32 masked_bits;
+	bool unmask_pending;
+};
+
 struct morse_chip_if_state {
 	enum morse_chip_if active_chip_if;
 	union {
@@ -169,6 +215,7 @@ struct morse_chip_if_state {
 	/* See enum morse_chip_if_event_flags for values */
 	unsigned long event_flags;
 	bool validate_skb_checksum;
+	struct morse_irq_coalesce irq_coalesce;
 };
 
 struct morse_chip_if_host_table {
@@ -10,6 +10,7 @@
 #include <linux/slab.h>
 #include <linux/atomic.h>
 #include <linux/workqueue.h>
+#include <linux/seq_file.h>
 
 #include "debug.h"
 #include "command.h"
@@ -26,6 +27,7 @@
 #include "ocs.h"
 #include "mbssid.h"
 #include "mesh.h"
+#include "offload.h"
 
 #define MM_BA_TIMEOUT (5000)
 #define MM_MAX_COMMAND_RETRY 2
@@ -49,10 +51,53 @@ enum morse_interface_type {
 	MORSE_INTERFACE_TYPE_MAX = INT_MAX,
 };
 
-struct morse_cmd_resp_cb {
+/** Most commands that may be waiting for a response at once */
+#define MORSE_CMD_MAX_IN_FLIGHT	(16)
+
+/**
+ * struct morse_cmd_req - A command sent to the chip and waiting for its response
+ *
+ * @list: Entry in mors->cmd_inflight, protected by mors->cmd_lock
+ * @skb: The current try on the command queue, NULL between tries
+ * @resp: Where to copy the response, may be NULL
+ * @resp_len: Size of @resp
+ * @timeout_ms: Time to wait for a response to each try
+ * @deadline: When the current try times out (jiffies)
+ * @submit_ns: When the caller submitted the command
+ * @sent_ns: When the command was first queued to the chip, 0 if never
+ * @host_id: Sequence part of the host ID, the try number is added when sending
+ * @retry: Current try number
+ * @ret: Result, once the command has failed outside of cmd_lock
+ * @batched: Part of a morse_cmd_batch, which holds the slot for all its commands
+ * @done: Called once with the result
+ * @ctx: Passed to @done
+ * @func: Caller, for logging
+ * @cmd_len: Length of @cmd
+ * @cmd: Copy of the request
+ */
+struct morse_cmd_req {
+	struct list_head list;
+	struct sk_buff *skb;
+	struct morse_resp *resp;
+	u32 resp_len;
+	u32 timeout_ms;
+	unsigned long deadline;
+	u64 submit_ns;
+	u64 sent_ns;
+	u16 host_id;
+	int retry;
+	int ret;
+	bool batched;
+	morse_cmd_done_t done;
+	void *ctx;
+	const char *func;
+	int cmd_len;
+	struct morse_cmd cmd;
+};
+
+struct morse_cmd_sync {
+	struct completion done;
 	int ret;
-	u32 length;
-	struct morse_resp *dest_resp;
 };
 
 /* Set driver to chip command timeout: max to wait (in ms) before failing the command */
@@ -60,6 +105,16 @@ static u32 default_cmd_timeout_ms __read_mostly = MM_CMD_DEFAULT_TIMEOUT_MS;
 module_param(default_cmd_timeout_ms, uint, 0644);
 MODULE_PARM_DESC(default_cmd_timeout_ms, "Set default command timeout (in ms)");
 
+static uint cmd_ps_hold_ms __read_mostly = 20;
+module_param(cmd_ps_hold_ms, uint, 0644);
+MODULE_PARM_DESC(cmd_ps_hold_ms,
+		 "Keep the chip awake for this long (ms) after a command, so bursts share one wake");
+
+static uint cmd_max_in_flight __read_mostly = 1;
+module_param(cmd_max_in_flight, uint, 0444);
+MODULE_PARM_DESC(cmd_max_in_flight,
+		 "Commands that may wait for a response at once (1 to 16, 1 serialises commands)");
+
 static void morse_cmd_init(struct morse *mors, struct morse_cmd_header *hdr,
 			   enum morse_commands_id cmd, u16 vif_id, u16 len)
 {
@@ -104,110 +159,653 @@ static const char *morse_cmd_standby_exit_reason_to_str(enum morse_standby_mode_
 	}
 }
 
-static int morse_cmd_tx(struct morse *mors, struct morse_resp *resp,
-			struct morse_cmd *cmd, u32 length, u32 timeout, const char *func)
+/* Re-arm the timeout work for the earliest deadline in flight. Call with cmd_lock held. */
+static void morse_cmd_timeout_arm(struct morse *mors)
+{
+	struct morse_cmd_req *req;
+	unsigned long earliest = 0;
+	bool armed = false;
+
+	list_for_each_entry(req, &mors->cmd_inflight, list) {
+		if (!req->skb)
+			continue;
+		if (!armed || time_before(req->deadline, earliest))
+			earliest = req->deadline;
+		armed = true;
+	}
+
+	if (armed)
+		mod_delayed_work(system_wq, &mors->cmd_timeout_work,
+				 time_after(earliest, jiffies) ? earliest - jiffies : 0);
+}
+
+/* Free the current try of @req from the command queue. Call with cmd_lock held. */
+static void morse_cmd_req_drop_skb(struct morse *mors, struct morse_cmd_req *req)
+{
+	struct morse_skbq *cmd_q = morse_chip_if_cmd_tc_q(mors);
+
+	if (!req->skb)
+		return;
+
+	if (cmd_q) {
+		spin_lock_bh(&cmd_q->lock);
+		morse_skbq_skb_finish(cmd_q, req->skb, NULL);
+		spin_unlock_bh(&cmd_q->lock);
+	}
+	req->skb = NULL;
+}
+
+/* Build the skb for the next try of @req. Call with cmd_lock held. */
+static struct sk_buff *morse_cmd_req_build(struct morse *mors, struct morse_skbq *cmd_q,
+					   struct morse_cmd_req *req)
 {
-	int cmd_len;
-	int ret = 0;
-	u16 host_id;
-	int retry = 0;
-	unsigned long wait_ret = 0;
 	struct sk_buff *skb;
-	struct morse_skbq *cmd_q = mors->cfg->ops->skbq_cmd_tc_q(mors);
-	struct morse_cmd_resp_cb *resp_cb;
-	DECLARE_COMPLETION_ONSTACK(cmd_comp);
 
-	BUILD_BUG_ON(sizeof(struct morse_cmd_resp_cb) > IEEE80211_TX_INFO_DRIVER_DATA_SIZE);
+	req->cmd.hdr.host_id = cpu_to_le16(req->host_id | req->retry);
+
+	skb = morse_skbq_alloc_skb(cmd_q, req->cmd_len);
+	if (!skb)
+		return NULL;
+
+	memcpy(skb->data, &req->cmd, req->cmd_len);
+
+	MORSE_DBG(mors, "CMD 0x%04x:%04x\n", le16_to_cpu(req->cmd.hdr.message_id),
+		  le16_to_cpu(req->cmd.hdr.host_id));
+
+	req->deadline = jiffies + msecs_to_jiffies(req->timeout_ms);
+	if (!req->sent_ns)
+		req->sent_ns = ktime_get_ns();
+
+	return skb;
+}
+
+/* Queue the next try of @req to the chip. Call with cmd_lock held. */
+static int morse_cmd_req_send(struct morse *mors, struct morse_cmd_req *req)
+{
+	int ret;
+	struct sk_buff *skb;
+	struct morse_skbq *cmd_q = morse_chip_if_cmd_tc_q(mors);
 
 	if (!cmd_q)
-		/* No control pageset, not supported by FW */
 		return -ENODEV;
 
-	cmd_len = sizeof(*cmd) + le16_to_cpu(cmd->hdr.len);
+	skb = morse_cmd_req_build(mors, cmd_q, req);
+	if (!skb)
+		return -ENOMEM;
+
+	req->skb = skb;
+	ret = morse_skbq_skb_tx(cmd_q, &skb, NULL, MORSE_SKB_CHAN_COMMAND);
+	if (ret) {
+		MORSE_ERR(mors, "morse_skbq_tx fail: %d\n", ret);
+		req->skb = NULL;
+	}
+
+	return ret;
+}
+
+static struct morse_cmd_stat *morse_cmd_stat_find(struct morse_cmd_stats *stats, u16 message_id)
+{
+	int i;
+
+	for (i = 0; i < stats->num; i++)
+		if (stats->ent[i].message_id == message_id)
+			return &stats->ent[i];
+
+	if (stats->num >= ARRAY_SIZE(stats->ent))
+		return NULL;
+
+	stats->ent[stats->num].message_id = message_id;
+	stats->ent[stats->num].min_us = U32_MAX;
+	return &stats->ent[stats->num++];
+}
+
+static void morse_cmd_stats_record(struct morse *mors, const struct morse_cmd_req *req, int ret)
+{
+	struct morse_cmd_stats *stats = mors->debug.cmd_stats;
+	struct morse_cmd_stat *stat;
+	u64 now_ns = ktime_get_ns();
+	u32 lat_us, wait_us;
+
+	if (!stats)
+		return;
+
+	spin_lock_bh(&stats->lock);
+	stat = morse_cmd_stat_find(stats, le16_to_cpu(req->cmd.hdr.message_id));
+	if (!stat) {
+		stats->untracked++;
+		goto exit;
+	}
+
+	stat->count++;
+	stat->retries += req->retry;
+	if (ret == -ETIMEDOUT)
+		stat->timeouts++;
+	else if (ret)
+		stat->errors++;
+
+	/* Commands that never reached the chip have no latency */
+	if (!req->sent_ns)
+		goto exit;
+
+	lat_us = min_t(u64, div_u64(now_ns - req->sent_ns, NSEC_PER_USEC), U32_MAX);
+	wait_us = min_t(u64, div_u64(req->sent_ns - req->submit_ns, NSEC_PER_USEC), U32_MAX);
+
+	stat->min_us = min(stat->min_us, lat_us);
+	stat->max_us = max(stat->max_us, lat_us);
+	stat->total_us += lat_us;
+	stat->wait_total_us += wait_us;
+	stat->wait_max_us = max(stat->wait_max_us, wait_us);
+	stat->hist[morse_hist_bucket(lat_us, MORSE_CMD_STAT_LAT_BUCKETS)]++;
+
+exit:
+	spin_unlock_bh(&stats->lock);
+}
+
+/* Upper bound (us) of the histogram bucket holding the @permille'th sample */
+static u32 morse_cmd_stat_percentile(const struct morse_cmd_stat *stat, unsigned int samples,
+				     unsigned int permille)
+{
+	unsigned int target = DIV_ROUND_UP(samples * permille, 1000);
+	unsigned int seen = 0;
+	int i;
+
+	for (i = 0; i < MORSE_CMD_STAT_LAT_BUCKETS - 1; i++) {
+		seen += stat->hist[i];
+		if (seen >= target)
+			return min_t(u32, 1U << i, stat->max_us);
+	}
+
+	return stat->max_us;
+}
+
+void morse_cmd_stats_reset(struct morse *mors)
+{
+	struct morse_cmd_stats *stats = mors->debug.cmd_stats;
+
+	if (!stats)
+		return;
+
+	spin_lock_bh(&stats->lock);
+	stats->num = 0;
+	stats->untracked = 0;
+	memset(stats->ent, 0, sizeof(stats->ent));
+	spin_unlock_bh(&stats->lock);
+}
+
+int morse_cmd_stats_show(struct morse *mors, struct seq_file *file)
+{
+	struct morse_cmd_stats *snap;
+	unsigned int samples;
+	int i, b;
+
+	if (!mors->debug.cmd_stats)
+		return -ENODEV;
+
+	/* Copy out so the lock is not held while printing */
+	snap = kmalloc(sizeof(*snap), GFP_KERNEL);
+	if (!snap)
+		return -ENOMEM;
+
+	spin_lock_bh(&mors->debug.cmd_stats->lock);
+	memcpy(snap, mors->debug.cmd_stats, sizeof(*snap));
+	spin_unlock_bh(&mors->debug.cmd_stats->lock);
+
+	seq_printf(file, "max in flight: %u\n", cmd_max_in_flight);
+	if (snap->untracked)
+		seq_printf(file, "untracked: %u\n", snap->untracked);
+	seq_puts(file, "id     count  retries timeouts errors   min(us)  avg(us)  p99(us)  max(us) "
+		 "wait_avg(us) wait_max(us)\n");
+
+	for (i = 0; i < snap->num; i++) {
+		const struct morse_cmd_stat *stat = &snap->ent[i];
+
+		samples = 0;
+		for (b = 0; b < MORSE_CMD_STAT_LAT_BUCKETS; b++)
+			samples += stat->hist[b];
+
+		seq_printf(file, "0x%04x %-6u %-7u %-8u %-8u %-8u %-8llu %-8u %-8u %-12llu %u\n",
+			   stat->message_id, stat->count, stat->retries, stat->timeouts,
+			   stat->errors, samples ? stat->min_us : 0,
+			   samples ? div_u64(stat->total_us, samples) : 0,
+			   samples ? morse_cmd_stat_percentile(stat, samples, 990) : 0,
+			   stat->max_us,
+			   samples ? div_u64(stat->wait_total_us, samples) : 0,
+			   stat->wait_max_us);
+	}
+
+	kfree(snap);
+	return 0;
+}
+
+/* Report the result of @req, which is no longer in flight, and free it */
+static void morse_cmd_req_complete(struct morse *mors, struct morse_cmd_req *req, int ret)
+{
+	morse_cmd_stats_record(mors, req, ret);
+
+	if (ret == -ETIMEDOUT)
+		MORSE_ERR(mors, "Command %s %02x:%02x timed out\n",
+			  req->func, le16_to_cpu(req->cmd.hdr.message_id),
+			  le16_to_cpu(req->cmd.hdr.host_id));
+	else if (ret != 0)
+		MORSE_ERR(mors, "Command %s %02x:%02x failed with rc %d (0x%x)\n",
+			  req->func, le16_to_cpu(req->cmd.hdr.message_id),
+			  le16_to_cpu(req->cmd.hdr.host_id), ret, ret);
+
+	morse_ps_enable_hold(mors, cmd_ps_hold_ms);
+	/* A batch holds a single slot, which is released with its last command */
+	if (!req->batched)
+		up(&mors->cmd_slots);
+
+	req->done(mors, req->ctx, ret);
+	kfree(req);
+}
+
+static void morse_cmd_timeout_work(struct work_struct *work)
+{
+	struct morse *mors = container_of(to_delayed_work(work), struct morse, cmd_timeout_work);
+	struct morse_cmd_req *req, *tmp;
+	LIST_HEAD(expired);
+	int ret;
+
+	mutex_lock(&mors->cmd_lock);
+	list_for_each_entry_safe(req, tmp, &mors->cmd_inflight, list) {
+		if (!req->skb || time_before(jiffies, req->deadline))
+			continue;
+
+		MORSE_INFO(mors, "Try:%d Command %04x:%04x timeout after %u ms\n",
+			   req->retry, le16_to_cpu(req->cmd.hdr.message_id),
+			   le16_to_cpu(req->cmd.hdr.host_id), req->timeout_ms);
+		morse_cmd_req_drop_skb(mors, req);
+
+		ret = -ETIMEDOUT;
+		if (++req->retry < MM_MAX_COMMAND_RETRY)
+			ret = morse_cmd_req_send(mors, req);
+		if (ret) {
+			req->ret = ret;
+			list_move_tail(&req->list, &expired);
+		}
+	}
+	morse_cmd_timeout_arm(mors);
+	mutex_unlock(&mors->cmd_lock);
+
+	list_for_each_entry_safe(req, tmp, &expired, list) {
+		list_del(&req->list);
+		morse_cmd_req_complete(mors, req, req->ret);
+	}
+}
+
+static struct morse_cmd_req *morse_cmd_req_alloc(struct morse_resp *resp,
+						 struct morse_cmd *cmd, u32 length, u32 timeout,
+						 morse_cmd_done_t done, void *ctx,
+						 const char *func)
+{
+	int cmd_len = sizeof(*cmd) + le16_to_cpu(cmd->hdr.len);
+	struct morse_cmd_req *req;
+
+	req = kzalloc(sizeof(*req) + cmd_len - sizeof(*cmd), GFP_KERNEL);
+	if (!req)
+		return NULL;
+
 	cmd->hdr.flags = cpu_to_le16(MORSE_CMD_REQ);
+	memcpy(&req->cmd, cmd, cmd_len);
+	req->cmd_len = cmd_len;
+	req->resp = resp;
+	req->resp_len = length;
+	req->timeout_ms = timeout ? timeout : default_cmd_timeout_ms;
+	req->done = done;
+	req->ctx = ctx;
+	req->func = func;
+	req->submit_ns = ktime_get_ns();
 
-	mutex_lock(&mors->cmd_wait);
+	return req;
+}
+
+/* Give @req the next sequence number. Call with cmd_lock held. */
+static void morse_cmd_req_assign_seq(struct morse *mors, struct morse_cmd_req *req,
+				     struct morse_cmd *cmd)
+{
 	mors->cmd_seq++;
 	if (mors->cmd_seq > MORSE_CMD_HOST_ID_SEQ_MAX)
 		mors->cmd_seq = 1;
-	host_id = mors->cmd_seq << MORSE_CMD_HOST_ID_SEQ_SHIFT;
+	req->host_id = mors->cmd_seq << MORSE_CMD_HOST_ID_SEQ_SHIFT;
+	/* The caller's copy carries the host ID that was used, for its own logging */
+	cmd->hdr.host_id = cpu_to_le16(req->host_id);
+}
+
+int morse_cmd_tx_async(struct morse *mors, struct morse_resp *resp, struct morse_cmd *cmd,
+		       u32 length, u32 timeout, morse_cmd_done_t done, void *ctx,
+		       const char *func)
+{
+	int ret;
+	struct morse_cmd_req *req;
+
+	if (!morse_chip_if_cmd_tc_q(mors))
+		/* No control pageset, not supported by FW */
+		return -ENODEV;
+
+	req = morse_cmd_req_alloc(resp, cmd, length, timeout, done, ctx, func);
+	if (!req)
+		return -ENOMEM;
+
+	down(&mors->cmd_slots);
 
 	/* Make sure no one enables PS until the command is responded to or timed out */
 	morse_ps_disable(mors);
 
-	do {
-		cmd->hdr.host_id = cpu_to_le16(host_id | retry);
+	mutex_lock(&mors->cmd_lock);
+	morse_cmd_req_assign_seq(mors, req, cmd);
 
-		skb = morse_skbq_alloc_skb(cmd_q, cmd_len);
-		if (!skb) {
-			ret = -ENOMEM;
-			break;
-		}
+	ret = morse_cmd_req_send(mors, req);
+	if (!ret) {
+		list_add_tail(&req->list, &mors->cmd_inflight);
+		morse_cmd_timeout_arm(mors);
+	}
+	mutex_unlock(&mors->cmd_lock);
 
-		memcpy(skb->data, cmd, cmd_len);
-		resp_cb = (struct morse_cmd_resp_cb *)IEEE80211_SKB_CB(skb)->driver_data;
-		resp_cb->length = length;
-		resp_cb->dest_resp = resp;
+	if (ret) {
+		morse_ps_enable(mors);
+		up(&mors->cmd_slots);
+		MORSE_ERR(mors, "Command %s %02x failed to send with rc %d\n",
+			  func, le16_to_cpu(cmd->hdr.message_id), ret);
+		kfree(req);
+	}
 
-		MORSE_DBG(mors, "CMD 0x%04x:%04x\n", le16_to_cpu(cmd->hdr.message_id),
-			  le16_to_cpu(cmd->hdr.host_id));
+	return ret;
+}
 
-		mutex_lock(&mors->cmd_lock);
-		mors->cmd_comp = &cmd_comp;
-		if (retry > 0)
-			reinit_completion(&cmd_comp);
-		timeout = timeout ? timeout : default_cmd_timeout_ms;
-		ret = morse_skbq_skb_tx(cmd_q, &skb, NULL, MORSE_SKB_CHAN_COMMAND);
-		mutex_unlock(&mors->cmd_lock);
+static void morse_cmd_sync_done(struct morse *mors, void *ctx, int ret)
+{
+	struct morse_cmd_sync *sync = ctx;
 
-		if (ret) {
-			MORSE_ERR(mors, "morse_skbq_tx fail: %d\n", ret);
-			break;
+	sync->ret = ret;
+	complete(&sync->done);
+}
+
+static int morse_cmd_tx(struct morse *mors, struct morse_resp *resp,
+			struct morse_cmd *cmd, u32 length, u32 timeout, const char *func)
+{
+	int ret;
+	struct morse_cmd_sync sync;
+
+	init_completion(&sync.done);
+
+	ret = morse_cmd_tx_async(mors, resp, cmd, length, timeout, morse_cmd_sync_done, &sync,
+				 func);
+	if (ret)
+		return ret;
+
+	/* The timeout work guarantees completion, including after the last retry */
+	wait_for_completion(&sync.done);
+
+	return sync.ret;
+}
+
+void morse_cmd_batch_init(struct morse_cmd_batch *batch)
+{
+	batch->num = 0;
+}
+
+int morse_cmd_batch_add(struct morse_cmd_batch *batch, struct morse_cmd *cmd,
+			struct morse_resp *resp, u32 length)
+{
+	struct morse_cmd_batch_ent *ent;
+
+	if (batch->num >= ARRAY_SIZE(batch->ent))
+		return -ENOSPC;
+
+	ent = &batch->ent[batch->num++];
+	ent->batch = batch;
+	ent->cmd = cmd;
+	ent->resp = resp;
+	ent->resp_len = length;
+	ent->ret = 0;
+
+	return 0;
+}
+
+static void morse_cmd_batch_done(struct morse *mors, void *ctx, int ret)
+{
+	struct morse_cmd_batch_ent *ent = ctx;
+	struct morse_cmd_batch *batch = ent->batch;
+
+	ent->ret = ret;
+	if (atomic_dec_and_test(&batch->remaining)) {
+		up(&mors->cmd_slots);
+		complete(&batch->done);
+	}
+}
+
+int morse_cmd_batch_tx(struct morse *mors, struct morse_cmd_batch *batch, u32 timeout,
+		       const char *func)
+{
+	int i;
+	int ret;
+	struct morse_skbq *cmd_q = morse_chip_if_cmd_tc_q(mors);
+	struct morse_cmd_req *reqs[MORSE_CMD_BATCH_MAX] = { NULL };
+	struct sk_buff *skbs[MORSE_CMD_BATCH_MAX];
+
+	if (!cmd_q)
+		/* No control pageset, not supported by FW */
+		return -ENODEV;
+
+	if (!batch->num)
+		return 0;
+
+	for (i = 0; i < batch->num; i++) {
+		struct morse_cmd_batch_ent *ent = &batch->ent[i];
+
+		reqs[i] = morse_cmd_req_alloc(ent->resp, ent->cmd, ent->resp_len, timeout,
+					      morse_cmd_batch_done, ent, func);
+		if (!reqs[i]) {
+			while (i--)
+				kfree(reqs[i]);
+			return -ENOMEM;
 		}
+		reqs[i]->batched = true;
+	}
 
-		wait_ret = wait_for_completion_timeout(&cmd_comp, msecs_to_jiffies(timeout));
-		mutex_lock(&mors->cmd_lock);
-		mors->cmd_comp = NULL;
+	atomic_set(&batch->remaining, batch->num);
+	init_completion(&batch->done);
 
-		if (!wait_ret) {
-			MORSE_INFO(mors, "Try:%d Command %04x:%04x timeout after %u ms\n",
-				   retry, le16_to_cpu(cmd->hdr.message_id),
-				   le16_to_cpu(cmd->hdr.host_id), timeout);
-			ret = -ETIMEDOUT;
-		} else {
-			ret = (length && resp) ? resp->status : resp_cb->ret;
+	/* The commands go to the chip together, so the batch takes a single slot */
+	down(&mors->cmd_slots);
 
-			MORSE_DBG(mors, "Command 0x%04x:%04x status 0x%08x\n",
-				  le16_to_cpu(cmd->hdr.message_id),
-				  le16_to_cpu(cmd->hdr.host_id), ret);
-			if (ret)
-				MORSE_ERR(mors, "Command 0x%04x:%04x error %d\n",
-					  le16_to_cpu(cmd->hdr.message_id),
-					  le16_to_cpu(cmd->hdr.host_id), ret);
+	for (i = 0; i < batch->num; i++)
+		morse_ps_disable(mors);
+
+	mutex_lock(&mors->cmd_lock);
+	for (i = 0; i < batch->num; i++) {
+		morse_cmd_req_assign_seq(mors, reqs[i], batch->ent[i].cmd);
+		skbs[i] = morse_cmd_req_build(mors, cmd_q, reqs[i]);
+		if (!skbs[i])
+			reqs[i]->ret = -ENOMEM;
+	}
+
+	ret = morse_skbq_cmd_tx_batch(cmd_q, skbs, batch->num);
+	if (ret)
+		MORSE_ERR(mors, "morse_skbq_tx fail: %d\n", ret);
+
+	for (i = 0; i < batch->num; i++) {
+		reqs[i]->skb = skbs[i];
+		if (skbs[i])
+			list_add_tail(&reqs[i]->list, &mors->cmd_inflight);
+		else if (!reqs[i]->ret)
+			reqs[i]->ret = ret;
+	}
+	morse_cmd_timeout_arm(mors);
+	mutex_unlock(&mors->cmd_lock);
+
+	/* Commands that were not queued complete straight away */
+	for (i = 0; i < batch->num; i++)
+		if (!skbs[i])
+			morse_cmd_req_complete(mors, reqs[i], reqs[i]->ret);
+
+	/* The timeout work guarantees completion, including after the last retry */
+	wait_for_completion(&batch->done);
+
+	for (i = 0; i < batch->num; i++)
+		if (batch->ent[i].ret)
+			return batch->ent[i].ret;
+
+	return 0;
+}
+
+/**
+ * struct morse_cmd_restore_ent - A command held back by morse_cmd_restore_begin()
+ *
+ * @list: Entry in mors->cmd_restore.cmds
+ * @key: Key to give the index allocated by the firmware, for key installs
+ * @cmd: The command
+ * @resp: Room for its response
+ */
+struct morse_cmd_restore_ent {
+	struct list_head list;
+	struct ieee80211_key_conf *key;
+	union {
+		struct morse_cmd_sta_state sta_state;
+		struct morse_cmd_install_key install_key;
+	} cmd;
+	union {
+		struct morse_resp_sta_state sta_state;
+		struct morse_resp_install_key install_key;
+	} resp;
+};
+
+static int morse_cmd_restore_defer(struct morse *mors, struct morse_cmd *cmd,
+				   struct ieee80211_key_conf *key)
+{
+	int cmd_len = sizeof(*cmd) + le16_to_cpu(cmd->hdr.len);
+	struct morse_cmd_restore_ent *ent;
+
+	lockdep_assert_held(&mors->lock);
+
+	if (WARN_ON(cmd_len > sizeof(ent->cmd)))
+		return -EINVAL;
+
+	ent = kzalloc(sizeof(*ent), GFP_KERNEL);
+	if (!ent)
+		return -ENOMEM;
+
+	memcpy(&ent->cmd, cmd, cmd_len);
+	ent->key = key;
+	list_add_tail(&ent->list, &mors->cmd_restore.cmds);
+
+	return 0;
+}
+
+void morse_cmd_restore_begin(struct morse *mors)
+{
+	lockdep_assert_held(&mors->lock);
+
+	/* Anything left from a restart that never completed is stale */
+	morse_cmd_restore_discard(mors);
+	mors->cmd_restore.active = true;
+}
+
+int morse_cmd_restore_flush(struct morse *mors)
+{
+	int i;
+	int ret = 0;
+	int failed = 0;
+	int total = 0;
+	struct morse_cmd_batch batch;
+	struct morse_cmd_restore_ent *ents[MORSE_CMD_BATCH_MAX];
+	struct morse_cmd_restore_ent *ent, *tmp;
+	LIST_HEAD(cmds);
+
+	lockdep_assert_held(&mors->lock);
+
+	mors->cmd_restore.active = false;
+	list_splice_init(&mors->cmd_restore.cmds, &cmds);
+
+	while (!list_empty(&cmds)) {
+		int num = 0;
+		int err;
+		bool cmd_failed = false;
+
+		morse_cmd_batch_init(&batch);
+		list_for_each_entry_safe(ent, tmp, &cmds, list) {
+			if (morse_cmd_batch_add(&batch, (struct morse_cmd *)&ent->cmd,
+						(struct morse_resp *)&ent->resp, sizeof(ent->resp)))
+				break;
+			list_del(&ent->list);
+			ents[num++] = ent;
 		}
-		/* Free the command request */
-		spin_lock_bh(&cmd_q->lock);
-		morse_skbq_skb_finish(cmd_q, skb, NULL);
-		spin_unlock_bh(&cmd_q->lock);
-		mutex_unlock(&mors->cmd_lock);
 
-		retry++;
-	} while ((ret == -ETIMEDOUT) && retry < MM_MAX_COMMAND_RETRY);
+		err = morse_cmd_batch_tx(mors, &batch, 0, __func__);
 
-	morse_ps_enable(mors);
-	mutex_unlock(&mors->cmd_wait);
+		/* A batch that fails without any command failing was not sent at all */
+		for (i = 0; i < num; i++)
+			cmd_failed |= !!batch.ent[i].ret;
 
-	if (ret == -ETIMEDOUT)
-		MORSE_ERR(mors, "Command %s %02x:%02x timed out\n",
-			  func, le16_to_cpu(cmd->hdr.message_id), le16_to_cpu(cmd->hdr.host_id));
-	else if (ret != 0)
-		MORSE_ERR(mors, "Command %s %02x:%02x failed with rc %d (0x%x)\n",
-			  func, le16_to_cpu(cmd->hdr.message_id),
-			  le16_to_cpu(cmd->hdr.host_id), ret, ret);
+		for (i = 0; i < num; i++) {
+			int ent_ret = cmd_failed ? batch.ent[i].ret : err;
+
+			ent = ents[i];
+			if (ent_ret) {
+				failed++;
+				if (!ret)
+					ret = ent_ret;
+			} else if (ent->key) {
+				ent->key->hw_key_idx = ent->resp.install_key.key_idx;
+			}
+			kfree(ent);
+		}
+		total += num;
+	}
+
+	if (failed)
+		MORSE_ERR(mors, "%s: %d of %d commands failed (errno:%d)\n",
+			  __func__, failed, total, ret);
+	else
+		MORSE_INFO(mors, "%s: Restored %d station and key commands\n", __func__, total);
 
 	return ret;
 }
 
+void morse_cmd_restore_discard(struct morse *mors)
+{
+	struct morse_cmd_restore_ent *ent, *tmp;
+
+	mors->cmd_restore.active = false;
+	list_for_each_entry_safe(ent, tmp, &mors->cmd_restore.cmds, list) {
+		list_del(&ent->list);
+		kfree(ent);
+	}
+}
+
+void morse_cmd_async_init(struct morse *mors)
+{
+	if (mors->debug.cmd_stats)
+		spin_lock_init(&mors->debug.cmd_stats->lock);
+	INIT_LIST_HEAD(&mors->cmd_inflight);
+	sema_init(&mors->cmd_slots, clamp_t(uint, cmd_max_in_flight, 1, MORSE_CMD_MAX_IN_FLIGHT));
+	INIT_DELAYED_WORK(&mors->cmd_timeout_work, morse_cmd_timeout_work);
+	INIT_LIST_HEAD(&mors->cmd_restore.cmds);
+}
+
+void morse_cmd_async_finish(struct morse *mors)
+{
+	struct morse_cmd_req *req, *tmp;
+	LIST_HEAD(aborted);
+
+	cancel_delayed_work_sync(&mors->cmd_timeout_work);
+	morse_cmd_restore_discard(mors);
+
+	mutex_lock(&mors->cmd_lock);
+	list_for_each_entry_safe(req, tmp, &mors->cmd_inflight, list) {
+		/* The command queue has already been torn down with its skbs */
+		req->skb = NULL;
+		list_move_tail(&req->list, &aborted);
+	}
+	mutex_unlock(&mors->cmd_lock);
+
+	list_for_each_entry_safe(req, tmp, &aborted, list) {
+		list_del(&req->list);
+		morse_cmd_req_complete(mors, req, -ENODEV);
+	}
+}
+
 static int morse_cmd_ocs_req(struct morse_vif *mors_vif, struct morse_resp_ocs *resp,
 			     struct morse_drv_cmd_ocs *drv_cmd)
 {
@@ -265,7 +863,7 @@ static int morse_cmd_coredump(struct morse *mors)
 
 	mors->user_coredump_comp = &user_coredump_comp;
 	set_bit(MORSE_STATE_FLAG_DO_COREDUMP, &mors->state_flags);
-	schedule_work(&mors->driver_restart);
+	queue_work(system_long_wq, &mors->driver_restart);
 
 	mutex_unlock(&mors->lock);
 	rem = wait_for_completion_timeout(&user_coredump_comp, msecs_to_jiffies(timeout_ms));
@@ -578,6 +1176,11 @@ static int morse_cmd_drv(struct morse *mors, struct ieee80211_vif *vif,
 		resp->hdr.len = 4;
 		resp->status = ret;
 		break;
+	case MORSE_COMMAND_SET_KEEP_ALIVE:
+		ret = morse_offload_keep_alive_config(mors_vif, (struct morse_cmd_keep_alive *)cmd);
+		resp->hdr.len = 4;
+		resp->status = ret;
+		break;
 	default:
 		ret = -EINVAL;
 	}
@@ -586,85 +1189,90 @@ static int morse_cmd_drv(struct morse *mors, struct ieee80211_vif *vif,
 
 int morse_cmd_resp_process(struct morse *mors, struct sk_buff *skb)
 {
-	int length, ret = -ESRCH;	/* No such process */
-	struct morse_skbq *cmd_q = mors->cfg->ops->skbq_cmd_tc_q(mors);
+	int length, ret;
 	struct morse_resp *src_resp = (struct morse_resp *)(skb->data);
-	struct sk_buff *cmd_skb = NULL;
-	struct morse_cmd_resp_cb *resp_cb;
-	struct morse_resp *dest_resp;
-	struct morse_cmd *cmd;
-	u16 message_id = 0;
-	u16 host_id = 0;
+	struct morse_cmd_req *req = NULL;
+	struct morse_cmd_req *iter;
 	u16 resp_message_id = le16_to_cpu(src_resp->hdr.message_id);
 	u16 resp_host_id = le16_to_cpu(src_resp->hdr.host_id);
-	bool is_late_response = false;
 
 	MORSE_DBG(mors, "EVT 0x%04x:0x%04x\n", resp_message_id, resp_host_id);
 
 	if (!MORSE_CMD_IS_CFM(src_resp)) {
-		ret = morse_mac_event_recv(mors, skb);
-		goto exit_free;
+		morse_mac_event_recv(mors, skb);
+		return 0;
 	}
 
 	mutex_lock(&mors->cmd_lock);
 
-	cmd_skb = morse_skbq_tx_pending(cmd_q);
-	if (cmd_skb) {
-		morse_skb_remove_hdr_after_sent_to_chip(cmd_skb);
-		cmd = (struct morse_cmd *)cmd_skb->data;
-		message_id = le16_to_cpu(cmd->hdr.message_id);
-		host_id = le16_to_cpu(cmd->hdr.host_id);
-	}
-
 	/*
-	 * If there is no pending command or the sequence ID does not match, this is a late response
-	 * for a timed out command which has been cleaned up, so just free up the response.
+	 * Match the response to a command in flight by message and sequence ID. No match is a late
+	 * response for a timed out command which has been cleaned up, so just free up the response.
 	 * If a command was retried, the response may be from the retry or from the original
 	 * command (late response) but not from both because the firmware will silently drop
 	 * a retry if it received the initial request. So a mismatched retry counter is treated
 	 * as a matched command and response.
 	 */
-	if (!cmd_skb || message_id != resp_message_id ||
-	    (host_id & MORSE_CMD_HOST_ID_SEQ_MASK) != (resp_host_id & MORSE_CMD_HOST_ID_SEQ_MASK)) {
-		MORSE_ERR(mors,
-			  "Late response for timed out cmd 0x%04x:%04x have 0x%04x:%04x 0x%04x\n",
-			  resp_message_id, resp_host_id, message_id, host_id, mors->cmd_seq);
-		is_late_response = true;
-		goto exit;
+	list_for_each_entry(iter, &mors->cmd_inflight, list) {
+		if (le16_to_cpu(iter->cmd.hdr.message_id) == resp_message_id &&
+		    iter->host_id == (resp_host_id & MORSE_CMD_HOST_ID_SEQ_MASK)) {
+			req = iter;
+			break;
+		}
+	}
+
+	if (!req) {
+		MORSE_ERR(mors, "Late response for timed out cmd 0x%04x:%04x seq 0x%04x\n",
+			  resp_message_id, resp_host_id, mors->cmd_seq);
+		mutex_unlock(&mors->cmd_lock);
+		goto exit_free;
 	}
-	if ((host_id & MORSE_CMD_HOST_ID_RETRY_MASK) !=
-	    (resp_host_id & MORSE_CMD_HOST_ID_RETRY_MASK))
+
+	if (req->retry != (resp_host_id & MORSE_CMD_HOST_ID_RETRY_MASK))
 		MORSE_INFO(mors, "Command retry mismatch 0x%04x:%04x 0x%04x:%04x\n",
-			   message_id, host_id, resp_message_id, resp_host_id);
+			   resp_message_id, req->host_id | req->retry, resp_message_id,
+			   resp_host_id);
 
-	resp_cb = (struct morse_cmd_resp_cb *)IEEE80211_SKB_CB(cmd_skb)->driver_data;
-	length = resp_cb->length;
-	dest_resp = resp_cb->dest_resp;
-	if (length >= sizeof(struct morse_resp) && dest_resp) {
-		ret = 0;
+	length = req->resp_len;
+	if (length >= sizeof(struct morse_resp) && req->resp) {
 		length = min_t(int, length, le16_to_cpu(src_resp->hdr.len) +
 			       sizeof(struct morse_cmd_header));
-		memcpy(dest_resp, src_resp, length);
+		memcpy(req->resp, src_resp, length);
+		ret = le32_to_cpu(req->resp->status);
 	} else {
 		ret = le32_to_cpu(src_resp->status);
 	}
 
-	resp_cb->ret = ret;
-
-exit:
-	if (cmd_skb && !is_late_response) {
-		/* Complete if not already timed out */
-		if (mors->cmd_comp)
-			complete(mors->cmd_comp);
-	}
+	MORSE_DBG(mors, "Command 0x%04x:%04x status 0x%08x\n", resp_message_id, resp_host_id, ret);
 
+	list_del(&req->list);
+	morse_cmd_req_drop_skb(mors, req);
+	morse_cmd_timeout_arm(mors);
 	mutex_unlock(&mors->cmd_lock);
+
+	morse_cmd_req_complete(mors, req, ret);
+
 exit_free:
-	dev_kfree_skb(skb);
+	morse_skb_cache_free(mors, skb);
 
 	return 0;
 }
 
+static void morse_cmd_set_channel_init(struct morse *mors, struct morse_cmd_set_channel *cmd,
+				       u32 op_chan_freq_hz, u8 pri_1mhz_chan_idx, u8 op_bw_mhz,
+				       u8 pri_bw_mhz)
+{
+	morse_cmd_init(mors, &cmd->hdr, MORSE_COMMAND_SET_CHANNEL, 0, sizeof(*cmd));
+
+	/* May be 0xFFFF/0xFFFFFFFF to indicate no change */
+	cmd->op_chan_freq_hz = cpu_to_le32(op_chan_freq_hz);
+	cmd->op_bw_mhz = op_bw_mhz;
+	cmd->pri_bw_mhz = pri_bw_mhz;
+	cmd->pri_1mhz_chan_idx = pri_1mhz_chan_idx;
+	/* TODO: add other modes as necessary */
+	cmd->dot11_mode = DOT11AH_MODE;
+}
+
 int morse_cmd_set_channel(struct morse *mors, u32 op_chan_freq_hz,
 			  u8 pri_1mhz_chan_idx, u8 op_bw_mhz, u8 pri_bw_mhz, s32 *power_mbm)
 {
@@ -672,15 +1280,8 @@ int morse_cmd_set_channel(struct morse *mors, u32 op_chan_freq_hz,
 	struct morse_cmd_set_channel cmd;
 	struct morse_resp_set_channel resp;
 
-	morse_cmd_init(mors, &cmd.hdr, MORSE_COMMAND_SET_CHANNEL, 0, sizeof(cmd));
-
-	/* May be 0xFFFF/0xFFFFFFFF to indicate no change */
-	cmd.op_chan_freq_hz = cpu_to_le32(op_chan_freq_hz);
-	cmd.op_bw_mhz = op_bw_mhz;
-	cmd.pri_bw_mhz = pri_bw_mhz;
-	cmd.pri_1mhz_chan_idx = pri_1mhz_chan_idx;
-	/* TODO: add other modes as necessary */
-	cmd.dot11_mode = DOT11AH_MODE;
+	morse_cmd_set_channel_init(mors, &cmd, op_chan_freq_hz, pri_1mhz_chan_idx, op_bw_mhz,
+				   pri_bw_mhz);
 
 	ret = morse_cmd_tx(mors, (struct morse_resp *)&resp,
 			   (struct morse_cmd *)&cmd, sizeof(resp), 0, __func__);
@@ -894,6 +1495,9 @@ int morse_cmd_sta_state(struct morse *mors, struct morse_vif *mors_vif,
 	if (mors_vif->enable_pv1 && mors_sta->pv1_frame_support)
 		cmd.flags = MORSE_STA_FLAG_S1G_PV1;
 
+	if (mors->cmd_restore.active)
+		return morse_cmd_restore_defer(mors, (struct morse_cmd *)&cmd, NULL);
+
 	ret = morse_cmd_tx(mors, (struct morse_resp *)&resp,
 			   (struct morse_cmd *)&cmd, sizeof(resp), 0, __func__);
 
@@ -954,6 +1558,9 @@ int morse_cmd_install_key(struct morse *mors, struct morse_vif *mors_vif,
 	cmd.key_idx = key->keyidx;
 	memcpy(&cmd.key[0], &key->key[0], sizeof(cmd.key));
 
+	if (mors->cmd_restore.active)
+		return morse_cmd_restore_defer(mors, (struct morse_cmd *)&cmd, key);
+
 	ret = morse_cmd_tx(mors, (struct morse_resp *)&resp,
 			   (struct morse_cmd *)&cmd, sizeof(resp), 0, __func__);
 
@@ -1035,6 +1642,47 @@ int morse_cmd_cfg_scan(struct morse *mors, bool enabled)
 	return ret;
 }
 
+int morse_cmd_set_channel_no_cal(struct morse *mors, u32 op_chan_freq_hz,
+				 u8 pri_1mhz_chan_idx, u8 op_bw_mhz, u8 pri_bw_mhz,
+				 s32 *power_mbm)
+{
+	int ret;
+	struct morse_cmd_cfg_scan scan_on;
+	struct morse_cmd_cfg_scan scan_off;
+	struct morse_cmd_set_channel cmd;
+	struct morse_resp_set_channel resp;
+	struct morse_cmd_batch batch;
+
+	morse_cmd_init(mors, &scan_on.hdr, MORSE_COMMAND_CFG_SCAN, 0, sizeof(scan_on));
+	scan_on.enabled = true;
+	morse_cmd_init(mors, &scan_off.hdr, MORSE_COMMAND_CFG_SCAN, 0, sizeof(scan_off));
+	scan_off.enabled = false;
+	morse_cmd_set_channel_init(mors, &cmd, op_chan_freq_hz, pri_1mhz_chan_idx, op_bw_mhz,
+				   pri_bw_mhz);
+
+	/* The firmware runs the commands of a batch in order */
+	morse_cmd_batch_init(&batch);
+	morse_cmd_batch_add(&batch, (struct morse_cmd *)&scan_on, NULL, 0);
+	morse_cmd_batch_add(&batch, (struct morse_cmd *)&cmd, (struct morse_resp *)&resp,
+			    sizeof(resp));
+	morse_cmd_batch_add(&batch, (struct morse_cmd *)&scan_off, NULL, 0);
+
+	ret = morse_cmd_batch_tx(mors, &batch, 0, __func__);
+	if (ret && !batch.ent[0].ret && !batch.ent[1].ret && !batch.ent[2].ret)
+		/* The batch was never sent */
+		return ret;
+
+	if (batch.ent[1].ret)
+		return batch.ent[1].ret;
+
+	*power_mbm = QDBM_TO_MBM(le32_to_cpu(resp.power_qdbm));
+
+	if (ret)
+		MORSE_ERR(mors, "%s: scan configuration failed %d\n", __func__, ret);
+
+	return 0;
+}
+
 int morse_cmd_get_channel_usage(struct morse *mors, struct morse_survey_rx_usage_record *record)
 {
 	int ret;
@@ -1096,6 +1744,8 @@ int morse_cmd_cfg_multicast_filter(struct morse *mors, struct morse_vif *mors_vi
 	int ret = 0;
 
 	cmd = kmalloc(alloc_len, GFP_KERNEL);
+	if (!cmd)
+		return -ENOMEM;
 
 	morse_cmd_init(mors, &cmd->hdr, MORSE_COMMAND_MCAST_FILTER, mors_vif->id, alloc_len);
 
@@ -1244,17 +1894,20 @@ static int morse_cmd_vendor_standby(struct morse *mors,
 		struct morse_cmd_standby_mode_exit *exit = &standby_mode_resp->info;
 		bool valid_response = (standby_mode_resp->hdr.len ==
 				(sizeof(*standby_mode_resp) - sizeof(standby_mode_resp->hdr)));
-		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
+		struct ieee80211_vif *vif;
 
 		if (valid_response)
 			MORSE_ERR(mors, "%s: Standby exited - reason: '%s', STA state %d\n",
 				__func__, morse_cmd_standby_exit_reason_to_str(exit->reason),
 				exit->sta_state);
 
+		rcu_read_lock();
+		vif = morse_get_vif_from_vif_id(mors, vif_id);
 		if (vif && vif->type == NL80211_IFTYPE_STATION &&
 		    morse_mac_is_sta_vif_associated(vif) &&
 		    valid_response && exit->sta_state < IEEE80211_STA_ASSOC)
 			ieee80211_connection_loss(vif);
+		rcu_read_unlock();
 	}
 
 exit:
@@ -8,6 +8,7 @@
  *
  */
 #include <linux/skbuff.h>
+#include <linux/completion.h>
 #include <linux/workqueue.h>
 #include "morse.h"
 
@@ -159,6 +160,7 @@ enum morse_commands_id {
 	MORSE_COMMAND_MBCA_SET_CONF = 0xA019,
 	MORSE_COMMAND_DYNAMIC_PEERING_SET_CONF = 0xA020,
 	MORSE_COMMAND_CONFIG_RAW = 0xA021,
+	MORSE_COMMAND_SET_KEEP_ALIVE = 0xA022,
 	MORSE_COMMAND_DRIVER_END,
 
 	/* Event notifications start at 0x4000 */
@@ -644,6 +646,7 @@ enum morse_cmd_raw_tlv_tag {
 	MORSE_RAW_CMD_TAG_START_TIME = 2,
 	MORSE_RAW_CMD_TAG_PRAW = 3,
 	MORSE_RAW_CMD_TAG_BCN_SPREAD = 4,
+	MORSE_RAW_CMD_TAG_ADAPTIVE = 5,
 };
 
 /* slot definition is required for new raw configs */
@@ -687,6 +690,15 @@ struct morse_cmd_raw_tlv_bcn_spread {
 	u16 nominal_sta_per_bcn;
 } __packed;
 
+/* Resize the slots of the RAW every beacon from station activity, within these bounds */
+struct morse_cmd_raw_tlv_adaptive {
+	u8 tag;
+	u8 min_slots;
+	u8 max_slots;
+	u32 min_slot_duration_us;
+	u32 max_slot_duration_us;
+} __packed;
+
 union morse_cmd_raw_tlvs {
 	u8 tag;
 	struct morse_cmd_raw_tlv_slot_def slot_def;
@@ -694,6 +706,7 @@ union morse_cmd_raw_tlvs {
 	struct morse_cmd_raw_tlv_start_time start_time;
 	struct morse_cmd_raw_tlv_praw praw;
 	struct morse_cmd_raw_tlv_bcn_spread bcn_spread;
+	struct morse_cmd_raw_tlv_adaptive adaptive;
 } __packed;
 
 /**
@@ -802,6 +815,17 @@ struct morse_cmd_arp_offload {
 	u32 ip_table[IEEE80211_BSS_ARP_ADDR_LIST_LEN];
 } __packed;
 
+/** Maximum length of a keep-alive frame, including the Ethernet header */
+#define MORSE_KEEP_ALIVE_FRAME_LEN_MAX		(256)
+
+struct morse_cmd_keep_alive {
+	struct morse_cmd_header hdr;
+	/** Seconds between keep-alives, 0 to stop sending them */
+	__le32 interval_s;
+	/** Ethernet frame to send. The source address is replaced with the interface address */
+	u8 frame[];
+} __packed;
+
 struct morse_cmd_set_long_sleep_config {
 	struct morse_cmd_header hdr;
 	u8 enabled;
@@ -1464,6 +1488,175 @@ struct morse_cmd_get_connection_state_cfm {
 	__le32 connected_time_s;
 } __packed;
 
+/**
+ * typedef morse_cmd_done_t - Called when an asynchronous command completes
+ *
+ * @mors: Morse chip struct
+ * @ctx: Context given to morse_cmd_tx_async()
+ * @ret: 0 or the command status on a response, otherwise a negative error such as -ETIMEDOUT
+ *
+ * Called from process context, either the response path or the command timeout work.
+ */
+typedef void (*morse_cmd_done_t)(struct morse *mors, void *ctx, int ret);
+
+/**
+ * morse_cmd_tx_async() - Send a command without waiting for its response
+ *
+ * @mors: Morse chip struct
+ * @resp: Where to copy the response, may be NULL. Must stay valid until @done is called.
+ * @cmd: Command to send, copied before returning
+ * @length: Size of @resp
+ * @timeout: Time to wait for a response to each try (ms), 0 for the default
+ * @done: Called once with the result, only if this returns 0
+ * @ctx: Passed to @done
+ * @func: Caller, for logging
+ *
+ * Sleeps while cmd_max_in_flight commands are already waiting for a response.
+ *
+ * Return: 0 if the command was queued, otherwise a negative error
+ */
+int morse_cmd_tx_async(struct morse *mors, struct morse_resp *resp, struct morse_cmd *cmd,
+		       u32 length, u32 timeout, morse_cmd_done_t done, void *ctx,
+		       const char *func);
+
+/** Most commands in one morse_cmd_batch */
+#define MORSE_CMD_BATCH_MAX	(8)
+
+struct morse_cmd_batch;
+
+/**
+ * struct morse_cmd_batch_ent - One command in a morse_cmd_batch
+ *
+ * @batch: The batch this belongs to
+ * @cmd: Command to send
+ * @resp: Where to copy the response, may be NULL
+ * @resp_len: Size of @resp
+ * @ret: Result of the command, once the batch has been sent
+ */
+struct morse_cmd_batch_ent {
+	struct morse_cmd_batch *batch;
+	struct morse_cmd *cmd;
+	struct morse_resp *resp;
+	u32 resp_len;
+	int ret;
+};
+
+/**
+ * struct morse_cmd_batch - Commands queued to the chip together
+ *
+ * The commands are queued in order and the chip interface is kicked once, so they are sent
+ * to the chip in one pass over the bus rather than one transfer and response at a time.
+ *
+ * @num: Number of commands added
+ * @remaining: Commands not yet complete
+ * @done: Completed once all the commands are
+ * @ent: The commands
+ */
+struct morse_cmd_batch {
+	int num;
+	atomic_t remaining;
+	struct completion done;
+	struct morse_cmd_batch_ent ent[MORSE_CMD_BATCH_MAX];
+};
+
+/**
+ * morse_cmd_batch_init() - Start an empty batch
+ *
+ * @batch: Batch to initialise
+ */
+void morse_cmd_batch_init(struct morse_cmd_batch *batch);
+
+/**
+ * morse_cmd_batch_add() - Add a command to a batch
+ *
+ * @batch: Batch to add to
+ * @cmd: Command to add. Must stay valid until morse_cmd_batch_tx() returns.
+ * @resp: Where to copy the response, may be NULL
+ * @length: Size of @resp
+ *
+ * Return: 0 on success, -ENOSPC if the batch is full
+ */
+int morse_cmd_batch_add(struct morse_cmd_batch *batch, struct morse_cmd *cmd,
+			struct morse_resp *resp, u32 length);
+
+/**
+ * morse_cmd_batch_tx() - Send a batch of commands and wait for all their responses
+ *
+ * @mors: Morse chip struct
+ * @batch: Commands to send. The result of each is left in its entry.
+ * @timeout: Time to wait for a response to each try (ms), 0 for the default
+ * @func: Caller, for logging
+ *
+ * The batch counts as one command towards cmd_max_in_flight.
+ *
+ * Return: 0 if every command succeeded, otherwise the result of the first one that failed
+ */
+int morse_cmd_batch_tx(struct morse *mors, struct morse_cmd_batch *batch, u32 timeout,
+		       const char *func);
+
+/**
+ * morse_cmd_restore_begin() - Hold back station and key commands for bulk replay
+ *
+ * @mors: Morse chip struct
+ *
+ * Used while mac80211 reconfigures the chip after a firmware restart. Station state and key
+ * install commands are recorded and reported as successful instead of being sent one at a
+ * time, until morse_cmd_restore_flush() is called. Must be called with mors->lock held.
+ */
+void morse_cmd_restore_begin(struct morse *mors);
+
+/**
+ * morse_cmd_restore_flush() - Send the commands held back since morse_cmd_restore_begin()
+ *
+ * @mors: Morse chip struct
+ *
+ * The commands are sent in their original order, MORSE_CMD_BATCH_MAX at a time. Must be
+ * called with mors->lock held.
+ *
+ * Return: 0 if every command succeeded, otherwise the result of the first one that failed
+ */
+int morse_cmd_restore_flush(struct morse *mors);
+
+/**
+ * morse_cmd_restore_discard() - Drop the commands held back since morse_cmd_restore_begin()
+ *
+ * @mors: Morse chip struct
+ */
+void morse_cmd_restore_discard(struct morse *mors);
+
+/**
+ * morse_cmd_stats_show() - Print the per message ID command statistics
+ *
+ * @mors: Morse chip struct
+ * @file: File to print to
+ *
+ * Return: 0 on success, otherwise a negative error
+ */
+int morse_cmd_stats_show(struct morse *mors, struct seq_file *file);
+
+/**
+ * morse_cmd_stats_reset() - Clear the per message ID command statistics
+ *
+ * @mors: Morse chip struct
+ */
+void morse_cmd_stats_reset(struct morse *mors);
+
+/**
+ * morse_cmd_async_init() - Initialise tracking of commands in flight
+ *
+ * @mors: Morse chip struct
+ */
+void morse_cmd_async_init(struct morse *mors);
+
+/**
+ * morse_cmd_async_finish() - Fail all commands still in flight with -ENODEV
+ *
+ * @mors: Morse chip struct
+ *
+ * Call after the command queue has been torn down.
+ */
+void morse_cmd_async_finish(struct morse *mors);
+
 int morse_cmd_set_duty_cycle(struct morse *mors, enum duty_cycle_mode mode,
 			     int duty_cycle, bool omit_ctrl_resp);
 int morse_cmd_set_mpsw(struct morse *mors, int min, int max, int window);
@@ -1487,6 +1680,25 @@ int morse_cmd_get_current_channel(struct morse *mors, u32 *op_chan_freq_hz,
 				  u8 *pri_1mhz_chan_idx, u8 *op_bw_mhz, u8 *pri_bw_mhz);
 int morse_cmd_get_version(struct morse *mors);
 int morse_cmd_cfg_scan(struct morse *mors, bool enabled);
+
+/**
+ * morse_cmd_set_channel_no_cal() - Change channel with the PHY calibration deferred
+ *
+ * @mors: Morse chip struct
+ * @op_chan_freq_hz: Operating channel frequency (Hz)
+ * @pri_1mhz_chan_idx: Primary 1MHz channel index
+ * @op_bw_mhz: Operating bandwidth (MHz)
+ * @pri_bw_mhz: Primary channel bandwidth (MHz)
+ * @power_mbm: Set to the TX power on the new channel
+ *
+ * Sends the set channel command between enabling and disabling the scan configuration, which
+ * skips the PHY calibration, as one batch so the switch costs a single bus round trip.
+ *
+ * Return: 0 on success, otherwise the error of the set channel command or of the batch
+ */
+int morse_cmd_set_channel_no_cal(struct morse *mors, u32 op_chan_freq_hz,
+				 u8 pri_1mhz_chan_idx, u8 op_bw_mhz, u8 pri_bw_mhz,
+				 s32 *power_mbm);
 int morse_cmd_get_channel_usage(struct morse *mors, struct morse_survey_rx_usage_record *record);
 
 int morse_cmd_sta_state(struct morse *mors, struct morse_vif *mors_vif,
@@ -40,6 +40,16 @@
 	(sizeof(*(p)) + (sizeof(*(p)->member) * count))
 #endif
 
+#if KERNEL_VERSION(5, 0, 0) <= LINUX_VERSION_CODE
+#include <linux/indirect_call_wrapper.h>
+#endif
+
+#if !defined(INDIRECT_CALL_2)
+/* Older kernels have no indirect call wrappers, fall back to calling through the pointer */
+#define INDIRECT_CALL_1(f, f1, ...)	f(__VA_ARGS__)
+#define INDIRECT_CALL_2(f, f2, f1, ...)	f(__VA_ARGS__)
+#endif
+
 #if !defined(EM_RISCV)
 #define EM_RISCV 243
 #endif
@@ -9,8 +9,11 @@
 #include <linux/atomic.h>
 #include <linux/workqueue.h>
 #include <linux/utsname.h>
+#include <linux/delay.h>
 #include <linux/devcoredump.h>
 #include <linux/elf.h>
+#include <linux/mm.h>
+#include <linux/sizes.h>
 
 #include "morse.h"
 #include "debug.h"
@@ -23,6 +26,11 @@
 #define MORSE_CHIP_HALT_IRQ_BIT           BIT(30)
 #define MORSE_CHIP_HALT_DELAY_MS          10
 
+/* Size of the bounce buffer chip memory is read through. Regions are read in bulk transfers
+ * of this size rather than with one intermediate buffer the size of the whole region.
+ */
+#define MORSE_COREDUMP_READ_CHUNK         SZ_64K
+
 #define MORSE_COREDUMP_DBG(_m, _f, _a...)   morse_dbg(FEATURE_ID_COREDUMP, _m, _f, ##_a)
 #define MORSE_COREDUMP_INFO(_m, _f, _a...)  morse_info(FEATURE_ID_COREDUMP, _m, _f, ##_a)
 #define MORSE_COREDUMP_WARN(_m, _f, _a...)  morse_warn(FEATURE_ID_COREDUMP, _m, _f, ##_a)
@@ -51,6 +59,34 @@ static unsigned long coredump_include __read_mostly = BIT(COREDUMP_OPTIONAL_FLAG
 module_param(coredump_include, ulong, 0644);
 MODULE_PARM_DESC(coredump_include, "Bitfield describing optional data to include in the coredump");
 
+/* Collect the coredump into page-sized pieces and hand it to devcoredump with a read callback,
+ * rather than staging the whole ELF in one virtually contiguous buffer. Only applicable to
+ * coredumps generated with COREDUMP_METHOD_BUS.
+ */
+static bool coredump_stream __read_mostly = true;
+module_param(coredump_stream, bool, 0644);
+MODULE_PARM_DESC(coredump_stream, "Stream the coredump to devcoredump instead of building it in one buffer");
+
+/* Drop all-zero pages of streamed memory regions from the coredump file. The regions are then
+ * described by several PT_LOAD program headers, with the zero runs covered by p_memsz exceeding
+ * p_filesz as the ELF format allows.
+ */
+static bool coredump_elide_zero __read_mostly;
+module_param(coredump_elide_zero, bool, 0644);
+MODULE_PARM_DESC(coredump_elide_zero, "Omit zero-filled pages of chip memory from streamed coredumps");
+
+/* Chip memory is read in transfers of this size, with the bus released and the CPU yielded
+ * between them, so a dump does not hog the bus host or a CPU for its whole duration.
+ */
+static uint coredump_chunk_kib __read_mostly = MORSE_COREDUMP_READ_CHUNK / SZ_1K;
+module_param(coredump_chunk_kib, uint, 0644);
+MODULE_PARM_DESC(coredump_chunk_kib, "Size (KiB) of each chip memory read of a coredump (max 64)");
+
+static uint coredump_yield_us __read_mostly = 200;
+module_param(coredump_yield_us, uint, 0644);
+MODULE_PARM_DESC(coredump_yield_us,
+		 "Time (us) to sleep between coredump chip memory reads (0 = only reschedule)");
+
 struct morse_elf_note {
 	struct list_head list;
 	enum morse_coredump_note_type type;
@@ -60,12 +96,47 @@ struct morse_elf_note {
 	u8 variable[];
 };
 
+/* A contiguous part of a streamed coredump file, backed by individually allocated pages */
+struct morse_coredump_seg {
+	/* offset of the segment within the file */
+	size_t offset;
+	/* length of the segment */
+	size_t len;
+	/* DIV_ROUND_UP(len, PAGE_SIZE) zeroed pages holding the segment contents. A page elided
+	 * for being all zero is NULL until the segment is packed.
+	 */
+	struct page **pages;
+};
+
+/* A coredump file handed to devcoredump as a list of segments in file order */
+struct morse_coredump_stream {
+	size_t num_segs;
+	struct morse_coredump_seg segs[];
+};
+
+/* Let the rest of the system run between chip memory reads */
+static void coredump_yield(struct morse *mors)
+{
+	const uint yield_us = coredump_yield_us;
+
+	morse_release_bus(mors);
+	if (yield_us)
+		usleep_range(yield_us, yield_us * 2);
+	else
+		cond_resched();
+	morse_claim_bus(mors);
+}
+
 static int read_memory_region(struct morse *mors,
 						const struct morse_coredump_mem_region *region,
-						void *copy_to)
+						u8 *bounce,
+						void (*copy)(void *dst, size_t pos, const void *src, size_t len),
+						void *dst)
 {
 	int ret;
-	void *buffer;
+	u32 pos;
+	u32 chunk;
+	u32 max_chunk;
 
 	if (WARN_ON(ROUND_BYTES_TO_WORD(region->len) > INT_MAX)) {
 		MORSE_COREDUMP_ERR(mors, "%s: invalid length for region 0x%08x:%u",
@@ -73,34 +144,222 @@ static int read_memory_region(struct morse *mors,
 		return -EINVAL;
 	}
 
-	buffer = kzalloc(ROUND_BYTES_TO_WORD(region->len), GFP_KERNEL);
-	if (!buffer) {
-		MORSE_COREDUMP_ERR(mors, "%s: failed to alloc buffer for 0x%08x:%u",
-						   __func__,
-						   region->start,
-						   region->len);
-		return -ENOMEM;
-	}
+	max_chunk = clamp_t(u32, coredump_chunk_kib * SZ_1K, sizeof(u32),
+			    MORSE_COREDUMP_READ_CHUNK);
 
-	/* Note: Data must be copied to an intermediate buffer as BUS transactions
+	/* Note: Data must be copied through an intermediate buffer as BUS transactions
 	 *       cannot write directly into virtual memory.
 	 */
-	if (region->len == sizeof(u32))
-		ret = morse_reg32_read(mors, region->start, buffer);
-	else
-		ret = morse_dm_read(mors, region->start, buffer,
-				    (int)ROUND_BYTES_TO_WORD(region->len));
+	for (pos = 0; pos < region->len; pos += chunk) {
+		/* An aborted dump keeps its metadata, the remaining regions are left empty */
+		if (READ_ONCE(mors->coredump.abort))
+			return -ECANCELED;
 
-	if (!ret)
-		memcpy(copy_to, buffer, region->len);
-	else
-		MORSE_COREDUMP_ERR(mors, "%s: failed to read memory 0x%08x:%u",
-						   __func__,
-						   region->start,
-						   region->len);
+		if (pos)
+			coredump_yield(mors);
 
-	kfree(buffer);
-	return ret;
+		chunk = min_t(u32, region->len - pos, max_chunk);
+
+		if (region->len == sizeof(u32))
+			ret = morse_reg32_read(mors, region->start, (u32 *)bounce);
+		else
+			ret = morse_dm_read(mors, region->start + pos, bounce,
+					    (int)ROUND_BYTES_TO_WORD(chunk));
+
+		if (ret) {
+			MORSE_COREDUMP_ERR(mors, "%s: failed to read memory 0x%08x:%u",
+							   __func__,
+							   region->start + pos,
+							   chunk);
+			return ret;
+		}
+
+		copy(dst, pos, bounce, chunk);
+	}
+
+	return 0;
+}
+
+static void copy_to_buffer(void *dst, size_t pos, const void *src, size_t len)
+{
+	memcpy((u8 *)dst + pos, src, len);
+}
+
+static void coredump_seg_free(struct morse_coredump_seg *seg)
+{
+	size_t i;
+
+	if (seg->pages) {
+		for (i = 0; i < DIV_ROUND_UP(seg->len, PAGE_SIZE); i++)
+			if (seg->pages[i])
+				__free_page(seg->pages[i]);
+	}
+
+	kfree(seg->pages);
+	seg->pages = NULL;
+	seg->len = 0;
+}
+
+static int coredump_seg_alloc(struct morse_coredump_seg *seg, size_t offset, size_t len)
+{
+	size_t num_pages = DIV_ROUND_UP(len, PAGE_SIZE);
+	size_t i;
+
+	seg->offset = offset;
+	seg->len = len;
+	if (!num_pages)
+		return 0;
+
+	seg->pages = kcalloc(num_pages, sizeof(*seg->pages), GFP_KERNEL);
+	if (!seg->pages)
+		goto err;
+
+	for (i = 0; i < num_pages; i++) {
+		seg->pages[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (!seg->pages[i])
+			goto err;
+	}
+
+	return 0;
+
+err:
+	coredump_seg_free(seg);
+	return -ENOMEM;
+}
+
+static void coredump_seg_copy(void *dst, size_t pos, const void *src, size_t len)
+{
+	struct morse_coredump_seg *seg = dst;
+	const u8 *from = src;
+
+	while (len) {
+		size_t off = offset_in_page(pos);
+		size_t n = min_t(size_t, len, PAGE_SIZE - off);
+
+		memcpy((u8 *)page_address(seg->pages[pos >> PAGE_SHIFT]) + off, from, n);
+		pos += n;
+		from += n;
+		len -= n;
+	}
+}
+
+static void coredump_seg_read(const struct morse_coredump_seg *seg, size_t pos,
+			      u8 *to, size_t len)
+{
+	while (len) {
+		size_t off = offset_in_page(pos);
+		size_t n = min_t(size_t, len, PAGE_SIZE - off);
+
+		memcpy(to, (u8 *)page_address(seg->pages[pos >> PAGE_SHIFT]) + off, n);
+		pos += n;
+		to += n;
+		len -= n;
+	}
+}
+
+static size_t coredump_seg_page_len(const struct morse_coredump_seg *seg, size_t idx)
+{
+	return min_t(size_t, PAGE_SIZE, seg->len - idx * PAGE_SIZE);
+}
+
+/* Free all-zero pages of a segment, leaving NULL in their place. Returns the bytes freed. */
+static size_t coredump_seg_elide_zero(struct morse_coredump_seg *seg)
+{
+	size_t elided = 0;
+	size_t len;
+	size_t i;
+
+	if (!seg->pages)
+		return 0;
+
+	for (i = 0; i < DIV_ROUND_UP(seg->len, PAGE_SIZE); i++) {
+		len = coredump_seg_page_len(seg, i);
+		if (memchr_inv(page_address(seg->pages[i]), 0, len))
+			continue;
+
+		__free_page(seg->pages[i]);
+		seg->pages[i] = NULL;
+		elided += len;
+	}
+
+	return elided;
+}
+
+/* Move the remaining pages of a segment to the front and place it in the file at offset.
+ * Only the last page of a segment can be partial, so it stays last once packed.
+ */
+static void coredump_seg_pack(struct morse_coredump_seg *seg, size_t offset)
+{
+	size_t num_pages = DIV_ROUND_UP(seg->len, PAGE_SIZE);
+	size_t packed = 0;
+	size_t len = 0;
+	size_t i;
+
+	for (i = 0; seg->pages && i < num_pages; i++) {
+		if (!seg->pages[i])
+			continue;
+
+		len += coredump_seg_page_len(seg, i);
+		seg->pages[packed++] = seg->pages[i];
+	}
+
+	for (i = packed; seg->pages && i < num_pages; i++)
+		seg->pages[i] = NULL;
+
+	seg->offset = offset;
+	seg->len = len;
+}
+
+static void coredump_stream_free(void *data)
+{
+	struct morse_coredump_stream *stream = data;
+	size_t i;
+
+	for (i = 0; i < stream->num_segs; i++)
+		coredump_seg_free(&stream->segs[i]);
+
+	kfree(stream);
+}
+
+/* devcoredump read callback, assembling the requested part of the file from its segments */
+static ssize_t coredump_stream_read(char *buffer, loff_t offset, size_t count,
+				    void *data, size_t datalen)
+{
+	const struct morse_coredump_stream *stream = data;
+	size_t done = 0;
+	size_t pos;
+	size_t n;
+	size_t i;
+
+	if (offset < 0 || offset >= datalen)
+		return 0;
+
+	count = min_t(size_t, count, datalen - offset);
+
+	for (i = 0; i < stream->num_segs && done < count; i++) {
+		const struct morse_coredump_seg *seg = &stream->segs[i];
+
+		pos = offset + done;
+		if (pos >= seg->offset + seg->len)
+			continue;
+
+		/* Anything not covered by a segment reads as zero */
+		if (pos < seg->offset) {
+			n = min_t(size_t, count - done, seg->offset - pos);
+			memset(buffer + done, 0, n);
+			done += n;
+			pos += n;
+			if (done == count)
+				break;
+		}
+
+		n = min_t(size_t, count - done, seg->offset + seg->len - pos);
+		coredump_seg_read(seg, pos - seg->offset, buffer + done, n);
+		done += n;
+	}
+
+	memset(buffer + done, 0, count - done);
+	return count;
 }
 
 static int meta_append(struct list_head *notes,
@@ -172,6 +431,12 @@ static size_t elf_size_of_all_memory_regions(struct morse *mors, size_t *count)
 	return size;
 }
 
+static size_t elf_note_size(const struct morse_elf_note *note)
+{
+	/* Need to ensure alignment within data section */
+	return ROUND_BYTES_TO_WORD(sizeof(struct elf32_note) + note->namesz + note->datasz);
+}
+
 static size_t elf_size_of_all_notes(struct morse *mors,
 								const struct list_head *notes,
 								size_t *count)
@@ -181,10 +446,7 @@ static size_t elf_size_of_all_notes(struct morse *mors,
 
 	list_for_each_entry(note, notes, list) {
 		size += sizeof(struct elf32_phdr);
-
-		/* Need to ensure alignment within data section */
-		size += ROUND_BYTES_TO_WORD(sizeof(struct elf32_note) +
-			note->namesz + note->datasz);
+		size += elf_note_size(note);
 
 		*count += 1;
 	}
@@ -192,6 +454,37 @@ static size_t elf_size_of_all_notes(struct morse *mors,
 	return size;
 }
 
+static void elf_init_note_phdr(const struct morse_elf_note *note,
+							struct elf32_phdr *phdr,
+							size_t offset)
+{
+	phdr->p_type = PT_NOTE;
+	phdr->p_offset = offset;
+	phdr->p_filesz = elf_note_size(note);
+	phdr->p_memsz = phdr->p_filesz;
+}
+
+static void elf_init_note_header(const struct morse_elf_note *note, struct elf32_note *enote)
+{
+	enote->n_type = cpu_to_le32(note->type);
+	enote->n_namesz = cpu_to_le32(note->namesz);
+	enote->n_descsz = cpu_to_le32(note->datasz);
+}
+
+static void elf_init_region_phdr(const struct morse_coredump_mem_region *region,
+							struct elf32_phdr *phdr,
+							size_t offset)
+{
+	phdr->p_type = PT_LOAD;
+	phdr->p_offset = offset;
+	phdr->p_vaddr = region->start;
+	phdr->p_paddr = region->start;
+	phdr->p_filesz = region->len;
+	phdr->p_memsz = region->len;
+	phdr->p_flags = PF_R | PF_W | PF_X;
+	phdr->p_align = 0;
+}
+
 static void elf_copy_notes(struct morse *mors,
 						const struct list_head *notes,
 						struct elf32_hdr *ehdr,
@@ -209,16 +502,10 @@ static void elf_copy_notes(struct morse *mors,
 		MORSE_COREDUMP_DBG(mors, "%s: copying note %s", __func__, note->variable);
 
 		/* init program header */
-		(*phdr)->p_type = PT_NOTE;
-		(*phdr)->p_offset = *offset;
-		(*phdr)->p_filesz =
-			ROUND_BYTES_TO_WORD(sizeof(*enote) + note->namesz + note->datasz);
-		(*phdr)->p_memsz = (*phdr)->p_filesz;
+		elf_init_note_phdr(note, *phdr, *offset);
 
 		/* init note header */
-		enote->n_type = cpu_to_le32(note->type);
-		enote->n_namesz = cpu_to_le32(note->namesz);
-		enote->n_descsz = cpu_to_le32(note->datasz);
+		elf_init_note_header(note, enote);
 
 		/* copy in note name + data */
 		insert_at += sizeof(*enote);
@@ -232,6 +519,7 @@ static void elf_copy_notes(struct morse *mors,
 
 static void elf_copy_memory_regions(struct morse *mors,
 								struct elf32_hdr *ehdr,
+								u8 *bounce,
 								struct elf32_phdr **phdr,
 								size_t *offset)
 {
@@ -246,16 +534,9 @@ static void elf_copy_memory_regions(struct morse *mors,
 		MORSE_COREDUMP_DBG(mors, "%s: copying region 0x%08x:%d",
 			__func__, region->start, region->len);
 
-		(*phdr)->p_type = PT_LOAD;
-		(*phdr)->p_offset =  *offset;
-		(*phdr)->p_vaddr = region->start;
-		(*phdr)->p_paddr = region->start;
-		(*phdr)->p_filesz = region->len;
-		(*phdr)->p_memsz = region->len;
-		(*phdr)->p_flags = PF_R | PF_W | PF_X;
-		(*phdr)->p_align = 0;
+		elf_init_region_phdr(region, *phdr, *offset);
 
-		if (read_memory_region(mors, region, insert_at)) {
+		if (read_memory_region(mors, region, bounce, copy_to_buffer, insert_at)) {
 			/* Failed to read the memory region */
 			(*phdr)->p_filesz = 0;
 			(*phdr)->p_memsz = 0;
@@ -323,12 +604,21 @@ static int coredump_build(struct morse *mors, void **cd, size_t *cd_size)
 	struct list_head notes;
 	struct morse_elf_note *note;
 	struct morse_elf_note *tmp;
+	u8 *bounce;
 
 	lockdep_assert_held(&mors->coredump.lock);
 
 	INIT_LIST_HEAD(&notes);
 	add_coredump_meta(mors, &notes);
 
+	bounce = kmalloc(MORSE_COREDUMP_READ_CHUNK, GFP_KERNEL);
+	if (!bounce) {
+		*cd = NULL;
+		*cd_size = 0;
+		ret = -ENOMEM;
+		goto exit;
+	}
+
 	file_size = sizeof(*ehdr);
 	file_size += elf_size_of_all_memory_regions(mors, &phnum);
 	file_size += elf_size_of_all_notes(mors, &notes, &phnum);
@@ -351,7 +641,7 @@ static int coredump_build(struct morse *mors, void **cd, size_t *cd_size)
 	offset = sizeof(*ehdr) + (sizeof(*phdr) * ehdr->e_phnum);
 
 	/* insert memory regions */
-	elf_copy_memory_regions(mors, ehdr, &phdr, &offset);
+	elf_copy_memory_regions(mors, ehdr, bounce, &phdr, &offset);
 
 	/* insert notes */
 	elf_copy_notes(mors, &notes, ehdr, &phdr, &offset);
@@ -363,6 +653,200 @@ static int coredump_build(struct morse *mors, void **cd, size_t *cd_size)
 
 	ret = 0;
 exit:
+	kfree(bounce);
+	/* Delete the notes */
+	list_for_each_entry_safe(note, tmp, &notes, list) {
+		list_del(&note->list);
+		kfree(note);
+	}
+	return ret;
+}
+
+/* Describe a captured memory region with program headers, placing its data at offset. A region
+ * with elided pages gets a PT_LOAD header per run of kept pages, each covering the zero pages
+ * that follow it in p_memsz only. Headers are only counted when phdr is NULL.
+ */
+static size_t elf_stream_region_phdrs(const struct morse_coredump_mem_region *region,
+							const struct morse_coredump_seg *seg,
+							struct elf32_phdr *phdr,
+							size_t offset)
+{
+	struct elf32_phdr cur = { 0 };
+	size_t count = 0;
+	size_t len;
+	size_t i;
+
+	if (!seg->pages) {
+		/* Empty, or failed to capture the memory region */
+		if (phdr) {
+			elf_init_region_phdr(region, phdr, offset);
+			phdr->p_filesz = 0;
+			phdr->p_memsz = 0;
+		}
+		return 1;
+	}
+
+	for (i = 0; i < DIV_ROUND_UP(seg->len, PAGE_SIZE); i++) {
+		len = coredump_seg_page_len(seg, i);
+
+		/* Kept data must directly follow the data of the header, or start a new one */
+		if (!count || (seg->pages[i] && cur.p_memsz != cur.p_filesz)) {
+			if (count && phdr)
+				*phdr++ = cur;
+			elf_init_region_phdr(region, &cur, offset);
+			cur.p_vaddr += i * PAGE_SIZE;
+			cur.p_paddr = cur.p_vaddr;
+			cur.p_filesz = 0;
+			cur.p_memsz = 0;
+			count++;
+		}
+
+		if (seg->pages[i]) {
+			cur.p_filesz += len;
+			offset += len;
+		}
+		cur.p_memsz += len;
+	}
+
+	if (phdr)
+		*phdr = cur;
+
+	return count;
+}
+
+/* Build the coredump as a list of page-backed segments: the ELF and program headers, one
+ * segment per memory region and one holding all the notes. Chip memory must still be captured
+ * here, as the chip is restarted long before userspace gets to read the file, but no part of
+ * it needs a large contiguous allocation and memory regions that fail to read take no space.
+ * Headers are built last, once the regions are read and any zero pages elided.
+ */
+static int coredump_build_stream(struct morse *mors, struct morse_coredump_stream **cd,
+				 size_t *cd_size)
+{
+	int ret;
+	struct morse_coredump_stream *stream = NULL;
+	const struct morse_coredump_mem_region *region;
+	struct morse_coredump_seg *seg;
+	struct elf32_hdr *ehdr = NULL;
+	struct elf32_phdr *phdr;
+	struct elf32_note enote;
+	struct list_head notes;
+	struct morse_elf_note *note;
+	struct morse_elf_note *tmp;
+	const bool elide_zero = coredump_elide_zero;
+	size_t num_regions = 0;
+	size_t num_notes = 0;
+	size_t phnum;
+	size_t notes_size;
+	size_t head_size;
+	size_t raw_size;
+	size_t elided = 0;
+	size_t offset;
+	size_t pos;
+	u8 *bounce;
+
+	lockdep_assert_held(&mors->coredump.lock);
+
+	INIT_LIST_HEAD(&notes);
+	add_coredump_meta(mors, &notes);
+
+	raw_size = elf_size_of_all_memory_regions(mors, &num_regions);
+	notes_size = elf_size_of_all_notes(mors, &notes, &num_notes);
+	notes_size -= num_notes * sizeof(*phdr);
+
+	/* Segments: headers, one per memory region, notes */
+	stream = kzalloc(struct_size(stream, segs, num_regions + 2), GFP_KERNEL);
+	bounce = kmalloc(MORSE_COREDUMP_READ_CHUNK, GFP_KERNEL);
+	if (!stream || !bounce) {
+		kfree(bounce);
+		ret = -ENOMEM;
+		goto err;
+	}
+	stream->num_segs = num_regions + 2;
+
+	seg = &stream->segs[1];
+	list_for_each_entry(region, &mors->coredump.crash.memory.regions, list) {
+		MORSE_COREDUMP_DBG(mors, "%s: copying region 0x%08x:%d",
+			__func__, region->start, region->len);
+
+		if (coredump_seg_alloc(seg, 0, region->len) ||
+		    read_memory_region(mors, region, bounce, coredump_seg_copy, seg))
+			coredump_seg_free(seg);
+		else if (elide_zero)
+			elided += coredump_seg_elide_zero(seg);
+
+		seg++;
+	}
+	kfree(bounce);
+
+	/* Now the regions are known, lay out the file */
+	phnum = num_notes;
+	seg = &stream->segs[1];
+	list_for_each_entry(region, &mors->coredump.crash.memory.regions, list)
+		phnum += elf_stream_region_phdrs(region, seg++, NULL, 0);
+
+	head_size = sizeof(*ehdr) + phnum * sizeof(*phdr);
+	ehdr = kzalloc(head_size, GFP_KERNEL);
+	if (!ehdr) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	elf_init_header(mors, ehdr, phnum);
+	phdr = (struct elf32_phdr *)((u8 *)ehdr + ehdr->e_phoff);
+	offset = head_size;
+
+	seg = &stream->segs[1];
+	list_for_each_entry(region, &mors->coredump.crash.memory.regions, list) {
+		phdr += elf_stream_region_phdrs(region, seg, phdr, offset);
+		coredump_seg_pack(seg, offset);
+		offset += seg->len;
+		seg++;
+	}
+
+	ret = coredump_seg_alloc(seg, offset, notes_size);
+	if (ret)
+		goto err;
+
+	pos = 0;
+	list_for_each_entry(note, &notes, list) {
+		MORSE_COREDUMP_DBG(mors, "%s: copying note %s", __func__, note->variable);
+
+		elf_init_note_phdr(note, phdr, offset + pos);
+		elf_init_note_header(note, &enote);
+		coredump_seg_copy(seg, pos, &enote, sizeof(enote));
+		coredump_seg_copy(seg, pos + sizeof(enote), note->variable,
+				  note->namesz + note->datasz);
+
+		pos += phdr->p_filesz;
+		phdr++;
+	}
+	offset += notes_size;
+
+	ret = coredump_seg_alloc(&stream->segs[0], 0, head_size);
+	if (ret)
+		goto err;
+	coredump_seg_copy(&stream->segs[0], 0, ehdr, head_size);
+
+	MORSE_COREDUMP_DBG(mors, "%s: elf size: %zu, n program headers: %zu",
+		__func__,
+		offset,
+		phnum);
+	if (elide_zero)
+		MORSE_COREDUMP_INFO(mors, "%s: elided %zu of %zu bytes of chip memory",
+			__func__,
+			elided,
+			raw_size - num_regions * sizeof(*phdr));
+
+	*cd = stream;
+	*cd_size = offset;
+	stream = NULL;
+	ret = 0;
+
+err:
+	if (stream)
+		coredump_stream_free(stream);
+	kfree(ehdr);
 	/* Delete the notes */
 	list_for_each_entry_safe(note, tmp, &notes, list) {
 		list_del(&note->list);
@@ -374,19 +858,29 @@ exit:
 static int coredump_submit(struct morse *mors)
 {
 	int ret;
-	void *coredump;
+	void *coredump = NULL;
+	struct morse_coredump_stream *stream = NULL;
 	size_t coredump_size;
+	const bool stream_mode = coredump_stream;
 
 	lockdep_assert_held(&mors->coredump.lock);
 
-	ret = coredump_build(mors, &coredump, &coredump_size);
+	if (stream_mode)
+		ret = coredump_build_stream(mors, &stream, &coredump_size);
+	else
+		ret = coredump_build(mors, &coredump, &coredump_size);
+
 	if (ret) {
 		MORSE_COREDUMP_ERR(mors, "%s: failed to produce crash data\n", __func__);
 		goto exit;
 	}
 
-	/* coredump is consumed and free'd by the devcoredumpv API */
-	dev_coredumpv(mors->dev, coredump, coredump_size, GFP_KERNEL);
+	/* coredump is consumed and free'd by the devcoredump API */
+	if (stream_mode)
+		dev_coredumpm(mors->dev, THIS_MODULE, stream, coredump_size, GFP_KERNEL,
+			      coredump_stream_read, coredump_stream_free);
+	else
+		dev_coredumpv(mors->dev, coredump, coredump_size, GFP_KERNEL);
 	ret = 0;
 
 exit:
@@ -489,6 +983,9 @@ int morse_coredump(struct morse *mors)
 	if (mors->cfg->post_coredump_hook)
 		ret = mors->cfg->post_coredump_hook(mors, method);
 
+	if (READ_ONCE(mors->coredump.abort))
+		MORSE_COREDUMP_WARN(mors, "%s: aborted, chip memory is incomplete", __func__);
+
 exit:
 	if (ret)
 		MORSE_COREDUMP_ERR(mors, "%s: failed to coredump: %d\n", __func__, ret);
@@ -497,6 +994,11 @@ exit:
 	return ret;
 }
 
+void morse_coredump_abort(struct morse *mors)
+{
+	WRITE_ONCE(mors->coredump.abort, true);
+}
+
 int morse_coredump_new(struct morse *mors, enum morse_coredump_reason reason)
 {
 	struct morse_coredump_data *data = &mors->coredump.crash;
@@ -509,6 +1011,8 @@ int morse_coredump_new(struct morse *mors, enum morse_coredump_reason reason)
 	mutex_lock(&mors->coredump.lock);
 	data->reason = reason;
 	ktime_get_real_ts64(&data->timestamp);
+	/* An abort only applies to the dump in progress when it was requested */
+	WRITE_ONCE(mors->coredump.abort, false);
 	mutex_unlock(&mors->coredump.lock);
 
 	return 0;
@@ -105,6 +105,16 @@ int morse_coredump_new(struct morse *mors, enum morse_coredump_reason reason);
  */
 int morse_coredump(struct morse *mors);
 
+/**
+ * morse_coredump_abort() - Stop reading chip memory for the coredump in progress
+ *
+ * @mors: Morse chip instance
+ *
+ * The dump is still submitted, with the regions not yet read left empty, and the restart
+ * it is part of carries on straight away.
+ */
+void morse_coredump_abort(struct morse *mors);
+
 /**
  * morse_coredump_add_memory_region() - Add the provided memory region descriptor
  *                                      to the list of on-chip memory regions to
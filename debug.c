@@ -9,6 +9,7 @@
 #include "debug.h"
 #include "trace.h"
 #include "mac.h"
+#include "command.h"
 #include "watchdog.h"
 #include "bus.h"
 #include "firmware.h"
@@ -16,9 +17,14 @@
 #include "vendor_ie.h"
 #include "twt.h"
 #include "coredump.h"
+#include "ps.h"
+#include "mbssid.h"
 #include "linux/semaphore.h"
 #include "linux/wait.h"
 #include <linux/ratelimit.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/sizes.h>
 
 /*
  * Array of configured LOG levels, indexed by the ID of the feature / module.
@@ -26,6 +32,28 @@
  */
 static u8 log_mask[NUM_FEATURE_IDS];
 
+bool enable_bus_stats __read_mostly;
+module_param(enable_bus_stats, bool, 0644);
+MODULE_PARM_DESC(enable_bus_stats, "Time bus operations into the bus_stats debugfs histograms");
+
+bool enable_tx_path_stats __read_mostly;
+module_param(enable_tx_path_stats, bool, 0644);
+MODULE_PARM_DESC(enable_tx_path_stats, "Time frames through the driver TX path into tx_path_stats");
+
+bool enable_pkt_latency __read_mostly;
+module_param(enable_pkt_latency, bool, 0644);
+MODULE_PARM_DESC(enable_pkt_latency, "Follow sampled packets through the driver into pkt_latency");
+
+static uint pkt_latency_sample_interval __read_mostly = 16;
+module_param(pkt_latency_sample_interval, uint, 0644);
+MODULE_PARM_DESC(pkt_latency_sample_interval, "Follow one in this many packets for pkt_latency");
+
+#ifdef CONFIG_MORSE_DEBUGFS
+static uint hostif_log_ring_kb __read_mostly = 256;
+module_param(hostif_log_ring_kb, uint, 0644);
+MODULE_PARM_DESC(hostif_log_ring_kb, "Size of each per-CPU fw_hostif_log ring in KiB (power of 2)");
+#endif
+
 /*
  * Mapping between feature name and ID. Used to populate debugFS.
  * The order must match the defintions in enum morse_feature_id!
@@ -49,6 +77,7 @@ static const char * const morse_log_features[] = {
 	[FEATURE_ID_BEACON] = "beacon",
 	[FEATURE_ID_YAPS] = "yaps",
 	[FEATURE_ID_USB] = "usb",
+	[FEATURE_ID_EMU] = "emu",
 };
 
 /*
@@ -60,8 +89,8 @@ static const char * const morse_log_features[] = {
  *
  * Note: %pV is used for printing a struct va_format structure.
  */
-#define __generate_log_fn(fn, lvl)							\
-void morse_ ## fn(u32 id, const struct morse *mors, const char *fmt, ...)			\
+#define __generate_log_fn(name, fn, lvl)						\
+void name(u32 id, const struct morse *mors, const char *fmt, ...)			\
 {											\
 	struct va_format vaf = {							\
 		.fmt = fmt,								\
@@ -76,95 +105,900 @@ void morse_ ## fn(u32 id, const struct morse *mors, const char *fmt, ...)			\
 	va_end(args);									\
 }											\
 
-__generate_log_fn(dbg, MORSE_MSG_DEBUG)
-__generate_log_fn(dbg_ratelimited, MORSE_MSG_DEBUG)
-__generate_log_fn(info, MORSE_MSG_INFO)
-__generate_log_fn(info_ratelimited, MORSE_MSG_INFO)
-__generate_log_fn(warn, MORSE_MSG_WARN)
-__generate_log_fn(warn_ratelimited, MORSE_MSG_WARN)
-__generate_log_fn(err, MORSE_MSG_ERR)
-__generate_log_fn(err_ratelimited, MORSE_MSG_ERR)
+__generate_log_fn(__morse_dbg, dbg, MORSE_MSG_DEBUG)
+__generate_log_fn(__morse_dbg_ratelimited, dbg_ratelimited, MORSE_MSG_DEBUG)
+__generate_log_fn(morse_info, info, MORSE_MSG_INFO)
+__generate_log_fn(morse_info_ratelimited, info_ratelimited, MORSE_MSG_INFO)
+__generate_log_fn(morse_warn, warn, MORSE_MSG_WARN)
+__generate_log_fn(morse_warn_ratelimited, warn_ratelimited, MORSE_MSG_WARN)
+__generate_log_fn(morse_err, err, MORSE_MSG_ERR)
+__generate_log_fn(morse_err_ratelimited, err_ratelimited, MORSE_MSG_ERR)
+
+#undef __generate_log_fn
+
+struct static_key_false morse_log_dbg_keys[NUM_FEATURE_IDS] = {
+	[0 ... NUM_FEATURE_IDS - 1] = STATIC_KEY_FALSE_INIT
+};
+DEFINE_STATIC_KEY_FALSE(morse_log_dbg_traced);
+
+/* Patch the debug sites of a feature in or out to match its log level */
+static void morse_log_update_dbg_key(enum morse_feature_id id)
+{
+	if (log_mask[id] >= MORSE_MSG_DEBUG)
+		static_branch_enable(&morse_log_dbg_keys[id]);
+	else
+		static_branch_disable(&morse_log_dbg_keys[id]);
+}
+
+#if KERNEL_VERSION(4, 10, 0) <= LINUX_VERSION_CODE
+int morse_log_dbg_trace_reg(void)
+{
+	static_branch_inc(&morse_log_dbg_traced);
+	return 0;
+}
+#else
+void morse_log_dbg_trace_reg(void)
+{
+	static_branch_inc(&morse_log_dbg_traced);
+}
+#endif
+
+void morse_log_dbg_trace_unreg(void)
+{
+	static_branch_dec(&morse_log_dbg_traced);
+}
+
+void morse_init_log_levels(u8 lvl)
+{
+	int id;
+
+	for (id = 0; id < NUM_FEATURE_IDS; id++) {
+		log_mask[id] = lvl;
+		morse_log_update_dbg_key(id);
+	}
+}
+
+bool morse_log_is_enabled(enum morse_feature_id id, u8 level)
+{
+	return (bool)(log_mask[id] >= level);
+}
+
+static ssize_t morse_log_level_write(struct file *file, const char __user *user_buf,
+				     size_t count, loff_t *ppos)
+{
+	u8 *level = file->private_data;
+	u8 value;
+
+	if (kstrtou8_from_user(user_buf, count, 0, &value))
+		return -EINVAL;
+
+	WRITE_ONCE(*level, value);
+	morse_log_update_dbg_key(level - log_mask);
+
+	return count;
+}
+
+static ssize_t morse_log_level_read(struct file *file, char __user *user_buf,
+				    size_t count, loff_t *ppos)
+{
+	u8 *level = file->private_data;
+	char buf[8];
+	size_t len;
+
+	len = scnprintf(buf, sizeof(buf), "%u\n", READ_ONCE(*level));
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static const struct file_operations log_level_fops = {
+	.open = simple_open,
+#if KERNEL_VERSION(6, 12, 0) > LINUX_VERSION_CODE
+	.llseek = no_llseek,
+#endif
+	.write = morse_log_level_write,
+	.read = morse_log_level_read,
+};
+
+static int morse_log_add_debugfs(struct morse *mors)
+{
+	enum morse_feature_id id;
+
+	if (!mors->debug.debugfs_phy)
+		return -ENODEV;
+
+	mors->debug.debugfs_logging = debugfs_create_dir("logging", mors->debug.debugfs_phy);
+	if (!mors->debug.debugfs_logging)
+		return -ENODEV;
+
+	for (id = 0; id < ARRAY_SIZE(morse_log_features); id++) {
+		debugfs_create_file(morse_log_features[id], 0600,
+				    mors->debug.debugfs_logging, &log_mask[id], &log_level_fops);
+	}
+
+	return 0;
+}
+
+static void morse_log_remove_debugfs(struct morse *mors)
+{
+	debugfs_remove_recursive(mors->debug.debugfs_logging);
+	mors->debug.debugfs_logging = NULL;
+}
+
+static void print_stat(struct seq_file *file, const char *desc, u32 val)
+{
+	seq_printf(file, "%s: %u\n", desc, val);
+}
+
+static int read_page_stats(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+
+	print_stat(file, "Command Tx", MORSE_PAGE_STAT_READ(mors, cmd_tx));
+	print_stat(file, "Beacon Tx", MORSE_PAGE_STAT_READ(mors, bcn_tx));
+	print_stat(file, "Management Tx", MORSE_PAGE_STAT_READ(mors, mgmt_tx));
+	print_stat(file, "Data Tx", MORSE_PAGE_STAT_READ(mors, data_tx));
+	print_stat(file, "Multi-packet Tx bursts", MORSE_PAGE_STAT_READ(mors, tx_burst));
+	print_stat(file, "Page write fail", MORSE_PAGE_STAT_READ(mors, write_fail));
+	print_stat(file, "No page", MORSE_PAGE_STAT_READ(mors, no_page));
+	print_stat(file, "No command page", MORSE_PAGE_STAT_READ(mors, cmd_no_page));
+	print_stat(file, "Command page retry", MORSE_PAGE_STAT_READ(mors, cmd_rsv_page_retry));
+	print_stat(file, "No beacon page", MORSE_PAGE_STAT_READ(mors, bcn_no_page));
+	print_stat(file, "Excessive beacon loss", MORSE_PAGE_STAT_READ(mors, excessive_bcn_loss));
+	print_stat(file, "Queue stop", MORSE_PAGE_STAT_READ(mors, queue_stop));
+	print_stat(file, "Popped page owned by chip", MORSE_PAGE_STAT_READ(mors, page_owned_by_chip));
+	print_stat(file, "Tx aged out", MORSE_PAGE_STAT_READ(mors, tx_aged_out));
+	print_stat(file, "TX ps filtered", MORSE_PAGE_STAT_READ(mors, tx_ps_filtered));
+	print_stat(file, "Stale tx status flushed", MORSE_PAGE_STAT_READ(mors, tx_status_flushed));
+	print_stat(file, "TX status invalid", MORSE_PAGE_STAT_READ(mors, tx_status_page_invalid));
+	print_stat(file, "TX dropped due to duty cycle",
+		   MORSE_PAGE_STAT_READ(mors, tx_status_duty_cycle_cant_send));
+	print_stat(file, "TX with retries disabled to duty cycle",
+		   MORSE_PAGE_STAT_READ(mors, tx_duty_cycle_retry_disabled));
+	print_stat(file, "TX status dropped", MORSE_PAGE_STAT_READ(mors, tx_status_dropped));
+	print_stat(file, "TX status slow lookup", MORSE_PAGE_STAT_READ(mors, tx_status_slow_lookup));
+	print_stat(file, "TX tailroom expanded", MORSE_PAGE_STAT_READ(mors, tx_tailroom_expand));
+	print_stat(file, "TX copied for S1G conversion", MORSE_PAGE_STAT_READ(mors, tx_s1g_copy));
+	print_stat(file, "RX copied for S1G conversion", MORSE_PAGE_STAT_READ(mors, rx_s1g_copy));
+	print_stat(file, "RX duplicate PN dropped", MORSE_PAGE_STAT_READ(mors, rx_pn_dup));
+	print_stat(file, "RX retries", MORSE_PAGE_STAT_READ(mors, rx_retry));
+	print_stat(file, "RX duplicate retries dropped", MORSE_PAGE_STAT_READ(mors, rx_retry_dup));
+	print_stat(file, "SKB cache hits", MORSE_PAGE_STAT_READ(mors, skb_cache_hit));
+	print_stat(file, "SKB cache misses", MORSE_PAGE_STAT_READ(mors, skb_cache_miss));
+	print_stat(file, "RX empty queue", MORSE_PAGE_STAT_READ(mors, rx_empty));
+	print_stat(file, "RX packet split across window", MORSE_PAGE_STAT_READ(mors, rx_split));
+	print_stat(file, "RX zero-copy packets", MORSE_PAGE_STAT_READ(mors, rx_zero_copy));
+	print_stat(file, "RX window reallocated", MORSE_PAGE_STAT_READ(mors, rx_window_realloc));
+	print_stat(file, "RX invalid byte count", MORSE_PAGE_STAT_READ(mors, rx_invalid_count));
+	print_stat(file, "Coalesced chip interrupts", MORSE_PAGE_STAT_READ(mors, irq_coalesced));
+	print_stat(file, "Invalid checksum", MORSE_PAGE_STAT_READ(mors, invalid_checksum));
+	print_stat(file, "Invalid TX status checksum",
+		MORSE_PAGE_STAT_READ(mors, invalid_tx_status_checksum));
+	print_stat(file, "TX AQM dropped", MORSE_PAGE_STAT_READ(mors, tx_aqm_dropped));
+
+	return 0;
+}
+
+static const char * const morse_bus_stat_op_names[MORSE_BUS_STAT_NUM_OPS] = {
+	[MORSE_BUS_STAT_DM_READ] = "dm_read",
+	[MORSE_BUS_STAT_DM_WRITE] = "dm_write",
+	[MORSE_BUS_STAT_REG32_READ] = "reg32_read",
+	[MORSE_BUS_STAT_REG32_WRITE] = "reg32_write",
+	[MORSE_BUS_STAT_CLAIM] = "claim_wait",
+	[MORSE_BUS_STAT_HOLD] = "claim_hold",
+};
+
+static const char * const morse_bus_stat_size_names[MORSE_BUS_STAT_SIZE_BUCKETS] = {
+	"<=64", "<=512", "<=4096", ">4096",
+};
+
+static unsigned int morse_bus_stat_size_bucket(unsigned int len)
+{
+	if (len <= 64)
+		return 0;
+	if (len <= 512)
+		return 1;
+	if (len <= 4096)
+		return 2;
+	return 3;
+}
+
+void morse_bus_stats_record(struct morse *mors, enum morse_bus_stat_op op, unsigned int len,
+			    u64 start_ns, int ret)
+{
+	u64 ns = ktime_get_ns() - start_ns;
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+	unsigned int size = morse_bus_stat_size_bucket(len);
+	unsigned int lat = morse_hist_bucket(us, MORSE_BUS_STAT_LAT_BUCKETS);
+
+	if (!mors->debug.bus_stats)
+		return;
+
+	this_cpu_inc(mors->debug.bus_stats->hist[op][size][lat]);
+	this_cpu_add(mors->debug.bus_stats->total_ns[op], ns);
+	if (ret < 0)
+		this_cpu_inc(mors->debug.bus_stats->errors[op]);
+}
+
+static void morse_bus_stats_reset(struct morse *mors)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(mors->debug.bus_stats, cpu), 0, sizeof(struct morse_bus_stats));
+	mors->debug.bus_stats_since_ns = ktime_get_ns();
+}
+
+static int morse_bus_stats_show(struct seq_file *file, void *data)
+{
+	struct morse *mors = file->private;
+	struct morse_bus_stats *sum;
+	u64 window_ns = ktime_get_ns() - mors->debug.bus_stats_since_ns;
+	int cpu, op, size, lat;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		const struct morse_bus_stats *stats = per_cpu_ptr(mors->debug.bus_stats, cpu);
+
+		for (op = 0; op < MORSE_BUS_STAT_NUM_OPS; op++) {
+			for (size = 0; size < MORSE_BUS_STAT_SIZE_BUCKETS; size++)
+				for (lat = 0; lat < MORSE_BUS_STAT_LAT_BUCKETS; lat++)
+					sum->hist[op][size][lat] += stats->hist[op][size][lat];
+			sum->errors[op] += stats->errors[op];
+			sum->total_ns[op] += stats->total_ns[op];
+		}
+	}
+
+	seq_printf(file, "enabled: %s\n", enable_bus_stats ? "yes" : "no");
+	seq_printf(file, "window (ms): %llu\n", div_u64(window_ns, NSEC_PER_MSEC));
+	seq_printf(file, "bus busy (%%): %llu\n", window_ns ?
+		   div64_u64(sum->total_ns[MORSE_BUS_STAT_HOLD] * 100, window_ns) : 0);
+
+	seq_puts(file, "latency buckets (us): <1");
+	for (lat = 1; lat < MORSE_BUS_STAT_LAT_BUCKETS - 1; lat++)
+		seq_printf(file, " <%u", 1U << lat);
+	seq_printf(file, " >=%u\n", 1U << (MORSE_BUS_STAT_LAT_BUCKETS - 2));
+
+	for (op = 0; op < MORSE_BUS_STAT_NUM_OPS; op++) {
+		unsigned int calls = 0;
+
+		for (size = 0; size < MORSE_BUS_STAT_SIZE_BUCKETS; size++)
+			for (lat = 0; lat < MORSE_BUS_STAT_LAT_BUCKETS; lat++)
+				calls += sum->hist[op][size][lat];
+
+		seq_printf(file, "%s: calls %u errors %u mean (ns) %llu\n",
+			   morse_bus_stat_op_names[op], calls, sum->errors[op],
+			   calls ? div_u64(sum->total_ns[op], calls) : 0);
+
+		for (size = 0; size < MORSE_BUS_STAT_SIZE_BUCKETS; size++) {
+			const unsigned int *hist = sum->hist[op][size];
+
+			if (!memchr_inv(hist, 0, sizeof(sum->hist[op][size])))
+				continue;
+
+			seq_printf(file, "\t%-7s", morse_bus_stat_size_names[size]);
+			for (lat = 0; lat < MORSE_BUS_STAT_LAT_BUCKETS; lat++)
+				seq_printf(file, " %u", hist[lat]);
+			seq_puts(file, "\n");
+		}
+	}
+
+	kfree(sum);
+	return 0;
+}
+
+static int morse_bus_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, morse_bus_stats_show, inode->i_private);
+}
+
+/* Any write clears the statistics and restarts the busy window */
+static ssize_t morse_bus_stats_write(struct file *file, const char __user *user_buf,
+				     size_t count, loff_t *ppos)
+{
+	struct morse *mors = ((struct seq_file *)file->private_data)->private;
+
+	morse_bus_stats_reset(mors);
+
+	return count;
+}
+
+static const struct file_operations bus_stats_fops = {
+	.open = morse_bus_stats_open,
+	.read = seq_read,
+	.write = morse_bus_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+#ifdef CONFIG_MORSE_HW_TRACE
+static int morse_hw_trace_debug_show(struct seq_file *file, void *data)
+{
+	morse_hw_trace_show(file);
+	return 0;
+}
+
+static int morse_hw_trace_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, morse_hw_trace_debug_show, inode->i_private);
+}
+
+/* Write "<point> <gpio>" to remap a trace point, or "<point> -1" to unmap it */
+static ssize_t morse_hw_trace_write(struct file *file, const char __user *user_buf,
+				    size_t count, loff_t *ppos)
+{
+	char name[32];
+	char *buf;
+	int pin;
+	int ret;
+
+	buf = memdup_user_nul(user_buf, min_t(size_t, count, 64));
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	if (sscanf(buf, "%31s %d", name, &pin) == 2)
+		ret = morse_hw_trace_map(name, pin);
+	else
+		ret = -EINVAL;
+	kfree(buf);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations hw_trace_fops = {
+	.open = morse_hw_trace_open,
+	.read = seq_read,
+	.write = morse_hw_trace_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif
+
+static const char * const morse_tx_path_names[MORSE_TX_PATH_NUM] = {
+	[MORSE_TX_PATH_DATA] = "data",
+	[MORSE_TX_PATH_GENERIC] = "generic",
+};
+
+void morse_tx_path_stats_record(struct morse *mors, enum morse_tx_path path, u64 start_ns)
+{
+	u64 ns = ktime_get_ns() - start_ns;
+
+	if (!mors->debug.tx_path_stats)
+		return;
+
+	this_cpu_inc(mors->debug.tx_path_stats->frames[path]);
+	this_cpu_add(mors->debug.tx_path_stats->total_ns[path], ns);
+	if (ns > this_cpu_read(mors->debug.tx_path_stats->max_ns[path]))
+		this_cpu_write(mors->debug.tx_path_stats->max_ns[path], ns);
+}
+
+static void morse_tx_path_stats_reset(struct morse *mors)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(mors->debug.tx_path_stats, cpu), 0,
+		       sizeof(struct morse_tx_path_stats));
+	mors->debug.tx_path_stats_since_ns = ktime_get_ns();
+}
+
+static int morse_tx_path_stats_show(struct seq_file *file, void *data)
+{
+	struct morse *mors = file->private;
+	struct morse_tx_path_stats sum = { 0 };
+	u64 window_ns = ktime_get_ns() - mors->debug.tx_path_stats_since_ns;
+	u64 window_ms = max_t(u64, div_u64(window_ns, NSEC_PER_MSEC), 1);
+	int cpu, path;
+
+	for_each_possible_cpu(cpu) {
+		const struct morse_tx_path_stats *stats = per_cpu_ptr(mors->debug.tx_path_stats, cpu);
+
+		for (path = 0; path < MORSE_TX_PATH_NUM; path++) {
+			sum.frames[path] += stats->frames[path];
+			sum.total_ns[path] += stats->total_ns[path];
+			sum.max_ns[path] = max(sum.max_ns[path], stats->max_ns[path]);
+		}
+	}
+
+	seq_printf(file, "enabled: %s\n", enable_tx_path_stats ? "yes" : "no");
+	seq_printf(file, "window (ms): %llu\n", window_ms);
+
+	for (path = 0; path < MORSE_TX_PATH_NUM; path++) {
+		seq_printf(file, "%s:\n", morse_tx_path_names[path]);
+		seq_printf(file, "\tframes: %llu\n", sum.frames[path]);
+		seq_printf(file, "\tframes per sec: %llu\n",
+			   div64_u64(sum.frames[path] * MSEC_PER_SEC, window_ms));
+		seq_printf(file, "\tmean cost (ns): %llu\n", sum.frames[path] ?
+			   div64_u64(sum.total_ns[path], sum.frames[path]) : 0);
+		seq_printf(file, "\tmax cost (ns): %llu\n", sum.max_ns[path]);
+	}
+
+	return 0;
+}
+
+static int morse_tx_path_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, morse_tx_path_stats_show, inode->i_private);
+}
+
+/* Any write clears the statistics and restarts the window */
+static ssize_t morse_tx_path_stats_write(struct file *file, const char __user *user_buf,
+					 size_t count, loff_t *ppos)
+{
+	struct morse *mors = ((struct seq_file *)file->private_data)->private;
+
+	morse_tx_path_stats_reset(mors);
+
+	return count;
+}
+
+static const struct file_operations tx_path_stats_fops = {
+	.open = morse_tx_path_stats_open,
+	.read = seq_read,
+	.write = morse_tx_path_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* A sample that has not completed by then is taken to be a dropped packet */
+#define MORSE_PKT_LAT_MAX_AGE_NS	(NSEC_PER_SEC)
+
+static const struct {
+	const char *name;
+	u8 from;
+	u8 to;
+} morse_pkt_lat_segs[MORSE_PKT_LAT_NUM_SEGS] = {
+	[MORSE_PKT_LAT_SEG_TX_DRIVER] = { "tx driver", MORSE_PKT_LAT_TX_MAC,
+					  MORSE_PKT_LAT_TX_SKBQ },
+	[MORSE_PKT_LAT_SEG_TX_QUEUE] = { "tx queue", MORSE_PKT_LAT_TX_SKBQ, MORSE_PKT_LAT_TX_BUS },
+	[MORSE_PKT_LAT_SEG_TX_AIR] = { "tx air", MORSE_PKT_LAT_TX_BUS, MORSE_PKT_LAT_TX_STATUS },
+	[MORSE_PKT_LAT_SEG_TX_REPORT] = { "tx report", MORSE_PKT_LAT_TX_STATUS,
+					  MORSE_PKT_LAT_TX_DONE },
+	[MORSE_PKT_LAT_SEG_TX_TOTAL] = { "tx total", MORSE_PKT_LAT_TX_MAC, MORSE_PKT_LAT_TX_DONE },
+	[MORSE_PKT_LAT_SEG_RX_QUEUE] = { "rx queue", MORSE_PKT_LAT_RX_BUS,
+					 MORSE_PKT_LAT_RX_DISPATCH },
+	[MORSE_PKT_LAT_SEG_RX_DRIVER] = { "rx driver", MORSE_PKT_LAT_RX_DISPATCH,
+					  MORSE_PKT_LAT_RX_MAC },
+	[MORSE_PKT_LAT_SEG_RX_TOTAL] = { "rx total", MORSE_PKT_LAT_RX_BUS, MORSE_PKT_LAT_RX_MAC },
+};
+
+static const char * const morse_aci_names[IEEE80211_NUM_ACS] = {
+	[MORSE_ACI_BE] = "BE",
+	[MORSE_ACI_BK] = "BK",
+	[MORSE_ACI_VI] = "VI",
+	[MORSE_ACI_VO] = "VO",
+};
+
+static inline bool morse_pkt_lat_stage_is_rx(enum morse_pkt_lat_stage stage)
+{
+	return stage >= MORSE_PKT_LAT_RX_BUS;
+}
+
+u64 morse_pkt_lat_sample(struct morse *mors)
+{
+	uint interval = max_t(uint, READ_ONCE(pkt_latency_sample_interval), 1);
+
+	if (!mors->debug.pkt_lat_slots)
+		return 0;
+
+	if ((u32)atomic_inc_return(&mors->debug.pkt_lat_sample_cnt) % interval)
+		return 0;
+
+	return ktime_get_ns();
+}
+
+void morse_pkt_lat_begin(struct morse *mors, struct sk_buff *skb, enum morse_pkt_lat_stage stage,
+			 u64 start_ns, u8 aci)
+{
+	u64 now_ns = ktime_get_ns();
+	int i;
+
+	for (i = 0; i < MORSE_PKT_LAT_SLOTS; i++) {
+		struct morse_pkt_lat_slot *slot = &mors->debug.pkt_lat_slots[i];
+		struct sk_buff *old = READ_ONCE(slot->skb);
+
+		if (old) {
+			/* Zero while the slot is being claimed, as the start is written last */
+			u64 slot_start_ns = READ_ONCE(slot->ts[MORSE_PKT_LAT_TX_MAC]) ?:
+					    READ_ONCE(slot->ts[MORSE_PKT_LAT_RX_BUS]);
+
+			if (!slot_start_ns || now_ns - slot_start_ns < MORSE_PKT_LAT_MAX_AGE_NS)
+				continue;
+		}
+
+		if (cmpxchg(&slot->skb, old, skb) != old)
+			continue;
+
+		if (old)
+			this_cpu_inc(mors->debug.pkt_lat_stats->lost);
+		else
+			atomic_inc(&mors->debug.pkt_lat_active);
+
+		memset(slot->ts, 0, sizeof(slot->ts));
+		slot->aci = aci;
+		/* The TX sample starts at mac80211 and is queued right away */
+		if (stage == MORSE_PKT_LAT_TX_MAC)
+			slot->ts[MORSE_PKT_LAT_TX_SKBQ] = now_ns;
+		WRITE_ONCE(slot->ts[stage], start_ns);
+		return;
+	}
+
+	this_cpu_inc(mors->debug.pkt_lat_stats->no_slot);
+}
+
+static struct morse_pkt_lat_slot *morse_pkt_lat_find(struct morse *mors, struct sk_buff *skb)
+{
+	int i;
+
+	for (i = 0; i < MORSE_PKT_LAT_SLOTS; i++) {
+		struct morse_pkt_lat_slot *slot = &mors->debug.pkt_lat_slots[i];
+
+		if (READ_ONCE(slot->skb) == skb)
+			return slot;
+	}
+
+	return NULL;
+}
+
+static bool morse_pkt_lat_release(struct morse *mors, struct morse_pkt_lat_slot *slot,
+				  struct sk_buff *skb)
+{
+	if (cmpxchg(&slot->skb, skb, NULL) != skb)
+		return false;
+
+	atomic_dec(&mors->debug.pkt_lat_active);
+	return true;
+}
+
+void __morse_pkt_lat_stamp(struct morse *mors, struct sk_buff *skb, enum morse_pkt_lat_stage stage)
+{
+	struct morse_pkt_lat_slot *slot = morse_pkt_lat_find(mors, skb);
+
+	/* Stages are stamped in order, which keeps a reused skb from adding to a stale sample */
+	if (slot && !slot->ts[stage] && slot->ts[stage - 1])
+		slot->ts[stage] = ktime_get_ns();
+}
+
+/* Access category of a received frame, from its 802.11 header */
+static u8 morse_pkt_lat_rx_aci(struct sk_buff *skb)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+
+	if (skb_headlen(skb) < sizeof(hdr->frame_control) || !ieee80211_is_data(hdr->frame_control))
+		return MORSE_ACI_VO;
+
+	if (!ieee80211_is_data_qos(hdr->frame_control) ||
+	    skb_headlen(skb) < ieee80211_hdrlen(hdr->frame_control))
+		return MORSE_ACI_BE;
+
+	return dot11_tid_to_ac(*ieee80211_get_qos_ctl(hdr) & IEEE80211_QOS_CTL_TID_MASK);
+}
+
+void __morse_pkt_lat_finish(struct morse *mors, struct sk_buff *skb, enum morse_pkt_lat_stage stage)
+{
+	struct morse_pkt_lat_slot *slot = morse_pkt_lat_find(mors, skb);
+	const bool rx = morse_pkt_lat_stage_is_rx(stage);
+	u64 seg_ns[MORSE_PKT_LAT_NUM_SEGS] = { 0 };
+	u64 ts[MORSE_PKT_LAT_NUM_STAGES];
+	u8 aci;
+	int seg;
+
+	if (!slot || !slot->ts[stage - 1])
+		return;
+
+	memcpy(ts, slot->ts, sizeof(ts));
+	ts[stage] = ktime_get_ns();
+	aci = rx ? morse_pkt_lat_rx_aci(skb) : slot->aci;
+
+	if (!morse_pkt_lat_release(mors, slot, skb))
+		return;
+
+	for (seg = 0; seg < MORSE_PKT_LAT_NUM_SEGS; seg++) {
+		u64 from_ns = ts[morse_pkt_lat_segs[seg].from];
+		u64 to_ns = ts[morse_pkt_lat_segs[seg].to];
+		u64 us;
+		unsigned int lat;
+
+		if (!from_ns || !to_ns || to_ns < from_ns)
+			continue;
+
+		seg_ns[seg] = to_ns - from_ns;
+		us = div_u64(seg_ns[seg], NSEC_PER_USEC);
+		lat = morse_hist_bucket(us, MORSE_BUS_STAT_LAT_BUCKETS);
+
+		this_cpu_inc(mors->debug.pkt_lat_stats->hist[seg][aci][lat]);
+		this_cpu_add(mors->debug.pkt_lat_stats->total_ns[seg][aci], seg_ns[seg]);
+		if (seg_ns[seg] > this_cpu_read(mors->debug.pkt_lat_stats->max_ns[seg][aci]))
+			this_cpu_write(mors->debug.pkt_lat_stats->max_ns[seg][aci], seg_ns[seg]);
+	}
+
+	if (rx)
+		trace_morse_pkt_latency_rx(mors, aci, seg_ns[MORSE_PKT_LAT_SEG_RX_QUEUE],
+					   seg_ns[MORSE_PKT_LAT_SEG_RX_DRIVER],
+					   seg_ns[MORSE_PKT_LAT_SEG_RX_TOTAL]);
+	else
+		trace_morse_pkt_latency_tx(mors, aci, seg_ns[MORSE_PKT_LAT_SEG_TX_DRIVER],
+					   seg_ns[MORSE_PKT_LAT_SEG_TX_QUEUE],
+					   seg_ns[MORSE_PKT_LAT_SEG_TX_AIR],
+					   seg_ns[MORSE_PKT_LAT_SEG_TX_REPORT],
+					   seg_ns[MORSE_PKT_LAT_SEG_TX_TOTAL]);
+}
+
+void __morse_pkt_lat_drop(struct morse *mors, struct sk_buff *skb)
+{
+	struct morse_pkt_lat_slot *slot = morse_pkt_lat_find(mors, skb);
+
+	if (slot && morse_pkt_lat_release(mors, slot, skb))
+		this_cpu_inc(mors->debug.pkt_lat_stats->lost);
+}
+
+static void morse_pkt_lat_stats_reset(struct morse *mors)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(mors->debug.pkt_lat_stats, cpu), 0,
+		       sizeof(struct morse_pkt_lat_stats));
+	mors->debug.pkt_lat_stats_since_ns = ktime_get_ns();
+}
+
+static int morse_pkt_lat_stats_show(struct seq_file *file, void *data)
+{
+	struct morse *mors = file->private;
+	struct morse_pkt_lat_stats *sum;
+	u64 window_ns = ktime_get_ns() - mors->debug.pkt_lat_stats_since_ns;
+	int cpu, seg, aci, lat;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		const struct morse_pkt_lat_stats *stats =
+			per_cpu_ptr(mors->debug.pkt_lat_stats, cpu);
+
+		for (seg = 0; seg < MORSE_PKT_LAT_NUM_SEGS; seg++) {
+			for (aci = 0; aci < IEEE80211_NUM_ACS; aci++) {
+				for (lat = 0; lat < MORSE_BUS_STAT_LAT_BUCKETS; lat++)
+					sum->hist[seg][aci][lat] += stats->hist[seg][aci][lat];
+				sum->total_ns[seg][aci] += stats->total_ns[seg][aci];
+				sum->max_ns[seg][aci] = max(sum->max_ns[seg][aci],
+							    stats->max_ns[seg][aci]);
+			}
+		}
+		sum->lost += stats->lost;
+		sum->no_slot += stats->no_slot;
+	}
+
+	seq_printf(file, "enabled: %s\n", enable_pkt_latency ? "yes" : "no");
+	seq_printf(file, "sample interval: %u\n", max_t(uint, pkt_latency_sample_interval, 1));
+	seq_printf(file, "window (ms): %llu\n", div_u64(window_ns, NSEC_PER_MSEC));
+	seq_printf(file, "in flight: %d\n", atomic_read(&mors->debug.pkt_lat_active));
+	seq_printf(file, "lost: %u\n", sum->lost);
+	seq_printf(file, "no slot: %u\n", sum->no_slot);
+
+	seq_puts(file, "latency buckets (us): <1");
+	for (lat = 1; lat < MORSE_BUS_STAT_LAT_BUCKETS - 1; lat++)
+		seq_printf(file, " <%u", 1U << lat);
+	seq_printf(file, " >=%u\n", 1U << (MORSE_BUS_STAT_LAT_BUCKETS - 2));
+
+	for (seg = 0; seg < MORSE_PKT_LAT_NUM_SEGS; seg++) {
+		seq_printf(file, "%s:\n", morse_pkt_lat_segs[seg].name);
+
+		for (aci = 0; aci < IEEE80211_NUM_ACS; aci++) {
+			const unsigned int *hist = sum->hist[seg][aci];
+			unsigned int samples = 0;
+
+			for (lat = 0; lat < MORSE_BUS_STAT_LAT_BUCKETS; lat++)
+				samples += hist[lat];
+			if (!samples)
+				continue;
+
+			seq_printf(file, "\t%s: samples %u mean (ns) %llu max (ns) %llu\n",
+				   morse_aci_names[aci], samples,
+				   div_u64(sum->total_ns[seg][aci], samples),
+				   sum->max_ns[seg][aci]);
+			seq_puts(file, "\t   ");
+			for (lat = 0; lat < MORSE_BUS_STAT_LAT_BUCKETS; lat++)
+				seq_printf(file, " %u", hist[lat]);
+			seq_puts(file, "\n");
+		}
+	}
+
+	kfree(sum);
+	return 0;
+}
+
+static int morse_pkt_lat_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, morse_pkt_lat_stats_show, inode->i_private);
+}
+
+/* Any write clears the statistics and restarts the window */
+static ssize_t morse_pkt_lat_stats_write(struct file *file, const char __user *user_buf,
+					 size_t count, loff_t *ppos)
+{
+	struct morse *mors = ((struct seq_file *)file->private_data)->private;
+
+	morse_pkt_lat_stats_reset(mors);
+
+	return count;
+}
+
+static const struct file_operations pkt_lat_stats_fops = {
+	.open = morse_pkt_lat_stats_open,
+	.read = seq_read,
+	.write = morse_pkt_lat_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static const char * const morse_boot_phase_names[MORSE_BOOT_PHASE_NUM] = {
+	[MORSE_BOOT_PHASE_BUS_PROBE] = "bus probe",
+	[MORSE_BOOT_PHASE_RESTART] = "restart",
+	[MORSE_BOOT_PHASE_FW_REQUEST] = "firmware request",
+	[MORSE_BOOT_PHASE_CHIP_RESET] = "chip reset",
+	[MORSE_BOOT_PHASE_FW_DOWNLOAD] = "firmware download",
+	[MORSE_BOOT_PHASE_BCF_LOAD] = "BCF load",
+	[MORSE_BOOT_PHASE_FW_BOOT] = "firmware boot",
+	[MORSE_BOOT_PHASE_MAC_INIT] = "mac init",
+	[MORSE_BOOT_PHASE_MAC_REGISTER] = "mac register",
+	[MORSE_BOOT_PHASE_FIRST_LINK] = "first link",
+};
+
+static u64 morse_boot_offset_us(const struct morse *mors, u64 ns)
+{
+	return div_u64(ns - mors->debug.boot.origin_ns, NSEC_PER_USEC);
+}
+
+void morse_boot_timeline_start(struct morse *mors, bool restart)
+{
+	struct morse_boot_timeline *boot = &mors->debug.boot;
+
+	memset(boot, 0, sizeof(*boot));
+	boot->origin_ns = ktime_get_ns();
+	boot->restart = restart;
+}
+
+void morse_boot_phase_begin(struct morse *mors, enum morse_boot_phase phase)
+{
+	struct morse_boot_timeline *boot = &mors->debug.boot;
+	u64 now_ns = ktime_get_ns();
+
+	boot->begin_ns[phase] = now_ns;
+	boot->end_ns[phase] = 0;
+	if (boot->attempts[phase] < U8_MAX)
+		boot->attempts[phase]++;
+	trace_morse_boot_phase(mors, phase, true, morse_boot_offset_us(mors, now_ns), 0);
+}
+
+void morse_boot_phase_end(struct morse *mors, enum morse_boot_phase phase, int ret)
+{
+	struct morse_boot_timeline *boot = &mors->debug.boot;
+	u64 now_ns = ktime_get_ns();
+
+	/* Ending a phase that was not begun records a point in time, once per timeline */
+	if (!boot->begin_ns[phase])
+		boot->begin_ns[phase] = now_ns;
+	else if (boot->end_ns[phase])
+		return;
+
+	boot->end_ns[phase] = now_ns;
+	boot->ret[phase] = ret;
+	trace_morse_boot_phase(mors, phase, false, morse_boot_offset_us(mors, now_ns), ret);
+}
 
-#undef __generate_log_fn
+static int read_boot_timeline(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+	const struct morse_boot_timeline *boot = &mors->debug.boot;
+	int phase;
 
-void morse_init_log_levels(u8 lvl)
+	seq_printf(file, "timeline: %s\n", boot->restart ? "restart" : "probe");
+	seq_printf(file, "%-18s %12s %12s %8s %4s\n", "phase", "start(us)", "duration(us)",
+		   "attempts", "ret");
+
+	for (phase = 0; phase < MORSE_BOOT_PHASE_NUM; phase++) {
+		if (!boot->begin_ns[phase])
+			continue;
+
+		seq_printf(file, "%-18s %12llu ", morse_boot_phase_names[phase],
+			   morse_boot_offset_us(mors, boot->begin_ns[phase]));
+		if (boot->end_ns[phase])
+			seq_printf(file, "%12llu ", div_u64(boot->end_ns[phase] -
+							    boot->begin_ns[phase], NSEC_PER_USEC));
+		else
+			seq_printf(file, "%12s ", "running");
+		seq_printf(file, "%8u %4d\n", boot->attempts[phase], boot->ret[phase]);
+	}
+
+	return 0;
+}
+
+static int read_duty_cycle_budget(struct seq_file *file, void *data)
 {
-	int id;
+	struct morse *mors = dev_get_drvdata(file->private);
 
-	for (id = 0; id < NUM_FEATURE_IDS; id++)
-		log_mask[id] = lvl;
+	morse_mac_duty_cycle_budget_show(mors, file);
+
+	return 0;
 }
 
-bool morse_log_is_enabled(enum morse_feature_id id, u8 level)
+static int read_ecsa_stats(struct seq_file *file, void *data)
 {
-	return (bool)(log_mask[id] >= level);
+	struct morse *mors = dev_get_drvdata(file->private);
+	const struct morse_ecsa_stats *stats = &mors->debug.ecsa_stats;
+
+	seq_printf(file, "switches: %u\n", stats->switches);
+	seq_printf(file, "in progress: %s\n", atomic64_read(&stats->start_ns) ? "yes" : "no");
+	seq_printf(file, "last outage(us): %u\n", stats->last_outage_us);
+	seq_printf(file, "max outage(us): %u\n", stats->max_outage_us);
+	seq_printf(file, "avg outage(us): %llu\n", stats->switches ?
+		   div_u64(stats->total_outage_us, stats->switches) : 0);
+
+	return 0;
 }
 
-static int morse_log_add_debugfs(struct morse *mors)
+static int morse_cmd_stats_open_show(struct seq_file *file, void *data)
 {
-	enum morse_feature_id id;
+	return morse_cmd_stats_show(file->private, file);
+}
 
-	if (!mors->debug.debugfs_phy)
-		return -ENODEV;
+static int morse_cmd_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, morse_cmd_stats_open_show, inode->i_private);
+}
 
-	mors->debug.debugfs_logging = debugfs_create_dir("logging", mors->debug.debugfs_phy);
-	if (!mors->debug.debugfs_logging)
-		return -ENODEV;
+/* Any write clears the statistics */
+static ssize_t morse_cmd_stats_write(struct file *file, const char __user *user_buf,
+				     size_t count, loff_t *ppos)
+{
+	struct morse *mors = ((struct seq_file *)file->private_data)->private;
 
-	for (id = 0; id < ARRAY_SIZE(morse_log_features); id++) {
-		debugfs_create_u8(morse_log_features[id], 0600,
-				  mors->debug.debugfs_logging, &log_mask[id]);
-	}
+	morse_cmd_stats_reset(mors);
 
-	return 0;
+	return count;
 }
 
-static void morse_log_remove_debugfs(struct morse *mors)
+static const struct file_operations cmd_stats_fops = {
+	.open = morse_cmd_stats_open,
+	.read = seq_read,
+	.write = morse_cmd_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int morse_ps_stats_open_show(struct seq_file *file, void *data)
 {
-	debugfs_remove_recursive(mors->debug.debugfs_logging);
-	mors->debug.debugfs_logging = NULL;
+	return morse_ps_stats_show(file->private, file);
 }
 
-static void print_stat(struct seq_file *file, const char *desc, u32 val)
+static int morse_ps_stats_open(struct inode *inode, struct file *file)
 {
-	seq_printf(file, "%s: %u\n", desc, val);
+	return single_open(file, morse_ps_stats_open_show, inode->i_private);
 }
 
-static int read_page_stats(struct seq_file *file, void *data)
+/* Any write clears the statistics */
+static ssize_t morse_ps_stats_write(struct file *file, const char __user *user_buf,
+				    size_t count, loff_t *ppos)
 {
-	struct morse *mors = dev_get_drvdata(file->private);
+	struct morse *mors = ((struct seq_file *)file->private_data)->private;
 
-	print_stat(file, "Command Tx", mors->debug.page_stats.cmd_tx);
-	print_stat(file, "Beacon Tx", mors->debug.page_stats.bcn_tx);
-	print_stat(file, "Management Tx", mors->debug.page_stats.mgmt_tx);
-	print_stat(file, "Data Tx", mors->debug.page_stats.data_tx);
-	print_stat(file, "Page write fail", mors->debug.page_stats.write_fail);
-	print_stat(file, "No page", mors->debug.page_stats.no_page);
-	print_stat(file, "No command page", mors->debug.page_stats.cmd_no_page);
-	print_stat(file, "Command page retry", mors->debug.page_stats.cmd_rsv_page_retry);
-	print_stat(file, "No beacon page", mors->debug.page_stats.bcn_no_page);
-	print_stat(file, "Excessive beacon loss", mors->debug.page_stats.excessive_bcn_loss);
-	print_stat(file, "Queue stop", mors->debug.page_stats.queue_stop);
-	print_stat(file, "Popped page owned by chip", mors->debug.page_stats.page_owned_by_chip);
-	print_stat(file, "Tx aged out", mors->debug.page_stats.tx_aged_out);
-	print_stat(file, "TX ps filtered", mors->debug.page_stats.tx_ps_filtered);
-	print_stat(file, "Stale tx status flushed", mors->debug.page_stats.tx_status_flushed);
-	print_stat(file, "TX status invalid", mors->debug.page_stats.tx_status_page_invalid);
-	print_stat(file, "TX dropped due to duty cycle",
-		   mors->debug.page_stats.tx_status_duty_cycle_cant_send);
-	print_stat(file, "TX with retries disabled to duty cycle",
-		   mors->debug.page_stats.tx_duty_cycle_retry_disabled);
-	print_stat(file, "TX status dropped", mors->debug.page_stats.tx_status_dropped);
-	print_stat(file, "RX empty queue", mors->debug.page_stats.rx_empty);
-	print_stat(file, "RX packet split across window", mors->debug.page_stats.rx_split);
-	print_stat(file, "RX invalid byte count", mors->debug.page_stats.rx_invalid_count);
-	print_stat(file, "Invalid checksum", mors->debug.page_stats.invalid_checksum);
-	print_stat(file, "Invalid TX status checksum",
-		mors->debug.page_stats.invalid_tx_status_checksum);
+	morse_ps_stats_reset(mors);
 
-	return 0;
+	return count;
 }
 
+static const struct file_operations ps_stats_fops = {
+	.open = morse_ps_stats_open,
+	.read = seq_read,
+	.write = morse_ps_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 #if defined(CONFIG_MORSE_DEBUG_IRQ)
 static int read_hostsync_stats(struct seq_file *file, void *data)
 {
@@ -247,6 +1081,7 @@ static int read_vendor_info_tbl(struct seq_file *file, void *data)
 		   mors->sw_ver.minor, mors->sw_ver.patch);
 	seq_printf(file, "    HW version: 0x%08x\n", mors->chip_id);
 	seq_printf(file, "    Rate control: %s\n", rc_method_to_string(mors->rc_method));
+	rcu_read_lock();
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
 		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
 		struct morse_vif *mors_vif;
@@ -291,6 +1126,7 @@ static int read_vendor_info_tbl(struct seq_file *file, void *data)
 			read_vendor_operations(file, &mors_vif->bss_vendor_info.operations);
 		}
 	}
+	rcu_read_unlock();
 
 	return 0;
 }
@@ -302,6 +1138,7 @@ static int dump_raw_configs(struct seq_file *file, void *data)
 	struct morse_raw_config *config;
 	struct morse *mors = dev_get_drvdata(file->private);
 
+	rcu_read_lock();
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
 		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
 		struct morse_vif *mors_vif;
@@ -348,6 +1185,7 @@ static int dump_raw_configs(struct seq_file *file, void *data)
 			seq_puts(file, "\n");
 		}
 	}
+	rcu_read_unlock();
 	return 0;
 }
 
@@ -374,6 +1212,17 @@ static int read_file_yaps(struct seq_file *file, void *data)
 	return 0;
 }
 
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+static int read_file_pageset_benchmark(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+
+	morse_pageset_benchmark(mors, file);
+
+	return 0;
+}
+#endif
+
 #ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
 static int read_file_yaps_benchmark(struct seq_file *file, void *data)
 {
@@ -383,8 +1232,27 @@ static int read_file_yaps_benchmark(struct seq_file *file, void *data)
 
 	return 0;
 }
+
+static int read_file_yaps_crc_benchmark(struct seq_file *file, void *data)
+{
+	morse_yaps_crc_benchmark(file);
+
+	return 0;
+}
 #endif
 
+static int read_file_tx_benchmark(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+
+	return morse_mac_tx_benchmark(mors, file);
+}
+
+static int read_file_dot11ah_benchmark(struct seq_file *file, void *data)
+{
+	return morse_dot11ah_benchmark(file);
+}
+
 static int read_skbq_mon_tbl(struct seq_file *file, void *data)
 {
 	struct morse *mors = dev_get_drvdata(file->private);
@@ -433,6 +1301,7 @@ static int read_vendor_ies(struct seq_file *file, void *data)
 	int i;
 	int vif_id;
 
+	rcu_read_lock();
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
 		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
 		struct morse_vif *mors_vif;
@@ -457,6 +1326,7 @@ static int read_vendor_ies(struct seq_file *file, void *data)
 		}
 		spin_unlock_bh(&mors_vif->vendor_ie.lock);
 	}
+	rcu_read_unlock();
 	return 0;
 }
 
@@ -468,6 +1338,7 @@ static int read_vendor_ie_oui_filter(struct seq_file *file, void *data)
 
 	seq_puts(file, "OUI Filters:\n");
 
+	rcu_read_lock();
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
 		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
 		struct morse_vif *mors_vif;
@@ -485,6 +1356,7 @@ static int read_vendor_ie_oui_filter(struct seq_file *file, void *data)
 		}
 		spin_unlock_bh(&mors_vif->vendor_ie.lock);
 	}
+	rcu_read_unlock();
 
 	return 0;
 }
@@ -575,7 +1447,7 @@ static ssize_t morse_debug_driver_restart_write(struct file *file, const char __
 		return -EINVAL;
 	if (value != 1)
 		return -EINVAL;
-	schedule_work(&mors->driver_restart);
+	queue_work(system_long_wq, &mors->driver_restart);
 	return count;
 }
 
@@ -587,6 +1459,28 @@ static const struct file_operations driver_restart_fops = {
 	.write = morse_debug_driver_restart_write,
 };
 
+static ssize_t morse_debug_coredump_abort_write(struct file *file, const char __user *user_buf,
+						size_t count, loff_t *ppos)
+{
+	struct morse *mors = file->private_data;
+	u8 value;
+
+	if (kstrtou8_from_user(user_buf, count, 0, &value))
+		return -EINVAL;
+	if (value != 1)
+		return -EINVAL;
+	morse_coredump_abort(mors);
+	return count;
+}
+
+static const struct file_operations coredump_abort_fops = {
+	.open = simple_open,
+#if KERNEL_VERSION(6, 12, 0) > LINUX_VERSION_CODE
+	.llseek = no_llseek,
+#endif
+	.write = morse_debug_coredump_abort_write,
+};
+
 static ssize_t morse_debug_watchdog_write(struct file *file, const char __user *user_buf,
 					  size_t count, loff_t *ppos)
 {
@@ -637,18 +1531,89 @@ static const struct file_operations reset_required_fops = {
 	.read = morse_debug_reset_required_read,
 };
 
-struct hostif_log_item {
-	struct list_head list;
-	u64 timestamp;
-	int length;
-	int to_chip;
-	int channel;
-	u8 data[];
+#ifdef CONFIG_MORSE_ENABLE_TEST_MODES
+#define BUS_PROFILE_BUF_SIZE	(32 * 1024)
+
+/* Write the number of calls per combination to run the bus profiler */
+static ssize_t morse_debug_bus_profile_write(struct file *file, const char __user *user_buf,
+					     size_t count, loff_t *ppos)
+{
+	struct morse *mors = file->private_data;
+	char *buf;
+	u32 rounds;
+	int ret;
+
+	if (kstrtou32_from_user(user_buf, count, 0, &rounds))
+		return -EINVAL;
+
+	buf = vmalloc(BUS_PROFILE_BUF_SIZE);
+	if (!buf)
+		return -ENOMEM;
+
+	ret = morse_bus_profile(mors, rounds, buf, BUS_PROFILE_BUF_SIZE);
+	if (ret < 0) {
+		vfree(buf);
+		return ret;
+	}
+
+	mutex_lock(&mors->debug.bus_profile.lock);
+	vfree(mors->debug.bus_profile.buf);
+	mors->debug.bus_profile.buf = buf;
+	mors->debug.bus_profile.len = ret;
+	mutex_unlock(&mors->debug.bus_profile.lock);
+
+	/* The profiler scribbles over chip data memory, restart to recover */
+	MORSE_WARN(mors, "Bus profile complete, restarting the chip\n");
+	queue_work(system_long_wq, &mors->driver_restart);
+
+	return count;
+}
+
+static ssize_t morse_debug_bus_profile_read(struct file *file, char __user *user_buf,
+					    size_t count, loff_t *ppos)
+{
+	struct morse *mors = file->private_data;
+	ssize_t ret = 0;
+
+	mutex_lock(&mors->debug.bus_profile.lock);
+	if (mors->debug.bus_profile.buf)
+		ret = simple_read_from_buffer(user_buf, count, ppos,
+					      mors->debug.bus_profile.buf,
+					      mors->debug.bus_profile.len);
+	mutex_unlock(&mors->debug.bus_profile.lock);
+
+	return ret;
+}
+
+static const struct file_operations bus_profile_fops = {
+	.open = simple_open,
+#if KERNEL_VERSION(6, 12, 0) > LINUX_VERSION_CODE
+	.llseek = no_llseek,
+#endif
+	.write = morse_debug_bus_profile_write,
+	.read = morse_debug_bus_profile_read,
 };
+#endif
+
+DEFINE_STATIC_KEY_FALSE(morse_hostif_log_active);
+
+static inline struct morse_hostif_log_ring_hdr *morse_hostif_log_ring(void *rings, u32 size,
+								      int cpu)
+{
+	return rings + (size_t)cpu * MORSE_HOSTIF_LOG_RING_STRIDE(size);
+}
+
+static inline u8 *morse_hostif_log_ring_data(struct morse_hostif_log_ring_hdr *ring)
+{
+	return (u8 *)ring + PAGE_SIZE;
+}
 
 static int morse_debug_fw_hostif_log_open(struct inode *inode, struct file *file)
 {
 	struct morse *mors = (struct morse *)inode->i_private;
+	u32 size = roundup_pow_of_two(clamp_t(u32, hostif_log_ring_kb, 4, SZ_64K) * SZ_1K);
+	void *rings;
+	int cpu;
 
 	if (!mors)
 		return -EINVAL;
@@ -659,71 +1624,153 @@ static int morse_debug_fw_hostif_log_open(struct inode *inode, struct file *file
 		return -EINVAL;
 
 	/* For now only allow one client */
-	if (mors->debug.hostif_log.active_clients >= 1) {
+	if (mors->debug.hostif_log.active_clients >= 1 || mors->debug.hostif_log.rings_mem) {
 		mutex_unlock(&mors->debug.hostif_log.lock);
 		return -ENOSPC;
 	}
 
+	rings = vmalloc_user((size_t)nr_cpu_ids * MORSE_HOSTIF_LOG_RING_STRIDE(size));
+	if (!rings) {
+		mutex_unlock(&mors->debug.hostif_log.lock);
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu)
+		morse_hostif_log_ring(rings, size, cpu)->size = size;
+
+	mors->debug.hostif_log.ring_size = size;
+	mors->debug.hostif_log.rings_mem = rings;
+	rcu_assign_pointer(mors->debug.hostif_log.rings, rings);
 	mors->debug.hostif_log.active_clients++;
 	mutex_unlock(&mors->debug.hostif_log.lock);
 
+	static_branch_inc(&morse_hostif_log_active);
+
 	return 0;
 }
 
-static void morse_debug_fw_hostif_log_flush(struct morse *mors)
+/* Stop producers from writing to the rings, must be called with the log lock held */
+static void morse_debug_fw_hostif_log_unpublish(struct morse *mors)
 {
-	struct list_head *curr, *next;
-
-	if (mutex_lock_interruptible(&mors->debug.hostif_log.lock) != 0)
-		return;
-	list_for_each_safe(curr, next, &mors->debug.hostif_log.items) {
-		list_del(curr);
-		kfree(curr);
-	}
-	mutex_unlock(&mors->debug.hostif_log.lock);
+	RCU_INIT_POINTER(mors->debug.hostif_log.rings, NULL);
+	synchronize_rcu();
 }
 
 static int morse_debug_fw_hostif_log_release(struct inode *inode, struct file *file)
 {
 	struct morse *mors = (struct morse *)file->private_data;
 
-	if (mutex_lock_interruptible(&mors->debug.hostif_log.lock) != 0)
-		return -EINVAL;
+	static_branch_dec(&morse_hostif_log_active);
+
+	/* Need to grab this lock, no interruptions, as the rings must be freed */
+	mutex_lock(&mors->debug.hostif_log.lock);
 
-	mors->debug.hostif_log.active_clients--;
+	if (mors->debug.hostif_log.active_clients > 0)
+		mors->debug.hostif_log.active_clients--;
 
-	if (mors->debug.hostif_log.active_clients == 0)
-		morse_debug_fw_hostif_log_flush((struct morse *)file->private_data);
+	morse_debug_fw_hostif_log_unpublish(mors);
+	vfree(mors->debug.hostif_log.rings_mem);
+	mors->debug.hostif_log.rings_mem = NULL;
 
 	mutex_unlock(&mors->debug.hostif_log.lock);
 
 	return 0;
 }
 
-static ssize_t morse_debug_fw_hostif_log_read(struct file *file,
-					      char __user *user_buf, size_t count, loff_t *ppos)
+/**
+ * morse_debug_fw_hostif_log_next() - Get the oldest record across all CPU rings.
+ *
+ * @mors: Morse chip struct
+ * @ring_out: set to the ring holding the record
+ * @len_out: set to the length of the record data
+ *
+ * Padding records are consumed on the way. Must be called with the log lock held.
+ *
+ * Return: the oldest record, or NULL if all rings are empty.
+ */
+static struct morse_hostif_log_rec *morse_debug_fw_hostif_log_next(struct morse *mors,
+						struct morse_hostif_log_ring_hdr **ring_out,
+						u32 *len_out)
 {
-	struct morse *mors = (struct morse *)file->private_data;
-	struct list_head *curr;
-	bool is_list_empty;
-	struct hostif_log_item *item;
-	u8 header_buf[sizeof(item->timestamp) + sizeof(item->to_chip)];
-	int length = sizeof(header_buf);
+	void *rings = mors->debug.hostif_log.rings_mem;
+	u32 size = mors->debug.hostif_log.ring_size;
+	struct morse_hostif_log_rec *oldest = NULL;
+	int cpu;
 
-	if (mutex_lock_interruptible(&mors->debug.hostif_log.lock) != 0)
-		return -ERESTARTSYS;
+	if (!rings)
+		return NULL;
 
-	is_list_empty = list_empty(&mors->debug.hostif_log.items);
-	mutex_unlock(&mors->debug.hostif_log.lock);
+	for_each_possible_cpu(cpu) {
+		struct morse_hostif_log_ring_hdr *ring = morse_hostif_log_ring(rings, size, cpu);
+		struct morse_hostif_log_rec *rec;
+		u32 tail = READ_ONCE(ring->tail) & ~(MORSE_HOSTIF_LOG_REC_ALIGN - 1);
+		u32 len;
+
+		if (smp_load_acquire(&ring->head) == tail)
+			continue;
 
-	if (is_list_empty && (file->f_flags & O_NONBLOCK))
-		return -EWOULDBLOCK;
+		rec = (struct morse_hostif_log_rec *)(morse_hostif_log_ring_data(ring) +
+						      (tail & (size - 1)));
+		if (READ_ONCE(rec->length) == MORSE_HOSTIF_LOG_REC_PAD) {
+			tail += size - (tail & (size - 1));
+			smp_store_release(&ring->tail, tail);
+			if (smp_load_acquire(&ring->head) == tail)
+				continue;
+			rec = (struct morse_hostif_log_rec *)morse_hostif_log_ring_data(ring);
+		}
 
-	if (is_list_empty &&
-	    wait_event_interruptible(mors->debug.hostif_log.waitqueue,
-				     !list_empty(&mors->debug.hostif_log.items) ||
-				     mors->debug.hostif_log.active_clients == 0)) {
-		return -ERESTARTSYS;
+		/* The header is shared with mmap readers, don't trust it to stay in the ring */
+		len = READ_ONCE(rec->length);
+		if (len > size - ((u8 *)rec->data - morse_hostif_log_ring_data(ring)))
+			continue;
+
+		if (!oldest || rec->timestamp < oldest->timestamp) {
+			oldest = rec;
+			*ring_out = ring;
+			*len_out = len;
+		}
+	}
+
+	return oldest;
+}
+
+static bool morse_debug_fw_hostif_log_empty(struct morse *mors)
+{
+	void *rings = mors->debug.hostif_log.rings_mem;
+	u32 size = mors->debug.hostif_log.ring_size;
+	int cpu;
+
+	if (!rings)
+		return true;
+
+	for_each_possible_cpu(cpu) {
+		struct morse_hostif_log_ring_hdr *ring = morse_hostif_log_ring(rings, size, cpu);
+
+		if (smp_load_acquire(&ring->head) != READ_ONCE(ring->tail))
+			return false;
+	}
+
+	return true;
+}
+
+static ssize_t morse_debug_fw_hostif_log_read(struct file *file,
+					      char __user *user_buf, size_t count, loff_t *ppos)
+{
+	struct morse *mors = (struct morse *)file->private_data;
+	struct morse_hostif_log_ring_hdr *ring = NULL;
+	struct morse_hostif_log_rec *rec;
+	const size_t header_len = offsetof(struct morse_hostif_log_rec, length);
+	ssize_t length;
+	u32 len = 0;
+
+	if (morse_debug_fw_hostif_log_empty(mors)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EWOULDBLOCK;
+
+		if (wait_event_interruptible(mors->debug.hostif_log.waitqueue,
+					     !morse_debug_fw_hostif_log_empty(mors) ||
+					     mors->debug.hostif_log.active_clients == 0))
+			return -ERESTARTSYS;
 	}
 
 	if (mutex_lock_interruptible(&mors->debug.hostif_log.lock) != 0)
@@ -737,43 +1784,95 @@ static ssize_t morse_debug_fw_hostif_log_read(struct file *file,
 		return -EINVAL;
 	}
 
-	/* Because the list_empty check as part of the wait event isn't protected
-	 * by the mutex, we check here again that it still has items. If not,
-	 * return this error so the read is tried again.
+	/* The ring may have been drained by an mmap reader since the wait, so ask for the
+	 * read to be retried.
 	 */
-	if (list_empty(&mors->debug.hostif_log.items)) {
+	rec = morse_debug_fw_hostif_log_next(mors, &ring, &len);
+	if (!rec) {
 		mutex_unlock(&mors->debug.hostif_log.lock);
 		return -ERESTARTSYS;
 	}
 
-	curr = mors->debug.hostif_log.items.next;
-	list_del(curr);
+	length = header_len + len;
+
+	/* We put the timestamp at the start, followed by the indication of to_chip */
+	if (count >= length &&
+	    (copy_to_user(user_buf, rec, header_len) ||
+	     copy_to_user(user_buf + header_len, rec->data, len)))
+		length = -EFAULT;
+
+	smp_store_release(&ring->tail, (READ_ONCE(ring->tail) & ~(MORSE_HOSTIF_LOG_REC_ALIGN - 1)) +
+			  ALIGN(sizeof(*rec) + len, MORSE_HOSTIF_LOG_REC_ALIGN));
 	mutex_unlock(&mors->debug.hostif_log.lock);
 
-	item = list_entry(curr, struct hostif_log_item, list);
-	length += item->length;
+	return length;
+}
+
+static int morse_debug_fw_hostif_log_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct morse *mors = (struct morse *)file->private_data;
+	int ret = -EINVAL;
+
+	mutex_lock(&mors->debug.hostif_log.lock);
+	if (mors->debug.hostif_log.rings_mem)
+		ret = remap_vmalloc_range(vma, mors->debug.hostif_log.rings_mem, vma->vm_pgoff);
+	mutex_unlock(&mors->debug.hostif_log.lock);
 
-	if (count >= length) {
-		/* We put the timestamp at the start, followed by the indication of to_chip */
-		memcpy(header_buf, &item->timestamp, sizeof(item->timestamp));
-		memcpy(&header_buf[sizeof(item->timestamp)], &item->to_chip, sizeof(item->to_chip));
+	return ret;
+}
 
-		if (copy_to_user(user_buf, header_buf, sizeof(header_buf)) ||
-		    copy_to_user(user_buf + sizeof(header_buf), item->data, item->length)) {
-			return -EFAULT;
-		}
+/**
+ * morse_hostif_log_ring_put() - Append a frame to a ring.
+ *
+ * Each ring has a single producer, the CPU it belongs to, so this must be called with
+ * interrupts disabled on that CPU. Frames that do not fit are dropped and counted rather
+ * than overwriting records the reader has not consumed.
+ *
+ * Return: true if the frame was logged.
+ */
+static bool morse_hostif_log_ring_put(struct morse_hostif_log_ring_hdr *ring, u32 size,
+				      int to_chip, struct sk_buff *skb)
+{
+	u32 rec_len = ALIGN(sizeof(struct morse_hostif_log_rec) + skb->len,
+			    MORSE_HOSTIF_LOG_REC_ALIGN);
+	/* The header is shared with mmap readers, so keep offsets aligned and in the ring */
+	u32 head = READ_ONCE(ring->head) & ~(MORSE_HOSTIF_LOG_REC_ALIGN - 1);
+	u32 tail = smp_load_acquire(&ring->tail);
+	u32 offset = head & (size - 1);
+	u32 to_end = size - offset;
+	u32 needed = rec_len + (to_end < rec_len ? to_end : 0);
+	struct morse_hostif_log_rec *rec;
+
+	if (rec_len > size || (head - tail) + needed > size) {
+		WRITE_ONCE(ring->overruns, ring->overruns + 1);
+		return false;
+	}
+
+	rec = (struct morse_hostif_log_rec *)(morse_hostif_log_ring_data(ring) + offset);
+	if (to_end < rec_len) {
+		/* Records are aligned so the padding header always fits */
+		rec->length = MORSE_HOSTIF_LOG_REC_PAD;
+		head += to_end;
+		rec = (struct morse_hostif_log_rec *)morse_hostif_log_ring_data(ring);
 	}
 
-	kfree(curr);
+	rec->timestamp = ktime_to_ns(ktime_get());
+	rec->to_chip = to_chip;
+	rec->length = skb->len;
+	memcpy(rec->data, skb->data, skb->len);
 
-	return length;
+	smp_store_release(&ring->head, head + rec_len);
+
+	return true;
 }
 
-void morse_debug_fw_hostif_log_record(struct morse *mors, int to_chip,
-				      struct sk_buff *skb, struct morse_buff_skb_header *hdr)
+void __morse_debug_fw_hostif_log_record(struct morse *mors, int to_chip,
+					struct sk_buff *skb, struct morse_buff_skb_header *hdr)
 {
-	struct hostif_log_item *item;
-	struct timespec64 time_now;
+	void *rings;
+	unsigned long flags;
+	bool logged;
+	u32 size;
 	int hostif_log_mask = 0;
 
 	/* The channel values don't lend themselves well to bitmasks, so we have a mapping */
@@ -790,41 +1889,36 @@ void morse_debug_fw_hostif_log_record(struct morse *mors, int to_chip,
 	}
 
 	/* If this channel isn't enabled in the mask, exit */
-	if ((mors->debug.hostif_log.enabled_channel_mask & hostif_log_mask) == 0)
-		return;
-
-	if (mutex_lock_interruptible(&mors->debug.hostif_log.lock) != 0)
+	if ((READ_ONCE(mors->debug.hostif_log.enabled_channel_mask) & hostif_log_mask) == 0)
 		return;
-	if (mors->debug.hostif_log.active_clients == 0)
-		goto exit;
-
-	item = kmalloc(sizeof(*item) + skb->len, GFP_KERNEL);
 
-	if (!item)
+	rcu_read_lock();
+	rings = rcu_dereference(mors->debug.hostif_log.rings);
+	if (!rings)
 		goto exit;
 
-	item->length = skb->len;
-	item->to_chip = to_chip;
-	item->channel = hdr->channel;
-	jiffies_to_timespec64(get_jiffies_64(), &time_now);
-	item->timestamp = (time_now.tv_sec * NSEC_PER_SEC) + time_now.tv_nsec;
-	memcpy(item->data, skb->data, skb->len);
+	size = mors->debug.hostif_log.ring_size;
+	local_irq_save(flags);
+	logged = morse_hostif_log_ring_put(morse_hostif_log_ring(rings, size, smp_processor_id()),
+					   size, to_chip, skb);
+	local_irq_restore(flags);
 
-	list_add_tail(&item->list, &mors->debug.hostif_log.items);
-
-	wake_up_interruptible_all(&mors->debug.hostif_log.waitqueue);
+	if (logged && wq_has_sleeper(&mors->debug.hostif_log.waitqueue))
+		wake_up_interruptible_all(&mors->debug.hostif_log.waitqueue);
 exit:
-	mutex_unlock(&mors->debug.hostif_log.lock);
+	rcu_read_unlock();
 }
 
 static void morse_debug_fw_hostif_log_destroy(struct morse *mors)
 {
-	/* Need to grab this lock, no interruptions */
+	/* Need to grab this lock, no interruptions. The rings are freed when the client
+	 * releases the file, as they may still be mapped.
+	 */
 	mutex_lock(&mors->debug.hostif_log.lock);
 	mors->debug.hostif_log.active_clients = 0;
+	morse_debug_fw_hostif_log_unpublish(mors);
 	mutex_unlock(&mors->debug.hostif_log.lock);
 	wake_up_all(&mors->debug.hostif_log.waitqueue);
-	morse_debug_fw_hostif_log_flush(mors);
 }
 
 static const struct file_operations fw_hostif_log_fops = {
@@ -834,8 +1928,37 @@ static const struct file_operations fw_hostif_log_fops = {
 	.llseek = no_llseek,
 #endif
 	.read = morse_debug_fw_hostif_log_read,
+	.mmap = morse_debug_fw_hostif_log_mmap,
 };
 
+static int read_hostif_log_stats(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+	void *rings;
+	u32 size;
+	int cpu;
+
+	mutex_lock(&mors->debug.hostif_log.lock);
+	rings = mors->debug.hostif_log.rings_mem;
+	size = mors->debug.hostif_log.ring_size;
+	if (!rings) {
+		seq_puts(file, "no active client\n");
+		goto exit;
+	}
+
+	seq_printf(file, "ring size (bytes): %u\n", size);
+	for_each_possible_cpu(cpu) {
+		struct morse_hostif_log_ring_hdr *ring = morse_hostif_log_ring(rings, size, cpu);
+
+		seq_printf(file, "cpu%d: used %u overruns %u\n", cpu,
+			   READ_ONCE(ring->head) - READ_ONCE(ring->tail),
+			   READ_ONCE(ring->overruns));
+	}
+exit:
+	mutex_unlock(&mors->debug.hostif_log.lock);
+	return 0;
+}
+
 static ssize_t morse_debug_hostif_log_config_write(struct file *file, const char __user *user_buf,
 						   size_t count, loff_t *ppos)
 {
@@ -844,7 +1967,7 @@ static ssize_t morse_debug_hostif_log_config_write(struct file *file, const char
 
 	if (kstrtou8_from_user(user_buf, count, 0, &value))
 		return -EINVAL;
-	mors->debug.hostif_log.enabled_channel_mask = value;
+	WRITE_ONCE(mors->debug.hostif_log.enabled_channel_mask, value);
 	return count;
 }
 
@@ -870,19 +1993,13 @@ static const struct file_operations fw_hostif_log_config_fops = {
 };
 #endif
 
-#ifndef CONFIG_MORSE_DEBUGFS
-void morse_debug_fw_hostif_log_record(struct morse *mors, int to_chip,
-				      struct sk_buff *skb, struct morse_buff_skb_header *hdr)
-{
-}
-#endif
-
 static int read_ap_info(struct seq_file *file, void *data)
 {
 	int i;
 	int vif_id;
 	struct morse *mors = dev_get_drvdata(file->private);
 
+	rcu_read_lock();
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
 		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
 		struct morse_vif *mors_vif;
@@ -898,6 +2015,15 @@ static int read_ap_info(struct seq_file *file, void *data)
 			seq_printf(file, "%s Info\n", morse_vif_name(vif));
 			seq_printf(file, "  Largest AID: %u\n", mors_vif->ap->largest_aid);
 			seq_printf(file, "  Num assoc STAs: %u\n", mors_vif->ap->num_stas);
+			seq_printf(file, "  TIM blocks reused: %u\n", mors_vif->ap->tim_cache.hits);
+			seq_printf(file, "  TIM blocks encoded: %u\n", mors_vif->ap->tim_cache.misses);
+			seq_printf(file, "  TIM blocks by mode (block/aid/olb/ade): %u/%u/%u/%u\n",
+				   mors_vif->ap->tim_cache.mode_count[ENC_MODE_BLOCK],
+				   mors_vif->ap->tim_cache.mode_count[ENC_MODE_AID],
+				   mors_vif->ap->tim_cache.mode_count[ENC_MODE_OLB],
+				   mors_vif->ap->tim_cache.mode_count[ENC_MODE_ADE]);
+			seq_printf(file, "  TIM bytes saved: %llu\n",
+				   mors_vif->ap->tim_cache.bytes_saved);
 			seq_puts(file, "  AID bitmap (LSB first, bit 0 is AID 0):\n\t");
 
 			/* Print bitmap as binary, e.g. 01101100 */
@@ -914,6 +2040,7 @@ static int read_ap_info(struct seq_file *file, void *data)
 			seq_puts(file, "\n");
 		}
 	}
+	rcu_read_unlock();
 
 	return 0;
 }
@@ -923,6 +2050,7 @@ static int read_twt_sta_agreements(struct seq_file *file, void *data)
 	int vif_id;
 	struct morse *mors = dev_get_drvdata(file->private);
 
+	rcu_read_lock();
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
 		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
 		struct morse_vif *mors_vif;
@@ -933,6 +2061,7 @@ static int read_twt_sta_agreements(struct seq_file *file, void *data)
 		mors_vif = ieee80211_vif_to_morse_vif(vif);
 		morse_twt_dump_sta_agreements(file, mors_vif);
 	}
+	rcu_read_unlock();
 
 	return 0;
 }
@@ -942,6 +2071,7 @@ static int read_twt_wi_tree(struct seq_file *file, void *data)
 	int vif_id;
 	struct morse *mors = dev_get_drvdata(file->private);
 
+	rcu_read_lock();
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
 		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
 		struct morse_vif *mors_vif;
@@ -953,6 +2083,7 @@ static int read_twt_wi_tree(struct seq_file *file, void *data)
 
 		morse_twt_dump_wake_interval_tree(file, mors_vif);
 	}
+	rcu_read_unlock();
 
 	return 0;
 }
@@ -995,6 +2126,7 @@ static int get_tx_sta_summary_tbl(struct seq_file *file, void *data)
 
 	seq_printf(file, "%-17s %s\n", "Station", "Packets");
 
+	rcu_read_lock();
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
 		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
 
@@ -1006,9 +2138,65 @@ static int get_tx_sta_summary_tbl(struct seq_file *file, void *data)
 							  print_sta_tx_pkt_count_iter, file);
 		}
 	}
+	rcu_read_unlock();
 	return ret;
 }
 
+/* Print the memory held by the driver per instance, per interface and per optional feature */
+static int read_file_mem_usage(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+	size_t pcpu = num_possible_cpus();
+	size_t bytes;
+	int vif_id;
+
+	seq_printf(file, "morse: %zu\n", sizeof(*mors));
+	seq_printf(file, "percpu stats: %zu\n",
+		   pcpu * (sizeof(struct morse_page_stats) + sizeof(struct morse_bus_stats) +
+			   sizeof(struct morse_tx_path_stats) +
+			   sizeof(struct morse_pkt_lat_stats)));
+	seq_printf(file, "pkt_lat slots: %zu\n", mors->debug.pkt_lat_slots ?
+		   MORSE_PKT_LAT_SLOTS * sizeof(*mors->debug.pkt_lat_slots) : 0);
+	seq_printf(file, "cmd stats: %zu\n",
+		   mors->debug.cmd_stats ? sizeof(*mors->debug.cmd_stats) : 0);
+
+#ifdef CONFIG_MORSE_DEBUGFS
+	mutex_lock(&mors->debug.hostif_log.lock);
+	bytes = 0;
+	if (mors->debug.hostif_log.rings_mem)
+		bytes = (size_t)nr_cpu_ids *
+			MORSE_HOSTIF_LOG_RING_STRIDE(mors->debug.hostif_log.ring_size);
+	mutex_unlock(&mors->debug.hostif_log.lock);
+	seq_printf(file, "hostif log: %zu\n", bytes);
+#endif
+
+	mutex_lock(&mors->lock);
+	bytes = 0;
+	if (mors->channel_survey)
+		bytes = sizeof(*mors->channel_survey) + mors->channel_survey->num_records *
+			sizeof(*mors->channel_survey->records);
+	seq_printf(file, "channel survey: %zu\n", bytes);
+
+	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
+		struct ieee80211_vif *vif = __morse_get_vif_from_vif_id(mors, vif_id);
+		struct morse_vif *mors_vif;
+
+		if (!vif)
+			continue;
+
+		mors_vif = ieee80211_vif_to_morse_vif(vif);
+		seq_printf(file, "%s: VIF [%d]:\n", morse_vif_name(vif), mors_vif->id);
+		seq_printf(file, "\tvif: %zu\n", sizeof(*mors_vif));
+		seq_printf(file, "\tsta backups: %zu\n", mors_vif->sta_backups ?
+			   STA_PRIV_BACKUP_NUM * sizeof(*mors_vif->sta_backups) : 0);
+		seq_printf(file, "\tmbssid ie cache: %zu\n", mors_vif->mbssid_ie_cache ?
+			   sizeof(*mors_vif->mbssid_ie_cache) : 0);
+	}
+	mutex_unlock(&mors->lock);
+
+	return 0;
+}
+
 int morse_init_debug(struct morse *mors)
 {
 	mors->debug.debugfs_phy = debugfs_create_dir("morse", mors->wiphy->debugfsdir);
@@ -1018,6 +2206,28 @@ int morse_init_debug(struct morse *mors)
 	debugfs_create_devm_seqfile(mors->dev, "page_stats",
 				    mors->debug.debugfs_phy, read_page_stats);
 
+	morse_bus_stats_reset(mors);
+	debugfs_create_file("bus_stats", 0600, mors->debug.debugfs_phy, mors, &bus_stats_fops);
+#ifdef CONFIG_MORSE_HW_TRACE
+	debugfs_create_file("hw_trace", 0600, mors->debug.debugfs_phy, mors, &hw_trace_fops);
+#endif
+	debugfs_create_file("cmd_stats", 0600, mors->debug.debugfs_phy, mors, &cmd_stats_fops);
+	debugfs_create_file("ps_stats", 0600, mors->debug.debugfs_phy, mors, &ps_stats_fops);
+	morse_tx_path_stats_reset(mors);
+	debugfs_create_file("tx_path_stats", 0600, mors->debug.debugfs_phy, mors,
+			    &tx_path_stats_fops);
+	morse_pkt_lat_stats_reset(mors);
+	debugfs_create_file("pkt_latency", 0600, mors->debug.debugfs_phy, mors,
+			    &pkt_lat_stats_fops);
+	debugfs_create_devm_seqfile(mors->dev, "boot_timeline",
+				    mors->debug.debugfs_phy, read_boot_timeline);
+
+	debugfs_create_devm_seqfile(mors->dev, "ecsa_stats",
+				    mors->debug.debugfs_phy, read_ecsa_stats);
+
+	debugfs_create_devm_seqfile(mors->dev, "duty_cycle_budget",
+				    mors->debug.debugfs_phy, read_duty_cycle_budget);
+
 #if defined(CONFIG_MORSE_DEBUG_IRQ)
 	debugfs_create_devm_seqfile(mors->dev, "hostsync_stats",
 				    mors->debug.debugfs_phy, read_hostsync_stats);
@@ -1044,17 +2254,27 @@ int morse_init_debug(struct morse *mors)
 				    mors->debug.debugfs_phy, dump_raw_configs);
 
 #ifdef CONFIG_MORSE_DEBUGFS
-	if (mors->chip_if->active_chip_if == MORSE_CHIP_IF_PAGESET)
+	if (mors->chip_if->active_chip_if == MORSE_CHIP_IF_PAGESET) {
 		debugfs_create_devm_seqfile(mors->dev, "pagesets",
 					    mors->debug.debugfs_phy, read_file_pagesets);
-	else if (mors->chip_if->active_chip_if == MORSE_CHIP_IF_YAPS) {
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+		debugfs_create_devm_seqfile(mors->dev, "pageset_benchmark",
+					    mors->debug.debugfs_phy, read_file_pageset_benchmark);
+#endif
+	} else if (mors->chip_if->active_chip_if == MORSE_CHIP_IF_YAPS) {
 		debugfs_create_devm_seqfile(mors->dev, "yaps",
 					    mors->debug.debugfs_phy, read_file_yaps);
 #ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
 		debugfs_create_devm_seqfile(mors->dev, "yaps_benchmark",
 					    mors->debug.debugfs_phy, read_file_yaps_benchmark);
+		debugfs_create_devm_seqfile(mors->dev, "yaps_crc_benchmark",
+					    mors->debug.debugfs_phy, read_file_yaps_crc_benchmark);
 #endif
 	}
+	debugfs_create_devm_seqfile(mors->dev, "dot11ah_benchmark",
+				    mors->debug.debugfs_phy, read_file_dot11ah_benchmark);
+	debugfs_create_devm_seqfile(mors->dev, "tx_benchmark",
+				    mors->debug.debugfs_phy, read_file_tx_benchmark);
 
 	debugfs_create_devm_seqfile(mors->dev, "skbq_mon",
 				    mors->debug.debugfs_phy, read_skbq_mon_tbl);
@@ -1062,6 +2282,9 @@ int morse_init_debug(struct morse *mors)
 	debugfs_create_devm_seqfile(mors->dev, "mcs_stats",
 				    mors->debug.debugfs_phy, read_mcs_stats_tbl);
 
+	debugfs_create_devm_seqfile(mors->dev, "mem_usage",
+				    mors->debug.debugfs_phy, read_file_mem_usage);
+
 	debugfs_create_devm_seqfile(mors->dev, "vendor_ies",
 				    mors->debug.debugfs_phy, read_vendor_ies);
 
@@ -1076,10 +2299,11 @@ int morse_init_debug(struct morse *mors)
 #endif
 	mutex_init(&mors->debug.hostif_log.lock);
 	init_waitqueue_head(&mors->debug.hostif_log.waitqueue);
-	INIT_LIST_HEAD(&mors->debug.hostif_log.items);
 	mors->debug.hostif_log.enabled_channel_mask = MORSE_HOSTIF_LOG_COMMAND;
 	debugfs_create_file("fw_hostif_log", 0600, mors->debug.debugfs_phy, mors,
 			    &fw_hostif_log_fops);
+	debugfs_create_devm_seqfile(mors->dev, "fw_hostif_log_stats",
+				    mors->debug.debugfs_phy, read_hostif_log_stats);
 	debugfs_create_file("fw_hostif_log_enabled_channels", 0600, mors->debug.debugfs_phy, mors,
 			    &fw_hostif_log_config_fops);
 
@@ -1087,12 +2311,20 @@ int morse_init_debug(struct morse *mors)
 	debugfs_create_file("reset", 0600, mors->debug.debugfs_phy, mors, &bus_reset_fops);
 
 	debugfs_create_file("restart", 0600, mors->debug.debugfs_phy, mors, &driver_restart_fops);
+	debugfs_create_file("coredump_abort", 0600, mors->debug.debugfs_phy, mors,
+			    &coredump_abort_fops);
 
 	debugfs_create_file("watchdog", 0600, mors->debug.debugfs_phy, mors, &watchdog_fops);
 
 	debugfs_create_file("reset_required", 0600, mors->debug.debugfs_phy, mors,
 			    &reset_required_fops);
 
+#ifdef CONFIG_MORSE_ENABLE_TEST_MODES
+	mutex_init(&mors->debug.bus_profile.lock);
+	debugfs_create_file("bus_profile", 0600, mors->debug.debugfs_phy, mors,
+			    &bus_profile_fops);
+#endif
+
 #endif
 
 #ifdef CONFIG_MORSE_RC
@@ -1107,6 +2339,10 @@ void morse_deinit_debug(struct morse *mors)
 {
 #ifdef CONFIG_MORSE_DEBUGFS
 	morse_debug_fw_hostif_log_destroy(mors);
+#ifdef CONFIG_MORSE_ENABLE_TEST_MODES
+	vfree(mors->debug.bus_profile.buf);
+	mors->debug.bus_profile.buf = NULL;
+#endif
 #endif
 
 	morse_log_remove_debugfs(mors);
@@ -10,6 +10,25 @@
 #include "skb_header.h"
 
 #include <linux/kern_levels.h>
+#include <linux/jump_label.h>
+#include <linux/version.h>
+#include <linux/log2.h>
+
+/**
+ * morse_hist_bucket() - Map a value onto a log2 histogram bucket
+ *
+ * Bucket 0 holds zero, bucket n holds [2^(n-1), 2^n) and the last bucket also takes
+ * everything above its range.
+ *
+ * @val: Value to bucket
+ * @nbuckets: Number of buckets in the histogram
+ *
+ * @return: The bucket index, less than @nbuckets
+ */
+static inline unsigned int morse_hist_bucket(u64 val, unsigned int nbuckets)
+{
+	return val ? min_t(unsigned int, ilog2(val) + 1, nbuckets - 1) : 0;
+}
 
 /*
  * Map onto standard kernel loglevels, see
@@ -50,6 +69,7 @@ enum morse_feature_id {
 	FEATURE_ID_BEACON,
 	FEATURE_ID_YAPS,
 	FEATURE_ID_USB,
+	FEATURE_ID_EMU,
 	NUM_FEATURE_IDS
 };
 
@@ -57,21 +77,52 @@ enum morse_feature_id {
  * Generator macro to produce the prototype for the various logging functions.
  * Note that "__printf(3, 4)"" is a shorthand for the format(printf) attribute.
  */
-#define __generate_log_fn_prototype(fn)					\
+#define __generate_log_fn_prototype(name)					\
 __printf(3, 4)								\
-void morse_ ## fn(u32 id, const struct morse *mors, const char *fmt, ...)
+void name(u32 id, const struct morse *mors, const char *fmt, ...)
 
-__generate_log_fn_prototype(dbg);
-__generate_log_fn_prototype(dbg_ratelimited);
-__generate_log_fn_prototype(info);
-__generate_log_fn_prototype(info_ratelimited);
-__generate_log_fn_prototype(warn);
-__generate_log_fn_prototype(warn_ratelimited);
-__generate_log_fn_prototype(err);
-__generate_log_fn_prototype(err_ratelimited);
+__generate_log_fn_prototype(__morse_dbg);
+__generate_log_fn_prototype(__morse_dbg_ratelimited);
+__generate_log_fn_prototype(morse_info);
+__generate_log_fn_prototype(morse_info_ratelimited);
+__generate_log_fn_prototype(morse_warn);
+__generate_log_fn_prototype(morse_warn_ratelimited);
+__generate_log_fn_prototype(morse_err);
+__generate_log_fn_prototype(morse_err_ratelimited);
 
 #undef __generate_log_fn_prototype
 
+/*
+ * Debug output sits on per-packet paths, so debug sites are gated by static keys and are
+ * a NOP unless the feature's log level includes debug or the debug tracepoints are enabled.
+ * The feature id must be a compile time constant.
+ */
+extern struct static_key_false morse_log_dbg_keys[NUM_FEATURE_IDS];
+DECLARE_STATIC_KEY_FALSE(morse_log_dbg_traced);
+
+#if KERNEL_VERSION(4, 10, 0) <= LINUX_VERSION_CODE
+int morse_log_dbg_trace_reg(void);
+#else
+void morse_log_dbg_trace_reg(void);
+#endif
+void morse_log_dbg_trace_unreg(void);
+
+#define morse_log_dbg_active(id)						\
+	(static_branch_unlikely(&morse_log_dbg_keys[id]) ||			\
+	 static_branch_unlikely(&morse_log_dbg_traced))
+
+#define morse_dbg(id, _m, _f, _a...)						\
+	do {									\
+		if (morse_log_dbg_active(id))					\
+			__morse_dbg(id, _m, _f, ##_a);				\
+	} while (0)
+
+#define morse_dbg_ratelimited(id, _m, _f, _a...)				\
+	do {									\
+		if (morse_log_dbg_active(id))					\
+			__morse_dbg_ratelimited(id, _m, _f, ##_a);		\
+	} while (0)
+
 /*
  * Helper macros to avoid having to pass FEATURE_ID_DEFAULT all the time.
  */
@@ -163,6 +214,134 @@ bool morse_log_is_enabled(u32 id, u8 level);
  */
 void morse_init_log_levels(u8 level);
 
+/**
+ * morse_boot_timeline_start() - Start a new startup timeline
+ *
+ * @mors: Morse chip instance
+ * @restart: This is a restart rather than the first probe
+ */
+void morse_boot_timeline_start(struct morse *mors, bool restart);
+
+/**
+ * morse_boot_phase_begin() - Record the start of a startup phase
+ *
+ * @mors: Morse chip instance
+ * @phase: The phase
+ */
+void morse_boot_phase_begin(struct morse *mors, enum morse_boot_phase phase);
+
+/**
+ * morse_boot_phase_end() - Record the end of a startup phase
+ *
+ * @mors: Morse chip instance
+ * @phase: The phase
+ * @ret: Result of the phase
+ */
+void morse_boot_phase_end(struct morse *mors, enum morse_boot_phase phase, int ret);
+
+extern bool enable_tx_path_stats;
+
+/**
+ * morse_tx_path_stats_record() - Account the driver cost of one transmitted frame.
+ *
+ * @mors: Morse chip instance
+ * @path: The TX path taken by the frame
+ * @start_ns: Start time from morse_tx_path_stats_start()
+ */
+void morse_tx_path_stats_record(struct morse *mors, enum morse_tx_path path, u64 start_ns);
+
+/** Start timing a frame through the TX path, returns 0 when TX path statistics are off */
+static inline u64 morse_tx_path_stats_start(void)
+{
+	return unlikely(enable_tx_path_stats) ? ktime_get_ns() : 0;
+}
+
+static inline void morse_tx_path_stats_end(struct morse *mors, enum morse_tx_path path,
+					   u64 start_ns)
+{
+	if (unlikely(start_ns))
+		morse_tx_path_stats_record(mors, path, start_ns);
+}
+
+extern bool enable_pkt_latency;
+
+/**
+ * morse_pkt_lat_sample() - Decide whether to follow the next packet.
+ *
+ * @mors: Morse chip instance
+ *
+ * Return: The start time of the sample, or 0 if this packet is not followed
+ */
+u64 morse_pkt_lat_sample(struct morse *mors);
+
+/**
+ * morse_pkt_lat_begin() - Start following a packet through the driver.
+ *
+ * @mors: Morse chip instance
+ * @skb: The packet, used only as a key until the sample is finished
+ * @stage: The first stage, MORSE_PKT_LAT_TX_MAC or MORSE_PKT_LAT_RX_BUS
+ * @start_ns: Start time from morse_pkt_lat_sample()
+ * @aci: Access category of a TX packet, RX access categories are taken from the header
+ */
+void morse_pkt_lat_begin(struct morse *mors, struct sk_buff *skb, enum morse_pkt_lat_stage stage,
+			 u64 start_ns, u8 aci);
+void __morse_pkt_lat_stamp(struct morse *mors, struct sk_buff *skb,
+			   enum morse_pkt_lat_stage stage);
+void __morse_pkt_lat_finish(struct morse *mors, struct sk_buff *skb,
+			    enum morse_pkt_lat_stage stage);
+void __morse_pkt_lat_drop(struct morse *mors, struct sk_buff *skb);
+
+/** Start timing a packet from mac80211, returns 0 if it is not sampled */
+static inline u64 morse_pkt_lat_start(struct morse *mors)
+{
+	return unlikely(enable_pkt_latency) ? morse_pkt_lat_sample(mors) : 0;
+}
+
+/** Follow a sampled TX packet, now that it is about to be queued on @aci */
+static inline void morse_pkt_lat_tx_begin(struct morse *mors, struct sk_buff *skb, u8 aci,
+					  u64 start_ns)
+{
+	if (unlikely(start_ns))
+		morse_pkt_lat_begin(mors, skb, MORSE_PKT_LAT_TX_MAC, start_ns, aci);
+}
+
+/** Sample a packet just read from the chip. Only data and management frames are followed. */
+static inline void morse_pkt_lat_rx_begin(struct morse *mors, struct sk_buff *skb, u8 channel)
+{
+	u64 start_ns;
+
+	if (likely(!enable_pkt_latency) ||
+	    (channel != MORSE_SKB_CHAN_DATA && channel != MORSE_SKB_CHAN_MGMT))
+		return;
+
+	start_ns = morse_pkt_lat_sample(mors);
+	if (start_ns)
+		morse_pkt_lat_begin(mors, skb, MORSE_PKT_LAT_RX_BUS, start_ns, 0);
+}
+
+/** Stamp an intermediate stage, if @skb is being followed */
+static inline void morse_pkt_lat_stamp(struct morse *mors, struct sk_buff *skb,
+				       enum morse_pkt_lat_stage stage)
+{
+	if (unlikely(atomic_read(&mors->debug.pkt_lat_active)))
+		__morse_pkt_lat_stamp(mors, skb, stage);
+}
+
+/** Stamp the final stage of @skb and account its latencies, if it is being followed */
+static inline void morse_pkt_lat_finish(struct morse *mors, struct sk_buff *skb,
+					enum morse_pkt_lat_stage stage)
+{
+	if (unlikely(atomic_read(&mors->debug.pkt_lat_active)))
+		__morse_pkt_lat_finish(mors, skb, stage);
+}
+
+/** Abandon the sample of a dropped packet */
+static inline void morse_pkt_lat_drop(struct morse *mors, struct sk_buff *skb)
+{
+	if (unlikely(atomic_read(&mors->debug.pkt_lat_active)))
+		__morse_pkt_lat_drop(mors, skb);
+}
+
 int morse_init_debug(struct morse *mors);
 
 void morse_deinit_debug(struct morse *mors);
@@ -175,8 +354,76 @@ enum morse_fw_hostif_log_channel_enable {
 	MORSE_HOSTIF_LOG_TX_STATUS = BIT(2)
 };
 
-void morse_debug_fw_hostif_log_record(struct morse *morse, int to_chip,
-				      struct sk_buff *skb, struct morse_buff_skb_header *hdr);
+/**
+ * struct morse_hostif_log_ring_hdr - Header of a per-CPU host interface log ring
+ *
+ * The fw_hostif_log debugfs file can be mmap()ed to read the rings directly. The mapping
+ * holds one ring per possible CPU, each MORSE_HOSTIF_LOG_RING_STRIDE(size) bytes apart,
+ * starting with this header. Record data follows the header at offset PAGE_SIZE.
+ *
+ * @head: free running byte count written by the producer
+ * @tail: free running byte count consumed by the reader
+ * @size: bytes of record data in the ring, a power of 2
+ * @overruns: records dropped because the ring was full
+ */
+struct morse_hostif_log_ring_hdr {
+	u32 head;
+	u32 tail;
+	u32 size;
+	u32 overruns;
+};
+
+#define MORSE_HOSTIF_LOG_RING_STRIDE(size)	(PAGE_SIZE + (size))
+
+/** Records start on this alignment within a ring */
+#define MORSE_HOSTIF_LOG_REC_ALIGN		(16)
+
+/** Record length of padding that skips to the start of the ring */
+#define MORSE_HOSTIF_LOG_REC_PAD		(U32_MAX)
+
+/**
+ * struct morse_hostif_log_rec - A host interface log record
+ *
+ * The timestamp and to_chip fields are also the header returned for each read().
+ *
+ * @timestamp: monotonic time the frame was logged, nsecs
+ * @to_chip: 1 for frames sent to the chip, 0 for frames received from it
+ * @length: length of @data, or MORSE_HOSTIF_LOG_REC_PAD
+ * @data: the frame, starting with its morse_buff_skb_header
+ */
+struct morse_hostif_log_rec {
+	u64 timestamp;
+	u32 to_chip;
+	u32 length;
+	u8 data[];
+};
+
+#ifdef CONFIG_MORSE_DEBUGFS
+DECLARE_STATIC_KEY_FALSE(morse_hostif_log_active);
+
+void __morse_debug_fw_hostif_log_record(struct morse *mors, int to_chip,
+					struct sk_buff *skb, struct morse_buff_skb_header *hdr);
+#endif
+
+/**
+ * morse_debug_fw_hostif_log_record() - Log a frame crossing the host interface.
+ *
+ * Costs a single patched branch unless a fw_hostif_log client is open.
+ *
+ * @mors: Morse chip struct
+ * @to_chip: true if the frame is being sent to the chip
+ * @skb: the frame, starting with @hdr
+ * @hdr: skb header of the frame
+ */
+static inline void morse_debug_fw_hostif_log_record(struct morse *mors, int to_chip,
+						    struct sk_buff *skb,
+						    struct morse_buff_skb_header *hdr)
+{
+#ifdef CONFIG_MORSE_DEBUGFS
+	if (static_branch_unlikely(&morse_hostif_log_active))
+		__morse_debug_fw_hostif_log_record(mors, to_chip, skb, hdr);
+#endif
+}
 
 const char *morse_iftype_to_str(enum nl80211_iftype type);
 
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+#include <linux/ieee80211.h>
+
+#include "dot11ah.h"
+#include "tim.h"
+#include "debug.h"
+
+/* Iterations timed per corpus entry */
+#define DOT11AH_BENCHMARK_ROUNDS	(10000)
+
+/* Largest AID used by the TIM patterns, keeps single AID encodings within one S1G TIM */
+#define DOT11AH_BENCHMARK_MAX_AID	(200)
+
+/* S1G beacon body: S1G beacon compatibility, TIM, SSID, RSN, S1G capabilities and operation,
+ * short beacon interval and WMM parameters.
+ */
+static const u8 dot11ah_bench_beacon_ies[] = {
+	WLAN_EID_S1G_BCN_COMPAT, 8, 0x11, 0x04, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00,
+	WLAN_EID_TIM, 4, 0x00, 0x0a, 0xf9, 0x00,
+	WLAN_EID_SSID, 11, 'h', 'a', 'l', 'o', 'w', '-', 'b', 'e', 'n', 'c', 'h',
+	WLAN_EID_RSN, 20, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04,
+			  0x01, 0x00, 0x00, 0x0f, 0xac, 0x08, 0xcc, 0x00,
+	WLAN_EID_S1G_CAPABILITIES, 15, 0x82, 0x30, 0x00, 0x00, 0x18, 0x6b, 0x00, 0x00, 0x00,
+				       0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	WLAN_EID_S1G_OPERATION, 6, 0x07, 0x1f, 0x21, 0x00, 0x02, 0x00,
+	WLAN_EID_S1G_SHORT_BCN_INTERVAL, 2, 0x64, 0x00,
+	WLAN_EID_VENDOR_SPECIFIC, 24, 0x00, 0x50, 0xf2, 0x02, 0x01, 0x01, 0x80, 0x00,
+				      0x03, 0xa4, 0x00, 0x00, 0x27, 0xa4, 0x00, 0x00,
+				      0x42, 0x43, 0x5e, 0x00, 0x62, 0x32, 0x2f, 0x00,
+};
+
+/* Probe response body: SSID, S1G beacon compatibility, RSN, extended capabilities,
+ * S1G capabilities and operation and WMM parameters.
+ */
+static const u8 dot11ah_bench_probe_resp_ies[] = {
+	WLAN_EID_SSID, 11, 'h', 'a', 'l', 'o', 'w', '-', 'b', 'e', 'n', 'c', 'h',
+	WLAN_EID_S1G_BCN_COMPAT, 8, 0x11, 0x04, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00,
+	WLAN_EID_RSN, 20, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04,
+			  0x01, 0x00, 0x00, 0x0f, 0xac, 0x08, 0xcc, 0x00,
+	WLAN_EID_EXT_CAPABILITY, 8, 0x04, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x40,
+	WLAN_EID_S1G_CAPABILITIES, 15, 0x82, 0x30, 0x00, 0x00, 0x18, 0x6b, 0x00, 0x00, 0x00,
+				       0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	WLAN_EID_S1G_OPERATION, 6, 0x07, 0x1f, 0x21, 0x00, 0x02, 0x00,
+	WLAN_EID_VENDOR_SPECIFIC, 24, 0x00, 0x50, 0xf2, 0x02, 0x01, 0x01, 0x80, 0x00,
+				      0x03, 0xa4, 0x00, 0x00, 0x27, 0xa4, 0x00, 0x00,
+				      0x42, 0x43, 0x5e, 0x00, 0x62, 0x32, 0x2f, 0x00,
+};
+
+/* Association response body: extended capabilities, S1G capabilities and operation and WMM
+ * parameters.
+ */
+static const u8 dot11ah_bench_assoc_resp_ies[] = {
+	WLAN_EID_EXT_CAPABILITY, 8, 0x04, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x40,
+	WLAN_EID_S1G_CAPABILITIES, 15, 0x82, 0x30, 0x00, 0x00, 0x18, 0x6b, 0x00, 0x00, 0x00,
+				       0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	WLAN_EID_S1G_OPERATION, 6, 0x07, 0x1f, 0x21, 0x00, 0x02, 0x00,
+	WLAN_EID_VENDOR_SPECIFIC, 24, 0x00, 0x50, 0xf2, 0x02, 0x01, 0x01, 0x80, 0x00,
+				      0x03, 0xa4, 0x00, 0x00, 0x27, 0xa4, 0x00, 0x00,
+				      0x42, 0x43, 0x5e, 0x00, 0x62, 0x32, 0x2f, 0x00,
+};
+
+static const struct {
+	const char *name;
+	const u8 *ies;
+	size_t len;
+} dot11ah_bench_frames[] = {
+	{ "beacon", dot11ah_bench_beacon_ies, sizeof(dot11ah_bench_beacon_ies) },
+	{ "probe_resp", dot11ah_bench_probe_resp_ies, sizeof(dot11ah_bench_probe_resp_ies) },
+	{ "assoc_resp", dot11ah_bench_assoc_resp_ies, sizeof(dot11ah_bench_assoc_resp_ies) },
+};
+
+/* AIDs with buffered traffic: one in every @stride AIDs starting from @first */
+static const struct {
+	const char *name;
+	u16 first;
+	u16 stride;
+} dot11ah_bench_tim_patterns[] = {
+	{ "single", 42, DOT11AH_BENCHMARK_MAX_AID },
+	{ "sparse", 3, 13 },
+	{ "dense", 1, 2 },
+};
+
+/* ADE is left out as it only supports the first 8 AIDs */
+static const enum dot11ah_tim_encoding_mode dot11ah_bench_tim_modes[] = {
+	ENC_MODE_BLOCK,
+	ENC_MODE_AID,
+	ENC_MODE_OLB,
+};
+
+static const char * const dot11ah_bench_tim_mode_names[] = {
+	[ENC_MODE_BLOCK] = "block",
+	[ENC_MODE_AID] = "aid",
+	[ENC_MODE_OLB] = "olb",
+	[ENC_MODE_ADE] = "ade",
+};
+
+struct dot11ah_bench_ctx {
+	u8 frame[256];
+	/* 11n TIM elements, with room for the largest partial virtual bitmap */
+	u8 tim_in[sizeof(struct ieee80211_tim_ie) + DOT11_MAX_TIM_VIRTUAL_MAP_LENGTH];
+	u8 tim_out[sizeof(struct ieee80211_tim_ie) + DOT11_MAX_TIM_VIRTUAL_MAP_LENGTH];
+	struct dot11ah_s1g_tim_ie s1g_tim;
+	struct dot11ah_s1g_tim_cache cache;
+};
+
+/* Check every element in @ies was recorded in @ies_mask where it appears in the frame */
+static bool morse_dot11ah_bench_check_ies(const u8 *ies, size_t len,
+					  const struct dot11ah_ies_mask *ies_mask)
+{
+	const u8 *pos = ies;
+
+	while (pos + 2 <= ies + len) {
+		const struct ie_element *element = &ies_mask->ies[pos[0]];
+
+		if (element->ptr != pos + 2 || element->len != pos[1])
+			return false;
+		pos += 2 + pos[1];
+	}
+
+	return true;
+}
+
+static void morse_dot11ah_bench_parse(struct seq_file *file, struct dot11ah_bench_ctx *ctx)
+{
+	struct dot11ah_ies_mask *ies_mask;
+	u64 start_ns, elapsed_ns;
+	bool good;
+	int i, j;
+
+	ies_mask = morse_dot11ah_ies_mask_alloc();
+	if (!ies_mask) {
+		seq_puts(file, "parse_ies: no memory\n");
+		return;
+	}
+
+	seq_puts(file, "parse_ies:\n");
+	for (i = 0; i < ARRAY_SIZE(dot11ah_bench_frames); i++) {
+		const u8 *ies = dot11ah_bench_frames[i].ies;
+		size_t len = dot11ah_bench_frames[i].len;
+
+		memcpy(ctx->frame, ies, len);
+		good = (morse_dot11ah_parse_ies(ctx->frame, len, ies_mask) == 0 &&
+			morse_dot11ah_bench_check_ies(ctx->frame, len, ies_mask));
+		morse_dot11ah_ies_mask_clear(ies_mask);
+
+		start_ns = ktime_get_ns();
+		for (j = 0; j < DOT11AH_BENCHMARK_ROUNDS; j++) {
+			morse_dot11ah_parse_ies(ctx->frame, len, ies_mask);
+			morse_dot11ah_ies_mask_clear(ies_mask);
+		}
+		elapsed_ns = ktime_get_ns() - start_ns;
+
+		seq_printf(file, "\t%s (%zu bytes): %s, %llu ns/frame\n",
+			   dot11ah_bench_frames[i].name, len, good ? "ok" : "MISMATCH",
+			   div_u64(elapsed_ns, DOT11AH_BENCHMARK_ROUNDS));
+		cond_resched();
+	}
+
+	morse_dot11ah_ies_mask_free(ies_mask);
+}
+
+static bool morse_dot11ah_bench_tim_has_aid(const struct ieee80211_tim_ie *tim, u16 aid)
+{
+	u8 offset = tim->bitmap_ctrl & IEEE80211_TIM_BITMAP_OFFSET;
+	u16 octet = aid >> 3;
+
+	if (octet < offset || octet - offset >= DOT11_MAX_TIM_VIRTUAL_MAP_LENGTH)
+		return false;
+
+	return tim->virtual_map[octet - offset] & BIT(aid & 0x07);
+}
+
+/* Fill a cleared 11n TIM from a pattern, returning the length of its partial virtual bitmap */
+static u8 morse_dot11ah_bench_tim_fill(struct ieee80211_tim_ie *tim, u16 first, u16 stride)
+{
+	u16 aid;
+	u16 last = first;
+
+	tim->dtim_period = 1;
+
+	for (aid = first; aid <= DOT11AH_BENCHMARK_MAX_AID; aid += stride) {
+		tim->virtual_map[aid >> 3] |= BIT(aid & 0x07);
+		last = aid;
+	}
+
+	return (last >> 3) + 1;
+}
+
+static void morse_dot11ah_bench_tim(struct seq_file *file, struct dot11ah_bench_ctx *ctx)
+{
+	struct ieee80211_tim_ie *tim_in = (struct ieee80211_tim_ie *)ctx->tim_in;
+	struct ieee80211_tim_ie *tim_out = (struct ieee80211_tim_ie *)ctx->tim_out;
+	u64 start_ns, enc_ns, cached_ns, dec_ns;
+	int s1g_len;
+	u8 map_len;
+	bool good;
+	u16 aid;
+	int i, m, j;
+
+	seq_puts(file, "tim:\n");
+	for (i = 0; i < ARRAY_SIZE(dot11ah_bench_tim_patterns); i++) {
+		memset(ctx->tim_in, 0, sizeof(ctx->tim_in));
+		map_len = morse_dot11ah_bench_tim_fill(tim_in, dot11ah_bench_tim_patterns[i].first,
+						       dot11ah_bench_tim_patterns[i].stride);
+
+		for (m = 0; m < ARRAY_SIZE(dot11ah_bench_tim_modes); m++) {
+			enum dot11ah_tim_encoding_mode mode = dot11ah_bench_tim_modes[m];
+
+			s1g_len = morse_dot11_tim_to_s1g(NULL, &ctx->s1g_tim, tim_in, map_len,
+							 mode, false, DOT11AH_BENCHMARK_MAX_AID,
+							 S1G_TIM_PAGE_SLICE_ENTIRE_PAGE, 0);
+			memset(ctx->tim_out, 0, sizeof(ctx->tim_out));
+			morse_dot11_s1g_to_tim(tim_out, &ctx->s1g_tim, s1g_len);
+
+			good = true;
+			for (aid = 1; aid <= DOT11AH_BENCHMARK_MAX_AID; aid++) {
+				if (morse_dot11ah_bench_tim_has_aid(tim_in, aid) !=
+				    morse_dot11ah_bench_tim_has_aid(tim_out, aid)) {
+					good = false;
+					break;
+				}
+			}
+
+			start_ns = ktime_get_ns();
+			for (j = 0; j < DOT11AH_BENCHMARK_ROUNDS; j++)
+				morse_dot11_tim_to_s1g(NULL, &ctx->s1g_tim, tim_in, map_len, mode,
+						       false, DOT11AH_BENCHMARK_MAX_AID,
+						       S1G_TIM_PAGE_SLICE_ENTIRE_PAGE, 0);
+			enc_ns = ktime_get_ns() - start_ns;
+
+			/* Beacons usually repeat the previous TIM, which the cache short cuts */
+			memset(&ctx->cache, 0, sizeof(ctx->cache));
+			start_ns = ktime_get_ns();
+			for (j = 0; j < DOT11AH_BENCHMARK_ROUNDS; j++)
+				morse_dot11_tim_to_s1g(&ctx->cache, &ctx->s1g_tim, tim_in, map_len,
+						       mode, false, DOT11AH_BENCHMARK_MAX_AID,
+						       S1G_TIM_PAGE_SLICE_ENTIRE_PAGE, 0);
+			cached_ns = ktime_get_ns() - start_ns;
+
+			s1g_len = morse_dot11_tim_to_s1g(NULL, &ctx->s1g_tim, tim_in, map_len,
+							 mode, false, DOT11AH_BENCHMARK_MAX_AID,
+							 S1G_TIM_PAGE_SLICE_ENTIRE_PAGE, 0);
+			start_ns = ktime_get_ns();
+			for (j = 0; j < DOT11AH_BENCHMARK_ROUNDS; j++)
+				morse_dot11_s1g_to_tim(tim_out, &ctx->s1g_tim, s1g_len);
+			dec_ns = ktime_get_ns() - start_ns;
+
+			seq_printf(file, "\t%s/%s (%d bytes): %s, ",
+				   dot11ah_bench_tim_patterns[i].name,
+				   dot11ah_bench_tim_mode_names[mode], s1g_len,
+				   good ? "ok" : "MISMATCH");
+			seq_printf(file, "encode %llu ns, cached encode %llu ns, decode %llu ns\n",
+				   div_u64(enc_ns, DOT11AH_BENCHMARK_ROUNDS),
+				   div_u64(cached_ns, DOT11AH_BENCHMARK_ROUNDS),
+				   div_u64(dec_ns, DOT11AH_BENCHMARK_ROUNDS));
+			cond_resched();
+		}
+	}
+}
+
+int morse_dot11ah_benchmark(struct seq_file *file)
+{
+	struct dot11ah_bench_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	seq_printf(file, "rounds: %d\n", DOT11AH_BENCHMARK_ROUNDS);
+	morse_dot11ah_bench_parse(file, ctx);
+	morse_dot11ah_bench_tim(file, ctx);
+
+	kfree(ctx);
+	return 0;
+}
+EXPORT_SYMBOL(morse_dot11ah_benchmark);
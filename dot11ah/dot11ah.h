@@ -355,7 +355,9 @@ struct morse_dot11ah_s1g_assoc_resp {
 };
 
 struct morse_dot11ah_cssid_item {
-	struct list_head list;
+	/** Entry in the cssid table, hashed by BSSID */
+	struct hlist_node node;
+	struct rcu_head rcu;
 	__le32 cssid;
 	unsigned long last_seen;
 	u16 capab_info;
@@ -508,6 +510,22 @@ struct ie_element {
 	struct ie_element *next;
 };
 
+/* Size of the arena backing element copies in a preallocated dot11ah_ies_mask */
+#ifndef DOT11AH_IES_ARENA_SIZE
+#define DOT11AH_IES_ARENA_SIZE		2048
+#endif
+
+/**
+ * struct dot11ah_ies_arena - Bump allocator for IE copies and list entries of an ies_mask
+ *
+ * @used: Bytes of @buf handed out since the ies_mask was last cleared
+ * @buf: Backing memory
+ */
+struct dot11ah_ies_arena {
+	size_t used;
+	u8 buf[DOT11AH_IES_ARENA_SIZE] __aligned(sizeof(void *));
+};
+
 /**
  * struct dot11ah_ies_mask - Stores IE values
  *
@@ -517,6 +535,8 @@ struct ie_element {
  * @fils_data: FILS Session element and encrypted data, which if present, is always at the end of a
  *	management frame
  * @fils_data_length: Length of the FILS Session element and encrypted data
+ * @arena: Arena for element copies when the mask is one of the preallocated per-CPU masks,
+ *	otherwise NULL. Preserved by morse_dot11ah_ies_mask_clear().
  */
 struct dot11ah_ies_mask {
 	struct ie_element ies[DOT11AH_MAX_EID];
@@ -524,10 +544,9 @@ struct dot11ah_ies_mask {
 	DECLARE_BITMAP(more_than_one_ie, DOT11AH_MAX_EID);
 	u8 *fils_data;
 	int fils_data_len;
+	struct dot11ah_ies_arena *arena;
 };
 
-extern spinlock_t cssid_list_lock;
-
 struct morse_channel {
 	u32 frequency_khz;
 	u8 channel_5g;
@@ -585,8 +604,42 @@ int morse_dot11ah_s1g_to_probe_resp_ies_size(struct dot11ah_ies_mask *ies_mask);
 void morse_dot11ah_s1g_to_probe_resp_ies(u8 *ies_11n, int length_11n,
 					 struct dot11ah_ies_mask *ies_mask);
 
+/**
+ * morse_dot11ah_ies_mask_alloc() - Get an empty ies_mask. Safe from any context.
+ *
+ * Hands out the current CPU's preallocated mask, with its arena for element copies, when it is
+ * not already in use, and only falls back to an atomic allocation otherwise.
+ *
+ * Return: The mask, to be returned with morse_dot11ah_ies_mask_free(), or NULL
+ */
 struct dot11ah_ies_mask *morse_dot11ah_ies_mask_alloc(void);
 
+/**
+ * morse_dot11_ies_mask_for_each() - Iterate over every element of an EID held in an ies_mask,
+ *	including repeated ones such as vendor specific or extension elements.
+ *
+ * @elem: &struct ie_element cursor
+ * @ies_mask: Parsed IEs
+ * @eid: Element ID
+ */
+#define morse_dot11_ies_mask_for_each(elem, ies_mask, eid) \
+	for ((elem) = &(ies_mask)->ies[eid]; (elem) && (elem)->ptr; (elem) = (elem)->next)
+
+/**
+ * morse_dot11_ies_mask_find_ext() - Find an extension element in an ies_mask.
+ *
+ * @ies_mask: Parsed IEs
+ * @ext_eid: Element ID extension
+ *
+ * Return: The element, with ptr at the Element ID extension field, or NULL if not present
+ */
+const struct ie_element *morse_dot11_ies_mask_find_ext(const struct dot11ah_ies_mask *ies_mask,
+							u8 ext_eid);
+
+int morse_dot11ah_ies_mask_pool_init(void);
+
+void morse_dot11ah_ies_mask_pool_finish(void);
+
 void morse_dot11ah_ies_mask_free(struct dot11ah_ies_mask *ies_mask);
 
 void morse_dot11ah_mask_ies(struct dot11ah_ies_mask *ies_mask, bool mask_ext_cap, bool is_beacon);
@@ -678,7 +731,8 @@ u32 morse_dot11ah_channel_get_flags(int chan_s1g);
  * morse_dot11ah_find_cssid_item_for_bssid() - Find the cssid list entry matching with given bssid.
  * @bssid: bssid for the item to find
  *
- * Use of this function and any returned items must be protected with cssid_list_lock
+ * Use of this function and any returned items must be protected with cssid_list_lock, or by RCU
+ * for read-only access. The IEs of an entry are never changed once it is visible.
  *
  * Return: the cssid list entry if entry with matching bssid found, NULL otherwise.
  */
@@ -686,6 +740,19 @@ struct morse_dot11ah_cssid_item *morse_dot11ah_find_cssid_item_for_bssid(const u
 
 struct morse_dot11ah_cssid_item *morse_dot11ah_find_bssid(const u8 bssid[ETH_ALEN]);
 
+/**
+ * morse_dot11ah_get_recent_bss_channels() - Get the channels of the recently seen BSSs.
+ * @max_age_ms: only include BSSs seen within this time
+ * @ssid: only include BSSs with this SSID, if @ssid_len is not 0
+ * @ssid_len: length of @ssid
+ * @chans: bitmap of U8_MAX + 1 bits, set to the S1G primary and operating channel numbers of
+ *         the BSSs. Mesh BSSs are not included.
+ *
+ * Return: number of BSSs found.
+ */
+int morse_dot11ah_get_recent_bss_channels(u32 max_age_ms, const u8 *ssid, int ssid_len,
+					  unsigned long *chans);
+
 /**
  * morse_dot11ah_store_cssid() - Stores BSS information and S1G IEs.
  * @ies_mask: contains array of information elements.
@@ -705,6 +772,20 @@ void morse_dot11ah_store_cssid(struct dot11ah_ies_mask *ies_mask, u16 capab_info
 
 int morse_dot11ah_parse_ies(u8 *start, size_t len, struct dot11ah_ies_mask *ies_mask);
 
+struct seq_file;
+
+/**
+ * morse_dot11ah_benchmark() - Time the per-frame translation helpers against a built-in corpus
+ * @file: seq file the results are written to.
+ *
+ * Parses a set of S1G beacon, probe response and association response IEs, and round trips
+ * a set of TIM patterns through each S1G TIM encoding, reporting whether each entry survived
+ * the translation intact and the time taken per frame.
+ *
+ * Return: 0 on success, otherwise a negative error code.
+ */
+int morse_dot11ah_benchmark(struct seq_file *file);
+
 /**
  * morse_dot11_ies_create_ie_element() - creates or finds pointer for the given EID.
  * @ies_mask: contains array of information elements.
@@ -774,6 +855,45 @@ int morse_dot11_insert_ordered_ies_from_ies_mask(struct sk_buff *skb, u8 *pos,
 
 const struct morse_reg_rule *morse_regdom_get_rule_for_freq(const char *alpha, int frequency);
 
+/**
+ * morse_regdom_find_rule() - Walk the rules of a regulatory domain for a frequency
+ *
+ * @regdom: Regulatory domain to search
+ * @frequency: Frequency (kHz)
+ *
+ * Return: the first rule covering @frequency, or NULL if there is none
+ */
+const struct morse_reg_rule *morse_regdom_find_rule(const struct morse_regdomain *regdom,
+						    int frequency);
+
+/**
+ * morse_dot11ah_get_regdom() - Get the regulatory domain of the selected region
+ *
+ * Return: the regulatory domain, or NULL if no region has been set
+ */
+const struct morse_regdomain *morse_dot11ah_get_regdom(void);
+
+/**
+ * morse_dot11ah_channel_get_reg_rule() - Get the regulatory rule covering a channel
+ *
+ * @chan: Channel of the selected region, as returned by the channel lookups
+ *
+ * The rules are indexed by channel when the region is set, so this does not walk them.
+ *
+ * Return: the rule, or NULL if the channel is not covered by the regulatory domain
+ */
+const struct morse_reg_rule *
+morse_dot11ah_channel_get_reg_rule(const struct morse_dot11ah_channel *chan);
+
+/**
+ * morse_dot11ah_freq_khz_get_reg_rule() - Get the indexed regulatory rule for a frequency
+ *
+ * @freq_khz: Centre frequency (kHz) of a channel of the selected region
+ *
+ * Return: the rule, or NULL if @freq_khz is not a channel centre or not covered by a rule
+ */
+const struct morse_reg_rule *morse_dot11ah_freq_khz_get_reg_rule(u32 freq_khz);
+
 struct ieee80211_regdomain *morse_regdom_to_ieee80211(const struct morse_regdomain *morse_domain);
 
 const struct morse_regdomain *morse_reg_set_alpha(const char *alpha);
@@ -8,6 +8,7 @@
 #include <linux/types.h>
 #include <linux/list.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
 #include <net/mac80211.h>
 #include <linux/crc32.h>
 #include <linux/ieee80211.h>
@@ -264,7 +265,43 @@ static const u8 morse_mgmt_mesh_peering_mgmt_ies_order[] = {
 		WLAN_EID_MIC,
 };
 
-static void free_eid_ies_list(struct ie_element *list_head)
+/* A preallocated ies_mask and the arena backing its element copies */
+struct dot11ah_ies_mask_pool {
+	/* Non-zero while the mask is handed out */
+	atomic_t in_use;
+	struct dot11ah_ies_mask mask;
+	struct dot11ah_ies_arena arena;
+};
+
+static struct dot11ah_ies_mask_pool __percpu *ies_mask_pool;
+
+static void *ies_arena_alloc(struct dot11ah_ies_mask *ies_mask, size_t len)
+{
+	struct dot11ah_ies_arena *arena = ies_mask->arena;
+	size_t start;
+
+	if (!arena)
+		return NULL;
+
+	start = ALIGN(arena->used, sizeof(void *));
+	if (start + len > sizeof(arena->buf))
+		return NULL;
+
+	arena->used = start + len;
+	memset(arena->buf + start, 0, len);
+
+	return arena->buf + start;
+}
+
+static bool ies_arena_owns(const struct dot11ah_ies_mask *ies_mask, const void *ptr)
+{
+	const struct dot11ah_ies_arena *arena = ies_mask->arena;
+
+	return arena && (const u8 *)ptr >= arena->buf &&
+	       (const u8 *)ptr < arena->buf + sizeof(arena->buf);
+}
+
+static void free_eid_ies_list(struct dot11ah_ies_mask *ies_mask, struct ie_element *list_head)
 {
 	struct ie_element *next, *cur;
 
@@ -272,23 +309,59 @@ static void free_eid_ies_list(struct ie_element *list_head)
 		next = cur->next;
 		if (cur->needs_free)
 			kfree(cur->ptr);
-		kfree(cur);
+		if (!ies_arena_owns(ies_mask, cur))
+			kfree(cur);
 	}
 }
 
 void morse_dot11_clear_eid_from_ies_mask(struct dot11ah_ies_mask *ies_mask, u8 eid)
 {
-	free_eid_ies_list(ies_mask->ies[eid].next);
+	free_eid_ies_list(ies_mask, ies_mask->ies[eid].next);
 	if (ies_mask->ies[eid].needs_free)
 		kfree(ies_mask->ies[eid].ptr);
 	ies_mask->ies[eid].ptr = NULL;
 	ies_mask->ies[eid].len = 0;
+	ies_mask->ies[eid].needs_free = false;
+	ies_mask->ies[eid].next = NULL;
+	clear_bit(eid, ies_mask->more_than_one_ie);
 }
 EXPORT_SYMBOL(morse_dot11_clear_eid_from_ies_mask);
 
+int morse_dot11ah_ies_mask_pool_init(void)
+{
+	int cpu;
+
+	ies_mask_pool = alloc_percpu(struct dot11ah_ies_mask_pool);
+	if (!ies_mask_pool)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct dot11ah_ies_mask_pool *pool = per_cpu_ptr(ies_mask_pool, cpu);
+
+		atomic_set(&pool->in_use, 0);
+		pool->mask.arena = &pool->arena;
+	}
+
+	return 0;
+}
+
+void morse_dot11ah_ies_mask_pool_finish(void)
+{
+	free_percpu(ies_mask_pool);
+	ies_mask_pool = NULL;
+}
+
 struct dot11ah_ies_mask *morse_dot11ah_ies_mask_alloc(void)
 {
 	struct dot11ah_ies_mask *ies_mask = NULL;
+	struct dot11ah_ies_mask_pool *pool;
+
+	/* The in_use flag owns the mask, so it does not matter if we migrate CPU after this */
+	if (ies_mask_pool) {
+		pool = raw_cpu_ptr(ies_mask_pool);
+		if (!atomic_xchg(&pool->in_use, 1))
+			return &pool->mask;
+	}
 
 	/* Atomic as ies mask can be allocated from the beacon tasklet */
 	ies_mask = kzalloc(sizeof(*ies_mask), GFP_ATOMIC);
@@ -299,13 +372,22 @@ EXPORT_SYMBOL(morse_dot11ah_ies_mask_alloc);
 
 void morse_dot11ah_ies_mask_free(struct dot11ah_ies_mask *ies_mask)
 {
+	struct dot11ah_ies_mask_pool *pool;
 	int pos;
 
 	if (!ies_mask)
 		return;
 
+	if (ies_mask->arena) {
+		/* Preallocated mask, leave it empty for the next user */
+		pool = container_of(ies_mask, struct dot11ah_ies_mask_pool, mask);
+		morse_dot11ah_ies_mask_clear(ies_mask);
+		atomic_set_release(&pool->in_use, 0);
+		return;
+	}
+
 	for_each_set_bit(pos, ies_mask->more_than_one_ie, DOT11AH_MAX_EID)
-		free_eid_ies_list(ies_mask->ies[pos].next);
+		free_eid_ies_list(ies_mask, ies_mask->ies[pos].next);
 
 	for (pos = 0; pos < ARRAY_SIZE(ies_mask->ies); pos++) {
 		if (ies_mask->ies[pos].needs_free)
@@ -318,13 +400,14 @@ EXPORT_SYMBOL(morse_dot11ah_ies_mask_free);
 
 void morse_dot11ah_ies_mask_clear(struct dot11ah_ies_mask *ies_mask)
 {
+	struct dot11ah_ies_arena *arena;
 	int pos;
 
 	if (!ies_mask)
 		return;
 
 	for_each_set_bit(pos, ies_mask->more_than_one_ie, DOT11AH_MAX_EID) {
-		free_eid_ies_list(ies_mask->ies[pos].next);
+		free_eid_ies_list(ies_mask, ies_mask->ies[pos].next);
 	}
 
 	for (pos = 0; pos < ARRAY_SIZE(ies_mask->ies); pos++) {
@@ -332,8 +415,13 @@ void morse_dot11ah_ies_mask_clear(struct dot11ah_ies_mask *ies_mask)
 			kfree(ies_mask->ies[pos].ptr);
 	}
 
-	/* clear the ies_mask */
+	/* clear the ies_mask, keeping (but emptying) any arena */
+	arena = ies_mask->arena;
 	memset(ies_mask, 0, sizeof(*ies_mask));
+	if (arena) {
+		arena->used = 0;
+		ies_mask->arena = arena;
+	}
 }
 EXPORT_SYMBOL(morse_dot11ah_ies_mask_clear);
 
@@ -351,7 +439,9 @@ struct ie_element *morse_dot11_ies_create_ie_element(struct dot11ah_ies_mask *ie
 			for (cur = &ies_mask->ies[eid]; cur->next; cur = cur->next)
 				continue; /* walk to the end of the list */
 
-			new = kzalloc(sizeof(*new), GFP_ATOMIC);
+			new = ies_arena_alloc(ies_mask, sizeof(*new));
+			if (!new)
+				new = kzalloc(sizeof(*new), GFP_ATOMIC);
 			if (!new)
 				return NULL;
 
@@ -362,10 +452,12 @@ struct ie_element *morse_dot11_ies_create_ie_element(struct dot11ah_ies_mask *ie
 	}
 
 	if (alloc) {
-		cur->ptr = kzalloc(length, GFP_ATOMIC);
+		cur->ptr = ies_arena_alloc(ies_mask, length);
+		cur->needs_free = !cur->ptr;
+		if (!cur->ptr)
+			cur->ptr = kzalloc(length, GFP_ATOMIC);
 		if (!cur->ptr)
 			return NULL;
-		cur->needs_free = true;
 	} else {
 		cur->needs_free = false;
 	}
@@ -436,6 +528,20 @@ int morse_dot11ah_parse_ies(u8 *start, size_t len, struct dot11ah_ies_mask *ies_
 }
 EXPORT_SYMBOL(morse_dot11ah_parse_ies);
 
+const struct ie_element *morse_dot11_ies_mask_find_ext(const struct dot11ah_ies_mask *ies_mask,
+							u8 ext_eid)
+{
+	const struct ie_element *elem;
+
+	morse_dot11_ies_mask_for_each(elem, ies_mask, WLAN_EID_EXTENSION) {
+		if (elem->len && elem->ptr[0] == ext_eid)
+			return elem;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL(morse_dot11_ies_mask_find_ext);
+
 const u8 *morse_dot11_find_ie(u8 eid, const u8 *ies, int length)
 {
 	return cfg80211_find_ie(eid, ies, length);
@@ -10,6 +10,8 @@
 #include <net/mac80211.h>
 #include <linux/crc32.h>
 #include <linux/ieee80211.h>
+#include <linux/hashtable.h>
+#include <linux/rcupdate.h>
 #include "s1g_ieee80211.h"
 
 #include "dot11ah.h"
@@ -20,9 +22,36 @@
 /* Validity of the cssid entry */
 #define MORSE_CSSID_ENTRY_VALIDITY_TIME	(60 * HZ)
 
-/* Serialise operations that manipulate the CSSID list */
-spinlock_t cssid_list_lock;
-static LIST_HEAD(cssid_list);
+/* The cssid entries are hashed by BSSID into 2^MORSE_CSSID_HASH_BITS buckets */
+#define MORSE_CSSID_HASH_BITS		8
+
+/* Upper bound on the number of cssid entries. The least recently seen is evicted beyond this. */
+#ifndef MORSE_CSSID_MAX_ENTRIES
+#define MORSE_CSSID_MAX_ENTRIES		1024
+#endif
+
+/* Minimum interval between sweeps of the table for expired entries */
+#define MORSE_CSSID_PRUNE_INTERVAL	HZ
+
+/* Serialise operations that manipulate the CSSID table. Entries, and the IEs they hold, are only
+ * freed after an RCU grace period, so lookups that just read an entry may use RCU instead.
+ */
+static spinlock_t cssid_list_lock;
+static DEFINE_HASHTABLE(cssid_table, MORSE_CSSID_HASH_BITS);
+static unsigned int cssid_count;
+static unsigned long cssid_last_prune;
+
+/*
+ * Number of mesh neighbours with a given beacon interval, for the beacon timing element. Counted
+ * at most once per MORSE_CSSID_PRUNE_INTERVAL, or when a mesh entry is added or removed, rather
+ * than for every beacon. Protected by cssid_list_lock.
+ */
+static struct {
+	bool valid;
+	u16 beacon_int;
+	int count;
+	unsigned long updated;
+} mesh_neighbors;
 
 /*
  * Static functions used only here
@@ -32,6 +61,11 @@ static int __init morse_dot11ah_init(void)
 	int ret = 0;
 
 	spin_lock_init(&cssid_list_lock);
+
+	/* Not fatal, ies masks are then allocated for each frame */
+	if (morse_dot11ah_ies_mask_pool_init())
+		pr_warn("Morse Micro Dot11ah failed to preallocate ies masks\n");
+
 	pr_info("Morse Micro Dot11ah driver registration. Version %s\n", DOT11AH_VERSION);
 	return ret;
 }
@@ -39,6 +73,9 @@ static int __init morse_dot11ah_init(void)
 static void __exit morse_dot11ah_exit(void)
 {
 	morse_dot11ah_clear_list();
+	/* Wait for the entries to be freed */
+	rcu_barrier();
+	morse_dot11ah_ies_mask_pool_finish();
 }
 
 /** morse_dot11ah_cssid_has_expired - Checks if the given cssid entry is expired or not.
@@ -62,45 +99,121 @@ static bool morse_dot11ah_cssid_has_expired(struct morse_dot11ah_cssid_item *ite
 	return false;
 }
 
-/*
- * Public functions used in  dot11ah module
- */
-struct morse_dot11ah_cssid_item *morse_dot11ah_find_cssid_item_for_bssid(const u8 bssid[ETH_ALEN])
+static void morse_dot11ah_cssid_item_free_rcu(struct rcu_head *head)
 {
-	struct morse_dot11ah_cssid_item *item, *tmp;
+	struct morse_dot11ah_cssid_item *item =
+		container_of(head, struct morse_dot11ah_cssid_item, rcu);
+
+	kfree(item->ies);
+	kfree(item);
+}
+
+static void morse_dot11ah_cssid_item_del(struct morse_dot11ah_cssid_item *item)
+{
+	lockdep_assert_held(&cssid_list_lock);
+
+	hash_del_rcu(&item->node);
+	cssid_count--;
+	if (item->mesh_beacon)
+		mesh_neighbors.valid = false;
+	call_rcu(&item->rcu, morse_dot11ah_cssid_item_free_rcu);
+}
+
+/* Lookup by BSSID. Caller holds cssid_list_lock or is in an RCU (or BH disabled) section. */
+static struct morse_dot11ah_cssid_item *morse_dot11ah_cssid_lookup(const u8 bssid[ETH_ALEN])
+{
+	struct morse_dot11ah_cssid_item *item;
 	u64 bssid_64 = mac2uint64(bssid);
 
-	list_for_each_entry_safe(item, tmp, &cssid_list, list) {
+	hash_for_each_possible_rcu(cssid_table, item, node, bssid_64) {
 		if (mac2uint64(item->bssid) == bssid_64) {
-			item->last_seen = jiffies;
+			WRITE_ONCE(item->last_seen, jiffies);
 			return item;
 		}
-
-		if (morse_dot11ah_cssid_has_expired(item)) {
-			list_del(&item->list);
-			kfree(item->ies);
-			kfree(item);
-		}
 	}
 
 	return NULL;
 }
 
-/** Use of this function and any returned items must be protected with cssid_list_lock */
-struct morse_dot11ah_cssid_item *morse_dot11ah_find_bssid(const u8 bssid[ETH_ALEN])
+/* Drop expired entries, at most once per MORSE_CSSID_PRUNE_INTERVAL unless forced */
+static void morse_dot11ah_cssid_prune(bool force)
+{
+	struct morse_dot11ah_cssid_item *item;
+	struct hlist_node *tmp;
+	int bkt;
+
+	lockdep_assert_held(&cssid_list_lock);
+
+	if (!force && time_before(jiffies, cssid_last_prune + MORSE_CSSID_PRUNE_INTERVAL))
+		return;
+
+	cssid_last_prune = jiffies;
+	hash_for_each_safe(cssid_table, bkt, tmp, item, node) {
+		if (morse_dot11ah_cssid_has_expired(item))
+			morse_dot11ah_cssid_item_del(item);
+	}
+}
+
+/* Make room for a new entry, evicting the least recently seen one if the table is full */
+static void morse_dot11ah_cssid_make_room(void)
 {
-	struct morse_dot11ah_cssid_item *item, *tmp;
+	struct morse_dot11ah_cssid_item *item, *oldest = NULL;
+	int bkt;
+
+	lockdep_assert_held(&cssid_list_lock);
 
+	morse_dot11ah_cssid_prune(cssid_count >= MORSE_CSSID_MAX_ENTRIES);
+	if (cssid_count < MORSE_CSSID_MAX_ENTRIES)
+		return;
+
+	hash_for_each(cssid_table, bkt, item, node) {
+		if (!oldest || time_before(item->last_seen, oldest->last_seen))
+			oldest = item;
+	}
+
+	if (oldest)
+		morse_dot11ah_cssid_item_del(oldest);
+}
+
+/* Length of the stored IEs once the RSN/RSNX IEs learnt from the probe response are added */
+static int morse_dot11ah_cssid_ies_len(const struct dot11ah_ies_mask *ies_mask,
+				       const u8 *s1g_ies, int s1g_ies_len,
+				       const struct dot11ah_update_rx_beacon_vals *vals)
+{
+	const u8 *rsn_ie;
+	const u8 *rsnx_ie;
+
+	if (!vals || !vals->cssid_ies || !s1g_ies)
+		return s1g_ies_len;
+
+	/* Get the RSN/RSNX IE from stored IEs to update incoming beacon IEs */
+	rsn_ie = morse_dot11_find_ie(WLAN_EID_RSN, vals->cssid_ies, vals->cssid_ies_len);
+	rsnx_ie = morse_dot11_find_ie(WLAN_EID_RSNX, vals->cssid_ies, vals->cssid_ies_len);
+
+	/* Update IEs length with RSN/RSNX IE if present */
+	if (rsn_ie && !ies_mask->ies[WLAN_EID_RSN].ptr)
+		s1g_ies_len += *(rsn_ie + 1) + 2;
+	if (rsnx_ie && !ies_mask->ies[WLAN_EID_RSNX].ptr)
+		s1g_ies_len += *(rsnx_ie + 1) + 2;
+
+	return s1g_ies_len;
+}
+
+/*
+ * Public functions used in  dot11ah module
+ */
+struct morse_dot11ah_cssid_item *morse_dot11ah_find_cssid_item_for_bssid(const u8 bssid[ETH_ALEN])
+{
+	return morse_dot11ah_cssid_lookup(bssid);
+}
+
+/** Use of this function and any returned items must be protected with cssid_list_lock or RCU */
+struct morse_dot11ah_cssid_item *morse_dot11ah_find_bssid(const u8 bssid[ETH_ALEN])
+{
 	if (!bssid)
 		return NULL;
 
-	list_for_each_entry_safe(item, tmp, &cssid_list, list) {
-		if (memcmp(item->bssid, bssid, ETH_ALEN) == 0) {
-			item->last_seen = jiffies;
-			return item;
-		}
-	}
-	return NULL;
+	return morse_dot11ah_cssid_lookup(bssid);
 }
 
 void morse_dot11ah_store_cssid(struct dot11ah_ies_mask *ies_mask, u16 capab_info, u8 *s1g_ies,
@@ -116,10 +229,27 @@ void morse_dot11ah_store_cssid(struct dot11ah_ies_mask *ies_mask, u16 capab_info
 	int length;
 	const u8 *ssid;
 	u8 network_id_eid;
+	int s1g_ies_len_updated;
 
 	if (WARN_ON(!bssid))
 		return;
 
+	s1g_ies_len_updated = morse_dot11ah_cssid_ies_len(ies_mask, s1g_ies, s1g_ies_len, vals);
+
+	/* Every beacon from a known BSS lands here. When the stored IEs are unchanged only
+	 * capab_info may need refreshing, which readers tolerate seeing either way, so skip
+	 * the lock shared by all interfaces.
+	 */
+	rcu_read_lock();
+	stored = morse_dot11ah_find_cssid_item_for_bssid(bssid);
+	if (stored && (!s1g_ies || stored->ies_len == s1g_ies_len_updated)) {
+		if (capab_info != 0 && READ_ONCE(stored->capab_info) != capab_info)
+			WRITE_ONCE(stored->capab_info, capab_info);
+		rcu_read_unlock();
+		return;
+	}
+	rcu_read_unlock();
+
 	network_id_eid = morse_is_mesh_network(ies_mask) ? WLAN_EID_MESH_ID : WLAN_EID_SSID;
 	cssid = morse_generate_cssid(ies_mask->ies[network_id_eid].ptr,
 		ies_mask->ies[network_id_eid].len);
@@ -130,44 +260,38 @@ void morse_dot11ah_store_cssid(struct dot11ah_ies_mask *ies_mask, u16 capab_info
 	stored = morse_dot11ah_find_cssid_item_for_bssid(bssid);
 
 	if (stored) {
-		int s1g_ies_len_updated = s1g_ies_len;
 		bool update_beacon = (vals && vals->cssid_ies);
 
 		if (stored->capab_info != capab_info && capab_info != 0)
-			stored->capab_info = capab_info;
-
-		if (update_beacon && s1g_ies) {
-			/* Get the RSN/RSNX IE from stored IEs to update incoming beacon IEs */
-			const u8 *rsn_ie = morse_dot11_find_ie(WLAN_EID_RSN, vals->cssid_ies,
-						vals->cssid_ies_len);
-			const u8 *rsnx_ie = morse_dot11_find_ie(WLAN_EID_RSNX, vals->cssid_ies,
-						vals->cssid_ies_len);
-
-			/* Update IEs length with RSN/RSNX IE if present */
-			if (rsn_ie && !ies_mask->ies[WLAN_EID_RSN].ptr)
-				s1g_ies_len_updated += *(rsn_ie + 1) + 2;
-			if (rsnx_ie && !ies_mask->ies[WLAN_EID_RSNX].ptr)
-				s1g_ies_len_updated += *(rsnx_ie + 1) + 2;
-		}
+			WRITE_ONCE(stored->capab_info, capab_info);
 
 		if (stored->ies_len != s1g_ies_len_updated && s1g_ies) {
-			kfree(stored->ies);
+			/* RCU readers may still be using the stored IEs, so publish a new copy of
+			 * the entry holding the new ones instead of changing them in place.
+			 */
+			item = kmemdup(stored, sizeof(*stored), GFP_ATOMIC);
+			if (!item)
+				goto exit;
 
-			stored->ies = kmalloc(s1g_ies_len_updated, GFP_ATOMIC);
-			if (!stored->ies) {
-				stored->ies_len = 0;
+			item->ies = kmalloc(s1g_ies_len_updated, GFP_ATOMIC);
+			if (!item->ies) {
+				kfree(item);
 				goto exit;
 			}
 
-			memcpy(stored->ies, s1g_ies, s1g_ies_len);
-			stored->ies_len = s1g_ies_len_updated;
+			memcpy(item->ies, s1g_ies, s1g_ies_len);
+			item->ies_len = s1g_ies_len_updated;
 
 			/* Update beacon IEs with stored RSN and RSNX IE (from probe response)
 			 * before storing again.
 			 */
 			if (update_beacon)
-				morse_dot11_insert_rsn_and_rsnx_ie(stored->ies + s1g_ies_len, vals,
+				morse_dot11_insert_rsn_and_rsnx_ie(item->ies + s1g_ies_len, vals,
 								   ies_mask);
+
+			hlist_replace_rcu(&stored->node, &item->node);
+			call_rcu(&stored->rcu, morse_dot11ah_cssid_item_free_rcu);
+			stored = item;
 		}
 
 		memcpy(stored->bssid, bssid, ETH_ALEN);
@@ -176,6 +300,8 @@ void morse_dot11ah_store_cssid(struct dot11ah_ies_mask *ies_mask, u16 capab_info
 		return;
 	}
 
+	morse_dot11ah_cssid_make_room();
+
 	item = kmalloc(sizeof(*item), GFP_ATOMIC);
 	if (!item)
 		goto exit;
@@ -186,6 +312,7 @@ void morse_dot11ah_store_cssid(struct dot11ah_ies_mask *ies_mask, u16 capab_info
 	item->capab_info = capab_info;
 	item->fc_bss_bw_subfield = MORSE_FC_BSS_BW_INVALID;
 	item->mesh_beacon = (network_id_eid == WLAN_EID_MESH_ID);
+	item->beacon_int = 0;
 	memcpy(item->ssid, ssid, length);
 
 	item->ies = kmalloc(s1g_ies_len, GFP_ATOMIC);
@@ -199,7 +326,10 @@ void morse_dot11ah_store_cssid(struct dot11ah_ies_mask *ies_mask, u16 capab_info
 	memcpy(item->ies, s1g_ies, s1g_ies_len);
 	memcpy(item->bssid, bssid, ETH_ALEN);
 
-	list_add(&item->list, &cssid_list);
+	hash_add_rcu(cssid_table, &item->node, mac2uint64(item->bssid));
+	cssid_count++;
+	if (item->mesh_beacon)
+		mesh_neighbors.valid = false;
 
 exit:
 	spin_unlock_bh(&cssid_list_lock);
@@ -216,7 +346,7 @@ bool morse_mac_find_channel_info_for_bssid(const u8 bssid[ETH_ALEN],
 	u8 *op = NULL;
 	struct morse_dot11ah_cssid_item *item = NULL;
 
-	spin_lock_bh(&cssid_list_lock);
+	rcu_read_lock();
 
 	item = morse_dot11ah_find_bssid(bssid);
 
@@ -238,7 +368,7 @@ bool morse_mac_find_channel_info_for_bssid(const u8 bssid[ETH_ALEN],
 		}
 	}
 
-	spin_unlock_bh(&cssid_list_lock);
+	rcu_read_unlock();
 
 	return found;
 }
@@ -247,11 +377,12 @@ EXPORT_SYMBOL(morse_mac_find_channel_info_for_bssid);
 int morse_dot11_find_bssid_on_channel(u32 op_chan_freq_hz, u8 bssid[ETH_ALEN])
 {
 	bool found = false;
-	struct morse_dot11ah_cssid_item *item, *tmp;
+	struct morse_dot11ah_cssid_item *item;
+	int bkt;
 
-	spin_lock_bh(&cssid_list_lock);
+	rcu_read_lock();
 
-	list_for_each_entry_safe(item, tmp, &cssid_list, list) {
+	hash_for_each_rcu(cssid_table, bkt, item, node) {
 		u8 *op = (u8 *)morse_dot11_find_ie(WLAN_EID_S1G_OPERATION, item->ies,
 						   item->ies_len);
 
@@ -268,23 +399,60 @@ int morse_dot11_find_bssid_on_channel(u32 op_chan_freq_hz, u8 bssid[ETH_ALEN])
 		}
 	}
 
-	spin_unlock_bh(&cssid_list_lock);
+	rcu_read_unlock();
 
 	return found ? 0 : -ENOENT;
 }
 EXPORT_SYMBOL(morse_dot11_find_bssid_on_channel);
 
+int morse_dot11ah_get_recent_bss_channels(u32 max_age_ms, const u8 *ssid, int ssid_len,
+					  unsigned long *chans)
+{
+	unsigned long max_age = msecs_to_jiffies(max_age_ms);
+	struct morse_dot11ah_cssid_item *item;
+	int found = 0;
+	int bkt;
+
+	bitmap_zero(chans, U8_MAX + 1);
+
+	rcu_read_lock();
+
+	hash_for_each_rcu(cssid_table, bkt, item, node) {
+		const u8 *op;
+
+		if (item->mesh_beacon ||
+		    time_before(READ_ONCE(item->last_seen) + max_age, jiffies))
+			continue;
+
+		if (ssid_len && (item->ssid_len != ssid_len || memcmp(item->ssid, ssid, ssid_len)))
+			continue;
+
+		op = morse_dot11_find_ie(WLAN_EID_S1G_OPERATION, item->ies, item->ies_len);
+		if (!op || op[1] < 4)
+			continue;
+
+		/* Primary and operating channel numbers */
+		__set_bit(op[4], chans);
+		__set_bit(op[5], chans);
+		found++;
+	}
+
+	rcu_read_unlock();
+
+	return found;
+}
+EXPORT_SYMBOL(morse_dot11ah_get_recent_bss_channels);
+
 void morse_dot11ah_clear_list(void)
 {
-	struct morse_dot11ah_cssid_item *item, *tmp;
+	struct morse_dot11ah_cssid_item *item;
+	struct hlist_node *tmp;
+	int bkt;
 
 	spin_lock_bh(&cssid_list_lock);
-	/* Free allocated list */
-	list_for_each_entry_safe(item, tmp, &cssid_list, list) {
-		list_del(&item->list);
-		kfree(item->ies);
-		kfree(item);
-	}
+	/* Free allocated entries */
+	hash_for_each_safe(cssid_table, bkt, tmp, item, node)
+		morse_dot11ah_cssid_item_del(item);
 	spin_unlock_bh(&cssid_list_lock);
 }
 EXPORT_SYMBOL(morse_dot11ah_clear_list);
@@ -295,7 +463,7 @@ bool morse_dot11ah_find_s1g_caps_for_bssid(u8 *bssid, struct ieee80211_s1g_cap *
 	bool found = false;
 	u8 *ie = NULL;
 
-	spin_lock_bh(&cssid_list_lock);
+	rcu_read_lock();
 
 	item = morse_dot11ah_find_bssid(bssid);
 	if (item) {
@@ -306,7 +474,7 @@ bool morse_dot11ah_find_s1g_caps_for_bssid(u8 *bssid, struct ieee80211_s1g_cap *
 		}
 	}
 
-	spin_unlock_bh(&cssid_list_lock);
+	rcu_read_unlock();
 	return found;
 }
 EXPORT_SYMBOL(morse_dot11ah_find_s1g_caps_for_bssid);
@@ -316,14 +484,14 @@ bool morse_dot11ah_find_bss_bw(u8 *bssid, u8 *fc_bss_bw_subfield)
 	struct morse_dot11ah_cssid_item *bssid_item = NULL;
 	bool found = false;
 
-	spin_lock_bh(&cssid_list_lock);
+	rcu_read_lock();
 	bssid_item = morse_dot11ah_find_bssid(bssid);
 
 	if (bssid_item) {
-		*fc_bss_bw_subfield = bssid_item->fc_bss_bw_subfield;
+		*fc_bss_bw_subfield = READ_ONCE(bssid_item->fc_bss_bw_subfield);
 		found = true;
 	}
-	spin_unlock_bh(&cssid_list_lock);
+	rcu_read_unlock();
 
 	return found;
 }
@@ -336,9 +504,9 @@ bool morse_dot11ah_is_mesh_peer_known(const u8 *peer_mac_addr)
 	if (!peer_mac_addr)
 		return false;
 
-	spin_lock_bh(&cssid_list_lock);
+	rcu_read_lock();
 	ret = morse_dot11ah_find_cssid_item_for_bssid(peer_mac_addr);
-	spin_unlock_bh(&cssid_list_lock);
+	rcu_read_unlock();
 
 	return ret;
 }
@@ -359,23 +527,17 @@ EXPORT_SYMBOL(morse_dot11ah_add_mesh_peer);
 
 bool morse_dot11ah_del_mesh_peer(const u8 *peer_mac_addr)
 {
-	struct morse_dot11ah_cssid_item *item, *tmp;
-	u64 bssid_64;
+	struct morse_dot11ah_cssid_item *item;
 	bool ret = false;
 
 	if (!peer_mac_addr)
 		return false;
-	bssid_64 = mac2uint64(peer_mac_addr);
 
 	spin_lock_bh(&cssid_list_lock);
-	list_for_each_entry_safe(item, tmp, &cssid_list, list) {
-		if (mac2uint64(item->bssid) == bssid_64) {
-			list_del(&item->list);
-			kfree(item->ies);
-			kfree(item);
-			ret = true;
-			break;
-		}
+	item = morse_dot11ah_cssid_lookup(peer_mac_addr);
+	if (item) {
+		morse_dot11ah_cssid_item_del(item);
+		ret = true;
 	}
 	spin_unlock_bh(&cssid_list_lock);
 
@@ -401,19 +563,31 @@ EXPORT_SYMBOL(morse_dot11_calc_prim_s1g_chan_loc);
 
 int morse_dot11ah_find_no_of_mesh_neighbors(u16 beacon_int)
 {
-	struct morse_dot11ah_cssid_item *item, *tmp;
+	struct morse_dot11ah_cssid_item *item;
+	struct hlist_node *tmp;
 	int mesh_neighbor_count = 0;
+	int bkt;
 
 	spin_lock_bh(&cssid_list_lock);
-	list_for_each_entry_safe(item, tmp, &cssid_list, list) {
+	if (mesh_neighbors.valid && mesh_neighbors.beacon_int == beacon_int &&
+	    time_before(jiffies, mesh_neighbors.updated + MORSE_CSSID_PRUNE_INTERVAL)) {
+		mesh_neighbor_count = mesh_neighbors.count;
+		goto exit;
+	}
+
+	hash_for_each_safe(cssid_table, bkt, tmp, item, node) {
 		if (morse_dot11ah_cssid_has_expired(item)) {
-			list_del(&item->list);
-			kfree(item->ies);
-			kfree(item);
-		} else if (item->mesh_beacon && (item->beacon_int == beacon_int)) {
+			morse_dot11ah_cssid_item_del(item);
+		} else if (item->mesh_beacon && (READ_ONCE(item->beacon_int) == beacon_int)) {
 			mesh_neighbor_count++;
 		}
 	}
+
+	mesh_neighbors.valid = true;
+	mesh_neighbors.beacon_int = beacon_int;
+	mesh_neighbors.count = mesh_neighbor_count;
+	mesh_neighbors.updated = jiffies;
+exit:
 	spin_unlock_bh(&cssid_list_lock);
 
 	return mesh_neighbor_count;
@@ -427,7 +601,7 @@ bool morse_dot11ah_is_page_slicing_enabled_on_bss(u8 *bssid)
 	u8 *ie = NULL;
 	struct ieee80211_s1g_cap *s1g_caps;
 
-	spin_lock_bh(&cssid_list_lock);
+	rcu_read_lock();
 
 	item = morse_dot11ah_find_bssid(bssid);
 	if (item) {
@@ -438,7 +612,7 @@ bool morse_dot11ah_is_page_slicing_enabled_on_bss(u8 *bssid)
 		}
 	}
 
-	spin_unlock_bh(&cssid_list_lock);
+	rcu_read_unlock();
 	return enabled;
 }
 EXPORT_SYMBOL(morse_dot11ah_is_page_slicing_enabled_on_bss);
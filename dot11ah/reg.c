@@ -43,7 +43,8 @@
  * @alpha: The desired ISO/IEC Alpha2 Country to apply regulatory rules in
  *
  * Finds a set of regulatory rules based on a given alpha code, looking through
- * the internally-defined domains.
+ * the internally-defined domains. The channel map of the country is selected, and the
+ * rule covering each of its channels indexed.
  *
  * Return: A pointer to the matching regdomain, defaults to MM.
  *
@@ -83,9 +84,9 @@ struct ieee80211_regdomain *morse_regdom_to_ieee80211(const struct morse_regdoma
 }
 EXPORT_SYMBOL(morse_regdom_to_ieee80211);
 
-const struct morse_reg_rule *morse_regdom_get_rule_for_freq(const char *alpha, int frequency)
+const struct morse_reg_rule *morse_regdom_find_rule(const struct morse_regdomain *regdom,
+						    int frequency)
 {
-	const struct morse_regdomain *regdom = morse_reg_alpha_lookup(alpha);
 	int i;
 
 	for (i = 0; i < regdom->n_reg_rules; i++) {
@@ -96,6 +97,28 @@ const struct morse_reg_rule *morse_regdom_get_rule_for_freq(const char *alpha, i
 
 	return NULL;
 }
+
+const struct morse_reg_rule *morse_regdom_get_rule_for_freq(const char *alpha, int frequency)
+{
+	const struct morse_regdomain *regdom = morse_dot11ah_get_regdom();
+	const struct morse_reg_rule *rule;
+
+	if (!alpha)
+		return NULL;
+
+	/* Channels of the selected region have their rule indexed, see morse_reg_set_alpha() */
+	if (regdom && !strncmp(regdom->alpha2, alpha, strlen(alpha))) {
+		rule = morse_dot11ah_freq_khz_get_reg_rule(frequency);
+		if (rule)
+			return rule;
+	} else {
+		regdom = morse_reg_alpha_lookup(alpha);
+		if (!regdom)
+			return NULL;
+	}
+
+	return morse_regdom_find_rule(regdom, frequency);
+}
 EXPORT_SYMBOL(morse_regdom_get_rule_for_freq);
 
 int morse_mac_set_country_info_from_regdom(const struct morse_regdomain *morse_domain,
@@ -631,7 +631,7 @@ morse_dot11ah_update_rx_beacon_elements(struct dot11ah_update_rx_beacon_vals *va
 	vals_to_update->tim_ie = ies_mask->ies[WLAN_EID_TIM].ptr;
 	vals_to_update->tim_len = ies_mask->ies[WLAN_EID_TIM].len;
 
-	spin_lock_bh(&cssid_list_lock);
+	rcu_read_lock();
 
 	/* Try to find the CSSID item using source address and save a backup of IEs
 	 * presumably stored from previous probe response or beacon, before it gets
@@ -647,7 +647,7 @@ morse_dot11ah_update_rx_beacon_elements(struct dot11ah_update_rx_beacon_vals *va
 			vals_to_update->cssid_ies_len = item->ies_len;
 		}
 	}
-	spin_unlock_bh(&cssid_list_lock);
+	rcu_read_unlock();
 }
 
 static int morse_dot11ah_s1g_to_beacon_size(struct ieee80211_vif *vif, struct sk_buff *skb,
@@ -699,12 +699,12 @@ static int morse_dot11ah_s1g_to_beacon_size(struct ieee80211_vif *vif, struct sk
 	 */
 	network_id_eid = morse_is_mesh_network(ies_mask) ? WLAN_EID_MESH_ID : WLAN_EID_SSID;
 
-	spin_lock_bh(&cssid_list_lock);
+	rcu_read_lock();
 	/* Try to find the CSSID item using source address */
 	item = morse_dot11ah_find_bssid(s1g_beacon->u.s1g_beacon.sa);
 
 	if (!item)
-		spin_unlock_bh(&cssid_list_lock);
+		rcu_read_unlock();
 
 	if (!ies_mask->ies[network_id_eid].len) {
 		if (item) {
@@ -759,7 +759,7 @@ static int morse_dot11ah_s1g_to_beacon_size(struct ieee80211_vif *vif, struct sk
 	}
 exit:
 	if (item)
-		spin_unlock_bh(&cssid_list_lock);
+		rcu_read_unlock();
 
 	/* NB: We do not need to strip out DS PARAMS, ERP INFO, or the Extended supported rates
 	 * EID as we reconstruct the S1G beacon from scratch when we TX.
@@ -1003,21 +1003,21 @@ static void morse_dot11ah_s1g_to_beacon(struct ieee80211_vif *vif, struct sk_buf
 		/* Fill in fc_bss_bw_subfield here, otherwise it will be
 		 * always set to 255 when DTIM period is 1 (no short beacons)
 		 */
-		spin_lock_bh(&cssid_list_lock);
+		rcu_read_lock();
 		item = morse_dot11ah_find_bssid(s1g_beacon->u.s1g_beacon.sa);
 		if (item)
-			item->fc_bss_bw_subfield =
-					IEEE80211AH_GET_FC_BSS_BW(s1g_beacon->frame_control);
+			WRITE_ONCE(item->fc_bss_bw_subfield,
+				   IEEE80211AH_GET_FC_BSS_BW(s1g_beacon->frame_control));
 		else
-			spin_unlock_bh(&cssid_list_lock);
+			rcu_read_unlock();
 	} else {
-		spin_lock_bh(&cssid_list_lock);
+		rcu_read_lock();
 		/* Try to find the CSSID item using source address */
 		item = morse_dot11ah_find_bssid(s1g_beacon->u.s1g_beacon.sa);
 
 		if (item) {
-			item->fc_bss_bw_subfield =
-				IEEE80211AH_GET_FC_BSS_BW(s1g_beacon->frame_control);
+			WRITE_ONCE(item->fc_bss_bw_subfield,
+				   IEEE80211AH_GET_FC_BSS_BW(s1g_beacon->frame_control));
 			/* Reparse for stored beacon */
 			if (morse_dot11ah_parse_ies(item->ies, item->ies_len, ies_mask) < 0) {
 				dot11ah_warn("Failed to parse stored beacon\n");
@@ -1043,9 +1043,9 @@ static void morse_dot11ah_s1g_to_beacon(struct ieee80211_vif *vif, struct sk_buf
 			if (s1g_bcn_comp)
 				updated_vals.capab_info = s1g_bcn_comp->information;
 			else
-				updated_vals.capab_info = item->capab_info;
+				updated_vals.capab_info = READ_ONCE(item->capab_info);
 		} else {
-			spin_unlock_bh(&cssid_list_lock);
+			rcu_read_unlock();
 		}
 	}
 
@@ -1060,8 +1060,8 @@ static void morse_dot11ah_s1g_to_beacon(struct ieee80211_vif *vif, struct sk_buf
 	else if (s1g_bcn_comp)
 		updated_vals.bcn_int = s1g_bcn_comp->beacon_interval;
 
-	if (item)
-		item->beacon_int = updated_vals.bcn_int; /* Update bcn interval in the cssid item */
+	if (item) /* Update bcn interval in the cssid item */
+		WRITE_ONCE(item->beacon_int, updated_vals.bcn_int);
 
 	beacon->frame_control = cpu_to_le16(IEEE80211_FTYPE_MGMT) |
 		cpu_to_le16(IEEE80211_STYPE_BEACON);
@@ -1104,7 +1104,7 @@ static void morse_dot11ah_s1g_to_beacon(struct ieee80211_vif *vif, struct sk_buf
 	skb_trim(skb, beacon_len);
 exit:
 	if (item)
-		spin_unlock_bh(&cssid_list_lock);
+		rcu_read_unlock();
 
 	/* Free the allocated IEs memory */
 	kfree(updated_vals.cssid_ies);
@@ -1449,6 +1449,7 @@ static void morse_dot11ah_s1g_to_assoc_resp(struct ieee80211_vif *vif, struct sk
 	bool frame_good = false;
 	struct morse_vif *mors_vif = (struct morse_vif *)vif->drv_priv;
 	struct morse_dot11ah_cssid_item *bssid_item = NULL;
+	u8 fc_bss_bw_subfield = MORSE_FC_BSS_BW_INVALID;
 	u8 *pri_bw_mhz = &mors_vif->custom_configs->channel_info.pri_bw_mhz;
 
 	if (length_11n <= 0)
@@ -1465,11 +1466,14 @@ static void morse_dot11ah_s1g_to_assoc_resp(struct ieee80211_vif *vif, struct sk
 	memcpy(assoc_resp, s1g_assoc_resp, header_length);
 	assoc_resp->u.assoc_resp.aid = *((u16 *)&ies_mask->ies[WLAN_EID_AID_RESPONSE].ptr[0]);
 
-	spin_lock_bh(&cssid_list_lock);
+	rcu_read_lock();
 	bssid_item = morse_dot11ah_find_bssid(assoc_resp->bssid);
+	if (bssid_item)
+		fc_bss_bw_subfield = READ_ONCE(bssid_item->fc_bss_bw_subfield);
+	rcu_read_unlock();
 
-	if (bssid_item && MORSE_IS_FC_BSS_BW_SUBFIELD_VALID(bssid_item->fc_bss_bw_subfield)) {
-		*pri_bw_mhz = s1g_fc_bss_bw_lookup_min[bssid_item->fc_bss_bw_subfield];
+	if (MORSE_IS_FC_BSS_BW_SUBFIELD_VALID(fc_bss_bw_subfield)) {
+		*pri_bw_mhz = s1g_fc_bss_bw_lookup_min[fc_bss_bw_subfield];
 	} else {
 		/* The min bss bw is == s1g op pri bw, if we don't have that then use 1MHz */
 		if (ies_mask->ies[WLAN_EID_S1G_OPERATION].ptr) {
@@ -1480,7 +1484,6 @@ static void morse_dot11ah_s1g_to_assoc_resp(struct ieee80211_vif *vif, struct sk
 			*pri_bw_mhz = 1;
 		}
 	}
-	spin_unlock_bh(&cssid_list_lock);
 
 	pos = assoc_resp->u.assoc_resp.variable;
 	pos = morse_dot11ah_insert_required_rx_ie(ies_mask, pos, true);
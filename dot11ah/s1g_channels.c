@@ -15,6 +15,7 @@
 
 #include "dot11ah.h"
 #include "tim.h"
+#include "debug.h"
 #include "../morse.h"
 #include "s1g_channels_rules.c"
 #include "channel_alphas.h"
@@ -355,34 +356,39 @@ const struct morse_dot11ah_ch_map *mapped_channels[] = {
 
 static const struct morse_dot11ah_ch_map *__mors_s1g_map;
 
-int morse_dot11ah_channel_set_map(const char *alpha)
-{
-	int i;
-
-	if (WARN_ON(!alpha))
-		return -ENOENT;
-
-	for (i = 0; i < ARRAY_SIZE(mapped_channels); i++)
-		if (!strncmp(mapped_channels[i]->alpha, alpha, strlen(alpha)))
-			__mors_s1g_map = mapped_channels[i];
+/* Lookup tables cover every channel number and the 500 kHz frequency grid around the S1G band */
+#define S1G_CHAN_LUT_SIZE		(256)
+#define S1G_FREQ_LUT_MIN_KHZ		(850000)
+#define S1G_FREQ_LUT_MAX_KHZ		(950000)
+#define S1G_FREQ_LUT_STEP_KHZ		(500)
+#define S1G_FREQ_LUT_SIZE \
+		(((S1G_FREQ_LUT_MAX_KHZ - S1G_FREQ_LUT_MIN_KHZ) / S1G_FREQ_LUT_STEP_KHZ) + 1)
+/* 1, 2, 4 and 8 MHz */
+#define S1G_BW_LUT_SIZE			(4)
 
-	if (!__mors_s1g_map)
-		return -ENOENT;
-
-	if (WARN_ON(!__mors_s1g_map->prim_1mhz_channel_loc_to_idx))
-		return -ENOENT;
-
-	if (WARN_ON(!__mors_s1g_map->calculate_primary_s1g))
-		return -ENOENT;
-
-	if (WARN_ON(!__mors_s1g_map->prim_1mhz_channel_loc_to_idx))
-		return -ENOENT;
-
-	if (WARN_ON(!__mors_s1g_map->get_pri_1mhz_chan))
-		return -ENOENT;
+/**
+ * Direct lookup tables into the channel list of the selected region, built by
+ * morse_dot11ah_channel_set_map(). Entries hold the channel list index + 1, or 0 if there is no
+ * such channel.
+ */
+struct morse_dot11ah_ch_lut {
+	/** Region of the selected map */
+	enum morse_dot11ah_region region;
+	/** Indexed by S1G channel number */
+	u8 by_s1g_chan[S1G_CHAN_LUT_SIZE];
+	/** Indexed by 5 GHz shadow channel number */
+	u8 by_5g_chan[S1G_CHAN_LUT_SIZE];
+	/** Indexed by centre frequency grid position and bandwidth */
+	u8 by_freq_bw[S1G_FREQ_LUT_SIZE][S1G_BW_LUT_SIZE];
+	/** Regulatory domain of the region */
+	const struct morse_regdomain *regdom;
+	/** Regulatory rule covering each entry of the channel list, NULL if there is none */
+	const struct morse_reg_rule *rule[U8_MAX];
+};
 
-	return 0;
-}
+static struct morse_dot11ah_ch_lut __mors_s1g_lut = {
+	.region = REGION_UNSET,
+};
 
 /* Convert a regional ISO alpha-2 string to a morse_region */
 static enum morse_dot11ah_region morse_reg_get_region(const char *alpha)
@@ -420,21 +426,163 @@ static enum morse_dot11ah_region morse_reg_get_region(const char *alpha)
 	return REGION_UNSET;
 }
 
-struct morse_dot11ah_channel *lookup_s1g_chan_from_5g_chan(int chan_5g)
+static int s1g_bw_mhz_to_lut_idx(int bw_mhz)
+{
+	switch (bw_mhz) {
+	case 1:
+		return 0;
+	case 2:
+		return 1;
+	case 4:
+		return 2;
+	case 8:
+		return 3;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int s1g_freq_khz_to_lut_idx(u32 freq_khz)
+{
+	if (freq_khz < S1G_FREQ_LUT_MIN_KHZ || freq_khz > S1G_FREQ_LUT_MAX_KHZ ||
+	    (freq_khz % S1G_FREQ_LUT_STEP_KHZ))
+		return -EINVAL;
+
+	return (freq_khz - S1G_FREQ_LUT_MIN_KHZ) / S1G_FREQ_LUT_STEP_KHZ;
+}
+
+static struct morse_dot11ah_channel *morse_dot11ah_lut_to_chan(u8 entry)
+{
+	return entry ? &__mors_s1g_map->s1g_channels[entry - 1] : NULL;
+}
+
+/* Index the channel list of the selected map. The first of any duplicate entries is kept. */
+static void morse_dot11ah_channel_build_lut(const struct morse_dot11ah_ch_map *map)
 {
+	struct morse_dot11ah_ch_lut *lut = &__mors_s1g_lut;
 	int ch;
 
-	if (__mors_s1g_map->transform_overlapping_5g_chan)
-		chan_5g = __mors_s1g_map->transform_overlapping_5g_chan(chan_5g);
+	memset(lut, 0, sizeof(*lut));
+	lut->region = morse_reg_get_region(map->alpha);
+	lut->regdom = morse_reg_alpha_lookup(map->alpha);
+
+	if (WARN_ON(map->num_mapped_channels >= U8_MAX))
+		return;
+
+	for (ch = map->num_mapped_channels - 1; ch >= 0; ch--) {
+		const struct morse_dot11ah_channel *chan = &map->s1g_channels[ch];
+		int freq_idx = s1g_freq_khz_to_lut_idx(ieee80211_channel_to_khz(&chan->ch));
+		int bw_idx = s1g_bw_mhz_to_lut_idx(ch_flag_to_chan_bw(chan->ch.flags));
+
+		if (chan->ch.hw_value < S1G_CHAN_LUT_SIZE)
+			lut->by_s1g_chan[chan->ch.hw_value] = ch + 1;
+
+		if (chan->hw_value_map < S1G_CHAN_LUT_SIZE)
+			lut->by_5g_chan[chan->hw_value_map] = ch + 1;
+
+		if (freq_idx >= 0 && bw_idx >= 0)
+			lut->by_freq_bw[freq_idx][bw_idx] = ch + 1;
+		else
+			dot11ah_warn("S1G channel %d is outside of the lookup table\n",
+				     chan->ch.hw_value);
+
+		if (lut->regdom)
+			lut->rule[ch] = morse_regdom_find_rule(lut->regdom,
+							       ieee80211_channel_to_khz(&chan->ch));
+	}
+}
+
+const struct morse_regdomain *morse_dot11ah_get_regdom(void)
+{
+	return __mors_s1g_lut.regdom;
+}
+EXPORT_SYMBOL(morse_dot11ah_get_regdom);
+
+const struct morse_reg_rule *
+morse_dot11ah_channel_get_reg_rule(const struct morse_dot11ah_channel *chan)
+{
+	ptrdiff_t idx;
+
+	if (!chan || !__mors_s1g_map)
+		return NULL;
 
-	for (ch = 0; ch < __mors_s1g_map->num_mapped_channels; ch++) {
-		if (chan_5g == __mors_s1g_map->s1g_channels[ch].hw_value_map)
-			return &__mors_s1g_map->s1g_channels[ch];
+	idx = chan - __mors_s1g_map->s1g_channels;
+	if (idx < 0 || idx >= __mors_s1g_map->num_mapped_channels || idx >= U8_MAX)
+		return NULL;
+
+	return __mors_s1g_lut.rule[idx];
+}
+EXPORT_SYMBOL(morse_dot11ah_channel_get_reg_rule);
+
+const struct morse_reg_rule *morse_dot11ah_freq_khz_get_reg_rule(u32 freq_khz)
+{
+	int freq_idx = s1g_freq_khz_to_lut_idx(freq_khz);
+	int bw_idx;
+
+	if (freq_idx < 0)
+		return NULL;
+
+	/* Channels sharing a centre frequency share its rule, so any bandwidth will do */
+	for (bw_idx = 0; bw_idx < S1G_BW_LUT_SIZE; bw_idx++) {
+		u8 entry = __mors_s1g_lut.by_freq_bw[freq_idx][bw_idx];
+
+		if (entry)
+			return __mors_s1g_lut.rule[entry - 1];
 	}
 
 	return NULL;
 }
 
+static struct morse_dot11ah_channel *lookup_s1g_chan(int chan_s1g)
+{
+	if (chan_s1g < 0 || chan_s1g >= S1G_CHAN_LUT_SIZE)
+		return NULL;
+
+	return morse_dot11ah_lut_to_chan(__mors_s1g_lut.by_s1g_chan[chan_s1g]);
+}
+
+int morse_dot11ah_channel_set_map(const char *alpha)
+{
+	int i;
+
+	if (WARN_ON(!alpha))
+		return -ENOENT;
+
+	for (i = 0; i < ARRAY_SIZE(mapped_channels); i++)
+		if (!strncmp(mapped_channels[i]->alpha, alpha, strlen(alpha)))
+			__mors_s1g_map = mapped_channels[i];
+
+	if (!__mors_s1g_map)
+		return -ENOENT;
+
+	if (WARN_ON(!__mors_s1g_map->prim_1mhz_channel_loc_to_idx))
+		return -ENOENT;
+
+	if (WARN_ON(!__mors_s1g_map->calculate_primary_s1g))
+		return -ENOENT;
+
+	if (WARN_ON(!__mors_s1g_map->prim_1mhz_channel_loc_to_idx))
+		return -ENOENT;
+
+	if (WARN_ON(!__mors_s1g_map->get_pri_1mhz_chan))
+		return -ENOENT;
+
+	morse_dot11ah_channel_build_lut(__mors_s1g_map);
+
+	return 0;
+}
+
+struct morse_dot11ah_channel *lookup_s1g_chan_from_5g_chan(int chan_5g)
+{
+	if (__mors_s1g_map->transform_overlapping_5g_chan)
+		chan_5g = __mors_s1g_map->transform_overlapping_5g_chan(chan_5g);
+
+	if (chan_5g < 0 || chan_5g >= S1G_CHAN_LUT_SIZE)
+		return NULL;
+
+	return morse_dot11ah_lut_to_chan(__mors_s1g_lut.by_5g_chan[chan_5g]);
+}
+
 #if KERNEL_VERSION(5, 10, 0) > MAC80211_VERSION_CODE
 u8 ch_flag_to_chan_bw(enum morse_dot11ah_channel_flags flags)
 #else
@@ -461,16 +609,12 @@ EXPORT_SYMBOL(ch_flag_to_chan_bw);
 /* Return s1g frequency in HZ given s1g chan number */
 u32 morse_dot11ah_s1g_chan_to_s1g_freq(int chan_s1g)
 {
-	int ch;
-
-	for (ch = 0; ch < __mors_s1g_map->num_mapped_channels; ch++) {
-		const struct ieee80211_channel_s1g *chan = &__mors_s1g_map->s1g_channels[ch].ch;
+	const struct morse_dot11ah_channel *chan = lookup_s1g_chan(chan_s1g);
 
-		if (chan_s1g == chan->hw_value)
-			return KHZ_TO_HZ(ieee80211_channel_to_khz(chan));
-	}
+	if (!chan)
+		return false;
 
-	return false;
+	return KHZ_TO_HZ(ieee80211_channel_to_khz(&chan->ch));
 }
 EXPORT_SYMBOL(morse_dot11ah_s1g_chan_to_s1g_freq);
 
@@ -492,19 +636,19 @@ EXPORT_SYMBOL(morse_dot11ah_get_region_str);
 
 const struct morse_dot11ah_channel *morse_dot11ah_s1g_freq_to_s1g(int freq, int bw)
 {
-	int ch;
-	int _freq;
-	int _bw;
-
-	for (ch = 0; ch < __mors_s1g_map->num_mapped_channels; ch++) {
-		_freq = MHZ_TO_HZ(__mors_s1g_map->s1g_channels[ch].ch.center_freq) +
-				KHZ_TO_HZ(__mors_s1g_map->s1g_channels[ch].ch.freq_offset);
-		_bw = ch_flag_to_chan_bw(__mors_s1g_map->s1g_channels[ch].ch.flags);
-		if (freq == _freq && bw == _bw)
-			return &__mors_s1g_map->s1g_channels[ch];
-	}
+	int freq_idx;
+	int bw_idx;
 
-	return NULL;
+	/* Channel centre frequencies are all whole kHz */
+	if (freq < 0 || (freq % KHZ_TO_HZ(1)))
+		return NULL;
+
+	freq_idx = s1g_freq_khz_to_lut_idx(HZ_TO_KHZ(freq));
+	bw_idx = s1g_bw_mhz_to_lut_idx(bw);
+	if (freq_idx < 0 || bw_idx < 0)
+		return NULL;
+
+	return morse_dot11ah_lut_to_chan(__mors_s1g_lut.by_freq_bw[freq_idx][bw_idx]);
 }
 EXPORT_SYMBOL(morse_dot11ah_s1g_freq_to_s1g);
 
@@ -531,28 +675,21 @@ EXPORT_SYMBOL(morse_dot11ah_channel_chandef_to_s1g);
 
 int morse_dot11ah_s1g_chan_to_5g_chan(int chan_s1g)
 {
-	int ch;
+	const struct morse_dot11ah_channel *chan = lookup_s1g_chan(chan_s1g);
 
-	for (ch = 0; ch < __mors_s1g_map->num_mapped_channels; ch++)
-		if (chan_s1g ==  __mors_s1g_map->s1g_channels[ch].ch.hw_value)
-			return __mors_s1g_map->s1g_channels[ch].hw_value_map;
-
-	return -ENOENT;
+	return chan ? chan->hw_value_map : -ENOENT;
 }
 EXPORT_SYMBOL(morse_dot11ah_s1g_chan_to_5g_chan);
 
 int morse_dot11ah_s1g_chan_bw_to_5g_chan(int chan_s1g, int bw_mhz)
 {
-	int ch;
-	int ch_bw;
+	const struct morse_dot11ah_channel *chan = lookup_s1g_chan(chan_s1g);
 
-	for (ch = 0; ch < __mors_s1g_map->num_mapped_channels; ch++)
-		if (chan_s1g ==  __mors_s1g_map->s1g_channels[ch].ch.hw_value) {
-			ch_bw = ch_flag_to_chan_bw(__mors_s1g_map->s1g_channels[ch].ch.flags);
-			if (ch_bw == bw_mhz)
-				return __mors_s1g_map->s1g_channels[ch].hw_value_map;
-		}
-	return -ENOENT;
+	/* S1G channel numbers are unique within a region, so the bandwidth is a check only */
+	if (!chan || ch_flag_to_chan_bw(chan->ch.flags) != bw_mhz)
+		return -ENOENT;
+
+	return chan->hw_value_map;
 }
 EXPORT_SYMBOL(morse_dot11ah_s1g_chan_bw_to_5g_chan);
 
@@ -564,22 +701,16 @@ EXPORT_SYMBOL(morse_dot11ah_s1g_op_chan_pri_chan_to_5g);
 
 u32 morse_dot11ah_channel_get_flags(int chan_s1g)
 {
-	int ch;
-
-	for (ch = 0; ch < __mors_s1g_map->num_mapped_channels; ch++)
-		if (chan_s1g ==  __mors_s1g_map->s1g_channels[ch].ch.hw_value)
-			return __mors_s1g_map->s1g_channels[ch].ch.flags;
+	const struct morse_dot11ah_channel *chan = lookup_s1g_chan(chan_s1g);
 
 	/* Could not find the channel? it is safe to set flags = 0 */
-	return 0;
+	return chan ? chan->ch.flags : 0;
 }
 EXPORT_SYMBOL(morse_dot11ah_channel_get_flags);
 
 int morse_dot11ah_channel_to_freq_khz(int chan)
 {
-	enum morse_dot11ah_region region;
-
-	region = morse_reg_get_region(__mors_s1g_map->alpha);
+	enum morse_dot11ah_region region = __mors_s1g_lut.region;
 
 	switch (region) {
 	case MORSE_AU:
@@ -621,9 +752,7 @@ EXPORT_SYMBOL(morse_dot11ah_channel_to_freq_khz);
 int morse_dot11ah_freq_khz_bw_mhz_to_chan(u32 freq, u8 bw)
 {
 	int channel = 0;
-	enum morse_dot11ah_region region;
-
-	region = morse_reg_get_region(__mors_s1g_map->alpha);
+	enum morse_dot11ah_region region = __mors_s1g_lut.region;
 
 	switch (region) {
 	case MORSE_AU:
@@ -5,6 +5,7 @@
  */
 
 #include <linux/types.h>
+#include <linux/module.h>
 #include <linux/ieee80211.h>
 
 #include "dot11ah.h"
@@ -15,6 +16,22 @@
 /* TODO: ADE for AIDs > 7 (not tested in WFA nor advertised in marketing material) */
 #define ADE_AID_LIMIT		(7)
 
+static bool tim_enc_optimise __read_mostly;
+module_param(tim_enc_optimise, bool, 0644);
+MODULE_PARM_DESC(tim_enc_optimise,
+		 "Encode each S1G TIM block in whichever mode gives the smallest encoding");
+
+/**
+ * Encodings considered per block when optimising the S1G TIM for size. Inverse modes and ADE
+ * are not considered: inverse encodings are clamped by the largest AID, and ADE is only
+ * supported for the first 8 AIDs.
+ */
+static const enum dot11ah_tim_encoding_mode tim_enc_optimise_modes[] = {
+	ENC_MODE_BLOCK,
+	ENC_MODE_AID,
+	ENC_MODE_OLB,
+};
+
 /**
  * State structure for parsing from 11n TIM to S1G TIM
  */
@@ -783,6 +800,159 @@ static void morse_dot11_tim_to_s1g_parse_ade_mode(struct tim_to_s1g_parse_state
 	}
 }
 
+/* Encodings where the output for a block depends only on the AID bits within that block */
+static bool s1g_tim_enc_mode_is_block_local(enum dot11ah_tim_encoding_mode enc_mode)
+{
+	return enc_mode == ENC_MODE_BLOCK || enc_mode == ENC_MODE_AID;
+}
+
+/*
+ * Encode one block from the octets of the 11n virtual bitmap it covers, appending to the S1G TIM
+ * at index. Returns the new index into the S1G TIM.
+ */
+static u16 morse_dot11_tim_to_s1g_encode_block(struct dot11ah_s1g_tim_ie *s1g_tim, u16 index,
+					       const u8 *map, u8 block,
+					       enum dot11ah_tim_encoding_mode enc_mode,
+					       bool inverse_bitmap, u16 max_aid)
+{
+	struct tim_to_s1g_parse_state state = {
+		.s1g_tim = s1g_tim,
+		.virtual_map_11n = map,
+		.index_s1g = index,
+		.length_11n = S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK,
+		.octet_offset_11n = block * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK,
+	};
+
+	consume_11n_tim_octets(&state, 0);
+
+	while (state.length_11n > 0 && state.index_s1g < sizeof(s1g_tim->encoded_block_info)) {
+		if (enc_mode == ENC_MODE_BLOCK)
+			morse_dot11_tim_to_s1g_parse_block_mode(&state, inverse_bitmap, max_aid);
+		else if (enc_mode == ENC_MODE_OLB)
+			morse_dot11_tim_to_s1g_parse_olb_mode(&state, inverse_bitmap, max_aid);
+		else
+			morse_dot11_tim_to_s1g_parse_single_mode(&state, inverse_bitmap);
+	}
+
+	return state.index_s1g;
+}
+
+/*
+ * Encode one block in each of the candidate modes and append the smallest encoding to the S1G
+ * TIM at index. Returns the new index into the S1G TIM.
+ */
+static u16 morse_dot11_tim_to_s1g_encode_block_optimal(struct dot11ah_s1g_tim_cache *cache,
+						       struct dot11ah_s1g_tim_ie *s1g_tim,
+						       u16 index, const u8 *map, u8 block,
+						       u16 max_aid)
+{
+	struct dot11ah_s1g_tim_ie scratch;
+	enum dot11ah_tim_encoding_mode best_mode = ENC_MODE_UNKNOWN;
+	u16 best_len = 0;
+	u16 block_len = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tim_enc_optimise_modes); i++) {
+		enum dot11ah_tim_encoding_mode mode = tim_enc_optimise_modes[i];
+		u16 len = morse_dot11_tim_to_s1g_encode_block(&scratch, 0, map, block, mode,
+							      false, max_aid);
+
+		if (mode == ENC_MODE_BLOCK)
+			block_len = len;
+
+		if (len && (!best_len || len < best_len)) {
+			best_mode = mode;
+			best_len = len;
+			memcpy(&s1g_tim->encoded_block_info[index], scratch.encoded_block_info,
+			       min_t(u16, len, sizeof(s1g_tim->encoded_block_info) - index));
+		}
+	}
+
+	/* No AIDs set in this block */
+	if (best_mode == ENC_MODE_UNKNOWN)
+		return index;
+
+	cache->mode_count[best_mode]++;
+	cache->bytes_saved += block_len - best_len;
+
+	return min_t(u16, index + best_len, sizeof(s1g_tim->encoded_block_info));
+}
+
+/*
+ * Encode the 11n virtual bitmap block by block, reusing the previous encoding of any block whose
+ * AID bits have not changed. Produces the same encoded block information as a full parse.
+ * Returns the length of the encoded block information.
+ */
+static u16 morse_dot11_tim_to_s1g_encode_cached(struct dot11ah_s1g_tim_cache *cache,
+						struct dot11ah_s1g_tim_ie *s1g_tim,
+						const struct ieee80211_tim_ie *tim,
+						u8 tim_virtual_map_length,
+						enum dot11ah_tim_encoding_mode enc_mode,
+						bool inverse_bitmap, u16 max_aid, bool optimise)
+{
+	const u16 max_len = sizeof(s1g_tim->encoded_block_info);
+	u8 octet_offset = (tim->bitmap_ctrl & IEEE80211_TIM_BITMAP_OFFSET);
+	bool reuse = cache->valid && cache->optimise == optimise && cache->enc_mode == enc_mode &&
+		     cache->inverse_bitmap == inverse_bitmap && cache->max_aid == max_aid;
+	u16 index = 0;
+	int block;
+
+	for (block = 0; block < S1G_TIM_CACHE_NUM_BLOCKS; block++) {
+		struct dot11ah_s1g_tim_cache_block *entry = &cache->blocks[block];
+		u8 map[S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK];
+		u16 start = index;
+		int i;
+
+		/* Octets outside of the partial virtual bitmap have no AIDs set */
+		for (i = 0; i < sizeof(map); i++) {
+			int octet = (block * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK) + i - octet_offset;
+
+			map[i] = (octet >= 0 && octet < tim_virtual_map_length) ?
+				 tim->virtual_map[octet] : 0;
+		}
+
+		if (reuse && memcmp(entry->map, map, sizeof(map)) == 0) {
+			u16 len = min_t(u16, entry->len, max_len - index);
+
+			memcpy(&s1g_tim->encoded_block_info[index], &cache->encoded[entry->offset],
+			       len);
+			index += len;
+			if (len)
+				cache->hits++;
+		} else {
+			if (optimise)
+				index = morse_dot11_tim_to_s1g_encode_block_optimal(cache, s1g_tim,
+										    index, map,
+										    block, max_aid);
+			else
+				index = morse_dot11_tim_to_s1g_encode_block(s1g_tim, index, map,
+									    block, enc_mode,
+									    inverse_bitmap,
+									    max_aid);
+			memcpy(entry->map, map, sizeof(map));
+			cache->misses++;
+		}
+
+		entry->offset = start;
+		entry->len = index - start;
+
+		/* Out of room, later blocks are dropped as they would be by a full parse */
+		if (index >= max_len) {
+			cache->valid = false;
+			return index;
+		}
+	}
+
+	memcpy(cache->encoded, s1g_tim->encoded_block_info, index);
+	cache->optimise = optimise;
+	cache->enc_mode = enc_mode;
+	cache->inverse_bitmap = inverse_bitmap;
+	cache->max_aid = max_aid;
+	cache->valid = true;
+
+	return index;
+}
+
 /*
  * Convert S1G TIM to Non-S1G TIM.
  * The output Non-S1G map is limited only to the first 8 AIDs.
@@ -931,7 +1101,8 @@ error:
 	return length;
 }
 
-int morse_dot11_tim_to_s1g(struct dot11ah_s1g_tim_ie *s1g_tim,
+int morse_dot11_tim_to_s1g(struct dot11ah_s1g_tim_cache *cache,
+			   struct dot11ah_s1g_tim_ie *s1g_tim,
 			   const struct ieee80211_tim_ie *tim,
 			   u8 tim_virtual_map_length,
 			   enum dot11ah_tim_encoding_mode enc_mode,
@@ -943,6 +1114,7 @@ int morse_dot11_tim_to_s1g(struct dot11ah_s1g_tim_ie *s1g_tim,
 	u8 octet_offset;
 	struct tim_to_s1g_parse_state state;
 	int s1g_tim_length = 0;
+	const bool optimise = READ_ONCE(tim_enc_optimise);
 
 	if (!s1g_tim || !tim)
 		/* Account for max length we will send */
@@ -980,6 +1152,17 @@ int morse_dot11_tim_to_s1g(struct dot11ah_s1g_tim_ie *s1g_tim,
 	state.length_11n = tim_virtual_map_length;
 	state.virtual_map_11n = tim->virtual_map;
 
+	if (cache && (optimise || s1g_tim_enc_mode_is_block_local(enc_mode))) {
+		state.index_s1g = morse_dot11_tim_to_s1g_encode_cached(cache, s1g_tim, tim,
+								       tim_virtual_map_length,
+								       enc_mode, inverse_bitmap,
+								       max_aid, optimise);
+		/* Everything has been encoded */
+		state.length_11n = 0;
+	} else if (cache) {
+		cache->valid = false;
+	}
+
 	/*
 	 * Consume any empty octets at the start of the 11n TIM.
 	 *	This can happen if the virtual map starts at an odd offset, or if we get passed an
@@ -1027,43 +1210,55 @@ error:
 	return s1g_tim_length;
 }
 
-void morse_dot11ah_insert_s1g_tim(struct ieee80211_vif *vif, struct dot11ah_ies_mask *ies_mask,
-				  u8 page_slice_no, u8 page_index)
+int morse_dot11ah_build_s1g_tim(struct ieee80211_vif *vif, struct dot11ah_s1g_tim_ie *s1g_tim,
+				const struct ieee80211_tim_ie *tim, u8 tim_len,
+				u8 page_slice_no, u8 page_index)
 {
-	int length;
 	struct morse_vif *mors_vif = (struct morse_vif *)vif->drv_priv;
-	struct dot11ah_s1g_tim_ie s1g_tim_ie;
-	const struct ieee80211_tim_ie *tim;
 	enum dot11ah_tim_encoding_mode enc_mode;
 	u8 tim_virtual_map_len_11n;
 	bool inverse_bitmap;
 
-	/* SW-4741: in IBSS, TIM element is not relevant and should not be inserted */
-	if (vif->type == NL80211_IFTYPE_ADHOC)
-		return;
-
 	/* enc_mode here is 3 bits, carrying both encoding mode and inverse bitmap fields
 	 * TODO: add inverse_bitmap field separate in morsectrl instead of muxing it with enc_mode
 	 */
 	enc_mode = mors_vif ? (mors_vif->custom_configs->enc_mode & 0x03) : 0;
 	inverse_bitmap = mors_vif ? ((mors_vif->custom_configs->enc_mode & 0x04) >> 2) : 0;
 
-	tim = (const struct ieee80211_tim_ie *)ies_mask->ies[WLAN_EID_TIM].ptr;
-
 	/* 11n TIM is either 2 bytes (with no virtual map), or 3 bytes + virtual map */
-	tim_virtual_map_len_11n = (ies_mask->ies[WLAN_EID_TIM].len <= 2) ?
-			0 : (ies_mask->ies[WLAN_EID_TIM].len - 3);
+	tim_virtual_map_len_11n = (tim_len <= 2) ? 0 : (tim_len - 3);
+
+	return morse_dot11_tim_to_s1g(&mors_vif->ap->tim_cache,
+				      s1g_tim,
+				      tim,
+				      tim_virtual_map_len_11n,
+				      enc_mode,
+				      inverse_bitmap,
+				      mors_vif->ap->largest_aid,
+				      page_slice_no,
+				      page_index);
+}
+EXPORT_SYMBOL(morse_dot11ah_build_s1g_tim);
+
+void morse_dot11ah_insert_s1g_tim(struct ieee80211_vif *vif, struct dot11ah_ies_mask *ies_mask,
+				  u8 page_slice_no, u8 page_index)
+{
+	int length;
+	struct dot11ah_s1g_tim_ie s1g_tim_ie;
+	const struct ieee80211_tim_ie *tim;
+	u8 tim_len;
+
+	/* SW-4741: in IBSS, TIM element is not relevant and should not be inserted */
+	if (vif->type == NL80211_IFTYPE_ADHOC)
+		return;
+
+	tim = (const struct ieee80211_tim_ie *)ies_mask->ies[WLAN_EID_TIM].ptr;
+	tim_len = ies_mask->ies[WLAN_EID_TIM].len;
 
 	morse_dot11_clear_eid_from_ies_mask(ies_mask, WLAN_EID_TIM);
 
-	length = morse_dot11_tim_to_s1g(&s1g_tim_ie,
-					tim,
-					tim_virtual_map_len_11n,
-					enc_mode,
-					inverse_bitmap,
-					mors_vif->ap->largest_aid,
-					page_slice_no,
-					page_index);
+	length = morse_dot11ah_build_s1g_tim(vif, &s1g_tim_ie, tim, tim_len,
+					     page_slice_no, page_index);
 
 	morse_dot11ah_insert_element(ies_mask, WLAN_EID_TIM, (u8 *)&s1g_tim_ie, length);
 }
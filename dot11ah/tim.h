@@ -78,9 +78,60 @@ struct dot11ah_s1g_tim_ie {
 	u8 encoded_block_info[S1G_TIM_MAX_BLOCK_SIZE];
 } __packed;
 
+/* Number of S1G blocks needed to cover the full 11n virtual bitmap */
+#define S1G_TIM_CACHE_NUM_BLOCKS \
+		DIV_ROUND_UP(DOT11_MAX_TIM_VIRTUAL_MAP_LENGTH, S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK)
+
+/**
+ * struct dot11ah_s1g_tim_cache_block - Cached encoding of one S1G block (64 AIDs)
+ *
+ * @map: 11n virtual bitmap octets covering the block when it was last encoded
+ * @offset: Offset of the block's encoding in &dot11ah_s1g_tim_cache.encoded
+ * @len: Length of the block's encoding (0 if no AIDs in the block are set)
+ */
+struct dot11ah_s1g_tim_cache_block {
+	u8 map[S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK];
+	u16 offset;
+	u8 len;
+};
+
+/**
+ * struct dot11ah_s1g_tim_cache - Encoded S1G TIM from the previous beacon
+ *
+ * Lets consecutive beacons only re-encode the blocks whose AID bits changed. Only used for
+ * encoding modes where each block encodes independently (block bitmap and single AID), or
+ * when each block's encoding mode is chosen by size.
+ *
+ * @valid: Cache holds the encoding of the previous TIM
+ * @optimise: Cache was built choosing the smallest encoding mode per block
+ * @enc_mode: Encoding mode the cache was built with
+ * @inverse_bitmap: Inverse mode the cache was built with
+ * @max_aid: Largest AID the cache was built with
+ * @hits: Number of blocks reused from the cache
+ * @misses: Number of blocks re-encoded
+ * @mode_count: Number of blocks encoded in each mode when optimising, by encoding mode
+ * @bytes_saved: Bytes saved by optimising, compared to encoding in block bitmap mode
+ * @blocks: Per block state, indexed by block offset
+ * @encoded: Encoded block information of the previous TIM
+ */
+struct dot11ah_s1g_tim_cache {
+	bool valid;
+	bool optimise;
+	u8 enc_mode;
+	bool inverse_bitmap;
+	u16 max_aid;
+	u32 hits;
+	u32 misses;
+	u32 mode_count[ENC_MODE_ADE + 1];
+	u64 bytes_saved;
+	struct dot11ah_s1g_tim_cache_block blocks[S1G_TIM_CACHE_NUM_BLOCKS];
+	u8 encoded[S1G_TIM_MAX_BLOCK_SIZE];
+};
+
 /**
  * morse_dot11_tim_to_s1g() - convert non S1G TIM to S1G TIM
  *
+ * @cache: Encoding of the previous TIM for this interface, updated on return. May be NULL.
  * @s1g_tim: pointer to S1G TIM (after conversion).
  * @tim: pointer to 11n TIM element data.
  * @tim_virtual_map_length: length of TIM partial virtual bitmap.
@@ -92,7 +143,8 @@ struct dot11ah_s1g_tim_ie {
  *
  * Return: The length of the S1G TIM element.
  */
-int morse_dot11_tim_to_s1g(struct dot11ah_s1g_tim_ie *s1g_tim,
+int morse_dot11_tim_to_s1g(struct dot11ah_s1g_tim_cache *cache,
+			   struct dot11ah_s1g_tim_ie *s1g_tim,
 			   const struct ieee80211_tim_ie *tim,
 			   u8 tim_virtual_map_length,
 			   enum dot11ah_tim_encoding_mode enc_mode,
@@ -104,6 +156,24 @@ int morse_dot11_tim_to_s1g(struct dot11ah_s1g_tim_ie *s1g_tim,
 int morse_dot11_s1g_to_tim(struct ieee80211_tim_ie *tim, const struct dot11ah_s1g_tim_ie *s1g_tim,
 			   size_t total_len);
 
+/**
+ * morse_dot11ah_build_s1g_tim() - translate an 11n TIM to an S1G TIM for an interface
+ *
+ * @vif: The AP interface the TIM is for.
+ * @s1g_tim: S1G TIM to fill.
+ * @tim: 11n TIM element data.
+ * @tim_len: Length of the 11n TIM element data.
+ * @page_slice_no: Number of page slice belonging to a page included in TIM.
+ * @page_index: Index of the page being served in the TIM.
+ *
+ * Uses the interface's configured encoding mode and TIM cache.
+ *
+ * Return: The length of the S1G TIM element data.
+ */
+int morse_dot11ah_build_s1g_tim(struct ieee80211_vif *vif, struct dot11ah_s1g_tim_ie *s1g_tim,
+				const struct ieee80211_tim_ie *tim, u8 tim_len,
+				u8 page_slice_no, u8 page_index);
+
 /**
  * morse_dot11ah_insert_s1g_tim() - translate to S1G TIM and insert into ies_mask
  *
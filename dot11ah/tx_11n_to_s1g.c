@@ -231,11 +231,10 @@ static int morse_dot11ah_insert_country_ie(struct dot11ah_ies_mask *ies_mask,
 	struct dot11ah_country_ie country_ie;
 	const struct morse_regdomain *regdom;
 
-	const char *region = morse_dot11ah_get_region_str();
-
 	memset(&country_ie, 0, sizeof(country_ie));
 
-	regdom = morse_reg_alpha_lookup(region);
+	/* Resolved when the region was set, rather than for every frame */
+	regdom = morse_dot11ah_get_regdom();
 	if (!regdom)
 		return 0;
 
@@ -0,0 +1,440 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Emulated bus, backed by host memory, for exercising the host side of the driver without a
+ * chip. Memory reads and writes go to a window of host memory at the chip's pager base address
+ * and registers are kept in a small table, with a configurable cost per transfer.
+ */
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/vmalloc.h>
+#include <linux/hashtable.h>
+#include <linux/delay.h>
+#include <linux/math64.h>
+
+#include "morse.h"
+#include "mac.h"
+#include "debug.h"
+#include "bus.h"
+
+#define MORSE_EMU_DBG(_m, _f, _a...)		morse_dbg(FEATURE_ID_EMU, _m, _f, ##_a)
+#define MORSE_EMU_INFO(_m, _f, _a...)		morse_info(FEATURE_ID_EMU, _m, _f, ##_a)
+#define MORSE_EMU_WARN(_m, _f, _a...)		morse_warn(FEATURE_ID_EMU, _m, _f, ##_a)
+#define MORSE_EMU_ERR(_m, _f, _a...)		morse_err(FEATURE_ID_EMU, _m, _f, ##_a)
+
+#define MORSE_EMU_DRV_NAME		"morse_emu"
+#define MORSE_EMU_MAX_DEVICES		(8)
+#define MORSE_EMU_REG_HASH_BITS		(6)
+
+/* Transfers costing less than this are busy waited rather than slept */
+#define MORSE_EMU_MIN_SLEEP_NS		(20 * NSEC_PER_USEC)
+
+static uint emu_devices __read_mostly;
+module_param(emu_devices, uint, 0444);
+MODULE_PARM_DESC(emu_devices, "Number of emulated bus devices to create (0 to disable)");
+
+static uint emu_chip_id __read_mostly = MM8108B2_ID;
+module_param(emu_chip_id, uint, 0444);
+MODULE_PARM_DESC(emu_chip_id, "Chip ID reported by emulated devices");
+
+static uint emu_mem_kib __read_mostly = 256;
+module_param(emu_mem_kib, uint, 0444);
+MODULE_PARM_DESC(emu_mem_kib, "Size of the emulated memory window, in KiB");
+
+static uint emu_xfer_latency_us __read_mostly;
+module_param(emu_xfer_latency_us, uint, 0644);
+MODULE_PARM_DESC(emu_xfer_latency_us, "Fixed cost of each emulated bus transfer, in us");
+
+static uint emu_bandwidth_kbps __read_mostly;
+module_param(emu_bandwidth_kbps, uint, 0644);
+MODULE_PARM_DESC(emu_bandwidth_kbps, "Emulated bus bandwidth in kbit/s (0 for unlimited)");
+
+struct morse_emu_reg {
+	struct hlist_node node;
+	u32 addr;
+	u32 value;
+};
+
+/**
+ * struct morse_emu - Emulated bus state
+ *
+ * @bus_lock: Held while the bus is claimed
+ * @lock: Protects @mem and @regs
+ * @mem: Host memory standing in for the chip memory at @mem_base
+ * @mem_base: Chip address of the start of @mem
+ * @mem_size: Size of @mem in bytes
+ * @regs: Registers written so far, also holding the chip ID
+ */
+struct morse_emu {
+	struct mutex bus_lock;
+	spinlock_t lock;
+	u8 *mem;
+	u32 mem_base;
+	u32 mem_size;
+	DECLARE_HASHTABLE(regs, MORSE_EMU_REG_HASH_BITS);
+};
+
+static struct platform_device *morse_emu_pdevs[MORSE_EMU_MAX_DEVICES];
+
+/* Model the time a transfer of @len bytes takes on the bus */
+static void morse_emu_xfer_delay(unsigned int len)
+{
+	u32 kbps = READ_ONCE(emu_bandwidth_kbps);
+	u64 ns = (u64)READ_ONCE(emu_xfer_latency_us) * NSEC_PER_USEC;
+
+	/* kbit/s is bits per ms */
+	if (kbps)
+		ns += div_u64((u64)len * BITS_PER_BYTE * NSEC_PER_MSEC, kbps);
+
+	if (!ns)
+		return;
+
+	if (ns < MORSE_EMU_MIN_SLEEP_NS) {
+		ndelay(ns);
+	} else {
+		unsigned long us = div_u64(ns, NSEC_PER_USEC);
+
+		usleep_range(us, us + us / 8);
+	}
+}
+
+static struct morse_emu_reg *morse_emu_reg_find(struct morse_emu *emu, u32 addr)
+{
+	struct morse_emu_reg *reg;
+
+	hash_for_each_possible(emu->regs, reg, node, addr) {
+		if (reg->addr == addr)
+			return reg;
+	}
+
+	return NULL;
+}
+
+static int morse_emu_reg_store(struct morse_emu *emu, u32 addr, u32 value)
+{
+	struct morse_emu_reg *reg;
+
+	reg = morse_emu_reg_find(emu, addr);
+	if (!reg) {
+		reg = kmalloc(sizeof(*reg), GFP_ATOMIC);
+		if (!reg)
+			return -ENOMEM;
+		reg->addr = addr;
+		hash_add(emu->regs, &reg->node, addr);
+	}
+	reg->value = value;
+
+	return 0;
+}
+
+/* Return the offset of [@addr, @addr + @len) in the memory window, or a negative error */
+static int morse_emu_mem_offset(struct morse_emu *emu, u32 addr, int len)
+{
+	if (len < 0 || addr < emu->mem_base || addr - emu->mem_base > emu->mem_size ||
+	    len > emu->mem_size - (addr - emu->mem_base))
+		return -EFAULT;
+
+	return addr - emu->mem_base;
+}
+
+static int morse_emu_dm_read(struct morse *mors, u32 addr, u8 *data, int len)
+{
+	struct morse_emu *emu = (struct morse_emu *)mors->drv_priv;
+	int offset;
+
+	spin_lock_bh(&emu->lock);
+	offset = morse_emu_mem_offset(emu, addr, len);
+	if (offset >= 0)
+		memcpy(data, emu->mem + offset, len);
+	spin_unlock_bh(&emu->lock);
+
+	if (offset < 0) {
+		MORSE_EMU_ERR(mors, "%s: 0x%08x (%d bytes) is outside emulated memory\n",
+			      __func__, addr, len);
+		return offset;
+	}
+
+	morse_emu_xfer_delay(len);
+	return 0;
+}
+
+static int morse_emu_dm_write(struct morse *mors, u32 addr, const u8 *data, int len)
+{
+	struct morse_emu *emu = (struct morse_emu *)mors->drv_priv;
+	int offset;
+
+	spin_lock_bh(&emu->lock);
+	offset = morse_emu_mem_offset(emu, addr, len);
+	if (offset >= 0)
+		memcpy(emu->mem + offset, data, len);
+	spin_unlock_bh(&emu->lock);
+
+	if (offset < 0) {
+		MORSE_EMU_ERR(mors, "%s: 0x%08x (%d bytes) is outside emulated memory\n",
+			      __func__, addr, len);
+		return offset;
+	}
+
+	morse_emu_xfer_delay(len);
+	return 0;
+}
+
+static int morse_emu_reg32_read(struct morse *mors, u32 addr, u32 *data)
+{
+	struct morse_emu *emu = (struct morse_emu *)mors->drv_priv;
+	struct morse_emu_reg *reg;
+	int offset;
+
+	spin_lock_bh(&emu->lock);
+	offset = morse_emu_mem_offset(emu, addr, sizeof(*data));
+	if (offset >= 0) {
+		memcpy(data, emu->mem + offset, sizeof(*data));
+	} else {
+		/* Registers that were never written read as zero */
+		reg = morse_emu_reg_find(emu, addr);
+		*data = reg ? reg->value : 0;
+	}
+	spin_unlock_bh(&emu->lock);
+
+	morse_emu_xfer_delay(sizeof(*data));
+	return 0;
+}
+
+static int morse_emu_reg32_write(struct morse *mors, u32 addr, u32 data)
+{
+	struct morse_emu *emu = (struct morse_emu *)mors->drv_priv;
+	int offset;
+	int ret = 0;
+
+	spin_lock_bh(&emu->lock);
+	offset = morse_emu_mem_offset(emu, addr, sizeof(data));
+	if (offset >= 0)
+		memcpy(emu->mem + offset, &data, sizeof(data));
+	else
+		ret = morse_emu_reg_store(emu, addr, data);
+	spin_unlock_bh(&emu->lock);
+
+	morse_emu_xfer_delay(sizeof(data));
+	return ret;
+}
+
+static int morse_emu_reset(struct morse *mors)
+{
+	struct morse_emu *emu = (struct morse_emu *)mors->drv_priv;
+
+	spin_lock_bh(&emu->lock);
+	memset(emu->mem, 0, emu->mem_size);
+	spin_unlock_bh(&emu->lock);
+
+	return 0;
+}
+
+static void morse_emu_set_bus_enable(struct morse *mors, bool enable)
+{
+}
+
+static void morse_emu_config_burst_mode(struct morse *mors, bool enable_burst)
+{
+}
+
+static void morse_emu_claim(struct morse *mors)
+{
+	struct morse_emu *emu = (struct morse_emu *)mors->drv_priv;
+
+	mutex_lock(&emu->bus_lock);
+}
+
+static void morse_emu_set_irq(struct morse *mors, bool enable)
+{
+}
+
+static void morse_emu_release(struct morse *mors)
+{
+	struct morse_emu *emu = (struct morse_emu *)mors->drv_priv;
+
+	mutex_unlock(&emu->bus_lock);
+}
+
+static const struct morse_bus_ops morse_emu_ops = {
+	.dm_read = morse_emu_dm_read,
+	.dm_write = morse_emu_dm_write,
+	.reg32_read = morse_emu_reg32_read,
+	.reg32_write = morse_emu_reg32_write,
+	.reset = morse_emu_reset,
+	.set_bus_enable = morse_emu_set_bus_enable,
+	.config_burst_mode = morse_emu_config_burst_mode,
+	.claim = morse_emu_claim,
+	.set_irq = morse_emu_set_irq,
+	.release = morse_emu_release,
+	.bulk_alignment = MORSE_DEFAULT_BULK_ALIGNMENT,
+};
+
+static struct morse_chip_series *morse_emu_chip_series(u32 chip_id)
+{
+	switch (chip_id) {
+	case MM6108A0_ID:
+	case MM6108A1_ID:
+	case MM6108A2_ID:
+		return &mm61xx_chip_series;
+	default:
+		return &mm81xx_chip_series;
+	}
+}
+
+static void morse_emu_free(struct morse_emu *emu)
+{
+	struct morse_emu_reg *reg;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe(emu->regs, bkt, tmp, reg, node) {
+		hash_del(&reg->node);
+		kfree(reg);
+	}
+	vfree(emu->mem);
+}
+
+static int morse_emu_probe(struct platform_device *pdev)
+{
+	struct morse_chip_series *mors_chip_series = morse_emu_chip_series(emu_chip_id);
+	struct morse_emu *emu;
+	struct morse *mors;
+	int ret;
+
+	mors = morse_mac_create(sizeof(*emu), &pdev->dev);
+	if (!mors) {
+		dev_err(&pdev->dev, "morse_mac_create failed\n");
+		return -ENOMEM;
+	}
+
+	mors->bus_ops = &morse_emu_ops;
+	mors->bus_type = MORSE_HOST_BUS_TYPE_EMU;
+
+	emu = (struct morse_emu *)mors->drv_priv;
+	mutex_init(&emu->bus_lock);
+	spin_lock_init(&emu->lock);
+	hash_init(emu->regs);
+	emu->mem_size = emu_mem_kib * 1024;
+	emu->mem = vzalloc(emu->mem_size);
+	if (!emu->mem) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	ret = morse_emu_reg_store(emu, mors_chip_series->chip_id_address, emu_chip_id);
+	if (ret)
+		goto err;
+
+	ret = morse_chip_cfg_detect_and_init(mors, mors_chip_series);
+	if (ret < 0) {
+		MORSE_EMU_ERR(mors, "morse_chip_cfg_detect_and_init failed: %d\n", ret);
+		goto err;
+	}
+
+	mors->cfg->mm_ps_gpios_supported = false;
+
+	ret = morse_hw_regs_attach(mors->cfg, mors->chip_id);
+	if (ret < 0) {
+		MORSE_EMU_ERR(mors, "morse hw regs attach failed: %d\n", ret);
+		goto err;
+	}
+
+	/* The chip ID register is outside the window, so it is left in the register table */
+	spin_lock_bh(&emu->lock);
+	emu->mem_base = mors->cfg->regs->pager_base_address;
+	spin_unlock_bh(&emu->lock);
+
+	platform_set_drvdata(pdev, mors);
+	MORSE_EMU_INFO(mors, "Emulated chip 0x%04x, %u KiB at 0x%08x\n",
+		       mors->chip_id, emu_mem_kib, emu->mem_base);
+
+#ifdef CONFIG_MORSE_ENABLE_TEST_MODES
+	if (test_mode == MORSE_CONFIG_TEST_MODE_BUS) {
+		morse_bus_test(mors, "EMU");
+		return 0;
+	}
+#endif
+
+	/* There is no firmware model behind the bus, so stop before firmware load */
+	MORSE_EMU_INFO(mors, "Bus ready, firmware is not emulated\n");
+	return 0;
+
+err:
+	morse_emu_free(emu);
+	morse_mac_destroy(mors);
+	return ret;
+}
+
+#if KERNEL_VERSION(6, 11, 0) <= LINUX_VERSION_CODE
+static void morse_emu_remove(struct platform_device *pdev)
+#else
+static int morse_emu_remove(struct platform_device *pdev)
+#endif
+{
+	struct morse *mors = platform_get_drvdata(pdev);
+
+	if (mors) {
+		morse_emu_free((struct morse_emu *)mors->drv_priv);
+		morse_mac_destroy(mors);
+	}
+#if KERNEL_VERSION(6, 11, 0) > LINUX_VERSION_CODE
+
+	return 0;
+#endif
+}
+
+static struct platform_driver morse_emu_driver = {
+	.probe = morse_emu_probe,
+	.remove = morse_emu_remove,
+	.driver = {
+		.name = MORSE_EMU_DRV_NAME,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+	},
+};
+
+int __init morse_emu_init(void)
+{
+	int ret;
+	int i;
+
+	if (!emu_devices)
+		return 0;
+
+	ret = platform_driver_register(&morse_emu_driver);
+	if (ret) {
+		MORSE_PR_ERR(FEATURE_ID_EMU, "platform_driver_register() failed: %d\n", ret);
+		return ret;
+	}
+
+	for (i = 0; i < min_t(uint, emu_devices, MORSE_EMU_MAX_DEVICES); i++) {
+		morse_emu_pdevs[i] = platform_device_register_simple(MORSE_EMU_DRV_NAME, i,
+								     NULL, 0);
+		if (IS_ERR(morse_emu_pdevs[i])) {
+			ret = PTR_ERR(morse_emu_pdevs[i]);
+			morse_emu_pdevs[i] = NULL;
+			MORSE_PR_ERR(FEATURE_ID_EMU, "failed to create emulated device %d: %d\n",
+				     i, ret);
+			break;
+		}
+	}
+
+	return ret;
+}
+
+void __exit morse_emu_exit(void)
+{
+	int i;
+
+	if (!emu_devices)
+		return;
+
+	for (i = 0; i < MORSE_EMU_MAX_DEVICES; i++) {
+		if (morse_emu_pdevs[i])
+			platform_device_unregister(morse_emu_pdevs[i]);
+		morse_emu_pdevs[i] = NULL;
+	}
+
+	platform_driver_unregister(&morse_emu_driver);
+}
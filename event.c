@@ -8,6 +8,7 @@
 #include <linux/types.h>
 #include <linux/atomic.h>
 #include <linux/slab.h>
+#include <linux/etherdevice.h>
 #include <linux/atomic.h>
 #include <linux/workqueue.h>
 
@@ -24,6 +25,14 @@
 #include "wiphy.h"
 #include "hw_scan.h"
 
+/** Most events taken off the queue, and searched for coalescing, per run of the event worker */
+#define MORSE_EVENT_BATCH_MAX		(32)
+
+static bool enable_event_worker __read_mostly = true;
+module_param(enable_event_worker, bool, 0444);
+MODULE_PARM_DESC(enable_event_worker,
+		 "Handle firmware events in batches on their own worker, not the chip worker");
+
 /** List of reason codes to use in the `command_connection_loss_evt` event */
 enum connection_loss_reason_code {
 	CONNECTION_LOSS_REASON_TSF_RESET = 0,
@@ -39,7 +48,7 @@ static const char *connection_loss_reason_to_str(enum connection_loss_reason_cod
 	}
 }
 
-int morse_mac_event_recv(struct morse *mors, struct sk_buff *skb)
+static int morse_mac_event_process(struct morse *mors, struct sk_buff *skb)
 {
 	int ret;
 
@@ -79,10 +88,13 @@ int morse_mac_event_recv(struct morse *mors, struct sk_buff *skb)
 		{
 			struct morse_evt_beacon_loss *bcn_loss_evt =
 			    (struct morse_evt_beacon_loss *)event;
-			struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
+			struct ieee80211_vif *vif;
 
+			rcu_read_lock();
+			vif = morse_get_vif_from_vif_id(mors, vif_id);
 			if (vif)
 				ieee80211_beacon_loss(vif);
+			rcu_read_unlock();
 
 			MORSE_DBG(mors, "Beacon loss event: number of beacons %u, vif id %u\n",
 				  bcn_loss_evt->num_bcns, vif_id);
@@ -142,9 +154,19 @@ int morse_mac_event_recv(struct morse *mors, struct sk_buff *skb)
 		}
 	case MORSE_COMMAND_EVT_OCS_DONE:
 		{
-			struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
+			struct ieee80211_vif *vif;
 
-			ret = morse_evt_ocs_done(ieee80211_vif_to_morse_vif(vif), event);
+			/* morse_evt_ocs_done() sleeps, so it cannot be called under RCU. The
+			 * firmware only reports OCS done for the live AP interface that started it.
+			 */
+			rcu_read_lock();
+			vif = morse_get_vif_from_vif_id(mors, vif_id);
+			rcu_read_unlock();
+
+			if (vif)
+				ret = morse_evt_ocs_done(ieee80211_vif_to_morse_vif(vif), event);
+			else
+				ret = -ENODEV;
 			break;
 		}
 	case MORSE_COMMAND_EVT_SCAN_RESULT:
@@ -214,13 +236,16 @@ int morse_mac_event_recv(struct morse *mors, struct sk_buff *skb)
 		{
 			struct morse_evt_connection_loss *conn_loss =
 				(struct morse_evt_connection_loss *)event;
-			struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
+			struct ieee80211_vif *vif;
 
 			MORSE_ERR(mors, "%s: connection loss observed on vif:%d, reason: '%s'",
 				__func__, vif_id, connection_loss_reason_to_str(conn_loss->reason));
 
+			rcu_read_lock();
+			vif = morse_get_vif_from_vif_id(mors, vif_id);
 			if (vif)
 				ieee80211_connection_loss(vif);
+			rcu_read_unlock();
 
 			ret = 0;
 			break;
@@ -232,3 +257,178 @@ int morse_mac_event_recv(struct morse *mors, struct sk_buff *skb)
 exit:
 	return ret;
 }
+
+/**
+ * morse_mac_event_is_urgent() - Check if an event must be handled in the chip worker
+ * @event_id: Event message ID
+ *
+ * Traffic control pauses data TX, so is not held back behind slower events.
+ *
+ * Return: true if the event is handled as soon as it is received
+ */
+static bool morse_mac_event_is_urgent(u16 event_id)
+{
+	return event_id == MORSE_COMMAND_EVT_UMAC_TRAFFIC_CONTROL;
+}
+
+/**
+ * morse_mac_event_superseded() - Check if a later event makes an earlier one redundant
+ * @skb: The earlier event
+ * @later: A later event with the same message ID
+ *
+ * Return: true if only @later needs handling
+ */
+static bool morse_mac_event_superseded(const struct sk_buff *skb, const struct sk_buff *later)
+{
+	const struct morse_event *event = (const struct morse_event *)skb->data;
+	const struct morse_event *later_event = (const struct morse_event *)later->data;
+
+	if (event->hdr.vif_id != later_event->hdr.vif_id)
+		return false;
+
+	switch (le16_to_cpu(event->hdr.message_id)) {
+	case MORSE_COMMAND_EVT_BEACON_LOSS:
+		return true;
+	case MORSE_COMMAND_EVT_SCAN_RESULT:
+		{
+			const struct morse_evt_scan_result *result =
+			    (const struct morse_evt_scan_result *)skb->data;
+			const struct morse_evt_scan_result *later_result =
+			    (const struct morse_evt_scan_result *)later->data;
+
+			/* The BSS entry is overwritten anyway, report just its latest frame */
+			return skb->len >= sizeof(*result) && later->len >= sizeof(*later_result) &&
+			       result->channel_freq_hz == later_result->channel_freq_hz &&
+			       result->frame_type == later_result->frame_type &&
+			       ether_addr_equal(result->bssid, later_result->bssid);
+		}
+	default:
+		return false;
+	}
+}
+
+/**
+ * morse_mac_event_coalesce() - Check the rest of a batch for an event superseding this one
+ * @batch: Events received after @skb
+ * @skb: Event to check
+ *
+ * Only the run of events with the same message ID directly after @skb is searched, so coalescing
+ * never reorders an event relative to a different one (for example a scan result and scan done).
+ *
+ * Return: true if @skb can be dropped
+ */
+static bool morse_mac_event_coalesce(struct sk_buff_head *batch, const struct sk_buff *skb)
+{
+	const struct morse_event *event = (const struct morse_event *)skb->data;
+	struct sk_buff *later;
+
+	skb_queue_walk(batch, later) {
+		const struct morse_event *later_event = (const struct morse_event *)later->data;
+
+		if (later_event->hdr.message_id != event->hdr.message_id)
+			break;
+
+		if (morse_mac_event_superseded(skb, later))
+			return true;
+	}
+
+	return false;
+}
+
+static void morse_mac_event_work(struct work_struct *work)
+{
+	struct morse *mors = container_of(work, struct morse, event.work);
+	struct sk_buff_head batch;
+	struct sk_buff *skb;
+	int coalesced = 0;
+	bool more;
+
+	__skb_queue_head_init(&batch);
+
+	spin_lock_bh(&mors->event.q.lock);
+	while (skb_queue_len(&batch) < MORSE_EVENT_BATCH_MAX) {
+		skb = __skb_dequeue(&mors->event.q);
+		if (!skb)
+			break;
+		__skb_queue_tail(&batch, skb);
+	}
+	more = !skb_queue_empty(&mors->event.q);
+	spin_unlock_bh(&mors->event.q.lock);
+
+	while ((skb = __skb_dequeue(&batch))) {
+		if (morse_mac_event_coalesce(&batch, skb))
+			coalesced++;
+		else
+			morse_mac_event_process(mors, skb);
+		morse_skb_cache_free(mors, skb);
+	}
+
+	if (coalesced)
+		MORSE_DBG(mors, "%s: coalesced %d events\n", __func__, coalesced);
+
+	/* Requeue rather than loop, so a flood of events cannot hold off morse_mac_event_stop() */
+	if (more)
+		queue_work(mors->event.wq, &mors->event.work);
+}
+
+int morse_mac_event_recv(struct morse *mors, struct sk_buff *skb)
+{
+	struct morse_event *event = (struct morse_event *)(skb->data);
+	int ret;
+
+	if (!morse_mac_event_is_urgent(le16_to_cpu(event->hdr.message_id))) {
+		spin_lock_bh(&mors->event.q.lock);
+		if (mors->event.wq) {
+			__skb_queue_tail(&mors->event.q, skb);
+			queue_work(mors->event.wq, &mors->event.work);
+			spin_unlock_bh(&mors->event.q.lock);
+			return 0;
+		}
+		spin_unlock_bh(&mors->event.q.lock);
+	}
+
+	ret = morse_mac_event_process(mors, skb);
+	morse_skb_cache_free(mors, skb);
+
+	return ret;
+}
+
+void morse_mac_event_start(struct morse *mors)
+{
+	struct workqueue_struct *wq;
+
+	if (!enable_event_worker)
+		return;
+
+	wq = alloc_ordered_workqueue("MorseEventWorkQ", 0);
+	if (!wq) {
+		MORSE_ERR(mors, "%s: failed to allocate event workqueue, handling events inline\n",
+			  __func__);
+		return;
+	}
+
+	INIT_WORK(&mors->event.work, morse_mac_event_work);
+	spin_lock_bh(&mors->event.q.lock);
+	mors->event.wq = wq;
+	spin_unlock_bh(&mors->event.q.lock);
+}
+
+void morse_mac_event_stop(struct morse *mors)
+{
+	struct workqueue_struct *wq;
+	struct sk_buff *skb;
+
+	spin_lock_bh(&mors->event.q.lock);
+	wq = mors->event.wq;
+	mors->event.wq = NULL;
+	spin_unlock_bh(&mors->event.q.lock);
+
+	if (!wq)
+		return;
+
+	cancel_work_sync(&mors->event.work);
+	destroy_workqueue(wq);
+
+	while ((skb = skb_dequeue(&mors->event.q)))
+		morse_skb_cache_free(mors, skb);
+}
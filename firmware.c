@@ -12,6 +12,7 @@
 #include <net/mac80211.h>
 #include <linux/elf.h>
 #include <linux/crc32.h>
+#include <linux/sizes.h>
 
 #include "morse.h"
 #include "bus.h"
@@ -48,10 +49,20 @@ int sdio_reset_time = CONFIG_MORSE_SDIO_RESET_TIME;
 module_param(sdio_reset_time, int, 0644);
 MODULE_PARM_DESC(sdio_reset_time, "Time to wait (in msec) after SDIO reset");
 
+static bool fw_cache __read_mostly = true;
+module_param(fw_cache, bool, 0644);
+MODULE_PARM_DESC(fw_cache,
+		 "Keep the firmware and BCF in memory so chip restarts skip the filesystem");
+
 static char fw_bin_file[MAX_FW_BIN_FILE_NAME_LEN];
 module_param_string(fw_bin_file, fw_bin_file, sizeof(fw_bin_file), 0644);
 MODULE_PARM_DESC(fw_bin_file, "Firmware binary filename to load");
 
+/* Firmware segments are copied into a bounce buffer of this size and written a chunk at a time */
+static uint fw_load_chunk_size __read_mostly = SZ_64K;
+module_param(fw_load_chunk_size, uint, 0644);
+MODULE_PARM_DESC(fw_load_chunk_size, "Largest single bus write (bytes) when loading firmware");
+
 static int get_file_header(const u8 *data, morse_elf_ehdr *ehdr)
 {
 	morse_elf_ehdr *p = (morse_elf_ehdr *)data;
@@ -128,20 +139,73 @@ static int get_section_header(const u8 *data, morse_elf_ehdr *ehdr, morse_elf_sh
 	return 0;
 }
 
+/**
+ * @brief Find where a program header of the buffered ELF is loaded
+ *
+ * @param fw The firmware image
+ * @param ehdr Header of the ELF File
+ * @param i Index of the program header
+ * @param address Set to the load address
+ * @param offset Set to the offset of the segment in the image
+ * @param size Set to the size of the segment in the image
+ * @return true if the segment must be written to the chip
+ */
+static bool morse_firmware_get_load_segment(const struct firmware *fw, morse_elf_ehdr *ehdr,
+					    int i, u32 *address, u32 *offset, u32 *size)
+{
+	morse_elf_phdr *p = (morse_elf_phdr *)(fw->data + ehdr->e_phoff + i * ehdr->e_phentsize);
+
+	*address = le32_to_cpu(p->p_paddr);
+	*offset = le32_to_cpu(p->p_offset);
+	*size = le32_to_cpu(p->p_filesz);
+
+	/* In current design, the iflash/dflash are only used in self-hosted mode. For
+	 * hosted mode, if the sections are found in the combined image, driver
+	 * needs to skip them.
+	 */
+	if (*address == IFLASH_BASE_ADDR || *address == DFLASH_BASE_ADDR)
+		return false;
+
+	if (le32_to_cpu(p->p_type) != PT_LOAD || !le32_to_cpu(p->p_memsz))
+		return false;
+
+	return *size && *offset && (*offset + *size) < fw->size;
+}
+
+/* Write one segment through the bounce buffer, padding its end to a word with 0xff */
+static int morse_firmware_load_segment(struct morse *mors, u32 address, const u8 *data,
+				       u32 size, u8 *buf, u32 buf_size)
+{
+	u32 done;
+
+	for (done = 0; done < size; done += buf_size) {
+		u32 len = min(size - done, buf_size);
+		u32 padded_len = ROUND_BYTES_TO_WORD(len);
+		int ret;
+
+		memcpy(buf, data + done, len);
+		memset(buf + len, 0xff, padded_len - len);
+
+		ret = morse_dm_write(mors, address + done, buf, padded_len);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
 static int morse_firmware_load(struct morse *mors, const struct firmware *fw)
 {
 	int i;
 	int ret = 0;
 	morse_elf_ehdr ehdr;
-	morse_elf_phdr phdr;
 	morse_elf_shdr shdr;
 	morse_elf_shdr sh_strtab;
 	const char *sh_strs;
-
-	u8 *fw_buf = devm_kmalloc(mors->dev, ROUND_BYTES_TO_WORD(fw->size), GFP_KERNEL);
-
-	if (!fw_buf)
-		return -ENOMEM;
+	u32 address, offset, size;
+	u32 largest = 0;
+	u32 buf_size;
+	u8 *fw_buf;
 
 	if (get_file_header(fw->data, &ehdr) != 0) {
 		MORSE_ERR(mors, "Wrong file format\n");
@@ -155,46 +219,33 @@ static int morse_firmware_load(struct morse *mors, const struct firmware *fw)
 
 	sh_strs = (const char *)fw->data + sh_strtab.sh_offset;
 
-	for (i = 0; i < ehdr.e_phnum; i++) {
-		int status;
-		int address;
-
-		morse_elf_phdr *p =
-			(morse_elf_phdr *)(fw->data + ehdr.e_phoff + i * ehdr.e_phentsize);
+	/* Size the bounce buffer to the largest segment, up to the chunk size */
+	for (i = 0; i < ehdr.e_phnum; i++)
+		if (morse_firmware_get_load_segment(fw, &ehdr, i, &address, &offset, &size))
+			largest = max(largest, size);
 
-		phdr.p_type = le32_to_cpu(p->p_type);
-		phdr.p_offset = le32_to_cpu(p->p_offset);
-		phdr.p_paddr = le32_to_cpu(p->p_paddr);
-		phdr.p_filesz = le32_to_cpu(p->p_filesz);
-		phdr.p_memsz = le32_to_cpu(p->p_memsz);
+	buf_size = round_down(clamp_t(u32, fw_load_chunk_size, 4, SZ_1M), 4);
+	buf_size = min(buf_size, ROUND_BYTES_TO_WORD(largest));
 
-		/* In current design, the iflash/dflash are only used in self-hosted mode. For
-		 * hosted mode, if the sections are found in the combined image, driver
-		 * needs to skip them.
-		 */
-		address = phdr.p_paddr;
-		if (address == IFLASH_BASE_ADDR || address == DFLASH_BASE_ADDR)
-			continue;
+	fw_buf = kmalloc(max_t(u32, buf_size, 4), GFP_KERNEL);
+	if (!fw_buf)
+		return -ENOMEM;
 
-		if (phdr.p_type != PT_LOAD || !phdr.p_memsz)
+	/* Hold the bus for the whole download rather than claiming it per segment */
+	morse_claim_bus(mors);
+	for (i = 0; i < ehdr.e_phnum; i++) {
+		if (!morse_firmware_get_load_segment(fw, &ehdr, i, &address, &offset, &size))
 			continue;
 
-		if (phdr.p_filesz && phdr.p_offset &&
-					(phdr.p_offset + phdr.p_filesz) < fw->size) {
-			u32 padded_size = ROUND_BYTES_TO_WORD(phdr.p_filesz);
-
-			memcpy(fw_buf, fw->data + phdr.p_offset, padded_size);
-			/* Set padding to 0xff */
-			memset(fw_buf + phdr.p_filesz, 0xff, padded_size - phdr.p_filesz);
-			morse_claim_bus(mors);
-			status = morse_dm_write(mors, address, fw_buf, padded_size);
-			morse_release_bus(mors);
-			if (status) {
-				ret = -1;
-				break;
-			}
+		if (morse_firmware_load_segment(mors, address, fw->data + offset, size,
+						fw_buf, buf_size)) {
+			ret = -1;
+			break;
 		}
 	}
+	morse_release_bus(mors);
+
+	kfree(fw_buf);
 
 	for (i = 0; i < ehdr.e_shnum; i++) {
 		if (get_section_header(fw->data, &ehdr, &shdr, i) != 0)
@@ -218,7 +269,6 @@ static int morse_firmware_load(struct morse *mors, const struct firmware *fw)
 			ret = -1;
 	}
 
-	devm_kfree(mors->dev, fw_buf);
 	return ret;
 }
 
@@ -337,7 +387,13 @@ static int morse_bcf_load(struct morse *mors, const struct firmware *bcf,
 
 static int morse_firmware_reset(struct morse *mors)
 {
-	return mors->cfg->digital_reset(mors);
+	int ret;
+
+	morse_boot_phase_begin(mors, MORSE_BOOT_PHASE_CHIP_RESET);
+	ret = mors->cfg->digital_reset(mors);
+	morse_boot_phase_end(mors, MORSE_BOOT_PHASE_CHIP_RESET, ret);
+
+	return ret;
 }
 
 static void morse_firmware_clear_aon(struct morse *mors)
@@ -825,6 +881,7 @@ static int morse_firmware_init_preloaded(struct morse *mors,
 {
 	int ret = 0;
 	int retries = 3;
+	bool booting;
 	struct fw_init_params init_params;
 
 	ret = morse_firmware_get_init_params(test_mode, &init_params);
@@ -845,16 +902,31 @@ static int morse_firmware_init_preloaded(struct morse *mors,
 
 		if (init_params.download_fw) {
 			ret = ret ? ret : morse_firmware_invalidate_host_ptr(mors);
-			ret = ret ? ret : morse_firmware_load(mors, fw);
-			ret = ret ? ret : morse_bcf_load(mors, bcf, mors->bcf_address);
-			ret = ret ? ret : morse_firmware_trigger(mors);
+			if (!ret) {
+				morse_boot_phase_begin(mors, MORSE_BOOT_PHASE_FW_DOWNLOAD);
+				ret = morse_firmware_load(mors, fw);
+				morse_boot_phase_end(mors, MORSE_BOOT_PHASE_FW_DOWNLOAD, ret);
+			}
+			if (!ret) {
+				morse_boot_phase_begin(mors, MORSE_BOOT_PHASE_BCF_LOAD);
+				ret = morse_bcf_load(mors, bcf, mors->bcf_address);
+				morse_boot_phase_end(mors, MORSE_BOOT_PHASE_BCF_LOAD, ret);
+			}
 		}
+
+		booting = !ret;
+		if (booting)
+			morse_boot_phase_begin(mors, MORSE_BOOT_PHASE_FW_BOOT);
+		if (init_params.download_fw)
+			ret = ret ? ret : morse_firmware_trigger(mors);
 		if (init_params.get_host_table_ptr)
 			ret = ret ? ret : morse_firmware_get_host_table_ptr(mors);
 		if (init_params.verify_fw) {
 			ret = ret ? ret : morse_firmware_magic_verify(mors);
 			ret = ret ? ret : morse_firmware_check_compatibility(mors);
 		}
+		if (booting)
+			morse_boot_phase_end(mors, MORSE_BOOT_PHASE_FW_BOOT, ret);
 		if (!ret)
 			break;
 
@@ -873,6 +945,315 @@ static uint32_t binary_crc(const struct firmware *fw)
 	return ~crc32_le(~0, (unsigned char const *)fw->data, fw->size) & 0xffffffff;
 }
 
+/**
+ * struct morse_fw_shared - A firmware or BCF image shared by every chip that uses it
+ *
+ * Chips that probe together (see the bus drivers' async probe) look their images up here, so
+ * each file is only kept in memory once.
+ *
+ * @list: Entry in morse_fw_shared_images
+ * @users: Number of chip caches holding the image
+ * @stale: A chip failed to boot this image, so it is no longer handed out
+ * @name: Name the image was requested with
+ * @fw: The image
+ */
+struct morse_fw_shared {
+	struct list_head list;
+	unsigned int users;
+	bool stale;
+	char *name;
+	const struct firmware *fw;
+};
+
+static LIST_HEAD(morse_fw_shared_images);
+/* Protects morse_fw_shared_images, nests inside fw_cache.lock */
+static DEFINE_MUTEX(morse_fw_shared_lock);
+
+/* Find by image if @fw is given, else by name. Call with morse_fw_shared_lock held. */
+static struct morse_fw_shared *morse_firmware_shared_find(const struct firmware *fw,
+							  const char *name)
+{
+	struct morse_fw_shared *shared;
+
+	list_for_each_entry(shared, &morse_fw_shared_images, list) {
+		if (fw ? shared->fw == fw : !shared->stale && strcmp(shared->name, name) == 0)
+			return shared;
+	}
+
+	return NULL;
+}
+
+static void morse_firmware_shared_free(struct morse_fw_shared *shared)
+{
+	release_firmware(shared->fw);
+	kfree(shared->name);
+	kfree(shared);
+}
+
+/*
+ * Take a reference to the image called @name, reading it if no chip holds it yet. The image is
+ * read without morse_fw_shared_lock held, so if another chip adds the same image meanwhile,
+ * its copy is used and this one released.
+ */
+static struct morse_fw_shared *morse_firmware_shared_get(struct morse *mors, const char *name,
+							 bool *hit)
+{
+	int ret;
+	struct morse_fw_shared *shared;
+	struct morse_fw_shared *found;
+
+	mutex_lock(&morse_fw_shared_lock);
+	found = morse_firmware_shared_find(NULL, name);
+	if (found)
+		found->users++;
+	mutex_unlock(&morse_fw_shared_lock);
+
+	*hit = !!found;
+	if (found)
+		return found;
+
+	shared = kzalloc(sizeof(*shared), GFP_KERNEL);
+	if (!shared)
+		return ERR_PTR(-ENOMEM);
+
+	shared->name = kstrdup(name, GFP_KERNEL);
+	if (!shared->name) {
+		kfree(shared);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	ret = request_firmware(&shared->fw, name, mors->dev);
+	if (ret) {
+		kfree(shared->name);
+		kfree(shared);
+		return ERR_PTR(ret);
+	}
+
+	mutex_lock(&morse_fw_shared_lock);
+	found = morse_firmware_shared_find(NULL, name);
+	if (found) {
+		found->users++;
+	} else {
+		shared->users = 1;
+		list_add_tail(&shared->list, &morse_fw_shared_images);
+	}
+	mutex_unlock(&morse_fw_shared_lock);
+
+	if (found) {
+		morse_firmware_shared_free(shared);
+		shared = found;
+	}
+
+	return shared;
+}
+
+static void morse_firmware_shared_put(const struct firmware *fw)
+{
+	struct morse_fw_shared *shared;
+
+	lockdep_assert_held(&morse_fw_shared_lock);
+
+	if (!fw)
+		return;
+
+	shared = morse_firmware_shared_find(fw, NULL);
+	if (WARN_ON(!shared))
+		return;
+
+	if (--shared->users)
+		return;
+
+	list_del(&shared->list);
+	morse_firmware_shared_free(shared);
+}
+
+/* Stop handing out @fw, chips already holding it keep their reference */
+static void morse_firmware_shared_invalidate(const struct firmware *fw)
+{
+	struct morse_fw_shared *shared;
+
+	mutex_lock(&morse_fw_shared_lock);
+	shared = morse_firmware_shared_find(fw, NULL);
+	if (shared)
+		shared->stale = true;
+	mutex_unlock(&morse_fw_shared_lock);
+}
+
+/* Call with morse_fw_shared_lock held */
+static void morse_firmware_cache_drop_one(const struct firmware **cached,
+					  const char **cached_name)
+{
+	morse_firmware_shared_put(*cached);
+	*cached = NULL;
+	*cached_name = NULL;
+}
+
+/*
+ * Drop both images. Call with fw_cache.lock and morse_fw_shared_lock held. Returns the number
+ * of pages this chip released, which are only freed once no other chip holds them.
+ */
+static unsigned long morse_firmware_cache_drop(struct morse *mors)
+{
+	struct morse_fw_cache *cache = &mors->fw_cache;
+	unsigned long pages = 0;
+
+	if (cache->fw)
+		pages += DIV_ROUND_UP(cache->fw->size, PAGE_SIZE);
+	if (cache->bcf)
+		pages += DIV_ROUND_UP(cache->bcf->size, PAGE_SIZE);
+
+	morse_firmware_cache_drop_one(&cache->fw, &cache->fw_name);
+	morse_firmware_cache_drop_one(&cache->bcf, &cache->bcf_name);
+
+	return pages;
+}
+
+/*
+ * Get the image called @name, from the cache if it is there. Otherwise request it and, if
+ * caching is enabled, keep it, sharing it with any other chip using the same file. Call with
+ * fw_cache.lock held.
+ */
+static int morse_firmware_cache_request(struct morse *mors, const struct firmware **cached,
+					const char **cached_name, const char *name,
+					const struct firmware **out, bool *hit)
+{
+	struct morse_fw_shared *shared;
+
+	*hit = *cached && strcmp(*cached_name, name) == 0;
+	if (*hit) {
+		*out = *cached;
+		return 0;
+	}
+
+	mutex_lock(&morse_fw_shared_lock);
+	morse_firmware_cache_drop_one(cached, cached_name);
+	mutex_unlock(&morse_fw_shared_lock);
+
+	if (!fw_cache)
+		return request_firmware(out, name, mors->dev);
+
+	shared = morse_firmware_shared_get(mors, name, hit);
+	if (IS_ERR(shared))
+		return PTR_ERR(shared);
+
+	*out = shared->fw;
+	*cached = shared->fw;
+	*cached_name = shared->name;
+
+	return 0;
+}
+
+static struct morse *morse_firmware_cache_shrinker_to_mors(struct shrinker *shrinker)
+{
+#if KERNEL_VERSION(6, 7, 0) <= LINUX_VERSION_CODE
+	return shrinker->private_data;
+#else
+	return container_of(shrinker, struct morse, fw_cache.shrinker);
+#endif
+}
+
+static unsigned long morse_firmware_cache_count(struct shrinker *shrinker,
+						struct shrink_control *sc)
+{
+	struct morse *mors = morse_firmware_cache_shrinker_to_mors(shrinker);
+	unsigned long pages;
+
+	/* The images are in use by a load, nothing can be freed now */
+	if (!mutex_trylock(&mors->fw_cache.lock))
+		return 0;
+
+	pages = (mors->fw_cache.fw ? DIV_ROUND_UP(mors->fw_cache.fw->size, PAGE_SIZE) : 0) +
+		(mors->fw_cache.bcf ? DIV_ROUND_UP(mors->fw_cache.bcf->size, PAGE_SIZE) : 0);
+	mutex_unlock(&mors->fw_cache.lock);
+
+	return pages;
+}
+
+static unsigned long morse_firmware_cache_scan(struct shrinker *shrinker,
+					       struct shrink_control *sc)
+{
+	struct morse *mors = morse_firmware_cache_shrinker_to_mors(shrinker);
+	unsigned long freed;
+
+	/* The images are in use by a load, try again later */
+	if (!mutex_trylock(&mors->fw_cache.lock))
+		return SHRINK_STOP;
+
+	/* Another chip may hold it while reclaiming */
+	if (!mutex_trylock(&morse_fw_shared_lock)) {
+		mutex_unlock(&mors->fw_cache.lock);
+		return SHRINK_STOP;
+	}
+
+	/* Images still held by another chip are only released with their last user */
+	freed = morse_firmware_cache_drop(mors);
+	mutex_unlock(&morse_fw_shared_lock);
+	mutex_unlock(&mors->fw_cache.lock);
+
+	if (freed)
+		MORSE_INFO(mors, "Dropped cached firmware under memory pressure\n");
+
+	return freed;
+}
+
+void morse_firmware_cache_init(struct morse *mors)
+{
+	struct morse_fw_cache *cache = &mors->fw_cache;
+	struct shrinker *shrinker;
+	int ret = 0;
+
+	mutex_init(&cache->lock);
+
+#if KERNEL_VERSION(6, 7, 0) <= LINUX_VERSION_CODE
+	shrinker = shrinker_alloc(0, "morse-fw-cache");
+	if (!shrinker) {
+		MORSE_WARN(mors, "%s: no shrinker, the firmware cache is kept under pressure\n",
+			   __func__);
+		return;
+	}
+	shrinker->private_data = mors;
+	cache->shrinker = shrinker;
+#else
+	shrinker = &cache->shrinker;
+#endif
+	shrinker->count_objects = morse_firmware_cache_count;
+	shrinker->scan_objects = morse_firmware_cache_scan;
+	shrinker->seeks = DEFAULT_SEEKS;
+
+#if KERNEL_VERSION(6, 7, 0) <= LINUX_VERSION_CODE
+	shrinker_register(shrinker);
+#elif KERNEL_VERSION(6, 0, 0) <= LINUX_VERSION_CODE
+	ret = register_shrinker(shrinker, "morse-fw-cache");
+#else
+	ret = register_shrinker(shrinker);
+#endif
+	if (ret)
+		MORSE_WARN(mors, "%s: no shrinker, the firmware cache is kept under pressure\n",
+			   __func__);
+	else
+		cache->shrinker_registered = true;
+}
+
+void morse_firmware_cache_finish(struct morse *mors)
+{
+	struct morse_fw_cache *cache = &mors->fw_cache;
+
+	if (cache->shrinker_registered) {
+#if KERNEL_VERSION(6, 7, 0) <= LINUX_VERSION_CODE
+		shrinker_free(cache->shrinker);
+#else
+		unregister_shrinker(&cache->shrinker);
+#endif
+		cache->shrinker_registered = false;
+	}
+
+	mutex_lock(&cache->lock);
+	mutex_lock(&morse_fw_shared_lock);
+	morse_firmware_cache_drop(mors);
+	mutex_unlock(&morse_fw_shared_lock);
+	mutex_unlock(&cache->lock);
+}
+
 int morse_firmware_init(struct morse *mors, enum morse_config_test_mode test_mode)
 {
 	int n;
@@ -886,6 +1267,7 @@ int morse_firmware_init(struct morse *mors, enum morse_config_test_mode test_mod
 	int board_id = 0;
 	char *p;
 	bool use_full_path = true;
+	bool hit;
 
 #ifdef CONFIG_ANDROID
 	/* Use filenames only - Android sets the path */
@@ -947,24 +1329,46 @@ int morse_firmware_init(struct morse *mors, enum morse_config_test_mode test_mod
 			bcf_name = p + 1;
 	}
 
-	ret = request_firmware(&fw, fw_name, mors->dev);
+	/* The bus is up by the time the firmware is first looked up */
+	if (!mors->debug.boot.restart)
+		morse_boot_phase_end(mors, MORSE_BOOT_PHASE_BUS_PROBE, 0);
+
+	/* Held until the images are loaded, so the shrinker cannot drop them while in use */
+	mutex_lock(&mors->fw_cache.lock);
+	morse_boot_phase_begin(mors, MORSE_BOOT_PHASE_FW_REQUEST);
+	if (!fw_cache) {
+		mutex_lock(&morse_fw_shared_lock);
+		morse_firmware_cache_drop(mors);
+		mutex_unlock(&morse_fw_shared_lock);
+	}
+
+	ret = morse_firmware_cache_request(mors, &mors->fw_cache.fw, &mors->fw_cache.fw_name,
+					   fw_name, &fw, &hit);
 	if (ret != 0) {
 		if (ret == -ENOENT)
 			dev_err(mors->dev, "Firmware %s not found\n", fw_name);
-		goto exit;
+		goto exit_unlock;
 	}
-	dev_info(mors->dev, "Loaded firmware from %s, size %zu, crc32 0x%08x\n",
-		fw_name, fw->size, binary_crc(fw));
+	if (hit)
+		MORSE_INFO(mors, "Using cached firmware %s\n", fw_name);
+	else
+		dev_info(mors->dev, "Loaded firmware from %s, size %zu, crc32 0x%08x\n",
+			 fw_name, fw->size, binary_crc(fw));
 
-	ret = request_firmware(&bcf, bcf_name, mors->dev);
+	ret = morse_firmware_cache_request(mors, &mors->fw_cache.bcf, &mors->fw_cache.bcf_name,
+					   bcf_name, &bcf, &hit);
 	if (ret != 0) {
 		if (ret == -ENOENT)
 			dev_err(mors->dev, "BCF %s not found\n", bcf_name);
-		goto exit;
+		goto exit_unlock;
 	}
-	/* Calculate CRC to match the crc32 line command */
-	dev_info(mors->dev, "Loaded BCF from %s, size %zu, crc32 0x%08x\n",
-		bcf_name, bcf->size, binary_crc(bcf));
+	if (hit)
+		MORSE_INFO(mors, "Using cached BCF %s\n", bcf_name);
+	else
+		/* Calculate CRC to match the crc32 line command */
+		dev_info(mors->dev, "Loaded BCF from %s, size %zu, crc32 0x%08x\n",
+			 bcf_name, bcf->size, binary_crc(bcf));
+	morse_boot_phase_end(mors, MORSE_BOOT_PHASE_FW_REQUEST, 0);
 	/* Clear out extra ACK timeout, its value is unknown */
 	mors->extra_ack_timeout_us = -1;
 
@@ -972,10 +1376,30 @@ int morse_firmware_init(struct morse *mors, enum morse_config_test_mode test_mod
 	morse_coredump_set_fw_binary_str(mors, fw_name);
 
 	ret = morse_firmware_init_preloaded(mors, fw, bcf, test_mode);
+	/* Don't keep reusing images the chip could not boot, read them afresh next time */
+	if (ret) {
+		/* Dropping the cache releases the images it holds */
+		if (fw == mors->fw_cache.fw) {
+			morse_firmware_shared_invalidate(fw);
+			fw = NULL;
+		}
+		if (bcf == mors->fw_cache.bcf) {
+			morse_firmware_shared_invalidate(bcf);
+			bcf = NULL;
+		}
+		mutex_lock(&morse_fw_shared_lock);
+		morse_firmware_cache_drop(mors);
+		mutex_unlock(&morse_fw_shared_lock);
+	}
+exit_unlock:
+	/* Only records a failure, success ended the phase above */
+	morse_boot_phase_end(mors, MORSE_BOOT_PHASE_FW_REQUEST, ret);
+	if (fw != mors->fw_cache.fw)
+		release_firmware(fw);
+	if (bcf != mors->fw_cache.bcf)
+		release_firmware(bcf);
+	mutex_unlock(&mors->fw_cache.lock);
 exit:
-	release_firmware(fw);
-	release_firmware(bcf);
-
 	kfree(fw_path);
 
 	if (ret)
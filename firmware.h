@@ -8,6 +8,9 @@
  *
  */
 #include <linux/firmware.h>
+#include <linux/mutex.h>
+#include <linux/shrinker.h>
+#include <linux/version.h>
 #include "capabilities.h"
 #include "misc.h"
 #include "yaps-hw.h"
@@ -139,6 +142,45 @@ struct extended_host_table {
 	u8 ext_host_table_data_tlvs[];
 } __packed;
 
+/**
+ * struct morse_fw_cache - Firmware and BCF images kept across chip restarts
+ *
+ * @lock: Held while the images are used or replaced
+ * @fw: Cached firmware image, may be NULL. Shared with other chips using the same file.
+ * @fw_name: Name @fw was requested with
+ * @bcf: Cached BCF image, may be NULL. Shared with other chips using the same file.
+ * @bcf_name: Name @bcf was requested with
+ * @shrinker: Drops the images under memory pressure
+ * @shrinker_registered: @shrinker is in use
+ */
+struct morse_fw_cache {
+	struct mutex lock;
+	const struct firmware *fw;
+	const char *fw_name;
+	const struct firmware *bcf;
+	const char *bcf_name;
+#if KERNEL_VERSION(6, 7, 0) <= LINUX_VERSION_CODE
+	struct shrinker *shrinker;
+#else
+	struct shrinker shrinker;
+#endif
+	bool shrinker_registered;
+};
+
+/**
+ * morse_firmware_cache_init() - Set up the firmware image cache
+ *
+ * @mors: The global morse config object
+ */
+void morse_firmware_cache_init(struct morse *mors);
+
+/**
+ * morse_firmware_cache_finish() - Release the cached firmware images
+ *
+ * @mors: The global morse config object
+ */
+void morse_firmware_cache_finish(struct morse *mors);
+
 int morse_firmware_init(struct morse *mors, uint test_mode);
 
 /**
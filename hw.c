@@ -18,6 +18,37 @@ module_param(hw_reload_after_stop, int, 0644);
 MODULE_PARM_DESC(hw_reload_after_stop,
 "Reload HW after a stop notification. Abort if stop events are less than this seconds apart (-1 to disable)");
 
+/* Coalesce chip_if interrupts arriving less than this many microseconds apart (0 to disable) */
+static uint rx_coalesce_usecs __read_mostly;
+module_param(rx_coalesce_usecs, uint, 0644);
+MODULE_PARM_DESC(rx_coalesce_usecs,
+		 "Maximum time (us) to defer chip interface work under load (0 to disable)");
+
+/* Stop coalescing early once this many interrupts have been absorbed (0 for time only) */
+static uint rx_coalesce_frames __read_mostly;
+module_param(rx_coalesce_frames, uint, 0644);
+MODULE_PARM_DESC(rx_coalesce_frames,
+		 "Number of chip interface interrupts to coalesce before waking (0 for time only)");
+
+/* Handle RX, data TX and command/beacon/mgmt chip_if events in separate work items */
+static bool chip_if_split_work __read_mostly;
+module_param(chip_if_split_work, bool, 0444);
+MODULE_PARM_DESC(chip_if_split_work,
+		 "Handle RX, data TX and command chip interface events in separate workers");
+
+static int chip_if_rx_cpu __read_mostly = -1;
+module_param(chip_if_rx_cpu, int, 0444);
+MODULE_PARM_DESC(chip_if_rx_cpu, "CPU to run the chip interface RX worker on (-1 for any)");
+
+static int chip_if_tx_cpu __read_mostly = -1;
+module_param(chip_if_tx_cpu, int, 0444);
+MODULE_PARM_DESC(chip_if_tx_cpu, "CPU to run the chip interface data TX worker on (-1 for any)");
+
+static int chip_if_cmd_cpu __read_mostly = -1;
+module_param(chip_if_cmd_cpu, int, 0444);
+MODULE_PARM_DESC(chip_if_cmd_cpu,
+		 "CPU to run the chip interface command/beacon/mgmt worker on (-1 for any)");
+
 int morse_hw_irq_enable(struct morse *mors, u32 irq, bool enable)
 {
 	u32 irq_en, irq_en_addr = irq < 32 ? MORSE_REG_INT1_EN(mors) : MORSE_REG_INT2_EN(mors);
@@ -62,7 +93,7 @@ void morse_hw_stop_work(struct work_struct *work)
 	set_bit(MORSE_STATE_FLAG_CHIP_UNRESPONSIVE, &mors->state_flags);
 	mors->last_hw_stop = ktime_get_seconds();
 	mutex_unlock(&mors->lock);
-	schedule_work(&mors->driver_restart);
+	queue_work(system_long_wq, &mors->driver_restart);
 }
 
 static void to_host_hw_stop_irq_handle(struct morse *mors)
@@ -76,6 +107,238 @@ static void to_host_hw_stop_irq_handle(struct morse *mors)
 	schedule_work(&mors->hw_stop);
 }
 
+static void morse_hw_chip_if_handle_events(struct morse *mors, unsigned long events)
+{
+	morse_hw_trace_point(MORSE_HWT_CHIP_IF_WORK, true);
+	mors->cfg->ops->chip_if_handle_events(mors, events);
+	morse_hw_trace_point(MORSE_HWT_CHIP_IF_WORK, false);
+}
+
+static void morse_hw_chip_if_work(struct work_struct *work)
+{
+	struct morse *mors = container_of(work, struct morse, chip_if_work);
+
+	morse_hw_chip_if_handle_events(mors, MORSE_CHIP_IF_ALL_EVENTS);
+}
+
+static void morse_hw_chip_if_rx_work(struct work_struct *work)
+{
+	struct morse *mors = container_of(work, struct morse, chip_if_rx_work);
+
+	morse_hw_chip_if_handle_events(mors, MORSE_CHIP_IF_RX_EVENTS);
+}
+
+static void morse_hw_chip_if_tx_work(struct work_struct *work)
+{
+	struct morse *mors = container_of(work, struct morse, chip_if_tx_work);
+
+	morse_hw_chip_if_handle_events(mors, MORSE_CHIP_IF_TX_EVENTS);
+}
+
+static void morse_hw_chip_if_cmd_work(struct work_struct *work)
+{
+	struct morse *mors = container_of(work, struct morse, chip_if_cmd_work);
+
+	morse_hw_chip_if_handle_events(mors, MORSE_CHIP_IF_CMD_EVENTS);
+}
+
+static int morse_hw_chip_if_work_cpu(struct morse *mors, int cpu)
+{
+	if (cpu < 0)
+		return WORK_CPU_UNBOUND;
+
+	if (cpu >= nr_cpu_ids || !cpu_online(cpu)) {
+		MORSE_WARN_ON_ONCE(FEATURE_ID_DEFAULT, 1);
+		return WORK_CPU_UNBOUND;
+	}
+
+	return cpu;
+}
+
+void morse_hw_chip_if_work_init(struct morse *mors)
+{
+	INIT_WORK(&mors->chip_if_work, morse_hw_chip_if_work);
+	mors->chip_if_split_wq = NULL;
+
+	if (!chip_if_split_work)
+		return;
+
+	INIT_WORK(&mors->chip_if_rx_work, morse_hw_chip_if_rx_work);
+	INIT_WORK(&mors->chip_if_tx_work, morse_hw_chip_if_tx_work);
+	INIT_WORK(&mors->chip_if_cmd_work, morse_hw_chip_if_cmd_work);
+
+	mors->chip_if_split_wq = alloc_workqueue("MorseChipIfSplitWorkQ",
+						 WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!mors->chip_if_split_wq)
+		MORSE_ERR(mors, "%s: failed to allocate split workqueue, using chip_if_work\n",
+			  __func__);
+}
+
+void morse_hw_chip_if_work_cancel(struct morse *mors)
+{
+	cancel_work_sync(&mors->chip_if_work);
+
+	if (!mors->chip_if_split_wq)
+		return;
+
+	cancel_work_sync(&mors->chip_if_rx_work);
+	cancel_work_sync(&mors->chip_if_tx_work);
+	cancel_work_sync(&mors->chip_if_cmd_work);
+}
+
+void morse_hw_chip_if_work_finish(struct morse *mors)
+{
+	morse_hw_chip_if_work_cancel(mors);
+
+	if (mors->chip_if_split_wq) {
+		destroy_workqueue(mors->chip_if_split_wq);
+		mors->chip_if_split_wq = NULL;
+	}
+}
+
+void morse_hw_chip_if_queue_work(struct morse *mors)
+{
+	unsigned long events = READ_ONCE(mors->chip_if->event_flags);
+	bool queued = false;
+
+	if (!mors->chip_if_split_wq) {
+		queue_work(mors->chip_wq, &mors->chip_if_work);
+		return;
+	}
+
+	if (events & MORSE_CHIP_IF_CMD_EVENTS) {
+		queue_work_on(morse_hw_chip_if_work_cpu(mors, chip_if_cmd_cpu),
+			      mors->chip_if_split_wq, &mors->chip_if_cmd_work);
+		queued = true;
+	}
+
+	if (events & MORSE_CHIP_IF_TX_EVENTS) {
+		queue_work_on(morse_hw_chip_if_work_cpu(mors, chip_if_tx_cpu),
+			      mors->chip_if_split_wq, &mors->chip_if_tx_work);
+		queued = true;
+	}
+
+	/* The RX worker also picks up kicks with no event set, e.g. the end of an interrupt
+	 * coalescing window.
+	 */
+	if ((events & MORSE_CHIP_IF_RX_EVENTS) || !queued)
+		queue_work_on(morse_hw_chip_if_work_cpu(mors, chip_if_rx_cpu),
+			      mors->chip_if_split_wq, &mors->chip_if_rx_work);
+}
+
+static enum hrtimer_restart morse_hw_irq_coalesce_timer(struct hrtimer *timer)
+{
+	struct morse_irq_coalesce *ic = container_of(timer, struct morse_irq_coalesce, timer);
+	struct morse *mors = ic->mors;
+
+	/* Wake for anything absorbed during the window */
+	if (ic->masked_bits) {
+		ic->unmask_pending = true;
+		morse_hw_chip_if_queue_work(mors);
+	} else if (atomic_read(&ic->irqs)) {
+		morse_hw_chip_if_queue_work(mors);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+void morse_hw_irq_coalesce_init(struct morse *mors)
+{
+	struct morse_irq_coalesce *ic = &mors->chip_if->irq_coalesce;
+
+	ic->mors = mors;
+	hrtimer_init(&ic->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ic->timer.function = morse_hw_irq_coalesce_timer;
+	atomic_set(&ic->irqs, 0);
+	ic->masked_bits = 0;
+	ic->unmask_pending = false;
+}
+
+void morse_hw_irq_coalesce_finish(struct morse *mors)
+{
+	hrtimer_cancel(&mors->chip_if->irq_coalesce.timer);
+}
+
+void morse_hw_irq_queue_chip_if_work(struct morse *mors)
+{
+	struct morse_irq_coalesce *ic = &mors->chip_if->irq_coalesce;
+	const u32 usecs = READ_ONCE(rx_coalesce_usecs);
+	const u32 frames = READ_ONCE(rx_coalesce_frames);
+	ktime_t now = ktime_get();
+	bool busy;
+	int irqs;
+
+	if (!usecs) {
+		morse_hw_chip_if_queue_work(mors);
+		return;
+	}
+
+	/* Inside a coalescing window: absorb the interrupt unless the frame limit is reached */
+	if (hrtimer_active(&ic->timer)) {
+		MORSE_PAGE_STAT_INC(mors, irq_coalesced);
+		/* Always counted, so the end of the window wakes for whatever was absorbed */
+		irqs = atomic_inc_return(&ic->irqs);
+		if (frames && irqs >= frames && hrtimer_try_to_cancel(&ic->timer) == 1)
+			morse_hw_chip_if_queue_work(mors);
+		return;
+	}
+
+	/* Only start coalescing once interrupts arrive faster than the window, so an isolated
+	 * packet is still handled immediately.
+	 */
+	busy = ktime_us_delta(now, ic->last_irq) < usecs;
+	ic->last_irq = now;
+	morse_hw_chip_if_queue_work(mors);
+	if (!busy)
+		return;
+
+	atomic_set(&ic->irqs, 0);
+
+	/* With no frame limit there is nothing to count, so mask the chip_if interrupts for the
+	 * window rather than taking and ignoring them. This runs with the bus claimed by the
+	 * interrupt handler, which also serialises it against morse_hw_irq_coalesce_done().
+	 */
+	if (!frames && !ic->masked_bits) {
+		u32 irq_en;
+
+		/* Without the mask, skip the window so the next interrupt is handled at once */
+		if (morse_reg32_read(mors, MORSE_REG_INT1_EN(mors), &irq_en))
+			return;
+
+		ic->masked_bits = irq_en & MORSE_CHIP_IF_IRQ_MASK_ALL;
+		morse_reg32_write(mors, MORSE_REG_INT1_EN(mors), irq_en & ~ic->masked_bits);
+	}
+
+	hrtimer_start(&ic->timer, ns_to_ktime((u64)usecs * NSEC_PER_USEC), HRTIMER_MODE_REL);
+}
+
+void morse_hw_irq_coalesce_done(struct morse *mors)
+{
+	struct morse_irq_coalesce *ic = &mors->chip_if->irq_coalesce;
+	bool retry = false;
+	u32 irq_en;
+
+	if (!READ_ONCE(ic->unmask_pending))
+		return;
+
+	/* The masking side runs with the bus claimed, so claim it before touching the mask */
+	morse_claim_bus(mors);
+	if (ic->unmask_pending) {
+		if (!morse_reg32_read(mors, MORSE_REG_INT1_EN(mors), &irq_en)) {
+			morse_reg32_write(mors, MORSE_REG_INT1_EN(mors), irq_en | ic->masked_bits);
+			ic->masked_bits = 0;
+			ic->unmask_pending = false;
+		} else {
+			/* No interrupt will wake the work while masked, so try again from it */
+			retry = true;
+		}
+	}
+	morse_release_bus(mors);
+
+	if (retry)
+		morse_hw_chip_if_queue_work(mors);
+}
+
 int morse_hw_irq_handle(struct morse *mors)
 {
 	u32 status1 = 0;
@@ -83,6 +346,7 @@ int morse_hw_irq_handle(struct morse *mors)
 	int i;
 #endif
 
+	morse_hw_trace_point(MORSE_HWT_IRQ, true);
 	morse_reg32_read(mors, MORSE_REG_INT1_STS(mors), &status1);
 
 	if (status1 & MORSE_CHIP_IF_IRQ_MASK_ALL)
@@ -95,6 +359,7 @@ int morse_hw_irq_handle(struct morse *mors)
 		to_host_hw_stop_irq_handle(mors);
 
 	morse_reg32_write(mors, MORSE_REG_INT1_CLR(mors), status1);
+	morse_hw_trace_point(MORSE_HWT_IRQ, false);
 
 #if defined(CONFIG_MORSE_DEBUG_IRQ)
 	mors->debug.hostsync_stats.irq++;
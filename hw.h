@@ -340,6 +340,68 @@ int morse_hw_irq_enable(struct morse *mors, u32 irq, bool enable);
 int morse_hw_irq_handle(struct morse *mors);
 int morse_hw_irq_clear(struct morse *mors);
 
+/**
+ * morse_hw_chip_if_work_init() - Initialise the chip_if work items. chip_if_work always
+ * handles every event; with chip_if_split_work, RX, data TX and command/beacon/mgmt events
+ * are instead handled by separate work items.
+ *
+ * @mors: Morse chip instance
+ */
+void morse_hw_chip_if_work_init(struct morse *mors);
+
+/**
+ * morse_hw_chip_if_work_cancel() - Cancel all chip_if work items and wait for them to finish
+ *
+ * @mors: Morse chip instance
+ */
+void morse_hw_chip_if_work_cancel(struct morse *mors);
+
+/**
+ * morse_hw_chip_if_work_finish() - Cancel and free the chip_if work items
+ *
+ * @mors: Morse chip instance
+ */
+void morse_hw_chip_if_work_finish(struct morse *mors);
+
+/**
+ * morse_hw_chip_if_queue_work() - Queue the chip_if work for any pending event flags
+ *
+ * @mors: Morse chip instance
+ */
+void morse_hw_chip_if_queue_work(struct morse *mors);
+
+/**
+ * morse_hw_irq_coalesce_init() - Initialise interrupt coalescing for the chip interface.
+ * Must be called once mors->chip_if has been allocated.
+ *
+ * @mors: Morse chip instance
+ */
+void morse_hw_irq_coalesce_init(struct morse *mors);
+
+/**
+ * morse_hw_irq_coalesce_finish() - Stop interrupt coalescing for the chip interface
+ *
+ * @mors: Morse chip instance
+ */
+void morse_hw_irq_coalesce_finish(struct morse *mors);
+
+/**
+ * morse_hw_irq_queue_chip_if_work() - Queue chip_if work in response to a chip_if interrupt.
+ * Under load the wakeup is deferred to the end of a coalescing window
+ * (rx_coalesce_usecs/rx_coalesce_frames). Called from the IRQ handler with the bus claimed.
+ *
+ * @mors: Morse chip instance
+ */
+void morse_hw_irq_queue_chip_if_work(struct morse *mors);
+
+/**
+ * morse_hw_irq_coalesce_done() - Re-enable chip_if interrupts masked for a coalescing window.
+ * Must be called at the start of the chip_if work, before any early return.
+ *
+ * @mors: Morse chip instance
+ */
+void morse_hw_irq_coalesce_done(struct morse *mors);
+
 enum sdio_burst_mode {
 	SDIO_WORD_BURST_DISABLE = 0,	/* Intentionally duplicate to make it clear it's disabled */
 	SDIO_WORD_BURST_SIZE_0 = 0,	/* 000: no bursting (single 32bit word) */
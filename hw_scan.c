@@ -25,6 +25,11 @@
 /** A margin to account for event/command processing */
 #define MORSE_HWSCAN_TIMEOUT_OVERHEAD_MS (2000)
 
+static uint hw_scan_recent_bss_age_ms __read_mostly;
+module_param(hw_scan_recent_bss_age_ms, uint, 0644);
+MODULE_PARM_DESC(hw_scan_recent_bss_age_ms,
+		 "Limit station scans to channels of BSSs seen in this time (ms) (0 for all)");
+
 /**
  * Scan TLV header
  */
@@ -351,6 +356,9 @@ static bool channel_is_in_hw_scan_list(const struct morse_hw_scan_params *params
 {
 	int channel;
 
+	if (chan->ch.hw_value <= U8_MAX)
+		return test_bit(chan->ch.hw_value, params->chan_map);
+
 	for (channel = 0; channel < params->num_chans; channel++) {
 		if (params->channels[channel].channel == chan)
 			return true;
@@ -379,11 +387,17 @@ static int insert_channel_into_hw_scan_list(struct morse_hw_scan_params *params,
 	if (params->num_chans >= params->allocated_chans)
 		return -ENOMEM;
 
+	if (params->partial &&
+	    (chan->ch.hw_value > U8_MAX || !test_bit(chan->ch.hw_value, params->recent_chans)))
+		return 0;
+
 	if (channel_is_in_hw_scan_list(params, chan))
 		return 0;
 
 	params->channels[params->num_chans].channel = chan;
 	params->num_chans++;
+	if (chan->ch.hw_value <= U8_MAX)
+		__set_bit(chan->ch.hw_value, params->chan_map);
 	return 0;
 }
 
@@ -508,6 +522,7 @@ static int hw_scan_initalise_channel_and_power_lists(struct morse_hw_scan_params
 		return -ENOMEM;
 	params->allocated_chans = chans_to_allocate;
 
+fill:
 	for (i = 0; i < request->n_channels; i++) {
 		const struct morse_dot11ah_channel *chan = morse_dot11ah_5g_chan_to_s1g(chans[i]);
 
@@ -520,6 +535,12 @@ static int hw_scan_initalise_channel_and_power_lists(struct morse_hw_scan_params
 			insert_channel_into_hw_scan_list(params, chan);
 	}
 
+	/* None of the recently seen channels were requested, fall back to a full sweep */
+	if (params->partial && !params->num_chans) {
+		params->partial = false;
+		goto fill;
+	}
+
 	/* Calculate a rough estimate of number of different channel powers required */
 	for (i = 0; i < params->num_chans; i++) {
 		const struct morse_dot11ah_channel *chan =  params->channels[i].channel;
@@ -572,37 +593,126 @@ static void hw_scan_clean_up_params(struct morse_hw_scan_params *params)
 		dev_kfree_skb_any(params->probe_req);
 	kfree(params->channels);
 	kfree(params->powers_qdbm);
+	kfree(params->req_key);
+	kfree(params->tlvs);
 
 	params->num_chans = 0;
 	params->allocated_chans = 0;
 }
 
-size_t morse_hw_scan_get_command_size(struct morse_hw_scan_params *params)
+/**
+ * Everything in a scan request that the HW scan params, and so the command TLVs, are built from.
+ * Followed by the request's channel pointers and then its common and 5GHz IEs.
+ */
+struct hw_scan_req_key {
+	const struct ieee80211_vif *vif;
+	enum nl80211_iftype type;
+	u8 addr[ETH_ALEN];
+	u8 country[MORSE_COUNTRY_LEN];
+	bool sta_associated;
+	bool use_1mhz_probes;
+	u8 n_ssids;
+	u8 ssid_len;
+	u8 ssid[IEEE80211_MAX_SSID_LEN];
+	u32 duration;
+	u32 n_channels;
+	u32 ies_len;
+	DECLARE_BITMAP(recent_chans, U8_MAX + 1);
+	u8 variable[];
+};
+
+/**
+ * hw_scan_build_req_key - Build the key identifying a scan request for the TLV cache
+ *
+ * @mors: Morse structure
+ * @vif: VIF requesting the scan
+ * @hw_req: Scan request
+ * @recent_chans: Channels a partial scan is limited to, or NULL for a full scan
+ * @key_len: Set to the length of the returned key
+ * Return: the key, to be freed by the caller, or NULL if it could not be allocated
+ */
+static void *hw_scan_build_req_key(struct morse *mors, struct ieee80211_vif *vif,
+				   struct ieee80211_scan_request *hw_req,
+				   const unsigned long *recent_chans, size_t *key_len)
+{
+	struct cfg80211_scan_request *req = &hw_req->req;
+	struct ieee80211_scan_ies *ies = &hw_req->ies;
+	size_t chans_len = req->n_channels * sizeof(req->channels[0]);
+	size_t ies_len = ies->common_ie_len + ies->len[NL80211_BAND_5GHZ];
+	struct hw_scan_req_key *key;
+	u8 *pos;
+
+	*key_len = sizeof(*key) + chans_len + ies_len;
+	/* Zeroed so that padding compares equal */
+	key = kzalloc(*key_len, GFP_KERNEL);
+	if (!key)
+		return NULL;
+
+	key->vif = vif;
+	key->type = vif->type;
+	ether_addr_copy(key->addr, vif->addr);
+	memcpy(key->country, mors->country, sizeof(key->country));
+	key->sta_associated = (vif->type == NL80211_IFTYPE_STATION) &&
+		morse_mac_is_sta_vif_associated(vif);
+	key->use_1mhz_probes = morse_mac_is_1mhz_probe_req_enabled();
+	key->n_ssids = req->n_ssids;
+	if (req->n_ssids) {
+		key->ssid_len = min_t(u8, req->ssids[0].ssid_len, sizeof(key->ssid));
+		memcpy(key->ssid, req->ssids[0].ssid, key->ssid_len);
+	}
+	key->duration = req->duration;
+	key->n_channels = req->n_channels;
+	key->ies_len = ies_len;
+	if (recent_chans)
+		bitmap_copy(key->recent_chans, recent_chans, U8_MAX + 1);
+
+	pos = key->variable;
+	memcpy(pos, req->channels, chans_len);
+	pos += chans_len;
+	memcpy(pos, ies->common_ies, ies->common_ie_len);
+	pos += ies->common_ie_len;
+	memcpy(pos, ies->ies[NL80211_BAND_5GHZ], ies->len[NL80211_BAND_5GHZ]);
+
+	return key;
+}
+
+/**
+ * hw_scan_tlvs_size - Get the size of the TLVs generated from the params
+ *
+ * @params: HW scan params
+ * Return: the size of the TLVs
+ */
+static size_t hw_scan_tlvs_size(struct morse_hw_scan_params *params)
 {
 	struct hw_scan_tlv_channel_list *ch_list;
 	struct hw_scan_tlv_power_list *pwr_list;
 	struct hw_scan_tlv_probe_req *probe_req;
 	struct hw_scan_tlv_dwell_on_home *dwell;
-	struct morse_cmd_hw_scan_req *cmd;
-	size_t cmd_size = sizeof(*cmd);
+	size_t size = 0;
 
-	/* No TLVs if simple abort command */
-	if (!params->start)
-		return cmd_size;
+	if (params->tlvs)
+		return params->tlvs_len;
 
-	cmd_size += struct_size(ch_list, channels, params->num_chans);
-	cmd_size += struct_size(pwr_list, tx_power_qdbm, params->n_powers);
+	size += struct_size(ch_list, channels, params->num_chans);
+	size += struct_size(pwr_list, tx_power_qdbm, params->n_powers);
 
 	if (params->probe_req)
-		cmd_size += struct_size(probe_req, buf, params->probe_req->len);
+		size += struct_size(probe_req, buf, params->probe_req->len);
 
 	if (params->dwell_on_home_ms)
-		cmd_size += sizeof(*dwell);
+		size += sizeof(*dwell);
 
-	return cmd_size;
+	return size;
 }
 
-u8 *morse_hw_scan_insert_tlvs(struct morse_hw_scan_params *params, u8 *buf)
+/**
+ * hw_scan_build_tlvs - Generate the TLVs from the params
+ *
+ * @params: HW scan params
+ * @buf: buffer of at least hw_scan_tlvs_size() bytes
+ * Return: Pointer to end of the TLVs inserted into the buffer
+ */
+static u8 *hw_scan_build_tlvs(struct morse_hw_scan_params *params, u8 *buf)
 {
 	buf = hw_scan_add_channel_list_tlv(buf, params);
 
@@ -617,6 +727,48 @@ u8 *morse_hw_scan_insert_tlvs(struct morse_hw_scan_params *params, u8 *buf)
 	return buf;
 }
 
+/**
+ * hw_scan_serialise_tlvs - Keep a serialised copy of the TLVs with the params, so a repeat of the
+ * same scan request does not need them regenerated. If it cannot be allocated they are
+ * generated for every command instead.
+ *
+ * @params: HW scan params
+ */
+static void hw_scan_serialise_tlvs(struct morse_hw_scan_params *params)
+{
+	size_t len = hw_scan_tlvs_size(params);
+	u8 *tlvs = kmalloc(len, GFP_KERNEL);
+
+	if (!tlvs)
+		return;
+
+	hw_scan_build_tlvs(params, tlvs);
+	params->tlvs = tlvs;
+	params->tlvs_len = len;
+}
+
+size_t morse_hw_scan_get_command_size(struct morse_hw_scan_params *params)
+{
+	struct morse_cmd_hw_scan_req *cmd;
+	size_t cmd_size = sizeof(*cmd);
+
+	/* No TLVs if simple abort command */
+	if (!params->start)
+		return cmd_size;
+
+	return cmd_size + hw_scan_tlvs_size(params);
+}
+
+u8 *morse_hw_scan_insert_tlvs(struct morse_hw_scan_params *params, u8 *buf)
+{
+	if (params->tlvs) {
+		memcpy(buf, params->tlvs, params->tlvs_len);
+		return buf + params->tlvs_len;
+	}
+
+	return hw_scan_build_tlvs(params, buf);
+}
+
 void morse_hw_scan_dump_scan_cmd(struct morse *mors, struct morse_cmd_hw_scan_req *cmd)
 {
 	int i;
@@ -694,6 +846,10 @@ int morse_ops_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 	struct morse *mors = hw->priv;
 	struct cfg80211_scan_request *req = &hw_req->req;
 	struct morse_hw_scan_params *params;
+	DECLARE_BITMAP(recent_chans, U8_MAX + 1);
+	bool partial = false;
+	size_t key_len;
+	void *key;
 	u32 timeout_ms;
 
 	mutex_lock(&mors->lock);
@@ -728,11 +884,27 @@ int morse_ops_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 		}
 
 		mors->hw_scan.params = params;
-	} else {
-		hw_scan_clean_up_params(params);
-		memset(params, 0, sizeof(*params));
 	}
 
+	/* Stations look where BSSs were recently seen first, to spend less time off channel */
+	if (hw_scan_recent_bss_age_ms && vif->type == NL80211_IFTYPE_STATION)
+		partial = morse_dot11ah_get_recent_bss_channels(hw_scan_recent_bss_age_ms,
+					req->n_ssids ? req->ssids[0].ssid : NULL,
+					req->n_ssids ? req->ssids[0].ssid_len : 0,
+					recent_chans) > 0;
+
+	/* Roaming and background scans repeat the same request, so reuse the last command's TLVs */
+	key = hw_scan_build_req_key(mors, vif, hw_req, partial ? recent_chans : NULL, &key_len);
+	if (key && params->req_key && key_len == params->req_key_len &&
+	    !memcmp(key, params->req_key, key_len)) {
+		MORSE_HWSCAN_DBG(mors, "%s: reusing scan params\n", __func__);
+		kfree(key);
+		goto send;
+	}
+
+	hw_scan_clean_up_params(params);
+	memset(params, 0, sizeof(*params));
+
 	params->hw = hw;
 	params->vif = vif;
 	params->has_directed_ssid = (req->ssids && req->ssids[0].ssid_len > 0);
@@ -751,16 +923,33 @@ int morse_ops_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 	params->dwell_on_home_ms = ((vif->type == NL80211_IFTYPE_STATION) &&
 		morse_mac_is_sta_vif_associated(vif)) ?	MORSE_HWSCAN_DEFAULT_DWELL_ON_HOME_MS : 0;
 	params->use_1mhz_probes = morse_mac_is_1mhz_probe_req_enabled();
-
-	hw_scan_initalise_channel_and_power_lists(params, &hw_req->req);
+	params->partial = partial;
+	if (partial)
+		bitmap_copy(params->recent_chans, recent_chans, U8_MAX + 1);
+
+	if (hw_scan_initalise_channel_and_power_lists(params, &hw_req->req)) {
+		/* Send what could be built, but don't reuse it */
+		kfree(key);
+		key = NULL;
+	}
 
 	/* Only initialise the probe request template if this is an active scan */
 	if (req->n_ssids > 0) {
 		ret = hw_scan_initialise_probe_req(params, hw_req);
-		if (ret)
+		if (ret) {
 			MORSE_HWSCAN_ERR(mors, "Failed to init probe req %d\n", ret);
+			kfree(key);
+			key = NULL;
+		}
 	}
 
+	if (key) {
+		params->req_key = key;
+		params->req_key_len = key_len;
+		hw_scan_serialise_tlvs(params);
+	}
+
+send:
 	ret = morse_cmd_hw_scan(mors, params, false);
 
 	if (ret) {
@@ -898,6 +1087,12 @@ void morse_hw_scan_finish(struct morse *mors)
 	};
 	lockdep_assert_held(&mors->lock);
 
+	/* The chip is being restarted, so rebuild the next scan from scratch */
+	if (mors->hw_scan.params) {
+		kfree(mors->hw_scan.params->req_key);
+		mors->hw_scan.params->req_key = NULL;
+	}
+
 	if (mors->hw_scan.state == HW_SCAN_STATE_IDLE)
 		return;
 
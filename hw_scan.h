@@ -49,6 +49,14 @@ struct morse_hw_scan_params {
 	/** Max allocated channels in @ref channels */
 	u16 allocated_chans;
 
+	/** S1G channel numbers in @ref channels, for de-duplication */
+	DECLARE_BITMAP(chan_map, U8_MAX + 1);
+
+	/** Only scan the channels of recently seen BSSs, given in @ref recent_chans */
+	bool partial;
+	/** S1G channel numbers to limit a partial scan to */
+	DECLARE_BITMAP(recent_chans, U8_MAX + 1);
+
 	/** List of channels */
 	struct {
 		/** The 802.11ah channel */
@@ -63,6 +71,16 @@ struct morse_hw_scan_params {
 	u8 n_powers;
 	/** Force probe requests to send at 1MHz despite primary channel config */
 	bool use_1mhz_probes;
+
+	/** Key of the scan request the params were built from, NULL if they must be rebuilt */
+	void *req_key;
+	/** Length of @ref req_key */
+	size_t req_key_len;
+
+	/** TLVs serialised from the params, reused for as long as the scan request matches */
+	u8 *tlvs;
+	/** Length of @ref tlvs */
+	size_t tlvs_len;
 };
 
 /**
@@ -9,17 +9,26 @@
 #include "hw_trace.h"
 #include "debug.h"
 
-struct hw_trace morse_traces[] = {
-	{ 2, 0 },		/* GPIO 2 */
-	{ 16, 0 },		/* GPIO 16 */
-	{ 21, 0 },		/* GPIO 21 */
-	{ 6, 0 },		/* GPIO 6 */
-};
+/** Most GPIOs which can be given to hw_trace_gpios */
+#define MORSE_HW_TRACE_MAX_GPIOS	(8)
+
+static int hw_trace_gpios[MORSE_HW_TRACE_MAX_GPIOS] = { 2, 16, 21, 6 };
+static int hw_trace_n_gpios = 4;
+module_param_array(hw_trace_gpios, int, &hw_trace_n_gpios, 0444);
+MODULE_PARM_DESC(hw_trace_gpios,
+		 "GPIOs available to hw trace points, mapped to the points in order at load");
+
+static struct hw_trace morse_traces[MORSE_HW_TRACE_MAX_GPIOS];
 
-struct hw_trace *hwt_tx_in;
-struct hw_trace *hwt_tx_out;
-struct hw_trace *hwt_pages;
-struct hw_trace *hwt_page_return;
+struct hw_trace *morse_hw_trace_points[MORSE_HWT_NUM];
+
+static const char * const morse_hw_trace_point_names[MORSE_HWT_NUM] = {
+	[MORSE_HWT_IRQ] = "irq",
+	[MORSE_HWT_CHIP_IF_WORK] = "chip_if_work",
+	[MORSE_HWT_BUS_XFER] = "bus_xfer",
+	[MORSE_HWT_TX_STATUS] = "tx_status",
+	[MORSE_HWT_PS_AWAKE] = "ps_awake",
+};
 
 void morse_hw_trace_set(struct hw_trace *hwt)
 {
@@ -41,7 +50,7 @@ struct hw_trace *morse_hw_trace_register(void)
 {
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(morse_traces); i++) {
+	for (i = 0; i < hw_trace_n_gpios; i++) {
 		struct hw_trace *hwt = &morse_traces[i];
 
 		if (!hwt->used) {
@@ -70,39 +79,91 @@ void morse_hw_trace_unregister(struct hw_trace *hwt)
 	gpio_free(hwt->pin);
 }
 
+int morse_hw_trace_map(const char *name, int pin)
+{
+	struct hw_trace *hwt = NULL;
+	struct hw_trace *old;
+	int point;
+	int i;
+
+	point = match_string(morse_hw_trace_point_names, MORSE_HWT_NUM, name);
+	if (point < 0)
+		return -EINVAL;
+
+	if (pin >= 0) {
+		for (i = 0; i < hw_trace_n_gpios; i++) {
+			if (morse_traces[i].used && morse_traces[i].pin == pin) {
+				hwt = &morse_traces[i];
+				break;
+			}
+		}
+		if (!hwt)
+			return -EINVAL;
+	}
+
+	/* Leave the old GPIO low, it may have been unmapped part way through a pulse */
+	old = xchg(&morse_hw_trace_points[point], hwt);
+	if (old && old != hwt)
+		gpio_set_value(old->pin, 0);
+
+	return 0;
+}
+
+void morse_hw_trace_show(struct seq_file *file)
+{
+	int i;
+
+	for (i = 0; i < MORSE_HWT_NUM; i++) {
+		struct hw_trace *hwt = READ_ONCE(morse_hw_trace_points[i]);
+
+		if (hwt)
+			seq_printf(file, "%s: gpio %d\n", morse_hw_trace_point_names[i], hwt->pin);
+		else
+			seq_printf(file, "%s: none\n", morse_hw_trace_point_names[i]);
+	}
+
+	seq_puts(file, "gpios:");
+	for (i = 0; i < hw_trace_n_gpios; i++)
+		if (morse_traces[i].used)
+			seq_printf(file, " %d", morse_traces[i].pin);
+	seq_puts(file, "\n");
+}
+
 int morse_hw_trace_init(void)
 {
-	hwt_tx_in = morse_hw_trace_register();
-	if (hwt_tx_in)
-		pr_info("hwt_tx_in set to gpio %d\n", hwt_tx_in->pin);
-	else
-		pr_info("hwt_tx_in was not set\n");
-
-	hwt_pages = morse_hw_trace_register();
-	if (hwt_pages)
-		pr_info("hwt_pages set to gpio %d\n", hwt_pages->pin);
-	else
-		pr_info("hwt_pages was not set\n");
-
-	hwt_tx_out = morse_hw_trace_register();
-	if (hwt_tx_out)
-		pr_info("hwt_tx_out set to gpio %d\n", hwt_tx_out->pin);
-	else
-		pr_info("hwt_tx_out was not set\n");
-
-	hwt_page_return = morse_hw_trace_register();
-	if (hwt_page_return)
-		pr_info("hwt_page_return set to gpio %d\n", hwt_page_return->pin);
-	else
-		pr_info("hwt_page_return was not set\n");
+	struct hw_trace *hwt;
+	int i;
+
+	for (i = 0; i < hw_trace_n_gpios; i++) {
+		morse_traces[i].pin = hw_trace_gpios[i];
+		morse_traces[i].used = 0;
+	}
+
+	for (i = 0; i < MORSE_HWT_NUM; i++) {
+		hwt = morse_hw_trace_register();
+		WRITE_ONCE(morse_hw_trace_points[i], hwt);
+		if (hwt)
+			pr_info("hw trace %s set to gpio %d\n", morse_hw_trace_point_names[i],
+				hwt->pin);
+		else
+			pr_info("hw trace %s was not set\n", morse_hw_trace_point_names[i]);
+	}
+
+	/* The rest of the pool stays requested so points can be remapped onto it */
+	while (morse_hw_trace_register())
+		;
 
 	return 0;
 }
 
 void morse_hw_trace_deinit(void)
 {
-	morse_hw_trace_unregister(hwt_tx_in);
-	morse_hw_trace_unregister(hwt_tx_out);
-	morse_hw_trace_unregister(hwt_pages);
-	morse_hw_trace_unregister(hwt_page_return);
+	int i;
+
+	for (i = 0; i < MORSE_HWT_NUM; i++)
+		WRITE_ONCE(morse_hw_trace_points[i], NULL);
+
+	for (i = 0; i < hw_trace_n_gpios; i++)
+		if (morse_traces[i].used)
+			morse_hw_trace_unregister(&morse_traces[i]);
 }
@@ -8,6 +8,9 @@
  *
  */
 
+#include <linux/gpio.h>
+#include <linux/seq_file.h>
+
 #include "morse.h"
 
 struct hw_trace {
@@ -15,10 +18,66 @@ struct hw_trace {
 	bool used;
 };
 
-extern struct hw_trace *hwt_tx_in;
-extern struct hw_trace *hwt_tx_out;
-extern struct hw_trace *hwt_pages;
-extern struct hw_trace *hwt_page_return;
+/**
+ * enum morse_hw_trace_point - Points in the driver which can drive a trace GPIO
+ *
+ * Each point raises its GPIO at the start of the traced section and lowers it at the end, so the
+ * pulse width on a logic analyser is the time spent in the section.
+ *
+ * @MORSE_HWT_IRQ: Handling of a chip interrupt in morse_hw_irq_handle()
+ * @MORSE_HWT_CHIP_IF_WORK: A run of the chip interface work
+ * @MORSE_HWT_BUS_XFER: A direct memory read or write on the bus
+ * @MORSE_HWT_TX_STATUS: Processing of a batch of TX status reports
+ * @MORSE_HWT_PS_AWAKE: High while power save holds the chip awake
+ * @MORSE_HWT_NUM: Number of trace points
+ */
+enum morse_hw_trace_point {
+	MORSE_HWT_IRQ,
+	MORSE_HWT_CHIP_IF_WORK,
+	MORSE_HWT_BUS_XFER,
+	MORSE_HWT_TX_STATUS,
+	MORSE_HWT_PS_AWAKE,
+	MORSE_HWT_NUM,
+};
+
+#ifdef CONFIG_MORSE_HW_TRACE
+extern struct hw_trace *morse_hw_trace_points[MORSE_HWT_NUM];
+
+/**
+ * morse_hw_trace_point() - Drive the GPIO mapped to a trace point, if any
+ * @point: Trace point
+ * @high: Level to drive
+ *
+ * Mapped GPIOs stay requested until morse_hw_trace_deinit(), so remapping while a point is being
+ * driven is safe.
+ */
+static inline void morse_hw_trace_point(enum morse_hw_trace_point point, bool high)
+{
+	struct hw_trace *hwt = READ_ONCE(morse_hw_trace_points[point]);
+
+	if (hwt)
+		gpio_set_value(hwt->pin, high);
+}
+
+/**
+ * morse_hw_trace_map() - Map a trace point to one of the trace GPIOs
+ * @name: Trace point name, as listed by morse_hw_trace_show()
+ * @pin: GPIO from the hw_trace_gpios pool, or negative to unmap the point
+ *
+ * Return: 0 on success, -EINVAL if the point or GPIO is unknown
+ */
+int morse_hw_trace_map(const char *name, int pin);
+
+/**
+ * morse_hw_trace_show() - Print the trace points and the GPIOs they drive
+ * @file: seq_file to print to
+ */
+void morse_hw_trace_show(struct seq_file *file);
+#else
+static inline void morse_hw_trace_point(enum morse_hw_trace_point point, bool high)
+{
+}
+#endif
 
 struct hw_trace *morse_hw_trace_register(void);
 
@@ -73,6 +73,12 @@ static int __init morse_init(void)
 		pr_err("morse_usb_failed() failed: %d\n", ret);
 #endif
 
+#ifdef CONFIG_MORSE_EMU
+	ret = morse_emu_init();
+	if (ret)
+		pr_err("morse_emu_init() failed: %d\n", ret);
+#endif
+
 	return ret;
 }
 
@@ -88,6 +94,10 @@ static void __exit morse_exit(void)
 #ifdef CONFIG_MORSE_USB
 	morse_usb_exit();
 #endif
+
+#ifdef CONFIG_MORSE_EMU
+	morse_emu_exit();
+#endif
 }
 
 module_init(morse_init);
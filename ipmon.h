@@ -40,7 +40,8 @@ struct ipmon_hdr {
 enum ipmon_loc {
 	IPMON_LOC_CLIENT_DRV1,
 	IPMON_LOC_CLIENT_DRV2,
-	IPMON_LOC_SERVER_DRV
+	IPMON_LOC_SERVER_DRV,
+	IPMON_NUM_LOCS
 };
 
 #define QOS_HDR_SIZE	32	/* sizeof(struct ieee80211_qos_hdr) */
@@ -7,6 +7,7 @@
 
 #include <linux/slab.h>
 #include <linux/jiffies.h>
+#include <linux/delay.h>
 #include <linux/crc32.h>
 #include <net/mac80211.h>
 #include <asm/div64.h>
@@ -33,6 +34,7 @@
 #include "mesh.h"
 #ifdef CONFIG_MORSE_RC
 #include "rc.h"
+#include "pageset.h"
 #else
 #include "minstrel_rc.h"
 #endif
@@ -84,9 +86,9 @@
 
 /* Arbitrary size limit for the filter command address list, to ensure that the command
  * does not exceed page/MTU size. This will be far greater than the number of filters
- * supported by the firmware.
+ * supported by the firmware. The count is carried in a u8, so it is also capped at U8_MAX.
  */
-#define MCAST_FILTER_COUNT_MAX (1024 / sizeof(filter->addr_list[0]))
+#define MCAST_FILTER_COUNT_MAX min_t(u16, 1024 / sizeof(filter->addr_list[0]), U8_MAX)
 
 /* Calculation of average RSSI */
 #define CALC_AVG_RSSI(_avg, _sample) ((((_avg) * 9 + (_sample)) / 10))
@@ -97,13 +99,16 @@
 #define MORSE_ECSA_ERR(_m, _f, _a...)		morse_err(FEATURE_ID_ECSA, _m, _f, ##_a)
 
 /**
- * Interval in milliseconds at which a work queue is scheduled to evaluate the rate
+ * Default interval in milliseconds at which a work queue is scheduled to evaluate the rate
  * to be used for multicast packets transmission
  */
-#define MULTICAST_TX_RATE_EVAL_WORK_PERIOD_MS	60000
+#define MULTICAST_TX_RATE_EVAL_WORK_PERIOD_MS	1000
 
 #define MORSE_HEALTH_CHECK_RETRIES 1
 
+/* Beacon tailroom for the IEs added on S1G conversion and the TX word padding */
+#define MORSE_BEACON_EXTRA_TAILROOM	(128)
+
 enum dot11ah_powersave_mode {
 	POWERSAVE_MODE_DISABLED = 0x00,
 	POWERSAVE_MODE_PROTOCOL_ENABLED = 0x01,
@@ -216,6 +221,30 @@ static int watchdog_interval_secs __read_mostly = 30;
 module_param(watchdog_interval_secs, int, 0644);
 MODULE_PARM_DESC(watchdog_interval_secs, "Set watchdog interval in seconds");
 
+/* Skip the health check command when the chip is already known to be alive */
+static bool enable_health_check_traffic __read_mostly = true;
+module_param(enable_health_check_traffic, bool, 0644);
+MODULE_PARM_DESC(enable_health_check_traffic,
+		 "Treat chip traffic since the last watchdog interval as a passed health check");
+
+/* Replay station and key state to the firmware in batches after a restart */
+static bool enable_bulk_restore __read_mostly = true;
+module_param(enable_bulk_restore, bool, 0644);
+MODULE_PARM_DESC(enable_bulk_restore,
+		 "Batch the station and key commands mac80211 reissues after a firmware restart");
+
+/* Upper bound on how long a flush waits for the chip to send the queued frames */
+static uint flush_timeout_ms __read_mostly = 200;
+module_param(flush_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(flush_timeout_ms,
+		 "Time (ms) a queue flush waits for TX status before dropping what is left");
+
+/* Switch ECSA channels in one command batch, keeping the queued frames across the switch */
+static bool enable_ecsa_fast_switch __read_mostly = true;
+module_param(enable_ecsa_fast_switch, bool, 0644);
+MODULE_PARM_DESC(enable_ecsa_fast_switch,
+		 "Batch the ECSA channel switch commands and keep queued frames across it");
+
 /* Enable/Disable watchdog reset */
 static bool enable_watchdog_reset __read_mostly;
 module_param(enable_watchdog_reset, bool, 0644);
@@ -246,6 +275,118 @@ static bool enable_airtime_fairness __read_mostly;
 module_param(enable_airtime_fairness, bool, 0644);
 MODULE_PARM_DESC(enable_airtime_fairness, "Enable mac80211 pull interface for airtime fairness");
 
+/* Airtime granted to a station each time its TX scheduler deficit runs out */
+static uint airtime_quantum_us __read_mostly = 8000;
+module_param(airtime_quantum_us, uint, 0644);
+MODULE_PARM_DESC(airtime_quantum_us, "Airtime (usecs) added to a station's TX deficit per round");
+
+/* Bound the number of frames pulled from a single TX queue per scheduler visit */
+static uint txq_max_frames_per_visit __read_mostly = 8;
+module_param(txq_max_frames_per_visit, uint, 0644);
+MODULE_PARM_DESC(txq_max_frames_per_visit, "Maximum frames dequeued from a TX queue per visit");
+
+/* Serve the background AC first after this many scheduler rounds that did not reach it */
+static uint txq_bk_max_skipped_rounds __read_mostly = 8;
+module_param(txq_bk_max_skipped_rounds, uint, 0644);
+MODULE_PARM_DESC(txq_bk_max_skipped_rounds,
+		 "Scheduler rounds the background AC may be starved before it is served first");
+
+/* Drop retried RX frames repeating the last sequence number before any host processing */
+static bool enable_rx_dup_filter __read_mostly = true;
+module_param(enable_rx_dup_filter, bool, 0644);
+MODULE_PARM_DESC(enable_rx_dup_filter,
+		 "Drop retried duplicate unicast frames in the driver RX path, ahead of mac80211");
+
+/* Drop hardware decrypted RX frames repeating a recently seen PN before any host processing */
+static bool enable_rx_pn_filter __read_mostly = true;
+module_param(enable_rx_pn_filter, bool, 0644);
+MODULE_PARM_DESC(enable_rx_pn_filter,
+		 "Drop duplicate PN unicast frames in the driver RX path, ahead of mac80211");
+
+/* Run the TX queue scheduler from a high priority workqueue rather than a softirq tasklet */
+static bool enable_txq_work __read_mostly;
+module_param(enable_txq_work, bool, 0444);
+MODULE_PARM_DESC(enable_txq_work,
+		 "Run the airtime fairness TX scheduler in a high priority workqueue");
+
+/* Bound the frames a TX scheduler worker run sends before it requeues itself */
+static uint txq_work_budget __read_mostly = 64;
+module_param(txq_work_budget, uint, 0644);
+MODULE_PARM_DESC(txq_work_budget,
+		 "Frames sent per TX scheduler worker run before yielding (0 for no limit)");
+
+static int txq_work_cpu __read_mostly = -1;
+module_param(txq_work_cpu, int, 0444);
+MODULE_PARM_DESC(txq_work_cpu, "CPU to run the TX scheduler worker on (-1 for any)");
+
+/* Hold downlink for TWT stations on the host until just before their next service period */
+static bool enable_twt_tx_hold __read_mostly;
+module_param(enable_twt_tx_hold, bool, 0644);
+MODULE_PARM_DESC(enable_twt_tx_hold,
+		 "Hold TWT station downlink until its service period (needs airtime fairness)");
+
+/* How long before a TWT service period starts held downlink is released to the chip */
+static uint twt_tx_hold_lead_us __read_mostly = 20000;
+module_param(twt_tx_hold_lead_us, uint, 0644);
+MODULE_PARM_DESC(twt_tx_hold_lead_us,
+		 "Time (usecs) before a TWT service period that held downlink is released");
+
+/* Window the host tracks the TX airtime used against the duty cycle over */
+static uint duty_cycle_window_s __read_mostly = 3600;
+module_param(duty_cycle_window_s, uint, 0644);
+MODULE_PARM_DESC(duty_cycle_window_s,
+		 "Window (seconds) of the host duty cycle airtime budget (0 to disable)");
+
+/* Below this share of the duty cycle budget left, the TX scheduler holds background traffic */
+static uint duty_cycle_reserve_pct __read_mostly = 20;
+module_param(duty_cycle_reserve_pct, uint, 0644);
+MODULE_PARM_DESC(duty_cycle_reserve_pct,
+		 "Budget left (%) below which BK is held, and BE below half of it (needs AFT)");
+
+/* Deliver RX frames to mac80211 through NAPI so the stack can apply GRO */
+static bool enable_rx_napi __read_mostly;
+module_param(enable_rx_napi, bool, 0444);
+MODULE_PARM_DESC(enable_rx_napi, "Deliver RX frames to mac80211 through NAPI (enables GRO)");
+
+/* Send unicast data frames to known stations through the dedicated data TX path */
+static bool enable_tx_data_fast_path __read_mostly = true;
+module_param(enable_tx_data_fast_path, bool, 0644);
+MODULE_PARM_DESC(enable_tx_data_fast_path, "Use the dedicated TX path for unicast data frames");
+
+/* Only start a TX BA session once a TID has sent this many frames within ba_start_window_ms */
+static uint ba_start_frames __read_mostly = 8;
+module_param(ba_start_frames, uint, 0644);
+MODULE_PARM_DESC(ba_start_frames,
+		 "QoS data frames a TID sends in ba_start_window_ms before a BA session starts");
+
+static uint ba_start_window_ms __read_mostly = 500;
+module_param(ba_start_window_ms, uint, 0644);
+MODULE_PARM_DESC(ba_start_window_ms, "Window (msecs) over which ba_start_frames is counted");
+
+/* Passed to mac80211 as the session timeout, so idle sessions free their chip reorder state */
+static uint ba_idle_timeout_ms __read_mostly = 10000;
+module_param(ba_idle_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(ba_idle_timeout_ms, "Tear down TX BA sessions idle this long (0 to keep)");
+
+static uint ba_max_sessions __read_mostly;
+module_param(ba_max_sessions, uint, 0644);
+MODULE_PARM_DESC(ba_max_sessions,
+		 "Maximum TX BA sessions set up or running per interface (0 for no limit)");
+
+/* Let mac80211 build A-MSDUs from small data frames on the TX queues */
+static bool enable_amsdu __read_mostly;
+module_param(enable_amsdu, bool, 0444);
+MODULE_PARM_DESC(enable_amsdu, "Aggregate TX data frames into A-MSDUs (needs airtime fairness)");
+
+/* Bound A-MSDUs by the airtime they take at the station's expected throughput */
+static uint amsdu_max_airtime_us __read_mostly = 8000;
+module_param(amsdu_max_airtime_us, uint, 0644);
+MODULE_PARM_DESC(amsdu_max_airtime_us, "Maximum airtime (usecs) of a TX A-MSDU");
+
+static uint amsdu_max_len __read_mostly = IEEE80211_MAX_MPDU_LEN_HT_3839;
+module_param(amsdu_max_len, uint, 0644);
+MODULE_PARM_DESC(amsdu_max_len, "Maximum length in bytes of a TX A-MSDU");
+
 /* Enable/disable the mac802.11 connection monitor */
 static bool enable_mac80211_connection_monitor __read_mostly;
 module_param(enable_mac80211_connection_monitor, bool, 0644);
@@ -351,6 +492,12 @@ module_param(enable_mcast_rate_control, bool, 0644);
 MODULE_PARM_DESC(enable_mcast_rate_control,
 	"Enable multicast rate control tracking to transmit at highest possible rate, bandwidth and GI");
 
+/* How often the multicast rate is re-evaluated against the weakest member */
+static uint mcast_rate_eval_period_ms __read_mostly = MULTICAST_TX_RATE_EVAL_WORK_PERIOD_MS;
+module_param(mcast_rate_eval_period_ms, uint, 0644);
+MODULE_PARM_DESC(mcast_rate_eval_period_ms,
+	"Interval (ms) at which the multicast rate is re-evaluated when multicast rate control is enabled");
+
 /* Enable/Disable automatic logging of modparams on boot */
 static bool log_modparams_on_boot __read_mostly = true;
 module_param(log_modparams_on_boot, bool, 0644);
@@ -539,41 +686,51 @@ static inline int morse_vif_max_tx_bw(struct morse_vif *mors_vif)
 	return max_bw_mhz;
 }
 
-struct ieee80211_vif *morse_get_vif_from_tx_status(struct morse *mors,
-						   struct morse_skb_tx_status *hdr_tx_status)
-{
-	u8 vif_id = MORSE_TX_CONF_FLAGS_VIF_ID_GET(le32_to_cpu(hdr_tx_status->flags));
-
-	return morse_get_vif_from_vif_id(mors, vif_id);
-}
-
-struct ieee80211_vif *__morse_get_vif_from_vif_id(struct morse *mors, int vif_id)
+/**
+ * morse_vif_update_rx_map() - Recompute the vifs that receive group addressed mgmt frames.
+ *
+ * @mors: Morse chip struct
+ *
+ * Must be called with the vif array lock held whenever the vif array changes.
+ * See morse_mac_find_vif_for_bcast_mcast().
+ */
+static void morse_vif_update_rx_map(struct morse *mors)
 {
-	struct ieee80211_vif *vif = NULL;
-
-	vif_id = array_index_nospec(vif_id, mors->max_vifs);
-
-	if (likely(vif_id < mors->max_vifs && mors->vif))
-		vif = mors->vif[vif_id];
+	u8 beacon = INVALID_VIF_INDEX;
+	u8 probe_resp = INVALID_VIF_INDEX;
+	u8 probe_req = INVALID_VIF_INDEX;
+	u8 first = INVALID_VIF_INDEX;
+	int idx;
 
-	return vif;
-}
+	for (idx = mors->max_vifs - 1; idx >= 0; idx--) {
+		struct ieee80211_vif *vif = rcu_dereference_protected(mors->vif[idx],
+						lockdep_is_held(&mors->vif_list_lock));
 
-struct ieee80211_vif *morse_get_vif_from_vif_id(struct morse *mors, int vif_id)
-{
-	struct ieee80211_vif *vif = NULL;
+		if (!vif)
+			continue;
 
-	spin_lock_bh(&mors->vif_list_lock);
-	vif = __morse_get_vif_from_vif_id(mors, vif_id);
-	spin_unlock_bh(&mors->vif_list_lock);
+		first = idx;
+		if (vif->type == NL80211_IFTYPE_STATION || ieee80211_vif_is_mesh(vif))
+			beacon = idx;
+		if (vif->type == NL80211_IFTYPE_STATION)
+			probe_resp = idx;
+		if (morse_mac_is_iface_ap_type(vif))
+			probe_req = idx;
+	}
 
-	return vif;
+	WRITE_ONCE(mors->rx_vif_map.beacon, beacon);
+	WRITE_ONCE(mors->rx_vif_map.probe_resp, probe_resp);
+	WRITE_ONCE(mors->rx_vif_map.probe_req, probe_req);
+	WRITE_ONCE(mors->rx_vif_map.first, first);
 }
 
 static void morse_vif_remove(struct morse *mors, u8 idx)
 {
+	lockdep_assert_held(&mors->lock);
+
 	spin_lock_bh(&mors->vif_list_lock);
-	mors->vif[idx] = NULL;
+	RCU_INIT_POINTER(mors->vif[idx], NULL);
+	morse_vif_update_rx_map(mors);
 	spin_unlock_bh(&mors->vif_list_lock);
 }
 
@@ -584,9 +741,13 @@ static void morse_vif_add(struct morse *mors, u8 idx, struct ieee80211_vif *vif)
 	 * but overwrite it anyway.
 	 * We do not need to free stale entries as the memory is managed by mac80211
 	 */
+	lockdep_assert_held(&mors->lock);
+
 	spin_lock_bh(&mors->vif_list_lock);
-	WARN_ON(mors->vif[idx] && mors->vif[idx] != vif);
-	mors->vif[idx] = vif;
+	WARN_ON(rcu_access_pointer(mors->vif[idx]) &&
+		rcu_access_pointer(mors->vif[idx]) != vif);
+	rcu_assign_pointer(mors->vif[idx], vif);
+	morse_vif_update_rx_map(mors);
 	spin_unlock_bh(&mors->vif_list_lock);
 }
 
@@ -605,14 +766,6 @@ struct ieee80211_vif *morse_get_vif(struct morse *mors)
 	return vif;
 }
 
-struct ieee80211_vif *morse_get_vif_from_rx_status(struct morse *mors,
-						   const struct morse_skb_rx_status *hdr_rx_status)
-{
-	u8 vif_id = MORSE_RX_STATUS_FLAGS_VIF_ID_GET(le32_to_cpu(hdr_rx_status->flags));
-
-	return morse_get_vif_from_vif_id(mors, vif_id);
-}
-
 static struct ieee80211_vif *morse_get_first_vif_of_type(struct morse *mors,
 							 enum nl80211_iftype type)
 {
@@ -905,7 +1058,7 @@ void morse_mac_fill_tx_info(struct morse *mors,
 	if (mors->duty_cycle > 0 && mors->duty_cycle <= duty_cycle_probe_retry_threshold) {
 		if (ieee80211_is_probe_req(hdr->frame_control) ||
 		    ieee80211_is_probe_resp(hdr->frame_control)) {
-			mors->debug.page_stats.tx_duty_cycle_retry_disabled++;
+			MORSE_PAGE_STAT_INC(mors, tx_duty_cycle_retry_disabled);
 			tx_info->rates[0].count = 1;
 			tx_info->rates[1].count = 0;
 		}
@@ -980,7 +1133,7 @@ static bool morse_mac_tx_ps_filtered_for_sta(struct morse *mors,
 		return false;
 
 	MORSE_DBG(mors, "Frame for sta[%pM] PS filtered\n", mors_sta->addr);
-	mors->debug.page_stats.tx_ps_filtered++;
+	MORSE_PAGE_STAT_INC(mors, tx_ps_filtered);
 
 	info->flags |= IEEE80211_TX_STAT_TX_FILTERED;
 	info->flags &= ~IEEE80211_TX_CTL_AMPDU;
@@ -1499,6 +1652,8 @@ static int morse_mac_process_s1g_caps(struct morse *mors,
 	/* Common code to all accepted frame types goes here */
 	if (ies_mask->ies[WLAN_EID_S1G_CAPABILITIES].ptr[5] & S1G_CAP5_AMPDU)
 		mors_sta->ampdu_supported = true;
+	if (ies_mask->ies[WLAN_EID_S1G_CAPABILITIES].ptr[5] & S1G_CAP5_AMSDU)
+		mors_sta->amsdu_supported = true;
 
 	/* Check partial PV1 support bit set in vendor IE. This is temporary. Replace PV1
 	 * frame support check with S1G capabilities once PV1 is fully supported and advertised
@@ -1842,6 +1997,8 @@ static int morse_mac_mgmt_pkt_to_s1g(struct morse *mors, struct sk_buff **skb_or
 
 		if ((skb->len + skb_tailroom(skb)) < (s1g_hdr_length + s1g_ies_length)) {
 			struct sk_buff *skb2;
+
+			MORSE_PAGE_STAT_INC(mors, tx_s1g_copy);
 			/* Allocate new SKB according to total size of ies_mask plus header */
 			skb2 = skb_copy_expand(skb,
 				skb_headroom(skb),
@@ -1951,6 +2108,41 @@ int morse_mac_pkt_to_s1g(struct morse *mors, struct morse_sta *mors_sta,
 	return ret;
 }
 
+/* Count a data frame on @tid, true once the TID is busy enough to be worth a BA session */
+static bool morse_aggr_burst_reached(struct morse_sta *mors_sta, u16 tid)
+{
+	unsigned long now = jiffies;
+
+	if (ba_start_frames <= 1)
+		return true;
+
+	if (time_after(now, mors_sta->ba_burst_start[tid] + msecs_to_jiffies(ba_start_window_ms))) {
+		mors_sta->ba_burst_start[tid] = now;
+		mors_sta->ba_burst_frames[tid] = 0;
+	}
+
+	return ++mors_sta->ba_burst_frames[tid] >= ba_start_frames;
+}
+
+/* Take a TX BA session from the interface limit, false if the limit is reached */
+static bool morse_aggr_reserve(struct morse_vif *mors_vif, struct morse_sta *mors_sta, u16 tid)
+{
+	if (atomic_inc_return(&mors_vif->ba_tx_sessions) > ba_max_sessions && ba_max_sessions) {
+		atomic_dec(&mors_vif->ba_tx_sessions);
+		return false;
+	}
+
+	set_bit(tid, &mors_sta->ba_tx_reserved);
+	return true;
+}
+
+/* Give back a session taken by morse_aggr_reserve(), if @tid holds one */
+static void morse_aggr_release(struct morse_vif *mors_vif, struct morse_sta *mors_sta, u16 tid)
+{
+	if (test_and_clear_bit(tid, &mors_sta->ba_tx_reserved))
+		atomic_dec(&mors_vif->ba_tx_sessions);
+}
+
 static void
 morse_aggr_check(struct morse_vif *mors_vif, struct ieee80211_sta *pubsta, struct sk_buff *skb)
 {
@@ -1988,9 +2180,17 @@ morse_aggr_check(struct morse_vif *mors_vif, struct ieee80211_sta *pubsta, struc
 	if (unlikely(skb->protocol == cpu_to_be16(ETH_P_PAE)))
 		return;
 
+	if (!morse_aggr_burst_reached(mors_sta, tid))
+		return;
+
+	if (!morse_aggr_reserve(mors_vif, mors_sta, tid))
+		return;
+
 	mors_sta->tid_start_tx[tid] = true;
 
-	ieee80211_start_tx_ba_session(pubsta, tid, 0);
+	/* mac80211 takes the timeout in TUs. On failure the TID is not retried, as before. */
+	if (ieee80211_start_tx_ba_session(pubsta, tid, ba_idle_timeout_ms * 1000 / 1024))
+		morse_aggr_release(mors_vif, mors_sta, tid);
 }
 
 void morse_mac_schedule_probe_req(struct ieee80211_vif *vif)
@@ -2003,10 +2203,112 @@ void morse_mac_schedule_probe_req(struct ieee80211_vif *vif)
 	mors_vif->waiting_for_probe_req_sched = false;
 }
 
-static void morse_mac_ops_tx(struct ieee80211_hw *hw,
-			     struct ieee80211_tx_control *control, struct sk_buff *skb)
+/*
+ * Unicast data frames to a known station, other than 4-address, EAPOL and minimum rate frames,
+ * can take morse_mac_tx_data(). mac80211 only passes a station for frames with a unicast
+ * receiver, so the AP group addressed bandwidth check never applies to these frames.
+ */
+static bool morse_mac_tx_is_fast_data(struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	__le16 fc = ((struct ieee80211_hdr *)skb->data)->frame_control;
+
+	if (morse_dot11ah_is_pv1_qos_data(fc))
+		return true;
+
+	return ieee80211_is_data(fc) && !ieee80211_has_a4(fc) &&
+	       skb->protocol != cpu_to_be16(ETH_P_PAE) &&
+	       !(info->flags & IEEE80211_TX_CTL_USE_MINRATE);
+}
+
+/* The longest frame the chip interface can take, the pageset interface fits each in a page */
+static u32 morse_mac_tx_chip_max_len(struct morse *mors)
+{
+	struct morse_pageset *to_chip;
+
+	if (mors->cfg->ops->skbq_tc_q_from_aci != skbq_pageset_tc_q_from_aci)
+		return U32_MAX;
+
+	to_chip = mors->chip_if->to_chip_pageset;
+	if (!to_chip || !to_chip->populated_pager)
+		return U32_MAX;
+
+	return to_chip->populated_pager->page_size_bytes - mors->hw->extra_tx_headroom;
+}
+
+/*
+ * Keep the A-MSDU length mac80211 builds for @sta within what the chip takes in one frame and
+ * what is sent in amsdu_max_airtime_us at the expected throughput of the station. It is
+ * refreshed from the TX path so it follows rate control.
+ */
+static void morse_mac_tx_amsdu_update(struct morse *mors, struct ieee80211_sta *sta,
+				      struct morse_sta *mors_sta)
+{
+	u32 tput_kbps = morse_rc_sta_expected_throughput(mors_sta);
+	u32 len = 0;
+
+	/* PV1 conversion works on single MSDUs */
+	if (mors_sta->amsdu_supported && !mors_sta->pv1_frame_support && tput_kbps) {
+		/* kbit/s is bits per ms */
+		len = div_u64((u64)tput_kbps * amsdu_max_airtime_us, BITS_PER_BYTE * USEC_PER_MSEC);
+		len = min3(len, amsdu_max_len, morse_mac_tx_chip_max_len(mors));
+		len = min_t(u32, len, U16_MAX);
+	}
+
+	/* mac80211 takes a zero limit as no limit, so one byte stops it aggregating */
+	len = max_t(u32, len, 1);
+	if (len == mors_sta->amsdu_max_len)
+		return;
+
+	mors_sta->amsdu_max_len = len;
+#if KERNEL_VERSION(6, 0, 0) <= MAC80211_VERSION_CODE
+	sta->deflink.agg.max_rc_amsdu_len = len;
+	ieee80211_sta_recalc_aggregates(sta);
+#else
+	sta->max_rc_amsdu_len = len;
+#endif
+}
+
+/*
+ * TX path for frames accepted by morse_mac_tx_is_fast_data(). Data frames need no S1G
+ * conversion and always go at the operating bandwidth, so this skips the frame type dispatch
+ * of morse_mac_pkt_to_s1g() and the DA lookup of the generic path in morse_mac_tx().
+ */
+static void morse_mac_tx_data(struct morse *mors, struct ieee80211_vif *vif,
+			      struct ieee80211_sta *sta, struct sk_buff *skb, u64 start_ns,
+			      u64 lat_ns, struct morse_skbq_tx_batch *batch)
+{
+	struct morse_vif *mors_vif = ieee80211_vif_to_morse_vif(vif);
+	struct morse_sta *mors_sta = (struct morse_sta *)sta->drv_priv;
+	struct morse_skb_tx_info tx_info = { 0 };
+	struct morse_skbq *mq;
+	int tx_bw_mhz = min(mors->custom_configs.channel_info.op_bw_mhz,
+			    morse_vif_max_tx_bw(mors_vif));
+
+	if (mors_sta->max_bw_mhz > 0)
+		tx_bw_mhz = min(tx_bw_mhz, mors_sta->max_bw_mhz);
+
+	if (ieee80211_hw_check(mors->hw, TX_AMSDU))
+		morse_mac_tx_amsdu_update(mors, sta, mors_sta);
+
+	morse_mac_fill_tx_info(mors, &tx_info, skb, vif, tx_bw_mhz, sta);
+
+	if (morse_mac_tx_ps_filtered_for_sta(mors, skb, sta))
+		return;
+
+	mq = morse_chip_if_tc_q_from_aci(mors, dot11_tid_to_ac(tx_info.tid));
+	morse_tx_path_stats_end(mors, MORSE_TX_PATH_DATA, start_ns);
+	morse_pkt_lat_tx_begin(mors, skb, dot11_tid_to_ac(tx_info.tid), lat_ns);
+	morse_skbq_skb_tx_batched(mq, skb, &tx_info, batch);
+}
+
+/*
+ * Convert and queue one frame. Data frames are added to @batch when one is given, for the
+ * caller to flush, otherwise every frame is queued straight away.
+ */
+static void morse_mac_tx(struct morse *mors, struct ieee80211_tx_control *control,
+			 struct sk_buff *skb, struct morse_skbq_tx_batch *batch)
 {
-	struct morse *mors = hw->priv;
 	struct morse_skbq *mq;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct morse_vif *mors_vif = NULL;
@@ -2020,6 +2322,8 @@ static void morse_mac_ops_tx(struct ieee80211_hw *hw,
 	struct morse_sta *mors_sta = NULL;
 	int vif_max_bw_mhz;
 	int sta_max_bw_mhz = 0;
+	u64 start_ns = morse_tx_path_stats_start();
+	u64 lat_ns = morse_pkt_lat_start(mors);
 
 	if (info && info->control.vif)
 		vif = info->control.vif;
@@ -2036,9 +2340,8 @@ static void morse_mac_ops_tx(struct ieee80211_hw *hw,
 	/* If we have a station, retrieve station-specific tx info */
 	if (sta) {
 #ifdef CONFIG_MORSE_IPMON
-		static u64 time_start;
-
-		morse_ipmon(&time_start, skb, skb->data, skb->len, IPMON_LOC_CLIENT_DRV1, 0);
+		morse_ipmon(&mors->debug.ipmon_time_start[IPMON_LOC_CLIENT_DRV1], skb,
+			    skb->data, skb->len, IPMON_LOC_CLIENT_DRV1, 0);
 #endif
 		/* see if we should start aggregation */
 		morse_aggr_check(mors_vif, sta, skb);
@@ -2051,6 +2354,13 @@ static void morse_mac_ops_tx(struct ieee80211_hw *hw,
 				hdr = (struct ieee80211_hdr *)skb->data;
 		}
 		mors_sta->tx_pkt_count++;
+		if (vif->type == NL80211_IFTYPE_AP)
+			morse_raw_note_activity(mors_vif, sta->aid);
+
+		if (likely(enable_tx_data_fast_path) && !is_mgmt && morse_mac_tx_is_fast_data(skb)) {
+			morse_mac_tx_data(mors, vif, sta, skb, start_ns, lat_ns, batch);
+			return;
+		}
 	}
 
 	if (morse_mac_pkt_to_s1g(mors, mors_sta, &skb, &tx_bw_mhz) < 0) {
@@ -2092,167 +2402,695 @@ static void morse_mac_ops_tx(struct ieee80211_hw *hw,
 		return;
 
 	if (is_mgmt)
-		mq = mors->cfg->ops->skbq_mgmt_tc_q(mors);
+		mq = morse_chip_if_mgmt_tc_q(mors);
 	else
-		mq = mors->cfg->ops->skbq_tc_q_from_aci(mors, dot11_tid_to_ac(tx_info.tid));
+		mq = morse_chip_if_tc_q_from_aci(mors, dot11_tid_to_ac(tx_info.tid));
 
-	morse_skbq_skb_tx(mq, &skb, &tx_info,
-			  (is_mgmt) ? MORSE_SKB_CHAN_MGMT : MORSE_SKB_CHAN_DATA);
+	morse_tx_path_stats_end(mors, MORSE_TX_PATH_GENERIC, start_ns);
+	morse_pkt_lat_tx_begin(mors, skb, is_mgmt ? MORSE_ACI_VO : dot11_tid_to_ac(tx_info.tid),
+			       lat_ns);
+	if (is_mgmt)
+		morse_skbq_skb_tx(mq, &skb, &tx_info, MORSE_SKB_CHAN_MGMT);
+	else
+		morse_skbq_skb_tx_batched(mq, skb, &tx_info, batch);
 }
 
-#if KERNEL_VERSION(5, 9, 0) <= MAC80211_VERSION_CODE
-/* The following functions are for airtime fairness */
-static int morse_txq_send(struct morse *mors, struct ieee80211_txq *txq)
+static void morse_mac_ops_tx(struct ieee80211_hw *hw,
+			     struct ieee80211_tx_control *control, struct sk_buff *skb)
 {
-	struct ieee80211_tx_control control = { };
+	morse_mac_tx(hw->priv, control, skb, NULL);
+}
 
-	control.sta = txq->sta;
+/* Synthetic frames timed by morse_mac_tx_benchmark(), in batches between reschedules */
+#define MORSE_TX_BENCHMARK_BATCHES	(32)
+#define MORSE_TX_BENCHMARK_BATCH_FRAMES	(128)
+#define MORSE_TX_BENCHMARK_PAYLOAD_LEN	(1400)
 
-	while (!test_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags)) {
-		struct sk_buff *skb = ieee80211_tx_dequeue(mors->hw, txq);
+/* Stages of the TX path timed by morse_mac_tx_benchmark() */
+enum morse_tx_benchmark_stage {
+	MORSE_TX_BENCHMARK_S1G,
+	MORSE_TX_BENCHMARK_TX_INFO,
+	MORSE_TX_BENCHMARK_HEADER,
+	MORSE_TX_BENCHMARK_NUM_STAGES,
+};
 
-		if (!skb)
-			break;
+static const char * const morse_tx_benchmark_stage_names[MORSE_TX_BENCHMARK_NUM_STAGES] = {
+	[MORSE_TX_BENCHMARK_S1G] = "s1g conversion",
+	[MORSE_TX_BENCHMARK_TX_INFO] = "tx info and rates",
+	[MORSE_TX_BENCHMARK_HEADER] = "bus header",
+};
 
-		morse_mac_ops_tx(mors->hw, &control, skb);
-	}
+/* Build a QoS data frame from @vif to @ra, as mac80211 would hand it to morse_mac_ops_tx() */
+static struct sk_buff *morse_mac_tx_benchmark_skb(struct morse *mors, struct ieee80211_vif *vif,
+						  const u8 *ra)
+{
+	struct ieee80211_qos_hdr *hdr;
+	struct ieee80211_tx_info *info;
+	struct sk_buff *skb;
+	u16 fc = IEEE80211_FTYPE_DATA | IEEE80211_STYPE_QOS_DATA;
+
+	skb = dev_alloc_skb(mors->hw->extra_tx_headroom + sizeof(*hdr) +
+			    MORSE_TX_BENCHMARK_PAYLOAD_LEN + 3);
+	if (!skb)
+		return NULL;
+
+	skb_reserve(skb, mors->hw->extra_tx_headroom);
+	hdr = (struct ieee80211_qos_hdr *)skb_put(skb, sizeof(*hdr));
+	memset(hdr, 0, sizeof(*hdr));
+	fc |= (vif->type == NL80211_IFTYPE_STATION) ? IEEE80211_FCTL_TODS : IEEE80211_FCTL_FROMDS;
+	hdr->frame_control = cpu_to_le16(fc);
+	memcpy(hdr->addr1, ra, ETH_ALEN);
+	memcpy(hdr->addr2, vif->addr, ETH_ALEN);
+	memcpy(hdr->addr3, ra, ETH_ALEN);
+	memset(skb_put(skb, MORSE_TX_BENCHMARK_PAYLOAD_LEN), 0, MORSE_TX_BENCHMARK_PAYLOAD_LEN);
+
+	skb->priority = 0;
+	skb_set_queue_mapping(skb, IEEE80211_AC_BE);
+	info = IEEE80211_SKB_CB(skb);
+	memset(info, 0, sizeof(*info));
+	info->control.vif = vif;
 
-	return test_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags);
+	return skb;
 }
 
-static bool morse_txq_schedule_list(struct morse *mors, enum morse_page_aci aci)
+/* Run one batch of synthetic frames, adding the time spent in each stage to @stage_ns */
+static int morse_mac_tx_benchmark_batch(struct morse *mors, u64 *stage_ns, u8 *ra)
 {
-	struct ieee80211_txq *txq;
-	bool tx_stopped = false;
+	struct ieee80211_vif *vif;
+	struct ieee80211_sta *sta = NULL;
+	struct morse_sta *mors_sta = NULL;
+	struct morse_skb_tx_info tx_info;
+	struct sk_buff *skb;
+	u64 t0, t1, t2, t3;
+	int tx_bw_mhz;
+	int ret = 0;
+	int i;
 
-	do {
-		txq = ieee80211_next_txq(mors->hw, aci);
-		if (!txq)
+	rcu_read_lock();
+	vif = morse_get_sta_vif(mors);
+	if (vif && morse_mac_is_sta_vif_associated(vif))
+		sta = ieee80211_find_sta(vif, vif->bss_conf.bssid);
+	else if (!vif)
+		vif = morse_get_ap_vif(mors);
+
+	if (!vif) {
+		ret = -ENODEV;
+		goto exit;
+	}
+
+	/* Without an AP to send to, time group addressed frames instead */
+	if (sta) {
+		mors_sta = (struct morse_sta *)sta->drv_priv;
+		memcpy(ra, sta->addr, ETH_ALEN);
+	} else {
+		eth_broadcast_addr(ra);
+	}
+
+	for (i = 0; i < MORSE_TX_BENCHMARK_BATCH_FRAMES; i++) {
+		skb = morse_mac_tx_benchmark_skb(mors, vif, ra);
+		if (!skb) {
+			ret = -ENOMEM;
 			break;
+		}
+		memset(&tx_info, 0, sizeof(tx_info));
+		tx_bw_mhz = mors->custom_configs.channel_info.op_bw_mhz;
 
-		tx_stopped = morse_txq_send(mors, txq);
+		t0 = ktime_get_ns();
+		if (morse_mac_pkt_to_s1g(mors, mors_sta, &skb, &tx_bw_mhz) < 0) {
+			dev_kfree_skb_any(skb);
+			ret = -EINVAL;
+			break;
+		}
+		tx_bw_mhz = min(tx_bw_mhz, morse_vif_max_tx_bw(ieee80211_vif_to_morse_vif(vif)));
+		t1 = ktime_get_ns();
+		morse_mac_fill_tx_info(mors, &tx_info, skb, vif, tx_bw_mhz, sta);
+		t2 = ktime_get_ns();
+		ret = morse_skbq_skb_push_header(mors, skb, &tx_info, MORSE_SKB_CHAN_DATA);
+		t3 = ktime_get_ns();
+		if (ret)
+			break;
 
-		ieee80211_return_txq(mors->hw, txq, false);
-	} while (!tx_stopped);
+		stage_ns[MORSE_TX_BENCHMARK_S1G] += t1 - t0;
+		stage_ns[MORSE_TX_BENCHMARK_TX_INFO] += t2 - t1;
+		stage_ns[MORSE_TX_BENCHMARK_HEADER] += t3 - t2;
+		dev_kfree_skb_any(skb);
+	}
 
-	return tx_stopped;
+exit:
+	rcu_read_unlock();
+	return ret;
 }
 
-static bool morse_txq_schedule(struct morse *mors, enum morse_page_aci aci)
+int morse_mac_tx_benchmark(struct morse *mors, struct seq_file *file)
 {
-	bool tx_stopped = false;
+	u64 stage_ns[MORSE_TX_BENCHMARK_NUM_STAGES] = { 0 };
+	u64 total_ns = 0;
+	u8 ra[ETH_ALEN] = { 0 };
+	u32 frames = 0;
+	int ret = 0;
+	int batch;
+	int stage;
 
-	if (aci > MORSE_ACI_VO)
+	for (batch = 0; batch < MORSE_TX_BENCHMARK_BATCHES; batch++) {
+		ret = morse_mac_tx_benchmark_batch(mors, stage_ns, ra);
+		if (ret)
+			break;
+		frames += MORSE_TX_BENCHMARK_BATCH_FRAMES;
+		cond_resched();
+	}
+
+	if (!frames) {
+		seq_printf(file, "error %d running benchmark\n", ret);
 		return 0;
+	}
 
-	rcu_read_lock();
+	seq_printf(file, "receiver: %pM\n", ra);
+	seq_printf(file, "frames: %u\n", frames);
+	seq_printf(file, "payload (bytes): %d\n", MORSE_TX_BENCHMARK_PAYLOAD_LEN);
+	for (stage = 0; stage < MORSE_TX_BENCHMARK_NUM_STAGES; stage++) {
+		seq_printf(file, "%s (ns/frame): %llu\n", morse_tx_benchmark_stage_names[stage],
+			   div_u64(stage_ns[stage], frames));
+		total_ns += stage_ns[stage];
+	}
+	seq_printf(file, "total (ns/frame): %llu\n", div_u64(total_ns, frames));
+
+	return 0;
+}
 
-	ieee80211_txq_schedule_start(mors->hw, aci);
-	tx_stopped = morse_txq_schedule_list(mors, aci);
-	ieee80211_txq_schedule_end(mors->hw, aci);
+#if KERNEL_VERSION(5, 9, 0) <= MAC80211_VERSION_CODE
+/* The following functions are for airtime fairness */
 
-	rcu_read_unlock();
+/* Length of one bucket of the duty cycle window, or 0 if the budget is not tracked */
+static unsigned long morse_duty_cycle_bucket_jiffies(void)
+{
+	uint window_s = READ_ONCE(duty_cycle_window_s);
 
-	return tx_stopped;
+	if (!window_s)
+		return 0;
+
+	return max(DIV_ROUND_UP(window_s * HZ, MORSE_DUTY_CYCLE_BUCKETS), 1u);
 }
 
-static void morse_txq_tasklet(struct tasklet_struct *t)
+/* Drop the buckets that have left the window. Must be called with the budget lock held. */
+static void morse_duty_cycle_budget_advance(struct morse_duty_cycle_budget *dc,
+					    unsigned long bucket_j)
 {
-	s16 aci;
-	bool tx_stopped;
-	struct morse *mors = from_tasklet(mors, t, tasklet_txq);
+	unsigned long elapsed = jiffies - dc->cur_start;
+	unsigned long steps = elapsed / bucket_j;
 
-	if (test_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags))
+	if (!steps)
 		return;
 
-	for (aci = MORSE_ACI_VO; aci >= 0; aci--) {
-		tx_stopped = morse_txq_schedule(mors, (enum morse_page_aci)aci);
-
-		if (tx_stopped)
-			/* Queues are stopped, probably filled */
-			break;
+	if (steps >= MORSE_DUTY_CYCLE_BUCKETS) {
+		memset(dc->bucket_us, 0, sizeof(dc->bucket_us));
+		dc->used_us = 0;
+		dc->cur_start = jiffies;
+		return;
+	}
 
-		if (aci == MORSE_ACI_BE)
-			break;
+	dc->cur_start += steps * bucket_j;
+	while (steps--) {
+		dc->cur = (dc->cur + 1) % MORSE_DUTY_CYCLE_BUCKETS;
+		dc->used_us -= dc->bucket_us[dc->cur];
+		dc->bucket_us[dc->cur] = 0;
 	}
 }
 
-static void morse_mac_ops_wake_tx_queue(struct ieee80211_hw *hw, struct ieee80211_txq *txq)
+static void morse_duty_cycle_budget_add(struct morse *mors, u32 airtime_us)
 {
-	struct morse *mors = hw->priv;
-
-	tasklet_schedule(&mors->tasklet_txq);
-}
-#endif
+	struct morse_duty_cycle_budget *dc = &mors->duty_cycle_budget;
+	unsigned long bucket_j = morse_duty_cycle_bucket_jiffies();
 
-static void morse_survey_destroy_usage_records(struct morse *mors)
-{
-	if (!mors->channel_survey)
+	if (!bucket_j)
 		return;
 
-	kfree(mors->channel_survey->records);
-	kfree(mors->channel_survey);
-	mors->channel_survey = NULL;
+	spin_lock_bh(&dc->lock);
+	morse_duty_cycle_budget_advance(dc, bucket_j);
+	dc->bucket_us[dc->cur] += airtime_us;
+	dc->used_us += airtime_us;
+	spin_unlock_bh(&dc->lock);
 }
 
-int morse_survey_init_usage_records(struct morse *mors)
+/*
+ * Airtime the duty cycle allows over the window and how much of it is left (usecs).
+ *
+ * Return: false if there is no duty cycle limit or the budget is not tracked
+ */
+static bool morse_duty_cycle_budget_get(struct morse *mors, u64 *budget_us, u64 *left_us)
 {
-	struct morse_channel_survey *survey;
+	struct morse_duty_cycle_budget *dc = &mors->duty_cycle_budget;
+	unsigned long bucket_j = morse_duty_cycle_bucket_jiffies();
+	u32 duty_cycle = READ_ONCE(mors->duty_cycle);
+	u64 used_us;
 
-	if (mors->channel_survey)
-		morse_survey_destroy_usage_records(mors);
+	if (!bucket_j || !duty_cycle || duty_cycle >= 10000)
+		return false;
 
-	survey = kmalloc(sizeof(*survey), GFP_KERNEL);
-	if (!survey)
-		return -ENOMEM;
+	spin_lock_bh(&dc->lock);
+	morse_duty_cycle_budget_advance(dc, bucket_j);
+	used_us = dc->used_us;
+	spin_unlock_bh(&dc->lock);
 
-	survey->num_records = morse_dot11ah_get_num_channels();
-	survey->first_channel_in_scan = true;
-	survey->records = kcalloc(survey->num_records, sizeof(*survey->records), GFP_KERNEL);
-	if (!survey->records) {
-		kfree(survey);
-		return -ENOMEM;
-	}
+	*budget_us = div_u64((u64)READ_ONCE(duty_cycle_window_s) * USEC_PER_SEC * duty_cycle,
+			     10000);
+	*left_us = *budget_us > used_us ? *budget_us - used_us : 0;
 
-	mors->channel_survey = survey;
-	return 0;
+	return true;
 }
 
-int morse_survey_add_channel_usage(struct morse *mors, struct morse_survey_rx_usage_record *record)
+/*
+ * As the duty cycle budget runs low, hold background and then best effort traffic so the
+ * airtime left goes to higher priority ACs. Held queues are revisited when the oldest bucket
+ * leaves the window.
+ *
+ * Return: true if @ac must not be served this round
+ */
+static bool morse_txq_duty_cycle_held(struct morse *mors, int ac)
 {
-	struct morse_channel_survey *survey = mors->channel_survey;
-	int ret = -1;
-	int i;
+	struct morse_duty_cycle_budget *dc = &mors->duty_cycle_budget;
+	uint reserve_pct = READ_ONCE(duty_cycle_reserve_pct);
+	u64 budget_us, left_us;
+	unsigned long release;
 
-	if (!survey)
-		return -EEXIST;
+	if (ac != IEEE80211_AC_BE && ac != IEEE80211_AC_BK)
+		return false;
 
-	for (i = 0; i < survey->num_records; i++) {
-		/* No record for this channel, so initialise it */
-		if (survey->records[i].freq_hz == 0) {
-			memcpy(&survey->records[i], record, sizeof(*record));
-			ret = 0;
-			break;
-		} else if (record->freq_hz == survey->records[i].freq_hz &&
-				record->bw_mhz == survey->records[i].bw_mhz) {
-			/* Matched record, so update */
-			survey->records[i].time_listen += record->time_listen;
-			survey->records[i].time_rx += record->time_rx;
-			/* Only take most recent noise figure */
-			survey->records[i].noise = record->noise;
-			ret = 0;
-			break;
-		}
-	}
+	if (!reserve_pct || !morse_duty_cycle_budget_get(mors, &budget_us, &left_us))
+		return false;
 
-	MORSE_DBG(mors, "%s: [%d] freq: %u bw: %d tot: %llu rx: %llu noise: %d\n", __func__,
-		ret ? -1 : i, record->freq_hz, record->bw_mhz, record->time_listen,
-		record->time_rx, record->noise);
-	return ret;
-}
+	if (ac == IEEE80211_AC_BE)
+		reserve_pct /= 2;
 
-static int morse_survey_update_channel_usage(struct morse *mors)
-{
+	if (left_us * 100 >= budget_us * reserve_pct)
+		return false;
+
+	dc->held[ac]++;
+	release = READ_ONCE(dc->cur_start) + morse_duty_cycle_bucket_jiffies();
+	if (!timer_pending(&mors->txq_release_timer) ||
+	    time_before(release, mors->txq_release_timer.expires))
+		mod_timer(&mors->txq_release_timer, release);
+
+	return true;
+}
+
+void morse_mac_duty_cycle_budget_show(struct morse *mors, struct seq_file *file)
+{
+	struct morse_duty_cycle_budget *dc = &mors->duty_cycle_budget;
+	u64 budget_us, left_us;
+	int ac;
+
+	seq_printf(file, "duty cycle: %u.%02u%%\n", mors->duty_cycle / 100,
+		   mors->duty_cycle % 100);
+	seq_printf(file, "window(s): %u\n", duty_cycle_window_s);
+
+	if (morse_duty_cycle_budget_get(mors, &budget_us, &left_us)) {
+		seq_printf(file, "budget(us): %llu\n", budget_us);
+		seq_printf(file, "used(us): %llu\n", READ_ONCE(dc->used_us));
+		seq_printf(file, "remaining(us): %llu\n", left_us);
+	} else {
+		seq_puts(file, "budget(us): unlimited\n");
+	}
+
+	seq_puts(file, "held (vo vi be bk):");
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		seq_printf(file, " %u", dc->held[ac]);
+	seq_puts(file, "\n");
+}
+
+/*
+ * Decide whether a TX queue may be served this round. A station that has used up its
+ * airtime is granted a new quantum and passed over, so it is served again only after
+ * every other backlogged station has had its turn.
+ */
+static bool morse_txq_may_send(struct ieee80211_txq *txq)
+{
+	struct morse_sta *mors_sta;
+	atomic_t *deficit;
+
+	if (!txq->sta || txq->ac >= IEEE80211_NUM_ACS)
+		return true;
+
+	mors_sta = (struct morse_sta *)txq->sta->drv_priv;
+	deficit = &mors_sta->airtime_deficit[txq->ac];
+	if (atomic_read(deficit) > 0)
+		return true;
+
+	atomic_add(max_t(uint, airtime_quantum_us, 1), deficit);
+	return false;
+}
+
+/**
+ * morse_txq_twt_held() - Check if a TX queue is held until its station's next TWT service period
+ *
+ * @mors: Morse chip struct
+ * @txq: TX queue about to be served
+ *
+ * Frames stay queued in mac80211 rather than filling chip buffers while the station sleeps. The
+ * release timer is armed so the queue is revisited when its release window opens.
+ *
+ * Return: true if the queue must not be served yet
+ */
+static bool morse_txq_twt_held(struct morse *mors, struct ieee80211_txq *txq)
+{
+	struct morse_vif *mors_vif;
+	unsigned long release;
+	u32 hold_us;
+
+	if (!enable_twt_tx_hold || !txq->sta || txq->vif->type != NL80211_IFTYPE_AP)
+		return false;
+
+	mors_vif = ieee80211_vif_to_morse_vif(txq->vif);
+	hold_us = morse_twt_tx_hold_us(mors_vif, txq->sta->addr,
+				       morse_mac_generate_timestamp_for_frame(mors_vif),
+				       twt_tx_hold_lead_us);
+	if (!hold_us)
+		return false;
+
+	release = jiffies + usecs_to_jiffies(hold_us);
+	if (!timer_pending(&mors->txq_release_timer) ||
+	    time_before(release, mors->txq_release_timer.expires))
+		mod_timer(&mors->txq_release_timer, release);
+
+	return true;
+}
+
+static void morse_txq_release_timer(struct timer_list *t)
+{
+	struct morse *mors = from_timer(mors, t, txq_release_timer);
+
+	morse_mac_schedule_txq(mors);
+}
+
+/*
+ * Send up to a visit's worth of frames from @txq, taking them from the run's @budget. The
+ * frames are queued to their skbq as one batch at the end of the visit.
+ */
+static int morse_txq_send(struct morse *mors, struct ieee80211_txq *txq, uint *budget)
+{
+	struct ieee80211_tx_control control = { };
+	struct morse_skbq_tx_batch batch;
+	uint limit = min_t(uint, max_t(uint, txq_max_frames_per_visit, 1), *budget);
+	int sent = 0;
+
+	control.sta = txq->sta;
+	morse_skbq_tx_batch_init(&batch, MORSE_SKB_CHAN_DATA);
+
+	while (sent < limit && !test_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags)) {
+		struct sk_buff *skb = ieee80211_tx_dequeue(mors->hw, txq);
+
+		if (!skb)
+			break;
+
+		morse_mac_tx(mors, &control, skb, &batch);
+		sent++;
+	}
+
+	morse_skbq_tx_batch_flush(&batch);
+
+	*budget -= sent;
+	return sent;
+}
+
+static bool morse_txq_schedule_list(struct morse *mors, int ac, bool *deferred, uint *budget)
+{
+	struct ieee80211_txq *txq;
+	bool tx_stopped = false;
+	bool sent = false;
+	bool skipped = false;
+
+	do {
+		txq = ieee80211_next_txq(mors->hw, ac);
+		if (!txq)
+			break;
+
+		if (morse_txq_twt_held(mors, txq)) {
+			/* Not out of airtime, so doesn't count towards deferring the round */
+		} else if (morse_txq_may_send(txq)) {
+			if (morse_txq_send(mors, txq, budget))
+				sent = true;
+			tx_stopped = test_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags);
+		} else {
+			skipped = true;
+		}
+
+		ieee80211_return_txq(mors->hw, txq, false);
+	} while (!tx_stopped && *budget);
+
+	/* Every backlogged station was out of airtime, they have all been replenished */
+	if (skipped && !sent)
+		*deferred = true;
+
+	return tx_stopped;
+}
+
+static bool morse_txq_schedule(struct morse *mors, int ac, bool *deferred, uint *budget)
+{
+	bool tx_stopped = false;
+
+	if (ac >= IEEE80211_NUM_ACS)
+		return false;
+
+	/* Nests in the tasklet. In the worker it lets pending softirqs, e.g. RX, run between ACs */
+	local_bh_disable();
+	rcu_read_lock();
+
+	ieee80211_txq_schedule_start(mors->hw, ac);
+	tx_stopped = morse_txq_schedule_list(mors, ac, deferred, budget);
+	ieee80211_txq_schedule_end(mors->hw, ac);
+
+	rcu_read_unlock();
+	local_bh_enable();
+
+	return tx_stopped;
+}
+
+/*
+ * One TX scheduler round over every AC, sending at most @budget frames.
+ *
+ * Return: true if the scheduler should run again, because stations were deferred for airtime
+ * or the budget ran out before the chip queues filled
+ */
+static bool morse_txq_run(struct morse *mors, uint budget)
+{
+	int ac;
+	bool tx_stopped = false;
+	bool deferred = false;
+
+	if (test_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags))
+		return false;
+
+	/* Higher ACs have filled the chip queues for too long, let background through first */
+	if (mors->txq_bk_skipped_rounds >= txq_bk_max_skipped_rounds) {
+		mors->txq_bk_skipped_rounds = 0;
+		if (!morse_txq_duty_cycle_held(mors, IEEE80211_AC_BK))
+			tx_stopped = morse_txq_schedule(mors, IEEE80211_AC_BK, &deferred,
+							&budget);
+	}
+
+	/* mac80211 numbers its ACs from highest (VO) to lowest (BK) priority */
+	for (ac = IEEE80211_AC_VO; ac < IEEE80211_NUM_ACS && !tx_stopped && budget; ac++) {
+		if (morse_txq_duty_cycle_held(mors, ac))
+			continue;
+
+		tx_stopped = morse_txq_schedule(mors, ac, &deferred, &budget);
+
+		if ((tx_stopped || !budget) && ac != IEEE80211_AC_BK)
+			/* Queues filled, or the run ended, before background was served */
+			mors->txq_bk_skipped_rounds++;
+	}
+
+	return !tx_stopped && (deferred || !budget);
+}
+
+static void morse_txq_tasklet(struct tasklet_struct *t)
+{
+	struct morse *mors = from_tasklet(mors, t, tasklet_txq);
+
+	if (morse_txq_run(mors, UINT_MAX))
+		tasklet_schedule(&mors->tasklet_txq);
+}
+
+static void morse_txq_work(struct work_struct *work)
+{
+	struct morse *mors = container_of(work, struct morse, txq_work);
+	bool again;
+
+	/* Fill the data skbqs for the whole run, then tell the chip interface once */
+	WRITE_ONCE(mors->txq_defer_data_kick, true);
+	again = morse_txq_run(mors, txq_work_budget ? txq_work_budget : UINT_MAX);
+	WRITE_ONCE(mors->txq_defer_data_kick, false);
+	/* Frames queued by other contexts while the kick was deferred are covered by this one */
+	smp_mb();
+	morse_skbq_data_tx_kick(mors);
+
+	/* Requeue rather than loop, so the budget bounds how long the worker holds the CPU */
+	if (again)
+		morse_mac_schedule_txq(mors);
+}
+
+static void morse_txq_work_init(struct morse *mors)
+{
+	if (!enable_txq_work)
+		return;
+
+	INIT_WORK(&mors->txq_work, morse_txq_work);
+	mors->txq_wq = alloc_workqueue("MorseTxqWorkQ", WQ_HIGHPRI | WQ_MEM_RECLAIM, 1);
+	if (!mors->txq_wq)
+		MORSE_ERR(mors, "%s: failed to allocate TX scheduler workqueue, using tasklet\n",
+			  __func__);
+}
+
+static void morse_txq_work_cancel(struct morse *mors)
+{
+	if (mors->txq_wq)
+		cancel_work_sync(&mors->txq_work);
+}
+
+static void morse_txq_work_finish(struct morse *mors)
+{
+	if (!mors->txq_wq)
+		return;
+
+	cancel_work_sync(&mors->txq_work);
+	destroy_workqueue(mors->txq_wq);
+	mors->txq_wq = NULL;
+}
+
+static void morse_mac_ops_wake_tx_queue(struct ieee80211_hw *hw, struct ieee80211_txq *txq)
+{
+	struct morse *mors = hw->priv;
+
+	morse_mac_schedule_txq(mors);
+}
+#endif
+
+void morse_mac_schedule_txq(struct morse *mors)
+{
+	int cpu = txq_work_cpu;
+
+	if (!mors->txq_wq) {
+		tasklet_schedule(&mors->tasklet_txq);
+		return;
+	}
+
+	if (cpu < 0 || cpu >= nr_cpu_ids || !cpu_online(cpu))
+		cpu = WORK_CPU_UNBOUND;
+
+	queue_work_on(cpu, mors->txq_wq, &mors->txq_work);
+}
+
+static void morse_survey_destroy_usage_records(struct morse *mors)
+{
+	if (!mors->channel_survey)
+		return;
+
+	kfree(mors->channel_survey->records);
+	kfree(mors->channel_survey);
+	mors->channel_survey = NULL;
+}
+
+int morse_survey_init_usage_records(struct morse *mors)
+{
+	struct morse_channel_survey *survey;
+	struct morse_channel *channels;
+	int num_channels;
+	int i;
+
+	if (mors->channel_survey)
+		morse_survey_destroy_usage_records(mors);
+
+	survey = kmalloc(sizeof(*survey), GFP_KERNEL);
+	if (!survey)
+		return -ENOMEM;
+
+	survey->num_records = morse_dot11ah_get_num_channels();
+	survey->first_channel_in_scan = true;
+	survey->records = kcalloc(survey->num_records, sizeof(*survey->records), GFP_KERNEL);
+	if (!survey->records) {
+		kfree(survey);
+		return -ENOMEM;
+	}
+
+	/* Key each record by the S1G channel number of its slot in the channel map */
+	memset(survey->record_idx, MORSE_SURVEY_NO_RECORD, sizeof(survey->record_idx));
+	channels = kcalloc(survey->num_records, sizeof(*channels), GFP_KERNEL);
+	if (!channels) {
+		kfree(survey->records);
+		kfree(survey);
+		return -ENOMEM;
+	}
+
+	num_channels = morse_dot11ah_fill_channel_list(channels);
+	for (i = 0; i < num_channels && i < MORSE_SURVEY_NO_RECORD; i++)
+		survey->record_idx[channels[i].channel_s1g] = i;
+	kfree(channels);
+
+	mors->channel_survey = survey;
+	return 0;
+}
+
+/**
+ * morse_survey_find_record() - Get the survey record slot for a channel.
+ *
+ * @survey: channel survey
+ * @freq_hz: center frequency of the channel
+ * @bw_mhz: bandwidth of the channel
+ *
+ * Return: record slot owned by the channel, which is empty (freq_hz of 0) if no usage has
+ * been recorded yet, or NULL if the channel is not in the channel map.
+ */
+static struct morse_survey_rx_usage_record *
+morse_survey_find_record(struct morse_channel_survey *survey, u32 freq_hz, u8 bw_mhz)
+{
+	struct morse_survey_rx_usage_record *record;
+	int chan = morse_dot11ah_freq_khz_bw_mhz_to_chan(HZ_TO_KHZ(freq_hz), bw_mhz);
+	u8 idx;
+
+	if (chan < 0 || chan > U8_MAX)
+		return NULL;
+
+	idx = survey->record_idx[chan];
+	if (idx == MORSE_SURVEY_NO_RECORD || idx >= survey->num_records)
+		return NULL;
+
+	record = &survey->records[idx];
+	if (record->freq_hz && (record->freq_hz != freq_hz || record->bw_mhz != bw_mhz))
+		return NULL;
+
+	return record;
+}
+
+int morse_survey_add_channel_usage(struct morse *mors, struct morse_survey_rx_usage_record *record)
+{
+	struct morse_channel_survey *survey = mors->channel_survey;
+	struct morse_survey_rx_usage_record *slot;
+	int ret = -1;
+
+	if (!survey)
+		return -EEXIST;
+
+	slot = morse_survey_find_record(survey, record->freq_hz, record->bw_mhz);
+	if (slot && slot->freq_hz == 0) {
+		/* No record for this channel, so initialise it */
+		memcpy(slot, record, sizeof(*record));
+		ret = 0;
+	} else if (slot) {
+		/* Matched record, so update */
+		slot->time_listen += record->time_listen;
+		slot->time_rx += record->time_rx;
+		/* Only take most recent noise figure */
+		slot->noise = record->noise;
+		ret = 0;
+	}
+
+	MORSE_DBG(mors, "%s: [%d] freq: %u bw: %d tot: %llu rx: %llu noise: %d\n", __func__,
+		ret ? -1 : (int)(slot - survey->records), record->freq_hz, record->bw_mhz,
+		record->time_listen, record->time_rx, record->noise);
+	return ret;
+}
+
+static int morse_survey_update_channel_usage(struct morse *mors)
+{
 	struct morse_channel_survey *survey = mors->channel_survey;
 	struct morse_survey_rx_usage_record usage_record;
 	int ret;
@@ -2276,18 +3114,16 @@ static struct morse_survey_rx_usage_record *morse_survey_get_record(struct morse
 								    u8 bw_mhz)
 {
 	struct morse_channel_survey *survey = mors->channel_survey;
-	int i;
+	struct morse_survey_rx_usage_record *record;
 
 	if (!survey || freq_hz == 0 || bw_mhz == 0)
 		return NULL;
 
-	for (i = 0; i < survey->num_records; i++) {
-		if (freq_hz == survey->records[i].freq_hz && bw_mhz == survey->records[i].bw_mhz)
-			return &survey->records[i];
-		else if (survey->records[i].freq_hz == 0)
-			break;
-	}
-	return NULL;
+	record = morse_survey_find_record(survey, freq_hz, bw_mhz);
+	if (!record || record->freq_hz == 0)
+		return NULL;
+
+	return record;
 }
 
 int morse_mac_traffic_control(struct morse *mors, int interface_id,
@@ -2295,18 +3131,21 @@ int morse_mac_traffic_control(struct morse *mors, int interface_id,
 {
 	int ret = -1;
 	unsigned long *event_flags = &mors->chip_if->event_flags;
-	struct morse_vif *mors_vif;
 	bool sources_includes_twt = (sources & UMAC_TRAFFIC_CONTROL_SOURCE_TWT);
-	struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, interface_id);
+	struct ieee80211_vif *vif;
+	bool twt_requester;
+
+	rcu_read_lock();
+	vif = morse_get_vif_from_vif_id(mors, interface_id);
+	twt_requester = vif && ieee80211_vif_to_morse_vif(vif)->twt.requester;
+	rcu_read_unlock();
 
 	if (!vif) {
 		MORSE_WARN_ON(FEATURE_ID_DEFAULT, 1);
 		goto exit;
 	}
 
-	mors_vif = ieee80211_vif_to_morse_vif(vif);
-
-	if (!mors_vif->twt.requester && sources_includes_twt) {
+	if (!twt_requester && sources_includes_twt) {
 		/* TWT not supported.. LMAC should not be signalling traffic control */
 		WARN_ONCE(1, "TWT not supported on interface\n");
 		goto exit;
@@ -2314,12 +3153,12 @@ int morse_mac_traffic_control(struct morse *mors, int interface_id,
 
 	if (pause_data_traffic) {
 		set_bit(MORSE_DATA_TRAFFIC_PAUSE_PEND, event_flags);
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+		morse_hw_chip_if_queue_work(mors);
 		if (sources_includes_twt)
 			morse_watchdog_pause(mors);
 	} else {
 		set_bit(MORSE_DATA_TRAFFIC_RESUME_PEND, event_flags);
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+		morse_hw_chip_if_queue_work(mors);
 		if (sources_includes_twt)
 			morse_watchdog_resume(mors);
 	}
@@ -2331,7 +3170,7 @@ exit:
 
 static int morse_mac_driver_restart(struct morse *mors)
 {
-	schedule_work(&mors->driver_restart);
+	queue_work(system_long_wq, &mors->driver_restart);
 	MORSE_INFO(mors, "Scheduled a driver reset ...\n");
 	set_bit(MORSE_STATE_FLAG_CHIP_UNRESPONSIVE, &mors->state_flags);
 
@@ -2441,7 +3280,7 @@ static int morse_mac_ops_start(struct ieee80211_hw *hw)
 
 	/* Read and print FW version */
 	morse_cmd_get_version(mors);
-	mors->mon_if.id = 0XFFFF;
+	mors->mon_if_id = 0xFFFF;
 	mors->started = true;
 
 	/* cfg80211 will consider a channel to be unusable if any sub-channel is disabled */
@@ -2453,6 +3292,23 @@ static int morse_mac_ops_start(struct ieee80211_hw *hw)
 	return 0;
 }
 
+/* Finish a bulk restore started by morse_mac_restart(), and let data through again */
+static void morse_mac_restore_end(struct morse *mors, bool replay)
+{
+	lockdep_assert_held(&mors->lock);
+
+	if (!mors->cmd_restore.active)
+		return;
+
+	if (replay)
+		morse_cmd_restore_flush(mors);
+	else
+		morse_cmd_restore_discard(mors);
+
+	morse_skbq_data_traffic_resume(mors);
+	morse_hw_chip_if_queue_work(mors);
+}
+
 #if KERNEL_VERSION(6, 11, 0) > MAC80211_VERSION_CODE
 static void morse_mac_ops_stop(struct ieee80211_hw *hw)
 #else
@@ -2460,16 +3316,16 @@ static void morse_mac_ops_stop(struct ieee80211_hw *hw, bool suspend)
 #endif
 {
 	struct morse *mors = hw->priv;
-	struct morse_vif *mon_if = &mors->mon_if;
 
 	mutex_lock(&mors->lock);
 	/* Make sure we stop any monitor interfaces */
-	if (mon_if->id != 0xFFFF) {
-		morse_cmd_rm_if(mors, mon_if->id);
-		mon_if->id = 0xFFFF;
+	if (mors->mon_if_id != 0xFFFF) {
+		morse_cmd_rm_if(mors, mors->mon_if_id);
+		mors->mon_if_id = 0xFFFF;
 		MORSE_INFO(mors, "monitor interfaced removed\n");
 	}
 	mors->started = false;
+	morse_mac_restore_end(mors, false);
 	mutex_unlock(&mors->lock);
 }
 
@@ -2497,7 +3353,8 @@ morse_mac_reset_s1g_bcn_change_seq_params(struct ieee80211_hw *hw, struct ieee80
 
 static void morse_mac_reset_sta_backup(struct morse *mors, struct morse_vif *mors_vif)
 {
-	memset(mors_vif->sta_backups, 0, sizeof(mors_vif->sta_backups));
+	kfree(mors_vif->sta_backups);
+	mors_vif->sta_backups = NULL;
 
 	MORSE_DBG(mors, "STA backup entries cleared\n");
 }
@@ -2508,7 +3365,17 @@ morse_mac_save_sta_backup(struct morse *mors, struct morse_vif *mors_vif,
 {
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(mors_vif->sta_backups); i++) {
+	/* Backups are only needed once a station reassociates, so allocate them then */
+	if (!mors_vif->sta_backups) {
+		mors_vif->sta_backups = kcalloc(STA_PRIV_BACKUP_NUM,
+						sizeof(*mors_vif->sta_backups), GFP_KERNEL);
+		if (!mors_vif->sta_backups) {
+			MORSE_WARN(mors, "No memory for STA backup\n");
+			return;
+		}
+	}
+
+	for (i = 0; i < STA_PRIV_BACKUP_NUM; i++) {
 		if (!mors_vif->sta_backups[i].already_assoc_req ||
 		    time_after(jiffies, mors_vif->sta_backups[i].timeout)) {
 			MORSE_DBG(mors, "Storing STA backup (slot %d) for %pM\n",
@@ -2528,12 +3395,14 @@ morse_mac_restore_sta_backup(struct morse *mors, struct morse_vif *mors_vif,
 {
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(mors_vif->sta_backups); i++) {
+	for (i = 0; mors_vif->sta_backups && i < STA_PRIV_BACKUP_NUM; i++) {
 		if (mors_vif->sta_backups[i].already_assoc_req &&
 		    ether_addr_equal_unaligned(mors_vif->sta_backups[i].addr, addr)) {
 			MORSE_INFO(mors, "Retrieving STA backup (slot %d) for %pM\n",
 				   i, mors_sta->addr);
 			memcpy(mors_sta, &mors_vif->sta_backups[i], sizeof(*mors_sta));
+			/* BA sessions were given back when the station left */
+			mors_sta->ba_tx_reserved = 0;
 			memset(&mors_vif->sta_backups[i], 0, sizeof(mors_vif->sta_backups[i]));
 			return;
 		}
@@ -2642,6 +3511,48 @@ static bool morse_mac_ecsa_finish_channel_switch(struct morse *mors)
 	}
 }
 
+/* Start timing the outage of an ECSA switch, see &struct morse_ecsa_stats */
+static void morse_mac_ecsa_outage_begin(struct morse *mors)
+{
+	atomic64_set(&mors->debug.ecsa_stats.start_ns, ktime_get_ns());
+}
+
+/* The first beacon on the new channel has been seen, so the switch is complete */
+static void morse_mac_ecsa_outage_end(struct morse *mors)
+{
+	struct morse_ecsa_stats *stats = &mors->debug.ecsa_stats;
+	u64 start_ns = atomic64_xchg(&stats->start_ns, 0);
+	u32 outage_us;
+
+	if (!start_ns)
+		return;
+
+	outage_us = (u32)min_t(u64, div_u64(ktime_get_ns() - start_ns, NSEC_PER_USEC), U32_MAX);
+	stats->switches++;
+	stats->last_outage_us = outage_us;
+	stats->max_outage_us = max(stats->max_outage_us, outage_us);
+	stats->total_outage_us += outage_us;
+
+	MORSE_ECSA_INFO(mors, "%s: channel switch outage %u us\n", __func__, outage_us);
+}
+
+/* Whether any interface is in the middle of a channel switch */
+static bool morse_mac_csa_in_progress(struct morse *mors)
+{
+	struct ieee80211_vif *vif;
+	bool active = false;
+	int vif_id;
+
+	rcu_read_lock();
+	for (vif_id = 0; vif_id < mors->max_vifs && !active; vif_id++) {
+		vif = morse_get_vif_from_vif_id(mors, vif_id);
+		active = vif && morse_mac_is_csa_active(vif);
+	}
+	rcu_read_unlock();
+
+	return active;
+}
+
 /* Update the ecsa channel config in mors_vif and mors channel info */
 static void morse_mac_ecsa_update_bss_chan_info(struct morse_vif *mors_vif)
 {
@@ -2671,9 +3582,9 @@ static void morse_mac_ecsa_update_bss_chan_info(struct morse_vif *mors_vif)
 /*
  * API to verify if we are switching to new channel as part of ECSA and update
  * the ECSA channel info in mors and mors_vif data structures.
- * It also configures scan state in the firmware to postpone the PHY calibration
- * so that AP can switch to new channel within beacon interval. Otherwise
- * channel change is taking 230 - 440msecs due to PHY DC calibration.
+ * The caller is expected to change channel with the scan state configured in the firmware
+ * to postpone the PHY calibration so that AP can switch to new channel within beacon
+ * interval. Otherwise channel change is taking 230 - 440msecs due to PHY DC calibration.
  * PHY calibration is not performed during scan.
  */
 static bool morse_mac_ecsa_channel_switch_in_progress(struct morse *mors, u32 freq_hz, u8 op_bw_mhz,
@@ -2681,11 +3592,11 @@ static bool morse_mac_ecsa_channel_switch_in_progress(struct morse *mors, u32 fr
 {
 	struct ieee80211_vif *vif;
 	struct morse_vif *mors_vif;
-	bool scan_configured = false;
+	bool ecsa_switch = false;
 	u16 if_idx;
 
 	for (if_idx = 0; if_idx < mors->max_vifs; if_idx++) {
-		vif = morse_get_vif_from_vif_id(mors, if_idx);
+		vif = __morse_get_vif_from_vif_id(mors, if_idx);
 
 		if (!vif || !morse_mac_is_csa_active(vif) ||
 		    (vif->type != NL80211_IFTYPE_AP && vif->type != NL80211_IFTYPE_STATION))
@@ -2729,7 +3640,8 @@ static bool morse_mac_ecsa_channel_switch_in_progress(struct morse *mors, u32 fr
 			 * mac80211 to unblock the traffic, if it has blocked during start of the
 			 * ECSA.
 			 */
-			scan_configured = morse_mac_ecsa_begin_channel_switch(mors);
+			ecsa_switch = true;
+			morse_mac_ecsa_outage_begin(mors);
 
 			mors_vif->ecsa_chan_configured = true;
 
@@ -2739,7 +3651,7 @@ static bool morse_mac_ecsa_channel_switch_in_progress(struct morse *mors, u32 fr
 				   mors_vif->s1g_bcn_change_seq);
 		}
 	}
-	return scan_configured;
+	return ecsa_switch;
 }
 
 static bool country_codes_are_equal(const char *cc1, const char *cc2)
@@ -2762,7 +3674,7 @@ static void morse_mcast_tx_rate_eval_work(struct work_struct *work)
 		   mors_vif->mcast_tx_rate.guard);
 
 	schedule_delayed_work(&mors_vif->mcast_tx_rate_work,
-		msecs_to_jiffies(MULTICAST_TX_RATE_EVAL_WORK_PERIOD_MS));
+		msecs_to_jiffies(max_t(uint, mcast_rate_eval_period_ms, 100)));
 }
 
 static int morse_mac_ops_add_interface(struct ieee80211_hw *hw, struct ieee80211_vif *vif)
@@ -2795,6 +3707,7 @@ static int morse_mac_ops_add_interface(struct ieee80211_hw *hw, struct ieee80211
 	}
 
 	morse_vendor_ie_init_interface(mors_vif);
+	morse_offload_keep_alive_init(mors_vif);
 
 	if (mors_vif->id >= mors->max_vifs) {
 		MORSE_ERR(mors, "vif_id is too large %u\n", mors_vif->id);
@@ -2836,6 +3749,15 @@ static int morse_mac_ops_add_interface(struct ieee80211_hw *hw, struct ieee80211
 			goto exit;
 		}
 
+		mors_vif->ap->sta_by_aid = kcalloc(MORSE_AP_AID_BITMAP_SIZE,
+						   sizeof(*mors_vif->ap->sta_by_aid), GFP_KERNEL);
+		if (!mors_vif->ap->sta_by_aid) {
+			kfree(mors_vif->ap);
+			mors_vif->ap = NULL;
+			ret = -ENOMEM;
+			goto exit;
+		}
+
 		if (mors->cfg->enable_short_bcn_as_dtim && enable_page_slicing) {
 			MORSE_ERR(mors,
 				  "%s: short dtim beacon can't be enabled while page slicing is enabled, disabling short dtim beacon",
@@ -2878,8 +3800,9 @@ static int morse_mac_ops_add_interface(struct ieee80211_hw *hw, struct ieee80211
 			INIT_DELAYED_WORK(&mors_vif->mcast_tx_rate_work,
 				morse_mcast_tx_rate_eval_work);
 			mors_vif->mcast_tx_rate_throughput = 0;
+			mors_vif->mcast_tx_rate_raise_evals = 0;
 			schedule_delayed_work(&mors_vif->mcast_tx_rate_work,
-				msecs_to_jiffies(MULTICAST_TX_RATE_EVAL_WORK_PERIOD_MS));
+				msecs_to_jiffies(max_t(uint, mcast_rate_eval_period_ms, 100)));
 		}
 
 		morse_pre_assoc_peer_list_vif_take(mors);
@@ -3062,6 +3985,7 @@ static void morse_mac_ops_remove_interface(struct ieee80211_hw *hw, struct ieee8
 			morse_raw_finish(mors_vif);
 
 		morse_pre_assoc_peer_list_vif_release(mors);
+		kfree(mors_vif->ap->sta_by_aid);
 		kfree(mors_vif->ap);
 		mors_vif->ap = NULL;
 	}
@@ -3089,6 +4013,8 @@ static void morse_mac_ops_remove_interface(struct ieee80211_hw *hw, struct ieee8
 		morse_pv1_finish_vif(mors_vif);
 
 	morse_vendor_ie_deinit_interface(mors_vif);
+	morse_offload_keep_alive_finish(mors_vif);
+	morse_mac_reset_sta_backup(mors, mors_vif);
 
 	ret = morse_cmd_rm_if(mors, mors_vif->id);
 	if (ret) {
@@ -3107,7 +4033,7 @@ static void morse_mac_ops_remove_interface(struct ieee80211_hw *hw, struct ieee8
 	if (vif->type == NL80211_IFTYPE_STATION &&
 	    test_bit(MORSE_STATE_FLAG_DATA_TX_STOPPED, &mors->state_flags)) {
 		set_bit(MORSE_DATA_TRAFFIC_RESUME_PEND, &mors->chip_if->event_flags);
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+		morse_hw_chip_if_queue_work(mors);
 	}
 
 	MORSE_INFO(mors, "%s: [id:%d %s]\n", __func__,
@@ -3214,8 +4140,10 @@ static int morse_mac_change_channel(struct ieee80211_hw *hw)
 	struct morse_channel_info info;
 	int ret = 0;
 	bool scan_configured = false;
+	bool ecsa_switch;
 	const struct morse_dot11ah_channel *chan_s1g;
 	const struct morse_reg_rule *mors_reg_rule;
+	const struct morse_reg_rule *prev_reg_rule;
 	u32 freq_hz;
 	u8 op_bw_mhz;
 	u8 pri_1mhz_chan_idx = mors->custom_configs.default_bw_info.pri_1mhz_chan_idx;
@@ -3244,7 +4172,7 @@ static int morse_mac_change_channel(struct ieee80211_hw *hw)
 	/* Update primary channel info based on BSS only if no AP interfaces */
 	if (!have_ap) {
 		for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
-			struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
+			struct ieee80211_vif *vif = __morse_get_vif_from_vif_id(mors, vif_id);
 
 			if (mors->in_scan) {
 				/* SW-2278 For interop:
@@ -3286,9 +4214,14 @@ static int morse_mac_change_channel(struct ieee80211_hw *hw)
 			}
 		}
 	}
-	scan_configured = morse_mac_ecsa_channel_switch_in_progress(mors, freq_hz, op_bw_mhz,
-									&pri_bw_mhz,
-									&pri_1mhz_chan_idx);
+	/* Rule of the channel being left, before an ECSA switch overwrites the channel info */
+	prev_reg_rule = morse_dot11ah_channel_get_reg_rule(morse_dot11ah_s1g_freq_to_s1g
+		(mors->custom_configs.channel_info.op_chan_freq_hz,
+		 mors->custom_configs.channel_info.op_bw_mhz));
+
+	ecsa_switch = morse_mac_ecsa_channel_switch_in_progress(mors, freq_hz, op_bw_mhz,
+								&pri_bw_mhz,
+								&pri_1mhz_chan_idx);
 
 	/* Final sanity check:
 	 * pri_bw_mhz is either 1MHZ or 2MHZ
@@ -3303,8 +4236,20 @@ static int morse_mac_change_channel(struct ieee80211_hw *hw)
 
 	mors->channel_num_80211n = conf->chandef.chan->hw_value;
 
-	ret = morse_mac_set_channel(mors, freq_hz, pri_1mhz_chan_idx, op_bw_mhz, pri_bw_mhz,
-				    false, __func__);
+	if (ecsa_switch && enable_ecsa_fast_switch) {
+		/* The scan configuration goes with the channel, in one round trip */
+		ret = morse_cmd_set_channel_no_cal(mors, freq_hz, pri_1mhz_chan_idx, op_bw_mhz,
+						   pri_bw_mhz, &mors->tx_power_mbm);
+		if (ret)
+			MORSE_ERR(mors, "%s: morse_cmd_set_channel_no_cal() failed, ret %d\n",
+				  __func__, ret);
+	} else {
+		if (ecsa_switch)
+			scan_configured = morse_mac_ecsa_begin_channel_switch(mors);
+
+		ret = morse_mac_set_channel(mors, freq_hz, pri_1mhz_chan_idx, op_bw_mhz,
+					    pri_bw_mhz, false, __func__);
+	}
 
 	if (ret == MORSE_RET_EPERM) {
 		MORSE_ERR(mors,
@@ -3343,10 +4288,13 @@ static int morse_mac_change_channel(struct ieee80211_hw *hw)
 		morse_mac_set_txpower(mors, chan_s1g->ch.max_reg_power);
 	}
 
-	mors_reg_rule = morse_regdom_get_rule_for_freq(region,
-							ieee80211_channel_to_khz
-							(&chan_s1g->ch));
-	if (mors_reg_rule) {
+	mors_reg_rule = morse_dot11ah_channel_get_reg_rule(chan_s1g);
+	if (mors_reg_rule && ecsa_switch && enable_ecsa_fast_switch &&
+	    mors_reg_rule == prev_reg_rule) {
+		/* Duty cycle and MPSW are set from the rule, which the switch has not changed */
+		MORSE_ECSA_INFO(mors, "%s: reg rule unchanged, duty cycle and mpsw kept\n",
+				__func__);
+	} else if (mors_reg_rule) {
 		if (enable_auto_duty_cycle)
 			ret = set_duty_cycle(mors, mors_reg_rule, have_ap);
 		if (!ret && enable_auto_mpsw) {
@@ -3385,23 +4333,23 @@ static int morse_mac_ops_config(struct ieee80211_hw *hw, u32 changed)
 
 	if (changed & IEEE80211_CONF_CHANGE_MONITOR) {
 		int ret = 0;
-		struct morse_vif *mon_if = &mors->mon_if;
 
 		MORSE_DBG(mors, "%s: change monitor mode: %s\n",
 			  __func__, conf->flags & IEEE80211_CONF_MONITOR ? "true" : "false");
 		if (conf->flags & IEEE80211_CONF_MONITOR) {
 			ret = morse_cmd_add_if(mors,
-					       &mon_if->id, mors->macaddr, NL80211_IFTYPE_MONITOR);
+					       &mors->mon_if_id, mors->macaddr,
+					       NL80211_IFTYPE_MONITOR);
 			if (ret)
 				MORSE_ERR(mors, "monitor interface add failed %d\n", ret);
 			else
-				MORSE_INFO(mors, "monitor interfaced added %d\n", mon_if->id);
+				MORSE_INFO(mors, "monitor interfaced added %d\n", mors->mon_if_id);
 		} else {
-			if (mon_if->id != 0xFFFF) {
-				morse_cmd_rm_if(mors, mon_if->id);
+			if (mors->mon_if_id != 0xFFFF) {
+				morse_cmd_rm_if(mors, mors->mon_if_id);
 				MORSE_INFO(mors, "monitor interfaced removed\n");
 			}
-			mon_if->id = 0xFFFF;
+			mors->mon_if_id = 0xFFFF;
 		}
 	}
 
@@ -3509,6 +4457,9 @@ morse_mac_ops_bss_info_changed(struct ieee80211_hw *hw,
 
 	mutex_lock(&mors->lock);
 
+	/* Anything reported here may change how the S1G beacon is built */
+	morse_beacon_template_invalidate(mors_vif);
+
 	if (changed & BSS_CHANGED_PS)
 		morse_mac_config_ps(mors, vif);
 
@@ -3529,6 +4480,8 @@ morse_mac_ops_bss_info_changed(struct ieee80211_hw *hw,
 			morse_cmd_config_beacon_timer(mors, mors_vif, bss_conf->enable_beacon);
 		}
 		mors_vif->beaconing_enabled = true;
+		if (bss_conf->enable_beacon)
+			morse_boot_phase_end(mors, MORSE_BOOT_PHASE_FIRST_LINK, 0);
 	}
 
 	if (changed & BSS_CHANGED_BANDWIDTH) {
@@ -3601,6 +4554,8 @@ morse_mac_ops_bss_info_changed(struct ieee80211_hw *hw,
 	 */
 	if (vif->type == NL80211_IFTYPE_STATION && changed & BSS_CHANGED_ASSOC && bss_conf) {
 		mors_vif->is_sta_assoc = morse_mac_is_sta_vif_associated(vif);
+		if (mors_vif->is_sta_assoc)
+			morse_boot_phase_end(mors, MORSE_BOOT_PHASE_FIRST_LINK, 0);
 
 		/* Request for new template buffer only on new association */
 		if (enable_bcn_change_seq_monitor && mors_vif->is_sta_assoc) {
@@ -3622,18 +4577,26 @@ morse_mac_ops_bss_info_changed(struct ieee80211_hw *hw,
 	 * table. ARP requests addressed to the first IP of this table will NEVER make their way
 	 * to Linux, instead having the response generated and transmitted in FW.
 	 * The other IPs in this table will behave as mac80211 expects and will be allowed to pass.
+	 * The firmware has no equivalent for IPv6 neighbour solicitations; those addressed to
+	 * other nodes are kept off the bus by the multicast filter (see enable_mcast_whitelist).
 	 */
 	if (changed & BSS_CHANGED_ARP_FILTER &&
 	    vif->type == NL80211_IFTYPE_STATION &&
-	    mors_vif->custom_configs->enable_arp_offload)
-		morse_cmd_arp_offload_update_ip_table(mors, mors_vif->id,
+	    mors_vif->custom_configs->enable_arp_offload) {
+		int ret = morse_cmd_arp_offload_update_ip_table(mors, mors_vif->id,
 #if KERNEL_VERSION(6, 0, 0) > MAC80211_VERSION_CODE
-						      info->arp_addr_cnt, info->arp_addr_list);
+								info->arp_addr_cnt,
+								info->arp_addr_list);
 #else
-						      vif->cfg.arp_addr_cnt,
-						      vif->cfg.arp_addr_list);
+								vif->cfg.arp_addr_cnt,
+								vif->cfg.arp_addr_list);
 #endif
 
+		/* ARP requests will keep waking the host until the next address change */
+		if (ret)
+			MORSE_ERR(mors, "%s: ARP offload update failed: %d\n", __func__, ret);
+	}
+
 	mutex_unlock(&mors->lock);
 }
 
@@ -3734,7 +4697,7 @@ morse_mac_ops_configure_filter(struct ieee80211_hw *hw,
 	mors->mcast_filter = cmd;
 
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
-		vif = morse_get_vif_from_vif_id(mors, vif_id);
+		vif = __morse_get_vif_from_vif_id(mors, vif_id);
 		if (vif && vif->type != NL80211_IFTYPE_MONITOR) {
 			mors_vif = ieee80211_vif_to_morse_vif(vif);
 
@@ -3901,34 +4864,22 @@ static void morse_mac_save_ecsa_chan_info(struct morse *mors, struct morse_vif *
 		   ecsa_ie_info->count);
 }
 
-void morse_mac_process_ecsa_ie(struct morse *mors, struct ieee80211_vif *vif, struct sk_buff *skb)
+void morse_mac_process_ecsa_ie(struct morse *mors, struct ieee80211_vif *vif,
+			       const struct dot11ah_ies_mask *ies_mask)
 {
-	struct morse_vif *mors_vif;
-	struct ieee80211_ext *s1g_beacon = (struct ieee80211_ext *)skb->data;
-	const u8 *ie;
-	u8 *s1g_ies = s1g_beacon->u.s1g_beacon.variable;
-	int header_length = s1g_ies - skb->data;
-	int s1g_ies_len = skb->len - header_length;
-
-	mors_vif = ieee80211_vif_to_morse_vif(vif);
-
-	if (s1g_beacon->frame_control & IEEE80211_FC_ANO) {
-		s1g_ies += 1;
-		s1g_ies_len -= 1;
-	}
-
-	ie = cfg80211_find_ie(WLAN_EID_EXT_CHANSWITCH_ANN, s1g_ies, s1g_ies_len);
+	struct morse_vif *mors_vif = ieee80211_vif_to_morse_vif(vif);
+	const struct ie_element *ecsa = &ies_mask->ies[WLAN_EID_EXT_CHANSWITCH_ANN];
+	const struct ie_element *wrapper = &ies_mask->ies[WLAN_EID_CHANNEL_SWITCH_WRAPPER];
 
 	/* Process ECSA Info only once by checking operating channel */
-	if (ie && !mors_vif->ecsa_channel_info.op_chan_freq_hz) {
+	if (ecsa->ptr && ecsa->len >= sizeof(struct ieee80211_ext_chansw_ie) &&
+	    !mors_vif->ecsa_channel_info.op_chan_freq_hz) {
 		struct ieee80211_ext_chansw_ie *ecsa_ie_info =
-		    (struct ieee80211_ext_chansw_ie *)(ie + 2);
+		    (struct ieee80211_ext_chansw_ie *)ecsa->ptr;
 
-		ie = cfg80211_find_ie(WLAN_EID_CHANNEL_SWITCH_WRAPPER, s1g_ies, s1g_ies_len);
-
-		if (ie)
-			morse_mac_save_ecsa_chan_info(mors, mors_vif, ecsa_ie_info, (ie + 2),
-						      ie[1]);
+		if (wrapper->ptr)
+			morse_mac_save_ecsa_chan_info(mors, mors_vif, ecsa_ie_info, wrapper->ptr,
+						      wrapper->len);
 		else
 			morse_mac_save_ecsa_chan_info(mors, mors_vif, ecsa_ie_info, NULL, 0);
 	}
@@ -4058,6 +5009,14 @@ static inline void morse_aid_bitmap_update(struct morse_ap *mors_ap)
 	mors_ap->largest_aid = largest_aid;
 }
 
+struct morse_sta *morse_mac_find_sta_by_aid(struct morse_vif *mors_vif, u16 aid)
+{
+	if (!mors_vif->ap || aid >= MORSE_AP_AID_BITMAP_SIZE)
+		return NULL;
+
+	return rcu_dereference(mors_vif->ap->sta_by_aid[aid]);
+}
+
 /*
  * This function updates remote peer capabilities using the custom config
  * based on the assumption that all nodes in the IBSS network have similar capabilities.
@@ -4139,6 +5098,7 @@ void morse_mac_update_ibss_node_capabilities(struct ieee80211_hw *hw,
 		mors_sta->ampdu_supported = true;
 	else
 		mors_sta->ampdu_supported = false;
+	mors_sta->amsdu_supported = !!(s1g_caps->capab_info[5] & S1G_CAP5_AMSDU);
 
 	ht_cap->ampdu_factor = (s1g_caps->capab_info[3] >> 3) & 0x3;
 	ht_cap->ampdu_density = (s1g_caps->capab_info[3] >> 5) & 0x7;
@@ -4240,6 +5200,14 @@ morse_mac_ops_sta_state(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 	mors_vif = (struct morse_vif *)vif->drv_priv;
 	mors_sta = (struct morse_sta *)sta->drv_priv;
 
+	if (old_state == IEEE80211_STA_NOTEXIST && new_state == IEEE80211_STA_NONE) {
+		/* As mac80211 does, start the sequence caches on a value no frame can carry */
+		memset(mors_sta->rx_last_seq_ctrl, 0xff, sizeof(mors_sta->rx_last_seq_ctrl));
+#ifdef CONFIG_MORSE_RC
+		morse_rc_sta_init(sta);
+#endif
+	}
+
 	/* Ignore both NOTEXIST to NONE and NONE to NOTEXIST */
 	if ((old_state == IEEE80211_STA_NOTEXIST && new_state == IEEE80211_STA_NONE) ||
 	    (old_state == IEEE80211_STA_NONE && new_state == IEEE80211_STA_NOTEXIST))
@@ -4301,6 +5269,7 @@ morse_mac_ops_sta_state(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 		int i;
 
 		for (i = 0; i < IEEE80211_NUM_TIDS; i++) {
+			morse_aggr_release(mors_vif, mors_sta, i);
 			mors_sta->tid_start_tx[i] = false;
 			mors_sta->tid_tx[i] = false;
 		}
@@ -4356,7 +5325,10 @@ morse_mac_ops_sta_state(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 			} else {
 				mors_vif->ap->num_stas++;
 				list_add(&mors_sta->list, &mors_vif->ap->stas);
+				rcu_assign_pointer(mors_vif->ap->sta_by_aid[aid], mors_sta);
 				morse_pre_assoc_peer_delete(mors, sta->addr);
+				if (vif->type == NL80211_IFTYPE_AP)
+					morse_raw_add_aid(mors_vif, aid);
 			}
 
 			morse_aid_bitmap_update(mors_vif->ap);
@@ -4393,6 +5365,9 @@ morse_mac_ops_sta_state(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 			if (test_and_clear_bit(aid, mors_vif->ap->aid_bitmap)) {
 				mors_vif->ap->num_stas--;
 				list_del_init(&mors_sta->list);
+				RCU_INIT_POINTER(mors_vif->ap->sta_by_aid[aid], NULL);
+				if (vif->type == NL80211_IFTYPE_AP)
+					morse_raw_remove_aid(mors_vif, aid);
 			} else {
 				MORSE_WARN(mors,
 					   "Non-existent station disassociated with AID %d\n",
@@ -4538,6 +5513,7 @@ morse_mac_ops_ampdu_action(struct ieee80211_hw *hw,
 	case IEEE80211_AMPDU_TX_STOP_FLUSH:
 	case IEEE80211_AMPDU_TX_STOP_FLUSH_CONT:
 		MORSE_INFO(mors, "%s %pM.%d A-MPDU TX flush\n", __func__, mors_sta->addr, tid);
+		morse_aggr_release(mors_vif, mors_sta, tid);
 		mors_sta->tid_start_tx[tid] = false;
 		mors_sta->tid_tx[tid] = false;
 		mors_sta->tid_params[tid] = 0;
@@ -4662,6 +5638,7 @@ morse_mac_ops_set_key(struct ieee80211_hw *hw,
 	} else if (sta && key->flags & IEEE80211_KEY_FLAG_PAIRWISE) {
 		mors_sta = (struct morse_sta *)sta->drv_priv;
 		mors_sta->last_rx_mgmt_pn = 0;
+		memset(mors_sta->rx_pn, 0, sizeof(mors_sta->rx_pn));
 	}
 
 exit:
@@ -4675,11 +5652,86 @@ static void morse_mac_ops_rfkill_poll(struct ieee80211_hw *hw)
 	(void)mors;
 }
 
+/**
+ * morse_mac_flush_can_drain() - Check whether queued data frames can still reach the chip
+ *
+ * @mors: Morse context
+ *
+ * Return: false if TX to the chip is stopped, in which case waiting for a flush is pointless
+ */
+static bool morse_mac_flush_can_drain(struct morse *mors)
+{
+	return !test_bit(MORSE_STATE_FLAG_CHIP_UNRESPONSIVE, &mors->state_flags) &&
+	       !test_bit(MORSE_STATE_FLAG_DATA_TX_STOPPED, &mors->state_flags) &&
+	       !test_bit(MORSE_STATE_FLAG_HOST_TO_CHIP_TX_BLOCKED, &mors->state_flags);
+}
+
 static void morse_mac_ops_flush(struct ieee80211_hw *hw,
 				struct ieee80211_vif *vif, u32 queues, bool drop)
 {
 	struct morse *mors = hw->priv;
-	(void)mors;
+	struct morse_skbq *qs[IEEE80211_NUM_ACS];
+	unsigned long timeout;
+	int num_qs = 0;
+	int dropped = 0;
+	bool busy;
+	int i;
+
+	if (!mors->started || is_fullmac_mode())
+		return;
+
+	/*
+	 * Frames queued across a channel switch are for the same BSS, so leave them to go out
+	 * on the new channel rather than holding up the switch.
+	 */
+	if (!drop && enable_ecsa_fast_switch && morse_mac_csa_in_progress(mors))
+		return;
+
+	/* The data queues are shared by all interfaces, so flush them whatever @vif is */
+	for (i = 0; i < IEEE80211_NUM_ACS; i++) {
+		struct morse_skbq *mq;
+
+		if (!(queues & BIT(i)))
+			continue;
+
+		mq = morse_chip_if_tc_q_from_aci(mors, map_mac80211q_2_morse_aci(i));
+		if (mq)
+			qs[num_qs++] = mq;
+	}
+
+	if (!num_qs)
+		return;
+
+	if (!drop && morse_mac_flush_can_drain(mors)) {
+		morse_skbq_data_tx_kick(mors);
+
+		/* Wait for the chip to take the queued frames and report their status */
+		timeout = jiffies + msecs_to_jiffies(flush_timeout_ms);
+		do {
+			busy = false;
+			for (i = 0; i < num_qs && !busy; i++)
+				busy = morse_skbq_count(qs[i]) || morse_skbq_pending_count(qs[i]);
+
+			if (!busy || !morse_mac_flush_can_drain(mors))
+				break;
+
+			usleep_range(500, 1000);
+		} while (time_before(jiffies, timeout));
+	}
+
+	/*
+	 * Whatever is still queued would otherwise go out late, possibly on another channel.
+	 * Unless asked to drop, frames the chip already holds are left for their TX status, or
+	 * the stale TX status timeout, since the chip may still send them.
+	 */
+	for (i = 0; i < num_qs; i++)
+		dropped += drop ? morse_skbq_tx_flush(qs[i]) : morse_skbq_tx_flush_queued(qs[i]);
+
+	if (dropped) {
+		MORSE_DBG(mors, "%s: dropped %d frames (queues 0x%x, drop %d)\n",
+			  __func__, dropped, queues, drop);
+		morse_skbq_may_wake_tx_queues(mors);
+	}
 }
 
 static u64 morse_mac_ops_get_tsf(struct ieee80211_hw *hw, struct ieee80211_vif *vif)
@@ -4858,6 +5910,10 @@ static void morse_mac_reconfig_complete(struct ieee80211_hw *hw,
 	if (reconfig_type != IEEE80211_RECONFIG_TYPE_RESTART)
 		return;
 
+	mutex_lock(&mors->lock);
+	morse_mac_restore_end(mors, true);
+	mutex_unlock(&mors->lock);
+
 	if (mesh_vif) {
 		int ret;
 		struct morse_vif *mors_vif = ieee80211_vif_to_morse_vif(mesh_vif);
@@ -4922,21 +5978,9 @@ morse_sta_tx_rate_stats(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 static u32 morse_get_expected_throughput(struct ieee80211_hw *hw, struct ieee80211_sta *sta)
 {
 	struct morse_sta *msta = (struct morse_sta *)sta->drv_priv;
-	struct morse *mors = hw->priv;
-	const struct mmrc_table *tb = msta->rc.tb;
-	struct mmrc_rate rate;
-	u32 tput;
-
-	if (!tb || tb->best_tp.rate == MMRC_MCS_UNUSED)
-		return 0;
 
-	rate = tb->best_tp;
-	tput = BPS_TO_KBPS(mmrc_calculate_theoretical_throughput(rate));
-	morse_dbg(FEATURE_ID_RATECONTROL, mors,
-		"%s: Throughput: MCS: %d, BW: %d, GI: %d -> %u\n",
-		__func__, rate.rate, 1 << rate.bw, rate.guard, tput);
-
-	return tput;
+	/* Queried often by the airtime and mesh path metric code, so refreshed by rate control */
+	return morse_rc_sta_expected_throughput(msta);
 }
 #endif
 
@@ -5118,6 +6162,9 @@ morse_mac_rx_status(struct morse *mors,
 			memcpy(status, hdr_rx_status, sizeof(*status));
 			msta->avg_rssi = msta->avg_rssi ?
 			    CALC_AVG_RSSI(msta->avg_rssi, rx_status->signal) : rx_status->signal;
+
+			if (vif->type == NL80211_IFTYPE_AP)
+				morse_raw_note_activity(ieee80211_vif_to_morse_vif(vif), sta->aid);
 		}
 		rcu_read_unlock();
 
@@ -5199,7 +6246,7 @@ int morse_mac_tx_mgmt_frame(struct ieee80211_vif *vif, struct sk_buff *skb)
 	info = IEEE80211_SKB_CB(skb);
 	info->control.vif = vif;
 
-	mq = mors->cfg->ops->skbq_mgmt_tc_q(mors);
+	mq = morse_chip_if_mgmt_tc_q(mors);
 	if (!mq)
 		return -1;
 
@@ -5341,6 +6388,7 @@ void morse_mac_ecsa_beacon_tx_done(struct morse *mors, struct sk_buff *skb)
 		 */
 		MORSE_INFO(mors, "%s: Configure ECSA Chan ts=%ld, to=%ld\n",
 			   __func__, jiffies, timeout);
+		morse_mac_ecsa_outage_end(mors);
 		schedule_delayed_work(&mors_vif->ecsa_chswitch_work, timeout);
 		mors_vif->ecsa_chan_configured = false;
 		/* Reset channel info */
@@ -5349,22 +6397,204 @@ void morse_mac_ecsa_beacon_tx_done(struct morse *mors, struct sk_buff *skb)
 	}
 }
 
-static void morse_mac_process_bcn_change_seq_tx_finish(struct morse *mors,
-		struct sk_buff *skb,
-		struct morse_vif *mors_vif)
+static void morse_mac_process_bcn_change_seq_tx_finish(struct morse *mors,
+		struct sk_buff *skb,
+		struct morse_vif *mors_vif)
+{
+	struct ieee80211_vif *vif = morse_vif_to_ieee80211_vif(mors_vif);
+	/*
+	 * Check if probe req frame to be sent after STA detected
+	 * update in beacon change sequence number and notified mac80211.
+	 * mac80211 will send out QoS NULL with PM clear and on completion
+	 * of QoS NULL data, here schedule to send unicast/directed probe req
+	 */
+	if (mors_vif->waiting_for_probe_req_sched &&
+	    mors_vif->is_sta_assoc) {
+		MORSE_INFO(mors, "%s: Send probe req for updated beacon\n", __func__);
+		morse_mac_schedule_probe_req(vif);
+	}
+}
+
+/* S1G timing used to estimate the airtime of a transmission (usecs) */
+#define MORSE_S1G_SYMBOL_US		(40)
+#define MORSE_S1G_SIFS_US		(160)
+/* STF, LTF1 and SIG fields of the 1MHz and >= 2MHz short preambles */
+#define MORSE_S1G_1M_PREAMBLE_US	(14 * MORSE_S1G_SYMBOL_US)
+#define MORSE_S1G_SHORT_PREAMBLE_US	(6 * MORSE_S1G_SYMBOL_US)
+/* The long preamble adds SIG-A, D-STF and SIG-B */
+#define MORSE_S1G_LONG_PREAMBLE_US	(10 * MORSE_S1G_SYMBOL_US)
+
+/*
+ * Airtime of one payload byte in usecs, Q16 fixed point, at a PHY rate in kbps. SGI shortens
+ * each symbol by 10%.
+ */
+#define MORSE_S1G_BYTE_US_Q16(_kbps)	((u32)DIV_ROUND_UP(8000ULL << 16, (_kbps)))
+#define MORSE_S1G_NSS_US_Q16(_kbps, _nss) { \
+	MORSE_S1G_BYTE_US_Q16((_kbps) * (_nss)), \
+	MORSE_S1G_BYTE_US_Q16((_kbps) * (_nss) * 10 / 9) }
+#define MORSE_S1G_RATE(_kbps) { \
+	MORSE_S1G_NSS_US_Q16(_kbps, 1), MORSE_S1G_NSS_US_Q16(_kbps, 2), \
+	MORSE_S1G_NSS_US_Q16(_kbps, 3), MORSE_S1G_NSS_US_Q16(_kbps, 4) }
+
+/*
+ * Per byte airtime (usecs, Q16) indexed by enum dot11_bandwidth, MCS, NSS index and SGI.
+ * Built by the compiler from the S1G single spatial stream, long guard interval PHY rates
+ * (kbps), so a TX status needs no division per rate. Invalid combinations (2MHz MCS9, MCS10
+ * above 1MHz) use the nearest valid lower rate.
+ */
+static const u32 morse_s1g_byte_us_q16[DOT11_MAX_BANDWIDTH + 1][11][4][2] = {
+	[DOT11_BANDWIDTH_1MHZ] = {
+		MORSE_S1G_RATE(300), MORSE_S1G_RATE(600), MORSE_S1G_RATE(900),
+		MORSE_S1G_RATE(1200), MORSE_S1G_RATE(1800), MORSE_S1G_RATE(2400),
+		MORSE_S1G_RATE(2700), MORSE_S1G_RATE(3000), MORSE_S1G_RATE(3600),
+		MORSE_S1G_RATE(4000), MORSE_S1G_RATE(150)
+	},
+	[DOT11_BANDWIDTH_2MHZ] = {
+		MORSE_S1G_RATE(650), MORSE_S1G_RATE(1300), MORSE_S1G_RATE(1950),
+		MORSE_S1G_RATE(2600), MORSE_S1G_RATE(3900), MORSE_S1G_RATE(5200),
+		MORSE_S1G_RATE(5850), MORSE_S1G_RATE(6500), MORSE_S1G_RATE(7800),
+		MORSE_S1G_RATE(7800), MORSE_S1G_RATE(650)
+	},
+	[DOT11_BANDWIDTH_4MHZ] = {
+		MORSE_S1G_RATE(1350), MORSE_S1G_RATE(2700), MORSE_S1G_RATE(4050),
+		MORSE_S1G_RATE(5400), MORSE_S1G_RATE(8100), MORSE_S1G_RATE(10800),
+		MORSE_S1G_RATE(12150), MORSE_S1G_RATE(13500), MORSE_S1G_RATE(16200),
+		MORSE_S1G_RATE(18000), MORSE_S1G_RATE(1350)
+	},
+	[DOT11_BANDWIDTH_8MHZ] = {
+		MORSE_S1G_RATE(2925), MORSE_S1G_RATE(5850), MORSE_S1G_RATE(8775),
+		MORSE_S1G_RATE(11700), MORSE_S1G_RATE(17550), MORSE_S1G_RATE(23400),
+		MORSE_S1G_RATE(26325), MORSE_S1G_RATE(29250), MORSE_S1G_RATE(35100),
+		MORSE_S1G_RATE(39000), MORSE_S1G_RATE(2925)
+	},
+	[DOT11_BANDWIDTH_16MHZ] = {
+		MORSE_S1G_RATE(5850), MORSE_S1G_RATE(11700), MORSE_S1G_RATE(17550),
+		MORSE_S1G_RATE(23400), MORSE_S1G_RATE(35100), MORSE_S1G_RATE(46800),
+		MORSE_S1G_RATE(52650), MORSE_S1G_RATE(58500), MORSE_S1G_RATE(70200),
+		MORSE_S1G_RATE(78000), MORSE_S1G_RATE(5850)
+	},
+};
+
+/*
+ * Preamble airtime (usecs) indexed by enum morse_rate_preamble and NSS index, including one
+ * additional LTF per extra spatial stream. Non S1G preambles are costed as S1G short.
+ */
+#define MORSE_S1G_PREAMBLE_NSS_US(_us) \
+	{ (_us), (_us) + MORSE_S1G_SYMBOL_US, (_us) + 2 * MORSE_S1G_SYMBOL_US, \
+	  (_us) + 3 * MORSE_S1G_SYMBOL_US }
+
+static const u16 morse_s1g_preamble_us[MORSE_RATE_MAX_PREAMBLE + 1][4] = {
+	[MORSE_RATE_PREAMBLE_S1G_LONG] = MORSE_S1G_PREAMBLE_NSS_US(MORSE_S1G_LONG_PREAMBLE_US),
+	[MORSE_RATE_PREAMBLE_S1G_SHORT] = MORSE_S1G_PREAMBLE_NSS_US(MORSE_S1G_SHORT_PREAMBLE_US),
+	[MORSE_RATE_PREAMBLE_S1G_1M] = MORSE_S1G_PREAMBLE_NSS_US(MORSE_S1G_1M_PREAMBLE_US),
+	[MORSE_RATE_PREAMBLE_DSSS_LONG] = MORSE_S1G_PREAMBLE_NSS_US(MORSE_S1G_SHORT_PREAMBLE_US),
+	[MORSE_RATE_PREAMBLE_DSSS_SHORT] = MORSE_S1G_PREAMBLE_NSS_US(MORSE_S1G_SHORT_PREAMBLE_US),
+	[MORSE_RATE_PREAMBLE_ERP] = MORSE_S1G_PREAMBLE_NSS_US(MORSE_S1G_SHORT_PREAMBLE_US),
+	[MORSE_RATE_PREAMBLE_HT] = MORSE_S1G_PREAMBLE_NSS_US(MORSE_S1G_SHORT_PREAMBLE_US),
+};
+
+/**
+ * morse_mac_s1g_attempt_airtime_us - Estimate the airtime of one transmission attempt
+ *
+ * @rc: rate code the attempt was sent at
+ * @len: length of the MPDU in bytes
+ * @ampdu_len: number of MPDUs sharing the preamble and acknowledgement
+ *
+ * Return: airtime in usecs, including the preamble and the acknowledgement exchange
+ */
+static u32 morse_mac_s1g_attempt_airtime_us(morse_rate_code_t rc, u32 len, u32 ampdu_len)
+{
+	enum dot11_bandwidth bw = morse_ratecode_bw_index_get(rc);
+	enum morse_rate_preamble preamble = morse_ratecode_preamble_get(rc);
+	u8 mcs = morse_ratecode_mcs_index_get(rc);
+	u8 nss_idx = morse_ratecode_nss_index_get(rc);
+	u32 byte_us_q16, overhead_us;
+
+	if (bw > DOT11_MAX_BANDWIDTH)
+		bw = DOT11_BANDWIDTH_1MHZ;
+	if (mcs >= ARRAY_SIZE(morse_s1g_byte_us_q16[0]))
+		mcs = 0;
+	if (nss_idx >= ARRAY_SIZE(morse_s1g_byte_us_q16[0][0]))
+		nss_idx = 0;
+	if (preamble > MORSE_RATE_MAX_PREAMBLE)
+		preamble = MORSE_RATE_PREAMBLE_S1G_SHORT;
+
+	byte_us_q16 = morse_s1g_byte_us_q16[bw][mcs][nss_idx][morse_ratecode_sgi_get(rc)];
+
+	/* Preamble, SIFS and the (NDP) acknowledgement are shared across an A-MPDU */
+	overhead_us = 2 * morse_s1g_preamble_us[preamble][nss_idx] + MORSE_S1G_SIFS_US;
+	if (ampdu_len > 1)
+		overhead_us /= ampdu_len;
+
+	return overhead_us + (u32)(((u64)(len + FCS_LEN) * byte_us_q16 + U16_MAX) >> 16);
+}
+
+/**
+ * morse_mac_tx_airtime_us - Estimate the airtime a frame used from its TX status
+ *
+ * @len: length of the MPDU in bytes
+ * @tx_sts: TX status reported by the chip
+ *
+ * Return: airtime in usecs summed over every attempt at every rate
+ */
+static u32 morse_mac_tx_airtime_us(u32 len, const struct morse_skb_tx_status *tx_sts)
+{
+	u16 ampdu_info = le16_to_cpu(tx_sts->ampdu_info);
+	u32 ampdu_len = ampdu_info ? MORSE_TXSTS_AMPDU_INFO_GET_LEN(ampdu_info) : 1;
+	u32 airtime = 0;
+	int i;
+
+	for (i = 0; i < MORSE_SKB_MAX_RATES; i++) {
+		if (!tx_sts->rates[i].count)
+			continue;
+		airtime += tx_sts->rates[i].count *
+			   morse_mac_s1g_attempt_airtime_us(tx_sts->rates[i].morse_ratecode,
+							    len, ampdu_len);
+	}
+
+	return airtime;
+}
+
+void morse_mac_tx_airtime_report(struct morse *mors, struct sk_buff *skb,
+				 const struct morse_skb_tx_status *tx_sts)
 {
-	struct ieee80211_vif *vif = morse_vif_to_ieee80211_vif(mors_vif);
-	/*
-	 * Check if probe req frame to be sent after STA detected
-	 * update in beacon change sequence number and notified mac80211.
-	 * mac80211 will send out QoS NULL with PM clear and on completion
-	 * of QoS NULL data, here schedule to send unicast/directed probe req
-	 */
-	if (mors_vif->waiting_for_probe_req_sched &&
-	    mors_vif->is_sta_assoc) {
-		MORSE_INFO(mors, "%s: Send probe req for updated beacon\n", __func__);
-		morse_mac_schedule_probe_req(vif);
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	u16 ac = skb_get_queue_mapping(skb);
+	struct ieee80211_sta *sta;
+	struct morse_sta *mors_sta;
+	u32 airtime;
+
+	if (!tx_sts)
+		return;
+
+	airtime = morse_mac_tx_airtime_us(skb->len, tx_sts);
+	if (!airtime)
+		return;
+
+	/* Every transmission counts against the duty cycle, whoever it was for */
+	morse_duty_cycle_budget_add(mors, airtime);
+
+	if (!info->control.vif || ac >= IEEE80211_NUM_ACS || is_multicast_ether_addr(hdr->addr1))
+		return;
+
+	rcu_read_lock();
+	sta = ieee80211_find_sta(info->control.vif, hdr->addr1);
+	if (!sta)
+		goto exit;
+
+#if KERNEL_VERSION(5, 1, 0) <= MAC80211_VERSION_CODE
+	/* Feeds station airtime statistics and the mac80211 airtime fairness scheduler */
+	ieee80211_sta_register_airtime(sta, tx_sts->tid & IEEE80211_QOS_CTL_TID_MASK, airtime, 0);
+#endif
+
+	if (mors->custom_configs.enable_airtime_fairness) {
+		mors_sta = (struct morse_sta *)sta->drv_priv;
+		atomic_sub(airtime, &mors_sta->airtime_deficit[ac]);
 	}
+
+exit:
+	rcu_read_unlock();
 }
 
 void morse_mac_process_tx_finish(struct morse *mors, struct sk_buff *skb)
@@ -5415,7 +6645,7 @@ static void morse_mac_process_s1g_beacon(struct morse *mors, struct ieee80211_vi
 	mors_vif = ieee80211_vif_to_morse_vif(vif);
 
 	/* S1G beacons are not management frames, but are processed the same way */
-	morse_vendor_ie_process_rx_mgmt(vif, skb);
+	morse_vendor_ie_process_rx_mgmt(vif, skb, ies_mask);
 
 	/* Past here we only care if we are an associated station and the beacon is from our BSS */
 	if (vif->type != NL80211_IFTYPE_STATION || !mors_vif->is_sta_assoc ||
@@ -5463,7 +6693,7 @@ static void morse_mac_process_s1g_beacon(struct morse *mors, struct ieee80211_vi
 	/* Check for ECSA IE and process it */
 	short_beacon = (s1g_beacon->frame_control & IEEE80211_FC_COMPRESS_SSID);
 	if (!short_beacon && ies_mask->ies[WLAN_EID_EXT_CHANSWITCH_ANN].ptr)
-		morse_mac_process_ecsa_ie(mors, vif, skb);
+		morse_mac_process_ecsa_ie(mors, vif, ies_mask);
 
 	if (morse_mac_is_csa_active(vif) && mors_vif->ecsa_chan_configured) {
 		/*
@@ -5474,6 +6704,7 @@ static void morse_mac_process_s1g_beacon(struct morse *mors, struct ieee80211_vi
 		 */
 		MORSE_ECSA_INFO(mors, "%s: Configure ECSA Chan ts=%ld,short_beacon=%d\n",
 			   __func__, jiffies, short_beacon);
+		morse_mac_ecsa_outage_end(mors);
 		/* Schedule immediately */
 		schedule_delayed_work(&mors_vif->ecsa_chswitch_work, 0);
 		mors_vif->ecsa_chan_configured = false;
@@ -5509,6 +6740,8 @@ static void morse_mac_process_s1g_beacon(struct morse *mors, struct ieee80211_vi
  * @skb: RX skbuff
  * @vif: Pointer to valid vif
  *
+ * Must be called under rcu_read_lock(), which also covers any use of the returned vif.
+ *
  * @return:
  * * beacon in STA or Mesh mode      - STA VIF
  * * NDP probe response in STA mode  - STA VIF
@@ -5517,10 +6750,8 @@ static void morse_mac_process_s1g_beacon(struct morse *mors, struct ieee80211_vi
 static bool morse_mac_find_vif_for_bcast_mcast(struct morse *mors, struct sk_buff *skb,
 					       struct ieee80211_vif **vif)
 {
-	int idx;
-	int dest_vif_id = INVALID_VIF_INDEX;
+	u8 dest_vif_id;
 	u16 fc;
-	struct ieee80211_vif *vif_tmp;
 	const struct ieee80211_hdr *hdr = NULL;
 
 	if (skb->len > 0)
@@ -5531,35 +6762,24 @@ static bool morse_mac_find_vif_for_bcast_mcast(struct morse *mors, struct sk_buf
 
 	fc = le16_to_cpu(hdr->frame_control);
 
-	for (idx = 0; idx < mors->max_vifs; idx++) {
-		vif_tmp = morse_get_vif_from_vif_id(mors, idx);
-		if (!vif_tmp)
-			continue;
-
-		if (!ieee80211_is_mgmt(fc)) {
-			/* bool bcast = is_multicast_ether_addr(hdr->addr1);
-			 *
-			 * MORSE_WARN_RATELIMITED(mors,
-			 *    "Unexpected rx data skb %s fc:%04x\n",
-			 *     bcast ? "bcast" : "ucast", fc);
-			 */
-			dest_vif_id = idx;
-			break;
-		}
-
+	if (!ieee80211_is_mgmt(fc)) {
+		/* bool bcast = is_multicast_ether_addr(hdr->addr1);
+		 *
+		 * MORSE_WARN_RATELIMITED(mors,
+		 *    "Unexpected rx data skb %s fc:%04x\n",
+		 *     bcast ? "bcast" : "ucast", fc);
+		 */
+		dest_vif_id = READ_ONCE(mors->rx_vif_map.first);
+	} else {
 		switch (fc & IEEE80211_FCTL_STYPE) {
 		case IEEE80211_STYPE_BEACON:
-			if (vif_tmp->type == NL80211_IFTYPE_STATION ||
-			    ieee80211_vif_is_mesh(vif_tmp))
-				dest_vif_id = idx;
+			dest_vif_id = READ_ONCE(mors->rx_vif_map.beacon);
 			break;
 		case IEEE80211_STYPE_PROBE_RESP:
-			if (vif_tmp->type == NL80211_IFTYPE_STATION)
-				dest_vif_id = idx;
+			dest_vif_id = READ_ONCE(mors->rx_vif_map.probe_resp);
 			break;
 		case IEEE80211_STYPE_PROBE_REQ:
-			if (morse_mac_is_iface_ap_type(vif_tmp))
-				dest_vif_id = idx;
+			dest_vif_id = READ_ONCE(mors->rx_vif_map.probe_req);
 			break;
 		default:
 			/* MORSE_WARN_RATELIMITED(mors,
@@ -5568,20 +6788,28 @@ static bool morse_mac_find_vif_for_bcast_mcast(struct morse *mors, struct sk_buf
 			 * MORSE_HEXDUMP_WARN_ONCE(FEATURE_ID_DEFAULT,"RX MGMT:",
 			 *	skb->data, skb->len);
 			 */
-			dest_vif_id = idx;
+			dest_vif_id = READ_ONCE(mors->rx_vif_map.first);
 			break;
 		}
-
-		if (dest_vif_id != INVALID_VIF_INDEX)
-			break;
 	}
 
-	if (dest_vif_id != INVALID_VIF_INDEX) {
-		*vif = morse_get_vif_from_vif_id(mors, dest_vif_id);
-		return true;
-	}
+	if (dest_vif_id == INVALID_VIF_INDEX)
+		return false;
 
-	return false;
+	*vif = morse_get_vif_from_vif_id(mors, dest_vif_id);
+
+	return *vif != NULL;
+}
+
+/** Convert the PN of a CCMP (or GCMP) header to a 64-bit integer */
+static u64 morse_mac_ccmp_hdr_to_pn(const u8 *ccmp_hdr)
+{
+	return ((u64)ccmp_hdr[7] << 40) |
+	       ((u64)ccmp_hdr[6] << 32) |
+	       ((u64)ccmp_hdr[5] << 24) |
+	       ((u64)ccmp_hdr[4] << 16) |
+	       ((u64)ccmp_hdr[1] << 8) |
+	       (u64)ccmp_hdr[0];
 }
 
 /**
@@ -5602,7 +6830,6 @@ static int morse_rx_mgmt_ccmp_replay_check(struct ieee80211_sta *sta, const stru
 	struct morse_sta *mors_sta = (struct morse_sta *)sta->drv_priv;
 	u8 hdr_len = ieee80211_get_hdrlen_from_skb(skb);
 	u8 *ccmp_hdr = skb->data + hdr_len;
-	u8 pn[IEEE80211_CCMP_PN_LEN];
 	u64 rpn64;
 	struct morse_dot11ah_s1g_twt_action *twt_action =
 		(struct morse_dot11ah_s1g_twt_action *)(skb->data + IEEE80211_CCMP_HDR_LEN);
@@ -5614,20 +6841,7 @@ static int morse_rx_mgmt_ccmp_replay_check(struct ieee80211_sta *sta, const stru
 	     action_code != WLAN_S1G_PROTECTED_TWT_TEARDOWN))
 		return false;
 
-	pn[0] = ccmp_hdr[0];
-	pn[1] = ccmp_hdr[1];
-	pn[2] = ccmp_hdr[4];
-	pn[3] = ccmp_hdr[5];
-	pn[4] = ccmp_hdr[6];
-	pn[5] = ccmp_hdr[7];
-
-    /* Convert the 6-byte PN to a 64-bit integer */
-	rpn64 = ((uint64_t)pn[5] << 40) |
-		  ((uint64_t)pn[4] << 32) |
-		  ((uint64_t)pn[3] << 24) |
-		  ((uint64_t)pn[2] << 16) |
-		  ((uint64_t)pn[1] << 8)  |
-		  (uint64_t)pn[0];
+	rpn64 = morse_mac_ccmp_hdr_to_pn(ccmp_hdr);
 
     /* Draft P802.11REVme_D4.0 section 12.5.2.4.4:
      * If management frame protection is negotiated, the receiver shall set
@@ -5644,6 +6858,171 @@ static int morse_rx_mgmt_ccmp_replay_check(struct ieee80211_sta *sta, const stru
 	return false; /* No replay detected */
 }
 
+/**
+ * morse_mac_rx_has_peer_addrs() - Check an RX frame can be matched to its transmitting peer
+ * @skb: RX frame
+ *
+ * S1G beacons and other extension frames do not carry addr1 and addr2, and a runt frame may
+ * not hold a full header, so neither can be looked up by transmitter address.
+ *
+ * Return: true for a unicast data or management frame with a full three address header
+ */
+static bool morse_mac_rx_has_peer_addrs(const struct sk_buff *skb)
+{
+	const struct ieee80211_hdr *hdr = (const struct ieee80211_hdr *)skb->data;
+
+	if (skb_headlen(skb) < sizeof(struct ieee80211_hdr_3addr))
+		return false;
+
+	if (!ieee80211_is_data(hdr->frame_control) && !ieee80211_is_mgmt(hdr->frame_control))
+		return false;
+
+	return is_unicast_ether_addr(hdr->addr1);
+}
+
+/**
+ * morse_mac_rx_pn_is_dup() - Check a hardware decrypted unicast frame for a repeated PN
+ * @mors_sta: Transmitting peer, under the RCU read lock
+ * @skb: RX frame, with its mac80211 RX status filled in
+ *
+ * Frames the chip fails to filter, such as retransmissions whose ACK was lost to interference,
+ * are dropped here before they are translated, copied or handed to mac80211. This is a filter
+ * rather than the replay check: data can arrive out of order ahead of the mac80211 reorder
+ * buffer, so only a PN already seen within the last %MORSE_RX_PN_WINDOW of the highest is dropped
+ * and mac80211 still enforces strict PN ordering for everything it is given.
+ *
+ * Return: true if the frame should be dropped
+ */
+static bool morse_mac_rx_pn_is_dup(struct morse_sta *mors_sta, const struct sk_buff *skb)
+{
+	const struct ieee80211_hdr *hdr = (const struct ieee80211_hdr *)skb->data;
+	const struct ieee80211_rx_status *rx_status = IEEE80211_SKB_RXCB(skb);
+	__le16 fc = hdr->frame_control;
+	struct morse_sta_rx_pn *rx_pn;
+	unsigned int hdr_len;
+	bool dup;
+	u64 pn;
+	u64 ago;
+	int idx;
+
+	if (!enable_rx_pn_filter || !(rx_status->flag & RX_FLAG_DECRYPTED) ||
+	    !ieee80211_has_protected(fc))
+		return false;
+
+	/* Indexed as mac80211 indexes its replay counters: per TID, with one for management */
+	if (ieee80211_is_data_qos(fc))
+		idx = *ieee80211_get_qos_ctl((struct ieee80211_hdr *)hdr) &
+		      IEEE80211_QOS_CTL_TID_MASK;
+	else if (ieee80211_is_data(fc))
+		idx = 0;
+	else if (ieee80211_is_mgmt(fc))
+		idx = IEEE80211_NUM_TIDS;
+	else
+		return false;
+
+	hdr_len = ieee80211_hdrlen(fc);
+	if (skb_headlen(skb) < hdr_len + IEEE80211_CCMP_HDR_LEN ||
+	    !(skb->data[hdr_len + 3] & IEEE80211_WEP_IV_KEY_EXT_IV))
+		return false;
+
+	pn = morse_mac_ccmp_hdr_to_pn(skb->data + hdr_len);
+	rx_pn = &mors_sta->rx_pn[idx];
+
+	if (pn > rx_pn->highest) {
+		ago = pn - rx_pn->highest;
+		rx_pn->seen = (ago < MORSE_RX_PN_WINDOW) ? (rx_pn->seen << ago) | 1 : 1;
+		rx_pn->highest = pn;
+		return false;
+	}
+
+	ago = rx_pn->highest - pn;
+	if (ago >= MORSE_RX_PN_WINDOW)
+		return false;
+
+	dup = rx_pn->seen & BIT_ULL(ago);
+	rx_pn->seen |= BIT_ULL(ago);
+	return dup;
+}
+
+/**
+ * morse_mac_rx_seq_is_dup() - Check a unicast frame for a retry of the last one received
+ * @mors: Morse chip instance
+ * @mors_sta: Transmitting peer, under the RCU read lock
+ * @skb: RX frame, with its mac80211 RX status filled in, already checked to have a full header
+ *
+ * This is the duplicate detection of mac80211 (IEEE802.11-2020 10.3.2.14), done before the frame
+ * is translated or copied. A retry with the sequence control of the last frame received on the
+ * same TID is dropped. mac80211 is told the frame has been checked so it does not repeat the work.
+ *
+ * Return: true if the frame should be dropped
+ */
+static bool morse_mac_rx_seq_is_dup(struct morse *mors, struct morse_sta *mors_sta,
+				    struct sk_buff *skb)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	__le16 fc = hdr->frame_control;
+	int idx;
+
+	if (!enable_rx_dup_filter || ieee80211_is_nullfunc(fc) || ieee80211_is_qos_nullfunc(fc))
+		return false;
+
+	/* Indexed as mac80211 indexes its sequence caches: per TID, with one for the rest */
+	if (ieee80211_is_data_qos(fc))
+		idx = *ieee80211_get_qos_ctl(hdr) & IEEE80211_QOS_CTL_TID_MASK;
+	else
+		idx = IEEE80211_NUM_TIDS;
+
+	if (ieee80211_has_retry(fc)) {
+		MORSE_PAGE_STAT_INC(mors, rx_retry);
+		if (mors_sta->rx_last_seq_ctrl[idx] == hdr->seq_ctrl)
+			return true;
+	}
+
+	mors_sta->rx_last_seq_ctrl[idx] = hdr->seq_ctrl;
+#if KERNEL_VERSION(4, 10, 0) <= MAC80211_VERSION_CODE
+	IEEE80211_SKB_RXCB(skb)->flag |= RX_FLAG_DUP_VALIDATED;
+#endif
+	return false;
+}
+
+/**
+ * morse_mac_rx_early_drop() - Drop unicast frames mac80211 would discard as duplicates
+ * @mors: Morse chip instance
+ * @vif: Receiving interface
+ * @skb: RX frame, with its mac80211 RX status filled in
+ *
+ * Return: true if the frame should be dropped
+ */
+static bool morse_mac_rx_early_drop(struct morse *mors, struct ieee80211_vif *vif,
+				    struct sk_buff *skb)
+{
+	const struct ieee80211_hdr *hdr = (const struct ieee80211_hdr *)skb->data;
+	struct morse_sta *mors_sta;
+	struct ieee80211_sta *sta;
+	bool drop = false;
+
+	if ((!enable_rx_dup_filter && !enable_rx_pn_filter) || !morse_mac_rx_has_peer_addrs(skb))
+		return false;
+
+	rcu_read_lock();
+	sta = ieee80211_find_sta_by_ifaddr(mors->hw, hdr->addr2, vif->addr);
+	if (!sta)
+		goto exit;
+
+	mors_sta = (struct morse_sta *)sta->drv_priv;
+
+	if (morse_mac_rx_seq_is_dup(mors, mors_sta, skb)) {
+		MORSE_PAGE_STAT_INC(mors, rx_retry_dup);
+		drop = true;
+	} else if (morse_mac_rx_pn_is_dup(mors_sta, skb)) {
+		MORSE_PAGE_STAT_INC(mors, rx_pn_dup);
+		drop = true;
+	}
+exit:
+	rcu_read_unlock();
+	return drop;
+}
+
 static int morse_mac_process_s1g_mgmt(struct morse *mors, struct ieee80211_vif *vif,
 				      const struct sk_buff *skb,
 				      struct dot11ah_ies_mask *ies_mask)
@@ -5676,7 +7055,7 @@ static int morse_mac_process_s1g_mgmt(struct morse *mors, struct ieee80211_vif *
 	if (mors_vif->cac.enabled && vif->type == NL80211_IFTYPE_AP && ieee80211_is_auth(fc))
 		morse_cac_count_auth(vif, hdr);
 
-	morse_vendor_ie_process_rx_mgmt(vif, skb);
+	morse_vendor_ie_process_rx_mgmt(vif, skb, ies_mask);
 
 	/* Deal with TWT messages. */
 	if (morse_mac_is_iface_infra_bss_type(vif))
@@ -5799,6 +7178,98 @@ static int morse_mac_process_s1g_mgmt_or_beacon(struct morse *mors,
 	return morse_mac_process_s1g_caps(mors, vif, skb, ies_mask);
 }
 
+/* Maximum number of frames handed to mac80211 per NAPI poll */
+#define MORSE_RX_NAPI_WEIGHT	64
+
+static int morse_mac_rx_napi_poll(struct napi_struct *napi, int budget)
+{
+	struct morse *mors = container_of(napi, struct morse, rx_napi);
+	struct sk_buff *skb;
+	int done = 0;
+
+	while (done < budget) {
+		skb = skb_dequeue(&mors->rx_napi_q);
+		if (!skb)
+			break;
+
+		ieee80211_rx_napi(mors->hw, NULL, skb, napi);
+		done++;
+	}
+
+	if (done < budget)
+		napi_complete_done(napi, done);
+
+	return done;
+}
+
+static int morse_mac_rx_napi_init(struct morse *mors)
+{
+	if (!enable_rx_napi)
+		return 0;
+
+#if KERNEL_VERSION(6, 10, 0) <= LINUX_VERSION_CODE
+	mors->napi_dev = alloc_netdev_dummy(0);
+#else
+	mors->napi_dev = kzalloc(sizeof(*mors->napi_dev), GFP_KERNEL);
+	if (mors->napi_dev)
+		init_dummy_netdev(mors->napi_dev);
+#endif
+	if (!mors->napi_dev)
+		return -ENOMEM;
+
+	skb_queue_head_init(&mors->rx_napi_q);
+#if KERNEL_VERSION(5, 19, 0) <= LINUX_VERSION_CODE
+	netif_napi_add_weight(mors->napi_dev, &mors->rx_napi, morse_mac_rx_napi_poll,
+			      MORSE_RX_NAPI_WEIGHT);
+#else
+	netif_napi_add(mors->napi_dev, &mors->rx_napi, morse_mac_rx_napi_poll,
+		       MORSE_RX_NAPI_WEIGHT);
+#endif
+	napi_enable(&mors->rx_napi);
+
+	return 0;
+}
+
+static void morse_mac_rx_napi_finish(struct morse *mors)
+{
+	struct net_device *napi_dev = mors->napi_dev;
+
+	if (!napi_dev)
+		return;
+
+	mors->napi_dev = NULL;
+	napi_disable(&mors->rx_napi);
+	netif_napi_del(&mors->rx_napi);
+	skb_queue_purge(&mors->rx_napi_q);
+#if KERNEL_VERSION(6, 10, 0) <= LINUX_VERSION_CODE
+	free_netdev(napi_dev);
+#else
+	kfree(napi_dev);
+#endif
+}
+
+void morse_mac_rx_napi_schedule(struct morse *mors)
+{
+	if (!mors->napi_dev || skb_queue_empty(&mors->rx_napi_q))
+		return;
+
+	/* Called from process context; let the NAPI softirq run as soon as BHs are re-enabled */
+	local_bh_disable();
+	napi_schedule(&mors->rx_napi);
+	local_bh_enable();
+}
+
+/* Hand a converted frame to mac80211, either directly or through the NAPI queue */
+static void morse_mac_rx_deliver(struct morse *mors, struct sk_buff *skb)
+{
+	morse_pkt_lat_finish(mors, skb, MORSE_PKT_LAT_RX_MAC);
+
+	if (mors->napi_dev)
+		skb_queue_tail(&mors->rx_napi_q, skb);
+	else
+		ieee80211_rx_irqsafe(mors->hw, skb);
+}
+
 void morse_mac_skb_recv(struct morse *mors,
 			struct sk_buff *skb,
 			struct morse_skb_rx_status *hdr_rx_status)
@@ -5817,27 +7288,40 @@ void morse_mac_skb_recv(struct morse *mors,
 	if (!skb->data || skb->len == 0)
 		goto exit;
 
+	/* Zero-copy RX data frames only carry their headers in the linear area. Anything the
+	 * driver needs to parse or rewrite in place must be linearised first. PV1 frames are
+	 * rewritten to PV0, and their frame control uses a different layout, so check for them
+	 * before the PV0 type.
+	 */
+	if (skb_is_nonlinear(skb)) {
+		__le16 fc = ((struct ieee80211_hdr *)skb->data)->frame_control;
+
+		if (((mors->hw->conf.flags & IEEE80211_CONF_MONITOR) ||
+		     morse_dot11ah_is_pv1_qos_data(fc) || !ieee80211_is_data(fc)) &&
+		    skb_linearize(skb))
+			goto exit;
+	}
+
+	/* Held until the frame is delivered or dropped, as it covers every use of the vif */
+	rcu_read_lock();
 	vif = morse_get_vif_from_rx_status(mors, hdr_rx_status);
 
 #ifdef CONFIG_MORSE_MONITOR
 	if (mors->hw->conf.flags & IEEE80211_CONF_MONITOR) {
-		morse_mon_rx(mors, skb, hdr_rx_status);
+		if (morse_mon_rx(mors, skb, hdr_rx_status))
+			skb_needs_free = false;
 		/* If we have a monitor interface, don't bother doing any
 		 * other work on the SKB as we only support a single interface
 		 */
-		goto exit;
+		goto exit_unlock;
 	}
 #endif
 
-	ies_mask = morse_dot11ah_ies_mask_alloc();
-	if (!ies_mask)
-		goto exit;
-
 	/* The firmware passes up broadcast mgmt frames such as beacons with a NULL VIF.
 	 * Assign the correct VIF. If no matching VIF was found, the VIF is not yet up.
 	 */
 	if (!vif && !morse_mac_find_vif_for_bcast_mcast(mors, skb, &vif))
-		goto exit;
+		goto exit_unlock;
 
 	mors_vif = ieee80211_vif_to_morse_vif(vif);
 
@@ -5853,13 +7337,27 @@ void morse_mac_skb_recv(struct morse *mors,
 	if (morse_dot11ah_is_pv1_qos_data(((struct ieee80211_hdr *)skb->data)->frame_control)) {
 		if (morse_mac_convert_pv1_to_pv0(mors, mors_vif, skb, hdr_rx_status,
 						(struct dot11ah_mac_pv1_hdr *)skb->data))
-			goto exit;
+			goto exit_unlock;
 	}
 
 	/* Fill iee80211 rx_status flags from morse RX status object */
 	morse_mac_rx_status(mors, hdr_rx_status, &rx_status, skb);
 	memcpy(IEEE80211_SKB_RXCB(skb), &rx_status, sizeof(rx_status));
 
+	if (morse_mac_rx_early_drop(mors, vif, skb))
+		goto exit_unlock;
+
+	/* Data frames have the same layout in S1G and 11n, so skip translating them */
+	if (ieee80211_is_data(((struct ieee80211_hdr *)skb->data)->frame_control)) {
+		morse_mac_rx_deliver(mors, skb);
+		skb_needs_free = false;
+		goto exit_unlock;
+	}
+
+	ies_mask = morse_dot11ah_ies_mask_alloc();
+	if (!ies_mask)
+		goto exit_unlock;
+
 	/* MGMT and beacon frames need to be inspected by the driver.
 	 * Logic in the following function may dictate that the frame must be
 	 * dropped (ignored) or modified prior to passing through
@@ -5867,12 +7365,12 @@ void morse_mac_skb_recv(struct morse *mors,
 	 */
 	if (morse_mac_process_s1g_mgmt_or_beacon(mors, vif, skb, hdr_rx_status, &rx_status,
 						 ies_mask))
-		goto exit;
+		goto exit_unlock;
 
 	/* Expand SKB to make room for 11n coversion (if required) */
 	length_11n = morse_dot11ah_s1g_to_11n_rx_packet_size(vif, skb, ies_mask);
 	if (length_11n < 0)
-		goto exit;
+		goto exit_unlock;
 
 	if (skb->len + skb_tailroom(skb) < length_11n) {
 		struct sk_buff *skb2;
@@ -5880,11 +7378,15 @@ void morse_mac_skb_recv(struct morse *mors,
 		int s1g_ies_length;
 		int s1g_hdr_length;
 
-		skb2 = skb_copy_expand(skb, skb_headroom(skb), length_11n - skb->len, GFP_KERNEL);
+		/* The RX paths reserve MORSE_SKB_RX_TAILROOM for management frames where they can,
+		 * so this should be rare
+		 */
+		MORSE_PAGE_STAT_INC(mors, rx_s1g_copy);
+		skb2 = skb_copy_expand(skb, skb_headroom(skb), length_11n - skb->len, GFP_ATOMIC);
 		morse_mac_skb_free(mors, skb);
 		skb = skb2;
 		if (!skb)
-			goto exit;
+			goto exit_unlock;
 
 		/* Since we have freed the old skb, we must also clear the mask
 		 * because now it will have references to invalid memory
@@ -5895,7 +7397,7 @@ void morse_mac_skb_recv(struct morse *mors,
 			if (morse_dot11ah_parse_ies(s1g_ies, s1g_ies_length, ies_mask) < 0) {
 				MORSE_WARN_RATELIMITED(mors, "Failed to Parse IEs: %d\n",
 						       s1g_ies_length);
-				goto exit;
+				goto exit_unlock;
 			}
 		}
 	}
@@ -5904,10 +7406,12 @@ void morse_mac_skb_recv(struct morse *mors,
 	morse_dot11ah_s1g_to_11n_rx_packet(vif, skb, length_11n, ies_mask);
 
 	if (skb->len > 0) {
-		ieee80211_rx_irqsafe(hw, skb);
+		morse_mac_rx_deliver(mors, skb);
 		skb_needs_free = false;
 	}
 
+exit_unlock:
+	rcu_read_unlock();
 exit:
 	if (skb_needs_free)
 		morse_mac_skb_free(mors, skb);
@@ -6051,6 +7555,11 @@ static void morse_mac_config_wiphy(struct morse *mors)
 
 	wiphy_ext_feature_set(wiphy, NL80211_EXT_FEATURE_SET_SCAN_DWELL);
 	wiphy_ext_feature_set(wiphy, NL80211_EXT_FEATURE_VHT_IBSS);
+#if KERNEL_VERSION(5, 9, 0) <= MAC80211_VERSION_CODE
+	/* TX airtime is reported per station from tx_status, see morse_mac_tx_airtime_report() */
+	if (enable_airtime_fairness)
+		wiphy_ext_feature_set(wiphy, NL80211_EXT_FEATURE_AIRTIME_FAIRNESS);
+#endif
 
 	comb = kcalloc(1, sizeof(*comb), GFP_KERNEL);
 	if_limits = kcalloc(1, sizeof(*if_limits), GFP_KERNEL);
@@ -6118,6 +7627,11 @@ static void morse_mac_config_ieee80211_hw(struct morse *mors, struct ieee80211_h
 
 	ieee80211_hw_set(hw, AMPDU_AGGREGATION);
 
+	/* mac80211 only builds A-MSDUs on its TX queues, i.e. with the pull interface */
+	if (enable_amsdu && enable_airtime_fairness &&
+	    MORSE_CAPAB_SUPPORTED(&mors->capabilities, AMSDU))
+		ieee80211_hw_set(hw, TX_AMSDU);
+
 #if KERNEL_VERSION(4, 10, 0) < MAC80211_VERSION_CODE
 	if (MORSE_CAPAB_SUPPORTED(&mors->capabilities, HW_FRAGMENT))
 		ieee80211_hw_set(hw, SUPPORTS_TX_FRAG);
@@ -6200,7 +7714,7 @@ static void morse_mac_cleanup_during_restart(struct morse *mors)
 	}
 
 	for (if_idx = 0; if_idx < mors->max_vifs; if_idx++) {
-		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, if_idx);
+		struct ieee80211_vif *vif = __morse_get_vif_from_vif_id(mors, if_idx);
 		struct morse_vif *mors_vif;
 		bool deinit_beacon = false;
 
@@ -6258,6 +7772,9 @@ static int morse_mac_restart(struct morse *mors)
 	dev_warn(mors->dev, "%s: Restarting HW", __func__);
 	lockdep_assert_held(&mors->lock);
 
+	morse_boot_timeline_start(mors, true);
+	morse_boot_phase_begin(mors, MORSE_BOOT_PHASE_RESTART);
+
 	/* Clear started flag to prevent already queued work items (internal/mac80211)
 	 * from accessing the chip during restart.
 	 */
@@ -6277,13 +7794,16 @@ static int morse_mac_restart(struct morse *mors)
 	set_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags);
 
 #if KERNEL_VERSION(5, 9, 0) <= MAC80211_VERSION_CODE
-	if (enable_airtime_fairness)
+	if (enable_airtime_fairness) {
+		del_timer_sync(&mors->txq_release_timer);
+		morse_txq_work_cancel(mors);
 		tasklet_kill(&mors->tasklet_txq);
+	}
 #endif
 
 	/* Allow time for in-transit tx/rx packets to settle */
 	mdelay(20);
-	cancel_work_sync(&mors->chip_if_work);
+	morse_hw_chip_if_work_cancel(mors);
 	cancel_work_sync(&mors->tx_stale_work);
 	mors->chip_if->event_flags = 0;
 	mors->cfg->ops->flush_tx_data(mors);
@@ -6321,14 +7841,20 @@ static int morse_mac_restart(struct morse *mors)
 	}
 
 	morse_bus_set_irq(mors, true);
-	/* Allow TX again before exiting */
-	clear_bit(MORSE_STATE_FLAG_DATA_TX_STOPPED, &mors->state_flags);
+	/* Allow TX again before exiting. With a bulk restore, data waits until the stations
+	 * are back in the firmware, see morse_mac_reconfig_complete().
+	 */
+	if (enable_bulk_restore && !is_fullmac_mode())
+		morse_cmd_restore_begin(mors);
+	else
+		clear_bit(MORSE_STATE_FLAG_DATA_TX_STOPPED, &mors->state_flags);
 	clear_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags);
 	clear_bit(MORSE_STATE_FLAG_CHIP_UNRESPONSIVE, &mors->state_flags);
 
 	morse_mac_restore_after_restart(mors);
 
 exit:
+	morse_boot_phase_end(mors, MORSE_BOOT_PHASE_RESTART, ret);
 	morse_ps_enable(mors);
 	return ret;
 }
@@ -6354,6 +7880,21 @@ static void morse_stale_tx_status_timer(struct timer_list *t)
 	spin_unlock_bh(&mors->stale_status.lock);
 }
 
+void morse_stale_tx_status_arm(struct morse *mors, unsigned long expires)
+{
+	struct timer_list *timer = &mors->stale_status.timer;
+
+	/* Nothing to do if the timer already fires first, so skip the lock in the common case */
+	if (timer_pending(timer) && !time_before(expires, READ_ONCE(timer->expires)))
+		return;
+
+	spin_lock_bh(&mors->stale_status.lock);
+	if (mors->stale_status.enabled &&
+	    (!timer_pending(timer) || time_before(expires, timer->expires)))
+		mod_timer(timer, expires);
+	spin_unlock_bh(&mors->stale_status.lock);
+}
+
 static int morse_stale_tx_status_timer_init(struct morse *mors)
 {
 	MORSE_WARN_ON(FEATURE_ID_DEFAULT, mors->stale_status.enabled);
@@ -6448,6 +7989,14 @@ static void morse_health_check_work(struct work_struct *work)
 	if (test_bit(MORSE_STATE_FLAG_HOST_TO_CHIP_CMD_BLOCKED, &mors->state_flags))
 		return;
 
+	/* TX statuses, RX frames and command responses all need a working firmware, so only
+	 * ping the chip (waking it from power save) after a quiet watchdog interval.
+	 */
+	if (test_and_clear_bit(0, &mors->watchdog.chip_alive) && enable_health_check_traffic) {
+		MORSE_DBG(mors, "Chip active since last health check, skipping\n");
+		return;
+	}
+
 	do {
 		ret = morse_cmd_health_check(mors);
 	} while (ret && retries++ < MORSE_HEALTH_CHECK_RETRIES);
@@ -6460,6 +8009,8 @@ static void morse_health_check_work(struct work_struct *work)
 
 		morse_mac_driver_restart(mors);
 	} else {
+		/* The response itself is not traffic, so do not let it skip the next check */
+		clear_bit(0, &mors->watchdog.chip_alive);
 		MORSE_DBG(mors, "Health check complete\n");
 	}
 }
@@ -6500,6 +8051,7 @@ static int morse_ieee80211_init(struct morse *mors)
 	hw->extra_tx_headroom = sizeof(struct morse_buff_skb_header) +
 			mors->bus_ops->bulk_alignment +
 			mors->extra_tx_offset;
+	hw->extra_beacon_tailroom = MORSE_BEACON_EXTRA_TAILROOM;
 	hw->queues = 4;
 	/* Limit the number of aggregations for SPI. May get overwhelmed by SDIO */
 	if (max_aggregation_count)
@@ -6564,6 +8116,7 @@ err:
 static void morse_reg_notifier(struct wiphy *wiphy, struct regulatory_request *request)
 {
 	struct morse *mors = morse_wiphy_to_morse(wiphy);
+	bool have_ap = false;
 	char *req_cc;
 	int i;
 
@@ -6582,16 +8135,19 @@ static void morse_reg_notifier(struct wiphy *wiphy, struct regulatory_request *r
 		return;
 	}
 
-	for (i = 0; i < mors->max_vifs; i++) {
-		if (morse_mac_is_iface_ap_type(morse_get_vif_from_vif_id(mors, i))) {
-			/*
-			 * Do not support changing regulatory whilst running as an AP type,
-			 * as userspace will require a config change
-			 */
-			MORSE_WARN(mors,
-				   "Ignoring regulatory domain change whilst running as an AP type\n");
-			return;
-		}
+	rcu_read_lock();
+	for (i = 0; i < mors->max_vifs && !have_ap; i++)
+		have_ap = morse_mac_is_iface_ap_type(morse_get_vif_from_vif_id(mors, i));
+	rcu_read_unlock();
+
+	if (have_ap) {
+		/*
+		 * Do not support changing regulatory whilst running as an AP type,
+		 * as userspace will require a config change
+		 */
+		MORSE_WARN(mors,
+			   "Ignoring regulatory domain change whilst running as an AP type\n");
+		return;
 	}
 
 	/* If unspecified (ZZ) or world regdom (00), fall back to using the country specified
@@ -6769,10 +8325,18 @@ static int morse_mac_init(struct morse *mors)
 	MORSE_WARN_ON(FEATURE_ID_DEFAULT, ret);
 
 #if KERNEL_VERSION(5, 9, 0) <= MAC80211_VERSION_CODE
-	if (enable_airtime_fairness)
+	if (enable_airtime_fairness) {
 		tasklet_setup(&mors->tasklet_txq, morse_txq_tasklet);
+		timer_setup(&mors->txq_release_timer, morse_txq_release_timer, 0);
+		morse_txq_work_init(mors);
+	}
 #endif
 
+	ret = morse_mac_rx_napi_init(mors);
+	MORSE_WARN_ON(FEATURE_ID_DEFAULT, ret);
+
+	morse_mac_event_start(mors);
+
 	ret = morse_twt_init(mors);
 	MORSE_WARN_ON(FEATURE_ID_DEFAULT, ret);
 
@@ -6805,7 +8369,9 @@ int morse_mac_register(struct morse *mors)
 	/* Pass debug_mask modparam to dot11ah module */
 	morse_dot11ah_debug_init(debug_mask);
 
+	morse_boot_phase_begin(mors, MORSE_BOOT_PHASE_MAC_INIT);
 	ret = morse_mac_init(mors);
+	morse_boot_phase_end(mors, MORSE_BOOT_PHASE_MAC_INIT, ret);
 	if (ret) {
 		MORSE_ERR(mors, "morse_mac_init failed %d\n", ret);
 		goto err_init;
@@ -6816,10 +8382,12 @@ int morse_mac_register(struct morse *mors)
 	mors->wiphy->reg_notifier = morse_reg_notifier;
 
 	/* Register with mac80211 */
+	morse_boot_phase_begin(mors, MORSE_BOOT_PHASE_MAC_REGISTER);
 	if (enable_wiphy)
 		ret = morse_wiphy_register(mors);
 	else
 		ret = ieee80211_register_hw(hw);
+	morse_boot_phase_end(mors, MORSE_BOOT_PHASE_MAC_REGISTER, ret);
 	if (ret) {
 		MORSE_ERR(mors, "ieee80211_register_hw failed %d\n", ret);
 		goto err_init;
@@ -6896,6 +8464,7 @@ err_rc_init:
 err_mon_init:
 	ieee80211_unregister_hw(hw);
 err_init:
+	morse_mac_event_stop(mors);
 	return ret;
 }
 
@@ -6949,11 +8518,46 @@ struct morse *morse_mac_create(size_t priv_size, struct device *dev)
 	if (!mors)
 		return NULL;
 
+	mors->debug.page_stats = alloc_percpu(struct morse_page_stats);
+	mors->debug.bus_stats = alloc_percpu(struct morse_bus_stats);
+	mors->debug.tx_path_stats = alloc_percpu(struct morse_tx_path_stats);
+	mors->debug.pkt_lat_stats = alloc_percpu(struct morse_pkt_lat_stats);
+	mors->debug.pkt_lat_slots = kcalloc(MORSE_PKT_LAT_SLOTS,
+					    sizeof(*mors->debug.pkt_lat_slots), GFP_KERNEL);
+	mors->debug.cmd_stats = kzalloc(sizeof(*mors->debug.cmd_stats), GFP_KERNEL);
+	morse_boot_timeline_start(mors, false);
+	morse_boot_phase_begin(mors, MORSE_BOOT_PHASE_BUS_PROBE);
+
+	if (!mors->debug.page_stats || !mors->debug.bus_stats || !mors->debug.tx_path_stats ||
+	    !mors->debug.pkt_lat_stats || !mors->debug.pkt_lat_slots || !mors->debug.cmd_stats) {
+		free_percpu(mors->debug.page_stats);
+		free_percpu(mors->debug.bus_stats);
+		free_percpu(mors->debug.tx_path_stats);
+		free_percpu(mors->debug.pkt_lat_stats);
+		kfree(mors->debug.pkt_lat_slots);
+		kfree(mors->debug.cmd_stats);
+		if (enable_wiphy)
+			morse_wiphy_destroy(mors);
+		else
+			ieee80211_free_hw(mors->hw);
+		return NULL;
+	}
+
 	mors->dev = dev;
+	morse_skb_cache_init(mors);
 	mutex_init(&mors->lock);
 	mutex_init(&mors->cmd_lock);
-	mutex_init(&mors->cmd_wait);
+	morse_cmd_async_init(mors);
 	spin_lock_init(&mors->vif_list_lock);
+	spin_lock_init(&mors->duty_cycle_budget.lock);
+	mors->duty_cycle_budget.cur_start = jiffies;
+	skb_queue_head_init(&mors->event.q);
+	mors->rx_vif_map.beacon = INVALID_VIF_INDEX;
+	mors->rx_vif_map.probe_resp = INVALID_VIF_INDEX;
+	mors->rx_vif_map.probe_req = INVALID_VIF_INDEX;
+	mors->rx_vif_map.first = INVALID_VIF_INDEX;
+
+	morse_firmware_cache_init(mors);
 
 	/* Initialise coredump structures */
 	mutex_init(&mors->coredump.lock);
@@ -6979,6 +8583,7 @@ struct morse *morse_mac_create(size_t priv_size, struct device *dev)
 	mors->watchdog.paused = 0;
 	mors->watchdog.consumers = 0;
 	mors->watchdog.ping = NULL;
+	mors->watchdog.chip_alive = 0;
 
 	/* Initialise pre-association station structure (shared between VIFs) */
 	morse_pre_assoc_peer_list_init(mors);
@@ -7008,9 +8613,13 @@ static void morse_mac_deinit(struct morse *mors)
 
 	mors->cfg->ops->flush_tx_data(mors);
 	morse_mac_clear_mesh_list(mors);
+	morse_mac_rx_napi_finish(mors);
 #if KERNEL_VERSION(5, 9, 0) <= MAC80211_VERSION_CODE
-	if (enable_airtime_fairness)
+	if (enable_airtime_fairness) {
+		del_timer_sync(&mors->txq_release_timer);
+		morse_txq_work_finish(mors);
 		tasklet_kill(&mors->tasklet_txq);
+	}
 #endif
 
 	if (wiphy->iface_combinations) {
@@ -7027,6 +8636,7 @@ void morse_mac_unregister(struct morse *mors)
 {
 	morse_deinit_debug(mors);
 	morse_ps_disable(mors);
+	morse_mac_event_stop(mors);
 
 #ifdef CONFIG_MORSE_RC
 	morse_rc_deinit(mors);
@@ -7057,6 +8667,15 @@ void morse_mac_destroy(struct morse *mors)
 		morse_watchdog_cleanup(mors);
 
 	morse_coredump_destroy(mors);
+	morse_firmware_cache_finish(mors);
+	morse_cmd_async_finish(mors);
+	morse_skb_cache_finish(mors);
+	free_percpu(mors->debug.page_stats);
+	free_percpu(mors->debug.bus_stats);
+	free_percpu(mors->debug.tx_path_stats);
+	free_percpu(mors->debug.pkt_lat_stats);
+	kfree(mors->debug.pkt_lat_slots);
+	kfree(mors->debug.cmd_stats);
 
 	if (enable_wiphy)
 		morse_wiphy_destroy(mors);
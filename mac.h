@@ -9,6 +9,8 @@
  */
 #include <linux/skbuff.h>
 #include <linux/crc32.h>
+#include <linux/nospec.h>
+#include <linux/rcupdate.h>
 #include "morse.h"
 #include "command.h"
 #include "skb_header.h"
@@ -28,9 +30,57 @@ struct morse *morse_mac_create(size_t priv_size, struct device *dev);
 void morse_mac_destroy(struct morse *mors);
 void morse_mac_skb_recv(struct morse *mors, struct sk_buff *skb,
 		       struct morse_skb_rx_status *hdr_rx_status);
+
+/**
+ * morse_mac_event_recv() - Handle an event from the chip, or queue it for the event worker
+ *
+ * @mors: Morse chip instance
+ * @skb: The event, which is consumed
+ *
+ * Return: 0 if queued, else the result of handling the event
+ */
 int morse_mac_event_recv(struct morse *mors, struct sk_buff *skb);
+
+/**
+ * morse_mac_event_start() - Start the event worker, until then events are handled inline
+ *
+ * @mors: Morse chip instance
+ */
+void morse_mac_event_start(struct morse *mors);
+
+/**
+ * morse_mac_event_stop() - Stop the event worker, dropping any events still queued
+ *
+ * @mors: Morse chip instance
+ */
+void morse_mac_event_stop(struct morse *mors);
+
+/**
+ * morse_mac_rx_napi_schedule() - Schedule NAPI delivery of RX frames queued by
+ * morse_mac_skb_recv(). Does nothing if NAPI RX is not enabled.
+ *
+ * @mors: Morse chip instance
+ */
+void morse_mac_rx_napi_schedule(struct morse *mors);
+
+/**
+ * morse_mac_schedule_txq() - Schedule a run of the airtime fairness TX scheduler, on its
+ * worker when enable_txq_work is set and otherwise on the TX queue tasklet.
+ *
+ * @mors: Morse chip instance
+ */
+void morse_mac_schedule_txq(struct morse *mors);
+
+/**
+ * morse_stale_tx_status_arm() - Make sure the stale TX status check runs by a deadline
+ *
+ * @mors: Morse chip instance
+ * @expires: Deadline in jiffies, ignored if the check is already due before it
+ */
+void morse_stale_tx_status_arm(struct morse *mors, unsigned long expires);
 int morse_mac_register(struct morse *mors);
 void morse_mac_unregister(struct morse *mors);
+/* Must be called under rcu_read_lock() */
 void morse_mac_rx_status(struct morse *mors,
 			 const struct morse_skb_rx_status *hdr_rx_status,
 			 struct ieee80211_rx_status *rx_status, struct sk_buff *skb);
@@ -42,6 +92,19 @@ void morse_mac_update_custom_s1g_capab(struct morse_vif *mors_vif,
 int morse_mac_pkt_to_s1g(struct morse *mors, struct morse_sta *mors_sta,
 			 struct sk_buff **skb, int *tx_bw_mhz);
 
+/**
+ * morse_mac_tx_benchmark() - Time the host side of the data TX path with synthetic frames
+ * @mors: Global Morse structure
+ * @file: seq file the results are written to
+ *
+ * Synthetic QoS data frames to the associated AP are taken through S1G conversion, TX info
+ * and rate selection, and bus header construction, then dropped instead of being queued for
+ * the chip. Group addressed frames are used when no station interface is associated.
+ *
+ * Return: 0 on success, otherwise a negative error code.
+ */
+int morse_mac_tx_benchmark(struct morse *mors, struct seq_file *file);
+
 /**
  * morse_mac_ps_enabled() - Check whether powersave can be enabled.
  * @mors: Global Morse structure
@@ -52,6 +115,14 @@ bool morse_mac_ps_enabled(struct morse *mors);
 
 int morse_mac_watchdog_create(struct morse *mors);
 void morse_mac_mcs0_10_stats_dump(struct morse *mors, struct seq_file *file);
+
+/**
+ * morse_mac_duty_cycle_budget_show() - Show the airtime used against the duty cycle
+ *
+ * @mors: Morse chip struct
+ * @file: File to write to
+ */
+void morse_mac_duty_cycle_budget_show(struct morse *mors, struct seq_file *file);
 void morse_mac_fill_tx_info(struct morse *mors, struct morse_skb_tx_info *tx_info,
 				   struct sk_buff *skb, struct ieee80211_vif *vif,
 				   int tx_bw_mhz, struct ieee80211_sta *sta);
@@ -61,14 +132,77 @@ bool is_thin_lmac_mode(void);
 bool is_virtual_sta_test_mode(void);
 bool is_sw_crypto_mode(void);
 
-/* Return a pointer to vif from vif id of tx status */
-struct ieee80211_vif *morse_get_vif_from_tx_status(struct morse *mors,
-						   struct morse_skb_tx_status *hdr_tx_status);
+/* Return the vif array slot for a vif id, or NULL if the id is out of range */
+static inline struct ieee80211_vif __rcu **morse_vif_slot(struct morse *mors, int vif_id)
+{
+	if (unlikely(vif_id < 0 || vif_id >= mors->max_vifs || !mors->vif))
+		return NULL;
+
+	return &mors->vif[array_index_nospec(vif_id, mors->max_vifs)];
+}
+
+/**
+ * __morse_get_vif_from_vif_id - Return a pointer to vif from vif id, from the update side
+ *
+ * @mors: Morse chip struct
+ * @vif_id: vif id reported by the firmware
+ *
+ * The caller must hold either vif_list_lock or mors->lock. Interfaces are only added to or
+ * removed from the vif array with both held, so the vif stays valid while either is held.
+ *
+ * Return: vif, or NULL if no interface is registered with @vif_id
+ */
+static inline struct ieee80211_vif *__morse_get_vif_from_vif_id(struct morse *mors, int vif_id)
+{
+	struct ieee80211_vif __rcu **slot = morse_vif_slot(mors, vif_id);
+
+	if (!slot)
+		return NULL;
 
-/* Return a pointer to vif from vif id */
-struct ieee80211_vif *morse_get_vif_from_vif_id(struct morse *mors, int vif_id);
-/* same as above but does not take the vif array lock */
-struct ieee80211_vif *__morse_get_vif_from_vif_id(struct morse *mors, int vif_id);
+	return rcu_dereference_protected(*slot, lockdep_is_held(&mors->vif_list_lock) ||
+					 lockdep_is_held(&mors->lock));
+}
+
+/**
+ * morse_get_vif_from_vif_id - Return a pointer to vif from vif id
+ *
+ * @mors: Morse chip struct
+ * @vif_id: vif id reported by the firmware
+ *
+ * The vif array is published with RCU so the lookup is lockless. The caller must hold
+ * rcu_read_lock() across the lookup and every use of the returned vif. The vif itself is
+ * owned by mac80211, which waits for an RCU grace period before freeing it after the
+ * interface has been removed.
+ *
+ * Return: vif, or NULL if no interface is registered with @vif_id
+ */
+static inline struct ieee80211_vif *morse_get_vif_from_vif_id(struct morse *mors, int vif_id)
+{
+	struct ieee80211_vif __rcu **slot = morse_vif_slot(mors, vif_id);
+
+	if (!slot)
+		return NULL;
+
+	return rcu_dereference(*slot);
+}
+
+/* Return a pointer to vif from vif id of tx status. Must be called under rcu_read_lock() */
+static inline struct ieee80211_vif *
+morse_get_vif_from_tx_status(struct morse *mors, struct morse_skb_tx_status *hdr_tx_status)
+{
+	u8 vif_id = MORSE_TX_CONF_FLAGS_VIF_ID_GET(le32_to_cpu(hdr_tx_status->flags));
+
+	return morse_get_vif_from_vif_id(mors, vif_id);
+}
+
+/* Return a pointer to vif from vif id of rx status. Must be called under rcu_read_lock() */
+static inline struct ieee80211_vif *
+morse_get_vif_from_rx_status(struct morse *mors, const struct morse_skb_rx_status *hdr_rx_status)
+{
+	u8 vif_id = MORSE_RX_STATUS_FLAGS_VIF_ID_GET(le32_to_cpu(hdr_rx_status->flags));
+
+	return morse_get_vif_from_vif_id(mors, vif_id);
+}
 
 /**
  * Return a pointer to the 1st valid VIF.
@@ -76,10 +210,6 @@ struct ieee80211_vif *__morse_get_vif_from_vif_id(struct morse *mors, int vif_id
  */
 struct ieee80211_vif *morse_get_vif(struct morse *mors);
 
-/* Return a pointer to vif from vif id of rx status */
-struct ieee80211_vif *morse_get_vif_from_rx_status(struct morse *mors,
-						const struct morse_skb_rx_status *hdr_rx_status);
-
 /* Return a pointer to the AP vif if present otherwise NULL */
 struct ieee80211_vif *morse_get_ap_vif(struct morse *mors);
 
@@ -314,7 +444,8 @@ void morse_fill_tx_info(struct morse *mors,
 			struct sk_buff *skb, struct morse_vif *mors_vif, int tx_bw_mhz);
 
 /* Process ECSA IE and store the channel info. Also starts chan switch timer in sta mode */
-void morse_mac_process_ecsa_ie(struct morse *mors, struct ieee80211_vif *vif, struct sk_buff *skb);
+void morse_mac_process_ecsa_ie(struct morse *mors, struct ieee80211_vif *vif,
+			       const struct dot11ah_ies_mask *ies_mask);
 
 /**
  * morse_mac_ecsa_beacon_tx_done - Process tx status completion of beacon to trigger the
@@ -359,8 +490,35 @@ int morse_mac_tx_mgmt_frame(struct ieee80211_vif *vif, struct sk_buff *skb);
  */
 void morse_mac_process_tx_finish(struct morse *mors, struct sk_buff *skb);
 
+/**
+ * morse_mac_tx_airtime_report - Charge the airtime a frame used to its destination station
+ *
+ * The airtime is estimated from the rates and attempt counts in the TX status. It is
+ * registered with mac80211 for the station and, when the pull interface is in use,
+ * deducted from the station's TX scheduler deficit for the frame's AC.
+ *
+ * @mors: pointer to morse struct
+ * @skb: the transmitted frame, with the morse header already removed
+ * @tx_sts: TX status reported by the chip for the frame
+ */
+void morse_mac_tx_airtime_report(struct morse *mors, struct sk_buff *skb,
+				 const struct morse_skb_tx_status *tx_sts);
+
 u64 morse_mac_generate_timestamp_for_frame(struct morse_vif *mors_vif);
 
+/**
+ * morse_mac_find_sta_by_aid - Get an associated STA of an AP type interface by AID
+ *
+ * @mors_vif: AP type interface
+ * @aid: Association ID of the STA
+ *
+ * Return: STA context, or NULL if no STA is associated with @aid
+ *
+ * @note: The RCU lock must be held when calling this function and while using the returned
+ *	  pointer.
+ */
+struct morse_sta *morse_mac_find_sta_by_aid(struct morse_vif *mors_vif, u16 aid);
+
 /**
  * morse_mac_is_1mhz_probe_req_enabled - Are 1MHz probe requests enabled.
  *
@@ -30,7 +30,7 @@ int morse_command_process_bssid_info(struct morse_vif *mors_vif,
 		return -ENOENT;
 
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
-		vif_tmp = morse_get_vif_from_vif_id(mors, vif_id);
+		vif_tmp = __morse_get_vif_from_vif_id(mors, vif_id);
 
 		if (!vif_tmp)
 			continue;
@@ -73,8 +73,17 @@ struct sk_buff *morse_mac_get_mbssid_beacon_ies(struct morse_vif *mors_vif)
 
 	mors = morse_vif_to_morse(mors_vif);
 	vif = morse_vif_to_ieee80211_vif(mors_vif);
-	if (mors_vif->beacon_buf)
-		return mors_vif->beacon_buf;
+	if (mors_vif->beacon_buf) {
+		if (mors_vif->beacon_buf_gen == atomic_read(&mors_vif->bcn_template_gen))
+			return mors_vif->beacon_buf;
+
+		/* The BSS changed since the beacon was fetched, fetch it again */
+		dev_kfree_skb_any(mors_vif->beacon_buf);
+		mors_vif->beacon_buf = NULL;
+		mors_vif->ssid_ie = NULL;
+	}
+
+	mors_vif->beacon_buf_gen = atomic_read(&mors_vif->bcn_template_gen);
 
 #if KERNEL_VERSION(6, 0, 0) > MAC80211_VERSION_CODE
 	mors_vif->beacon_buf = ieee80211_beacon_get(mors->hw, vif);
@@ -167,13 +176,60 @@ static void morse_insert_mbssid_ie_subelem(struct morse_vif *mors_vif, u8 **buf,
 	*buf += sizeof(idx_ie);
 }
 
+/**
+ * morse_mbssid_build_ie - Build the MBSSID element for a transmitting BSS
+ *
+ * @mors_vif:   Transmitting AP iface
+ * @members:    Non-transmitting AP ifaces to include
+ * @n_members:  Number of entries in @members
+ * @buf:        Buffer of MBSSID_IE_SIZE_MAX bytes to build the element in
+ * @cache:      If not NULL, records where the MBSSID Index IEs were placed
+ *
+ * Return: Length of the element
+ */
+static int morse_mbssid_build_ie(struct morse_vif *mors_vif, struct morse_vif **members,
+				 int n_members, u8 *buf, struct morse_mbssid_ie_cache *cache)
+{
+	struct mbssid_ie mbssid_ie;
+	u8 *tmp = buf;
+	int i;
+
+	/* We need only non-Tx BSSID in IE. Excluding Tx BSS. */
+	*tmp = mors_vif->mbssid_info.max_bssid_indicator - 1;
+	tmp += sizeof(mbssid_ie.max_bssid_indicator);
+
+	if (cache)
+		cache->n_idx = 0;
+
+	for (i = 0; i < n_members; i++) {
+		u8 *start = tmp;
+
+		morse_insert_mbssid_ie_subelem(members[i], &tmp, buf);
+		if (!cache || tmp == start)
+			continue;
+
+		cache->idx_off[cache->n_idx] = (tmp - buf) - sizeof(struct sub_elem_mbssid_idx_ie);
+		cache->idx_vif_id[cache->n_idx] = members[i]->id;
+		cache->n_idx++;
+	}
+
+	return tmp - buf;
+}
+
 void morse_mbssid_insert_ie(struct morse_vif *mors_vif, struct morse *mors,
 			    struct dot11ah_ies_mask *ies_mask)
 {
 	int vif_id;
+	int i;
 	u8 mbssid_ie_buf[MBSSID_IE_SIZE_MAX];
-	struct mbssid_ie mbssid_ie;
-	u8 *tmp = mbssid_ie_buf;
+	struct morse_vif *members[MORSE_MAX_IF];
+	struct morse_mbssid_ie_cache *cache;
+	struct ie_element *element;
+	int n_members = 0;
+	u32 member_mask = 0;
+	bool rebuild;
+	u8 *ie;
+	int len;
 
 	if (!morse_mbssid_ie_enabled(mors))
 		return;
@@ -181,13 +237,21 @@ void morse_mbssid_insert_ie(struct morse_vif *mors_vif, struct morse *mors,
 	if (mors_vif->mbssid_info.max_bssid_indicator <= 1)
 		return;
 
-	/* We need only non-Tx BSSID in IE. Excluding Tx BSS. */
-	*tmp = mors_vif->mbssid_info.max_bssid_indicator - 1;
-	tmp += sizeof(mbssid_ie.max_bssid_indicator);
+	cache = mors_vif->mbssid_ie_cache;
+	if (!cache) {
+		cache = kzalloc(sizeof(*cache), GFP_ATOMIC);
+		mors_vif->mbssid_ie_cache = cache;
+	}
+
+	rebuild = !cache || !cache->len ||
+		  cache->max_bssid_indicator != mors_vif->mbssid_info.max_bssid_indicator;
 
-	for (vif_id = 0; vif_id < (mors->max_vifs); vif_id++) {
+	/* Covers the member interfaces until the element has been built */
+	rcu_read_lock();
+	for (vif_id = 0; vif_id < (mors->max_vifs) && n_members < ARRAY_SIZE(members); vif_id++) {
 		struct morse_vif *mors_if_tmp;
 		struct ieee80211_vif *vif_tmp;
+		int gen;
 
 		vif_tmp = morse_get_vif_from_vif_id(mors, vif_id);
 
@@ -202,16 +266,55 @@ void morse_mbssid_insert_ie(struct morse_vif *mors_vif, struct morse *mors,
 		if (mors_if_tmp->id == mors_vif->mbssid_info.transmitter_vif_id)
 			continue;
 
+		gen = mors_if_tmp->beacon_buf_gen;
 		if (!morse_mac_get_mbssid_beacon_ies(mors_if_tmp))
 			continue;
 
-		morse_insert_mbssid_ie_subelem(mors_if_tmp, &tmp, mbssid_ie_buf);
+		/* Fetched again since the element was built, so its SSID may have changed */
+		if (gen != mors_if_tmp->beacon_buf_gen)
+			rebuild = true;
+
+		members[n_members++] = mors_if_tmp;
+		member_mask |= BIT(vif_id);
 	}
-	if ((tmp - mbssid_ie_buf) > sizeof(mbssid_ie)) {
-		morse_dot11ah_insert_element(ies_mask,
-					     WLAN_EID_MULTIPLE_BSSID,
-					     mbssid_ie_buf, (tmp - mbssid_ie_buf));
+
+	if (!cache) {
+		/* No cache to reuse, build on the stack and have it copied into the mask */
+		len = morse_mbssid_build_ie(mors_vif, members, n_members, mbssid_ie_buf, NULL);
+		if (len > sizeof(struct mbssid_ie))
+			morse_dot11ah_insert_element(ies_mask, WLAN_EID_MULTIPLE_BSSID,
+						     mbssid_ie_buf, len);
+		rcu_read_unlock();
+		return;
+	}
+
+	if (rebuild || cache->members != member_mask) {
+		cache->len = morse_mbssid_build_ie(mors_vif, members, n_members, cache->ie, cache);
+		cache->max_bssid_indicator = mors_vif->mbssid_info.max_bssid_indicator;
+		cache->members = member_mask;
+	} else {
+		/* Only the DTIM counts move from beacon to beacon */
+		for (i = 0; i < cache->n_idx; i++) {
+			struct ieee80211_vif *vif_tmp;
+
+			vif_tmp = morse_get_vif_from_vif_id(mors, cache->idx_vif_id[i]);
+			if (vif_tmp)
+				morse_insert_mbssid_index_ie(ieee80211_vif_to_morse_vif(vif_tmp),
+							     cache->ie + cache->idx_off[i]);
+		}
 	}
+	rcu_read_unlock();
+
+	ie = cache->ie;
+	len = cache->len;
+	if (len <= sizeof(struct mbssid_ie))
+		return;
+
+	/* The cache outlives this beacon's IEs mask, so it can be referenced in place */
+	element = morse_dot11_ies_create_ie_element(ies_mask, WLAN_EID_MULTIPLE_BSSID, len,
+						     false, true);
+	if (element)
+		element->ptr = ie;
 }
 
 #if KERNEL_VERSION(5, 1, 0) < MAC80211_VERSION_CODE
@@ -287,7 +390,7 @@ int morse_process_beacon_from_mbssid_ie(struct morse *mors, struct sk_buff *skb,
 
 			skb2 = skb_copy_expand(skb_beacon, skb_headroom(skb_beacon),
 					       bcn_length_11n - skb_beacon->len,
-					       GFP_KERNEL);
+					       GFP_ATOMIC);
 			morse_mac_skb_free(mors, skb_beacon);
 			skb_beacon = skb2;
 			if (!skb_beacon)
@@ -318,6 +421,9 @@ int morse_mbssid_ie_deinit_bss(struct morse *mors, struct morse_vif *mors_vif)
 		mors_vif->beacon_buf = NULL;
 	}
 
+	kfree(mors_vif->mbssid_ie_cache);
+	mors_vif->mbssid_ie_cache = NULL;
+
 	return 0;
 }
 
@@ -79,6 +79,28 @@ struct mbssid_ie {
 	struct mbssid_subelement sub_elem;
 } __packed;
 
+/**
+ * struct morse_mbssid_ie_cache - MBSSID element reused across beacons of a transmitting BSS
+ *
+ * @ie:                   The MBSSID element body
+ * @len:                  Length of @ie, 0 if it has not been built
+ * @max_bssid_indicator:  Max BSSID indicator @ie was built for
+ * @members:              Bitmap of the VIF IDs of the non-transmitting BSSs @ie was built from
+ * @n_idx:                Number of MBSSID Index IEs in @ie
+ * @idx_off:              Offset of each MBSSID Index IE in @ie, rewritten every beacon as the
+ *                        DTIM count changes
+ * @idx_vif_id:           VIF ID of the non-transmitting BSS of each MBSSID Index IE
+ */
+struct morse_mbssid_ie_cache {
+	u8 ie[MBSSID_IE_SIZE_MAX];
+	u8 len;
+	u8 max_bssid_indicator;
+	u32 members;
+	u8 n_idx;
+	u8 idx_off[MORSE_MAX_IF];
+	u8 idx_vif_id[MORSE_MAX_IF];
+};
+
 /**
  * morse_mbssid_insert_ie - Insert MBSSID IE of non-transmitting BSS to the beacon of
  *                          transmitting BSS
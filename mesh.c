@@ -30,6 +30,9 @@
 /** Duration in seconds, a kicked out peer is blacklisted */
 #define DEFAULT_MESH_BLACKLIST_TIMEOUT 30
 
+/** Time the lowest RSSI peer is kept as the kick out candidate, while the peers don't change */
+#define MORSE_MESH_KICKOUT_CANDIDATE_AGE_MS	500
+
 static void morse_schedule_mesh_probe_timer(struct morse_mesh *mesh, int delay)
 {
 	unsigned long timeout;
@@ -436,6 +439,65 @@ int morse_mac_process_mesh_tx_mgmt(struct morse_vif *mors_vif,
 	return 0;
 }
 
+/**
+ * morse_mesh_update_kickout_candidate() - Choose the peer with the lowest RSSI, among those with
+ * other peerings, as the one to kick out for a better new peer. The choice is kept for a short
+ * time, or until the number of peers changes.
+ *
+ * @mors_vif: pointer to morse interface
+ *
+ * Return: true if there is a candidate
+ */
+static bool morse_mesh_update_kickout_candidate(struct morse_vif *mors_vif)
+{
+	struct morse_mesh *mesh = mors_vif->mesh;
+	struct morse *mors = morse_vif_to_morse(mors_vif);
+	struct list_head *morse_sta_list = &mors_vif->ap->stas;
+	struct list_head *pos;
+	s16 peer_rssi = 0;
+	u8 *peer_addr = NULL;
+
+	if (mesh->kickout_candidate.num_stas == mors_vif->ap->num_stas &&
+	    time_before(jiffies, mesh->kickout_candidate.updated +
+			msecs_to_jiffies(MORSE_MESH_KICKOUT_CANDIDATE_AGE_MS)))
+		return mesh->kickout_candidate.valid;
+
+	rcu_read_lock();
+	/* Find the peer with lowest rssi */
+	list_for_each(pos, morse_sta_list) {
+		struct morse_sta *msta = list_entry(pos, struct morse_sta, list);
+
+		if (!msta) {
+			MORSE_MESH_WARN(mors, "%s: msta NULL\n", __func__);
+			continue;
+		}
+
+		MORSE_MESH_DBG(mors, "msta %pM with rssi %d and peerings=%u\n",
+			       msta->addr, msta->avg_rssi, msta->mesh_no_of_peerings);
+
+		/* Ignore if number of peerings is 1 */
+		if (msta->mesh_no_of_peerings == 1)
+			continue;
+
+		if (!peer_addr || peer_rssi > msta->avg_rssi) {
+			peer_rssi = msta->avg_rssi;
+			peer_addr = msta->addr;
+		}
+	}
+
+	mesh->kickout_candidate.valid = !!peer_addr;
+	if (peer_addr) {
+		memcpy(mesh->kickout_candidate.addr, peer_addr, ETH_ALEN);
+		mesh->kickout_candidate.rssi = peer_rssi;
+	}
+	rcu_read_unlock();
+
+	mesh->kickout_candidate.num_stas = mors_vif->ap->num_stas;
+	mesh->kickout_candidate.updated = jiffies;
+
+	return mesh->kickout_candidate.valid;
+}
+
 /**
  * morse_mac_check_for_dynamic_peering() - Checks if a link can be established with the
  * new peer by kicking out one of existing peer (with low signal strength).
@@ -450,10 +512,8 @@ static void morse_mac_check_for_dynamic_peering(struct morse_vif *mors_vif, u8 *
 {
 	struct morse_mesh *mesh = mors_vif->mesh;
 	struct morse *mors = morse_vif_to_morse(mors_vif);
-	struct list_head *morse_sta_list = &mors_vif->ap->stas;
-	struct list_head *pos;
-	s16 peer_rssi = 0;
-	u8 *peer_addr = NULL;
+	s16 peer_rssi;
+	u8 *peer_addr;
 	struct ie_element *mesh_id_ie = &ies_mask->ies[WLAN_EID_MESH_ID];
 	struct ie_element *mesh_conf_ie = &ies_mask->ies[WLAN_EID_MESH_CONFIG];
 	struct ieee80211_vif *vif = morse_vif_to_ieee80211_vif(mors_vif);
@@ -481,32 +541,14 @@ static void morse_mac_check_for_dynamic_peering(struct morse_vif *mors_vif, u8 *
 	if (!accept_additional_peer)
 		return;
 
-	rcu_read_lock();
-	/* Find the peer with lowest rssi */
-	list_for_each(pos, morse_sta_list) {
-		struct morse_sta *msta = list_entry(pos, struct morse_sta, list);
-
-		if (!msta) {
-			MORSE_MESH_WARN(mors, "%s: msta NULL\n", __func__);
-			continue;
-		}
-
-		MORSE_MESH_DBG(mors, "msta %pM with rssi %d and peerings=%u\n",
-			       msta->addr, msta->avg_rssi, msta->mesh_no_of_peerings);
-
-		/* Ignore if number of peerings is 1 */
-		if (msta->mesh_no_of_peerings == 1)
-			continue;
+	if (!morse_mesh_update_kickout_candidate(mors_vif))
+		return;
 
-		if (!peer_addr || peer_rssi > msta->avg_rssi) {
-			peer_rssi = msta->avg_rssi;
-			peer_addr = msta->addr;
-		}
-	}
-	rcu_read_unlock();
+	peer_addr = mesh->kickout_candidate.addr;
+	peer_rssi = mesh->kickout_candidate.rssi;
 
 	/* Check if the new peer has better signal than existing peer */
-	if (peer_addr && (peer_rssi + mesh->rssi_margin) < rssi) {
+	if ((peer_rssi + mesh->rssi_margin) < rssi) {
 		struct morse_event event;
 		int ret;
 
@@ -517,6 +559,8 @@ static void morse_mac_check_for_dynamic_peering(struct morse_vif *mors_vif, u8 *
 		if (!ret) {
 			memcpy(mesh->kickout_peer_addr, peer_addr, ETH_ALEN);
 			mesh->kickout_ts = jiffies;
+			/* Chosen again once the peer has left and the number of peers changed */
+			mesh->kickout_candidate.valid = false;
 		}
 		MORSE_MESH_INFO(mors, "Kickout Peer %pM rssi %d, new peer %pM rssi %d, ret=%d\n",
 				mesh->kickout_peer_addr, peer_rssi, sa, rssi, ret);
@@ -7,6 +7,8 @@
 
 #include <linux/types.h>
 #include <linux/debugfs.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
 #include "morse.h"
 #include "mac.h"
 #include "rc.h"
@@ -61,6 +63,7 @@ static int mesh_stats_read(struct seq_file *file, void *data)
 	struct morse *mors = dev_get_drvdata(file->private);
 	int vif_id;
 
+	rcu_read_lock();
 	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
 		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
 		struct list_head *morse_sta_list;
@@ -74,14 +77,13 @@ static int mesh_stats_read(struct seq_file *file, void *data)
 		morse_sta_list = &mors_vif->ap->stas;
 
 		seq_printf(file, "%s: Peer Stats\n", morse_vif_name(vif));
-		rcu_read_lock();
 		list_for_each(pos, morse_sta_list) {
 			struct morse_sta *msta = list_entry(pos, struct morse_sta, list);
 
 			morse_print_station_stats(msta, file);
 		}
-		rcu_read_unlock();
 	}
+	rcu_read_unlock();
 	return 0;
 }
 
@@ -262,6 +264,213 @@ static int stats_csv_read(struct seq_file *file, void *data)
 	return 0;
 }
 
+/*
+ * Binary form of the rate tables, for tools polling many stations. The file is a header
+ * followed by, for each station, a station record and then its rate records. All fields are
+ * little endian, and the record lengths in the header allow fields to be appended in later
+ * versions without breaking readers.
+ */
+#define MMRC_STATS_BIN_VERSION		(1)
+
+/* Rate selection of the last update, as shown by the text tables */
+#define MMRC_STATS_BIN_SEL_BEST_TP	BIT(0)
+#define MMRC_STATS_BIN_SEL_SECOND_TP	BIT(1)
+#define MMRC_STATS_BIN_SEL_BASELINE	BIT(2)
+#define MMRC_STATS_BIN_SEL_BEST_PROB	BIT(3)
+#define MMRC_STATS_BIN_SEL_LOOKAROUND	BIT(4)
+
+struct mmrc_stats_bin_hdr {
+	__le16 version;
+	__le16 hdr_len;
+	__le16 sta_len;
+	__le16 rate_len;
+	__le32 num_stas;
+	/* Time of the snapshot, milliseconds since boot */
+	__le32 timestamp_ms;
+} __packed;
+
+struct mmrc_stats_bin_sta {
+	u8 addr[ETH_ALEN];
+	__le16 num_rates;
+	__le32 total_lookaround;
+	/* Expected throughput of the best rate, kbps */
+	__le32 expected_tput_kbps;
+} __packed;
+
+struct mmrc_stats_bin_rate {
+	u8 index;
+	u8 mcs;
+	u8 ss;
+	/* MMRC bandwidth index */
+	u8 bw;
+	u8 guard;
+	/* MMRC_STATS_BIN_SEL_* */
+	u8 selection;
+	__le16 prob;
+	__le32 evidence;
+	/* Airtime of the rate, as reported by get_tx_time() */
+	__le32 airtime;
+	/* Throughput, bps */
+	__le32 max_tput;
+	__le32 avg_tput;
+	__le32 last_sent;
+	__le32 last_success;
+	__le32 total_sent;
+	__le32 total_success;
+	__le32 mpdu_success;
+	__le32 mpdu_failure;
+} __packed;
+
+struct mmrc_stats_bin {
+	size_t len;
+	u8 data[];
+};
+
+static void stats_bin_fill_rate(const struct mmrc_table *tb, struct mmrc_rate *ratei,
+				struct mmrc_stats_bin_rate *rec)
+{
+	const struct mmrc_stats_table *rate_stats = &tb->table[ratei->index];
+
+	rec->index = ratei->index;
+	rec->mcs = ratei->rate;
+	rec->ss = ratei->ss;
+	rec->bw = ratei->bw;
+	rec->guard = ratei->guard;
+	rec->selection = 0;
+	if (ratei->index == tb->best_tp.index)
+		rec->selection |= MMRC_STATS_BIN_SEL_BEST_TP;
+	if (ratei->index == tb->second_tp.index)
+		rec->selection |= MMRC_STATS_BIN_SEL_SECOND_TP;
+	if (ratei->index == tb->baseline.index)
+		rec->selection |= MMRC_STATS_BIN_SEL_BASELINE;
+	if (ratei->index == tb->best_prob.index)
+		rec->selection |= MMRC_STATS_BIN_SEL_BEST_PROB;
+	if (ratei->index == tb->current_lookaround_rate_index)
+		rec->selection |= MMRC_STATS_BIN_SEL_LOOKAROUND;
+	rec->prob = cpu_to_le16(rate_stats->prob);
+	rec->evidence = cpu_to_le32(rate_stats->evidence);
+	rec->airtime = cpu_to_le32(get_tx_time(ratei));
+	rec->max_tput = cpu_to_le32(rate_stats->max_throughput);
+	rec->avg_tput = cpu_to_le32(rate_stats->avg_throughput_counter ?
+				    rate_stats->sum_throughput /
+				    rate_stats->avg_throughput_counter : 0);
+	rec->last_sent = cpu_to_le32(rate_stats->sent);
+	rec->last_success = cpu_to_le32(rate_stats->sent_success);
+	rec->total_sent = cpu_to_le32(rate_stats->total_sent);
+	rec->total_success = cpu_to_le32(rate_stats->total_success);
+	rec->mpdu_success = cpu_to_le32(rate_stats->back_mpdu_success);
+	rec->mpdu_failure = cpu_to_le32(rate_stats->back_mpdu_failure);
+}
+
+/* Write the records of a station, returns the bytes used or 0 if they don't fit in @avail */
+static size_t stats_bin_fill_sta(struct morse_rc_sta *mrc_sta, u8 *buf, size_t avail)
+{
+	struct morse_sta *sta = container_of(mrc_sta, struct morse_sta, rc);
+	struct mmrc_stats_bin_sta *sta_rec = (struct mmrc_stats_bin_sta *)buf;
+	struct mmrc_stats_bin_rate *rate_rec = (struct mmrc_stats_bin_rate *)(sta_rec + 1);
+	struct mmrc_table *tb = mrc_sta->tb;
+	struct mmrc_rate ratei;
+	u16 caps_size = rows_from_sta_caps(&tb->caps);
+	u16 num_rates = 0;
+	u16 i;
+
+	if (avail < sizeof(*sta_rec) + caps_size * sizeof(*rate_rec))
+		return 0;
+
+	for (i = 0; i < caps_size; i++) {
+		ratei = get_rate_row(tb, i);
+		if (!validate_rate(tb, &ratei) || i != ratei.index)
+			continue;
+
+		stats_bin_fill_rate(tb, &ratei, &rate_rec[num_rates++]);
+	}
+
+	ether_addr_copy(sta_rec->addr, sta->addr);
+	sta_rec->num_rates = cpu_to_le16(num_rates);
+	sta_rec->total_lookaround = cpu_to_le32(tb->total_lookaround);
+	sta_rec->expected_tput_kbps = cpu_to_le32(morse_rc_sta_expected_throughput(sta));
+
+	return sizeof(*sta_rec) + num_rates * sizeof(*rate_rec);
+}
+
+/* Snapshot all rate tables when the file is opened, so reads are plain copies */
+static int stats_bin_open(struct inode *inode, struct file *file)
+{
+	struct morse *mors = inode->i_private;
+	struct mmrc_stats_bin *bin;
+	struct mmrc_stats_bin_hdr *hdr;
+	struct list_head *pos;
+	size_t size = sizeof(*hdr);
+	size_t len = sizeof(*hdr);
+	u32 num_stas = 0;
+
+	/* Size the snapshot first, as it may be too large to allocate under the lock */
+	spin_lock_bh(&mors->mrc.lock);
+	list_for_each(pos, &mors->mrc.stas) {
+		struct morse_rc_sta *mrc_sta = container_of(pos, struct morse_rc_sta, list);
+
+		size += sizeof(struct mmrc_stats_bin_sta) +
+			rows_from_sta_caps(&mrc_sta->tb->caps) * sizeof(struct mmrc_stats_bin_rate);
+	}
+	spin_unlock_bh(&mors->mrc.lock);
+
+	bin = vmalloc(sizeof(*bin) + size);
+	if (!bin)
+		return -ENOMEM;
+
+	/* Stations added since sizing are left out, they'll be in the next snapshot */
+	spin_lock_bh(&mors->mrc.lock);
+	list_for_each(pos, &mors->mrc.stas) {
+		struct morse_rc_sta *mrc_sta = container_of(pos, struct morse_rc_sta, list);
+		size_t used;
+
+		spin_lock(&mrc_sta->lock);
+		used = stats_bin_fill_sta(mrc_sta, bin->data + len, size - len);
+		spin_unlock(&mrc_sta->lock);
+
+		if (!used)
+			continue;
+
+		len += used;
+		num_stas++;
+	}
+	spin_unlock_bh(&mors->mrc.lock);
+
+	hdr = (struct mmrc_stats_bin_hdr *)bin->data;
+	hdr->version = cpu_to_le16(MMRC_STATS_BIN_VERSION);
+	hdr->hdr_len = cpu_to_le16(sizeof(*hdr));
+	hdr->sta_len = cpu_to_le16(sizeof(struct mmrc_stats_bin_sta));
+	hdr->rate_len = cpu_to_le16(sizeof(struct mmrc_stats_bin_rate));
+	hdr->num_stas = cpu_to_le32(num_stas);
+	hdr->timestamp_ms = cpu_to_le32((u32)ktime_to_ms(ktime_get_boottime()));
+	bin->len = len;
+
+	file->private_data = bin;
+
+	return 0;
+}
+
+static ssize_t stats_bin_read(struct file *file, char __user *user_buf, size_t count,
+			      loff_t *ppos)
+{
+	struct mmrc_stats_bin *bin = file->private_data;
+
+	return simple_read_from_buffer(user_buf, count, ppos, bin->data, bin->len);
+}
+
+static int stats_bin_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations mmrc_stats_bin = {
+	.open = stats_bin_open,
+	.read = stats_bin_read,
+	.llseek = default_llseek,
+	.release = stats_bin_release,
+};
+
 static ssize_t set_fixed_rate(struct file *file, const char __user *user_buf,
 			      size_t count, loff_t *ppos)
 {
@@ -277,8 +486,11 @@ static ssize_t set_fixed_rate(struct file *file, const char __user *user_buf,
 	list_for_each(pos, &mors->mrc.stas) {
 		struct morse_rc_sta *mrc_sta = container_of(pos, struct morse_rc_sta, list);
 
+		spin_lock(&mrc_sta->lock);
 		fixed_rate = get_rate_row(mrc_sta->tb, value);
 		mmrc_set_fixed_rate(mrc_sta->tb, fixed_rate);
+		morse_rc_sta_table_changed(mrc_sta);
+		spin_unlock(&mrc_sta->lock);
 	}
 	spin_unlock_bh(&mors->mrc.lock);
 	return count;
@@ -292,6 +504,64 @@ static const struct file_operations mmrc_fixed_rate = {
 	.write = set_fixed_rate,
 };
 
+static int update_stats_read(struct seq_file *file, void *data)
+{
+	struct morse *mors = file->private;
+	const typeof(mors->mrc.update_stats) *stats = &mors->mrc.update_stats;
+	struct list_head *pos;
+	unsigned long now = jiffies;
+
+	spin_lock_bh(&mors->mrc.lock);
+	seq_printf(file, "period (ms): %u\n", jiffies_to_msecs(now - stats->since));
+	seq_printf(file, "updates: %llu\n", stats->count);
+	seq_printf(file, "average update (ns): %llu\n",
+		   stats->count ? div64_u64(stats->total_ns, stats->count) : 0);
+	seq_printf(file, "max update (ns): %llu\n", stats->max_ns);
+
+	list_for_each(pos, &mors->mrc.stas) {
+		struct morse_rc_sta *mrc_sta = container_of(pos, struct morse_rc_sta, list);
+		struct morse_sta *sta = container_of(mrc_sta, struct morse_sta, rc);
+		u32 tput_kbps = morse_rc_sta_expected_throughput(sta);
+
+		seq_printf(file, "\nPeer %pM\n", sta->addr);
+		seq_printf(file, "    age (ms): %u\n", jiffies_to_msecs(now - mrc_sta->added));
+		seq_printf(file, "    best rate changes: %u\n", mrc_sta->best_changes);
+		seq_printf(file, "    best rate stable for (ms): %u\n",
+			   jiffies_to_msecs(now - mrc_sta->best_changed));
+		seq_printf(file, "    best rate: MCS%u/%u %uMHz %cGI %u.%03uMbps\n",
+			   mrc_sta->expected_tput_rate.rate, mrc_sta->expected_tput_rate.ss + 1,
+			   morse_ratecode_bw_index_to_s1g_bw_mhz(mrc_sta->expected_tput_rate.bw),
+			   mrc_sta->expected_tput_rate.guard == MMRC_GUARD_SHORT ? 'S' : 'L',
+			   tput_kbps / 1000, tput_kbps % 1000);
+	}
+	spin_unlock_bh(&mors->mrc.lock);
+
+	return 0;
+}
+
+static int update_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, update_stats_read, inode->i_private);
+}
+
+static ssize_t update_stats_write(struct file *file, const char __user *user_buf,
+				  size_t count, loff_t *ppos)
+{
+	struct morse *mors = ((struct seq_file *)file->private_data)->private;
+
+	/* Any write restarts the statistics */
+	morse_rc_update_stats_reset(mors);
+	return count;
+}
+
+static const struct file_operations mmrc_update_stats = {
+	.open = update_stats_open,
+	.read = seq_read,
+	.write = update_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 void mmrc_s1g_add_mesh_debugfs(struct morse *mors)
 {
 	debugfs_create_devm_seqfile(mors->dev, "mesh_stats", mors->debug.debugfs_phy,
@@ -305,4 +575,8 @@ void mmrc_s1g_add_sta_debugfs(struct morse *mors)
 				    stats_csv_read);
 
 	debugfs_create_file("fixed_rate", 0600, mors->debug.debugfs_phy, mors, &mmrc_fixed_rate);
+	debugfs_create_file("mmrc_table_bin", 0400, mors->debug.debugfs_phy, mors,
+			    &mmrc_stats_bin);
+	debugfs_create_file("mmrc_update_stats", 0600, mors->debug.debugfs_phy, mors,
+			    &mmrc_update_stats);
 }
@@ -134,10 +134,13 @@ static enum dot11_rt_s1g_bandwidth int_bw_to_radiotap_bw_enum(int bw_mhz)
 	return bw;
 }
 
-void morse_mon_rx(struct morse *mors, struct sk_buff *rx_skb,
-		  struct morse_skb_rx_status *hdr_rx_status)
+bool morse_mon_rx(struct morse *mors, struct sk_buff *rx_skb,
+		  const struct morse_skb_rx_status *rx_status)
 {
-	struct sk_buff *skb;
+	/* The RX status sits in the headroom the radiotap header is built over, so copy it out */
+	struct morse_skb_rx_status status = *rx_status;
+	struct morse_skb_rx_status *hdr_rx_status = &status;
+	struct sk_buff *skb = rx_skb;
 	u16 flags;
 	struct morse_radiotap_hdr *hdr;
 	struct zero_length_psdu *psdu;
@@ -165,15 +168,15 @@ void morse_mon_rx(struct morse *mors, struct sk_buff *rx_skb,
 	}
 
 	if (!netif_running(morse_mon))
-		return;
+		return false;
 
-	/* There are specific radiotap fields we need
-	 * to append to our skb depending on the packet type
+	/* There are specific radiotap fields we need to prepend to the skb depending on the
+	 * packet type. They are built in place in the headroom left by the morse header, so the
+	 * frame is only reallocated if that is too small or the skb is shared.
 	 */
 	if (hdr_rx_status->flags & MORSE_RX_STATUS_FLAGS_NDP) {
-		skb = skb_copy_expand(rx_skb, sizeof(*hdr) + sizeof(*psdu), 0, GFP_KERNEL);
-		if (!skb)
-			return;
+		if (skb_cow_head(skb, sizeof(*hdr) + sizeof(*psdu)))
+			return false;
 		psdu = (struct zero_length_psdu *)skb_push(skb, sizeof(*psdu));
 
 		/* Set bits for 0 length PSDU radiotap field */
@@ -193,9 +196,8 @@ void morse_mon_rx(struct morse *mors, struct sk_buff *rx_skb,
 	} else {
 		int len = sizeof(*hdr) +
 		    sizeof(*ampdu_hdr) + sizeof(*s1g_info_hdr) + sizeof(*align_padding);
-		skb = skb_copy_expand(rx_skb, len, 0, GFP_KERNEL);
-		if (!skb)
-			return;
+		if (skb_cow_head(skb, len))
+			return false;
 
 		s1g_info_hdr = (struct radiotap_s1g_tlv *)skb_push(skb, sizeof(*s1g_info_hdr));
 
@@ -310,6 +312,8 @@ void morse_mon_rx(struct morse *mors, struct sk_buff *rx_skb,
 	memset(skb->cb, 0, sizeof(skb->cb));
 	/* Push to network interface */
 	netif_rx(skb);
+
+	return true;
 }
 
 void morse_mon_sig_field_error(const struct morse_evt_sig_field_error_evt *sig_field_error_evt)
@@ -13,8 +13,20 @@ int morse_mon_init(struct morse *mors);
 
 void morse_mon_free(struct morse *mors);
 
-void morse_mon_rx(struct morse *mors, struct sk_buff *rx_skb,
-		  struct morse_skb_rx_status *hdr_rx_status);
+/**
+ * morse_mon_rx() - Pass a received frame to the monitor interface.
+ *
+ * The radiotap header is built in the headroom of @rx_skb, which is handed to the network
+ * stack rather than copied.
+ *
+ * @mors: Morse chip struct
+ * @rx_skb: Received frame, with the morse header removed
+ * @rx_status: RX status of the frame, which may lie in the headroom of @rx_skb
+ *
+ * Return: true if @rx_skb was consumed, false if the caller still owns it
+ */
+bool morse_mon_rx(struct morse *mors, struct sk_buff *rx_skb,
+		  const struct morse_skb_rx_status *rx_status);
 
 void morse_mon_sig_field_error(const struct morse_evt_sig_field_error_evt *sig_field_error_evt);
 
@@ -16,7 +16,11 @@
 #include <linux/crc32.h>
 #if KERNEL_VERSION(4, 9, 81) < LINUX_VERSION_CODE
 #include <linux/nospec.h>
+#include <linux/percpu.h>
 #endif
+#include <linux/semaphore.h>
+#include <linux/rbtree.h>
+#include <linux/hashtable.h>
 #include "compat.h"
 #include "hw.h"
 #include "skbq.h"
@@ -42,6 +46,9 @@
 #include "uaccess.h"
 #endif
 #include "page_slicing.h"
+#ifdef CONFIG_MORSE_IPMON
+#include "ipmon.h"
+#endif
 
 #ifdef MAC80211_BACKPORT_VERSION_CODE
 #define MAC80211_VERSION_CODE MAC80211_BACKPORT_VERSION_CODE
@@ -72,6 +79,9 @@
 /** Max number of OUIs supported in vendor IE OUI filter. Must match the define in the firmware */
 #define MAX_NUM_OUI_FILTERS			(5)
 
+/** Beacon sources tracked for vendor IE event suppression are hashed into 2^bits buckets */
+#define MORSE_VENDOR_IE_BCN_SEEN_HASH_BITS	(6)
+
 /**
  * AID limit, currently limited to non-s1g for compatibility.
  *
@@ -200,9 +210,17 @@ struct morse_twt_sta_vif {
  * @dialog_token	Dialog token of Tx action frames.
  * @sta_vif		STA VIF specific data
  */
+/* TWT stations are hashed by address into 2^MORSE_TWT_STA_HASH_BITS buckets */
+#define MORSE_TWT_STA_HASH_BITS		(6)
+
 struct morse_twt {
 	struct list_head stas;
-	struct list_head wake_intervals;
+	/* TWT stations indexed by address, see MORSE_TWT_STA_HASH_BITS */
+	DECLARE_HASHTABLE(sta_hash, MORSE_TWT_STA_HASH_BITS);
+	/* Wake intervals in use, keyed by wake interval */
+	struct rb_root wake_intervals;
+	/* Unused wake interval nodes, so agreement setup rarely needs to allocate */
+	struct list_head wake_interval_pool;
 	struct list_head events;
 	struct list_head tx;
 	u8 *req_event_tx;
@@ -241,6 +259,55 @@ struct morse_custom_configs {
 	u32 duty_cycle;
 };
 
+/* Wake latency buckets (us): below 1us, then doubling up to an open ended last bucket (~8s) */
+#define MORSE_PS_STAT_LAT_BUCKETS	(24)
+/* Sleep residency buckets (ms): below 1ms, then doubling up to an open ended last bucket (~1.5d) */
+#define MORSE_PS_STAT_RES_BUCKETS	(28)
+/* Chip interface event flag bits attributed individually */
+#define MORSE_PS_STAT_EVENT_BITS	(32)
+
+/* What woke the bus, in the order morse_ps_evaluate() attributes them */
+enum morse_ps_wake_reason {
+	MORSE_PS_WAKE_TX_BUFFERED,
+	MORSE_PS_WAKE_EVENT_FLAG,
+	MORSE_PS_WAKE_WAKERS,
+	MORSE_PS_WAKE_HOLD,
+	MORSE_PS_WAKE_PREDICTED,
+	MORSE_PS_WAKE_NETWORK,
+	MORSE_PS_WAKE_ASYNC_IRQ,
+	MORSE_PS_WAKE_NUM_REASONS
+};
+
+/* Power save wake and sleep accounting, see morse_ps_stats_show() */
+struct morse_ps_stats {
+	/* Start of the statistics (ktime ns) */
+	u64 since_ns;
+	/* Last wake or sleep transition (ktime ns) */
+	u64 last_change_ns;
+	unsigned int wakes;
+	unsigned int sleeps;
+	unsigned int reasons[MORSE_PS_WAKE_NUM_REASONS];
+	/* Wakes with each event flag set, when woken for event flags */
+	unsigned int event_flags[MORSE_PS_STAT_EVENT_BITS];
+	/* Wake latency, from raising the wake pin to the bus being enabled */
+	u32 wake_lat_min_us;
+	u32 wake_lat_max_us;
+	u64 wake_lat_total_us;
+	unsigned int wake_lat_hist[MORSE_PS_STAT_LAT_BUCKETS];
+	/* Time spent asleep, from each sleep to the following wake */
+	u32 sleep_max_ms;
+	u64 sleep_total_ms;
+	unsigned int sleep_hist[MORSE_PS_STAT_RES_BUCKETS];
+	u64 awake_total_ms;
+	/* Wakes per minute: start of the current minute (ktime ns), its wakes so far, the last
+	 * complete minute and the busiest minute
+	 */
+	u64 minute_start_ns;
+	unsigned int minute_wakes;
+	unsigned int last_minute_wakes;
+	unsigned int max_minute_wakes;
+};
+
 struct morse_ps {
 	/* Number of clients requesting to talk to chip */
 	u32 wakers;
@@ -248,10 +315,35 @@ struct morse_ps {
 	bool suspended;
 	bool dynamic_ps_en;
 	unsigned long bus_ps_timeout;
+	/* Scale (in 1/MORSE_PS_TIMEOUT_SCALE_UNIT) applied to network activity timeouts */
+	u16 bus_timeout_scale;
+	/* When the bus last went to sleep and last woke (jiffies) */
+	unsigned long sleep_start;
+	unsigned long wake_start;
+	/* Keep the chip awake until this time (jiffies), see morse_ps_enable_hold() */
+	unsigned long hold_timeout;
 	/* Serialise access to the PS structure */
 	struct mutex lock;
 	struct work_struct async_wake_work;
 	struct delayed_work delayed_eval_work;
+	/* Learned periodicity of network traffic, used to wake the bus ahead of it */
+	struct {
+		/* Start of the last traffic burst that followed a sleep (jiffies) */
+		unsigned long last_burst;
+		/* Average interval between traffic bursts (jiffies), 0 if unknown */
+		unsigned long period;
+		/* Consecutive bursts that arrived within tolerance of the period */
+		u8 hits;
+		/* Consecutive pre-wakes that saw no traffic */
+		u8 misses;
+		/* The bus has slept since the last traffic burst */
+		bool slept;
+		/* The bus was woken ahead of a predicted burst which has not arrived yet */
+		bool prewoken;
+		struct delayed_work work;
+	} predict;
+	/* Protected by @lock */
+	struct morse_ps_stats stats;
 };
 
 /* Morse ACI map for page metadata */
@@ -329,6 +421,20 @@ struct morse_vendor_info {
 	enum morse_rc_method rc_method;
 };
 
+/** PNs behind the highest received that are remembered for duplicate detection */
+#define MORSE_RX_PN_WINDOW	(64)
+
+/**
+ * struct morse_sta_rx_pn - Recently received PNs for one replay counter of a peer
+ *
+ * @highest: Highest PN received
+ * @seen: Bit n is set if PN @highest - n has been received
+ */
+struct morse_sta_rx_pn {
+	u64 highest;
+	u64 seen;
+};
+
 /** Morse Private STA record */
 struct morse_sta {
 	/** pointer to next morse_sta's and used only in AP mode */
@@ -343,12 +449,21 @@ struct morse_sta {
 	enum ieee80211_sta_state state;
 	/** Whether A-MPDU is supported on this STA */
 	bool ampdu_supported;
+	/** Whether A-MSDU is supported on this STA, from its S1G capabilities */
+	bool amsdu_supported;
+	/** TX A-MSDU length limit last given to mac80211 for this STA */
+	u16 amsdu_max_len;
 	/** STA's required Minimum MPDU start spacing as reported by s1g capabs */
 	u8 ampdu_mmss;
 	/** Whether we have a TX A-MPDU on this TID */
 	bool tid_tx[IEEE80211_NUM_TIDS];
 	/** Whether we have tried to start a TX A-MPDU on this TID */
 	bool tid_start_tx[IEEE80211_NUM_TIDS];
+	/** TIDs holding a TX BA session against the interface limit, see ba_max_sessions */
+	unsigned long ba_tx_reserved;
+	/** Start and QoS data frame count of the current BA start window, per TID */
+	unsigned long ba_burst_start[IEEE80211_NUM_TIDS];
+	u16 ba_burst_frames[IEEE80211_NUM_TIDS];
 	/** Whether travelling pilots is supported */
 	enum trav_pilot_support trav_pilot_support;
 	/** Per-TID parameters */
@@ -382,6 +497,12 @@ struct morse_sta {
 	/** Counts the number of packets passed from the kernel to the driver */
 	u64 tx_pkt_count;
 
+	/**
+	 * Remaining TX airtime (usecs) per mac80211 AC for the TX queue scheduler.
+	 * Charged from tx_status and replenished by the scheduler once exhausted.
+	 */
+	atomic_t airtime_deficit[IEEE80211_NUM_ACS];
+
 	/** number of peerings established and valid only if it is mesh peer */
 	u8 mesh_no_of_peerings;
 
@@ -394,9 +515,18 @@ struct morse_sta {
 	/** Save stored status of peer STA from Header Compression Request on RX*/
 	struct morse_sta_pv1 rx_pv1_ctx;
 
+	/** PV1 headers built for this peer STA at TX, per PTID */
+	struct morse_pv1_tx_templates pv1_tx_templates;
+
 	/** Last received S1G protected action PN */
 	u64 last_rx_mgmt_pn;
 
+	/** Recently received PNs, per TID and then management, see morse_mac_rx_pn_is_dup() */
+	struct morse_sta_rx_pn rx_pn[IEEE80211_NUM_TIDS + 1];
+
+	/** Sequence control of the last frame received, per TID and then the rest */
+	__le16 rx_last_seq_ctrl[IEEE80211_NUM_TIDS + 1];
+
 	/** non-TIM mode negotiated between AP & STA */
 	enum morse_non_tim_mode non_tim_mode_status;
 
@@ -428,6 +558,15 @@ struct morse_ap {
 	 * Bitmap of AIDs currently in use. Bit position corresponds to the AID.
 	 */
 	DECLARE_BITMAP(aid_bitmap, MORSE_AP_AID_BITMAP_SIZE);
+
+	/**
+	 * Associated STAs indexed by AID (MORSE_AP_AID_BITMAP_SIZE entries). Entries are
+	 * published in morse_mac_ops_sta_state() and read under RCU.
+	 */
+	struct morse_sta __rcu **sta_by_aid;
+
+	/** S1G TIM encoding of the previous beacon */
+	struct dot11ah_s1g_tim_cache tim_cache;
 };
 
 struct morse_mbca_config {
@@ -485,6 +624,19 @@ struct morse_mesh {
 	u8 kickout_peer_addr[ETH_ALEN];
 	/** Timestamp when peer is kicked out */
 	u32 kickout_ts;
+	/**
+	 * Peer with the lowest RSSI that could be kicked out for a better one, kept for
+	 * MORSE_MESH_KICKOUT_CANDIDATE_AGE_MS so that the peer list is not walked for every
+	 * beacon from a new neighbour.
+	 */
+	struct {
+		bool valid;
+		u8 addr[ETH_ALEN];
+		s16 rssi;
+		/* Number of peers when the candidate was chosen */
+		u16 num_stas;
+		unsigned long updated;
+	} kickout_candidate;
 
 	/* Mesh Beacon Collision Avoidance state */
 	struct morse_mbca_config mbca;
@@ -522,6 +674,61 @@ struct morse_mesh_config_list {
 	spinlock_t lock;
 };
 
+/**
+ * struct morse_keep_alive - Keep-alive frame periodically sent on behalf of an application
+ */
+struct morse_keep_alive {
+	/** Sends @frame and re-arms itself every @interval_ms */
+	struct delayed_work work;
+	/** Ethernet frame to send, NULL when no keep-alive is configured */
+	u8 *frame;
+	/** Length of @frame in bytes */
+	u16 frame_len;
+	/** Period between keep-alives */
+	u32 interval_ms;
+};
+
+/**
+ * struct morse_beacon_template_key - Inputs to the S1G beacon, other than the 11n beacon IEs and
+ * RPS IE, that a beacon template was built from
+ */
+struct morse_beacon_template_key {
+	/** Generation, incremented to force the template to be rebuilt */
+	u32 gen;
+	u8 bssid[ETH_ALEN];
+	__le16 beacon_int;
+	__le16 capab_info;
+	u8 dtim_period;
+	u16 change_seq;
+	u8 sta_type;
+	bool enable_ampdu;
+	bool enable_trav_pilot;
+	bool enable_sgi_rc;
+	bool cac_enabled;
+	u16 cac_threshold;
+	struct morse_channel_info channel_info;
+};
+
+/**
+ * struct morse_beacon_template - An S1G beacon built from a given 11n beacon, with the TIM
+ * element removed so it can be reused for as long as its inputs do not change.
+ */
+struct morse_beacon_template {
+	struct morse_beacon_template_key key;
+	/** 11n beacon IEs (before and after the TIM element), followed by the RPS IE */
+	u8 *src;
+	u16 src_pre_tim_len;
+	u16 src_post_tim_len;
+	u8 src_rps_len;
+	/** S1G beacon header and IEs, without the TIM element. NULL if not yet built */
+	u8 *s1g;
+	u16 s1g_len;
+	/** Offset in @s1g the S1G TIM element is inserted at */
+	u16 tim_offset;
+	/** Offset in @s1g of the S1G beacon compatibility TSF completion field, 0 if absent */
+	u16 compat_tsf_offset;
+};
+
 /**
  * enum morse_sme_state_flags - VIF state flags in fullmac mode.
  */
@@ -615,15 +822,24 @@ struct morse_vif {
 		/** Number of elements in the OUI filter list */
 		u8 n_oui_filters;
 
+		/** Hash of the last reported filtered vendor IEs, per beacon source address */
+		DECLARE_HASHTABLE(bcn_seen, MORSE_VENDOR_IE_BCN_SEEN_HASH_BITS);
+
+		/** Number of entries in @bcn_seen */
+		u16 n_bcn_seen;
+
 		/** Spinlock to protect access to these fields */
 		spinlock_t lock;
 	} vendor_ie;
 
+	/** Keep-alive sent by the driver, see MORSE_COMMAND_SET_KEEP_ALIVE */
+	struct morse_keep_alive keep_alive;
+
 	/** SW-3908 unveiled a race condition, so sometimes we have to store a backup
 	 * of our private data when a device reassociates so that S1G information
-	 * is persisted
+	 * is persisted. STA_PRIV_BACKUP_NUM entries, allocated on the first backup.
 	 */
-	struct morse_sta sta_backups[STA_PRIV_BACKUP_NUM];
+	struct morse_sta *sta_backups;
 
 	struct morse_caps capabilities;
 	struct morse_ops operations;
@@ -641,9 +857,34 @@ struct morse_vif {
 	 */
 	struct tasklet_struct beacon_tasklet;
 
+	/**
+	 * S1G beacon templates, indexed by short beacon. Only accessed from the beacon tasklet.
+	 */
+	struct morse_beacon_template bcn_template[2];
+
+	/**
+	 * Generation of the beacon templates, see morse_beacon_template_invalidate()
+	 */
+	atomic_t bcn_template_gen;
+
+	/** TX BA sessions set up or running to stations of this interface */
+	atomic_t ba_tx_sessions;
+
 	/** Tasklet for responding to NDP probe requests received by chip */
 	struct tasklet_struct ndp_probe_req_resp;
 
+	/** Converted S1G probe response reused for NDP probe requests, see ndpprobe.c */
+	struct {
+		/** Template, NULL when none has been built since it was last invalidated */
+		struct sk_buff *skb;
+		/** Beacon template generation the template was built for */
+		int gen;
+		/** Beacon change sequence the template was built for */
+		u16 change_seq;
+		/** Protects the template, which is used from the chip IRQ path */
+		spinlock_t lock;
+	} ndp_probe_resp;
+
 	/**
 	 *  Keeping track of beacon change sequence number for both AP and STA
 	 */
@@ -683,6 +924,18 @@ struct morse_vif {
 	 */
 	const u8 *ssid_ie;
 
+	/**
+	 * Beacon template generation @beacon_buf was fetched for. The beacon is fetched again
+	 * once it changes, see morse_beacon_template_invalidate()
+	 */
+	int beacon_buf_gen;
+
+	/**
+	 * MBSSID element last built for the beacons of this transmitting BSS, see mbssid.c.
+	 * Only accessed from the beacon tasklet.
+	 */
+	struct morse_mbssid_ie_cache *mbssid_ie_cache;
+
 	/**
 	 * Flag to check if STA is in asscociated state. This gets populated in
 	 * bss_info_changed event handler. Any other place to access vif->bss_conf
@@ -785,6 +1038,11 @@ struct morse_vif {
 	 */
 	u32 mcast_tx_rate_throughput;
 
+	/**
+	 * Consecutive evaluations the weakest member has supported a higher multicast rate.
+	 */
+	u8 mcast_tx_rate_raise_evals;
+
 	/**
 	 * User configuration of non-TIM mode.
 	 */
@@ -800,6 +1058,12 @@ struct morse_vif {
 	 */
 	struct wireless_dev wdev;
 	struct net_device *ndev;
+	/** RX delivery to @ndev through GRO, see morse_wiphy_rx_napi_schedule() */
+	struct napi_struct rx_napi;
+	struct sk_buff_head rx_napi_q;
+	bool rx_napi_enabled;
+	/** Frames held from @ndev while the stack has more to send, see netdev_xmit_more() */
+	struct morse_skbq_tx_batch tx_batch;
 
 	/**
 	 * @sme_state: Bit field of state flags in fullmac mode.
@@ -808,6 +1072,283 @@ struct morse_vif {
 	unsigned long sme_state;
 };
 
+/**
+ * Chip interface statistics. Per-CPU, so they can be bumped from any context without sharing a
+ * cache line. Use MORSE_PAGE_STAT_INC() / MORSE_PAGE_STAT_ADD() to update and
+ * MORSE_PAGE_STAT_READ() to fold the per-CPU values.
+ *
+ * The statistics vendor command reports these in order, so new counters must be appended.
+ */
+struct morse_page_stats {
+	unsigned int cmd_tx;
+	unsigned int bcn_tx;
+	unsigned int mgmt_tx;
+	unsigned int data_tx;
+	unsigned int tx_burst;
+	unsigned int write_fail;
+	unsigned int no_page;
+	unsigned int cmd_no_page;
+	unsigned int cmd_rsv_page_retry;
+	unsigned int bcn_no_page;
+	unsigned int excessive_bcn_loss;
+	unsigned int queue_stop;
+	unsigned int page_owned_by_chip;
+	unsigned int tx_aged_out;
+	unsigned int tx_ps_filtered;
+	unsigned int tx_status_flushed;
+	unsigned int tx_status_page_invalid;
+	unsigned int tx_status_duty_cycle_cant_send;
+	unsigned int tx_duty_cycle_retry_disabled;
+	unsigned int tx_status_dropped;
+	unsigned int tx_status_slow_lookup;
+	unsigned int tx_tailroom_expand;
+	unsigned int tx_s1g_copy;
+	unsigned int rx_s1g_copy;
+	unsigned int rx_pn_dup;
+	unsigned int rx_retry;
+	unsigned int rx_retry_dup;
+	unsigned int skb_cache_hit;
+	unsigned int skb_cache_miss;
+	unsigned int rx_empty;
+	unsigned int rx_split;
+	unsigned int rx_zero_copy;
+	unsigned int rx_window_realloc;
+	unsigned int rx_invalid_count;
+	unsigned int irq_coalesced;
+	unsigned int invalid_checksum;
+	unsigned int invalid_tx_status_checksum;
+	unsigned int tx_aqm_dropped;
+};
+
+#define MORSE_PAGE_STAT_INC(_mors, _stat)	this_cpu_inc((_mors)->debug.page_stats->_stat)
+#define MORSE_PAGE_STAT_ADD(_mors, _stat, _n)	this_cpu_add((_mors)->debug.page_stats->_stat, (_n))
+#define MORSE_PAGE_STAT_READ(_mors, _stat) ({					\
+	unsigned int __sum = 0;							\
+	int __cpu;								\
+										\
+	for_each_possible_cpu(__cpu)						\
+		__sum += per_cpu_ptr((_mors)->debug.page_stats, __cpu)->_stat;	\
+	__sum;									\
+})
+
+/** Bus operations timed by the bus statistics, see morse_bus_stats_record() */
+enum morse_bus_stat_op {
+	MORSE_BUS_STAT_DM_READ,
+	MORSE_BUS_STAT_DM_WRITE,
+	MORSE_BUS_STAT_REG32_READ,
+	MORSE_BUS_STAT_REG32_WRITE,
+	/* Waiting to claim the bus */
+	MORSE_BUS_STAT_CLAIM,
+	/* Bus held, from claim to release */
+	MORSE_BUS_STAT_HOLD,
+	MORSE_BUS_STAT_NUM_OPS,
+};
+
+/** Transfer size buckets: up to 64, 512 and 4096 bytes, then larger */
+#define MORSE_BUS_STAT_SIZE_BUCKETS	(4)
+/** Latency buckets: below 1us, then doubling up to an open ended last bucket */
+#define MORSE_BUS_STAT_LAT_BUCKETS	(16)
+
+/**
+ * Bus operation latency statistics. Per-CPU like &struct morse_page_stats, and only
+ * updated while the enable_bus_stats module parameter is set.
+ */
+struct morse_bus_stats {
+	unsigned int hist[MORSE_BUS_STAT_NUM_OPS][MORSE_BUS_STAT_SIZE_BUCKETS]
+			 [MORSE_BUS_STAT_LAT_BUCKETS];
+	unsigned int errors[MORSE_BUS_STAT_NUM_OPS];
+	u64 total_ns[MORSE_BUS_STAT_NUM_OPS];
+};
+
+/** TX paths timed by &struct morse_tx_path_stats */
+enum morse_tx_path {
+	/* Unicast data frames to a known station, see morse_mac_tx_data() */
+	MORSE_TX_PATH_DATA,
+	/* Everything else, including management and group addressed frames */
+	MORSE_TX_PATH_GENERIC,
+	MORSE_TX_PATH_NUM,
+};
+
+/**
+ * Per-frame cost of the driver TX path, from mac80211 handing over a frame until it is
+ * queued for the chip. Per-CPU like &struct morse_bus_stats, and only updated while the
+ * enable_tx_path_stats module parameter is set.
+ */
+struct morse_tx_path_stats {
+	u64 frames[MORSE_TX_PATH_NUM];
+	u64 total_ns[MORSE_TX_PATH_NUM];
+	u64 max_ns[MORSE_TX_PATH_NUM];
+};
+
+/** Points on the driver data path stamped by the packet latency sampler */
+enum morse_pkt_lat_stage {
+	/* Handed over by mac80211 */
+	MORSE_PKT_LAT_TX_MAC,
+	/* Queued on a morse skbq */
+	MORSE_PKT_LAT_TX_SKBQ,
+	/* Written to the chip */
+	MORSE_PKT_LAT_TX_BUS,
+	/* Matched to its tx_status */
+	MORSE_PKT_LAT_TX_STATUS,
+	/* Status reported to mac80211 */
+	MORSE_PKT_LAT_TX_DONE,
+	/* Read from the chip */
+	MORSE_PKT_LAT_RX_BUS,
+	/* Taken off the RX skbq by the dispatch work */
+	MORSE_PKT_LAT_RX_DISPATCH,
+	/* Handed to mac80211 */
+	MORSE_PKT_LAT_RX_MAC,
+	MORSE_PKT_LAT_NUM_STAGES,
+};
+
+/** Intervals between the stages of &enum morse_pkt_lat_stage kept as histograms */
+enum morse_pkt_lat_seg {
+	/* TX_MAC to TX_SKBQ: S1G conversion and TX info */
+	MORSE_PKT_LAT_SEG_TX_DRIVER,
+	/* TX_SKBQ to TX_BUS: waiting in the host queue */
+	MORSE_PKT_LAT_SEG_TX_QUEUE,
+	/* TX_BUS to TX_STATUS: on the chip and over the air */
+	MORSE_PKT_LAT_SEG_TX_AIR,
+	/* TX_STATUS to TX_DONE */
+	MORSE_PKT_LAT_SEG_TX_REPORT,
+	MORSE_PKT_LAT_SEG_TX_TOTAL,
+	/* RX_BUS to RX_DISPATCH: waiting in the host queue */
+	MORSE_PKT_LAT_SEG_RX_QUEUE,
+	/* RX_DISPATCH to RX_MAC: S1G conversion */
+	MORSE_PKT_LAT_SEG_RX_DRIVER,
+	MORSE_PKT_LAT_SEG_RX_TOTAL,
+	MORSE_PKT_LAT_NUM_SEGS,
+};
+
+/** Number of packets that may be followed through the driver at once */
+#define MORSE_PKT_LAT_SLOTS		(32)
+
+/**
+ * A packet being followed by the latency sampler. The slot is owned by whoever sets @skb,
+ * which is only used as a key and never dereferenced.
+ */
+struct morse_pkt_lat_slot {
+	struct sk_buff *skb;
+	/* Stage timestamps (ns), 0 where the stage has not been reached */
+	u64 ts[MORSE_PKT_LAT_NUM_STAGES];
+	/* enum morse_page_aci, TX only */
+	u8 aci;
+};
+
+/**
+ * Per-packet latency histograms, per access category. Per-CPU like &struct morse_bus_stats,
+ * and only updated while the enable_pkt_latency module parameter is set.
+ */
+struct morse_pkt_lat_stats {
+	unsigned int hist[MORSE_PKT_LAT_NUM_SEGS][IEEE80211_NUM_ACS][MORSE_BUS_STAT_LAT_BUCKETS];
+	u64 total_ns[MORSE_PKT_LAT_NUM_SEGS][IEEE80211_NUM_ACS];
+	u64 max_ns[MORSE_PKT_LAT_NUM_SEGS][IEEE80211_NUM_ACS];
+	/* Samples abandoned because the packet was dropped or never completed */
+	unsigned int lost;
+	/* Samples skipped because every slot was in use */
+	unsigned int no_slot;
+};
+
+/** Startup phases recorded in &struct morse_boot_timeline */
+enum morse_boot_phase {
+	/** From driver creation until the firmware is first looked up */
+	MORSE_BOOT_PHASE_BUS_PROBE,
+	/** Restart from a fault, until the firmware is reloaded and restored */
+	MORSE_BOOT_PHASE_RESTART,
+	MORSE_BOOT_PHASE_FW_REQUEST,
+	MORSE_BOOT_PHASE_CHIP_RESET,
+	MORSE_BOOT_PHASE_FW_DOWNLOAD,
+	MORSE_BOOT_PHASE_BCF_LOAD,
+	/** Starting the firmware until its host table is found and checked */
+	MORSE_BOOT_PHASE_FW_BOOT,
+	MORSE_BOOT_PHASE_MAC_INIT,
+	MORSE_BOOT_PHASE_MAC_REGISTER,
+	/** First beacon enabled or association, recorded as a point in time */
+	MORSE_BOOT_PHASE_FIRST_LINK,
+	MORSE_BOOT_PHASE_NUM,
+};
+
+/**
+ * Timeline of the last probe or restart. Times are relative to @origin_ns, and written only
+ * by the probing or restarting thread.
+ */
+struct morse_boot_timeline {
+	u64 origin_ns;
+	bool restart;
+	u64 begin_ns[MORSE_BOOT_PHASE_NUM];
+	u64 end_ns[MORSE_BOOT_PHASE_NUM];
+	/** Times a phase was begun, more than one when firmware loading is retried */
+	u8 attempts[MORSE_BOOT_PHASE_NUM];
+	int ret[MORSE_BOOT_PHASE_NUM];
+};
+
+/**
+ * ECSA channel switch outage accounting. The outage runs from when the switch leaves the old
+ * channel until the first beacon is sent (AP) or received (STA) on the new one.
+ */
+struct morse_ecsa_stats {
+	/** When the switch in progress left the old channel (ns), 0 if there is none */
+	atomic64_t start_ns;
+	unsigned int switches;
+	u32 last_outage_us;
+	u32 max_outage_us;
+	u64 total_outage_us;
+};
+
+/** Buckets of the sliding window in &struct morse_duty_cycle_budget */
+#define MORSE_DUTY_CYCLE_BUCKETS	(60)
+
+/**
+ * Host estimate of the TX airtime used against the regulatory duty cycle. Airtime from
+ * tx_status is summed per bucket over a sliding window of MORSE_DUTY_CYCLE_BUCKETS buckets.
+ * Protected by @lock.
+ */
+struct morse_duty_cycle_budget {
+	spinlock_t lock;
+	u32 bucket_us[MORSE_DUTY_CYCLE_BUCKETS];
+	/** Bucket being filled, and when it started (jiffies) */
+	int cur;
+	unsigned long cur_start;
+	/** Sum of @bucket_us */
+	u64 used_us;
+	/** TX scheduler visits each AC was held for to save the budget */
+	unsigned int held[IEEE80211_NUM_ACS];
+};
+
+/** Most distinct command message IDs tracked by &struct morse_cmd_stats */
+#define MORSE_CMD_STAT_MAX_IDS		(128)
+/** Latency buckets: below 1us, then doubling up to an open ended last bucket (~8s) */
+#define MORSE_CMD_STAT_LAT_BUCKETS	(24)
+
+/**
+ * Statistics for one command message ID. Latency runs from when the command is first queued
+ * to the chip until its response (or final failure), so it includes bus time, firmware
+ * processing and any retries. Wait time is spent on the host before that, for a free
+ * command slot.
+ */
+struct morse_cmd_stat {
+	u16 message_id;
+	unsigned int count;
+	unsigned int retries;
+	unsigned int timeouts;
+	unsigned int errors;
+	u32 min_us;
+	u32 max_us;
+	u64 total_us;
+	u64 wait_total_us;
+	u32 wait_max_us;
+	unsigned int hist[MORSE_CMD_STAT_LAT_BUCKETS];
+};
+
+/** Per message ID command statistics, see morse_cmd_stats_show() */
+struct morse_cmd_stats {
+	spinlock_t lock;
+	/** Command IDs beyond MORSE_CMD_STAT_MAX_IDS */
+	unsigned int untracked;
+	int num;
+	struct morse_cmd_stat ent[MORSE_CMD_STAT_MAX_IDS];
+};
+
 struct morse_debug {
 	struct dentry *debugfs_phy;
 #ifdef CONFIG_MORSE_DEBUG_TXSTATUS
@@ -829,32 +1370,31 @@ struct morse_debug {
 			unsigned int rx_count;
 		} mcs10;
 	} mcs_stats_tbl;
-	struct {
-		unsigned int cmd_tx;
-		unsigned int bcn_tx;
-		unsigned int mgmt_tx;
-		unsigned int data_tx;
-		unsigned int write_fail;
-		unsigned int no_page;
-		unsigned int cmd_no_page;
-		unsigned int cmd_rsv_page_retry;
-		unsigned int bcn_no_page;
-		unsigned int excessive_bcn_loss;
-		unsigned int queue_stop;
-		unsigned int page_owned_by_chip;
-		unsigned int tx_aged_out;
-		unsigned int tx_ps_filtered;
-		unsigned int tx_status_flushed;
-		unsigned int tx_status_page_invalid;
-		unsigned int tx_status_duty_cycle_cant_send;
-		unsigned int tx_duty_cycle_retry_disabled;
-		unsigned int tx_status_dropped;
-		unsigned int rx_empty;
-		unsigned int rx_split;
-		unsigned int rx_invalid_count;
-		unsigned int invalid_checksum;
-		unsigned int invalid_tx_status_checksum;
-	} page_stats;
+	struct morse_page_stats __percpu *page_stats;
+	struct morse_bus_stats __percpu *bus_stats;
+	struct morse_tx_path_stats __percpu *tx_path_stats;
+	/* Start of the TX path statistics window */
+	u64 tx_path_stats_since_ns;
+#ifdef CONFIG_MORSE_IPMON
+	/* Per location IPMON latency reference, reset by each probe packet */
+	u64 ipmon_time_start[IPMON_NUM_LOCS];
+	/* TX queue stops, reported in IPMON packets without folding the per-CPU page stats */
+	atomic_t ipmon_queue_stops;
+#endif
+	struct morse_pkt_lat_stats __percpu *pkt_lat_stats;
+	struct morse_pkt_lat_slot *pkt_lat_slots;
+	/* Slots currently in use, so unsampled packets skip the slot search */
+	atomic_t pkt_lat_active;
+	atomic_t pkt_lat_sample_cnt;
+	/* Start of the packet latency statistics window */
+	u64 pkt_lat_stats_since_ns;
+	/* Start of the bus statistics window, for the bus busy percentage */
+	u64 bus_stats_since_ns;
+	/* When the bus was claimed, 0 if not timed */
+	u64 bus_claimed_ns;
+	struct morse_cmd_stats *cmd_stats;
+	struct morse_boot_timeline boot;
+	struct morse_ecsa_stats ecsa_stats;
 #if defined(CONFIG_MORSE_DEBUG_IRQ)
 	struct {
 		unsigned int irq;
@@ -863,13 +1403,26 @@ struct morse_debug {
 #endif
 #ifdef CONFIG_MORSE_DEBUGFS
 	struct {
-		/* Serialise manipulation of the log queue */
+		/* Serialise clients and consumption of the log rings */
 		struct mutex lock;
 		wait_queue_head_t waitqueue;
 		int active_clients;
-		struct list_head items;
+		/* Per-CPU rings while a client is open, read by producers under RCU */
+		void __rcu *rings;
+		/* Allocation backing the rings, owned by the open client */
+		void *rings_mem;
+		/* Bytes of record data in each ring, a power of 2 */
+		u32 ring_size;
 		int enabled_channel_mask;
 	} hostif_log;
+#ifdef CONFIG_MORSE_ENABLE_TEST_MODES
+	struct {
+		/* Serialise profiler runs and access to the last result */
+		struct mutex lock;
+		char *buf;
+		size_t len;
+	} bus_profile;
+#endif
 #endif
 	struct dentry *debugfs_logging;
 };
@@ -890,10 +1443,19 @@ struct morse_survey_rx_usage_record {
 	s8 noise;
 };
 
+/** Marks an S1G channel number without a survey record */
+#define MORSE_SURVEY_NO_RECORD		(U8_MAX)
+
 struct morse_channel_survey {
 	bool first_channel_in_scan;
 	int num_records;
 	struct morse_survey_rx_usage_record *records;
+	/**
+	 * Index into records[] for each S1G channel number of the current channel map,
+	 * or MORSE_SURVEY_NO_RECORD. Each channel (and so each frequency/bandwidth pair)
+	 * owns one record.
+	 */
+	u8 record_idx[U8_MAX + 1];
 };
 
 struct morse_watchdog {
@@ -904,6 +1466,8 @@ struct morse_watchdog {
 	/* Serialise use of watchdog functions */
 	struct mutex lock;
 	int paused;
+	/* Bit 0 is set when the chip has shown signs of life since the last health check */
+	unsigned long chip_alive;
 };
 
 struct morse_stale_tx_status {
@@ -983,6 +1547,11 @@ struct morse {
 	 * or NULL if no scan is in progress (fullmac only).
 	 */
 	struct cfg80211_scan_request *scan_req;
+	/** @scan_ies: translated IE buffer shared by the results of a scan (fullmac only) */
+	struct {
+		u8 *buf;
+		int size;
+	} scan_ies;
 
 	/* Extra padding to insert at the start of each tx packet */
 	u8 extra_tx_offset;
@@ -994,26 +1563,56 @@ struct morse {
 	struct ieee80211_hw *hw;
 
 	/* Array of vif pointers, indexed by vif ID. Allocated based on max interfaces supported.
+	 * Entries are published with RCU and updated with both mors->lock and vif_list_lock held.
 	 * Do not access directly. Use morse_get_vif_* functions.
 	 */
-	struct ieee80211_vif **vif;
+	struct ieee80211_vif __rcu **vif;
 	/* Size of the above array */
 	u16 max_vifs;
 
 	/* spinlock to protect vif array */
 	spinlock_t vif_list_lock;
 
+	/* vif IDs that receive group addressed frames, recomputed when the vif array changes */
+	struct {
+		/* first STA or mesh vif, for beacons */
+		u8 beacon;
+		/* first STA vif, for probe responses */
+		u8 probe_resp;
+		/* first AP type vif, for probe requests */
+		u8 probe_req;
+		/* first vif, for any other frame */
+		u8 first;
+	} rx_vif_map;
+
 	struct device *dev;
 	/** See morse_state_flags */
 	unsigned long state_flags;
 
 	/* Command sequence counter */
 	u16 cmd_seq;
-	struct completion *cmd_comp;
 	/* Mutex to martial command completion and retries */
 	struct mutex cmd_lock;
-	/* Allow only one command at a time */
-	struct mutex cmd_wait;
+	/** Commands waiting for a response, protected by cmd_lock */
+	struct list_head cmd_inflight;
+	/** Limits the number of commands in flight, see cmd_max_in_flight */
+	struct semaphore cmd_slots;
+	/** Retries or fails commands in flight when they time out */
+	struct delayed_work cmd_timeout_work;
+	/**
+	 * Firmware events handed from the chip worker to the event worker. wq is NULL while
+	 * events are handled inline, and is protected by the queue lock.
+	 */
+	struct {
+		struct workqueue_struct *wq;
+		struct work_struct work;
+		struct sk_buff_head q;
+	} event;
+	/** Station and key commands held back for bulk replay after a restart, under lock */
+	struct {
+		bool active;
+		struct list_head cmds;
+	} cmd_restore;
 
 	/** User-initiated coredump complete signal mechanism */
 	struct completion *user_coredump_comp;
@@ -1021,7 +1620,22 @@ struct morse {
 	/** Address in hardware to write the BCF file */
 	u32 bcf_address;
 
+	/** Images from the last firmware load, reused on restart */
+	struct morse_fw_cache fw_cache;
+
 	struct tasklet_struct tasklet_txq;
+	/** High priority workqueue running the TX scheduler in place of tasklet_txq, if enabled */
+	struct workqueue_struct *txq_wq;
+	struct work_struct txq_work;
+	/** Data TX chip interface kicks are held back while the TX scheduler worker runs */
+	bool txq_defer_data_kick;
+	/**
+	 * Reschedules the TX queue tasklet when downlink held for TWT stations, or for the duty
+	 * cycle budget, is due
+	 */
+	struct timer_list txq_release_timer;
+	/** TX queue scheduler rounds in which the background AC was not reached */
+	u8 txq_bk_skipped_rounds;
 	/* Serialise high-level operations to the morse structure */
 	struct mutex lock;
 	/**
@@ -1052,6 +1666,17 @@ struct morse {
 	struct work_struct chip_if_work;
 	struct work_struct usb_irq_work;
 
+	/* Per-direction chip_if work, used instead of chip_if_work with chip_if_split_work */
+	struct workqueue_struct *chip_if_split_wq;
+	struct work_struct chip_if_rx_work;
+	struct work_struct chip_if_tx_work;
+	struct work_struct chip_if_cmd_work;
+
+	/* NAPI context used to deliver RX frames to mac80211 (enable_rx_napi) */
+	struct net_device *napi_dev;
+	struct napi_struct rx_napi;
+	struct sk_buff_head rx_napi_q;
+
 	/* Used to periodically check for stale tx skbs */
 	struct morse_stale_tx_status stale_status;
 
@@ -1083,7 +1708,8 @@ struct morse {
 	struct morse_rc mrc;
 	int rts_threshold;
 #endif
-	struct morse_vif mon_if;	/* monitor interface */
+	/* Firmware interface ID of the monitor interface, 0xFFFF if none */
+	u16 mon_if_id;
 
 	struct morse_hw_cfg *cfg;
 	const struct morse_bus_ops *bus_ops;
@@ -1100,6 +1726,7 @@ struct morse {
 	struct work_struct hw_stop;
 
 	struct morse_debug debug;
+	struct morse_skb_cache skb_cache;
 
 	char *board_serial;
 
@@ -1123,6 +1750,8 @@ struct morse {
 
 	/** Current Duty Cycle in 100ths of a percent. E.g. 10000 = 100% */
 	u32 duty_cycle;
+	/** Airtime used against @duty_cycle, see morse_mac_duty_cycle_budget_show() */
+	struct morse_duty_cycle_budget duty_cycle_budget;
 
 	struct {
 		/* read from the FW at runtime, used for coredump metadata filling */
@@ -1133,6 +1762,8 @@ struct morse {
 		struct morse_coredump_data crash;
 		/* lock for accessing / modifying crash data */
 		struct mutex lock;
+		/* set to stop the coredump in progress, so the restart goes ahead sooner */
+		bool abort;
 	} coredump;
 
 	/* Kernel time of last HW stop event */
@@ -1215,12 +1846,61 @@ int __init morse_usb_init(void);
 void __exit morse_usb_exit(void);
 #endif
 
+#ifdef CONFIG_MORSE_EMU
+int __init morse_emu_init(void);
+void __exit morse_emu_exit(void);
+#endif
+
+/*
+ * Hot path chip_if_ops calls. The ops table is fixed per chip at probe, so these test for the
+ * YAPS and pageset implementations before falling back to the indirect call, avoiding a
+ * retpoline on every TX frame.
+ */
+static inline struct morse_skbq *morse_chip_if_tc_q_from_aci(struct morse *mors, int aci)
+{
+	return INDIRECT_CALL_2(mors->cfg->ops->skbq_tc_q_from_aci, skbq_yaps_tc_q_from_aci,
+			       skbq_pageset_tc_q_from_aci, mors, aci);
+}
+
+static inline struct morse_skbq *morse_chip_if_mgmt_tc_q(struct morse *mors)
+{
+	return INDIRECT_CALL_2(mors->cfg->ops->skbq_mgmt_tc_q, skbq_yaps_mgmt_q,
+			       skbq_pageset_mgmt_tc_q, mors);
+}
+
+static inline struct morse_skbq *morse_chip_if_cmd_tc_q(struct morse *mors)
+{
+	return INDIRECT_CALL_2(mors->cfg->ops->skbq_cmd_tc_q, skbq_yaps_cmd_q,
+			       skbq_pageset_cmd_tc_q, mors);
+}
+
+static inline int morse_chip_if_tx_buffered_count(struct morse *mors)
+{
+	return INDIRECT_CALL_2(mors->cfg->ops->skbq_get_tx_buffered_count,
+			       morse_yaps_get_tx_buffered_count,
+			       morse_pagesets_get_tx_buffered_count, mors);
+}
+
 static inline bool morse_is_data_tx_allowed(struct morse *mors)
 {
 	return !test_bit(MORSE_STATE_FLAG_DATA_TX_STOPPED, &mors->state_flags) &&
 	    !test_bit(MORSE_DATA_TRAFFIC_PAUSE_PEND, &mors->chip_if->event_flags);
 }
 
+/**
+ * morse_watchdog_chip_alive - Record that the chip has just delivered traffic to the host
+ *
+ * @mors: Morse chip instance
+ *
+ * Lets the next health check be skipped, as the chip has already proven it is responsive.
+ */
+static inline void morse_watchdog_chip_alive(struct morse *mors)
+{
+	/* Only dirty the cache line once per health check interval */
+	if (!test_bit(0, &mors->watchdog.chip_alive))
+		set_bit(0, &mors->watchdog.chip_alive);
+}
+
 static inline struct ieee80211_vif *morse_vif_to_ieee80211_vif(struct morse_vif *mors_vif)
 {
 	return container_of((void *)mors_vif, struct ieee80211_vif, drv_priv);
@@ -1282,6 +1962,7 @@ static inline bool is_assoc_frame(__le16 frame_control)
 
 int morse_beacon_init(struct morse_vif *mors_vif);
 void morse_beacon_finish(struct morse_vif *mors_vif);
+void morse_beacon_template_invalidate(struct morse_vif *mors_vif);
 void morse_beacon_irq_handle(struct morse *mors, u32 status);
 
 /**
@@ -1311,8 +1992,9 @@ int morse_ndp_probe_req_resp_init(struct morse_vif *mors_vif);
 void morse_ndp_probe_req_resp_finish(struct morse_vif *mors_vif);
 
 /**
- * morse_ndp_probe_req_resp_irq_handle - Schedules NDP probe request tasklet for VIF
- *					based on the IRQ status
+ * morse_ndp_probe_req_resp_irq_handle - Responds to NDP probe requests for each VIF
+ *					based on the IRQ status, from the probe response
+ *					template when current, else via the tasklet
  *
  * @mors:	Global morse struct
  * @status:	NDP probe request IRQ status
@@ -14,6 +14,11 @@
 
 static unsigned long ndp_probe_irqs_enabled;
 
+static bool ndp_probe_resp_template __read_mostly;
+module_param(ndp_probe_resp_template, bool, 0644);
+MODULE_PARM_DESC(ndp_probe_resp_template,
+		 "Answer NDP probe requests from the IRQ path with a cached probe response");
+
 void morse_fill_tx_info(struct morse *mors,
 			struct morse_skb_tx_info *tx_info,
 			struct sk_buff *skb, struct morse_vif *mors_vif, int tx_bw_mhz)
@@ -36,18 +41,124 @@ void morse_fill_tx_info(struct morse *mors,
 	tx_info->rates[1].count = 0;
 }
 
-static void morse_ndp_probe_req_resp_tasklet(unsigned long data)
+/*
+ * The probe response template follows the beacon template generation, which is bumped whenever
+ * the BSS configuration or vendor IEs change. Channel switches change the response in ways
+ * that generation does not capture, so they always take the tasklet path.
+ */
+static bool morse_ndp_probe_resp_template_allowed(struct morse_vif *mors_vif)
 {
-	int ret;
+	return READ_ONCE(ndp_probe_resp_template) && !mors_vif->ecsa_chan_configured &&
+	       !mors_vif->mask_ecsa_info_in_beacon && !mors_vif->chan_switch_in_progress;
+}
+
+static void morse_ndp_probe_resp_template_free(struct morse_vif *mors_vif)
+{
+	struct sk_buff *skb;
+
+	spin_lock_bh(&mors_vif->ndp_probe_resp.lock);
+	skb = mors_vif->ndp_probe_resp.skb;
+	mors_vif->ndp_probe_resp.skb = NULL;
+	spin_unlock_bh(&mors_vif->ndp_probe_resp.lock);
+
+	dev_kfree_skb_any(skb);
+}
+
+static void morse_ndp_probe_resp_template_store(struct morse_vif *mors_vif,
+						const struct sk_buff *skb, int gen)
+{
+	struct sk_buff *copy = skb_copy(skb, GFP_ATOMIC);
+	struct sk_buff *old;
+
+	if (!copy)
+		return;
+
+	spin_lock_bh(&mors_vif->ndp_probe_resp.lock);
+	old = mors_vif->ndp_probe_resp.skb;
+	mors_vif->ndp_probe_resp.skb = copy;
+	mors_vif->ndp_probe_resp.gen = gen;
+	mors_vif->ndp_probe_resp.change_seq = mors_vif->s1g_bcn_change_seq;
+	spin_unlock_bh(&mors_vif->ndp_probe_resp.lock);
+
+	dev_kfree_skb_any(old);
+}
+
+/* Return a copy of the probe response template if it is still current, else NULL */
+static struct sk_buff *morse_ndp_probe_resp_template_get(struct morse_vif *mors_vif)
+{
+	struct sk_buff *skb = NULL;
+
+	if (!morse_ndp_probe_resp_template_allowed(mors_vif))
+		return NULL;
+
+	spin_lock_bh(&mors_vif->ndp_probe_resp.lock);
+	if (mors_vif->ndp_probe_resp.skb &&
+	    mors_vif->ndp_probe_resp.gen == atomic_read(&mors_vif->bcn_template_gen) &&
+	    mors_vif->ndp_probe_resp.change_seq == mors_vif->s1g_bcn_change_seq)
+		skb = skb_copy(mors_vif->ndp_probe_resp.skb, GFP_ATOMIC);
+	spin_unlock_bh(&mors_vif->ndp_probe_resp.lock);
+
+	return skb;
+}
+
+/* Queue an S1G probe response to the chip */
+static int morse_ndp_probe_resp_tx(struct morse *mors, struct morse_vif *mors_vif,
+				   struct sk_buff *skb)
+{
+	struct morse_skb_tx_info tx_info = { 0 };
 	struct morse_skbq *mq;
+	int ret;
+
+	mq = morse_chip_if_mgmt_tc_q(mors);
+	if (!mq) {
+		MORSE_ERR(mors,
+			  "%s: mors->cfg->ops->skbq_mgmt_tc_q failed, no matching Q found\n",
+			  __func__);
+		kfree_skb(skb);
+		return -ENOENT;
+	}
+
+	/* Always send back at 1mhz */
+	morse_fill_tx_info(mors, &tx_info, skb, mors_vif, 1);
+
+	MORSE_DBG(mors, "Generated Probe Response for NDP probe request\n");
+	ret = morse_skbq_skb_tx(mq, &skb, &tx_info, MORSE_SKB_CHAN_MGMT);
+	if (ret)
+		MORSE_ERR(mors, "%s failed\n", __func__);
+
+	return ret;
+}
+
+/*
+ * Respond from the chip IRQ path using the probe response template, skipping the tasklet and
+ * the S1G conversion. Only the timestamp differs between responses.
+ */
+static bool morse_ndp_probe_resp_tx_template(struct morse *mors, struct morse_vif *mors_vif)
+{
+	struct ieee80211_mgmt *probe_resp;
+	struct sk_buff *skb = morse_ndp_probe_resp_template_get(mors_vif);
+
+	if (!skb)
+		return false;
+
+	probe_resp = (struct ieee80211_mgmt *)skb->data;
+	probe_resp->u.probe_resp.timestamp =
+	    cpu_to_le64(morse_mac_generate_timestamp_for_frame(mors_vif));
+
+	morse_ndp_probe_resp_tx(mors, mors_vif, skb);
+	return true;
+}
+
+static void morse_ndp_probe_req_resp_tasklet(unsigned long data)
+{
 	struct sk_buff *skb;
 	struct morse *mors;
 	struct ieee80211_vif *vif;
 	struct ieee80211_mgmt *probe_resp;
 	struct morse_vif *mors_vif = (struct morse_vif *)data;
-	struct morse_skb_tx_info tx_info = { 0 };
 	int tx_bw_mhz = 1;
 	struct ieee80211_tx_info *info;
+	int gen;
 
 	if (!mors_vif) {
 		MORSE_WARN_ON(FEATURE_ID_MGMT_FRAMES, !mors_vif);
@@ -62,6 +173,9 @@ static void morse_ndp_probe_req_resp_tasklet(unsigned long data)
 		return;
 	}
 
+	/* Sampled before building, so a change made meanwhile invalidates the new template */
+	gen = atomic_read(&mors_vif->bcn_template_gen);
+
 	skb = ieee80211_proberesp_get(mors->hw, vif);
 	if (!skb) {
 		MORSE_ERR(mors, "%s: ieee80211_proberesp_get failed\n", __func__);
@@ -71,15 +185,6 @@ static void morse_ndp_probe_req_resp_tasklet(unsigned long data)
 	info = IEEE80211_SKB_CB(skb);
 	info->control.vif = vif;
 
-	mq = mors->cfg->ops->skbq_mgmt_tc_q(mors);
-	if (!mq) {
-		MORSE_ERR(mors,
-			  "%s: mors->cfg->ops->skbq_mgmt_tc_q failed, no matching Q found\n",
-			  __func__);
-		kfree_skb(skb);
-		return;
-	}
-
 	probe_resp = (struct ieee80211_mgmt *)skb->data;
 
 	/* Make it a broadcast probe request */
@@ -92,13 +197,10 @@ static void morse_ndp_probe_req_resp_tasklet(unsigned long data)
 		return;
 	}
 
-	/* Always send back at 1mhz */
-	morse_fill_tx_info(mors, &tx_info, skb, mors_vif, 1);
+	if (morse_ndp_probe_resp_template_allowed(mors_vif))
+		morse_ndp_probe_resp_template_store(mors_vif, skb, gen);
 
-	MORSE_DBG(mors, "Generated Probe Response for NDP probe request\n");
-	ret = morse_skbq_skb_tx(mq, &skb, &tx_info, MORSE_SKB_CHAN_MGMT);
-	if (ret)
-		MORSE_ERR(mors, "%s failed\n", __func__);
+	morse_ndp_probe_resp_tx(mors, mors_vif, skb);
 }
 
 void morse_ndp_probe_req_resp_irq_handle(struct morse *mors, u32 status)
@@ -116,7 +218,8 @@ void morse_ndp_probe_req_resp_irq_handle(struct morse *mors, u32 status)
 			vif = __morse_get_vif_from_vif_id(mors, count);
 			mors_vif = ieee80211_vif_to_morse_vif(vif);
 
-			tasklet_schedule(&mors_vif->ndp_probe_req_resp);
+			if (!morse_ndp_probe_resp_tx_template(mors, mors_vif))
+				tasklet_schedule(&mors_vif->ndp_probe_req_resp);
 		}
 		masked_status >>= 1;
 		count++;
@@ -146,6 +249,8 @@ int morse_ndp_probe_req_resp_enable(struct morse_vif *mors_vif, bool enable)
 
 int morse_ndp_probe_req_resp_init(struct morse_vif *mors_vif)
 {
+	spin_lock_init(&mors_vif->ndp_probe_resp.lock);
+	mors_vif->ndp_probe_resp.skb = NULL;
 	tasklet_init(&mors_vif->ndp_probe_req_resp,
 		     morse_ndp_probe_req_resp_tasklet, (unsigned long)mors_vif);
 
@@ -156,4 +261,5 @@ void morse_ndp_probe_req_resp_finish(struct morse_vif *mors_vif)
 {
 	morse_ndp_probe_req_resp_enable(mors_vif, false);
 	tasklet_kill(&mors_vif->ndp_probe_req_resp);
+	morse_ndp_probe_resp_template_free(mors_vif);
 }
@@ -6,6 +6,9 @@
 
 #include <linux/inetdevice.h>
 #include <linux/in.h>
+#include <linux/etherdevice.h>
+#include <linux/netdevice.h>
+#include <linux/timer.h>
 
 #include "morse.h"
 #include "debug.h"
@@ -14,6 +17,9 @@
 
 #define DHCP_OFFLOAD_MAX_CMD_SIZE			(256)
 
+/* Longest supported keep-alive period, one day */
+#define KEEP_ALIVE_INTERVAL_S_MAX			(24 * 60 * 60)
+
 static int append_ip_addr_to_string(char *str, int n, u32 ip)
 {
 	u8 *ptr = (u8 *)&ip;
@@ -83,3 +89,94 @@ exit:
 	}
 	return ret;
 }
+
+static void morse_offload_keep_alive_arm(struct morse_keep_alive *ka)
+{
+	/* Rounded so the host wakes for this together with other timers due around the same time */
+	queue_delayed_work(system_power_efficient_wq, &ka->work,
+			   round_jiffies_relative(msecs_to_jiffies(ka->interval_ms)));
+}
+
+static void morse_offload_keep_alive_work(struct work_struct *work)
+{
+	struct morse_keep_alive *ka = container_of(to_delayed_work(work),
+						   struct morse_keep_alive, work);
+	struct morse_vif *mors_vif = container_of(ka, struct morse_vif, keep_alive);
+	struct ieee80211_vif *vif = morse_vif_to_ieee80211_vif(mors_vif);
+	struct wireless_dev *wdev = ieee80211_vif_to_wdev(vif);
+	struct net_device *ndev = wdev ? wdev->netdev : NULL;
+	struct sk_buff *skb;
+
+	if (!ndev || !netif_running(ndev) || !morse_mac_is_sta_vif_associated(vif))
+		goto rearm;
+
+	skb = alloc_skb(LL_RESERVED_SPACE(ndev) + ka->frame_len, GFP_KERNEL);
+	if (!skb)
+		goto rearm;
+
+	skb_reserve(skb, LL_RESERVED_SPACE(ndev));
+	memcpy(skb_put(skb, ka->frame_len), ka->frame, ka->frame_len);
+	ether_addr_copy(((struct ethhdr *)skb->data)->h_source, vif->addr);
+
+	skb->dev = ndev;
+	skb->protocol = ((struct ethhdr *)skb->data)->h_proto;
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, ETH_HLEN);
+	dev_queue_xmit(skb);
+
+rearm:
+	morse_offload_keep_alive_arm(ka);
+}
+
+int morse_offload_keep_alive_config(struct morse_vif *mors_vif, struct morse_cmd_keep_alive *cmd)
+{
+	struct morse_keep_alive *ka;
+	u32 interval_s;
+	u16 frame_len;
+	u8 *frame = NULL;
+
+	if (!mors_vif || morse_vif_to_ieee80211_vif(mors_vif)->type != NL80211_IFTYPE_STATION)
+		return -EFAULT;
+
+	ka = &mors_vif->keep_alive;
+	interval_s = le32_to_cpu(cmd->interval_s);
+	frame_len = (cmd->hdr.len + sizeof(cmd->hdr)) - sizeof(*cmd);
+
+	if (interval_s) {
+		if (frame_len < ETH_HLEN || frame_len > MORSE_KEEP_ALIVE_FRAME_LEN_MAX ||
+		    interval_s > KEEP_ALIVE_INTERVAL_S_MAX)
+			return -EINVAL;
+
+		frame = kmemdup(cmd->frame, frame_len, GFP_KERNEL);
+		if (!frame)
+			return -ENOMEM;
+	}
+
+	morse_offload_keep_alive_finish(mors_vif);
+
+	if (!frame)
+		return 0;
+
+	ka->frame = frame;
+	ka->frame_len = frame_len;
+	ka->interval_ms = interval_s * MSEC_PER_SEC;
+	morse_offload_keep_alive_arm(ka);
+
+	return 0;
+}
+
+void morse_offload_keep_alive_init(struct morse_vif *mors_vif)
+{
+	INIT_DELAYED_WORK(&mors_vif->keep_alive.work, morse_offload_keep_alive_work);
+	mors_vif->keep_alive.frame = NULL;
+}
+
+void morse_offload_keep_alive_finish(struct morse_vif *mors_vif)
+{
+	struct morse_keep_alive *ka = &mors_vif->keep_alive;
+
+	cancel_delayed_work_sync(&ka->work);
+	kfree(ka->frame);
+	ka->frame = NULL;
+	ka->frame_len = 0;
+}
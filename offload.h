@@ -34,4 +34,31 @@
  */
 int morse_offload_dhcpc_set_address(struct morse *mors, struct morse_evt_dhcp_lease_update *evt);
 
+/**
+ * @brief Configure (or stop) the periodic keep-alive frame of a STA interface
+ * The driver sends the frame itself, so applications that only transmit to keep NAT and ARP
+ * state fresh need not wake up. The frame is queued to the interface like any other data frame,
+ * so it is encrypted by mac80211 and held by the firmware until a TWT service period or power
+ * save wake like the rest of the station's traffic.
+ *
+ * @param mors_vif Interface to send the keep-alive on
+ * @param cmd Keep-alive configuration command
+ * @return int 0 on success else error number
+ */
+int morse_offload_keep_alive_config(struct morse_vif *mors_vif, struct morse_cmd_keep_alive *cmd);
+
+/**
+ * @brief Initialise the keep-alive state of an interface
+ *
+ * @param mors_vif Interface to initialise
+ */
+void morse_offload_keep_alive_init(struct morse_vif *mors_vif);
+
+/**
+ * @brief Stop sending keep-alives on an interface and free the configured frame
+ *
+ * @param mors_vif Interface to stop
+ */
+void morse_offload_keep_alive_finish(struct morse_vif *mors_vif);
+
 #endif /* !_MORSE_OFFLOAD_H_ */
@@ -81,13 +81,12 @@ static void morse_insert_page_slice_element(struct morse_vif *mors_vif,
 	u32 element_size;
 	struct page_slice_element *page_slice_elem;
 	struct page_slicing *page_slicing_data = &mors_vif->page_slicing_info;
-	u32 page_bitmap = 0;
+	u32 page_bitmap;
 	u32 page_bitmap_size;
-	bool update_bitmap = false;
+	u32 block_mask;
 	u8 block_idx = page_slicing_data->tim_bitmap_ctrl_offset / S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-	u8 offset = 0;
 	u8 last_block_idx;
-	u8 no_of_blocks = 0;
+	u8 no_of_blocks;
 	u8 page_period = page_slicing_data->page_period;
 	u8 page_bitmap_byte_offset = block_idx / PAGE_BITMAP_NUMBER_OF_BLOCKS_PER_BYTE;
 	u8 page_bitmap_first_block = page_bitmap_byte_offset *
@@ -96,40 +95,18 @@ static void morse_insert_page_slice_element(struct morse_vif *mors_vif,
 	last_block_idx = (page_slicing_data->tim_bitmap_ctrl_offset +
 		page_slicing_data->tim_virtual_map_len - 1) / S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
 
-	/* Update page bitmap by going through the every block i.e, 64 AIDs
-	 * (8 sub blocks - 8 octets).
+	/* First & last octet(i.e., 1st and last block) of TIM PVB will have traffic
+	 * buffered for atleast one STA, the remaining blocks are taken from the
+	 * summary built when the PVB was saved.
 	 */
-	for (; block_idx <= last_block_idx; block_idx++) {
-		/* First & last octet(i.e., 1st and last block) of TIM PVB will have traffic
-		 * buffered for atleast one STA. So set the corresponding bit for these two
-		 * blocks in page bitmap.
-		 */
-		if (block_idx == page_slicing_data->block_offset ||
-			block_idx == last_block_idx) {
-			update_bitmap = true;
-			/* mac80211's TIM PVB may not have all 8 octets (subblocks) of 1st block.
-			 * So increase offset based on the bitmap offset.
-			 */
-			if (block_idx == page_slicing_data->block_offset)
-				offset = (block_idx + 1) * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK -
-							page_slicing_data->tim_bitmap_ctrl_offset;
-		} else {
-			/* set the block in the page bitmap even if one AID (belonging to the block)
-			 * is set.
-			 */
-			if (*(u64 *)(page_slicing_data->tim_virtual_map + offset))
-				update_bitmap = true;
+	block_mask = page_slicing_data->block_mask;
+	if (block_idx < NUMBER_OF_BLOCKS_PER_PAGE)
+		block_mask |= BIT(block_idx);
+	if (last_block_idx < NUMBER_OF_BLOCKS_PER_PAGE)
+		block_mask |= BIT(last_block_idx);
 
-			/* Move to next block */
-			offset += S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-		}
-		if (update_bitmap) {
-			page_bitmap |= 1 << (block_idx - page_bitmap_first_block);
-			no_of_blocks++;
-		}
-		/* Reset update flag */
-		update_bitmap = false;
-	}
+	page_bitmap = block_mask >> page_bitmap_first_block;
+	no_of_blocks = hweight32(block_mask);
 
 	/* Store the number of blocks to be scheduled during the page period */
 	page_slicing_data->total_number_of_blocks = no_of_blocks;
@@ -194,34 +171,73 @@ static void morse_insert_page_slice_element(struct morse_vif *mors_vif,
 	}
 }
 
-static u8 morse_page_slicing_find_next_block(struct page_slicing *page_slicing_data,
-										u8 no_of_blocks)
+/**
+ * morse_page_slicing_update_block_mask() - Summarise which blocks of the saved PVB are non-empty.
+ *
+ * @page_slicing_data: pointer to page slicing data holding the saved TIM PVB
+ *
+ * Built once per DTIM so that the page bitmap and the search for the next block with
+ * buffered traffic are resolved with bit operations instead of rescanning the PVB.
+ */
+static void morse_page_slicing_update_block_mask(struct page_slicing *page_slicing_data)
 {
-	u64 block_bitmap = *(u64 *)(page_slicing_data->tim_virtual_map +
-							page_slicing_data->tim_virtual_map_index);
-	u8 len_in_octets = 0;
+	const u8 *tim_pvb = page_slicing_data->tim_virtual_map;
+	u16 octet = page_slicing_data->tim_bitmap_ctrl_offset;
+	u32 block_mask = 0;
+	u8 i;
 
-	while (!block_bitmap) {
-		/* when searching for 1st block, ignore blocks without any AID set*/
-		if (!no_of_blocks)
-			page_slicing_data->tim_virtual_map_index += S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-		else /* Move to next block */
-			len_in_octets += S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-
-		block_bitmap = *(u64 *)(page_slicing_data->tim_virtual_map +
-					page_slicing_data->tim_virtual_map_index + len_in_octets);
+	for (i = 0; i < page_slicing_data->tim_virtual_map_len; i++, octet++) {
+		u16 block = octet / S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
 
-		if (page_slicing_data->tim_virtual_map_index + len_in_octets >
-				page_slicing_data->tim_virtual_map_len)
+		if (block >= NUMBER_OF_BLOCKS_PER_PAGE)
 			break;
+		if (tim_pvb[i])
+			block_mask |= BIT(block);
+	}
+
+	page_slicing_data->block_mask = block_mask;
+}
+
+/**
+ * morse_page_slicing_find_next_block() - Find the next block of the saved PVB with traffic.
+ *
+ * @page_slicing_data: pointer to page slicing data holding the saved TIM PVB
+ * @no_of_blocks: number of blocks already included in the current TIM slice
+ *
+ * When searching for the first block of a slice, blocks without any AID set are skipped by
+ * moving the virtual map index. Otherwise they are included in the returned length so the
+ * slice stays contiguous.
+ *
+ * Return: number of PVB octets to copy from the virtual map index, or 0 if no block with
+ * buffered traffic remains.
+ */
+static u8 morse_page_slicing_find_next_block(struct page_slicing *page_slicing_data,
+										u8 no_of_blocks)
+{
+	u16 ctrl_offset = page_slicing_data->tim_bitmap_ctrl_offset;
+	u16 start = ctrl_offset + page_slicing_data->tim_virtual_map_index;
+	u16 map_end = ctrl_offset + page_slicing_data->tim_virtual_map_len;
+	u16 block = start / S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
+	u16 block_end;
+	u32 pending;
+
+	if (block >= NUMBER_OF_BLOCKS_PER_PAGE)
+		return 0;
+
+	pending = page_slicing_data->block_mask & ~(BIT(block) - 1);
+	if (!pending)
+		return 0;
+
+	block = __ffs(pending);
+	block_end = min_t(u16, (block + 1) * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK, map_end);
+
+	/* when searching for 1st block, ignore blocks without any AID set */
+	if (!no_of_blocks) {
+		start = max_t(u16, block * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK, start);
+		page_slicing_data->tim_virtual_map_index = start - ctrl_offset;
 	}
 
-	/* Update length for first block as we ignore all blocks without any aid set */
-	if (!no_of_blocks)
-		len_in_octets = S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-	else
-		len_in_octets += S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-	return len_in_octets;
+	return block_end - start;
 }
 
 void morse_page_slicing_process_tim_element(struct ieee80211_vif *vif,
@@ -279,6 +295,7 @@ void morse_page_slicing_process_tim_element(struct ieee80211_vif *vif,
 		page_slicing_data->tim_bitmap_ctrl_offset = bitmap_offset;
 		page_slicing_data->page_slice_no = 0;
 		page_slicing_data->tim_virtual_map_index = 0;
+		morse_page_slicing_update_block_mask(page_slicing_data);
 
 		/* Derive block offset based on the starting/first AID in the block */
 		page_slicing_data->block_offset =
@@ -358,6 +375,9 @@ void morse_page_slicing_process_tim_element(struct ieee80211_vif *vif,
 			len_in_octets =
 				morse_page_slicing_find_next_block(page_slicing_data,
 									no_of_blocks);
+			/* No more buffered traffic for this slice */
+			if (!len_in_octets)
+				break;
 		}
 
 		if ((tim_len + len_in_octets) > virtual_map_len) {
@@ -431,4 +451,5 @@ void morse_page_slicing_init(struct ieee80211_vif *vif, u8 dtim_period, u8 enabl
 		page_slicing_data->page_slice_length = NUMBER_OF_BLOCKS_PER_PAGE / dtim_period;
 	page_slicing_data->tim_virtual_map_len = 0;
 	page_slicing_data->page_slice_no = 0;
+	page_slicing_data->block_mask = 0;
 }
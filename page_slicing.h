@@ -108,6 +108,12 @@ struct page_slicing {
      * Indicates blocks that are scheduled in the page period
      */
 	u32 page_bitmap;
+
+    /**
+     * Summary of the saved TIM PVB, one bit per block of the page that has at least
+     * one AID set. Rebuilt whenever a new PVB is saved from a DTIM beacon.
+     */
+	u32 block_mask;
 };
 
 /* Page slice element - fields format is specified in section 9.4.2.192 Page Slice element
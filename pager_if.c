@@ -82,12 +82,46 @@ int morse_pager_irq_handler(struct morse *mors, u32 status)
 		if (tx_buffer_return_pend)
 			set_bit(MORSE_PAGE_RETURN_PEND, &chip_if->event_flags);
 
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+		morse_hw_irq_queue_chip_if_work(mors);
 	}
 
 	return 0;
 }
 
+int morse_pager_bulk_put(struct morse_pager *pager, struct morse_page *pages, int num_pages)
+{
+	int i;
+	int ret = 0;
+
+	if (pager->ops->bulk_put)
+		return pager->ops->bulk_put(pager, pages, num_pages);
+
+	for (i = 0; i < num_pages; i++) {
+		ret = pager->ops->put(pager, &pages[i]);
+		if (ret)
+			break;
+	}
+
+	return (i > 0 || !ret) ? i : ret;
+}
+
+int morse_pager_bulk_pop(struct morse_pager *pager, struct morse_page *pages, int num_pages)
+{
+	int i;
+	int ret = 0;
+
+	if (pager->ops->bulk_pop)
+		return pager->ops->bulk_pop(pager, pages, num_pages);
+
+	for (i = 0; i < num_pages; i++) {
+		ret = pager->ops->pop(pager, &pages[i]);
+		if (ret)
+			break;
+	}
+
+	return (i > 0 || !ret || ret == -EAGAIN) ? i : ret;
+}
+
 void morse_pager_show(struct morse *mors, struct morse_pager *pager, struct seq_file *file)
 {
 	seq_printf(file, "flags:0x%01x\n", pager->flags);
@@ -83,6 +83,30 @@ struct morse_pager_ops {
 	 */
 	int (*pop)(struct morse_pager *pager, struct morse_page *page);
 
+	/**
+	 * Puts a number of pages into the given pager with a single update of the pager.
+	 * Optional; use morse_pager_bulk_put() which falls back to put().
+	 *
+	 * @pager: Pointer to pager instance to insert pages into
+	 * @pages: Array of pages to insert
+	 * @num_pages: Number of pages in @pages
+	 *
+	 * @return: Number of pages put (from the start of @pages), or error code if none were
+	 */
+	int (*bulk_put)(struct morse_pager *pager, struct morse_page *pages, int num_pages);
+
+	/**
+	 * Pops up to a number of pages from the given pager.
+	 * Optional; use morse_pager_bulk_pop() which falls back to pop().
+	 *
+	 * @pager: Pointer to pager instance to take pages from
+	 * @pages: Array to place popped pages into
+	 * @num_pages: Maximum number of pages to pop
+	 *
+	 * @return: Number of pages popped (0 if none are available), or error code
+	 */
+	int (*bulk_pop)(struct morse_pager *pager, struct morse_page *pages, int num_pages);
+
 	/**
 	 * Notify the pager that there are pages available.
 	 *
@@ -159,6 +183,30 @@ void morse_pager_show(struct morse *mors, struct morse_pager *pager, struct seq_
  */
 void morse_pager_finish(struct morse_pager *pager);
 
+/**
+ * Puts a number of pages into the given pager, using the pager's bulk_put op if it has one.
+ * Pages that were not put keep their address.
+ *
+ * @pager: Pointer to pager instance to insert pages into
+ * @pages: Array of pages to insert
+ * @num_pages: Number of pages in @pages
+ *
+ * @return: Number of pages put (from the start of @pages), or error code if none were
+ */
+int morse_pager_bulk_put(struct morse_pager *pager, struct morse_page *pages, int num_pages);
+
+/**
+ * Pops up to a number of pages from the given pager, using the pager's bulk_pop op if it
+ * has one.
+ *
+ * @pager: Pointer to pager instance to take pages from
+ * @pages: Array to place popped pages into
+ * @num_pages: Maximum number of pages to pop
+ *
+ * @return: Number of pages popped (0 if none are available), or error code
+ */
+int morse_pager_bulk_pop(struct morse_pager *pager, struct morse_page *pages, int num_pages);
+
 /**
  * Enables an interrupt for the given pager
  *
@@ -165,8 +165,7 @@ exit:
 	return ret;
 }
 
-static int morse_pager_hw_pop(struct morse_pager *pager,
-			      struct morse_page *page)
+int morse_pager_hw_pop(struct morse_pager *pager, struct morse_page *page)
 {
 	int ret;
 
@@ -209,8 +208,7 @@ static int _morse_pager_hw_put(struct morse_pager *pager,
 	return ret;
 }
 
-static int morse_pager_hw_put(struct morse_pager *pager,
-			      struct morse_page *page)
+int morse_pager_hw_put(struct morse_pager *pager, struct morse_page *page)
 {
 	struct morse_pager_hw_aux_data *aux_data =
 		(struct morse_pager_hw_aux_data *)pager->aux_data;
@@ -280,9 +278,8 @@ static int morse_pager_hw_notify_pager(const struct morse_pager *pager)
 #endif
 }
 
-static int morse_pager_hw_page_write(struct morse_pager *pager,
-				     struct morse_page *page, int offset,
-				     const char *buff, int num_bytes)
+int morse_pager_hw_page_write(struct morse_pager *pager, struct morse_page *page, int offset,
+			      const char *buff, int num_bytes)
 {
 	if (offset < 0)
 		return -EINVAL;
@@ -313,6 +310,10 @@ static int morse_pager_hw_page_read(struct morse_pager *pager,
 	return morse_dm_read(pager->mors, page->addr + offset, buff, num_bytes);
 }
 
+/* No bulk ops: the pager FIFOs take a single page address per register access, and pages
+ * for the free pagers are already coalesced into one bitmap access by the page cache.
+ * morse_pager_bulk_put/pop() fall back to put/pop.
+ */
 const struct morse_pager_ops morse_pager_hw_ops = {
 	.put = morse_pager_hw_put,
 	.pop = morse_pager_hw_pop,
@@ -461,7 +462,8 @@ int morse_pager_hw_pagesets_init(struct morse *mors)
 	/* Only valid while we only have 2 pagesets */
 	mors->chip_if->to_chip_pageset = &mors->chip_if->pagesets[0];
 	mors->chip_if->from_chip_pageset = &mors->chip_if->pagesets[1];
-	INIT_WORK(&mors->chip_if_work, morse_pagesets_work);
+	morse_hw_chip_if_work_init(mors);
+	morse_hw_irq_coalesce_init(mors);
 	INIT_WORK(&mors->tx_stale_work, morse_pagesets_stale_tx_work);
 	INIT_KFIFO(mors->chip_if->tx_status_addrs);
 
@@ -515,7 +517,8 @@ void morse_pager_hw_pagesets_finish(struct morse *mors)
 	struct morse_pager *pager;
 	struct morse_pageset *pageset;
 
-	cancel_work_sync(&mors->chip_if_work);
+	morse_hw_irq_coalesce_finish(mors);
+	morse_hw_chip_if_work_finish(mors);
 	for (pageset = mors->chip_if->pagesets, count = 0;
 	     count < mors->chip_if->pageset_count; pageset++, count++) {
 		morse_pageset_finish(pageset);
@@ -36,6 +36,12 @@ int morse_pager_hw_read_table(struct morse *mors, struct morse_pager_hw_table *t
 int morse_pager_hw_init(struct morse *mors, struct morse_pager *pager, u32 put_addr, u32 pop_addr);
 void morse_pager_hw_finish(struct morse *mors, struct morse_pager *pager);
 
+/* Pager ops, exposed so the pageset hot path can call them directly */
+int morse_pager_hw_put(struct morse_pager *pager, struct morse_page *page);
+int morse_pager_hw_pop(struct morse_pager *pager, struct morse_page *page);
+int morse_pager_hw_page_write(struct morse_pager *pager, struct morse_page *page, int offset,
+			      const char *buff, int num_bytes);
+
 /* Implementing interface from hw.h */
 int morse_pager_hw_pagesets_init(struct morse *mors);
 void morse_pager_hw_pagesets_flush_tx_data(struct morse *mors);
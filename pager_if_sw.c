@@ -296,41 +296,51 @@ static int morse_pager_sw_notify_pager(const struct morse_pager *pager)
 	return 0;
 }
 
-static int morse_pager_sw_pop(struct morse_pager *pager, struct morse_page *page)
+/* Refill the page cache from the ring buffer. Returns -EAGAIN if the ring is empty. */
+static int morse_pager_sw_cache_fill(struct morse_pager *pager)
+{
+	int ret;
+	int i;
+	u32 to_read;
+	u32 *buffer;
+
+	/**
+	 * Read the head pointer to see how many pages might be available.
+	 */
+	morse_pager_sw_rb_read_head(pager);
+	to_read = __morse_pager_sw_count(pager);
+	if (!to_read)
+		return -EAGAIN;
+
+	buffer = kzalloc(to_read, GFP_KERNEL);
+	if (!buffer)
+		return -ENOMEM;
+
+	ret = morse_pager_sw_data_read(pager, (u8 *)buffer, to_read);
+	if (ret) {
+		kfree(buffer);
+		return ret;
+	}
+
+	for (i = 0; i < (to_read / sizeof(u32)); i++) {
+		ret = kfifo_put(&MORSE_AUX_DATA_CACHE(pager), buffer[i]);
+		WARN_ON(!ret);
+	}
+
+	kfree(buffer);
+	return 0;
+}
+
+int morse_pager_sw_pop(struct morse_pager *pager, struct morse_page *page)
 {
 	int ret = 0;
 	u32 page_addr = 0;
 
+	/* If the cache is empty, time to fill it again */
 	if (kfifo_is_empty(&MORSE_AUX_DATA_CACHE(pager))) {
-		int i;
-		u32 to_read;
-		u32 *buffer;
-
-		/**
-		 * If the cache is empty, time to fill it again,
-		 * read the head pointer to see how many pages might be available.
-		 */
-		morse_pager_sw_rb_read_head(pager);
-		to_read = __morse_pager_sw_count(pager);
-		if (!to_read)
-			return -EAGAIN;
-
-		buffer = kzalloc(to_read, GFP_KERNEL);
-		if (!buffer)
-			return -ENOMEM;
-
-		ret = morse_pager_sw_data_read(pager, (u8 *)buffer, to_read);
-		if (ret) {
-			kfree(buffer);
+		ret = morse_pager_sw_cache_fill(pager);
+		if (ret)
 			return ret;
-		}
-
-		for (i = 0; i < (to_read / sizeof(u32)); i++) {
-			ret = kfifo_put(&MORSE_AUX_DATA_CACHE(pager), buffer[i]);
-			WARN_ON(!ret);
-		}
-
-		kfree(buffer);
 	}
 
 	ret = kfifo_get(&MORSE_AUX_DATA_CACHE(pager), &page_addr);
@@ -344,7 +354,36 @@ static int morse_pager_sw_pop(struct morse_pager *pager, struct morse_page *page
 	return ret;
 }
 
-static int morse_pager_sw_put(struct morse_pager *pager, struct morse_page *page)
+static int morse_pager_sw_bulk_pop(struct morse_pager *pager, struct morse_page *pages,
+				   int num_pages)
+{
+	int ret = 0;
+	int popped = 0;
+	u32 page_addrs[MAX_PAGER_PAGE_LEN];
+
+	while (popped < num_pages) {
+		int i;
+		int n;
+
+		if (kfifo_is_empty(&MORSE_AUX_DATA_CACHE(pager))) {
+			ret = morse_pager_sw_cache_fill(pager);
+			if (ret)
+				break;
+		}
+
+		n = kfifo_out(&MORSE_AUX_DATA_CACHE(pager), page_addrs,
+			      min_t(int, num_pages - popped, ARRAY_SIZE(page_addrs)));
+		for (i = 0; i < n; i++) {
+			pages[popped + i].size_bytes = pager->page_size_bytes;
+			pages[popped + i].addr = le32_to_cpu(page_addrs[i]);
+		}
+		popped += n;
+	}
+
+	return (popped > 0 || ret == -EAGAIN) ? popped : ret;
+}
+
+int morse_pager_sw_put(struct morse_pager *pager, struct morse_page *page)
 {
 	int ret = 0;
 	u32 page_addr = cpu_to_le32(page->addr);
@@ -365,9 +404,46 @@ static int morse_pager_sw_put(struct morse_pager *pager, struct morse_page *page
 	return ret;
 }
 
-static int morse_pager_sw_page_write(struct morse_pager *pager,
-				     struct morse_page *page, int offset,
-				     const char *buff, int num_bytes)
+/* Write all pages to the ring buffer in one access. The ring pointer is written on notify(). */
+static int morse_pager_sw_bulk_put(struct morse_pager *pager, struct morse_page *pages,
+				   int num_pages)
+{
+	int ret;
+	int i;
+	int cached;
+	u32 *buffer;
+	struct morse_pager_sw_aux_data *aux_data =
+	    (struct morse_pager_sw_aux_data *)pager->aux_data;
+
+	cached = kfifo_len(&MORSE_AUX_DATA_CACHE(pager));
+	buffer = kcalloc(cached + num_pages, sizeof(u32), GFP_KERNEL);
+	if (!buffer)
+		return -ENOMEM;
+
+	/* Pages already cached by put() must go first */
+	cached = kfifo_out(&MORSE_AUX_DATA_CACHE(pager), buffer, cached);
+	for (i = 0; i < num_pages; i++)
+		buffer[cached + i] = cpu_to_le32(pages[i].addr);
+
+	ret = morse_pager_sw_data_write(pager, (u8 *)buffer, (cached + num_pages) * sizeof(u32));
+	if (ret) {
+		kfifo_in(&MORSE_AUX_DATA_CACHE(pager), buffer, cached);
+		kfree(buffer);
+		return ret;
+	}
+
+	aux_data->pages_need_put = false;
+	for (i = 0; i < num_pages; i++) {
+		pages[i].addr = 0;
+		pages[i].size_bytes = 0;
+	}
+
+	kfree(buffer);
+	return num_pages;
+}
+
+int morse_pager_sw_page_write(struct morse_pager *pager, struct morse_page *page, int offset,
+			      const char *buff, int num_bytes)
 {
 	int ret;
 
@@ -405,6 +481,8 @@ static int morse_pager_sw_page_read(struct morse_pager *pager,
 const struct morse_pager_ops morse_pager_sw_ops = {
 	.put = morse_pager_sw_put,
 	.pop = morse_pager_sw_pop,
+	.bulk_put = morse_pager_sw_bulk_put,
+	.bulk_pop = morse_pager_sw_bulk_pop,
 	.write_page = morse_pager_sw_page_write,
 	.read_page = morse_pager_sw_page_read,
 	.notify = morse_pager_sw_notify_pager,
@@ -557,7 +635,8 @@ int morse_pager_sw_pagesets_init(struct morse *mors)
 	/* Only valid while we only have 2 pagesets */
 	mors->chip_if->to_chip_pageset = &mors->chip_if->pagesets[0];
 	mors->chip_if->from_chip_pageset = &mors->chip_if->pagesets[1];
-	INIT_WORK(&mors->chip_if_work, morse_pagesets_work);
+	morse_hw_chip_if_work_init(mors);
+	morse_hw_irq_coalesce_init(mors);
 	INIT_WORK(&mors->tx_stale_work, morse_pagesets_stale_tx_work);
 	INIT_KFIFO(mors->chip_if->tx_status_addrs);
 
@@ -604,7 +683,8 @@ void morse_pager_sw_pagesets_finish(struct morse *mors)
 	struct morse_pager *pager;
 	struct morse_pageset *pageset;
 
-	cancel_work_sync(&mors->chip_if_work);
+	morse_hw_irq_coalesce_finish(mors);
+	morse_hw_chip_if_work_finish(mors);
 	for (pageset = mors->chip_if->pagesets, count = 0;
 	     count < mors->chip_if->pageset_count; pageset++, count++) {
 		morse_pageset_finish(pageset);
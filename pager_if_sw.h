@@ -36,6 +36,12 @@ int morse_pager_sw_init(struct morse *mors, struct morse_pager *pager,
 			u32 entry_addr, u32 size, u32 base, u32 head, u32 tail);
 void morse_pager_sw_finish(struct morse *mors, struct morse_pager *pager);
 
+/* Pager ops, exposed so the pageset hot path can call them directly */
+int morse_pager_sw_put(struct morse_pager *pager, struct morse_page *page);
+int morse_pager_sw_pop(struct morse_pager *pager, struct morse_page *page);
+int morse_pager_sw_page_write(struct morse_pager *pager, struct morse_page *page, int offset,
+			      const char *buff, int num_bytes);
+
 /* Implementing interface from hw.h */
 int morse_pager_sw_pagesets_init(struct morse *mors);
 void morse_pager_sw_pagesets_flush_tx_data(struct morse *mors);
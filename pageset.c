@@ -13,8 +13,11 @@
 #include "ps.h"
 #include "hw.h"
 #include "bus.h"
+#include "mac.h"
 #include "ipmon.h"
 #include <linux/gpio.h>
+#include <linux/math64.h>
+#include <linux/random.h>
 #include "pager_if_hw.h"
 #include "pager_if_sw.h"
 
@@ -33,9 +36,32 @@
 #define PAGE_RETURN_NOTIFY_INT	4
 #endif
 
+/* Smallest number of free pages the TX path tries to keep cached while there is a backlog */
+#ifndef PAGESET_PREFETCH_MIN_PAGES
+#define PAGESET_PREFETCH_MIN_PAGES	4
+#endif
+
+/* Time for the pages held back for a traffic class to drop by one once it stops starving */
+#define PAGESET_QUOTA_DECAY_MS		100
+
+/*
+ * Most pages that may be held back for each traffic class (enum morse_pageset_class) from the
+ * classes below it. The hold grows by a page each time the class finds too few cached pages for
+ * its backlog, and decays again once it stops starving.
+ */
+static uint pageset_quota_max[PAGESET_CLASS_NUM] __read_mostly = { 4, 2, 2, 1, 0 };
+module_param_array(pageset_quota_max, uint, NULL, 0644);
+MODULE_PARM_DESC(pageset_quota_max,
+		 "Most cached TX pages held back for mgmt,VO,VI,BE,BK from lower classes");
+
 /* Time in milliseconds to wait for the beacon tasklet to queue the beacon to skbq */
 #define BEACON_TASKLET_WAITQ_TIMEOUT 1
 
+#define BENCHMARK_PKT_LEN		(1496)
+#define BENCHMARK_WAIT_MS		(5000)
+/* Time allowed for outstanding loopback packets to return at the end of the benchmark */
+#define BENCHMARK_DRAIN_MS		(500)
+
 static int is_pageset_locked(struct morse_pageset *pageset)
 {
 	return test_bit(0, &pageset->access_lock);
@@ -53,8 +79,46 @@ static void pageset_unlock(struct morse_pageset *pageset)
 	clear_bit_unlock(0, &pageset->access_lock);
 }
 
+/* Per page pager ops, devirtualised to the hardware and software pager implementations */
+static inline int morse_pageset_pager_put(struct morse_pager *pager, struct morse_page *page)
+{
+	return INDIRECT_CALL_2(pager->ops->put, morse_pager_sw_put, morse_pager_hw_put,
+			       pager, page);
+}
+
+static inline int morse_pageset_pager_pop(struct morse_pager *pager, struct morse_page *page)
+{
+	return INDIRECT_CALL_2(pager->ops->pop, morse_pager_sw_pop, morse_pager_hw_pop,
+			       pager, page);
+}
+
+static inline int morse_pageset_pager_write_page(struct morse_pager *pager,
+						 struct morse_page *page, int offset,
+						 const char *buff, int num_bytes)
+{
+	return INDIRECT_CALL_2(pager->ops->write_page, morse_pager_sw_page_write,
+			       morse_pager_hw_page_write, pager, page, offset, buff, num_bytes);
+}
+
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+static inline u64 morse_pageset_benchmark_start(struct morse_pageset *pageset)
+{
+	return pageset->benchmark.active ? ktime_to_ns(ktime_get()) : 0;
+}
+
+static inline void morse_pageset_benchmark_end(struct morse_pageset *pageset, u64 start_ns,
+					       int num_pages)
+{
+	if (!pageset->benchmark.active || !start_ns)
+		return;
+
+	pageset->benchmark.pages += num_pages;
+	pageset->benchmark.bus_ns += ktime_to_ns(ktime_get()) - start_ns;
+}
+#endif
+
 /* Mappings between sk_buff, skbq and pageset */
-static inline struct morse_skbq *skbq_pageset_tc_q_from_aci(struct morse *mors, int aci)
+struct morse_skbq *skbq_pageset_tc_q_from_aci(struct morse *mors, int aci)
 {
 	struct morse_pageset *pageset = mors->chip_if->to_chip_pageset;
 
@@ -98,7 +162,7 @@ static inline struct morse_pageset *q2pageset(struct morse_skbq *mq)
 	return NULL;
 }
 
-static struct morse_skbq *skbq_pageset_cmd_tc_q(struct morse *mors)
+struct morse_skbq *skbq_pageset_cmd_tc_q(struct morse *mors)
 {
 	return (mors->chip_if->to_chip_pageset) ? &mors->chip_if->to_chip_pageset->cmd_q : NULL;
 }
@@ -108,7 +172,7 @@ static struct morse_skbq *skbq_pageset_bcn_tc_q(struct morse *mors)
 	return (mors->chip_if->to_chip_pageset) ? &mors->chip_if->to_chip_pageset->beacon_q : NULL;
 }
 
-static struct morse_skbq *skbq_pageset_mgmt_tc_q(struct morse *mors)
+struct morse_skbq *skbq_pageset_mgmt_tc_q(struct morse *mors)
 {
 	return (mors->chip_if->to_chip_pageset) ? &mors->chip_if->to_chip_pageset->mgmt_q : NULL;
 }
@@ -159,7 +223,8 @@ const struct chip_if_ops morse_pageset_hw_ops = {
 	.skbq_mgmt_tc_q = skbq_pageset_mgmt_tc_q,
 	.skbq_cmd_tc_q = skbq_pageset_cmd_tc_q,
 	.skbq_tc_q_from_aci = skbq_pageset_tc_q_from_aci,
-	.chip_if_handle_irq = morse_pager_irq_handler
+	.chip_if_handle_irq = morse_pager_irq_handler,
+	.chip_if_handle_events = morse_pagesets_handle_events
 };
 
 const struct chip_if_ops morse_pageset_sw_ops = {
@@ -174,7 +239,8 @@ const struct chip_if_ops morse_pageset_sw_ops = {
 	.skbq_mgmt_tc_q = skbq_pageset_mgmt_tc_q,
 	.skbq_cmd_tc_q = skbq_pageset_cmd_tc_q,
 	.skbq_tc_q_from_aci = skbq_pageset_tc_q_from_aci,
-	.chip_if_handle_irq = morse_pager_irq_handler
+	.chip_if_handle_irq = morse_pager_irq_handler,
+	.chip_if_handle_events = morse_pagesets_handle_events
 };
 
 static bool morse_pageset_page_is_cached(struct morse_pageset *pageset, struct morse_page *page)
@@ -207,9 +273,9 @@ static void morse_pageset_to_chip_return_handler_no_lock(struct morse *mors)
 {
 	struct morse_pageset *pageset = mors->chip_if->to_chip_pageset;
 	struct morse_pager *pager = pageset->return_pager;
-	struct morse_page page;
+	struct morse_page pages[CACHED_PAGES_MAX];
 	int ret;
-	bool pager_empty = false;
+	int i;
 	unsigned int popped = 0;
 	/* Continue to pop until either the pager is exhausted or more than
 	 * double the amount of possible cache entries have been popped.
@@ -219,38 +285,30 @@ static void morse_pageset_to_chip_return_handler_no_lock(struct morse *mors)
 
 	MORSE_WARN_ON(FEATURE_ID_PAGER, !is_pageset_locked(pageset));
 
-	while (kfifo_len(&pageset->reserved_pages) < CMD_RSVED_PAGES_MAX) {
-		if (pager->ops->pop(pager, &page)) {
-			pager_empty = true;
-			break;
-		}
-
-		popped++;
-		if (morse_pageset_page_is_cached(pageset, &page))
-			continue;
-
-		ret = kfifo_put(&pageset->reserved_pages, page);
-		MORSE_WARN_ON(FEATURE_ID_PAGER, !ret);
-	}
-
-	if (pager_empty)
-		goto exit;
-
 	while (popped < max_expected_pops) {
-		if (pager->ops->pop(pager, &page))
-			break;
+		int n = morse_pager_bulk_pop(pager, pages,
+					     min_t(int, ARRAY_SIZE(pages),
+						   max_expected_pops - popped));
 
-		popped++;
-		if (morse_pageset_page_is_cached(pageset, &page))
-			continue;
+		if (n <= 0)
+			break;
 
-		ret = kfifo_put(&pageset->cached_pages, page);
-		MORSE_WARN_ON(FEATURE_ID_PAGER, !ret);
+		popped += n;
+		for (i = 0; i < n; i++) {
+			if (morse_pageset_page_is_cached(pageset, &pages[i]))
+				continue;
+
+			/* Top up the reserved pages first */
+			if (kfifo_len(&pageset->reserved_pages) < CMD_RSVED_PAGES_MAX)
+				ret = kfifo_put(&pageset->reserved_pages, pages[i]);
+			else
+				ret = kfifo_put(&pageset->cached_pages, pages[i]);
+			MORSE_WARN_ON(FEATURE_ID_PAGER, !ret);
+		}
 	}
 
 	MORSE_WARN_ON(FEATURE_ID_PAGER, popped >= max_expected_pops);
 
-exit:
 	if (popped)
 		pager->ops->notify(pager);
 }
@@ -278,21 +336,20 @@ static void morse_pageset_to_chip_return_handler(struct morse *mors, bool have_l
 #define BCN_LOSS_CHECK		(500)
 #define BCN_LOSS_THRESHOLD	(50)
 
-static unsigned int bcn_page_get;
-static unsigned int bcn_page_fail;
-
 /*
  * Some beacons may be lost by design. Report excessive beacon loss.
  */
-static void morse_pageset_bcn_loss_monitor(struct morse *mors)
+static void morse_pageset_bcn_loss_monitor(struct morse_pageset *pageset)
 {
-	if (bcn_page_fail > BCN_LOSS_THRESHOLD) {
-		mors->debug.page_stats.excessive_bcn_loss++;
+	struct morse *mors = pageset->mors;
+
+	if (pageset->bcn_loss.fail > BCN_LOSS_THRESHOLD) {
+		MORSE_PAGE_STAT_INC(mors, excessive_bcn_loss);
 		MORSE_WARN(mors, "%s failed to send %d of %d beacons\n",
-			   __func__, bcn_page_fail, bcn_page_get);
+			   __func__, pageset->bcn_loss.fail, pageset->bcn_loss.get);
 	}
-	bcn_page_get = 0;
-	bcn_page_fail = 0;
+	pageset->bcn_loss.get = 0;
+	pageset->bcn_loss.fail = 0;
 }
 
 static bool morse_pageset_rsved_page_is_avail(struct morse_pageset *pageset, u8 channel,
@@ -302,13 +359,13 @@ static bool morse_pageset_rsved_page_is_avail(struct morse_pageset *pageset, u8
 
 	switch (channel) {
 	case MORSE_SKB_CHAN_BEACON:
-		bcn_page_get++;
-		if (bcn_page_get == BCN_LOSS_CHECK)
-			morse_pageset_bcn_loss_monitor(mors);
+		pageset->bcn_loss.get++;
+		if (pageset->bcn_loss.get == BCN_LOSS_CHECK)
+			morse_pageset_bcn_loss_monitor(pageset);
 		/* Always hold at least one reserved page for commands */
 		if (kfifo_len(&pageset->reserved_pages) <= 1) {
-			bcn_page_fail++;
-			mors->debug.page_stats.bcn_no_page++;
+			pageset->bcn_loss.fail++;
+			MORSE_PAGE_STAT_INC(mors, bcn_no_page);
 			MORSE_DBG(mors, "%s no page available for beacon\n", __func__);
 			return false;
 		}
@@ -322,11 +379,11 @@ static bool morse_pageset_rsved_page_is_avail(struct morse_pageset *pageset, u8
 		if (kfifo_is_empty(&pageset->reserved_pages)) {
 			morse_pageset_to_chip_return_handler(mors, have_lock);
 			if (kfifo_is_empty(&pageset->reserved_pages)) {
-				mors->debug.page_stats.cmd_no_page++;
+				MORSE_PAGE_STAT_INC(mors, cmd_no_page);
 				MORSE_ERR(mors, "%s unexpected command page exhaustion\n",
 					  __func__);
 			} else {
-				mors->debug.page_stats.cmd_rsv_page_retry++;
+				MORSE_PAGE_STAT_INC(mors, cmd_rsv_page_retry);
 				MORSE_DBG(mors, "%s got command page on second attempt\n",
 					  __func__);
 			}
@@ -337,76 +394,105 @@ static bool morse_pageset_rsved_page_is_avail(struct morse_pageset *pageset, u8
 	return 0;
 }
 
-static int morse_pageset_write(struct morse_pageset *pageset, struct sk_buff *skb)
+/*
+ * Write an skb into a free page. The page is returned through @page and is not put into the
+ * populated pager; that is left to morse_pageset_put_pages() so a whole batch can be put in one
+ * pager update. Must be called with the pageset lock held.
+ */
+static int morse_pageset_write(struct morse_pageset *pageset, struct sk_buff *skb,
+			       struct morse_page *page)
 {
 	int ret = 0;
 	bool from_rsvd = false;
 	struct morse *mors = pageset->mors;
 	struct morse_pager *populated_pager = pageset->populated_pager;
-	struct morse_page page;
 	struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)skb->data;
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	u64 start_ns;
+#endif
 
-	ret = pageset_lock(pageset);
-	if (ret) {
-		MORSE_DBG(mors, "%s pageset lock failed %d\n", __func__, ret);
-		return ret;
-	}
+	MORSE_WARN_ON(FEATURE_ID_PAGER, !is_pageset_locked(pageset));
 
 	if (morse_pageset_rsved_page_is_avail(pageset, hdr->channel, true)) {
-		ret = kfifo_get(&pageset->reserved_pages, &page);
+		ret = kfifo_get(&pageset->reserved_pages, page);
 		from_rsvd = true;
 	} else {
-		ret = kfifo_get(&pageset->cached_pages, &page);
+		ret = kfifo_get(&pageset->cached_pages, page);
 	}
 
 	if (ret <= 0) {
 		MORSE_ERR(mors, "%s no pages available\n", __func__);
-		ret = -ENOSPC;
-		goto exit;
+		return -ENOSPC;
 	}
 
-	if (skb->len > page.size_bytes) {
+	if (skb->len > page->size_bytes) {
 		MORSE_ERR(mors, "%s Data larger than pagesize: [%d:%d]\n",
-			  __func__, skb->len, page.size_bytes);
-		ret = -ENOSPC;
-		goto exit;
+			  __func__, skb->len, page->size_bytes);
+		return -ENOSPC;
 	}
 
 	morse_debug_fw_hostif_log_record(mors, true, skb, hdr);
 
-	ret = populated_pager->ops->write_page(populated_pager, &page, 0, skb->data, skb->len);
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	start_ns = morse_pageset_benchmark_start(pageset);
+#endif
+	ret = morse_pageset_pager_write_page(populated_pager, page, 0, skb->data, skb->len);
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	if (!ret)
+		morse_pageset_benchmark_end(pageset, start_ns, 1);
+#endif
 	if (ret) {
 		MORSE_ERR(mors, "%s failed to write page: %d\n", __func__, ret);
 		/* Put the page back into the cache */
 		if (from_rsvd)
-			kfifo_put(&pageset->reserved_pages, page);
+			kfifo_put(&pageset->reserved_pages, *page);
 		else
-			kfifo_put(&pageset->cached_pages, page);
-
-		goto exit;
+			kfifo_put(&pageset->cached_pages, *page);
 	}
 
-	/* Put the filled page to send it to the chip */
-	ret = populated_pager->ops->put(populated_pager, &page);
-	if (ret) {
-		MORSE_ERR(mors, "%s failed to return page: %d\n", __func__, ret);
-		/* Return page to avoid page leak.
-		 * Write sync word as 0 so the chip discards it.
-		 * Don't not putting this in the return pager to avoid
-		 * reading and writing from the same pager, as this would require
-		 * additional synchronisation.
-		 */
-		hdr->sync = 0;
-		populated_pager->ops->write_page(populated_pager, &page, 0,
-						 (const char *)hdr, sizeof(*hdr));
-		populated_pager->ops->put(populated_pager, &page);
-		goto exit;
-	}
+	return ret;
+}
 
-exit:
-	pageset_unlock(pageset);
+/*
+ * Put filled pages into the populated pager to send them to the chip. Returns the number of
+ * pages (from the start of @pages) that were sent. Must be called with the pageset lock held.
+ */
+static int morse_pageset_put_pages(struct morse_pageset *pageset, struct morse_page *pages,
+				   int num_pages)
+{
+	int i;
+	int ret;
+	struct morse *mors = pageset->mors;
+	struct morse_pager *populated_pager = pageset->populated_pager;
+	const struct morse_buff_skb_header discard_hdr = { .sync = 0 };
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	u64 start_ns = morse_pageset_benchmark_start(pageset);
+#endif
 
-	return ret;
+	ret = morse_pager_bulk_put(populated_pager, pages, num_pages);
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	/* Pages were already counted when written, only account for the put */
+	morse_pageset_benchmark_end(pageset, start_ns, 0);
+#endif
+	if (ret == num_pages)
+		return ret;
+
+	MORSE_ERR(mors, "%s failed to put %d pages: %d\n", __func__,
+		  num_pages - max(ret, 0), ret);
+
+	/* Return pages to avoid page leak.
+	 * Write sync word as 0 so the chip discards them.
+	 * Don't not putting these in the return pager to avoid
+	 * reading and writing from the same pager, as this would require
+	 * additional synchronisation.
+	 */
+	for (i = max(ret, 0); i < num_pages; i++) {
+		morse_pageset_pager_write_page(populated_pager, &pages[i], 0,
+					       (const char *)&discard_hdr, sizeof(discard_hdr));
+		morse_pageset_pager_put(populated_pager, &pages[i]);
+	}
+
+	return max(ret, 0);
 }
 
 static int morse_pageset_read(struct morse_pageset *pageset)
@@ -421,9 +507,13 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 	struct morse_page page = { .addr = 0, .size_bytes = 0 };
 	struct morse_buff_skb_header *hdr;
 	int skb_len;
+	int alloc_len;
 	int max_checksum_rounds = 2;
 	int count = 0;
 	bool checksum_valid = !(mors->chip_if->validate_skb_checksum);
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	u64 start_ns;
+#endif
 
 	if (kfifo_len(&chip_if->tx_status_addrs) > 0) {
 		/* The pager has been bypassed, take page address from the fifo */
@@ -432,7 +522,7 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 		page.size_bytes = populated_pager->page_size_bytes;
 	} else {
 		/* Pop one page from pager */
-		ret = populated_pager->ops->pop(populated_pager, &page);
+		ret = morse_pageset_pager_pop(populated_pager, &page);
 		if (ret) {
 			/* No pages left */
 			page.addr = 0;
@@ -443,8 +533,16 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 	skb_len = round_up(page.addr >> 20, 4);
 	page.addr = ((page.addr & 0xFFFFF) | mors->cfg->regs->pager_base_address);
 
-	/* Allocate an skb for the page data, copy header to it */
-	skb = dev_alloc_skb(skb_len);
+	/*
+	 * Allocate an skb for the page data, copy header to it. The channel is not known until the
+	 * page is read, so use the cache: control frames come back to it once consumed. For the
+	 * same reason, room for management frames to be translated in place is only left when it
+	 * still fits a cached buffer. Larger management frames are copied by morse_mac_skb_recv().
+	 */
+	alloc_len = skb_len + MORSE_SKB_RX_TAILROOM;
+	if (alloc_len > MORSE_SKB_CACHE_BUF_LEN)
+		alloc_len = skb_len;
+	skb = morse_skb_cache_alloc(mors, alloc_len);
 	if (!skb) {
 		ret = -ENOMEM;
 		goto exit;
@@ -452,7 +550,14 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 	skb_put(skb, skb_len);
 
 	/* Read page data */
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	start_ns = morse_pageset_benchmark_start(pageset);
+#endif
 	ret = populated_pager->ops->read_page(populated_pager, &page, 0, skb->data, skb_len);
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	if (!ret)
+		morse_pageset_benchmark_end(pageset, start_ns, 1);
+#endif
 
 	if (ret) {
 		MORSE_ERR(mors, "%s failed to read page: %d\n", __func__, ret);
@@ -477,7 +582,7 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 			/* Chip already owns the page, clear page address
 			 * to indicate that it should not be returned
 			 */
-			mors->debug.page_stats.page_owned_by_chip++;
+			MORSE_PAGE_STAT_INC(mors, page_owned_by_chip);
 			page.addr = 0;
 		}
 
@@ -493,7 +598,7 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 		if (checksum_valid)
 			break;
 
-		mors->debug.page_stats.invalid_checksum++;
+		MORSE_PAGE_STAT_INC(mors, invalid_checksum);
 		/* Read tx status again if the first read is corrupted. There is a tput degradation
 		 * if continue to read pages from the pager.
 		 */
@@ -511,7 +616,7 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 			  "%s: SKB checksum is invalid, page:[a:0x%08x len:%d] hdr:[c:%02X s:%02X]",
 			  __func__, page.addr, skb_len, hdr->channel, hdr->sync);
 		if (hdr->channel == MORSE_SKB_CHAN_TX_STATUS)
-			mors->debug.page_stats.invalid_tx_status_checksum++;
+			MORSE_PAGE_STAT_INC(mors, invalid_tx_status_checksum);
 		goto exit;
 	}
 
@@ -528,6 +633,11 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 		hdr->offset = (hdr->len & 0x03) ? (4 - (unsigned long)(hdr->len & 3)) : 0;
 	}
 
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	if (hdr->channel == MORSE_SKB_CHAN_LOOPBACK)
+		atomic_inc(&pageset->benchmark.cnt);
+#endif
+
 	/* Get correct skbq for the data based on the declared channel */
 	switch (hdr->channel) {
 	case MORSE_SKB_CHAN_DATA:
@@ -562,13 +672,13 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 
 #ifdef CONFIG_MORSE_IPMON
 	if (hdr->channel == MORSE_SKB_CHAN_DATA) {
-		static u64 time_start;
-
-		morse_ipmon(&time_start, skb, skb->data + sizeof(*hdr),
-			    le16_to_cpu(hdr->len), IPMON_LOC_SERVER_DRV, 0);
+		morse_ipmon(&mors->debug.ipmon_time_start[IPMON_LOC_SERVER_DRV], skb,
+			    skb->data + sizeof(*hdr), le16_to_cpu(hdr->len),
+			    IPMON_LOC_SERVER_DRV, 0);
 	}
 #endif
 
+	morse_pkt_lat_rx_begin(mors, skb, hdr->channel);
 	ret = morse_skbq_put(mq, skb);
 
 	/* Unconditionally queue network work to process RX page. Either
@@ -595,11 +705,12 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 
 exit:
 	/* If the SKB did not successfully make it into an MQ, it must be freed */
-	dev_kfree_skb(skb);
+	if (skb)
+		morse_skb_cache_free(mors, skb);
 
 	if (page.addr) {
 		/* Put the emptied page to send it back to the chip */
-		ret = return_pager->ops->put(return_pager, &page);
+		ret = morse_pageset_pager_put(return_pager, &page);
 		if (ret)
 			MORSE_ERR(mors, "%s: return page failed: %d\n", __func__, ret);
 	}
@@ -607,37 +718,146 @@ exit:
 	return ret;
 }
 
+/* Traffic class of a TX queue, or -1 for queues outside of the cached page quota */
+static int morse_pageset_tx_class(struct morse_pageset *pageset, struct morse_skbq *mq)
+{
+	if (mq == &pageset->mgmt_q)
+		return PAGESET_CLASS_MGMT;
+
+	if (mq == &pageset->data_qs[MORSE_ACI_VO])
+		return PAGESET_CLASS_VO;
+	if (mq == &pageset->data_qs[MORSE_ACI_VI])
+		return PAGESET_CLASS_VI;
+	if (mq == &pageset->data_qs[MORSE_ACI_BE])
+		return PAGESET_CLASS_BE;
+	if (mq == &pageset->data_qs[MORSE_ACI_BK])
+		return PAGESET_CLASS_BK;
+
+	return -1;
+}
+
+/* Pages currently held back for @class, after the decay since it last starved */
+static int morse_pageset_quota_hold(struct morse_pageset *pageset, int class)
+{
+	unsigned long elapsed = jiffies - pageset->quota.last_starved[class];
+	unsigned long decayed = elapsed / max(msecs_to_jiffies(PAGESET_QUOTA_DECAY_MS), 1UL);
+	int hold = pageset->quota.hold[class];
+
+	if (decayed >= hold)
+		return 0;
+
+	return min_t(int, hold - decayed, READ_ONCE(pageset_quota_max[class]));
+}
+
+/* Cached pages that a queue of @class may use, leaving the holds of the classes above it */
+static int morse_pageset_quota_avail(struct morse_pageset *pageset, int class)
+{
+	int avail = kfifo_len(&pageset->cached_pages);
+	int i;
+
+	for (i = 0; i < class; i++)
+		avail -= morse_pageset_quota_hold(pageset, i);
+
+	return max(avail, 0);
+}
+
+/* Grow the hold of @class when it could not get pages for the head of its backlog */
+static void morse_pageset_quota_update(struct morse_pageset *pageset, int class, int backlog,
+				       int num_pages)
+{
+	int hold;
+
+	if (class < 0 || num_pages >= min(backlog, MAX_PAGES_PER_TX_TXN))
+		return;
+
+	pageset->quota.starved[class]++;
+	hold = morse_pageset_quota_hold(pageset, class);
+	pageset->quota.hold[class] = min_t(int, hold + 1,
+					   min(READ_ONCE(pageset_quota_max[class]),
+					       (uint)CACHED_PAGES_MAX / 2));
+	pageset->quota.last_starved[class] = jiffies;
+}
+
 /**
  * Determine how many pages are available for sending packets to the firmware.
  * - Always use 1 for commands. There should only ever be one command in progress at a
  *   time and there is a reserved page for it. If anything goes wrong the command will
  *   be dropped.
+ * - Management and data frames only get the cached pages not held back for the traffic
+ *   classes above them, so bulk data cannot take every page management frames need.
  */
-static int morse_pageset_num_pages(struct morse_pageset *pageset, struct sk_buff *skb)
+static int morse_pageset_num_pages(struct morse_pageset *pageset, struct sk_buff *skb,
+				   int class)
 {
 	struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)skb->data;
 	int num_pages = 0;
+	int cached = kfifo_len(&pageset->cached_pages);
 
 	if (hdr->channel == MORSE_SKB_CHAN_COMMAND) {
 		num_pages = min(CMD_RSVED_CMD_PAGES_MAX,
-				(int)kfifo_len(&pageset->reserved_pages) +
-				(int)kfifo_len(&pageset->cached_pages));
+				(int)kfifo_len(&pageset->reserved_pages) + cached);
 	} else {
 		if (morse_pageset_rsved_page_is_avail(pageset, hdr->channel, false))
 			num_pages = (CMD_RSVED_PAGES_MAX - CMD_RSVED_CMD_PAGES_MAX);
 
-		num_pages = min(MAX_PAGES_PER_TX_TXN,
-				num_pages + (int)kfifo_len(&pageset->cached_pages));
+		if (class >= 0)
+			cached = morse_pageset_quota_avail(pageset, class);
+
+		num_pages = min(MAX_PAGES_PER_TX_TXN, num_pages + cached);
 	}
 
 	return num_pages;
 }
 
+/* Number of free pages to keep cached: enough for two batches at the recent TX rate */
+static int morse_pageset_prefetch_target(struct morse_pageset *pageset)
+{
+	int target = DIV_ROUND_UP(pageset->prefetch.avg_tx_pages_x8, 8) * 2;
+
+	return clamp(target, PAGESET_PREFETCH_MIN_PAGES, CACHED_PAGES_MAX);
+}
+
+/*
+ * Make sure the page cache can keep up with the TX backlog of a queue. Free pages are normally
+ * only collected from the return pager on a PAGE_RETURN interrupt; if the backlog has grown
+ * beyond what is cached, poll the return pager now rather than running out of pages part way
+ * through the batch.
+ */
+static void morse_pageset_prefetch_pages(struct morse_pageset *pageset, struct morse_skbq *mq)
+{
+	int backlog = morse_skbq_count(mq);
+	int cached = kfifo_len(&pageset->cached_pages);
+
+	if (!backlog)
+		return;
+
+	if (cached >= min(backlog, MAX_PAGES_PER_TX_TXN))
+		pageset->prefetch.hits++;
+	else
+		pageset->prefetch.misses++;
+
+	if (cached < min(backlog, morse_pageset_prefetch_target(pageset))) {
+		pageset->prefetch.polls++;
+		morse_pageset_to_chip_return_handler(pageset->mors, false);
+	}
+}
+
+/* Track the TX rate that the prefetch target is sized from */
+static void morse_pageset_prefetch_update(struct morse_pageset *pageset, int num_written)
+{
+	u32 *avg = &pageset->prefetch.avg_tx_pages_x8;
+
+	*avg = *avg - (*avg >> 3) + num_written;
+}
+
 static void morse_pageset_tx(struct morse_pageset *pageset, struct morse_skbq *mq)
 {
 	int ret = 0;
+	int lock_ret;
 	int num_pages;
 	int num_items = 0;
+	int num_written = 0;
+	struct morse_page pages[MAX_PAGES_PER_TX_TXN];
 	struct sk_buff *skb;
 	struct sk_buff_head skbq_to_send;
 	struct sk_buff_head skbq_sent;
@@ -645,11 +865,18 @@ static void morse_pageset_tx(struct morse_pageset *pageset, struct morse_skbq *m
 	struct sk_buff *pfirst, *pnext;
 	struct morse *mors = pageset->mors;
 	struct morse_buff_skb_header *hdr;
+	int class = morse_pageset_tx_class(pageset, mq);
+
+	if (mq != &pageset->cmd_q)
+		morse_pageset_prefetch_pages(pageset, mq);
 
 	spin_lock_bh(&mq->lock);
+	morse_skbq_tx_collect(mq);
 	skb = skb_peek(&mq->skbq);
-	if (skb)
-		num_pages = morse_pageset_num_pages(pageset, skb);
+	if (skb) {
+		num_pages = morse_pageset_num_pages(pageset, skb, class);
+		morse_pageset_quota_update(pageset, class, skb_queue_len(&mq->skbq), num_pages);
+	}
 	spin_unlock_bh(&mq->lock);
 
 	if (!skb)
@@ -669,41 +896,73 @@ static void morse_pageset_tx(struct morse_pageset *pageset, struct morse_skbq *m
 	if (num_pages > 0)
 		num_items = morse_skbq_deq_num_items(mq, &skbq_to_send, num_pages);
 
+	if (skb_queue_empty(&skbq_to_send))
+		return;
+
+	lock_ret = pageset_lock(pageset);
+	if (lock_ret)
+		MORSE_DBG(mors, "%s pageset lock failed %d\n", __func__, lock_ret);
+
 	skb_queue_walk_safe(&skbq_to_send, pfirst, pnext) {
-		if (num_pages) {
-			ret = morse_pageset_write(pageset, pfirst);
+		if (lock_ret) {
+			ret = lock_ret;
+		} else if (num_pages) {
+			ret = morse_pageset_write(pageset, pfirst, &pages[num_written]);
 		} else {
-			mors->debug.page_stats.no_page++;
+			MORSE_PAGE_STAT_INC(mors, no_page);
 			MORSE_ERR(mors, "%s no pages available\n", __func__);
 			ret = -ENOSPC;
 		}
+		__skb_unlink(pfirst, &skbq_to_send);
 		if (ret == 0) {
-			hdr = (struct morse_buff_skb_header *)pfirst->data;
-			switch (hdr->channel) {
-			case MORSE_SKB_CHAN_COMMAND:
-				mors->debug.page_stats.cmd_tx++;
-				break;
-			case MORSE_SKB_CHAN_BEACON:
-				mors->debug.page_stats.bcn_tx++;
-				break;
-			case MORSE_SKB_CHAN_MGMT:
-				mors->debug.page_stats.mgmt_tx++;
-				break;
-			default:
-				mors->debug.page_stats.data_tx++;
-				break;
-			}
 			num_pages--;
-			__skb_unlink(pfirst, &skbq_to_send);
+			num_written++;
 			__skb_queue_tail(&skbq_sent, pfirst);
 		} else {
-			__skb_unlink(pfirst, &skbq_to_send);
 			__skb_queue_tail(&skbq_failed, pfirst);
 		}
 	}
 
+	if (num_written) {
+		/* Send all written pages with one pager update */
+		int num_put = morse_pageset_put_pages(pageset, pages, num_written);
+
+		while (skb_queue_len(&skbq_sent) > num_put) {
+			pfirst = __skb_dequeue_tail(&skbq_sent);
+			__skb_queue_head(&skbq_failed, pfirst);
+		}
+	}
+
+	if (!lock_ret)
+		pageset_unlock(pageset);
+
+	if (mq != &pageset->cmd_q)
+		morse_pageset_prefetch_update(pageset, skb_queue_len(&skbq_sent));
+
+	skb_queue_walk(&skbq_sent, pfirst) {
+		hdr = (struct morse_buff_skb_header *)pfirst->data;
+		switch (hdr->channel) {
+		case MORSE_SKB_CHAN_COMMAND:
+			MORSE_PAGE_STAT_INC(mors, cmd_tx);
+			break;
+		case MORSE_SKB_CHAN_BEACON:
+			MORSE_PAGE_STAT_INC(mors, bcn_tx);
+			break;
+		case MORSE_SKB_CHAN_MGMT:
+			MORSE_PAGE_STAT_INC(mors, mgmt_tx);
+			break;
+		default:
+			MORSE_PAGE_STAT_INC(mors, data_tx);
+			break;
+		}
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+		if (hdr->channel == MORSE_SKB_CHAN_LOOPBACK)
+			atomic_inc(&pageset->benchmark.cnt);
+#endif
+	}
+
 	if (skbq_failed.qlen > 0) {
-		mors->debug.page_stats.write_fail += skbq_failed.qlen;
+		MORSE_PAGE_STAT_ADD(mors, write_fail, skbq_failed.qlen);
 		MORSE_ERR(mors, "%s could not write %d pkts - rc=%d items=%d pages=%d",
 			  __func__, skbq_failed.qlen, ret, num_items, num_pages);
 		morse_skbq_purge(NULL, &skbq_failed);
@@ -743,7 +1002,7 @@ static bool morse_pageset_tx_data_handler(struct morse_pageset *pageset)
 	morse_skbq_may_wake_tx_queues(mors);
 	if (mors->custom_configs.enable_airtime_fairness &&
 	    !test_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags))
-		tasklet_schedule(&mors->tasklet_txq);
+		morse_mac_schedule_txq(mors);
 
 	return (count > 0) && morse_is_data_tx_allowed(mors);
 }
@@ -841,6 +1100,7 @@ void morse_pagesets_stale_tx_work(struct work_struct *work)
 {
 	int i;
 	int flushed = 0;
+	u32 next_us = U32_MAX;
 	struct morse *mors = container_of(work, struct morse, tx_stale_work);
 	struct morse_pageset *tx_pageset;
 
@@ -848,11 +1108,15 @@ void morse_pagesets_stale_tx_work(struct work_struct *work)
 		return;
 
 	tx_pageset = mors->chip_if->to_chip_pageset;
-	flushed += morse_skbq_check_for_stale_tx(mors, &tx_pageset->beacon_q);
-	flushed += morse_skbq_check_for_stale_tx(mors, &tx_pageset->mgmt_q);
+	flushed += morse_skbq_check_for_stale_tx(mors, &tx_pageset->beacon_q, &next_us);
+	flushed += morse_skbq_check_for_stale_tx(mors, &tx_pageset->mgmt_q, &next_us);
 
 	for (i = 0; i < ARRAY_SIZE(tx_pageset->data_qs); i++)
-		flushed += morse_skbq_check_for_stale_tx(mors, &tx_pageset->data_qs[i]);
+		flushed += morse_skbq_check_for_stale_tx(mors, &tx_pageset->data_qs[i], &next_us);
+
+	/* Wake again for the oldest frame still pending, rather than on a fixed period */
+	if (next_us != U32_MAX)
+		morse_stale_tx_status_arm(mors, jiffies + usecs_to_jiffies(next_us) + 1);
 
 	if (flushed) {
 		MORSE_DBG(mors, "%s: Flushed %d stale TX SKBs\n", __func__, flushed);
@@ -865,17 +1129,17 @@ void morse_pagesets_stale_tx_work(struct work_struct *work)
 	}
 }
 
-void morse_pagesets_work(struct work_struct *work)
+void morse_pagesets_handle_events(struct morse *mors, unsigned long events)
 {
-	struct morse *mors = container_of(work,
-					  struct morse, chip_if_work);
 	int ps_bus_timeout_ms = 0;
 	unsigned long flags_on_entry = mors->chip_if->event_flags;
 	unsigned long *flags = &mors->chip_if->event_flags;
 	int rx_buffered_on_entry = morse_pageset_get_rx_buffered_count(mors);
 	bool is_beacon_pending = false;
 
-	if (!flags_on_entry)
+	morse_hw_irq_coalesce_done(mors);
+
+	if (!(flags_on_entry & events))
 		return;
 
 	/* Don't attempt to interact with device once it becomes unresponsive */
@@ -887,7 +1151,7 @@ void morse_pagesets_work(struct work_struct *work)
 	morse_claim_bus(mors);
 
 	/* Tx beacons first */
-	if (test_and_clear_bit(MORSE_TX_BEACON_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_BEACON_PEND, events, flags)) {
 		if (morse_pageset_tx_beacon_handler(mors->chip_if->to_chip_pageset))
 			set_bit(MORSE_TX_BEACON_PEND, flags);
 	}
@@ -896,13 +1160,16 @@ void morse_pagesets_work(struct work_struct *work)
 	 * avoid dropping pkts due to full on-chip buffers.
 	 * Check if all pages were removed, set event flags if not.
 	 */
-	if (test_and_clear_bit(MORSE_RX_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_RX_PEND, events, flags)) {
 		/* Check for beacon requests from target if AP interface exists */
 		if (morse_pageset_rx_handler(mors->chip_if->from_chip_pageset,
 				mors->num_of_ap_interfaces > 0 ? &is_beacon_pending : NULL))
 			set_bit(MORSE_RX_PEND, flags);
 
-		if (is_beacon_pending) {
+		/* Give the beacon tasklet a chance to queue the beacon. When beacons are handled by
+		 * a separate worker, releasing the bus at the end of this pass is enough.
+		 */
+		if (is_beacon_pending && (events & BIT(MORSE_TX_BEACON_PEND))) {
 			mors->beacon_queued = false;
 			morse_release_bus(mors);
 			wait_event_interruptible_timeout(mors->beacon_tasklet_waitq,
@@ -913,36 +1180,37 @@ void morse_pagesets_work(struct work_struct *work)
 	}
 
 	/* Handle any free TX pages being returned so caches are refilled */
-	if (test_and_clear_bit(MORSE_PAGE_RETURN_PEND, flags))
+	if (morse_chip_if_test_and_clear_event(MORSE_PAGE_RETURN_PEND, events, flags))
 		morse_pageset_to_chip_return_handler(mors, false);
 
 	/* TX any commands before anything else */
-	if (test_and_clear_bit(MORSE_TX_COMMAND_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_COMMAND_PEND, events, flags)) {
 		if (morse_pageset_tx_cmd_handler(mors->chip_if->to_chip_pageset))
 			set_bit(MORSE_TX_COMMAND_PEND, flags);
 	}
 
 	/* TX beacons before considering mgmt/data */
-	if (test_and_clear_bit(MORSE_TX_BEACON_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_BEACON_PEND, events, flags)) {
 		if (morse_pageset_tx_beacon_handler(mors->chip_if->to_chip_pageset))
 			set_bit(MORSE_TX_BEACON_PEND, flags);
 	}
 
 	/* Process Rx buffers again if rx pages processing is stopped for any pending beacon */
-	if (test_and_clear_bit(MORSE_RX_PEND, flags) && is_beacon_pending) {
+	if ((events & BIT(MORSE_TX_BEACON_PEND)) &&
+	    morse_chip_if_test_and_clear_event(MORSE_RX_PEND, events, flags) && is_beacon_pending) {
 		if (morse_pageset_rx_handler(mors->chip_if->from_chip_pageset, NULL))
 			set_bit(MORSE_RX_PEND, flags);
 	}
 
 	/* TX mgmt before considering data */
-	if (test_and_clear_bit(MORSE_TX_MGMT_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_MGMT_PEND, events, flags)) {
 		if (morse_pageset_tx_mgmt_handler(mors->chip_if->to_chip_pageset))
 			set_bit(MORSE_TX_MGMT_PEND, flags);
 	}
 
 	/* Pause TX data Qs */
-	if (test_and_clear_bit(MORSE_DATA_TRAFFIC_PAUSE_PEND, flags)) {
-		if (test_and_clear_bit(MORSE_DATA_TRAFFIC_RESUME_PEND, flags))
+	if (morse_chip_if_test_and_clear_event(MORSE_DATA_TRAFFIC_PAUSE_PEND, events, flags)) {
+		if (morse_chip_if_test_and_clear_event(MORSE_DATA_TRAFFIC_RESUME_PEND, events, flags))
 			MORSE_ERR_RATELIMITED(mors,
 					      "Latency to handle traffic pause is too great\n");
 		else
@@ -950,7 +1218,7 @@ void morse_pagesets_work(struct work_struct *work)
 	}
 
 	/* Resume TX data Qs  */
-	if (test_and_clear_bit(MORSE_DATA_TRAFFIC_RESUME_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_DATA_TRAFFIC_RESUME_PEND, events, flags)) {
 		if (test_bit(MORSE_DATA_TRAFFIC_PAUSE_PEND, flags))
 			MORSE_ERR_RATELIMITED(mors,
 					      "Latency to handle traffic resume is too great\n");
@@ -959,7 +1227,7 @@ void morse_pagesets_work(struct work_struct *work)
 	}
 
 	/* Finally TX any data */
-	if (test_and_clear_bit(MORSE_TX_DATA_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_DATA_PEND, events, flags)) {
 		if (morse_pageset_tx_data_handler(mors->chip_if->to_chip_pageset))
 			set_bit(MORSE_TX_DATA_PEND, flags);
 	}
@@ -989,7 +1257,7 @@ void morse_pagesets_work(struct work_struct *work)
 	 * schedule a work event.
 	 */
 	if (test_bit(MORSE_RX_PEND, flags))
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+		morse_hw_chip_if_queue_work(mors);
 }
 
 void morse_pageset_show(struct morse *mors, struct morse_pageset *pageset, struct seq_file *file)
@@ -999,6 +1267,22 @@ void morse_pageset_show(struct morse *mors, struct morse_pageset *pageset, struc
 	seq_printf(file, "flags:0x%01x reserved=%d cached=%d\n",
 		   pageset->flags,
 		   kfifo_len(&pageset->reserved_pages), kfifo_len(&pageset->cached_pages));
+	if (pageset->flags & MORSE_CHIP_IF_FLAGS_DIR_TO_CHIP)
+		seq_printf(file, "prefetch: target=%d hits=%u misses=%u polls=%u\n",
+			   morse_pageset_prefetch_target(pageset), pageset->prefetch.hits,
+			   pageset->prefetch.misses, pageset->prefetch.polls);
+	if (pageset->flags & MORSE_CHIP_IF_FLAGS_DIR_TO_CHIP) {
+		static const char * const class_names[PAGESET_CLASS_NUM] = {
+			"mgmt", "vo", "vi", "be", "bk"
+		};
+
+		seq_puts(file, "quota (hold/starved):");
+		for (i = 0; i < PAGESET_CLASS_NUM; i++)
+			seq_printf(file, " %s=%d/%u", class_names[i],
+				   morse_pageset_quota_hold(pageset, i), pageset->quota.starved[i]);
+		seq_printf(file, " bcn_loss=%u/%u\n",
+			   pageset->bcn_loss.fail, pageset->bcn_loss.get);
+	}
 
 	morse_pager_show(pageset->mors, pageset->populated_pager, file);
 	morse_pager_show(pageset->mors, pageset->return_pager, file);
@@ -1009,6 +1293,130 @@ void morse_pageset_show(struct morse *mors, struct morse_pageset *pageset, struc
 	morse_skbq_show(&pageset->cmd_q, file);
 }
 
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+static void morse_pageset_benchmark_reset(struct morse_pageset *pageset, bool active)
+{
+	if (active) {
+		atomic_set(&pageset->benchmark.cnt, 0);
+		pageset->benchmark.pages = 0;
+		pageset->benchmark.bus_ns = 0;
+	}
+	WRITE_ONCE(pageset->benchmark.active, active);
+}
+
+static void morse_pageset_benchmark_show_bus(struct seq_file *file,
+					     const struct morse_pageset *pageset)
+{
+	seq_printf(file, "\tpages: %u\n", pageset->benchmark.pages);
+	seq_printf(file, "\tbus time per page (ns): %llu\n",
+		   pageset->benchmark.pages ?
+		   div_u64(pageset->benchmark.bus_ns, pageset->benchmark.pages) : 0);
+}
+
+int morse_pageset_benchmark(struct morse *mors, struct seq_file *file)
+{
+	int rc = 0;
+	struct morse_pageset *to_chip = mors->chip_if->to_chip_pageset;
+	struct morse_pageset *from_chip = mors->chip_if->from_chip_pageset;
+	struct morse_skbq *mq = skbq_pageset_tc_q_from_aci(mors, MORSE_ACI_VO);
+	struct morse_skb_tx_info tx_info = { 0 };
+	struct sk_buff *skb;
+	unsigned long start_time, end_time, max_time;
+	unsigned long time_taken_msec;
+	u32 hits, misses;
+	u32 queued = 0;
+	int fc_cnt, tc_cnt;
+	int pkt_len, len;
+	char *body;
+
+	if (!to_chip || !from_chip || !mq)
+		return -ENODEV;
+
+	/* Each packet, with its header and alignment padding, must fit in a single page */
+	len = min_t(int, BENCHMARK_PKT_LEN, to_chip->populated_pager->page_size_bytes -
+		    sizeof(struct morse_buff_skb_header) - 3);
+	pkt_len = len + sizeof(struct morse_buff_skb_header);
+
+	body = kmalloc(len, GFP_KERNEL);
+	if (!body)
+		return -ENOMEM;
+
+#if KERNEL_VERSION(4, 10, 0) <= LINUX_VERSION_CODE
+	get_random_bytes_wait(body, len);
+#endif
+
+	hits = to_chip->prefetch.hits;
+	misses = to_chip->prefetch.misses;
+	morse_pageset_benchmark_reset(to_chip, true);
+	morse_pageset_benchmark_reset(from_chip, true);
+
+	start_time = jiffies;
+	max_time = start_time + msecs_to_jiffies(BENCHMARK_WAIT_MS);
+	while (time_before(jiffies, max_time)) {
+		/* Wait for space and don't hold the spinlock too much */
+		while (morse_skbq_space(mq) < (2 * pkt_len) && time_before(jiffies, max_time))
+			usleep_range(5000, 6000);
+
+		if (!time_before(jiffies, max_time))
+			break;
+
+		skb = morse_skb_cache_alloc(mors, len);
+		if (!skb) {
+			rc = -ENOMEM;
+			break;
+		}
+		skb_put(skb, len);
+		memcpy(skb->data, body, len);
+		skb_set_queue_mapping(skb, IEEE80211_AC_VO);
+
+		rc = morse_skbq_skb_tx(mq, &skb, &tx_info, MORSE_SKB_CHAN_LOOPBACK);
+		if (!rc)
+			queued++;
+	}
+
+	end_time = jiffies;
+	fc_cnt = atomic_read(&from_chip->benchmark.cnt);
+	tc_cnt = atomic_read(&to_chip->benchmark.cnt);
+	hits = to_chip->prefetch.hits - hits;
+	misses = to_chip->prefetch.misses - misses;
+
+	/* Let outstanding packets drain before the next run */
+	max_time = end_time + msecs_to_jiffies(BENCHMARK_DRAIN_MS);
+	while (atomic_read(&from_chip->benchmark.cnt) < queued && time_before(jiffies, max_time))
+		usleep_range(1000, 2000);
+
+	morse_pageset_benchmark_reset(to_chip, false);
+	morse_pageset_benchmark_reset(from_chip, false);
+
+	seq_printf(file, "packet size (bytes): %d\n", len);
+
+	if (tc_cnt == 0) {
+		seq_printf(file, "error %d running benchmark\n", rc);
+		seq_printf(file, "bytes sent %d\n", tc_cnt);
+		seq_printf(file, "bytes received %d\n", fc_cnt);
+		goto exit;
+	}
+
+	time_taken_msec = max(jiffies_to_msecs(end_time - start_time), 1U);
+	seq_printf(file, "time taken (ms): %lu\n", time_taken_msec);
+	morse_bus_bench_show_rate(file, "to chip", tc_cnt, len, time_taken_msec);
+	morse_pageset_benchmark_show_bus(file, to_chip);
+	morse_bus_bench_show_rate(file, "from chip", fc_cnt, len, time_taken_msec);
+	morse_pageset_benchmark_show_bus(file, from_chip);
+	morse_bus_bench_show_rate(file, "combined", tc_cnt + fc_cnt, len, time_taken_msec);
+
+	seq_puts(file, "page cache:\n");
+	seq_printf(file, "\thits: %u\n", hits);
+	seq_printf(file, "\tmisses: %u\n", misses);
+	seq_printf(file, "\thit rate (%%): %u\n",
+		   (hits + misses) ? (hits * 100) / (hits + misses) : 0);
+
+exit:
+	kfree(body);
+	return 0;
+}
+#endif
+
 int morse_pageset_init(struct morse *mors, struct morse_pageset *pageset,
 		       u8 flags,
 		       struct morse_pager *populated_pager, struct morse_pager *return_pager)
@@ -1023,6 +1431,8 @@ int morse_pageset_init(struct morse *mors, struct morse_pageset *pageset,
 
 	INIT_KFIFO(pageset->reserved_pages);
 	INIT_KFIFO(pageset->cached_pages);
+	memset(&pageset->quota, 0, sizeof(pageset->quota));
+	memset(&pageset->bcn_loss, 0, sizeof(pageset->bcn_loss));
 	if (pageset->flags & MORSE_CHIP_IF_FLAGS_DATA) {
 		morse_skbq_init(mors,
 				pageset->flags & MORSE_PAGER_FLAGS_DIR_TO_HOST,
@@ -1032,10 +1442,16 @@ int morse_pageset_init(struct morse *mors, struct morse_pageset *pageset,
 				pageset->flags & MORSE_PAGER_FLAGS_DIR_TO_HOST,
 				&pageset->mgmt_q, MORSE_CHIP_IF_FLAGS_DATA);
 
-		for (i = 0; i < ARRAY_SIZE(pageset->data_qs); i++)
+		for (i = 0; i < ARRAY_SIZE(pageset->data_qs); i++) {
 			morse_skbq_init(mors,
 					pageset->flags & MORSE_PAGER_FLAGS_DIR_TO_HOST,
 					&pageset->data_qs[i], MORSE_CHIP_IF_FLAGS_DATA);
+			if (!(pageset->flags & MORSE_PAGER_FLAGS_DIR_TO_HOST)) {
+				morse_skbq_enable_tx_inbox(&pageset->data_qs[i]);
+				morse_skbq_enable_bql(&pageset->data_qs[i]);
+				morse_skbq_enable_aqm(&pageset->data_qs[i]);
+			}
+		}
 	}
 
 	if (pageset->flags & MORSE_CHIP_IF_FLAGS_COMMAND)
@@ -58,6 +58,23 @@
  */
 #define PAGESET_TX_SKBQ_MAX			4
 
+/**
+ * Traffic classes sharing the cached HOST->CHIP pages, highest priority first. Pages held
+ * back for a class are not given to any class after it.
+ */
+enum morse_pageset_class {
+	PAGESET_CLASS_MGMT,
+	PAGESET_CLASS_VO,
+	PAGESET_CLASS_VI,
+	PAGESET_CLASS_BE,
+	PAGESET_CLASS_BK,
+	PAGESET_CLASS_NUM,
+};
+
+/* Enable to support benchmarking the interface */
+
+#define MORSE_PAGESET_SUPPORTS_BENCHMARK
+
 extern const struct chip_if_ops morse_pageset_hw_ops;
 extern const struct chip_if_ops morse_pageset_sw_ops;
 
@@ -90,6 +107,46 @@ struct morse_pageset {
 	DECLARE_KFIFO(reserved_pages, struct morse_page, CMD_RSVED_KFIFO_LEN);
 	DECLARE_KFIFO(cached_pages, struct morse_page, CACHED_PAGES_KFIFO_LEN);
 
+	/* Adaptive prefetch of free pages into cached_pages (HOST->CHIP only) */
+	struct {
+		/* Moving average of pages written per TX batch, scaled by 8 */
+		u32 avg_tx_pages_x8;
+		/* TX batches that found enough pages in the cache */
+		u32 hits;
+		/* TX batches that found too few pages in the cache */
+		u32 misses;
+		/* Times the return pager was polled ahead of an IRQ */
+		u32 polls;
+	} prefetch;
+
+	/* Adaptive share of cached_pages held back per traffic class (HOST->CHIP only) */
+	struct {
+		/* Pages held back for the class when it last found too few, decaying over time */
+		u8 hold[PAGESET_CLASS_NUM];
+		/* When the class last found too few pages for its backlog (jiffies) */
+		unsigned long last_starved[PAGESET_CLASS_NUM];
+		/* TX rounds that found too few pages for the class backlog */
+		u32 starved[PAGESET_CLASS_NUM];
+	} quota;
+
+	/* Beacon page requests and failures since the last beacon loss check */
+	struct {
+		u32 get;
+		u32 fail;
+	} bcn_loss;
+
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+	/* Loopback benchmark accounting, only updated while a benchmark is running */
+	struct {
+		bool active;
+		/* Loopback packets written (HOST->CHIP) or read (CHIP->HOST) */
+		atomic_t cnt;
+		/* Pages transferred and time spent transferring them over the bus */
+		u32 pages;
+		u64 bus_ns;
+	} benchmark;
+#endif
+
 #ifdef CONFIG_MORSE_PAGESET_TRACE
 	struct pageset_trace trace;
 #endif
@@ -132,6 +189,21 @@ void morse_pageset_finish(struct morse_pageset *pageset);
 
 void morse_pageset_flush_tx_data(struct morse_pageset *pageset);
 
+#ifdef MORSE_PAGESET_SUPPORTS_BENCHMARK
+/**
+ * Runs a loopback benchmark and prints info about the pageset performance to a file.
+ *
+ * Reports throughput in each direction, the to-chip page cache hit rate and the average
+ * bus time per page written and read.
+ *
+ * @mors: Morse chip instance
+ * @file: Pointer to file to print to
+ *
+ * @return: 0 on success, else error code
+ */
+int morse_pageset_benchmark(struct morse *mors, struct seq_file *file);
+#endif
+
 /**
  * Return a count of all the TX SKBs awaiting a status return
  *
@@ -157,11 +229,17 @@ void morse_pagesets_stale_tx_work(struct work_struct *work);
  */
 int morse_pagesets_get_tx_buffered_count(struct morse *mors);
 
+/* chip_if_ops queue lookups, exposed so the TX path can call them directly */
+struct morse_skbq *skbq_pageset_tc_q_from_aci(struct morse *mors, int aci);
+struct morse_skbq *skbq_pageset_mgmt_tc_q(struct morse *mors);
+struct morse_skbq *skbq_pageset_cmd_tc_q(struct morse *mors);
+
 /**
- * Work function executed to perform pageset operations
+ * Perform pageset operations for pending chip_if events
  *
- * @work: Pointer to work struct.
+ * @mors: Morse chip instance
+ * @events: Mask of the events to handle (BIT(enum morse_chip_if_event_flags))
  */
-void morse_pagesets_work(struct work_struct *work);
+void morse_pagesets_handle_events(struct morse *mors, unsigned long events);
 
 #endif /* !_MORSE_PAGESET_H_ */
@@ -13,6 +13,8 @@
 #include <linux/completion.h>
 #include <linux/gpio.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
 
 #include "morse.h"
 #include "debug.h"
@@ -24,6 +26,50 @@
 
 #define MORSE_PS_DBG(_m, _f, _a...)		morse_dbg(FEATURE_ID_POWERSAVE, _m, _f, ##_a)
 
+/* Traffic periods outside these bounds are not learned */
+#define MORSE_PS_PREDICT_MIN_PERIOD_MS		(200)
+#define MORSE_PS_PREDICT_MAX_PERIOD_MS		(15 * 60 * MSEC_PER_SEC)
+/* Consecutive on-time traffic bursts before pre-waking starts */
+#define MORSE_PS_PREDICT_MIN_HITS		(3)
+/* Consecutive pre-wakes without traffic before the period is forgotten */
+#define MORSE_PS_PREDICT_MAX_MISSES		(3)
+
+/* Bounds of the network activity timeout scale, as multiples of MORSE_PS_TIMEOUT_SCALE_UNIT */
+#define MORSE_PS_TIMEOUT_SCALE_MIN		(MORSE_PS_TIMEOUT_SCALE_UNIT / 4)
+#define MORSE_PS_TIMEOUT_SCALE_MAX		(MORSE_PS_TIMEOUT_SCALE_UNIT * 8)
+
+/* Adapt the network activity timeout to the traffic, instead of using it as given */
+static bool enable_ps_adaptive_timeout __read_mostly;
+module_param(enable_ps_adaptive_timeout, bool, 0644);
+MODULE_PARM_DESC(enable_ps_adaptive_timeout,
+		 "Grow the PS network timeout on sleep/wake thrash and shrink it when idle");
+
+static uint ps_adaptive_thrash_ms __read_mostly = 20;
+module_param(ps_adaptive_thrash_ms, uint, 0644);
+MODULE_PARM_DESC(ps_adaptive_thrash_ms,
+		 "Sleeps (ms) shorter than this which end in network traffic grow the PS timeout");
+
+static uint ps_adaptive_idle_ms __read_mostly = 1000;
+module_param(ps_adaptive_idle_ms, uint, 0644);
+MODULE_PARM_DESC(ps_adaptive_idle_ms,
+		 "Sleeps (ms) longer than this before network traffic shrink the PS timeout");
+
+/* Wake the bus ahead of network traffic that has been arriving periodically */
+static bool enable_ps_predictive_wake __read_mostly;
+module_param(enable_ps_predictive_wake, bool, 0644);
+MODULE_PARM_DESC(enable_ps_predictive_wake, "Wake the bus ahead of periodic network traffic");
+
+/* Larger values cost power but absorb more jitter in the traffic period */
+static uint ps_predict_guard_ms __read_mostly = 10;
+module_param(ps_predict_guard_ms, uint, 0644);
+MODULE_PARM_DESC(ps_predict_guard_ms,
+		 "Time (ms) ahead of predicted traffic, beyond the chip wakeup delay, to wake the bus");
+
+static uint ps_predict_window_ms __read_mostly = 50;
+module_param(ps_predict_window_ms, uint, 0644);
+MODULE_PARM_DESC(ps_predict_window_ms,
+		 "Time (ms) to keep the bus awake after the predicted time for late traffic");
+
 static bool morse_ps_is_busy_pin_asserted(struct morse *mors)
 {
 	bool active_high = !(mors->firmware_flags & MORSE_FW_FLAGS_BUSY_ACTIVE_LOW);
@@ -68,9 +114,87 @@ static void morse_ps_wait_after_wake_pin_raise(struct morse *mors)
 	mdelay(morse_ps_get_wakeup_delay_ms(mors));
 }
 
-static int morse_ps_wakeup(struct morse_ps *mps)
+static const char *const morse_ps_wake_reason_strs[MORSE_PS_WAKE_NUM_REASONS] = {
+	[MORSE_PS_WAKE_TX_BUFFERED] = "tx buffered",
+	[MORSE_PS_WAKE_EVENT_FLAG] = "event flag",
+	[MORSE_PS_WAKE_WAKERS] = "wakers",
+	[MORSE_PS_WAKE_HOLD] = "hold",
+	[MORSE_PS_WAKE_PREDICTED] = "predicted traffic",
+	[MORSE_PS_WAKE_NETWORK] = "network timeout",
+	[MORSE_PS_WAKE_ASYNC_IRQ] = "async irq",
+};
+
+static void morse_ps_stats_minute_roll(struct morse_ps_stats *stats, u64 now_ns)
+{
+	if (now_ns - stats->minute_start_ns < 60ULL * NSEC_PER_SEC)
+		return;
+
+	/* A minute with no wakes at all is a minute of zero wakes */
+	stats->last_minute_wakes = (now_ns - stats->minute_start_ns < 120ULL * NSEC_PER_SEC) ?
+				   stats->minute_wakes : 0;
+	stats->max_minute_wakes = max(stats->max_minute_wakes, stats->last_minute_wakes);
+	stats->minute_wakes = 0;
+	stats->minute_start_ns = now_ns;
+}
+
+static void morse_ps_stats_record_wake(struct morse_ps *mps, enum morse_ps_wake_reason reason,
+				       unsigned long event_flags, u64 start_ns, u64 ready_ns)
+{
+	struct morse_ps_stats *stats = &mps->stats;
+	u32 lat_us = min_t(u64, div_u64(ready_ns - start_ns, NSEC_PER_USEC), U32_MAX);
+	u32 slept_ms = min_t(u64, div_u64(start_ns - stats->last_change_ns, NSEC_PER_MSEC),
+			     U32_MAX);
+	int bit;
+
+	stats->wakes++;
+	stats->reasons[reason]++;
+	if (reason == MORSE_PS_WAKE_EVENT_FLAG)
+		for_each_set_bit(bit, &event_flags, MORSE_PS_STAT_EVENT_BITS)
+			stats->event_flags[bit]++;
+
+	stats->wake_lat_min_us = min(stats->wake_lat_min_us, lat_us);
+	stats->wake_lat_max_us = max(stats->wake_lat_max_us, lat_us);
+	stats->wake_lat_total_us += lat_us;
+	stats->wake_lat_hist[morse_hist_bucket(lat_us, MORSE_PS_STAT_LAT_BUCKETS)]++;
+
+	/* Sleep residency is only known for sleeps that started after the stats did */
+	if (stats->sleeps) {
+		stats->sleep_max_ms = max(stats->sleep_max_ms, slept_ms);
+		stats->sleep_total_ms += slept_ms;
+		stats->sleep_hist[morse_hist_bucket(slept_ms, MORSE_PS_STAT_RES_BUCKETS)]++;
+	}
+
+	morse_ps_stats_minute_roll(stats, ready_ns);
+	stats->minute_wakes++;
+	stats->last_change_ns = ready_ns;
+}
+
+static void morse_ps_stats_record_sleep(struct morse_ps *mps, u64 now_ns)
+{
+	struct morse_ps_stats *stats = &mps->stats;
+
+	stats->sleeps++;
+	stats->awake_total_ms += div_u64(now_ns - stats->last_change_ns, NSEC_PER_MSEC);
+	stats->last_change_ns = now_ns;
+	morse_ps_stats_minute_roll(stats, now_ns);
+}
+
+static void morse_ps_stats_init(struct morse_ps_stats *stats)
+{
+	u64 now_ns = ktime_get_ns();
+
+	memset(stats, 0, sizeof(*stats));
+	stats->since_ns = now_ns;
+	stats->last_change_ns = now_ns;
+	stats->minute_start_ns = now_ns;
+	stats->wake_lat_min_us = U32_MAX;
+}
+
+static int morse_ps_wakeup(struct morse_ps *mps, enum morse_ps_wake_reason reason,
+			   unsigned long event_flags)
 {
 	struct morse *mors = container_of(mps, struct morse, ps);
+	u64 start_ns;
 
 	if (!mps->enable)
 		return 0;
@@ -78,13 +202,109 @@ static int morse_ps_wakeup(struct morse_ps *mps)
 	if (!mps->suspended)
 		return 0;
 
+	start_ns = ktime_get_ns();
 	morse_ps_set_wake_gpio(mors, true);
 	morse_ps_wait_after_wake_pin_raise(mors);
 	morse_set_bus_enable(mors, true);
+	morse_hw_trace_point(MORSE_HWT_PS_AWAKE, true);
 	mps->suspended = false;
+	mps->wake_start = jiffies;
+	morse_ps_stats_record_wake(mps, reason, event_flags, start_ns, ktime_get_ns());
 	return 0;
 }
 
+/**
+ * morse_ps_predict_arm() - Schedule a pre-wake ahead of the next predicted traffic burst
+ * @mps: PS state, with the lock held
+ */
+static void morse_ps_predict_arm(struct morse_ps *mps)
+{
+	struct morse *mors = container_of(mps, struct morse, ps);
+	unsigned long next;
+	unsigned long wake_at;
+	unsigned long lead;
+
+	if (!enable_ps_predictive_wake || mps->predict.hits < MORSE_PS_PREDICT_MIN_HITS)
+		return;
+
+	next = mps->predict.last_burst + mps->predict.period;
+	if (time_after_eq(jiffies, next))
+		return;
+
+	lead = msecs_to_jiffies(morse_ps_get_wakeup_delay_ms(mors) + ps_predict_guard_ms);
+	wake_at = next - lead;
+
+	MORSE_PS_DBG(mors, "%s: Pre-wake in %u ms\n", __func__,
+		     time_after(wake_at, jiffies) ? jiffies_to_msecs(wake_at - jiffies) : 0);
+	mod_delayed_work(mors->chip_wq, &mps->predict.work,
+			 time_after(wake_at, jiffies) ? wake_at - jiffies : 0);
+}
+
+/**
+ * morse_ps_predict_learn() - Learn the traffic period from the start of a traffic burst
+ * @mps: PS state, with the lock held
+ *
+ * Only the first network activity after the bus has slept is a burst start, traffic which keeps
+ * the bus awake costs no wakeup delay so is not worth predicting.
+ */
+static void morse_ps_predict_learn(struct morse_ps *mps)
+{
+	unsigned long now = jiffies;
+	unsigned long interval = now - mps->predict.last_burst;
+	unsigned long period = mps->predict.period;
+	unsigned long tolerance;
+
+	if (!mps->predict.slept)
+		return;
+
+	mps->predict.slept = false;
+	mps->predict.prewoken = false;
+	mps->predict.misses = 0;
+	mps->predict.last_burst = now;
+
+	if (interval < msecs_to_jiffies(MORSE_PS_PREDICT_MIN_PERIOD_MS) ||
+	    interval > msecs_to_jiffies(MORSE_PS_PREDICT_MAX_PERIOD_MS)) {
+		mps->predict.hits = 0;
+		return;
+	}
+
+	tolerance = max_t(unsigned long, period / 8, msecs_to_jiffies(ps_predict_guard_ms));
+	if (period && interval + tolerance >= period && interval <= period + tolerance) {
+		/* Track slow drift in the period */
+		mps->predict.period = period - (period / 4) + (interval / 4);
+		if (mps->predict.hits < U8_MAX)
+			mps->predict.hits++;
+	} else {
+		mps->predict.period = interval;
+		mps->predict.hits = 0;
+	}
+}
+
+static int morse_ps_evaluate(struct morse_ps *mps);
+
+static void morse_ps_predict_work(struct work_struct *work)
+{
+	struct morse_ps *mps = container_of(work, struct morse_ps, predict.work.work);
+	struct morse *mors = container_of(mps, struct morse, ps);
+	unsigned long hold_timeout;
+
+	if (!mps->enable)
+		return;
+
+	mutex_lock(&mps->lock);
+	if (mps->suspended && mps->predict.slept) {
+		hold_timeout = mps->predict.last_burst + mps->predict.period +
+			       msecs_to_jiffies(ps_predict_window_ms);
+		if (time_after(hold_timeout, mps->hold_timeout))
+			mps->hold_timeout = hold_timeout;
+
+		MORSE_PS_DBG(mors, "%s: Waking ahead of predicted traffic\n", __func__);
+		mps->predict.prewoken = true;
+		morse_ps_evaluate(mps);
+	}
+	mutex_unlock(&mps->lock);
+}
+
 static int morse_ps_sleep(struct morse_ps *mps)
 {
 	struct morse *mors = container_of(mps, struct morse, ps);
@@ -96,8 +316,23 @@ static int morse_ps_sleep(struct morse_ps *mps)
 		return 0;
 
 	mps->suspended = true;
+	morse_hw_trace_point(MORSE_HWT_PS_AWAKE, false);
 	morse_set_bus_enable(mors, false);
 	morse_ps_set_wake_gpio(mors, false);
+	morse_ps_stats_record_sleep(mps, ktime_get_ns());
+	mps->sleep_start = jiffies;
+
+	mps->predict.slept = true;
+	if (mps->predict.prewoken) {
+		/* The predicted traffic did not come, it may have skipped a period */
+		mps->predict.prewoken = false;
+		if (++mps->predict.misses >= MORSE_PS_PREDICT_MAX_MISSES)
+			mps->predict.hits = 0;
+		else
+			mps->predict.last_burst += mps->predict.period;
+	}
+	morse_ps_predict_arm(mps);
+
 	return 0;
 }
 
@@ -122,31 +357,83 @@ static void morse_ps_async_wake_work(struct work_struct *work)
 		return;
 
 	mutex_lock(&mps->lock);
-	morse_ps_wakeup(mps);
+	morse_ps_wakeup(mps, MORSE_PS_WAKE_ASYNC_IRQ, 0);
 	mutex_unlock(&mps->lock);
 }
 
+/**
+ * morse_ps_adapt_timeout() - Adapt the network activity timeout to how long the bus last slept
+ * @mps: PS state, with the lock held
+ *
+ * Network traffic shortly after the bus went to sleep means the timeout was too short to cover
+ * the gaps in that traffic, so the wake cost is paid again: double it. Traffic after a long sleep
+ * means the bus was idle most of the time, so the timeout is mostly spent waiting: shrink it
+ * gradually.
+ */
+static void morse_ps_adapt_timeout(struct morse_ps *mps)
+{
+	unsigned long slept_ms;
+	u16 scale = mps->bus_timeout_scale;
+
+	if (!enable_ps_adaptive_timeout || !mps->predict.slept)
+		return;
+
+	slept_ms = jiffies_to_msecs(mps->wake_start - mps->sleep_start);
+	if (slept_ms < ps_adaptive_thrash_ms)
+		scale = min_t(u16, scale * 2, MORSE_PS_TIMEOUT_SCALE_MAX);
+	else if (slept_ms > ps_adaptive_idle_ms)
+		scale = max_t(u16, scale - max(scale / 8, 1), MORSE_PS_TIMEOUT_SCALE_MIN);
+
+	if (scale != mps->bus_timeout_scale) {
+		MORSE_PS_DBG(container_of(mps, struct morse, ps),
+			     "%s: Slept %lu ms, timeout scale %u/%u\n", __func__, slept_ms, scale,
+			     MORSE_PS_TIMEOUT_SCALE_UNIT);
+		mps->bus_timeout_scale = scale;
+	}
+}
+
 void morse_ps_bus_activity(struct morse *mors, int timeout_ms)
 {
-	mutex_lock(&mors->ps.lock);
-	mors->ps.bus_ps_timeout = jiffies + msecs_to_jiffies(timeout_ms);
-	mutex_unlock(&mors->ps.lock);
+	struct morse_ps *mps = &mors->ps;
+
+	mutex_lock(&mps->lock);
+	morse_ps_adapt_timeout(mps);
+	if (enable_ps_adaptive_timeout)
+		timeout_ms = DIV_ROUND_UP(timeout_ms * mps->bus_timeout_scale,
+					  MORSE_PS_TIMEOUT_SCALE_UNIT);
+	mps->bus_ps_timeout = jiffies + msecs_to_jiffies(timeout_ms);
+	morse_ps_predict_learn(mps);
+	mutex_unlock(&mps->lock);
 }
 
 static int morse_ps_evaluate(struct morse_ps *mps)
 {
 	struct morse *mors = container_of(mps, struct morse, ps);
-	bool needs_wake = false;
+	bool needs_wake = true;
 	bool eval_later = false;
+	enum morse_ps_wake_reason reason;
 	unsigned long flags_on_entry =
 		(mors->chip_if->event_flags & ~BIT(MORSE_DATA_TRAFFIC_PAUSE_PEND));
 
 	if (!mps->enable)
 		return 0;
 
-	needs_wake = (mps->wakers > 0);
-	needs_wake |= (flags_on_entry > 0);
-	needs_wake |= (mors->cfg->ops->skbq_get_tx_buffered_count(mors) > 0);
+	/* Attribute the wake to the most specific reason */
+	if (morse_chip_if_tx_buffered_count(mors) > 0)
+		reason = MORSE_PS_WAKE_TX_BUFFERED;
+	else if (flags_on_entry > 0)
+		reason = MORSE_PS_WAKE_EVENT_FLAG;
+	else if (mps->wakers > 0)
+		reason = MORSE_PS_WAKE_WAKERS;
+	else
+		needs_wake = false;
+
+	if (!needs_wake && time_before(jiffies, mps->hold_timeout)) {
+		/* A recent client asked for the chip to stay awake a little longer */
+		reason = mps->predict.prewoken ? MORSE_PS_WAKE_PREDICTED : MORSE_PS_WAKE_HOLD;
+		needs_wake = true;
+		eval_later = true;
+	}
 
 	if (!needs_wake &&
 	    mps->dynamic_ps_en &&
@@ -159,12 +446,13 @@ static int morse_ps_evaluate(struct morse_ps *mps)
 		 * In TWT, the device may go into TWT sleep immediately without
 		 * caring about recent network traffic.
 		 */
+		reason = MORSE_PS_WAKE_NETWORK;
 		needs_wake = true;
 		eval_later = true;
 	}
 
 	if (needs_wake) {
-		morse_ps_wakeup(mps);
+		morse_ps_wakeup(mps, reason, flags_on_entry);
 	} else if (morse_ps_is_busy_pin_asserted(mors)) {
 		/* Chip has something to send across the bus, re-evaluate later */
 		eval_later = true;
@@ -178,6 +466,8 @@ static int morse_ps_evaluate(struct morse_ps *mps)
 
 		if (mps->dynamic_ps_en && time_after(mps->bus_ps_timeout, expire))
 			expire = mps->bus_ps_timeout;
+		if (time_after(mps->hold_timeout, expire))
+			expire = mps->hold_timeout;
 
 		expire = expire - jiffies;
 		MORSE_PS_DBG(mors, "%s: Delaying eval work by %d ms\n",
@@ -206,6 +496,11 @@ static void morse_ps_evaluate_work(struct work_struct *work)
 }
 
 int morse_ps_enable(struct morse *mors)
+{
+	return morse_ps_enable_hold(mors, 0);
+}
+
+int morse_ps_enable_hold(struct morse *mors, u32 hold_ms)
 {
 	int ret;
 	struct morse_ps *mps = &mors->ps;
@@ -215,6 +510,13 @@ int morse_ps_enable(struct morse *mors)
 
 	mutex_lock(&mps->lock);
 
+	if (hold_ms) {
+		unsigned long hold_timeout = jiffies + msecs_to_jiffies(hold_ms);
+
+		if (time_after(hold_timeout, mps->hold_timeout))
+			mps->hold_timeout = hold_timeout;
+	}
+
 	if (mps->wakers == 0) {
 		MORSE_WARN_ON_ONCE(FEATURE_ID_POWERSAVE, 1);
 		ret = -EFAULT;
@@ -254,14 +556,21 @@ int morse_ps_init(struct morse *mors, bool enable, bool enable_dynamic_ps)
 
 	mps->enable = enable;
 	mps->bus_ps_timeout = jiffies;
+	mps->hold_timeout = jiffies;
 	mps->dynamic_ps_en = enable_dynamic_ps;
 	mps->suspended = false;
 	mps->wakers = 1;	/* we default to being on */
+	mps->bus_timeout_scale = MORSE_PS_TIMEOUT_SCALE_UNIT;
+	mps->sleep_start = jiffies;
+	mps->wake_start = jiffies;
+	mps->predict.last_burst = jiffies;
+	morse_ps_stats_init(&mps->stats);
 	mutex_init(&mps->lock);
 
 	if (mps->enable) {
 		INIT_WORK(&mps->async_wake_work, morse_ps_async_wake_work);
 		INIT_DELAYED_WORK(&mps->delayed_eval_work, morse_ps_evaluate_work);
+		INIT_DELAYED_WORK(&mps->predict.work, morse_ps_predict_work);
 
 		if (!mors->cfg->mm_ps_gpios_supported) {
 			/* The rest of the code is GPIO related, we need to bail */
@@ -312,5 +621,94 @@ void morse_ps_finish(struct morse *mors)
 
 		cancel_work_sync(&mps->async_wake_work);
 		cancel_delayed_work_sync(&mps->delayed_eval_work);
+		cancel_delayed_work_sync(&mps->predict.work);
 	}
 }
+
+void morse_ps_stats_reset(struct morse *mors)
+{
+	struct morse_ps *mps = &mors->ps;
+
+	mutex_lock(&mps->lock);
+	morse_ps_stats_init(&mps->stats);
+	mutex_unlock(&mps->lock);
+}
+
+static void morse_ps_stats_show_hist(struct seq_file *file, const unsigned int *hist,
+				     int buckets, const char *unit)
+{
+	int i;
+
+	for (i = 0; i < buckets; i++) {
+		if (!hist[i])
+			continue;
+
+		if (i == buckets - 1)
+			seq_printf(file, "\t>= %lu%s: %u\n", 1UL << (i - 1), unit, hist[i]);
+		else
+			seq_printf(file, "\t< %lu%s: %u\n", 1UL << i, unit, hist[i]);
+	}
+}
+
+int morse_ps_stats_show(struct morse *mors, struct seq_file *file)
+{
+	struct morse_ps *mps = &mors->ps;
+	struct morse_ps_stats *stats;
+	u64 now_ns;
+	u64 elapsed_ms;
+	int i;
+
+	if (!mps->enable)
+		return -ENODEV;
+
+	/* Copy out so the lock is not held while printing */
+	stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return -ENOMEM;
+
+	mutex_lock(&mps->lock);
+	now_ns = ktime_get_ns();
+	morse_ps_stats_minute_roll(&mps->stats, now_ns);
+	memcpy(stats, &mps->stats, sizeof(*stats));
+	/* Account for the current state up to now */
+	if (mps->suspended)
+		stats->sleep_total_ms += div_u64(now_ns - stats->last_change_ns, NSEC_PER_MSEC);
+	else
+		stats->awake_total_ms += div_u64(now_ns - stats->last_change_ns, NSEC_PER_MSEC);
+	mutex_unlock(&mps->lock);
+
+	elapsed_ms = max_t(u64, div_u64(now_ns - stats->since_ns, NSEC_PER_MSEC), 1);
+
+	seq_printf(file, "elapsed (ms): %llu\n", elapsed_ms);
+	seq_printf(file, "state: %s\n", mps->suspended ? "asleep" : "awake");
+	seq_printf(file, "network timeout scale: %u/%u\n", READ_ONCE(mps->bus_timeout_scale),
+		   MORSE_PS_TIMEOUT_SCALE_UNIT);
+	seq_printf(file, "wakes: %u\n", stats->wakes);
+	seq_printf(file, "sleeps: %u\n", stats->sleeps);
+	seq_printf(file, "wakes per minute: avg %llu, last minute %u, max %u\n",
+		   div64_u64((u64)stats->wakes * 60 * MSEC_PER_SEC, elapsed_ms),
+		   stats->last_minute_wakes, stats->max_minute_wakes);
+	seq_printf(file, "awake (ms): %llu\n", stats->awake_total_ms);
+	seq_printf(file, "asleep (ms): %llu\n", stats->sleep_total_ms);
+
+	seq_puts(file, "wake reasons:\n");
+	for (i = 0; i < MORSE_PS_WAKE_NUM_REASONS; i++)
+		seq_printf(file, "\t%s: %u\n", morse_ps_wake_reason_strs[i], stats->reasons[i]);
+
+	seq_puts(file, "event flag wakes:\n");
+	for (i = 0; i < MORSE_PS_STAT_EVENT_BITS; i++)
+		if (stats->event_flags[i])
+			seq_printf(file, "\tbit %d: %u\n", i, stats->event_flags[i]);
+
+	seq_printf(file, "wake latency (us): min %u, avg %llu, max %u\n",
+		   stats->wakes ? stats->wake_lat_min_us : 0,
+		   stats->wakes ? div_u64(stats->wake_lat_total_us, stats->wakes) : 0,
+		   stats->wake_lat_max_us);
+	morse_ps_stats_show_hist(file, stats->wake_lat_hist, MORSE_PS_STAT_LAT_BUCKETS, "us");
+
+	seq_printf(file, "sleep residency (ms): max %u\n", stats->sleep_max_ms);
+	morse_ps_stats_show_hist(file, stats->sleep_hist, MORSE_PS_STAT_RES_BUCKETS, "ms");
+
+	kfree(stats);
+	return 0;
+}
@@ -9,11 +9,15 @@
  */
 #include "morse.h"
 
+struct seq_file;
+
 /** This should be nominally <= the dynamic ps timeout */
 #define NETWORK_BUS_TIMEOUT_MS (90)
 #define UAPSD_NETWORK_BUS_TIMEOUT_MS (5)
 /** The default period of time to wait to re-evaluate powersave */
 #define DEFAULT_BUS_TIMEOUT_MS (5)
+/** Network activity timeouts are scaled in units of 1/MORSE_PS_TIMEOUT_SCALE_UNIT */
+#define MORSE_PS_TIMEOUT_SCALE_UNIT (16)
 
 static inline int morse_network_bus_timeout(struct morse *mors)
 {
@@ -36,6 +40,16 @@ int morse_ps_disable(struct morse *mors);
  */
 int morse_ps_enable(struct morse *mors);
 
+/**
+ * morse_ps_enable_hold() - Release the wake line after a grace period.
+ * @mors: Morse chip instance
+ * @hold_ms: Keep the chip awake for this long (ms) after the last waker is released
+ *
+ * Like morse_ps_enable(), but a following morse_ps_disable() within @hold_ms finds the chip
+ * still awake, so back-to-back operations do not pay the wakeup delay each time.
+ */
+int morse_ps_enable_hold(struct morse *mors, u32 hold_ms);
+
 /**
  * Call this function when there is activity on the bus that should
  * delay the driver in disabling the bus.
@@ -45,6 +59,21 @@ int morse_ps_enable(struct morse *mors);
  */
 void morse_ps_bus_activity(struct morse *mors, int timeout_ms);
 
+/**
+ * morse_ps_stats_show() - Print the power save wake and sleep statistics
+ * @mors: Morse chip instance
+ * @file: File to print to
+ *
+ * Return: 0 on success, -ENODEV if power save is not enabled
+ */
+int morse_ps_stats_show(struct morse *mors, struct seq_file *file);
+
+/**
+ * morse_ps_stats_reset() - Clear the power save wake and sleep statistics
+ * @mors: Morse chip instance
+ */
+void morse_ps_stats_reset(struct morse *mors);
+
 int morse_ps_init(struct morse *mors, bool enable, bool enable_dynamic_ps);
 
 void morse_ps_finish(struct morse *mors);
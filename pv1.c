@@ -11,12 +11,27 @@
 #include <linux/crc32.h>
 #include <linux/ieee80211.h>
 #include <linux/bitfield.h>
+#include <linux/module.h>
 
 #include "morse.h"
 #include "mac.h"
 #include "pv1.h"
 #include "debug.h"
 
+static bool enable_pv1_tx_template __read_mostly = true;
+module_param(enable_pv1_tx_template, bool, 0644);
+MODULE_PARM_DESC(enable_pv1_tx_template, "Reuse PV1 TX headers while the PV0 addresses are unchanged");
+
+/**
+ * morse_pv1_invalidate_tx_templates - Drop the PV1 TX header templates of a peer STA
+ *
+ * @mors_sta:  Peer STA
+ */
+static void morse_pv1_invalidate_tx_templates(struct morse_sta *mors_sta)
+{
+	WRITE_ONCE(mors_sta->pv1_tx_templates.gen, mors_sta->pv1_tx_templates.gen + 1);
+}
+
 /**
  * morse_pv1_retrieve_tx_bpn - Retrieve the PV1 Tx BPN for QoS Data & MGMT frames per TID
  *
@@ -150,6 +165,9 @@ static void morse_mac_process_hc_response(struct morse_dot11ah_s1g_action *mgmt,
 
 	memcpy(mors_vif->pv1.tx_pv1_sta_addr, sta->addr, ETH_ALEN);
 
+	/* The stored addresses decide the PV1 frame type and which addresses are sent */
+	morse_pv1_invalidate_tx_templates(mors_sta);
+
 	if (resp_status->a3_stored || resp_status->a4_stored)
 		schedule_work(&mors_vif->pv1.hc_resp_work);
 
@@ -300,7 +318,7 @@ void morse_mac_send_pv1_hc_action_frame(struct morse *mors,
 		return;
 
 	ie_len = morse_dot11ah_insert_pv1_hc_ie(vif, ies_mask, is_response);
-	mq = mors->cfg->ops->skbq_mgmt_tc_q(mors);
+	mq = morse_chip_if_mgmt_tc_q(mors);
 
 	skb = morse_skbq_alloc_skb(mq, frame_len + ie_len);
 	if (!skb)
@@ -353,6 +371,36 @@ end:
 	morse_dot11ah_ies_mask_free(ies_mask);
 }
 
+/**
+ * morse_prepare_pv1_frame_ctrl_flags - Prepare the PV1 frame control bits that can change
+ *                                      from frame to frame, see MORSE_PV1_FCTL_PER_FRAME
+ *
+ * @hdr:         PV0 MAC Header
+ */
+static u16 morse_prepare_pv1_frame_ctrl_flags(struct ieee80211_hdr *hdr)
+{
+	__le16 pv0_fc = hdr->frame_control;
+	u8 *qos_ctrl = ieee80211_get_qos_ctl(hdr);
+	u16 pv1_fc = 0;
+
+	if (ieee80211_has_morefrags(pv0_fc))
+		pv1_fc |= IEEE80211_PV1_FCTL_MOREFRAGS;
+
+	if (ieee80211_has_pm(pv0_fc))
+		pv1_fc |= IEEE80211_PV1_FCTL_PM;
+
+	if (ieee80211_has_moredata(pv0_fc))
+		pv1_fc |= IEEE80211_PV1_FCTL_MOREDATA;
+
+	if (ieee80211_has_protected(pv0_fc))
+		pv1_fc |= IEEE80211_PV1_FCTL_PROTECTED;
+
+	if (*qos_ctrl & IEEE80211_QOS_CTL_EOSP)
+		pv1_fc |= IEEE80211_PV1_FCTL_END_SP;
+
+	return pv1_fc;
+}
+
 /**
  * morse_prepare_pv1_frame_ctrl  - Prepare PV1 frame control for PV1 data
  *
@@ -381,22 +429,7 @@ static u16 morse_prepare_pv1_frame_ctrl(struct morse_vif *mors_vif,
 	if (ieee80211_has_fromds(pv0_fc))
 		pv1_fc |= (IEEE80211_PV1_FCTL_FROMDS);
 
-	if (ieee80211_has_morefrags(pv0_fc))
-		pv1_fc |= IEEE80211_PV1_FCTL_MOREFRAGS;
-
-	if (ieee80211_has_pm(pv0_fc))
-		pv1_fc |= IEEE80211_PV1_FCTL_PM;
-
-	if (ieee80211_has_moredata(pv0_fc))
-		pv1_fc |= IEEE80211_PV1_FCTL_MOREDATA;
-
-	if (ieee80211_has_protected(pv0_fc))
-		pv1_fc |= IEEE80211_PV1_FCTL_PROTECTED;
-
-	if (*qos_ctrl & IEEE80211_QOS_CTL_EOSP)
-		pv1_fc |= IEEE80211_PV1_FCTL_END_SP;
-
-	return pv1_fc;
+	return pv1_fc | morse_prepare_pv1_frame_ctrl_flags(hdr);
 }
 
 /**
@@ -516,6 +549,132 @@ static int morse_prepare_pv1_mac_header(struct ieee80211_vif *vif,
 	return sizeof(*pv1_hdr);
 }
 
+/**
+ * morse_pv1_tx_template_matches - Check if a PV1 TX template was built for the addresses
+ *                                 of a PV0 frame
+ *
+ * @tmpl:    Template for the PTID of the frame
+ * @gen:     Current template generation of the peer STA
+ * @pv0_hdr: PV0 MAC header
+ *
+ * @return:  true if the template can be used
+ */
+static bool morse_pv1_tx_template_matches(const struct morse_pv1_tx_template *tmpl, u32 gen,
+		struct ieee80211_hdr *pv0_hdr)
+{
+	__le16 ds = pv0_hdr->frame_control & cpu_to_le16(IEEE80211_FCTL_TODS |
+							  IEEE80211_FCTL_FROMDS);
+
+	if (!tmpl->valid || tmpl->gen != gen || tmpl->pv0_ds != ds)
+		return false;
+
+	/* A1, A2 and A3 are contiguous in the PV0 header */
+	if (memcmp(tmpl->pv0_addr, pv0_hdr->addr1, sizeof(tmpl->pv0_addr)))
+		return false;
+
+	return !ieee80211_has_a4(ds) || !memcmp(tmpl->pv0_addr4, pv0_hdr->addr4, ETH_ALEN);
+}
+
+/**
+ * morse_pv1_tx_template_store - Save a PV1 header as the template for the addresses of
+ *                               a PV0 frame
+ *
+ * @tmpl:    Template for the PTID of the frame
+ * @gen:     Template generation of the peer STA the header was built against
+ * @pv0_hdr: PV0 MAC header
+ * @pv1_hdr: PV1 MAC header built for the frame
+ * @len:     Length of the PV1 MAC header
+ */
+static void morse_pv1_tx_template_store(struct morse_pv1_tx_template *tmpl, u32 gen,
+		struct ieee80211_hdr *pv0_hdr, struct dot11ah_mac_pv1_hdr *pv1_hdr, int len)
+{
+	if (len > sizeof(tmpl->hdr)) {
+		tmpl->valid = false;
+		return;
+	}
+
+	tmpl->gen = gen;
+	tmpl->pv0_ds = pv0_hdr->frame_control & cpu_to_le16(IEEE80211_FCTL_TODS |
+							     IEEE80211_FCTL_FROMDS);
+	memcpy(tmpl->pv0_addr, pv0_hdr->addr1, sizeof(tmpl->pv0_addr));
+	if (ieee80211_has_a4(pv0_hdr->frame_control))
+		memcpy(tmpl->pv0_addr4, pv0_hdr->addr4, ETH_ALEN);
+	tmpl->pv1_fc = le16_to_cpu(pv1_hdr->frame_ctrl) & ~MORSE_PV1_FCTL_PER_FRAME;
+	tmpl->len = len;
+	memcpy(tmpl->hdr, pv1_hdr, len);
+	tmpl->valid = true;
+}
+
+/**
+ * morse_pv1_tx_template_apply - Build a PV1 header from a template, filling in the per
+ *                               frame control bits and sequence control of the PV0 frame
+ *
+ * @tmpl:    Template matching the frame
+ * @pv1_hdr: PV1 MAC header to fill
+ * @pv0_hdr: PV0 MAC header
+ *
+ * @return:  PV1 header size
+ */
+static int morse_pv1_tx_template_apply(const struct morse_pv1_tx_template *tmpl,
+		struct dot11ah_mac_pv1_hdr *pv1_hdr, struct ieee80211_hdr *pv0_hdr)
+{
+	u16 fc = tmpl->pv1_fc | morse_prepare_pv1_frame_ctrl_flags(pv0_hdr);
+
+	memcpy(pv1_hdr, tmpl->hdr, tmpl->len);
+	pv1_hdr->frame_ctrl = cpu_to_le16(fc);
+
+	switch (fc & IEEE80211_PV1_FCTL_FTYPE) {
+	case DOT11_MAC_PV1_FRAME_TYPE_QOS_DATA_SID:
+		((struct dot11ah_mac_pv1_qos_data_sid_hdr *)pv1_hdr)->sequence_ctrl =
+			cpu_to_le16(pv0_hdr->seq_ctrl);
+		break;
+	case DOT11_MAC_PV1_FRAME_TYPE_QOS_DATA:
+		((struct dot11ah_mac_pv1_qos_data_hdr *)pv1_hdr)->sequence_ctrl =
+			cpu_to_le16(pv0_hdr->seq_ctrl);
+		break;
+	default:
+		break;
+	}
+
+	return tmpl->len;
+}
+
+/**
+ * morse_pv1_prepare_tx_header - Get the PV1 MAC header for a PV0 frame, from the template
+ *                               of its PTID when the addresses have not changed
+ *
+ * @mors_vif: Valid AP/STA VIF
+ * @sta:      Pointer to peer STA context
+ * @pv1_hdr:  Pointer to PV1 MAC header to fill
+ * @pv0_hdr:  Pointer to PV0 MAC header
+ *
+ * @return:   PV1 header size
+ */
+static int morse_pv1_prepare_tx_header(struct morse_vif *mors_vif, struct ieee80211_sta *sta,
+		struct dot11ah_mac_pv1_hdr *pv1_hdr, struct ieee80211_hdr *pv0_hdr)
+{
+	struct morse_sta *mors_sta = (struct morse_sta *)sta->drv_priv;
+	struct ieee80211_vif *vif = morse_vif_to_ieee80211_vif(mors_vif);
+	u8 *qos_ctrl = ieee80211_get_qos_ctl(pv0_hdr);
+	struct morse_pv1_tx_template *tmpl =
+		&mors_sta->pv1_tx_templates.ptid[TID_TO_PTID(qos_ctrl[0])];
+	/* Read before the header is built, so a concurrent invalidation is not lost */
+	u32 gen = READ_ONCE(mors_sta->pv1_tx_templates.gen);
+	u16 pv1_fc;
+	int len;
+
+	if (enable_pv1_tx_template && morse_pv1_tx_template_matches(tmpl, gen, pv0_hdr))
+		return morse_pv1_tx_template_apply(tmpl, pv1_hdr, pv0_hdr);
+
+	pv1_fc = morse_prepare_pv1_frame_ctrl(mors_vif, mors_sta, pv0_hdr);
+	len = morse_prepare_pv1_mac_header(vif, sta, pv1_hdr, pv0_hdr, pv1_fc);
+
+	if (enable_pv1_tx_template)
+		morse_pv1_tx_template_store(tmpl, gen, pv0_hdr, pv1_hdr, len);
+
+	return len;
+}
+
 /**
  * morse_convert_pv0_to_pv1 - Convert PV0 to PV1 frame
  *
@@ -529,9 +688,7 @@ static int morse_prepare_pv1_mac_header(struct ieee80211_vif *vif,
 static int morse_convert_pv0_to_pv1(struct morse *mors, struct morse_vif *mors_vif,
 		struct ieee80211_sta *sta, struct sk_buff *skb)
 {
-	struct morse_sta *mors_sta = (struct morse_sta *)sta->drv_priv;
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)(skb)->data;
-	struct ieee80211_vif *vif = morse_vif_to_ieee80211_vif(mors_vif);
 	u16 pv0_fc = le16_to_cpu(hdr->frame_control);
 	u8 tid = skb->priority & IEEE80211_QOS_CTL_TAG1D_MASK;
 	u16 seq_num = IEEE80211_SEQ_TO_SN(hdr->seq_ctrl);
@@ -541,14 +698,12 @@ static int morse_convert_pv0_to_pv1(struct morse *mors, struct morse_vif *mors_v
 			(struct dot11ah_mac_pv1_hdr *)pv1_header_buf;
 	bool is_protected = pv0_fc & IEEE80211_FCTL_PROTECTED;
 	int bpn = 0;
-	u16 pv1_fc;
 	int pv1_header_length;
 	int pv0_hdr_len;
 	int headroom_required;
 
 	pv0_hdr_len = (ieee80211_get_qos_ctl(hdr) - (u8 *)hdr) + IEEE80211_QOS_CTL_LEN;
-	pv1_fc = morse_prepare_pv1_frame_ctrl(mors_vif, mors_sta, hdr);
-	pv1_header_length = morse_prepare_pv1_mac_header(vif, sta, pv1_mac_header, hdr, pv1_fc);
+	pv1_header_length = morse_pv1_prepare_tx_header(mors_vif, sta, pv1_mac_header, hdr);
 	headroom_required = (skb->len - pv0_hdr_len) + pv1_header_length;
 
 	if (is_protected) {
@@ -648,21 +803,12 @@ static void morse_convert_pv1_to_pv0_qos_ctrl(u8 *qos, u16 fc)
  */
 static struct ieee80211_sta *morse_pv1_find_sta_by_aid(struct morse_vif *mors_vif, u16 aid)
 {
-	struct list_head *morse_sta_list = &mors_vif->ap->stas;
-	struct list_head *pos;
+	struct morse_sta *msta = morse_mac_find_sta_by_aid(mors_vif, aid);
 
-	list_for_each(pos, morse_sta_list) {
-		struct morse_sta *msta = list_entry(pos, struct morse_sta, list);
-
-		if (msta) {
-			struct ieee80211_sta *sta =
-				container_of((void *)msta, struct ieee80211_sta, drv_priv);
-			if (sta->aid == aid)
-				return sta;
-		}
-	}
+	if (!msta)
+		return NULL;
 
-	return NULL;
+	return container_of((void *)msta, struct ieee80211_sta, drv_priv);
 }
 
 struct ieee80211_sta *morse_pv1_find_sta(struct ieee80211_vif *vif,
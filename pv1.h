@@ -218,6 +218,45 @@ struct morse_sta_pv1 {
 	u32 bpn[IEEE80211_NUM_PTIDS + 1];
 };
 
+/** PV1 frame control bits taken from each PV0 frame rather than from a template */
+#define MORSE_PV1_FCTL_PER_FRAME	(IEEE80211_PV1_FCTL_MOREFRAGS | IEEE80211_PV1_FCTL_PM | \
+					 IEEE80211_PV1_FCTL_MOREDATA | \
+					 IEEE80211_PV1_FCTL_PROTECTED | IEEE80211_PV1_FCTL_END_SP)
+
+/**
+ * struct morse_pv1_tx_template - PV1 header last built on a PTID, reused while the PV0
+ *                                addresses of the frames stay the same
+ */
+struct morse_pv1_tx_template {
+	/** Set once the template has been built */
+	bool valid;
+	/** Value of &struct morse_pv1_tx_templates gen when the template was built */
+	u32 gen;
+	/** PV0 DS bits the template was built for */
+	__le16 pv0_ds;
+	/** PV0 A1, A2 and A3 the template was built for */
+	u8 pv0_addr[3 * ETH_ALEN];
+	/** PV0 A4 the template was built for, if the frame had one */
+	u8 pv0_addr4[ETH_ALEN];
+	/** PV1 frame control without the bits in MORSE_PV1_FCTL_PER_FRAME */
+	u16 pv1_fc;
+	/** Length of the PV1 header */
+	u8 len;
+	u8 hdr[DOT11_PV1_MAC_HEADER_SIZE_MAX];
+};
+
+/**
+ * struct morse_pv1_tx_templates - PV1 TX header templates of a peer STA
+ */
+struct morse_pv1_tx_templates {
+	/**
+	 * Bumped by morse_pv1_invalidate_tx_templates() whenever the stored header
+	 * compression state changes, so older templates are rebuilt
+	 */
+	u32 gen;
+	struct morse_pv1_tx_template ptid[IEEE80211_NUM_PTIDS];
+};
+
 static inline bool morse_dot11ah_is_protocol_version_1(u16 fc)
 {
 	return ((fc & IEEE80211_PV1_FCTL_VERS) == 1);
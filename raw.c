@@ -90,6 +90,16 @@ enum ieee80211_s1g_rps_raw_chan_activity_flags {
 	IEEE80211_S1G_RPS_RAW_CHAN_DL_ACTIVITY = BIT(4),
 };
 
+/** The AID list grows by at least this many AIDs at a time */
+#define MORSE_RAW_AID_LIST_MIN_GROWTH	(32)
+
+/** Airtime given in a slot for each frame its stations are expected to exchange */
+#define MORSE_RAW_ADAPTIVE_FRAME_US	(1000)
+/** Fractional bits of the smoothed activity of adaptive RAWs */
+#define MORSE_RAW_ADAPTIVE_FRAC_BITS	(4)
+/** Weight of the latest beacon interval in the smoothed activity, as a shift */
+#define MORSE_RAW_ADAPTIVE_EWMA_SHIFT	(2)
+
 /** Minimum slot duration in us. (Corresponds to a cslot value of 0) */
 #define MORSE_RAW_MIN_SLOT_DURATION_US	(500)
 
@@ -255,11 +265,12 @@ static struct morse_aid_list *morse_generate_aid_list(unsigned long *aid_bitmap,
 	 */
 	const int num_bits = max_aid + 1;
 
-	list = kmalloc(sizeof(list) + (num_aids * sizeof(list->aids[0])), gfp);
+	list = kmalloc(sizeof(*list) + (num_aids * sizeof(list->aids[0])), gfp);
 	if (!list)
 		return NULL;
 
 	list->num_aids = num_aids;
+	list->max_aids = num_aids;
 
 	for_each_set_bit(aid, aid_bitmap, num_bits) {
 		list->aids[idx++] = aid;
@@ -355,16 +366,6 @@ static __le16 morse_raw_generate_slot_definition(struct morse *mors,
 	return slot_def;
 }
 
-u8 morse_raw_get_rps_ie_size(struct morse_vif *mors_vif)
-{
-	struct morse_ap *ap = mors_vif->ap;
-
-	if (!ap || !ap->raw.rps_ie)
-		return 0;
-
-	return ap->raw.rps_ie_len;
-}
-
 /**
  * morse_raw_calc_rps_ie_size() -	Calculates the RPS IE size required for the provided RAW
  *									configurations
@@ -416,9 +417,24 @@ static int morse_raw_calc_rps_ie_size(const struct morse_raw_config *const *conf
 	return size;
 }
 
-u8 *morse_raw_get_rps_ie(struct morse_vif *mors_vif)
+u8 morse_raw_get_rps_ie(struct morse_vif *mors_vif, u8 *buf)
 {
-	return mors_vif->ap->raw.rps_ie;
+	struct morse_ap *ap = mors_vif->ap;
+	struct morse_raw_rps_ie *rps_ie;
+	u8 len = 0;
+
+	if (!ap)
+		return 0;
+
+	rcu_read_lock();
+	rps_ie = rcu_dereference(ap->raw.rps_ie);
+	if (rps_ie) {
+		len = rps_ie->len;
+		memcpy(buf, rps_ie->data, len);
+	}
+	rcu_read_unlock();
+
+	return len;
 }
 
 static u8 *morse_raw_generate_assignment_with_aid_range(struct morse_vif *mors_vif,
@@ -598,24 +614,23 @@ static u8 *morse_raw_generate_assignment(struct morse_vif *mors_vif,
 }
 
 /**
- * morse_raw_generate_rps_ie() - Generate and update the RPS IE depending on RAW configurations.
+ * morse_raw_build_rps_ie() - Build an RPS IE from RAW configurations.
  * Note: Caller should hold the RAW lock
  *
- * @mors:		Morse chip struct
+ * @mors_vif:		Morse interface
  * @config_list		List of RAW configurations
  * @num_configs		Number of RAW configurations in the list.
  *
- * Return 0 on success otherwise -EINVAL if a RAW configuration is invalid.
+ * Return: the allocated RPS IE, or NULL on failure
  */
-static int morse_raw_generate_rps_ie(struct morse_vif *mors_vif,
+static struct morse_raw_rps_ie *morse_raw_build_rps_ie(struct morse_vif *mors_vif,
 					struct morse_raw_config *const *config_list,
 					u8 num_configs)
 {
 	int i;
 	u8 *head;
-	u8 old_rps_ie_len;
 	struct morse *mors = morse_vif_to_morse(mors_vif);
-	struct morse_raw *raw = &mors_vif->ap->raw;
+	struct morse_raw_rps_ie *rps_ie;
 
 	/* Calculate the size so we can allocate memory */
 	int size =
@@ -625,44 +640,163 @@ static int morse_raw_generate_rps_ie(struct morse_vif *mors_vif,
 	MORSE_RAW_DBG(mors, "Number of RAWs: %u\n", num_configs);
 	MORSE_RAW_DBG(mors, "RPS IE size: %d\n", size);
 
-	WARN_ON((size <= 0) || (size > __UINT8_MAX__));
-
-	/* Invalidate current raw until we are finished by setting to 0. */
-	old_rps_ie_len = raw->rps_ie_len;
-	raw->rps_ie_len = 0;
+	if (WARN_ON((size <= 0) || (size > MORSE_RAW_RPS_IE_MAX_LEN)))
+		return NULL;
 
-	if (raw->rps_ie) {
-		/* Adjust size of allocated memory if necessary. */
-		if (old_rps_ie_len != size) {
-			kfree(raw->rps_ie);
-			raw->rps_ie = kmalloc(size, GFP_KERNEL);
-		}
-	} else {
-		/* Allocate memory for the RPS IE. */
-		MORSE_RAW_DBG(mors, "Allocate RAW RPS IE\n");
-		raw->rps_ie = kmalloc(size, GFP_KERNEL);
-	}
-	/* Check we got our allocated memory. */
-	if (!raw->rps_ie) {
+	/* Keep everything neat and zero the memory. */
+	rps_ie = kzalloc(sizeof(*rps_ie) + size, GFP_KERNEL);
+	if (!rps_ie) {
 		MORSE_RAW_DBG(mors, "Failed to allocate RAW RPS IE\n");
-		return -ENOMEM;
+		return NULL;
 	}
 
-	/* Keep everything neat and zero the memory. */
-	memset(raw->rps_ie, 0, size);
-	head = raw->rps_ie;
+	head = rps_ie->data;
 
 	/* Populate RPS IE using config settings. */
 	for (i = 0; i < num_configs; i++) {
 		head = morse_raw_generate_assignment(mors_vif, config_list[i], head);
-		WARN_ON(head > (raw->rps_ie + size));
+		WARN_ON(head > (rps_ie->data + size));
 	}
 
-	/* Validate RPS IE by giving its size. */
-	WARN_ON(head != (raw->rps_ie + size));
-	raw->rps_ie_len = size;
+	WARN_ON(head != (rps_ie->data + size));
+	rps_ie->len = size;
 
-	return 0;
+	return rps_ie;
+}
+
+/**
+ * morse_raw_rps_ie_cache_replace() - Replace the cached RPS IEs and publish the first new entry
+ * Note: Caller should hold the RAW lock
+ *
+ * @raw: RAW context
+ * @entries: New RPS IEs, one per consecutive beacon
+ * @num: Number of entries, 0 to clear the cache
+ */
+static void morse_raw_rps_ie_cache_replace(struct morse_raw *raw,
+					   struct morse_raw_rps_ie *const *entries, u8 num)
+{
+	u8 i;
+
+	lockdep_assert_held(&raw->lock);
+
+	rcu_assign_pointer(raw->rps_ie, num ? entries[0] : NULL);
+
+	/* The beacon path may still be copying a previously published entry */
+	for (i = 0; i < raw->rps_ie_cached; i++) {
+		kfree_rcu(raw->rps_ie_cache[i], rcu);
+		raw->rps_ie_cache[i] = NULL;
+	}
+
+	for (i = 0; i < num; i++)
+		raw->rps_ie_cache[i] = entries[i];
+
+	raw->rps_ie_cached = num;
+	raw->rps_ie_cache_idx = 0;
+}
+
+/**
+ * morse_raw_rps_ie_cache_advance() - Publish the cached RPS IE for the next beacon
+ * Note: Caller should hold the RAW lock
+ *
+ * @raw: RAW context
+ * Return: true if a cached RPS IE was published, false if it must be regenerated
+ */
+static bool morse_raw_rps_ie_cache_advance(struct morse_raw *raw)
+{
+	struct morse_raw_config *cfg;
+	u8 idx = raw->rps_ie_cache_idx + 1;
+
+	lockdep_assert_held(&raw->lock);
+
+	if (idx >= raw->rps_ie_cached)
+		return false;
+
+	/* Move beacon spreading on to where it was after generating this entry */
+	list_for_each_entry(cfg, &raw->active_raws, active_list)
+		cfg->beacon_spreading.last_aid = cfg->beacon_spreading.cached_last_aid[idx];
+	list_for_each_entry(cfg, &raw->active_praws, active_list)
+		cfg->beacon_spreading.last_aid = cfg->beacon_spreading.cached_last_aid[idx];
+
+	raw->rps_ie_cache_idx = idx;
+	rcu_assign_pointer(raw->rps_ie, raw->rps_ie_cache[idx]);
+
+	return true;
+}
+
+/**
+ * morse_raw_collect_configs() - Collect the RAW configurations to include in the next RPS IE
+ * Note: Caller should hold the RAW lock
+ *
+ * @mors_vif: Morse interface
+ * @configs_list: Filled with the configurations, of at least %MAX_NUM_RAWS entries
+ * @include_praws: Include PRAWs even if there are no active RAWs
+ * Return: Number of configurations in @configs_list
+ */
+static u8 morse_raw_collect_configs(struct morse_vif *mors_vif,
+				    struct morse_raw_config **configs_list, bool include_praws)
+{
+	struct morse *mors = morse_vif_to_morse(mors_vif);
+	struct morse_raw *raw = &mors_vif->ap->raw;
+	struct morse_raw_config *config_ptr;
+	u8 count = 0;
+
+	/*
+	 * Count how many RAWs exist and are enabled, starting with PRAWs
+	 *
+	 * Configs should already be sorted by ID
+	 */
+
+	/* Include RAWs */
+	list_for_each_entry_reverse(config_ptr, &raw->active_raws, active_list) {
+		if (count >= MAX_NUM_RAWS) {
+			MORSE_RAW_WARN_RATELIMITED(mors,
+				"Too many active RAW assignments, ID %u not included\n",
+				config_ptr->id);
+			continue;
+		}
+
+		configs_list[count++] = config_ptr;
+		/* If including regular RAWs, must include PRAWs too */
+		include_praws = true;
+	}
+
+	/* Include PRAWs if required */
+	if (include_praws) {
+		list_for_each_entry_reverse(config_ptr, &raw->active_praws, active_list) {
+			if (count >= MAX_NUM_RAWS) {
+				MORSE_RAW_WARN_RATELIMITED(mors,
+					"Too many active RAW assignments, ID %u not included\n",
+					config_ptr->id);
+				continue;
+			}
+
+			configs_list[count++] = config_ptr;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * morse_raw_rps_ie_lookahead() - Number of beacons to generate RPS IEs for ahead of time
+ *
+ * @raw: RAW context
+ * Return: Number of RPS IEs to generate, starting with the next beacon
+ */
+static u8 morse_raw_rps_ie_lookahead(struct morse_raw *raw)
+{
+	struct morse_raw_config *cfg;
+
+	/* The RPS IE is the same for every beacon until the next configuration change */
+	if (!test_bit(RAW_STATE_UPDATE_EACH_BEACON, &raw->flags))
+		return 1;
+
+	/* Adaptive slots depend on activity seen up to each beacon, so can't be predicted */
+	list_for_each_entry(cfg, &raw->active_raws, active_list)
+		if (cfg->adaptive.enabled)
+			return 1;
+
+	return MORSE_RAW_RPS_IE_CACHE_SIZE;
 }
 
 /**
@@ -724,30 +858,44 @@ static void morse_raw_start_praw_transmission(struct morse_raw *raw, bool new_co
 	raw->praw_tx_count = num_bcns_to_send_praw;
 }
 
+/**
+ * morse_raw_praw_advance() - Move a PRAW's countdown on by one beacon
+ *
+ * @cfg: Active PRAW config
+ * Return: true if the PRAW has expired
+ */
+static bool morse_raw_praw_advance(struct morse_raw_config *cfg)
+{
+	if (cfg->periodic.cur_start_offset == 0)
+		cfg->periodic.cur_start_offset = cfg->periodic.periodicity - 1;
+	else
+		cfg->periodic.cur_start_offset--;
+
+	/* When we wrap back to our start offset, we have gone through a period */
+	if (cfg->periodic.cur_start_offset == cfg->periodic.start_offset)
+		cfg->periodic.cur_validity--;
+
+	return cfg->periodic.cur_validity == 0;
+}
+
 /**
  * morse_raw_update_praw_after_bcn() - Update active PRAWs after a beacon has been transmitted
  *
  * @raw: RAW context
+ * Return: true if a PRAW expired
  */
-static void morse_raw_update_praw_after_bcn(struct morse_raw *raw)
+static bool morse_raw_update_praw_after_bcn(struct morse_raw *raw)
 {
 	struct morse_raw_config *cfg, *tmp;
 	bool kick_tx = false;
+	bool expired = false;
 
 	lockdep_assert_held(&raw->lock);
 
 	list_for_each_entry_safe(cfg, tmp, &raw->active_praws, active_list) {
-		if (cfg->periodic.cur_start_offset == 0)
-			cfg->periodic.cur_start_offset = cfg->periodic.periodicity - 1;
-		else
-			cfg->periodic.cur_start_offset--;
-
-		/* When we wrap back to our start offset, we have gone through a period */
-		if (cfg->periodic.cur_start_offset == cfg->periodic.start_offset)
-			cfg->periodic.cur_validity--;
-
 		/* PRAW has expired */
-		if (cfg->periodic.cur_validity == 0) {
+		if (morse_raw_praw_advance(cfg)) {
+			expired = true;
 			/* reset values in case we want to start again */
 			cfg->periodic.cur_validity = cfg->periodic.validity;
 			cfg->periodic.cur_start_offset = cfg->periodic.start_offset;
@@ -762,6 +910,102 @@ static void morse_raw_update_praw_after_bcn(struct morse_raw *raw)
 
 	if (kick_tx)
 		morse_raw_start_praw_transmission(raw, false);
+
+	return expired;
+}
+
+/**
+ * morse_raw_generate_rps_ies() - Regenerate the RPS IE cache depending on RAW configurations.
+ * Note: Caller should hold the RAW lock
+ *
+ * PRAW countdowns and beacon spreading move on by one beacon per entry, so they are simulated
+ * for the beacons after the next one and rewound afterwards. The lookahead stops early at a
+ * PRAW expiry, as that changes which configurations are active.
+ *
+ * @mors_vif: Morse interface
+ * @include_praws: Include PRAWs in the RPS IE for the next beacon
+ */
+static void morse_raw_generate_rps_ies(struct morse_vif *mors_vif, bool include_praws)
+{
+	struct morse_raw *raw = &mors_vif->ap->raw;
+	struct morse_raw_config *configs_list[MAX_NUM_RAWS];
+	struct morse_raw_rps_ie *entries[MORSE_RAW_RPS_IE_CACHE_SIZE];
+	struct {
+		u8 cur_validity;
+		u8 cur_start_offset;
+	} praw_state[MAX_NUM_RAWS];
+	struct morse_raw_config *cfg;
+	const u8 praw_tx_count = raw->praw_tx_count;
+	u8 depth = morse_raw_rps_ie_lookahead(raw);
+	u8 count;
+	u8 num = 0;
+	u8 i = 0;
+
+	lockdep_assert_held(&raw->lock);
+
+	list_for_each_entry(cfg, &raw->active_praws, active_list) {
+		if (i >= ARRAY_SIZE(praw_state)) {
+			depth = 1;
+			break;
+		}
+		praw_state[i].cur_validity = cfg->periodic.cur_validity;
+		praw_state[i].cur_start_offset = cfg->periodic.cur_start_offset;
+		i++;
+	}
+
+	while (num < depth) {
+		bool expired = false;
+
+		count = morse_raw_collect_configs(mors_vif, configs_list, include_praws);
+		if (!count)
+			break;
+
+		/* This cast looks strange but adds some protection. */
+		entries[num] = morse_raw_build_rps_ie(mors_vif,
+			(struct morse_raw_config * const *)configs_list, count);
+		if (!entries[num])
+			break;
+
+		list_for_each_entry(cfg, &raw->active_raws, active_list)
+			cfg->beacon_spreading.cached_last_aid[num] = cfg->beacon_spreading.last_aid;
+		list_for_each_entry(cfg, &raw->active_praws, active_list)
+			cfg->beacon_spreading.cached_last_aid[num] = cfg->beacon_spreading.last_aid;
+
+		if (++num == depth)
+			break;
+
+		/* Step on to the following beacon, as morse_raw_do_update() would */
+		list_for_each_entry(cfg, &raw->active_praws, active_list)
+			expired |= morse_raw_praw_advance(cfg);
+		if (expired)
+			break;
+
+		include_praws = false;
+		if (raw->praw_tx_count) {
+			include_praws = true;
+			raw->praw_tx_count--;
+		}
+	}
+
+	/* Rewind to the state of the next beacon */
+	if (depth > 1) {
+		i = 0;
+		list_for_each_entry(cfg, &raw->active_praws, active_list) {
+			cfg->periodic.cur_validity = praw_state[i].cur_validity;
+			cfg->periodic.cur_start_offset = praw_state[i].cur_start_offset;
+			if (num)
+				cfg->beacon_spreading.last_aid =
+					cfg->beacon_spreading.cached_last_aid[0];
+			i++;
+		}
+		if (num)
+			list_for_each_entry(cfg, &raw->active_raws, active_list)
+				cfg->beacon_spreading.last_aid =
+					cfg->beacon_spreading.cached_last_aid[0];
+		raw->praw_tx_count = praw_tx_count;
+	}
+
+	morse_raw_rps_ie_cache_replace(raw, entries, num);
 }
 
 /**
@@ -824,7 +1068,32 @@ static void raw_update_aid_indexes(struct morse_raw_config *cfg,
 }
 
 /**
- * morse_raw_refresh_aids() - Refresh AID list used for beacon spreading
+ * morse_raw_update_all_aid_indexes() - Update the AID indexes of all beacon spreading RAWs
+ *
+ * @raw: RAW context
+ */
+static void morse_raw_update_all_aid_indexes(struct morse_raw *raw)
+{
+	struct morse_raw_config *config_ptr;
+
+	lockdep_assert_held(&raw->lock);
+
+	list_for_each_entry(config_ptr, &raw->active_raws, active_list) {
+		/* only care about AID indexes for active beacon spreading RAWs */
+		if (config_ptr->beacon_spreading.nominal_sta_per_beacon) {
+			/* Reset indices */
+			config_ptr->start_aid_idx = INVALID_AID_VALUE;
+			config_ptr->end_aid_idx = INVALID_AID_VALUE;
+
+			if (raw->aid_list)
+				raw_update_aid_indexes(config_ptr, raw->aid_list);
+		}
+	}
+}
+
+/**
+ * morse_raw_refresh_aids() - Refresh AID indexes used for beacon spreading, rebuilding the AID
+ * list first if it could not be kept up to date.
  *
  * @ap: AP context
  * @raw: RAW context
@@ -832,33 +1101,202 @@ static void raw_update_aid_indexes(struct morse_raw_config *cfg,
 static void morse_raw_refresh_aids(struct morse_ap *ap, struct morse_raw *raw)
 {
 	struct morse_aid_list *aid_list;
-	struct morse_raw_config *config_ptr;
 
 	lockdep_assert_held(&raw->lock);
 
-	aid_list =
-		morse_generate_aid_list(ap->aid_bitmap, ap->num_stas, ap->largest_aid, GFP_KERNEL);
+	if (test_and_clear_bit(RAW_STATE_REBUILD_AIDS, &raw->flags)) {
+		aid_list = morse_generate_aid_list(ap->aid_bitmap, ap->num_stas, ap->largest_aid,
+						   GFP_KERNEL);
+		if (aid_list) {
+			kfree(raw->aid_list);
+			raw->aid_list = aid_list;
+		} else {
+			set_bit(RAW_STATE_REBUILD_AIDS, &raw->flags);
+		}
+	}
 
-	if (!aid_list)
-		return;
+	morse_raw_update_all_aid_indexes(raw);
+}
 
-	/* reset aid list */
-	kfree(raw->aid_list);
+/**
+ * raw_aid_list_lower_bound() - Find the index of the first AID in the list not below @aid
+ *
+ * @aid_list: AID list to search
+ * @aid: AID to find
+ * Return: Index of @aid, or where it would be inserted
+ */
+static int raw_aid_list_lower_bound(const struct morse_aid_list *aid_list, u16 aid)
+{
+	int start_idx = 0;
+	int end_idx = aid_list->num_aids;
 
-	raw->aid_list = aid_list;
+	while (start_idx < end_idx) {
+		int mid_idx = start_idx + ((end_idx - start_idx) / 2);
 
-	WARN_ON(aid_list->num_aids > 0 && !aid_list->aids);
+		if (aid_list->aids[mid_idx] < aid)
+			start_idx = mid_idx + 1;
+		else
+			end_idx = mid_idx;
+	}
 
-	list_for_each_entry(config_ptr, &raw->active_raws, active_list) {
-		/* only care about AID indexes for active beacon spreading RAWs */
-		if (config_ptr->beacon_spreading.nominal_sta_per_beacon) {
-			/* Reset indices */
-			config_ptr->start_aid_idx = INVALID_AID_VALUE;
-			config_ptr->end_aid_idx = INVALID_AID_VALUE;
+	return start_idx;
+}
+
+void morse_raw_add_aid(struct morse_vif *mors_vif, u16 aid)
+{
+	struct morse_raw *raw = &mors_vif->ap->raw;
+	struct morse_aid_list *aid_list;
+	int idx;
+
+	mutex_lock(&raw->lock);
+
+	if (test_bit(RAW_STATE_REBUILD_AIDS, &raw->flags))
+		goto exit;
 
-			raw_update_aid_indexes(config_ptr, aid_list);
+	aid_list = raw->aid_list;
+	if (!aid_list || aid_list->num_aids == aid_list->max_aids) {
+		u16 max_aids = aid_list ? aid_list->max_aids : 0;
+
+		max_aids = min_t(u16, max_aids + max_t(u16, max_aids, MORSE_RAW_AID_LIST_MIN_GROWTH),
+				 MORSE_AP_AID_BITMAP_SIZE);
+		aid_list = krealloc(raw->aid_list,
+				    sizeof(*aid_list) + (max_aids * sizeof(aid_list->aids[0])),
+				    GFP_KERNEL);
+		if (!aid_list) {
+			set_bit(RAW_STATE_REBUILD_AIDS, &raw->flags);
+			goto exit;
 		}
+
+		if (!raw->aid_list)
+			aid_list->num_aids = 0;
+		aid_list->max_aids = max_aids;
+		raw->aid_list = aid_list;
 	}
+
+	idx = raw_aid_list_lower_bound(aid_list, aid);
+	if (idx < aid_list->num_aids && aid_list->aids[idx] == aid)
+		goto exit;
+
+	memmove(&aid_list->aids[idx + 1], &aid_list->aids[idx],
+		(aid_list->num_aids - idx) * sizeof(aid_list->aids[0]));
+	aid_list->aids[idx] = aid;
+	aid_list->num_aids++;
+
+	/* Keep the indexes in step with the list, beacon updates may use it before a refresh */
+	morse_raw_update_all_aid_indexes(raw);
+exit:
+	mutex_unlock(&raw->lock);
+}
+
+void morse_raw_remove_aid(struct morse_vif *mors_vif, u16 aid)
+{
+	struct morse_raw *raw = &mors_vif->ap->raw;
+	struct morse_aid_list *aid_list;
+	int idx;
+
+	mutex_lock(&raw->lock);
+
+	aid_list = raw->aid_list;
+	if (!aid_list || test_bit(RAW_STATE_REBUILD_AIDS, &raw->flags))
+		goto exit;
+
+	idx = raw_aid_list_lower_bound(aid_list, aid);
+	if (idx >= aid_list->num_aids || aid_list->aids[idx] != aid)
+		goto exit;
+
+	aid_list->num_aids--;
+	memmove(&aid_list->aids[idx], &aid_list->aids[idx + 1],
+		(aid_list->num_aids - idx) * sizeof(aid_list->aids[0]));
+
+	morse_raw_update_all_aid_indexes(raw);
+exit:
+	mutex_unlock(&raw->lock);
+}
+
+void morse_raw_note_activity(struct morse_vif *mors_vif, u16 aid)
+{
+	atomic_t *aid_activity = READ_ONCE(mors_vif->ap->raw.aid_activity);
+
+	if (aid_activity && aid < MORSE_AP_AID_BITMAP_SIZE)
+		atomic_inc(&aid_activity[aid]);
+}
+
+static u32 morse_raw_adaptive_ewma(u32 avg, u32 sample)
+{
+	sample <<= MORSE_RAW_ADAPTIVE_FRAC_BITS;
+
+	return avg - (avg >> MORSE_RAW_ADAPTIVE_EWMA_SHIFT) +
+	       (sample >> MORSE_RAW_ADAPTIVE_EWMA_SHIFT);
+}
+
+/**
+ * morse_raw_adapt_config() - Resize the slots of an adaptive RAW from the activity of its
+ * stations over the last beacon interval
+ *
+ * @raw: RAW context
+ * @cfg: Adaptive RAW config
+ */
+static void morse_raw_adapt_config(struct morse_raw *raw, struct morse_raw_config *cfg)
+{
+	const struct morse_aid_list *aid_list = raw->aid_list;
+	u32 active = 0;
+	u32 frames = 0;
+	u32 num_slots;
+	u32 frames_per_slot;
+	u32 duration_us;
+	int i;
+
+	if (aid_list && raw->aid_activity) {
+		for (i = raw_aid_list_lower_bound(aid_list, cfg->start_aid);
+		     i < aid_list->num_aids && aid_list->aids[i] <= cfg->end_aid; i++) {
+			u32 count = atomic_read(&raw->aid_activity[aid_list->aids[i]]);
+
+			if (count) {
+				active++;
+				frames += count;
+			}
+		}
+	}
+
+	cfg->adaptive.avg_active = morse_raw_adaptive_ewma(cfg->adaptive.avg_active, active);
+	cfg->adaptive.avg_frames = morse_raw_adaptive_ewma(cfg->adaptive.avg_frames, frames);
+
+	/* A slot per active station limits contention, idle RAWs shrink to the minimum */
+	active = DIV_ROUND_UP(cfg->adaptive.avg_active, BIT(MORSE_RAW_ADAPTIVE_FRAC_BITS));
+	frames = DIV_ROUND_UP(cfg->adaptive.avg_frames, BIT(MORSE_RAW_ADAPTIVE_FRAC_BITS));
+	num_slots = clamp_t(u32, active, cfg->adaptive.min_slots, cfg->adaptive.max_slots);
+	frames_per_slot = DIV_ROUND_UP(frames, num_slots);
+	duration_us = clamp_t(u32, MORSE_RAW_MIN_SLOT_DURATION_US +
+			      frames_per_slot * MORSE_RAW_ADAPTIVE_FRAME_US,
+			      cfg->adaptive.min_slot_duration_us,
+			      cfg->adaptive.max_slot_duration_us);
+
+	cfg->slot_definition.num_slots = num_slots;
+	cfg->slot_definition.slot_duration_us = duration_us;
+}
+
+/**
+ * morse_raw_adapt_configs() - Resize all active adaptive RAWs and restart activity counting
+ *
+ * @raw: RAW context
+ */
+static void morse_raw_adapt_configs(struct morse_raw *raw)
+{
+	struct morse_raw_config *config_ptr;
+	int i;
+
+	lockdep_assert_held(&raw->lock);
+
+	if (!raw->aid_activity)
+		return;
+
+	list_for_each_entry(config_ptr, &raw->active_raws, active_list)
+		if (config_ptr->adaptive.enabled)
+			morse_raw_adapt_config(raw, config_ptr);
+
+	/* Only counted after all configs have seen them, as AID ranges may overlap */
+	for (i = 0; raw->aid_list && i < raw->aid_list->num_aids; i++)
+		atomic_set(&raw->aid_activity[raw->aid_list->aids[i]], 0);
 }
 
 /**
@@ -868,21 +1306,22 @@ static void morse_raw_refresh_aids(struct morse_ap *ap, struct morse_raw *raw)
  */
 static void morse_raw_do_update(struct morse_vif *mors_vif)
 {
-	struct morse_raw_config *configs_list[MAX_NUM_RAWS];
-	struct morse_raw_config *config_ptr;
-	u8 count = 0;
 	struct morse_ap *ap = mors_vif->ap;
 	struct morse_raw *raw = &ap->raw;
-	struct morse *mors = morse_vif_to_morse(mors_vif);
 	bool include_praws = false;
+	bool stale;
+
+	mutex_lock(&raw->lock);
 
 	/* RPS IE should only be regenerated if RAW is enabled. */
 	if (!test_bit(RAW_STATE_ENABLED, &raw->flags)) {
 		MORSE_WARN_ON(FEATURE_ID_RAW, true);
-		goto cleanup;
+		morse_raw_rps_ie_cache_replace(raw, NULL, 0);
+		mutex_unlock(&raw->lock);
+		return;
 	}
 
-	mutex_lock(&raw->lock);
+	stale = test_and_clear_bit(RAW_STATE_RPS_IE_STALE, &raw->flags);
 
 	/* STAs have been added or removed, update AID list */
 	if (test_and_clear_bit(RAW_STATE_REFRESH_AIDS, &raw->flags)) {
@@ -893,13 +1332,16 @@ static void morse_raw_do_update(struct morse_vif *mors_vif)
 
 		/* Start broadcasting PRAWs for the new STAs */
 		morse_raw_start_praw_transmission(raw, false);
+		stale = true;
 	}
 
 	/* A beacon has been sent, update PRAWs (if any). If a PRAW is about to expire, we must
 	 * also include all active PRAWs
 	 */
 	if (test_and_clear_bit(RAW_STATE_BEACON_SENT, &raw->flags)) {
-		morse_raw_update_praw_after_bcn(raw);
+		if (morse_raw_update_praw_after_bcn(raw))
+			stale = true;
+		morse_raw_adapt_configs(raw);
 
 		/* Always include PRAWs if we are still transmitting them after an update
 		 * (to make sure all STAs see them)
@@ -908,54 +1350,15 @@ static void morse_raw_do_update(struct morse_vif *mors_vif)
 			include_praws = true;
 			raw->praw_tx_count--;
 		}
-	}
 
-	/*
-	 * Count how many RAWs exist and are enabled, starting with PRAWs
-	 *
-	 * Configs should already be sorted by ID
-	 */
-
-	/* Include RAWs */
-	list_for_each_entry_reverse(config_ptr, &raw->active_raws, active_list) {
-		if (count >= ARRAY_SIZE(configs_list)) {
-			MORSE_RAW_WARN_RATELIMITED(mors,
-				"Too many active RAW assignments, ID %u not included\n",
-				config_ptr->id);
-			continue;
-		}
-
-		configs_list[count++] = config_ptr;
-		/* If including regular RAWs, must include PRAWs too */
-		include_praws = true;
-	}
-
-	/* Include PRAWs if required */
-	if (include_praws) {
-		list_for_each_entry_reverse(config_ptr, &raw->active_praws, active_list) {
-			if (count >= ARRAY_SIZE(configs_list)) {
-				MORSE_RAW_WARN_RATELIMITED(mors,
-					"Too many active RAW assignments, ID %u not included\n",
-					config_ptr->id);
-				continue;
-			}
-
-			configs_list[count++] = config_ptr;
+		/* Nothing changed that the cache didn't account for, select the next entry */
+		if (!stale && morse_raw_rps_ie_cache_advance(raw)) {
+			mutex_unlock(&raw->lock);
+			return;
 		}
 	}
 
-	if (count) {
-		/* This cast looks strange but adds some protection. */
-		morse_raw_generate_rps_ie(mors_vif,
-			(struct morse_raw_config * const *)configs_list, count);
-		mutex_unlock(&raw->lock);
-
-		return;
-	}
-cleanup:
-	raw->rps_ie_len = 0;
-	kfree(raw->rps_ie);
-	raw->rps_ie = NULL;
+	morse_raw_generate_rps_ies(mors_vif, include_praws);
 	mutex_unlock(&raw->lock);
 }
 
@@ -1049,6 +1452,25 @@ static bool morse_raw_cmd_to_config(struct morse_cmd_raw_cfg *cmd, struct morse_
 
 			head += sizeof(tlv->bcn_spread);
 			break;
+
+		case MORSE_RAW_CMD_TAG_ADAPTIVE:
+			cfg->adaptive.min_slots = tlv->adaptive.min_slots;
+			cfg->adaptive.max_slots = tlv->adaptive.max_slots;
+			cfg->adaptive.min_slot_duration_us =
+				max_t(u32, tlv->adaptive.min_slot_duration_us,
+				      MORSE_RAW_MIN_SLOT_DURATION_US);
+			cfg->adaptive.max_slot_duration_us = tlv->adaptive.max_slot_duration_us;
+			cfg->adaptive.avg_active = 0;
+			cfg->adaptive.avg_frames = 0;
+			cfg->adaptive.enabled = true;
+
+			if (!cfg->adaptive.min_slots ||
+			    cfg->adaptive.max_slots < cfg->adaptive.min_slots ||
+			    cfg->adaptive.max_slot_duration_us < cfg->adaptive.min_slot_duration_us)
+				return false;
+
+			head += sizeof(tlv->adaptive);
+			break;
 		default:
 			/* unrecognised TLV */
 			WARN_ON(true);
@@ -1233,6 +1655,16 @@ int morse_raw_process_cmd(struct morse_vif *mors_vif, struct morse_cmd_raw_cfg *
 
 			/* config is not valid, disable it */
 			enable = false;
+		} else if (config->adaptive.enabled && !raw->aid_activity) {
+			atomic_t *aid_activity = kcalloc(MORSE_AP_AID_BITMAP_SIZE,
+							 sizeof(*aid_activity), GFP_KERNEL);
+
+			if (!aid_activity) {
+				ret = -ENOMEM;
+				enable = false;
+			}
+			/* Pairs with the lockless read in morse_raw_note_activity() */
+			smp_store_release(&raw->aid_activity, aid_activity);
 		}
 	} else {
 		config = morse_raw_find_config_by_id(raw, cmd->id);
@@ -1268,9 +1700,12 @@ exit:
 		/* PRAWs require updates on each beacon */
 		set_bit(RAW_STATE_UPDATE_EACH_BEACON, &raw->flags);
 	} else {
-		list_for_each_entry(config, &raw->active_raws, list) {
-			/* Beacon spreading requires updates to the RPS IE on every beacon */
-			if (config->beacon_spreading.nominal_sta_per_beacon) {
+		list_for_each_entry(config, &raw->active_raws, active_list) {
+			/* Beacon spreading and adaptive slots require updates to the RPS IE on
+			 * every beacon
+			 */
+			if (config->beacon_spreading.nominal_sta_per_beacon ||
+			    config->adaptive.enabled) {
 				set_bit(RAW_STATE_UPDATE_EACH_BEACON, &raw->flags);
 				break;
 			}
@@ -1307,6 +1742,7 @@ void morse_raw_trigger_update(struct morse_vif *mors_vif, bool refresh_aids)
 	if (!raw->aid_list || refresh_aids)
 		set_bit(RAW_STATE_REFRESH_AIDS, &raw->flags);
 
+	set_bit(RAW_STATE_RPS_IE_STALE, &raw->flags);
 	schedule_work(&raw->update_work);
 }
 
@@ -1357,9 +1793,13 @@ void morse_raw_finish(struct morse_vif *mors_vif)
 	morse_raw_disable(raw);
 
 	/* Free RAW and clean up */
-	raw->rps_ie_len = 0;
-	kfree(raw->rps_ie);
-	raw->rps_ie = NULL;
+	mutex_lock(&raw->lock);
+	morse_raw_rps_ie_cache_replace(raw, NULL, 0);
+	mutex_unlock(&raw->lock);
+	kfree(raw->aid_list);
+	raw->aid_list = NULL;
+	kfree(raw->aid_activity);
+	raw->aid_activity = NULL;
 
 	list_for_each_entry_safe(config, tmp, &raw->raw_config_list, list)
 		morse_raw_delete_config(config);
@@ -9,6 +9,7 @@
 
 #include <linux/types.h>
 #include <linux/workqueue.h>
+#include <linux/rcupdate.h>
 
 #define MAX_NUM_RAWS_USER_PRIO			(8)	/* Limited by QoS User Priority */
 #define MAX_NUM_RAWS_INTERNAL			(1)	/* Internal (e.g. used by OCS) */
@@ -25,6 +26,11 @@
 	((x) & ~MORSE_RAW_AID_PRIO_MASK)
 #define MORSE_RAW_AID_DEVICE_MASK		GENMASK(7, 0)
 
+/** Number of beacons worth of RPS IEs that may be generated ahead of time */
+#define MORSE_RAW_RPS_IE_CACHE_SIZE		(4)
+/** Largest possible RPS IE, as its length must fit in the element header */
+#define MORSE_RAW_RPS_IE_MAX_LEN		(U8_MAX)
+
 struct morse;
 struct morse_vif;
 struct morse_cmd_raw_cfg;
@@ -99,10 +105,23 @@ struct morse_raw_config_triggering_t {
 struct morse_aid_list {
 	/** Number of AIDs */
 	u16 num_aids;
-	/** Array of AIDs of stations */
+	/** Number of AIDs there is room for */
+	u16 max_aids;
+	/** Array of AIDs of stations, in ascending order */
 	u16 aids[];
 };
 
+/**
+ * A generated RPS IE, published to the beacon path under RCU
+ */
+struct morse_raw_rps_ie {
+	struct rcu_head rcu;
+	/** Length of the IE body */
+	u8 len;
+	/** IE body, without the element header */
+	u8 data[];
+};
+
 /** Structure containing configuration information creating for RAW assignments in an RPS IE. */
 struct morse_raw_config {
 	/** List head for RAW config list */
@@ -193,8 +212,27 @@ struct morse_raw_config {
 		u16 nominal_sta_per_beacon;
 		/** Last AID that was used in a beacon with spreading. */
 		u16 last_aid;
+		/** Value of @last_aid after generating each entry of the RPS IE cache */
+		u16 cached_last_aid[MORSE_RAW_RPS_IE_CACHE_SIZE];
 	} beacon_spreading;
 
+	/**
+	 * Optional load adaptive slot assignment. The slot definition is recomputed every beacon
+	 * from the activity of the stations in the AID range, within the bounds given here.
+	 * Only applies to non-periodic RAWs.
+	 */
+	struct {
+		bool enabled;
+		u8 min_slots;
+		u8 max_slots;
+		u32 min_slot_duration_us;
+		u32 max_slot_duration_us;
+		/** Smoothed number of active stations per beacon interval, fixed point */
+		u32 avg_active;
+		/** Smoothed number of frames per beacon interval, fixed point */
+		u32 avg_frames;
+	} adaptive;
+
 	/** RAW type specific configuration information. */
 	union {
 		/** Generic RAW specific configuration information. */
@@ -217,6 +255,10 @@ enum raw_state_flags {
 	RAW_STATE_REFRESH_AIDS,
 	/** A beacon has been sent since the last update */
 	RAW_STATE_BEACON_SENT,
+	/** RAW configuration changed, RPS IEs generated ahead of time can't be used */
+	RAW_STATE_RPS_IE_STALE,
+	/** The AID list missed a station change and must be rebuilt from the AID bitmap */
+	RAW_STATE_REBUILD_AIDS,
 };
 
 /**
@@ -227,11 +269,21 @@ struct morse_raw {
 	unsigned long flags;
 	/** Number of beacons left to send PRAWs */
 	u8 praw_tx_count;
-	/** The currently generated RPS IE */
-	u8 *rps_ie;
-	/** The size of the currently generated RPS IE */
-	u8 rps_ie_len;
-	/** An ordered list of AIDs, for use in generating the RPS IE */
+	/** The RPS IE for the next beacon, or NULL if none. Read under RCU by the beacon path */
+	struct morse_raw_rps_ie __rcu *rps_ie;
+	/**
+	 * RPS IEs for consecutive beacons, generated ahead of time so that most beacons only need
+	 * the next one selected. The entry at @rps_ie_cache_idx is the current @rps_ie.
+	 */
+	struct morse_raw_rps_ie *rps_ie_cache[MORSE_RAW_RPS_IE_CACHE_SIZE];
+	/** Number of entries in @rps_ie_cache */
+	u8 rps_ie_cached;
+	/** Index of the current entry in @rps_ie_cache */
+	u8 rps_ie_cache_idx;
+	/**
+	 * An ordered list of AIDs, for use in generating the RPS IE. Kept up to date as
+	 * stations associate and disassociate, see morse_raw_add_aid().
+	 */
 	struct morse_aid_list *aid_list;
 	/** All RAW configs */
 	struct list_head raw_config_list;
@@ -257,22 +309,13 @@ static inline bool morse_raw_cfg_is_periodic(const struct morse_raw_config * con
 }
 
 /**
- * morse_raw_get_rps_ie_size() - Gets the size of the RPS IE for current RAW settings.
+ * morse_raw_get_rps_ie() - Copy the RPS IE for the next beacon.
  * @mors_vif: Morse VIF structure
+ * @buf: Buffer of at least %MORSE_RAW_RPS_IE_MAX_LEN bytes for the IE body
  *
- * Return: Size of the RPS IE or 0 on error / RAW disabled.
+ * Return: Length of the RPS IE, or 0 if RAW is disabled or there is no IE.
  */
-u8 morse_raw_get_rps_ie_size(struct morse_vif *mors_vif);
-
-/**
- * morse_raw_get_rps_ie() - Gets the current RPS IE for current RAW settings.
- * @mors_vif: Morse VIF structure
- *
- * Use morse_raw_get_rps_ie_size() to calculate the size to allocate for &rps_ie.
- *
- * Return: a pointer to the RPS IE or NULL on error.
- */
-u8 *morse_raw_get_rps_ie(struct morse_vif *mors_vif);
+u8 morse_raw_get_rps_ie(struct morse_vif *mors_vif, u8 *buf);
 
 /**
  * morse_raw_process_cmd() - Execute command to enable/disable/configure RAW
@@ -328,6 +371,30 @@ void morse_raw_enable(struct morse_raw *raw);
  */
 void morse_raw_trigger_update(struct morse_vif *mors_vif, bool refresh_aids);
 
+/**
+ * morse_raw_add_aid() - Add the AID of a newly associated station to the ordered AID list
+ *
+ * @mors_vif: Morse VIF structure
+ * @aid: AID of the station
+ */
+void morse_raw_add_aid(struct morse_vif *mors_vif, u16 aid);
+
+/**
+ * morse_raw_remove_aid() - Remove the AID of a disassociated station from the ordered AID list
+ *
+ * @mors_vif: Morse VIF structure
+ * @aid: AID of the station
+ */
+void morse_raw_remove_aid(struct morse_vif *mors_vif, u16 aid);
+
+/**
+ * morse_raw_note_activity() - Count a frame to or from a station, for adaptive RAWs
+ *
+ * @mors_vif: Morse VIF structure of the AP
+ * @aid: AID of the station
+ */
+void morse_raw_note_activity(struct morse_vif *mors_vif, u16 aid);
+
 /**
  * morse_raw_beacon_sent() - Call this function after a beacon has been transmitted to update
  * RPS IE, if required.
@@ -7,6 +7,7 @@
 
 #include <linux/slab.h>
 #include <linux/timer.h>
+#include <linux/ktime.h>
 #include "morse.h"
 #include "utils.h"
 #include "mac.h"
@@ -41,6 +42,33 @@ static int fixed_guard __read_mostly;
 module_param(fixed_guard, int, 0644);
 MODULE_PARM_DESC(fixed_guard, "Set the fixed guard value (work when enable_fixed_rate is on)");
 
+/* Limit how long the rate control update holds off station changes */
+static uint rc_update_batch __read_mostly = 16;
+module_param(rc_update_batch, uint, 0644);
+MODULE_PARM_DESC(rc_update_batch, "Maximum stations updated per hold of the rate control lock");
+
+/* Number of frames that may reuse a rate chain before MMRC is consulted again */
+static uint rc_tx_rate_reuse __read_mostly = 3;
+module_param(rc_tx_rate_reuse, uint, 0644);
+MODULE_PARM_DESC(rc_tx_rate_reuse,
+		 "TX frames that may reuse a station's last rate chain without locking (0 to disable)");
+
+/* Hysteresis for raising the multicast rate, lowering it always takes effect at once */
+static uint mcast_rate_raise_pct __read_mostly = 10;
+module_param(mcast_rate_raise_pct, uint, 0644);
+MODULE_PARM_DESC(mcast_rate_raise_pct,
+		 "Throughput gain (%) the weakest member needs before the multicast rate is raised");
+
+static uint mcast_rate_raise_evals __read_mostly = 3;
+module_param(mcast_rate_raise_evals, uint, 0644);
+MODULE_PARM_DESC(mcast_rate_raise_evals,
+		 "Consecutive evaluations the gain must hold for before the multicast rate is raised");
+
+/* How often each station's rate table is updated */
+#define MORSE_RC_UPDATE_INTERVAL_MS	(100)
+/* Minimum gap between update passes, so stations falling due close together share a pass */
+#define MORSE_RC_UPDATE_MIN_GAP_MS	(10)
+
 #define MORSE_RC_MMRC_BW_TO_FLAGS(X)				\
 	(((X) == MMRC_BW_1MHZ) ? MORSE_SKB_RATE_FLAGS_1MHZ :	\
 	((X) == MMRC_BW_2MHZ) ? MORSE_SKB_RATE_FLAGS_2MHZ :	\
@@ -63,25 +91,206 @@ MODULE_PARM_DESC(fixed_guard, "Set the fixed guard value (work when enable_fixed
 #define MORSE_RC_WARN_RATELIMITED(_m, _f, _a...)		\
 	morse_warn_ratelimited(FEATURE_ID_RATECONTROL, _m, _f, ##_a)
 
+/**
+ * morse_rc_sta_lock_table() - Lock the rate table of a station
+ *
+ * @mrc_sta: Rate control state of the station
+ *
+ * Return: The rate table with the station lock held, or NULL without the lock held if the
+ *	   station is not in rate control
+ */
+static struct mmrc_table *morse_rc_sta_lock_table(struct morse_rc_sta *mrc_sta)
+{
+	/* Pairs with morse_rc_sta_add(), skip stations that have no table yet */
+	if (!smp_load_acquire(&mrc_sta->tb))
+		return NULL;
+
+	spin_lock_bh(&mrc_sta->lock);
+	if (!mrc_sta->tb) {
+		spin_unlock_bh(&mrc_sta->lock);
+		return NULL;
+	}
+
+	return mrc_sta->tb;
+}
+
+static void morse_rc_sta_unlock_table(struct morse_rc_sta *mrc_sta)
+{
+	spin_unlock_bh(&mrc_sta->lock);
+}
+
+/* Drop the published rate chain of a station, must be called with the station lock held */
+static void morse_rc_sta_invalidate_snapshot(struct morse_rc_sta *mrc_sta)
+{
+	write_seqcount_begin(&mrc_sta->snapshot_seq);
+	mrc_sta->snapshot_valid = false;
+	write_seqcount_end(&mrc_sta->snapshot_seq);
+	atomic_set(&mrc_sta->snapshot_uses, 0);
+}
+
+/* Recompute the expected throughput if the best rate changed, call with the station lock held */
+static void morse_rc_sta_refresh_expected_tput(struct morse_rc_sta *mrc_sta)
+{
+	const struct mmrc_rate *best = mrc_sta->tb ? &mrc_sta->tb->best_tp : NULL;
+	struct mmrc_rate *cached = &mrc_sta->expected_tput_rate;
+	u32 tput;
+
+	if (!best || best->rate == MMRC_MCS_UNUSED) {
+		WRITE_ONCE(mrc_sta->expected_tput_kbps, 0);
+		cached->rate = MMRC_MCS_UNUSED;
+		return;
+	}
+
+	if (READ_ONCE(mrc_sta->expected_tput_kbps) && best->rate == cached->rate &&
+	    best->bw == cached->bw && best->ss == cached->ss && best->guard == cached->guard)
+		return;
+
+	*cached = *best;
+	tput = BPS_TO_KBPS(mmrc_calculate_theoretical_throughput(*best));
+	WRITE_ONCE(mrc_sta->expected_tput_kbps, tput);
+	mrc_sta->best_changed = jiffies;
+	mrc_sta->best_changes++;
+}
+
+void morse_rc_sta_table_changed(struct morse_rc_sta *mrc_sta)
+{
+	morse_rc_sta_invalidate_snapshot(mrc_sta);
+	morse_rc_sta_refresh_expected_tput(mrc_sta);
+}
+
+void morse_rc_update_stats_reset(struct morse *mors)
+{
+	spin_lock_bh(&mors->mrc.lock);
+	memset(&mors->mrc.update_stats, 0, sizeof(mors->mrc.update_stats));
+	mors->mrc.update_stats.since = jiffies;
+	spin_unlock_bh(&mors->mrc.lock);
+}
+
+/* Update the rate table of a station, called with the list and station locks held */
+static void morse_rc_sta_update(struct morse_rc *mrc, struct morse_rc_sta *mrc_sta,
+				unsigned long now)
+{
+	u64 start_ns = ktime_get_ns();
+	u64 ns;
+
+	mrc_sta->last_update = now;
+	mmrc_update(mrc_sta->tb);
+
+	ns = ktime_get_ns() - start_ns;
+	mrc->update_stats.count++;
+	mrc->update_stats.total_ns += ns;
+	mrc->update_stats.max_ns = max(mrc->update_stats.max_ns, ns);
+
+	morse_rc_sta_table_changed(mrc_sta);
+}
+
+/*
+ * Publish the rate chain from a locked MMRC lookup, must be called with the station lock held.
+ * Only chains led by the best throughput rate are published, so lookaround probes are never
+ * repeated on later frames.
+ */
+static void morse_rc_sta_publish_snapshot(struct morse_rc_sta *mrc_sta,
+					  const struct mmrc_rate_table *rates, u8 size_class)
+{
+	const struct mmrc_rate *best = &mrc_sta->tb->best_tp;
+	const struct mmrc_rate *first = &rates->rates[0];
+
+	if (first->rate != best->rate || first->bw != best->bw || first->ss != best->ss ||
+	    first->guard != best->guard) {
+		if (mrc_sta->snapshot_valid)
+			morse_rc_sta_invalidate_snapshot(mrc_sta);
+		return;
+	}
+
+	write_seqcount_begin(&mrc_sta->snapshot_seq);
+	mrc_sta->snapshot = *rates;
+	mrc_sta->snapshot_size_class = size_class;
+	mrc_sta->snapshot_valid = true;
+	write_seqcount_end(&mrc_sta->snapshot_seq);
+	atomic_set(&mrc_sta->snapshot_uses, rc_tx_rate_reuse);
+}
+
+/* Copy the published rate chain of a station without locking, false if it can't be used */
+static bool morse_rc_sta_read_snapshot(struct morse_rc_sta *mrc_sta,
+				       struct mmrc_rate_table *rates, u8 size_class)
+{
+	unsigned int seq;
+	bool valid;
+
+	if (atomic_dec_if_positive(&mrc_sta->snapshot_uses) < 0)
+		return false;
+
+	do {
+		seq = read_seqcount_begin(&mrc_sta->snapshot_seq);
+		valid = mrc_sta->snapshot_valid && mrc_sta->snapshot_size_class == size_class;
+		if (valid)
+			*rates = mrc_sta->snapshot;
+	} while (read_seqcount_retry(&mrc_sta->snapshot_seq, seq));
+
+	return valid;
+}
+
+/* Get the best throughput rate of a station, false if it is not in rate control */
+static bool morse_rc_sta_best_rate(struct morse_sta *msta, struct mmrc_rate *best_rate)
+{
+	struct mmrc_table *tb = morse_rc_sta_lock_table(&msta->rc);
+
+	if (!tb)
+		return false;
+
+	*best_rate = mmrc_sta_get_best_rate(tb);
+	morse_rc_sta_unlock_table(&msta->rc);
+
+	return true;
+}
+
 static void morse_rc_work(struct work_struct *work)
 {
 	struct morse_rc *mrc = container_of(work, struct morse_rc, work);
-	struct list_head *pos;
+	const unsigned long interval = msecs_to_jiffies(MORSE_RC_UPDATE_INTERVAL_MS);
+	const unsigned int batch = max_t(unsigned int, rc_update_batch, 1);
+	unsigned long next = jiffies + interval;
+	bool more;
 
-	spin_lock_bh(&mrc->lock);
+	/* The list is in update order, so the stations due an update are at its head. Update
+	 * them a batch at a time and drop the lock in between.
+	 */
+	do {
+		unsigned int done = 0;
 
-	list_for_each(pos, &mrc->stas) {
-		struct morse_rc_sta *mrc_sta = container_of(pos, struct morse_rc_sta, list);
-		unsigned long now = jiffies;
+		more = false;
+		spin_lock_bh(&mrc->lock);
 
-		mrc_sta->last_update = now;
+		while (!list_empty(&mrc->stas)) {
+			struct morse_rc_sta *mrc_sta =
+				list_first_entry(&mrc->stas, struct morse_rc_sta, list);
+			unsigned long now = jiffies;
 
-		mmrc_update(mrc_sta->tb);
-	}
+			if (time_before(now, mrc_sta->last_update + interval)) {
+				next = mrc_sta->last_update + interval;
+				break;
+			}
+
+			if (done++ == batch) {
+				more = true;
+				break;
+			}
+
+			spin_lock(&mrc_sta->lock);
+			morse_rc_sta_update(mrc, mrc_sta, now);
+			spin_unlock(&mrc_sta->lock);
+
+			list_move_tail(&mrc_sta->list, &mrc->stas);
+		}
 
-	spin_unlock_bh(&mrc->lock);
+		spin_unlock_bh(&mrc->lock);
 
-	mod_timer(&mrc->timer, jiffies + msecs_to_jiffies(100));
+		if (more)
+			cond_resched();
+	} while (more);
+
+	next = max(next, jiffies + msecs_to_jiffies(MORSE_RC_UPDATE_MIN_GAP_MS));
+	mod_timer(&mrc->timer, next);
 }
 
 #if KERNEL_VERSION(4, 14, 0) > LINUX_VERSION_CODE
@@ -105,6 +314,7 @@ int morse_rc_init(struct morse *mors)
 	MORSE_RC_WARN(mors, "rate control algorithm: 'MMRC'\n");
 	INIT_LIST_HEAD(&mors->mrc.stas);
 	spin_lock_init(&mors->mrc.lock);
+	mors->mrc.update_stats.since = jiffies;
 
 	INIT_WORK(&mors->mrc.work, morse_rc_work);
 #if KERNEL_VERSION(4, 14, 0) > LINUX_VERSION_CODE
@@ -117,7 +327,7 @@ int morse_rc_init(struct morse *mors)
 #endif
 
 	mors->mrc.mors = mors;
-	mod_timer(&mors->mrc.timer, jiffies + msecs_to_jiffies(100));
+	mod_timer(&mors->mrc.timer, jiffies + msecs_to_jiffies(MORSE_RC_UPDATE_INTERVAL_MS));
 	return 0;
 }
 
@@ -326,17 +536,36 @@ int morse_rc_sta_add(struct morse *mors, struct ieee80211_vif *vif, struct ieee8
 	mmrc_sta_init(tb, &caps, msta->avg_rssi);
 
 	spin_lock_bh(&mors->mrc.lock);
+	spin_lock(&msta->rc.lock);
 
 	kfree(msta->rc.tb);
-	msta->rc.tb = tb;
-	list_add(&msta->rc.list, &mors->mrc.stas);
+	morse_rc_sta_invalidate_snapshot(&msta->rc);
+	/* Pairs with morse_rc_sta_lock_table() */
+	smp_store_release(&msta->rc.tb, tb);
 	msta->rc.last_update = jiffies;
+	msta->rc.added = jiffies;
+	msta->rc.best_changed = jiffies;
+	msta->rc.best_changes = 0;
+	morse_rc_sta_refresh_expected_tput(&msta->rc);
+
+	spin_unlock(&msta->rc.lock);
+	/* Not due an update until the end of the list */
+	list_move_tail(&msta->rc.list, &mors->mrc.stas);
 
 	spin_unlock_bh(&mors->mrc.lock);
 
 	return 0;
 }
 
+void morse_rc_sta_init(struct ieee80211_sta *sta)
+{
+	struct morse_sta *msta = (struct morse_sta *)sta->drv_priv;
+
+	spin_lock_init(&msta->rc.lock);
+	INIT_LIST_HEAD(&msta->rc.list);
+	seqcount_init(&msta->rc.snapshot_seq);
+}
+
 void morse_rc_reinit_stas(struct morse *mors, struct ieee80211_vif *vif)
 {
 	struct list_head *pos;
@@ -396,7 +625,7 @@ bool _morse_rc_set_fixed_rate(struct morse *mors,
 			      int mcs, int bw, int ss, int guard, const char *caller)
 {
 	struct morse_sta *msta = (struct morse_sta *)sta->drv_priv;
-	struct list_head *pos;
+	struct mmrc_table *tb;
 	struct mmrc_rate fixed_rate;
 	bool ret_val = true;
 
@@ -411,16 +640,12 @@ bool _morse_rc_set_fixed_rate(struct morse *mors,
 	fixed_rate.ss = (ss - 1);
 	fixed_rate.guard = guard;
 
-	spin_lock_bh(&mors->mrc.lock);
-	list_for_each(pos, &mors->mrc.stas) {
-		struct morse_rc_sta *mrc_sta = list_entry(pos, struct morse_rc_sta, list);
-
-		if (&msta->rc == mrc_sta) {
-			ret_val = mmrc_set_fixed_rate(msta->rc.tb, fixed_rate);
-			break;
-		}
+	tb = morse_rc_sta_lock_table(&msta->rc);
+	if (tb) {
+		ret_val = mmrc_set_fixed_rate(tb, fixed_rate);
+		morse_rc_sta_table_changed(&msta->rc);
+		morse_rc_sta_unlock_table(&msta->rc);
 	}
-	spin_unlock_bh(&mors->mrc.lock);
 
 	if (!ret_val)
 		MORSE_RC_ERR(mors, "%s failed, caller %s ss %d bw %d mcs %d guard %d\n",
@@ -433,12 +658,18 @@ void morse_rc_sta_remove(struct morse *mors, struct ieee80211_sta *sta)
 {
 	struct morse_sta *msta = (struct morse_sta *)sta->drv_priv;
 
+	if (!msta->rc.tb)
+		return;
+
 	spin_lock_bh(&mors->mrc.lock);
+	spin_lock(&msta->rc.lock);
 	if (msta->rc.tb) {
 		list_del_init(&msta->rc.list);
 		kfree(msta->rc.tb);
 		msta->rc.tb = NULL;
+		morse_rc_sta_table_changed(&msta->rc);
 	}
+	spin_unlock(&msta->rc.lock);
 	spin_unlock_bh(&mors->mrc.lock);
 }
 
@@ -470,22 +701,33 @@ static int morse_rc_sta_get_rates(struct morse *mors,
 				  struct morse_sta *msta,
 				  struct mmrc_rate_table *rates, size_t size)
 {
-	int ret = -ENOENT;
-	struct list_head *pos;
+	/* The attempts in a chain depend on the frame length, so only frames of a similar
+	 * length share a chain
+	 */
+	u8 size_class = fls(size);
+	struct mmrc_table *tb;
 
-	spin_lock_bh(&mors->mrc.lock);
-	list_for_each(pos, &mors->mrc.stas) {
-		struct morse_rc_sta *mrc_sta = list_entry(pos, struct morse_rc_sta, list);
+	if (morse_rc_sta_read_snapshot(&msta->rc, rates, size_class))
+		return 0;
 
-		if (&msta->rc == mrc_sta) {
-			ret = 0;
-			mmrc_get_rates(msta->rc.tb, rates, size);
-			break;
-		}
-	}
-	spin_unlock_bh(&mors->mrc.lock);
+	tb = morse_rc_sta_lock_table(&msta->rc);
+	if (!tb)
+		return -ENOENT;
+
+	mmrc_get_rates(tb, rates, size);
+	if (rc_tx_rate_reuse)
+		morse_rc_sta_publish_snapshot(&msta->rc, rates, size_class);
+	morse_rc_sta_unlock_table(&msta->rc);
+
+	return 0;
+}
 
-	return ret;
+static void morse_rc_vif_set_mcast_rate(struct morse_vif *mors_vif, struct mmrc_rate rate,
+					u32 throughput)
+{
+	mors_vif->mcast_tx_rate_throughput = throughput;
+	mors_vif->mcast_tx_rate = rate;
+	mors_vif->mcast_tx_rate_raise_evals = 0;
 }
 
 void morse_rc_vif_update_mcast_rate(struct morse *mors, struct morse_vif *mors_vif)
@@ -493,14 +735,17 @@ void morse_rc_vif_update_mcast_rate(struct morse *mors, struct morse_vif *mors_v
 	struct list_head *pos;
 	struct list_head *morse_sta_list = &mors_vif->ap->stas;
 	u32 best_rate_throughput = 0;
-	u32 mcast_throughput = 0;
+	u32 weakest_throughput = 0;
+	u32 current_throughput = mors_vif->mcast_tx_rate_throughput;
 	struct mmrc_rate best_rate;
+	struct mmrc_rate weakest_rate;
 
 	if (!mors_vif->ap->num_stas) {
 		/* If there are no STAs connected, reset the throughput to use basic rates
 		 * for multicast traffic.
 		 */
 		mors_vif->mcast_tx_rate_throughput = 0;
+		mors_vif->mcast_tx_rate_raise_evals = 0;
 		return;
 	}
 
@@ -508,17 +753,38 @@ void morse_rc_vif_update_mcast_rate(struct morse *mors, struct morse_vif *mors_v
 	list_for_each(pos, morse_sta_list) {
 		struct morse_sta *msta = list_entry(pos, struct morse_sta, list);
 
-		if (!msta)
+		if (!msta || !morse_rc_sta_best_rate(msta, &best_rate))
 			continue;
 
-		best_rate = mmrc_sta_get_best_rate(msta->rc.tb);
 		best_rate_throughput = mmrc_calculate_theoretical_throughput(best_rate);
-		if (!mcast_throughput || mcast_throughput > best_rate_throughput) {
-			mcast_throughput = best_rate_throughput;
-			mors_vif->mcast_tx_rate_throughput = mcast_throughput;
-			mors_vif->mcast_tx_rate = best_rate;
+		if (!weakest_throughput || weakest_throughput > best_rate_throughput) {
+			weakest_throughput = best_rate_throughput;
+			weakest_rate = best_rate;
 		}
 	}
+
+	if (!weakest_throughput)
+		return;
+
+	/* Every member must be able to receive, so follow the weakest one down at once */
+	if (!current_throughput || weakest_throughput <= current_throughput) {
+		morse_rc_vif_set_mcast_rate(mors_vif, weakest_rate, weakest_throughput);
+		return;
+	}
+
+	/* Only raise once the weakest member has held a clearly better rate for a while */
+	if (weakest_throughput < current_throughput +
+	    div_u64((u64)current_throughput * mcast_rate_raise_pct, 100)) {
+		mors_vif->mcast_tx_rate_raise_evals = 0;
+		return;
+	}
+
+	if (++mors_vif->mcast_tx_rate_raise_evals < mcast_rate_raise_evals)
+		return;
+
+	MORSE_RC_DBG(mors, "%s: raising multicast rate %u -> %u bps\n", __func__,
+		     current_throughput, weakest_throughput);
+	morse_rc_vif_set_mcast_rate(mors_vif, weakest_rate, weakest_throughput);
 }
 
 static bool morse_rc_use_basic_rates(struct ieee80211_sta *sta, struct sk_buff *skb,
@@ -656,25 +922,136 @@ static void morse_rc_sta_set_rates(struct morse *mors,
 				   int attempts,
 				   bool is_agg_mode, u32 success, u32 failure)
 {
-	struct list_head *pos;
+	struct mmrc_table *tb = morse_rc_sta_lock_table(&msta->rc);
 
-	spin_lock_bh(&mors->mrc.lock);
-	list_for_each(pos, &mors->mrc.stas) {
-		struct morse_rc_sta *mrc_sta = list_entry(pos, struct morse_rc_sta, list);
+	if (!tb)
+		return;
+
+	if (is_agg_mode)
+		mmrc_feedback_agg(tb, rates, attempts, success, failure);
+	else
+		mmrc_feedback(tb, rates, attempts);
+
+	morse_rc_sta_unlock_table(&msta->rc);
+}
+
+/* Lower the multicast rate of the interface if the station can't keep up with it */
+static void morse_rc_sta_feedback_mcast_rate(struct morse_vif *mors_vif, struct morse_sta *msta)
+{
+	struct mmrc_rate best_rate;
+	u32 best_rate_tp;
+
+	if (!mors_vif->enable_multicast_rate_control || !morse_rc_sta_best_rate(msta, &best_rate))
+		return;
+
+	best_rate_tp = mmrc_calculate_theoretical_throughput(best_rate);
+
+	if (!mors_vif->mcast_tx_rate_throughput ||
+	    mors_vif->mcast_tx_rate_throughput > best_rate_tp)
+		morse_rc_vif_set_mcast_rate(mors_vif, best_rate, best_rate_tp);
+}
 
-		if (&msta->rc == mrc_sta) {
-			if (is_agg_mode)
-				mmrc_feedback_agg(msta->rc.tb, rates, attempts, success, failure);
+void morse_rc_feedback_batch_init(struct morse_rc_feedback_batch *batch)
+{
+	batch->num_stas = 0;
+	batch->next_sta = 0;
+	batch->sta = NULL;
+	batch->vif = NULL;
+	batch->num_frames = 0;
+}
+
+void morse_rc_feedback_batch_flush(struct morse *mors, struct morse_rc_feedback_batch *batch)
+{
+	struct morse_sta *msta;
+	struct mmrc_table *tb;
+	int i;
+
+	if (!batch->num_frames)
+		return;
+
+	msta = (struct morse_sta *)batch->sta->drv_priv;
+	tb = morse_rc_sta_lock_table(&msta->rc);
+	if (tb) {
+		for (i = 0; i < batch->num_frames; i++) {
+			if (batch->frames[i].is_agg)
+				mmrc_feedback_agg(tb, &batch->frames[i].rates,
+						  batch->frames[i].attempts,
+						  batch->frames[i].success, batch->frames[i].failure);
 			else
-				mmrc_feedback(msta->rc.tb, rates, attempts);
-			break;
+				mmrc_feedback(tb, &batch->frames[i].rates,
+					      batch->frames[i].attempts);
 		}
+		morse_rc_sta_unlock_table(&msta->rc);
 	}
-	spin_unlock_bh(&mors->mrc.lock);
+
+	morse_rc_sta_feedback_mcast_rate(ieee80211_vif_to_morse_vif(batch->vif), msta);
+	batch->num_frames = 0;
+}
+
+/* Hold back feedback for a station, applying what is held for any other station first */
+static void morse_rc_feedback_batch_add(struct morse *mors, struct morse_rc_feedback_batch *batch,
+					struct ieee80211_vif *vif, struct ieee80211_sta *sta,
+					const struct mmrc_rate_table *rates, int attempts,
+					bool is_agg, u32 success, u32 failure)
+{
+	if (batch->num_frames && (batch->sta != sta ||
+				  batch->num_frames == MORSE_RC_FEEDBACK_BATCH_FRAMES))
+		morse_rc_feedback_batch_flush(mors, batch);
+
+	batch->sta = sta;
+	batch->vif = vif;
+	batch->frames[batch->num_frames].rates = *rates;
+	batch->frames[batch->num_frames].attempts = attempts;
+	batch->frames[batch->num_frames].is_agg = is_agg;
+	batch->frames[batch->num_frames].success = success;
+	batch->frames[batch->num_frames].failure = failure;
+	batch->num_frames++;
+}
+
+static struct ieee80211_sta *morse_rc_feedback_find_sta(struct morse_rc_feedback_batch *batch,
+							struct ieee80211_vif *vif,
+							struct ieee80211_hdr *hdr)
+{
+	bool pv1 = morse_dot11ah_is_pv1_qos_data(hdr->frame_control);
+	/* The addressing fields of PV1 depend on the frame type and direction */
+	u16 type = pv1 ? le16_to_cpu(hdr->frame_control) &
+		   (IEEE80211_FCTL_FTYPE | IEEE80211_FCTL_FROMDS | IEEE80211_FCTL_VERS) : 0;
+	const u8 *key = pv1 ? (const u8 *)hdr + sizeof(hdr->frame_control) : hdr->addr1;
+	struct ieee80211_sta *sta;
+	int i;
+
+	if (batch) {
+		for (i = 0; i < batch->num_stas; i++) {
+			if (batch->stas[i].vif == vif && batch->stas[i].type == type &&
+			    !memcmp(batch->stas[i].key, key, pv1 ? MORSE_RC_FEEDBACK_KEY_LEN :
+				    ETH_ALEN))
+				return batch->stas[i].sta;
+		}
+	}
+
+	if (pv1)
+		sta = morse_pv1_find_sta(vif, (struct dot11ah_mac_pv1_hdr *)hdr);
+	else
+		sta = ieee80211_find_sta(vif, hdr->addr1);
+
+	if (!batch || !sta)
+		return sta;
+
+	i = batch->next_sta;
+	batch->stas[i].vif = vif;
+	batch->stas[i].sta = sta;
+	batch->stas[i].type = type;
+	memcpy(batch->stas[i].key, key, pv1 ? MORSE_RC_FEEDBACK_KEY_LEN : ETH_ALEN);
+	batch->next_sta = (i + 1) % MORSE_RC_FEEDBACK_BATCH_STAS;
+	if (batch->num_stas < MORSE_RC_FEEDBACK_BATCH_STAS)
+		batch->num_stas++;
+
+	return sta;
 }
 
 void morse_rc_sta_feedback_rates(struct morse *mors,
-				 struct sk_buff *skb, struct morse_skb_tx_status *tx_sts)
+				 struct sk_buff *skb, struct morse_skb_tx_status *tx_sts,
+				 struct morse_rc_feedback_batch *batch)
 {
 	int attempts;
 	struct ieee80211_sta *sta;
@@ -686,18 +1063,15 @@ void morse_rc_sta_feedback_rates(struct morse *mors,
 	struct mmrc_rate_table rates;
 	struct morse_sta *msta = NULL;
 	struct ieee80211_vif *vif = NULL;
-	u32 agg_success, agg_packets;
-	struct morse_vif *mors_vif;
+	u32 agg_success = 0, agg_packets = 0;
+	bool is_agg = false;
 
 	/* Must be held while finding and dereferencing sta */
 	rcu_read_lock();
 
 	vif = txi->control.vif ? txi->control.vif : morse_get_vif_from_tx_status(mors, tx_sts);
 
-	if (morse_dot11ah_is_pv1_qos_data(hdr->frame_control))
-		sta = morse_pv1_find_sta(vif, (struct dot11ah_mac_pv1_hdr *)hdr);
-	else
-		sta = ieee80211_find_sta(vif, hdr->addr1);
+	sta = morse_rc_feedback_find_sta(batch, vif, hdr);
 
 	/* Don't update rate info if basic rates were used */
 	if (morse_rc_use_basic_rates(sta, skb, hdr))
@@ -707,8 +1081,6 @@ void morse_rc_sta_feedback_rates(struct morse *mors,
 	if (!msta)
 		goto exit;
 
-	mors_vif = ieee80211_vif_to_morse_vif(vif);
-
 	attempts = morse_rc_sta_get_attempts(mors, tx_sts);
 	if (attempts <= 0)
 		/* Did we really send the packet? */
@@ -724,36 +1096,26 @@ void morse_rc_sta_feedback_rates(struct morse *mors,
 		rates.rates[i].attempts = txi->control.rates[i].count;
 	}
 
-	if (msta) {
-		/* Save the rate information. This will be used to update station's tx rate stats */
-		msta->last_sta_tx_rate.bw = rates.rates[0].bw;
-		msta->last_sta_tx_rate.rate = rates.rates[0].rate;
-		msta->last_sta_tx_rate.ss = rates.rates[0].ss;
-		msta->last_sta_tx_rate.guard = rates.rates[0].guard;
-
-		/* Check if the new rate is lowest rate used */
-		if (mors_vif->enable_multicast_rate_control) {
-			u32 best_rate_tp;
-			struct mmrc_rate best_rate;
-
-			best_rate = mmrc_sta_get_best_rate(msta->rc.tb);
-			best_rate_tp = mmrc_calculate_theoretical_throughput(best_rate);
-
-			if (!mors_vif->mcast_tx_rate_throughput ||
-			    mors_vif->mcast_tx_rate_throughput > best_rate_tp) {
-				mors_vif->mcast_tx_rate_throughput = best_rate_tp;
-				mors_vif->mcast_tx_rate = best_rate;
-			}
-		}
-	}
+	/* Save the rate information. This will be used to update station's tx rate stats */
+	msta->last_sta_tx_rate.bw = rates.rates[0].bw;
+	msta->last_sta_tx_rate.rate = rates.rates[0].rate;
+	msta->last_sta_tx_rate.ss = rates.rates[0].ss;
+	msta->last_sta_tx_rate.guard = rates.rates[0].guard;
 
 	if (tx_sts->ampdu_info) {
 		agg_success = MORSE_TXSTS_AMPDU_INFO_GET_SUC(tx_sts->ampdu_info);
 		agg_packets = MORSE_TXSTS_AMPDU_INFO_GET_LEN(tx_sts->ampdu_info);
-		morse_rc_sta_set_rates(mors, msta, &rates, attempts, true, agg_success,
-				       agg_packets - agg_success);
+		is_agg = true;
+	}
+
+	if (batch) {
+		morse_rc_feedback_batch_add(mors, batch, vif, sta, &rates, attempts, is_agg,
+					    agg_success, agg_packets - agg_success);
 	} else {
-		morse_rc_sta_set_rates(mors, msta, &rates, attempts, false, 0, 0);
+		/* Check if the new rate is lowest rate used */
+		morse_rc_sta_feedback_mcast_rate(ieee80211_vif_to_morse_vif(vif), msta);
+		morse_rc_sta_set_rates(mors, msta, &rates, attempts, is_agg, agg_success,
+				       agg_packets - agg_success);
 	}
 
 exit:
@@ -764,7 +1126,7 @@ exit:
 		txi->flags |= IEEE80211_TX_STAT_ACK;
 
 	if (tx_sts->flags & MORSE_TX_STATUS_FLAGS_PS_FILTERED) {
-		mors->debug.page_stats.tx_ps_filtered++;
+		MORSE_PAGE_STAT_INC(mors, tx_ps_filtered);
 		txi->flags |= IEEE80211_TX_STAT_TX_FILTERED;
 
 		/* Clear TX CTL AMPDU flag so that this frame gets rescheduled in
@@ -824,20 +1186,18 @@ void morse_rc_sta_state_check(struct morse *mors,
 			morse_rc_set_fixed_rate(mors, sta, fixed_mcs, fixed_bw, fixed_ss,
 						fixed_guard);
 
-		if (mors_vif->enable_multicast_rate_control) {
+		if (mors_vif->enable_multicast_rate_control &&
+		    morse_rc_sta_best_rate(msta, &best_rate)) {
 			u32 best_tp;
 
 			/* Check if new STA supports multicast rate. If the new STA is the first one
 			 * to join the network then update vif multicast rate to STA's best rate.
 			 */
-			best_rate = mmrc_sta_get_best_rate(msta->rc.tb);
 			best_tp = mmrc_calculate_theoretical_throughput(best_rate);
 
 			if (mors_vif->mcast_tx_rate_throughput > best_tp ||
-			    !mors_vif->ap->num_stas) {
-				mors_vif->mcast_tx_rate_throughput = best_tp;
-				mors_vif->mcast_tx_rate = best_rate;
-			}
+			    !mors_vif->ap->num_stas)
+				morse_rc_vif_set_mcast_rate(mors_vif, best_rate, best_tp);
 		}
 	} else if (old_state > new_state &&
 		   (old_state == IEEE80211_STA_ASSOC || old_state == IEEE80211_STA_AUTH)) {
@@ -845,7 +1205,7 @@ void morse_rc_sta_state_check(struct morse *mors,
 		morse_rc_sta_remove(mors, sta);
 	} else if (old_state < new_state &&
 		   old_state == IEEE80211_STA_NONE &&
-		   msta->rc.list.prev) {
+		   !list_empty(&msta->rc.list)) {
 		/* Special case for driver warning issue causing a sta to be left on the list */
 		MORSE_RC_INFO(mors, "Remove stale sta from rc list\n");
 		morse_rc_sta_remove(mors, sta);
@@ -12,30 +12,121 @@
 #include "mmrc-submodule/src/core/mmrc.h"
 #include "linux/list.h"
 #include <linux/workqueue.h>
+#include <linux/seqlock.h>
 
 /* This initial value is for MMRC, and there is another in minstrel_rc.h for Minstrel */
 #define INIT_MAX_RATES_NUM 4
 
+/*
+ * Locking: &struct morse_rc lock protects the station list and is taken before the lock of
+ * any station. Each station's rate table is protected by its own lock, so the TX and TX
+ * status paths only ever contend on the station they are working on.
+ */
 struct morse_rc {
-	/* Serialise rate control queue manipulation and timer functions */
+	/* Serialise station list manipulation and the periodic update */
 	spinlock_t lock;
+	/* Stations in the order they were last updated, the next one due at the head */
 	struct list_head stas;
 	struct timer_list timer;
 	struct work_struct work;
 	struct morse *mors;
+
+	/* CPU cost of mmrc_update() since @since (jiffies), protected by @lock */
+	struct {
+		u64 count;
+		u64 total_ns;
+		u64 max_ns;
+		unsigned long since;
+	} update_stats;
 };
 
 struct morse_rc_sta {
+	/* Serialise access to the rate table */
+	spinlock_t lock;
 	struct mmrc_table *tb;
 	struct list_head list;
 
 	unsigned long last_update;
+
+	/*
+	 * Rate chain from the last locked lookup, read without the lock by the TX path.
+	 * Written with the station lock held, and dropped whenever the table is updated.
+	 */
+	seqcount_t snapshot_seq;
+	struct mmrc_rate_table snapshot;
+	bool snapshot_valid;
+	/* Frame size class the chain was computed for, see morse_rc_sta_get_rates() */
+	u8 snapshot_size_class;
+	/* Lock free lookups left before the chain is recomputed */
+	atomic_t snapshot_uses;
+
+	/*
+	 * Expected throughput (kbps) of the best rate, for mac80211. Recomputed with the
+	 * station lock held whenever the best rate changes, read without it.
+	 */
+	u32 expected_tput_kbps;
+	/* Best rate @expected_tput_kbps was computed for */
+	struct mmrc_rate expected_tput_rate;
+
+	/* Convergence of rate selection: when the station was added, and its best rate changed */
+	unsigned long added;
+	unsigned long best_changed;
+	u32 best_changes;
+};
+
+/* Stations remembered, and frames held back, by a TX status batch */
+#define MORSE_RC_FEEDBACK_BATCH_STAS	(4)
+#define MORSE_RC_FEEDBACK_BATCH_FRAMES	(8)
+
+/* Station key: addr1 for PV0, the addressing fields following the frame control for PV1 */
+#define MORSE_RC_FEEDBACK_KEY_LEN	(8)
+
+/*
+ * Rate control state shared by the TX statuses of one batch. Statuses for the same station
+ * tend to arrive together, so stations found for earlier frames are remembered and their
+ * feedback is applied to the rate table in one go. The stations are only valid under the
+ * RCU read lock, which must be held from morse_rc_feedback_batch_init() until
+ * morse_rc_feedback_batch_flush().
+ */
+struct morse_rc_feedback_batch {
+	struct {
+		struct ieee80211_vif *vif;
+		struct ieee80211_sta *sta;
+		/* Frame type bits for PV1, or zero for PV0 */
+		u16 type;
+		u8 key[MORSE_RC_FEEDBACK_KEY_LEN];
+	} stas[MORSE_RC_FEEDBACK_BATCH_STAS];
+	u8 num_stas;
+	/* Entry replaced by the next miss */
+	u8 next_sta;
+
+	/* Feedback not yet applied to the rate table of @sta */
+	struct ieee80211_sta *sta;
+	struct ieee80211_vif *vif;
+	u8 num_frames;
+	struct {
+		struct mmrc_rate_table rates;
+		int attempts;
+		bool is_agg;
+		u32 success;
+		u32 failure;
+	} frames[MORSE_RC_FEEDBACK_BATCH_FRAMES];
 };
 
 int morse_rc_init(struct morse *mors);
 
 int morse_rc_deinit(struct morse *mors);
 
+/**
+ * morse_rc_sta_init() - Initialise the rate control state of a new station
+ *
+ * Called once when mac80211 creates the station, before it can be added to rate control
+ * or used by the TX path.
+ *
+ * @sta: Station being created
+ */
+void morse_rc_sta_init(struct ieee80211_sta *sta);
+
 int morse_rc_sta_add(struct morse *mors, struct ieee80211_vif *vif, struct ieee80211_sta *sta);
 
 #define morse_rc_set_fixed_rate(mors, sta, mcs, bw, ss, guard) \
@@ -51,8 +142,58 @@ void morse_rc_sta_fill_tx_rates(struct morse *mors,
 				struct sk_buff *skb,
 				struct ieee80211_sta *sta, int tx_bw, bool rts_allowed);
 
+/**
+ * morse_rc_sta_feedback_rates() - Feed a TX status back to rate control and fill the status to
+ *				   report to mac80211
+ * @mors: Morse chip struct
+ * @skb: The transmitted frame, reported to mac80211 before returning
+ * @tx_sts: The TX status from the chip
+ * @batch: Batch shared with the other statuses being processed, or NULL to apply the feedback
+ *	   immediately
+ */
 void morse_rc_sta_feedback_rates(struct morse *mors,
-				 struct sk_buff *skb, struct morse_skb_tx_status *tx_sts);
+				 struct sk_buff *skb, struct morse_skb_tx_status *tx_sts,
+				 struct morse_rc_feedback_batch *batch);
+
+/**
+ * morse_rc_feedback_batch_init() - Start a batch of TX status feedback
+ * @batch: Batch to initialise
+ *
+ * Context: Must be called, and the batch used and flushed, under the RCU read lock.
+ */
+void morse_rc_feedback_batch_init(struct morse_rc_feedback_batch *batch);
+
+/**
+ * morse_rc_feedback_batch_flush() - Apply the feedback held back by a batch
+ * @mors: Morse chip struct
+ * @batch: Batch to flush
+ */
+void morse_rc_feedback_batch_flush(struct morse *mors, struct morse_rc_feedback_batch *batch);
+
+/**
+ * morse_rc_sta_table_changed() - Drop rate control state derived from a station's rate table
+ * @mrc_sta: Station whose table was changed outside of rate control
+ *
+ * Context: Must be called with the station lock held.
+ */
+void morse_rc_sta_table_changed(struct morse_rc_sta *mrc_sta);
+
+/**
+ * morse_rc_update_stats_reset() - Restart the mmrc_update() cost statistics
+ * @mors: Morse chip struct
+ */
+void morse_rc_update_stats_reset(struct morse *mors);
+
+/**
+ * morse_rc_sta_expected_throughput() - Get the expected throughput of a station
+ * @msta: Station to get the throughput of
+ *
+ * Return: Throughput of the best rate in kbps, or 0 if the station has no best rate yet
+ */
+static inline u32 morse_rc_sta_expected_throughput(struct morse_sta *msta)
+{
+	return READ_ONCE(msta->rc.expected_tput_kbps);
+}
 
 void morse_rc_sta_state_check(struct morse *mors,
 			      struct ieee80211_vif *vif, struct ieee80211_sta *sta,
@@ -69,6 +210,9 @@ void morse_rc_reinit_stas(struct morse *mors, struct ieee80211_vif *vif);
  * morse_rc_vif_update_mcast_rate() - Goes through the list of STAs connected to
  * VIF to find and update MMRC rate for multicast traffic.
  *
+ * The multicast rate follows the weakest member's best rate down straight away, but is only
+ * raised once the member has held a clearly higher rate over several evaluations.
+ *
  * @note: This function must be called with mutex mors->lock held.
  *
  * @mors: Global morse struct
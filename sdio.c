@@ -17,6 +17,10 @@
 #include <linux/mmc/sdio.h>
 #include <linux/mmc/sd.h>
 #include <linux/pm_runtime.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/debugfs.h>
+#include <linux/uio.h>
 
 #include "hw.h"
 #include "morse.h"
@@ -26,6 +30,7 @@
 #include "debug.h"
 #include "of.h"
 #include "bus_trace.h"
+#include "trace.h"
 
 #ifdef CONFIG_MORSE_USER_ACCESS
 #include "uaccess.h"
@@ -52,6 +57,35 @@ module_param_string(sdio_clk_debugfs, sdio_clk_debugfs, sizeof(sdio_clk_debugfs)
 /* Slow down SDIO CLK to 150KHz. This is the lowest value we can set. */
 #define SLOW_SDIO_CLK_HZ 150000
 
+/* Step the SDIO clock down on bus errors and periodically probe back up */
+static bool sdio_clk_adaptive __read_mostly;
+module_param(sdio_clk_adaptive, bool, 0444);
+MODULE_PARM_DESC(sdio_clk_adaptive, "Adapt the SDIO clock to the bus CRC/timeout error rate");
+
+static uint sdio_clk_min_hz __read_mostly = 10000000;
+module_param(sdio_clk_min_hz, uint, 0644);
+MODULE_PARM_DESC(sdio_clk_min_hz, "Lowest SDIO clock the adaptive governor steps down to");
+
+static uint sdio_clk_err_threshold __read_mostly = 3;
+module_param(sdio_clk_err_threshold, uint, 0644);
+MODULE_PARM_DESC(sdio_clk_err_threshold,
+		 "CRC/timeout errors per evaluation period that step the SDIO clock down");
+
+static uint sdio_clk_probe_up_ms __read_mostly = 60000;
+module_param(sdio_clk_probe_up_ms, uint, 0644);
+MODULE_PARM_DESC(sdio_clk_probe_up_ms,
+		 "Error free time before the SDIO clock is stepped back up (0 to disable)");
+
+/** Period over which bus errors are counted by the adaptive clock governor */
+#define MORSE_SDIO_CLK_EVAL_MS		(1000)
+/** Largest back-off applied to the probe up interval after failed probes */
+#define MORSE_SDIO_CLK_MAX_PROBE_SHIFT	(4)
+
+/** Clock steps of the adaptive governor, fastest first */
+static const u32 morse_sdio_clk_steps_hz[] = {
+	50000000, 41666667, 33333333, 25000000, 20000000, 16666667, 12500000, 10000000,
+};
+
 /* Value to indicate that the base address for bulk/register read/writes has yet to be set */
 #define MORSE_SDIO_BASE_ADDR_UNSET 0xFFFFFFFF
 
@@ -67,6 +101,23 @@ module_param_string(sdio_clk_debugfs, sdio_clk_debugfs, sizeof(sdio_clk_debugfs)
 #define MORSE_SDIO_ALIGNMENT	(2)
 #endif
 
+/** Maximum number of buffers gathered into a single scatter-gather bulk write */
+#define MORSE_SDIO_SG_MAX_SEGS		(32)
+/**
+ * Size of the bounce buffer used for the sub-block tail of a scatter-gather write and
+ * for unaligned reads. Also the largest block size supported by scatter-gather writes.
+ */
+#define MORSE_SDIO_BOUNCE_LEN		(512)
+
+/* CMD53 (IO_RW_EXTENDED) argument fields */
+#define MORSE_SDIO_CMD53_WRITE		BIT(31)
+#define MORSE_SDIO_CMD53_FUNC(_fn)	(((_fn) & 0x7) << 28)
+#define MORSE_SDIO_CMD53_BLOCK_MODE	BIT(27)
+#define MORSE_SDIO_CMD53_INCR_ADDR	BIT(26)
+#define MORSE_SDIO_CMD53_ADDR(_addr)	(((_addr) & 0x1FFFF) << 9)
+#define MORSE_SDIO_CMD53_COUNT(_cnt)	((_cnt) & 0x1FF)
+#define MORSE_SDIO_CMD53_MAX_BLOCKS	(511)
+
 #define MORSE_SDIO_DBG(_m, _f, _a...)		morse_dbg(FEATURE_ID_SDIO, _m, _f, ##_a)
 #define MORSE_SDIO_INFO(_m, _f, _a...)		morse_info(FEATURE_ID_SDIO, _m, _f, ##_a)
 #define MORSE_SDIO_WARN(_m, _f, _a...)		morse_warn(FEATURE_ID_SDIO, _m, _f, ##_a)
@@ -79,6 +130,27 @@ struct morse_sdio {
 	struct sdio_func *func;
 	const struct sdio_device_id *id;
 	struct bus_trace trace;
+	/* Scatter-gather bulk writes */
+	struct scatterlist sg[MORSE_SDIO_SG_MAX_SEGS];
+	/* Bounce buffer for scatter-gather write tails and unaligned reads */
+	u8 *bounce;
+	/* Adaptive clock governor */
+	struct {
+		struct delayed_work work;
+		/* Index into morse_sdio_clk_steps_hz of the current and fastest clocks */
+		u32 level;
+		u32 top_level;
+		/* Errors counted in the current evaluation period */
+		atomic_t period_errs;
+		atomic_t crc_errs;
+		atomic_t timeouts;
+		u32 step_downs;
+		u32 step_ups;
+		/* When the clock last changed, and the probe up back-off since */
+		unsigned long changed;
+		u32 probe_shift;
+		bool probing;
+	} clk;
 };
 
 #ifdef CONFIG_MORSE_USER_ACCESS
@@ -86,6 +158,7 @@ struct uaccess *morse_uaccess;
 #endif
 
 static void morse_sdio_remove(struct sdio_func *func);
+static void morse_sdio_clk_note_err(struct morse_sdio *sdio, int ret);
 
 static void sdio_log_err(struct morse_sdio *sdio, const char *operation, unsigned int fn,
 			   unsigned int address, unsigned int len, int ret)
@@ -98,6 +171,8 @@ static void sdio_log_err(struct morse_sdio *sdio, const char *operation, unsigne
 	MORSE_SDIO_ERR(mors, "sdio: %s fn=%d 0x%08x:%d r=0x%08x b=0x%08x (ret:%d)",
 		       operation, fn, address, len, sdio->register_addr_base,
 		       sdio->bulk_addr_base, ret);
+
+	morse_sdio_clk_note_err(sdio, ret);
 }
 
 static void irq_handler(struct sdio_func *func1)
@@ -420,6 +495,154 @@ exit:
 	return ret;
 }
 
+/*
+ * Issue a single block mode CMD53 write of @blocks blocks from an already built
+ * scatterlist. The base address window must already be set.
+ */
+static int morse_sdio_cmd53_write_blocks(struct sdio_func *func, u32 address,
+					 struct scatterlist *sg, int nents, u32 blocks)
+{
+	struct mmc_host *host = func->card->host;
+	struct mmc_request mrq = { };
+	struct mmc_command cmd = { };
+	struct mmc_data data = { };
+
+	cmd.opcode = SD_IO_RW_EXTENDED;
+	cmd.arg = MORSE_SDIO_CMD53_WRITE | MORSE_SDIO_CMD53_FUNC(func->num) |
+		  MORSE_SDIO_CMD53_BLOCK_MODE | MORSE_SDIO_CMD53_INCR_ADDR |
+		  MORSE_SDIO_CMD53_ADDR(address) | MORSE_SDIO_CMD53_COUNT(blocks);
+	cmd.flags = MMC_RSP_SPI_R5 | MMC_RSP_R5 | MMC_CMD_ADTC;
+
+	data.blksz = func->cur_blksize;
+	data.blocks = blocks;
+	data.flags = MMC_DATA_WRITE;
+	data.sg = sg;
+	data.sg_len = nents;
+
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+
+	mmc_set_data_timeout(&data, func->card);
+	mmc_wait_for_req(host, &mrq);
+
+	if (cmd.error)
+		return cmd.error;
+	if (data.error)
+		return data.error;
+	if (mmc_host_is_spi(host))
+		return 0;
+	if (cmd.resp[0] & R5_ERROR)
+		return -EIO;
+	if (cmd.resp[0] & R5_FUNCTION_NUMBER)
+		return -EINVAL;
+	if (cmd.resp[0] & R5_OUT_OF_RANGE)
+		return -ERANGE;
+
+	return 0;
+}
+
+/*
+ * Write several buffers to consecutive chip memory in one SDIO transaction. Whole blocks
+ * are sent straight from the buffers with a single CMD53; only a trailing partial block
+ * is bounced. Returns -EOPNOTSUPP, without touching the bus, when the host cannot gather
+ * this request so the caller can fall back to a linear write.
+ */
+static int morse_sdio_mem_writev(struct morse_sdio *sdio, u32 address,
+				 const struct kvec *vec, int cnt, int size)
+{
+	int ret;
+	int i;
+	int nents = 0;
+	struct morse *mors = sdio->func ? sdio_get_drvdata(sdio->func) : NULL;
+	struct sdio_func *func_to_use;
+	struct mmc_host *host;
+	u32 blksz, blocks, block_bytes, remaining;
+
+	if (!mors)
+		return -EINVAL;
+
+	host = sdio->func->card->host;
+	blksz = sdio->func->cur_blksize;
+	blocks = size / blksz;
+	block_bytes = blocks * blksz;
+
+	if (!sdio->func->card->cccr.multi_block || !blksz || blksz > MORSE_SDIO_BOUNCE_LEN ||
+	    cnt > min_t(int, MORSE_SDIO_SG_MAX_SEGS, host->max_segs) ||
+	    blocks > min_t(u32, MORSE_SDIO_CMD53_MAX_BLOCKS, host->max_blk_count) ||
+	    block_bytes > host->max_req_size)
+		return -EOPNOTSUPP;
+
+	/* Must stay within a single address window */
+	if ((address & MORSE_SDIO_RW_ADDR_BOUNDARY_MASK) !=
+	    ((address + size - 1) & MORSE_SDIO_RW_ADDR_BOUNDARY_MASK))
+		return -EOPNOTSUPP;
+
+	for (i = 0; i < cnt; i++) {
+		if ((vec[i].iov_len & 0x3) || is_vmalloc_addr(vec[i].iov_base) ||
+		    !IS_ALIGNED((uintptr_t)vec[i].iov_base, mors->bus_ops->bulk_alignment))
+			return -EOPNOTSUPP;
+	}
+
+	func_to_use = morse_sdio_get_func(sdio, address, size, MORSE_CONFIG_ACCESS_4BYTE);
+	if (!func_to_use)
+		return -EIO;
+
+	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_BULK_WRITE, func_to_use->num, address, size);
+	address &= 0x0000FFFF;	/* remove base and keep offset */
+
+	/* Map whole blocks straight from the buffers, the last one may be split */
+	sg_init_table(sdio->sg, cnt);
+	remaining = block_bytes;
+	for (i = 0; i < cnt && remaining; i++) {
+		u32 len = min_t(u32, vec[i].iov_len, remaining);
+
+		sg_set_buf(&sdio->sg[nents++], vec[i].iov_base, len);
+		remaining -= len;
+	}
+	if (nents)
+		sg_mark_end(&sdio->sg[nents - 1]);
+
+	if (blocks) {
+		ret = morse_sdio_cmd53_write_blocks(func_to_use, address, sdio->sg, nents, blocks);
+		if (ret) {
+			sdio_log_err(sdio, "cmd53_write_sg", func_to_use->num, address,
+				     block_bytes, ret);
+			return ret;
+		}
+	}
+
+	if (size == block_bytes)
+		return size;
+
+	/* Bounce the sub-block tail and send it in byte mode */
+	{
+		u32 offset = block_bytes;
+		u32 copied = 0;
+
+		for (i = 0; i < cnt; i++) {
+			u32 len = vec[i].iov_len;
+
+			if (offset >= len) {
+				offset -= len;
+				continue;
+			}
+			memcpy(sdio->bounce + copied, (u8 *)vec[i].iov_base + offset,
+			       len - offset);
+			copied += len - offset;
+			offset = 0;
+		}
+
+		ret = sdio_memcpy_toio(func_to_use, address + block_bytes, sdio->bounce, copied);
+		if (ret) {
+			sdio_log_err(sdio, "memcpy_toio", func_to_use->num,
+				     address + block_bytes, copied, ret);
+			return ret;
+		}
+	}
+
+	return size;
+}
+
 static void morse_sdio_claim_host(struct morse *mors)
 {
 	struct morse_sdio *sdio = (struct morse_sdio *)mors->drv_priv;
@@ -436,6 +659,51 @@ static void morse_sdio_release_host(struct morse *mors)
 	sdio_release_host(func);
 }
 
+static int morse_sdio_mem_read(struct morse_sdio *sdio, u32 address, u8 *data, ssize_t size);
+
+/*
+ * Serve a read whose size is not a word multiple with word accesses: small reads go
+ * through the bounce buffer in one go, larger ones read the aligned body in place and
+ * bounce only the last word. Returns -EOPNOTSUPP if the read cannot be done this way.
+ */
+static int morse_sdio_mem_read_unaligned(struct morse_sdio *sdio, u32 address, u8 *data,
+					 ssize_t size)
+{
+	struct morse *mors = sdio_get_drvdata(sdio->func);
+	ssize_t rounded = ROUND_BYTES_TO_WORD(size);
+	ssize_t body = size & ~0x3;
+	int ret;
+
+	/* The over-read must not leave the address window */
+	if (!IS_ALIGNED(address, 4) ||
+	    (address & MORSE_SDIO_RW_ADDR_BOUNDARY_MASK) !=
+	    ((address + rounded - 1) & MORSE_SDIO_RW_ADDR_BOUNDARY_MASK))
+		return -EOPNOTSUPP;
+
+	if (rounded <= MORSE_SDIO_BOUNCE_LEN) {
+		ret = morse_sdio_mem_read(sdio, address, sdio->bounce, rounded);
+		if (ret != rounded)
+			return (ret < 0) ? ret : -EIO;
+
+		memcpy(data, sdio->bounce, size);
+		return size;
+	}
+
+	if (!IS_ALIGNED((uintptr_t)data, mors->bus_ops->bulk_alignment))
+		return -EOPNOTSUPP;
+
+	ret = morse_sdio_mem_read(sdio, address, data, body);
+	if (ret != body)
+		return (ret < 0) ? ret : -EIO;
+
+	ret = morse_sdio_mem_read(sdio, address + body, sdio->bounce, sizeof(u32));
+	if (ret != sizeof(u32))
+		return (ret < 0) ? ret : -EIO;
+
+	memcpy(data + body, sdio->bounce, size - body);
+	return size;
+}
+
 static int morse_sdio_mem_read(struct morse_sdio *sdio, u32 address, u8 *data, ssize_t size)
 {
 	ssize_t ret = 0;
@@ -448,6 +716,13 @@ static int morse_sdio_mem_read(struct morse_sdio *sdio, u32 address, u8 *data, s
 		goto exit;
 	}
 
+	if (access == MORSE_CONFIG_ACCESS_1BYTE) {
+		ret = morse_sdio_mem_read_unaligned(sdio, address, data, size);
+		if (ret != -EOPNOTSUPP)
+			goto exit;
+		ret = 0;
+	}
+
 	func_to_use = morse_sdio_get_func(sdio, address, size, access);
 	if (!func_to_use) {
 		ret = -EIO;
@@ -530,6 +805,27 @@ err:
 	return -EIO;
 }
 
+static int morse_sdio_dm_writev(struct morse *mors, u32 address, const struct kvec *vec,
+				int cnt)
+{
+	struct morse_sdio *sdio = (struct morse_sdio *)mors->drv_priv;
+	int len = 0;
+	int ret;
+	int i;
+
+	if (WARN_ON(cnt <= 0))
+		return -EINVAL;
+
+	for (i = 0; i < cnt; i++)
+		len += vec[i].iov_len;
+
+	ret = morse_sdio_mem_writev(sdio, address, vec, cnt, len);
+	if (ret == -EOPNOTSUPP)
+		return ret;
+
+	return (ret == len) ? 0 : -EIO;
+}
+
 static int morse_sdio_dm_read(struct morse *mors, u32 address, u8 *data, int len)
 {
 	int ret = 0;
@@ -621,6 +917,154 @@ static void morse_sdio_clk_freq_switch(struct morse *mors, u64 sdio_clk_hz)
 		MORSE_SDIO_DBG(mors, "%s: SDIO-CLK switched to %lldHz\n", __func__, sdio_clk_hz);
 }
 
+static void morse_sdio_clk_apply(struct morse_sdio *sdio, u32 hz)
+{
+	struct sdio_func *func = sdio->func;
+	struct mmc_host *host = func->card->host;
+	struct morse *mors = sdio_get_drvdata(func);
+
+	/* Prefer the platform's debugfs clock control when one is configured */
+	if (strlen(sdio_clk_debugfs) > MIN_STRLEN_SDIO_CLK_PATH) {
+		morse_sdio_clk_freq_switch(mors, hz);
+		return;
+	}
+
+	sdio_claim_host(func);
+	host->ios.clock = clamp_t(u32, hz, host->f_min, host->f_max);
+	host->ops->set_ios(host, &host->ios);
+	sdio_release_host(func);
+
+	MORSE_SDIO_DBG(mors, "%s: SDIO-CLK set to %uHz\n", __func__, host->ios.clock);
+}
+
+static void morse_sdio_clk_note_err(struct morse_sdio *sdio, int ret)
+{
+	if (!sdio_clk_adaptive)
+		return;
+
+	if (ret == -EILSEQ)
+		atomic_inc(&sdio->clk.crc_errs);
+	else if (ret == -ETIMEDOUT)
+		atomic_inc(&sdio->clk.timeouts);
+	else
+		return;
+
+	/* Evaluate straight away rather than waiting for the end of the period */
+	if (atomic_inc_return(&sdio->clk.period_errs) == max_t(uint, sdio_clk_err_threshold, 1))
+		mod_delayed_work(system_wq, &sdio->clk.work, 0);
+}
+
+static void morse_sdio_clk_set_level(struct morse_sdio *sdio, u32 level)
+{
+	struct morse *mors = sdio_get_drvdata(sdio->func);
+
+	MORSE_SDIO_INFO(mors, "SDIO clock %s to %uHz\n",
+			(level > sdio->clk.level) ? "stepped down" : "probing up",
+			morse_sdio_clk_steps_hz[level]);
+
+	sdio->clk.level = level;
+	sdio->clk.changed = jiffies;
+	morse_sdio_clk_apply(sdio, morse_sdio_clk_steps_hz[level]);
+}
+
+static void morse_sdio_clk_work(struct work_struct *work)
+{
+	struct morse_sdio *sdio = container_of(to_delayed_work(work), struct morse_sdio,
+					       clk.work);
+	u32 errs = atomic_xchg(&sdio->clk.period_errs, 0);
+	u32 level = sdio->clk.level;
+	unsigned long probe_up;
+
+	/* The bus runs at the slow clock while disabled */
+	if (!sdio->enabled)
+		goto resched;
+
+	if (errs >= max_t(uint, sdio_clk_err_threshold, 1)) {
+		/* A probe up that failed straight away backs off the next one */
+		if (sdio->clk.probing)
+			sdio->clk.probe_shift = min_t(u32, sdio->clk.probe_shift + 1,
+						      MORSE_SDIO_CLK_MAX_PROBE_SHIFT);
+		sdio->clk.probing = false;
+
+		if (level + 1 < ARRAY_SIZE(morse_sdio_clk_steps_hz) &&
+		    morse_sdio_clk_steps_hz[level + 1] >= sdio_clk_min_hz) {
+			sdio->clk.step_downs++;
+			morse_sdio_clk_set_level(sdio, level + 1);
+		}
+		goto resched;
+	}
+
+	if (errs == 0 && sdio->clk.probing &&
+	    time_after(jiffies, sdio->clk.changed + msecs_to_jiffies(MORSE_SDIO_CLK_EVAL_MS))) {
+		/* The faster clock held up for a full period */
+		sdio->clk.probing = false;
+		sdio->clk.probe_shift = 0;
+	}
+
+	probe_up = msecs_to_jiffies(sdio_clk_probe_up_ms) << sdio->clk.probe_shift;
+	if (errs == 0 && sdio_clk_probe_up_ms && level > sdio->clk.top_level &&
+	    time_after(jiffies, sdio->clk.changed + probe_up)) {
+		sdio->clk.step_ups++;
+		sdio->clk.probing = true;
+		morse_sdio_clk_set_level(sdio, level - 1);
+	}
+
+resched:
+	schedule_delayed_work(&sdio->clk.work, msecs_to_jiffies(MORSE_SDIO_CLK_EVAL_MS));
+}
+
+/* Start the governor at the fastest step the host and card support */
+static void morse_sdio_clk_init(struct morse_sdio *sdio)
+{
+	struct mmc_card *card = sdio->func->card;
+	u32 max_hz = min_t(u32, card->host->f_max, FAST_SDIO_CLK_HZ);
+	u32 level = 0;
+
+	if (!sdio_clk_adaptive)
+		return;
+
+	if (card->cis.max_dtr)
+		max_hz = min_t(u32, max_hz, card->cis.max_dtr);
+
+	while (level + 1 < ARRAY_SIZE(morse_sdio_clk_steps_hz) &&
+	       morse_sdio_clk_steps_hz[level] > max_hz)
+		level++;
+
+	sdio->clk.top_level = level;
+	sdio->clk.level = level;
+	sdio->clk.changed = jiffies;
+	morse_sdio_clk_apply(sdio, morse_sdio_clk_steps_hz[level]);
+	schedule_delayed_work(&sdio->clk.work, msecs_to_jiffies(MORSE_SDIO_CLK_EVAL_MS));
+}
+
+static void morse_sdio_clk_finish(struct morse_sdio *sdio)
+{
+	cancel_delayed_work_sync(&sdio->clk.work);
+}
+
+#ifdef CONFIG_MORSE_DEBUGFS
+static int morse_sdio_clk_show(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+	struct morse_sdio *sdio = (struct morse_sdio *)mors->drv_priv;
+
+	seq_printf(file, "adaptive: %d\n", sdio_clk_adaptive);
+	seq_printf(file, "clock (Hz): %u\n", sdio->func->card->host->ios.clock);
+	if (sdio_clk_adaptive) {
+		seq_printf(file, "governor clock (Hz): %u\n",
+			   morse_sdio_clk_steps_hz[sdio->clk.level]);
+		seq_printf(file, "max clock (Hz): %u\n",
+			   morse_sdio_clk_steps_hz[sdio->clk.top_level]);
+	}
+	seq_printf(file, "crc errors: %d\n", atomic_read(&sdio->clk.crc_errs));
+	seq_printf(file, "timeouts: %d\n", atomic_read(&sdio->clk.timeouts));
+	seq_printf(file, "step downs: %u\n", sdio->clk.step_downs);
+	seq_printf(file, "step ups: %u\n", sdio->clk.step_ups);
+
+	return 0;
+}
+#endif
+
 static void morse_sdio_bus_enable(struct morse *mors, bool enable)
 {
 	struct morse_sdio *sdio = (struct morse_sdio *)mors->drv_priv;
@@ -651,7 +1095,11 @@ static void morse_sdio_bus_enable(struct morse *mors, bool enable)
 	}
 
 	sdio_release_host(func);
-	morse_sdio_clk_freq_switch(mors, (enable) ? FAST_SDIO_CLK_HZ : SLOW_SDIO_CLK_HZ);
+
+	if (enable && sdio_clk_adaptive)
+		morse_sdio_clk_apply(sdio, morse_sdio_clk_steps_hz[sdio->clk.level]);
+	else
+		morse_sdio_clk_freq_switch(mors, (enable) ? FAST_SDIO_CLK_HZ : SLOW_SDIO_CLK_HZ);
 }
 
 static int morse_sdio_reset(int reset_pin, struct sdio_func *func)
@@ -705,6 +1153,7 @@ static void morse_sdio_config_burst_mode(struct morse *mors, bool enable_burst)
 static const struct morse_bus_ops morse_sdio_ops = {
 	.dm_read = morse_sdio_dm_read,
 	.dm_write = morse_sdio_dm_write,
+	.dm_writev = morse_sdio_dm_writev,
 	.reg32_read = morse_sdio_reg32_read,
 	.reg32_write = morse_sdio_reg32_write,
 	.set_bus_enable = morse_sdio_bus_enable,
@@ -716,6 +1165,10 @@ static const struct morse_bus_ops morse_sdio_ops = {
 	.bulk_alignment = MORSE_SDIO_ALIGNMENT
 };
 
+MORSE_BUS_DIRECT_OPS(morse_sdio_dm_read, morse_sdio_dm_write,
+		     morse_sdio_reg32_read, morse_sdio_reg32_write,
+		     morse_sdio_claim_host, morse_sdio_release_host)
+
 static int morse_sdio_enable(struct morse_sdio *sdio)
 {
 	int ret;
@@ -734,6 +1187,8 @@ static void morse_sdio_release(struct morse_sdio *sdio)
 {
 	struct sdio_func *func = sdio->func;
 
+	morse_sdio_clk_finish(sdio);
+
 	sdio_claim_host(func);
 	sdio_disable_func(func);
 	sdio_release_host(func);
@@ -781,8 +1236,15 @@ static int morse_sdio_probe(struct sdio_func *func, const struct sdio_device_id
 	sdio->func = func;
 	sdio->id = id;
 	sdio->enabled = true;
-	bus_trace_init(&sdio->trace);
+	bus_trace_init(&sdio->trace, mors);
 	morse_sdio_reset_base_address(sdio);
+	INIT_DELAYED_WORK(&sdio->clk.work, morse_sdio_clk_work);
+
+	sdio->bounce = devm_kmalloc(dev, MORSE_SDIO_BOUNCE_LEN, GFP_KERNEL);
+	if (!sdio->bounce) {
+		ret = -ENOMEM;
+		goto err_cfg;
+	}
 
 	mors->bus_ops = &morse_sdio_ops;
 	mors->bus_type = MORSE_HOST_BUS_TYPE_SDIO;
@@ -835,6 +1297,8 @@ static int morse_sdio_probe(struct sdio_func *func, const struct sdio_device_id
 		goto err_cfg;
 	}
 
+	morse_sdio_clk_init(sdio);
+
 	ret = morse_firmware_init(mors, test_mode);
 	if (ret)
 		goto err_fw;
@@ -872,6 +1336,11 @@ static int morse_sdio_probe(struct sdio_func *func, const struct sdio_device_id
 			MORSE_SDIO_ERR(mors, "morse_mac_register failed: %d\n", ret);
 			goto err_mac;
 		}
+
+#ifdef CONFIG_MORSE_DEBUGFS
+		debugfs_create_devm_seqfile(mors->dev, "sdio_clock", mors->debug.debugfs_phy,
+					    morse_sdio_clk_show);
+#endif
 	}
 	/* Now all set, enable SDIO interrupts */
 	ret = morse_sdio_enable_irq(sdio);
@@ -946,6 +1415,7 @@ err_net_wq:
 err_fw:
 	morse_sdio_release(sdio);
 err_cfg:
+	bus_trace_deinit(&sdio->trace);
 	morse_mac_destroy(mors);
 err_exit:
 	pr_err("%s failed. The driver has not been loaded!\n", __func__);
@@ -980,6 +1450,7 @@ static void morse_sdio_remove(struct sdio_func *func)
 		}
 
 		morse_sdio_release(sdio);
+		bus_trace_deinit(&sdio->trace);
 		morse_mac_destroy(mors);
 
 		/* Reset HW for a cleaner restart */
@@ -1000,6 +1471,10 @@ static struct sdio_driver morse_sdio_driver = {
 	.id_table = morse_sdio_devices,
 	.probe = morse_sdio_probe,
 	.remove = morse_sdio_remove,
+	/* Firmware download takes a while, let each radio come up alongside the others */
+	.drv = {
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+	},
 };
 
 int __init morse_sdio_init(void)
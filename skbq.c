@@ -22,11 +22,44 @@
 #include "wiphy.h"
 #include "bus.h"
 
+/* Maximum number of RX frames processed per pass of an RX skbq dispatch work */
+#define MORSE_SKBQ_RX_DISPATCH_BUDGET	64
+
+/* Dynamic TX queue limit: evaluation interval and bounds */
+#define MORSE_SKBQ_BQL_INTERVAL_MS	100
+#define MORSE_SKBQ_BQL_MIN_LIMIT	(4 * 1024)
+#define MORSE_SKBQ_BQL_MAX_LIMIT	(MORSE_SKBQ_SIZE - 5 * 1024)
+
 /* Enable/Disable avoid buffer bloating */
 static int max_txq_len __read_mostly = 32;
 module_param(max_txq_len, int, 0644);
 MODULE_PARM_DESC(max_txq_len, "Maximum number of queued TX packets");
 
+static u32 tx_queue_target_ms __read_mostly = 20;
+module_param(tx_queue_target_ms, uint, 0644);
+MODULE_PARM_DESC(tx_queue_target_ms,
+		 "Target queuing delay (ms) for the dynamic TX data queue limit (0 for static limits)");
+
+static uint tx_aqm_target_ms __read_mostly;
+module_param(tx_aqm_target_ms, uint, 0644);
+MODULE_PARM_DESC(tx_aqm_target_ms,
+		 "CoDel target sojourn time (ms) for the TX data queues (0 to disable AQM)");
+
+static uint tx_aqm_interval_ms __read_mostly = 100;
+module_param(tx_aqm_interval_ms, uint, 0644);
+MODULE_PARM_DESC(tx_aqm_interval_ms,
+		 "CoDel interval (ms) the TX data queue delay must exceed target before dropping");
+
+static uint rx_checksum_skip_chans __read_mostly;
+module_param(rx_checksum_skip_chans, uint, 0644);
+MODULE_PARM_DESC(rx_checksum_skip_chans,
+		 "Bitmask of RX frame channels (BIT(chan), chan 0-5) whose skb checksum is not validated");
+
+static uint skb_cache_depth __read_mostly = 32;
+module_param(skb_cache_depth, uint, 0644);
+MODULE_PARM_DESC(skb_cache_depth,
+		 "Maximum number of host-interface skbs kept for reuse (0 to disable)");
+
 static u32 tx_queued_lifetime_ms __read_mostly = (1000);
 module_param(tx_queued_lifetime_ms, uint, 0644);
 MODULE_PARM_DESC(tx_queued_lifetime_ms,
@@ -48,14 +81,61 @@ MODULE_PARM_DESC(tx_status_lifetime_ms,
  */
 struct morse_tx_status_drv_data {
 	/**
-	 * Time (jiffies) at which this packet has spent too long in the pending queue, waiting for
-	 * status notification from the firmware, and should be considered lost.
+	 * Time (see morse_skbq_now_us()) at which this packet was given to the chip. The pending
+	 * queue is kept in this order, so its timed out packets are always at the head.
 	 */
-	unsigned long tx_status_expiry;
+	u32 tx_sent;
+	/** Packet ID, locating the packet in the pending index */
+	u32 pkt_id;
+	/** Index of the matching record in a tx_status buffer, while its report is deferred */
+	u16 tx_sts_idx;
 };
 
-static int __skbq_data_tx_finish(struct morse_skbq *mq, struct sk_buff *skb,
-				 struct morse_skb_tx_status *tx_sts);
+/**
+ * Get tx_status driver data from skb control buffer. Only valid once packet has been sent to
+ * the chip
+ */
+static inline struct morse_tx_status_drv_data *__get_tx_status_driver_data(struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *tx_info = IEEE80211_SKB_CB(skb);
+
+	BUILD_BUG_ON(sizeof(struct morse_tx_status_drv_data) >
+		     sizeof(tx_info->status.status_driver_data));
+	return (struct morse_tx_status_drv_data *)&tx_info->status.status_driver_data[0];
+}
+
+static void __skbq_data_tx_unlink(struct morse_skbq *mq, struct sk_buff *skb);
+
+/** Sojourn times kept by the SKB queue monitor */
+enum morse_skbq_mon_hist {
+	/* From morse_skbq_skb_tx() until written to the chip */
+	MORSE_SKBQ_MON_HIST_QUEUE,
+	/* From written to the chip until the tx_status */
+	MORSE_SKBQ_MON_HIST_AIR,
+	MORSE_SKBQ_MON_NUM_HIST,
+};
+
+static void morse_skbq_mon_sojourn(struct morse *mors, struct sk_buff *skb,
+				   enum morse_skbq_mon_hist hist, u32 us);
+static void morse_skbq_mon_adjust(struct morse *mors, struct sk_buff *skb, bool incr);
+
+/**
+ * Queued and pending TX frames are stamped with a wrapping microsecond clock. Only differences
+ * of up to about an hour are meaningful.
+ */
+static inline u32 morse_skbq_now_us(void)
+{
+	return (u32)ktime_to_us(ktime_get());
+}
+
+/* Low bit of the enqueue timestamp, set for frames dropped once queued for too long */
+#define MORSE_SKBQ_ENQUEUE_EXPIRES	BIT(0)
+
+struct morse_rc_feedback_batch;
+
+static void __skbq_data_tx_report(struct morse *mors, struct sk_buff *skb,
+				  struct morse_skb_tx_status *tx_sts,
+				  struct morse_rc_feedback_batch *rc_batch);
 
 static struct sk_buff *__skbq_get_pending_by_id(struct morse *mors,
 						struct morse_skbq *mq,
@@ -91,7 +171,7 @@ morse_skb_tx_status_to_tx_control(struct morse *mors, struct sk_buff *skb,
 			txi->flags |= IEEE80211_TX_STAT_ACK;
 
 	if (tx_sts->flags & MORSE_TX_STATUS_FLAGS_PS_FILTERED) {
-		mors->debug.page_stats.tx_ps_filtered++;
+		MORSE_PAGE_STAT_INC(mors, tx_ps_filtered);
 		txi->flags |= IEEE80211_TX_STAT_TX_FILTERED;
 
 		MORSE_SKB_DBG(mors, "from_chip ps filtered [sn:%d]%s\n",
@@ -163,7 +243,12 @@ void morse_set_max_skb_txq_len(int new_max_txq_len)
 
 static inline u32 __morse_skbq_size(const struct morse_skbq *mq)
 {
-	return mq->skbq_size;
+	return READ_ONCE(mq->skbq_size) + atomic_read(&mq->tx_inbox_size);
+}
+
+static inline u32 __morse_skbq_qlen(const struct morse_skbq *mq)
+{
+	return skb_queue_len(&mq->skbq) + atomic_read(&mq->tx_inbox_len);
 }
 
 static inline u32 __morse_skbq_space(const struct morse_skbq *mq)
@@ -171,15 +256,85 @@ static inline u32 __morse_skbq_space(const struct morse_skbq *mq)
 	return MORSE_SKBQ_SIZE - __morse_skbq_size(mq);
 }
 
+static inline bool __morse_skbq_bql_active(const struct morse_skbq *mq)
+{
+	return mq->bql.enabled && tx_queue_target_ms;
+}
+
+/*
+ * Re-evaluate the dynamic limit once per interval. If the queue stopped mac80211 and still ran
+ * dry, the limit was too low and is doubled. If it stayed backlogged, the limit tracks the bytes
+ * completed in the target delay (growing at once, decaying gradually). Otherwise the queue was
+ * demand limited and the rate says nothing about the air interface, so the limit is kept.
+ */
+static void __morse_skbq_bql_update(struct morse_skbq *mq)
+{
+	u32 elapsed_ms = jiffies_to_msecs(jiffies - mq->bql.interval_start);
+	u32 limit = mq->bql.limit;
+	u32 target;
+
+	if (elapsed_ms < MORSE_SKBQ_BQL_INTERVAL_MS)
+		return;
+
+	target = div_u64((u64)mq->bql.completed * tx_queue_target_ms, elapsed_ms);
+
+	if (mq->bql.starved) {
+		if (mq->bql.throttled)
+			limit = max(limit * 2, target);
+	} else if (target >= limit) {
+		limit = target;
+	} else {
+		limit -= (limit - target) / 4;
+	}
+
+	WRITE_ONCE(mq->bql.limit,
+		   clamp_t(u32, limit, MORSE_SKBQ_BQL_MIN_LIMIT, MORSE_SKBQ_BQL_MAX_LIMIT));
+	mq->bql.completed = 0;
+	mq->bql.starved = false;
+	WRITE_ONCE(mq->bql.throttled, false);
+	mq->bql.interval_start = jiffies;
+}
+
+static void __morse_skbq_bql_completed(struct morse_skbq *mq, u32 bytes)
+{
+	if (!mq->bql.enabled)
+		return;
+
+	mq->bql.completed += bytes;
+	__morse_skbq_bql_update(mq);
+}
+
 static inline bool __morse_skbq_over_threshold(struct morse_skbq *mq)
 {
-	return max_txq_len ? (mq->skbq.qlen >= max_txq_len) : (__morse_skbq_space(mq) <= 2 * 1024);
+	if (__morse_skbq_bql_active(mq))
+		return __morse_skbq_size(mq) >= READ_ONCE(mq->bql.limit);
+
+	return max_txq_len ?
+	    (__morse_skbq_qlen(mq) >= max_txq_len) : (__morse_skbq_space(mq) <= 2 * 1024);
 }
 
 static inline bool __morse_skbq_under_threshold(struct morse_skbq *mq)
 {
+	if (__morse_skbq_bql_active(mq)) {
+		u32 limit = READ_ONCE(mq->bql.limit);
+
+		return __morse_skbq_size(mq) <= limit - limit / 4;
+	}
+
 	return max_txq_len ?
-	    (mq->skbq.qlen < (max_txq_len - 2)) : (__morse_skbq_space(mq) >= (5 * 1024));
+	    (__morse_skbq_qlen(mq) < (max_txq_len - 2)) : (__morse_skbq_space(mq) >= (5 * 1024));
+}
+
+/*
+ * Slot of a pending SKB in the pending index. Keyed on the ID saved in the control buffer as the
+ * morse header has been removed by the time some SKBs are unlinked.
+ */
+static inline struct sk_buff **__morse_skbq_pending_slot(struct morse_skbq *mq,
+							   struct sk_buff *skb)
+{
+	BUILD_BUG_ON(!is_power_of_2(MORSE_SKBQ_PENDING_INDEX_SIZE));
+	return &mq->pending_index[__get_tx_status_driver_data(skb)->pkt_id &
+				  (MORSE_SKBQ_PENDING_INDEX_SIZE - 1)];
 }
 
 /*
@@ -193,6 +348,11 @@ static void __morse_skbq_unlink(struct morse_skbq *mq, struct sk_buff_head *queu
 	if (queue == &mq->skbq) {
 		MORSE_WARN_ON(FEATURE_ID_SKB, skb->len > mq->skbq_size);
 		mq->skbq_size -= min(skb->len, mq->skbq_size);
+	} else if (queue == &mq->pending) {
+		struct sk_buff **slot = __morse_skbq_pending_slot(mq, skb);
+
+		if (*slot == skb)
+			*slot = NULL;
 	}
 
 	__skb_unlink(skb, queue);
@@ -213,6 +373,12 @@ static int __morse_skbq_put(struct morse_skbq *mq, struct sk_buff_head *queue,
 			return -ENOMEM;
 		}
 		mq->skbq_size += skb->len;
+	} else if (queue == &mq->pending) {
+		struct sk_buff **slot = __morse_skbq_pending_slot(mq, skb);
+
+		/* On a collision the older frame keeps the slot, the newer one is found by walking */
+		if (!*slot)
+			*slot = skb;
 	}
 
 	if (queue_before)
@@ -232,6 +398,60 @@ static void __morse_skbq_pkt_id(struct morse_skbq *mq, struct sk_buff *skb)
 	hdr->tx_info.pkt_id = cpu_to_le32(mq->pkt_seq++);
 }
 
+/* Push an skb onto the lock-free TX inbox. Safe against concurrent producers. */
+static int morse_skbq_tx_inbox_push(struct morse_skbq *mq, struct sk_buff *skb)
+{
+	struct sk_buff *head;
+
+	if (skb->len > __morse_skbq_space(mq)) {
+		MORSE_SKB_INFO(mq->mors, "Morse SKBQ out of memory %d:%d:%d\n",
+			       skb->len, __morse_skbq_space(mq), __morse_skbq_size(mq));
+		return -ENOMEM;
+	}
+
+	atomic_add(skb->len, &mq->tx_inbox_size);
+	atomic_inc(&mq->tx_inbox_len);
+
+	do {
+		head = READ_ONCE(mq->tx_inbox);
+		skb->next = head;
+	} while (cmpxchg(&mq->tx_inbox, head, skb) != head);
+
+	return 0;
+}
+
+void morse_skbq_tx_collect(struct morse_skbq *mq)
+{
+	struct sk_buff *skb, *next;
+	struct sk_buff *fifo = NULL;
+
+	if (!mq->tx_inbox_enabled || !READ_ONCE(mq->tx_inbox))
+		return;
+
+	/* The inbox is LIFO, reverse it to restore submission order */
+	skb = xchg(&mq->tx_inbox, NULL);
+	while (skb) {
+		next = skb->next;
+		skb->next = fifo;
+		fifo = skb;
+		skb = next;
+	}
+
+	while (fifo) {
+		skb = fifo;
+		fifo = skb->next;
+		skb->next = NULL;
+
+		/* Space was reserved when the skb was pushed */
+		mq->skbq_size += skb->len;
+		__skb_queue_tail(&mq->skbq, skb);
+		__morse_skbq_pkt_id(mq, skb);
+
+		atomic_sub(skb->len, &mq->tx_inbox_size);
+		atomic_dec(&mq->tx_inbox_len);
+	}
+}
+
 static struct morse_skbq *__morse_skbq_match_tx_status_to_skbq(struct morse *mors,
 						       const struct morse_skb_tx_status *tx_sts)
 {
@@ -243,11 +463,11 @@ static struct morse_skbq *__morse_skbq_match_tx_status_to_skbq(struct morse *mor
 	case MORSE_SKB_CHAN_LOOPBACK:{
 			int aci = dot11_tid_to_ac(tx_sts->tid);
 
-			mq = mors->cfg->ops->skbq_tc_q_from_aci(mors, aci);
+			mq = morse_chip_if_tc_q_from_aci(mors, aci);
 			break;
 		}
 	case MORSE_SKB_CHAN_MGMT:
-		mq = mors->cfg->ops->skbq_mgmt_tc_q(mors);
+		mq = morse_chip_if_mgmt_tc_q(mors);
 		break;
 	case MORSE_SKB_CHAN_BEACON:
 		mq = mors->cfg->ops->skbq_bcn_tc_q(mors);
@@ -269,6 +489,9 @@ static void insert_pending_skb_to_skbq(struct morse_skbq *mq,
 
 	/* Remove it from the pending list */
 	__morse_skbq_unlink(mq, &mq->pending, skb);
+	/* The driver data overwrote the enqueue time, restart the queue sojourn from now */
+	IEEE80211_SKB_CB(skb)->control.enqueue_time =
+		morse_skbq_now_us() & ~MORSE_SKBQ_ENQUEUE_EXPIRES;
 
 	if (!tail) {
 		/* List is empty */
@@ -299,34 +522,38 @@ static void insert_pending_skb_to_skbq(struct morse_skbq *mq,
 	MORSE_WARN_ON_ONCE(FEATURE_ID_DEFAULT, 1);
 }
 
-static void __skbq_drop_pending_skb(struct morse_skbq *mq, struct sk_buff *skb,
-				    struct ieee80211_vif *vif)
+/*
+ * If this dropped frame is the last frame in a PS-Poll or u-APSD SP, then mac80211 must be
+ * informed that the SP is now over. The morse header must have been removed.
+ */
+static void __skbq_drop_end_sp(struct sk_buff *skb, struct ieee80211_vif *vif)
 {
 	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct ieee80211_sta *sta;
+
+	if (!(txi->flags & IEEE80211_TX_STATUS_EOSP) || !vif)
+		return;
 
+	/* Must be held while finding and dereferencing sta */
+	rcu_read_lock();
+	sta = ieee80211_find_sta(vif, hdr->addr1);
+	if (sta)
+		ieee80211_sta_eosp(sta);
+	rcu_read_unlock();
+}
+
+static void __skbq_drop_pending_skb(struct morse_skbq *mq, struct sk_buff *skb,
+				    struct ieee80211_vif *vif)
+{
 	__morse_skbq_unlink(mq, &mq->pending, skb);
+	morse_pkt_lat_drop(mq->mors, skb);
 
 	morse_skb_remove_hdr_after_sent_to_chip(skb);
-
-	/* If this frame is the last frame in a PS-Poll or u-APSD SP,
-	 * then mac80211 must be informed that the SP is now over.
-	 */
-	if (txi->flags & IEEE80211_TX_STATUS_EOSP) {
-		struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
-		struct ieee80211_sta *sta;
-
-		if (vif) {
-			/* Must be held while finding and dereferencing sta */
-			rcu_read_lock();
-			sta = ieee80211_find_sta(vif, hdr->addr1);
-			if (sta)
-				ieee80211_sta_eosp(sta);
-			rcu_read_unlock();
-		}
-	}
+	__skbq_drop_end_sp(skb, vif);
 
 	ieee80211_free_txskb(mq->mors->hw, skb);
-	mq->mors->debug.page_stats.tx_status_dropped++;
+	MORSE_PAGE_STAT_INC(mq->mors, tx_status_dropped);
 }
 
 static bool tx_skb_is_ps_filtered(struct morse_skbq *mq, struct sk_buff *skb,
@@ -366,11 +593,26 @@ static void morse_skbq_tx_status_process(struct morse *mors, struct sk_buff *skb
 {
 	int i;
 	int mismatch = 0;
-	struct morse_skb_tx_status *tx_sts = (struct morse_skb_tx_status *)skb->data;
+	int batched = 0;
+	struct morse_skb_tx_status *tx_sts_base = (struct morse_skb_tx_status *)skb->data;
+	struct morse_skb_tx_status *tx_sts = tx_sts_base;
 	int count = skb->len / sizeof(*tx_sts);
+	struct morse_skbq *locked_mq = NULL;
+	struct sk_buff_head done;
+	struct sk_buff *tx_skb, *tmp;
+#ifdef CONFIG_MORSE_RC
+	struct morse_rc_feedback_batch rc_batch_buf;
+	struct morse_rc_feedback_batch *rc_batch = &rc_batch_buf;
+#else
+	struct morse_rc_feedback_batch *rc_batch = NULL;
+#endif
 
+	__skb_queue_head_init(&done);
+	morse_hw_trace_point(MORSE_HWT_TX_STATUS, true);
+
+	/* Covers the vif lookups, then the reports so station lookups can be shared */
+	rcu_read_lock();
 	for (i = 0; i < count; tx_sts++, i++) {
-		struct sk_buff *tx_skb;
 		struct ieee80211_vif *vif;
 		struct morse_skbq *mq = __morse_skbq_match_tx_status_to_skbq(mors, tx_sts);
 		bool is_ps_filtered = (tx_sts->flags & MORSE_TX_STATUS_FLAGS_PS_FILTERED);
@@ -384,49 +626,76 @@ static void morse_skbq_tx_status_process(struct morse *mors, struct sk_buff *skb
 
 		vif = morse_get_vif_from_tx_status(mq->mors, tx_sts);
 
-		spin_lock_bh(&mq->lock);
+		/* Statuses tend to arrive in runs for the same queue, so hold its lock across them */
+		if (mq != locked_mq) {
+			if (locked_mq)
+				spin_unlock_bh(&locked_mq->lock);
+			spin_lock_bh(&mq->lock);
+			locked_mq = mq;
+		}
+
 		tx_skb = __skbq_get_pending_by_id(mors, mq, tx_sts->pkt_id, vif);
 		if (!tx_skb) {
 			MORSE_SKB_DBG(mors, "No pending pkt match found [pktid:%d chan:%d]\n",
 				      tx_sts->pkt_id, tx_sts->channel);
 			mismatch++;
-			spin_unlock_bh(&mq->lock);
 			continue;
 		}
 
 		if (tx_sts->flags & MORSE_TX_STATUS_PAGE_INVALID) {
 			/* Drop invalid SKBs */
-			mors->debug.page_stats.tx_status_page_invalid++;
+			MORSE_PAGE_STAT_INC(mors, tx_status_page_invalid);
 			__skbq_drop_pending_skb(mq, tx_skb, vif);
-			spin_unlock_bh(&mq->lock);
 			continue;
 		}
 
 		if (tx_sts->flags & MORSE_TX_STATUS_DUTY_CYCLE_CANT_SEND) {
 			/* Drop SKBs that can't be sent due to duty cycle restrictions  */
-			mors->debug.page_stats.tx_status_duty_cycle_cant_send++;
+			MORSE_PAGE_STAT_INC(mors, tx_status_duty_cycle_cant_send);
 			__skbq_drop_pending_skb(mq, tx_skb, vif);
-			spin_unlock_bh(&mq->lock);
 			continue;
 		}
 
 		if (is_ps_filtered && tx_skb_is_ps_filtered(mq, tx_skb, tx_sts)) {
 			/* Has been consumed by tx_skb_is_ps_filtered */
-			spin_unlock_bh(&mq->lock);
 			continue;
 		}
 
 		morse_skb_remove_hdr_after_sent_to_chip(tx_skb);
 
-		morse_skbq_skb_finish(mq, tx_skb, tx_sts);
+		if (mq->flags & MORSE_CHIP_IF_FLAGS_COMMAND) {
+			morse_skbq_skb_finish(mq, tx_skb, tx_sts);
+			continue;
+		}
+
+		/* Unlink now, report to mac80211 once the lock has been dropped */
+		__skbq_data_tx_unlink(mq, tx_skb);
+		__get_tx_status_driver_data(tx_skb)->tx_sts_idx = i;
+		__skb_queue_tail(&done, tx_skb);
+		batched++;
+	}
 
-		spin_unlock_bh(&mq->lock);
+	if (locked_mq)
+		spin_unlock_bh(&locked_mq->lock);
+
+#ifdef CONFIG_MORSE_RC
+	morse_rc_feedback_batch_init(rc_batch);
+#endif
+	skb_queue_walk_safe(&done, tx_skb, tmp) {
+		tx_sts = &tx_sts_base[__get_tx_status_driver_data(tx_skb)->tx_sts_idx];
+		__skb_unlink(tx_skb, &done);
+		__skbq_data_tx_report(mors, tx_skb, tx_sts, rc_batch);
 	}
+#ifdef CONFIG_MORSE_RC
+	morse_rc_feedback_batch_flush(mors, rc_batch);
+#endif
+	rcu_read_unlock();
+	morse_hw_trace_point(MORSE_HWT_TX_STATUS, false);
 
-	MORSE_SKB_DBG(mors, "TX status %d (%d mismatch)\n", count, mismatch);
+	MORSE_SKB_DBG(mors, "TX status %d (%d mismatch, %d batched)\n", count, mismatch, batched);
 
 	if (mors->ps.enable &&
-	    !mors->ps.suspended && (mors->cfg->ops->skbq_get_tx_buffered_count(mors) == 0)) {
+	    !mors->ps.suspended && (morse_chip_if_tx_buffered_count(mors) == 0)) {
 		/* Evaluate ps to check if it was gated on a pending tx status */
 		queue_delayed_work(mors->chip_wq, &mors->ps.delayed_eval_work, 0);
 	}
@@ -445,10 +714,12 @@ static void morse_skbq_dispatch_work(struct work_struct *dispatch_work)
 
 	__skb_queue_head_init(&skbq);
 
-	morse_skbq_deq_num_items(mq, &skbq, morse_skbq_count(mq));
+	morse_skbq_deq_num_items(mq, &skbq, min_t(u32, morse_skbq_count(mq),
+						  MORSE_SKBQ_RX_DISPATCH_BUDGET));
 
 	skb_queue_walk_safe(&skbq, pfirst, pnext) {
 		__skb_unlink(pfirst, &skbq);
+		morse_pkt_lat_stamp(mors, pfirst, MORSE_PKT_LAT_RX_DISPATCH);
 		/* Header endianness has already be adjusted */
 		hdr = (struct morse_buff_skb_header *)pfirst->data;
 		channel = hdr->channel;
@@ -464,7 +735,7 @@ static void morse_skbq_dispatch_work(struct work_struct *dispatch_work)
 			morse_skbq_tx_status_process(mors, pfirst);
 			fallthrough;
 		case MORSE_SKB_CHAN_LOOPBACK:
-			dev_kfree_skb_any(pfirst);
+			morse_skb_cache_free(mors, pfirst);
 			break;
 		case MORSE_SKB_CHAN_WIPHY:
 			morse_wiphy_rx(mors, pfirst);
@@ -476,9 +747,23 @@ static void morse_skbq_dispatch_work(struct work_struct *dispatch_work)
 		count++;
 	}
 
+	if (count)
+		morse_watchdog_chip_alive(mors);
+
+	morse_mac_rx_napi_schedule(mors);
+	morse_wiphy_rx_napi_schedule(mors);
+
+	/* Budget used up: yield to other work and come back for the rest before pulling more
+	 * from the chip.
+	 */
+	if (morse_skbq_count(mq) > 0) {
+		queue_work(mors->net_wq, &mq->dispatch_work);
+		return;
+	}
+
 	/* rerun recv in case skbq was full and we couldn't copy data */
 	set_bit(MORSE_RX_PEND, &mors->chip_if->event_flags);
-	queue_work(mors->chip_wq, &mors->chip_if_work);
+	morse_hw_chip_if_queue_work(mors);
 }
 
 void morse_skb_remove_hdr_after_sent_to_chip(struct sk_buff *skb)
@@ -513,17 +798,18 @@ static void set_queued_tx_skb_expiry(struct sk_buff *skb)
 {
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
 	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+	/* Every frame is stamped, which also gives the queue sojourn time */
+	u32 enqueue_time = morse_skbq_now_us() & ~MORSE_SKBQ_ENQUEUE_EXPIRES;
 
 	if (ieee80211_is_probe_req(hdr->frame_control) ||
 	    ieee80211_is_probe_resp(hdr->frame_control) ||
-	    ieee80211_is_auth(hdr->frame_control)) {
-		/* This field is used for other purposes in mac80211 but cannot be referenced
-		 * again, so it is safe to repurpose.
-		 */
-		txi->control.enqueue_time = (u32)jiffies;
-	} else {
-		txi->control.enqueue_time = 0;
-	}
+	    ieee80211_is_auth(hdr->frame_control))
+		enqueue_time |= MORSE_SKBQ_ENQUEUE_EXPIRES;
+
+	/* This field is used for other purposes in mac80211 but cannot be referenced
+	 * again, so it is safe to repurpose.
+	 */
+	txi->control.enqueue_time = enqueue_time;
 }
 
 /**
@@ -532,15 +818,12 @@ static void set_queued_tx_skb_expiry(struct sk_buff *skb)
 static bool has_queued_tx_skb_expired(struct sk_buff *skb)
 {
 	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+	u32 queued_us = morse_skbq_now_us() - txi->control.enqueue_time;
 
-	if (txi->control.enqueue_time > 0) {
-		u32 expiry_time =
-			txi->control.enqueue_time + msecs_to_jiffies(tx_queued_lifetime_ms);
-
-		return (s32)((u32)jiffies - expiry_time) > 0;
-	}
+	if (!(txi->control.enqueue_time & MORSE_SKBQ_ENQUEUE_EXPIRES))
+		return false;
 
-	return false;
+	return queued_us > (u64)tx_queued_lifetime_ms * USEC_PER_MSEC;
 }
 
 /*
@@ -555,6 +838,7 @@ void morse_skbq_purge_aged(struct morse *mors, struct morse_skbq *mq)
 	struct sk_buff *pnext;
 
 	spin_lock_bh(&mq->lock);
+	morse_skbq_tx_collect(mq);
 
 	skb_queue_walk_safe(&mq->skbq, pfirst, pnext) {
 		if (!has_queued_tx_skb_expired(pfirst))
@@ -566,7 +850,116 @@ void morse_skbq_purge_aged(struct morse *mors, struct morse_skbq *mq)
 
 	spin_unlock_bh(&mq->lock);
 
-	mors->debug.page_stats.tx_aged_out += dropped;
+	MORSE_PAGE_STAT_ADD(mors, tx_aged_out, dropped);
+}
+
+static inline bool __morse_skbq_aqm_active(const struct morse_skbq *mq)
+{
+	return mq->aqm.enabled && tx_aqm_target_ms && !is_fullmac_mode();
+}
+
+/* Next drop time: the interval after @t, shrinking with the square root of the drop count */
+static inline u32 __morse_skbq_aqm_control_law(u32 t, u32 count)
+{
+	return t + (tx_aqm_interval_ms * USEC_PER_MSEC) / int_sqrt(max_t(u32, count, 1));
+}
+
+/*
+ * Has the queue been above the target sojourn time for a full interval? The head frame's wait is
+ * the standing queue delay. The last queued frame is never dropped, a lone frame waiting that
+ * long is the air interface being slow rather than a standing queue.
+ */
+static bool __morse_skbq_aqm_ok_to_drop(struct morse_skbq *mq, struct sk_buff *skb, u32 now)
+{
+	u32 sojourn = now - IEEE80211_SKB_CB(skb)->control.enqueue_time;
+
+	if (sojourn < tx_aqm_target_ms * USEC_PER_MSEC || skb_queue_len(&mq->skbq) <= 1) {
+		mq->aqm.above_target = false;
+		return false;
+	}
+
+	if (!mq->aqm.above_target) {
+		mq->aqm.above_target = true;
+		mq->aqm.first_above = now + tx_aqm_interval_ms * USEC_PER_MSEC;
+		return false;
+	}
+
+	return (s32)(now - mq->aqm.first_above) >= 0;
+}
+
+static void __morse_skbq_aqm_drop(struct morse_skbq *mq, struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+
+	__morse_skbq_unlink(mq, &mq->skbq, skb);
+	morse_pkt_lat_drop(mq->mors, skb);
+
+	morse_skb_remove_hdr_after_sent_to_chip(skb);
+	morse_skbq_mon_adjust(mq->mors, skb, 0);
+	__skbq_drop_end_sp(skb, txi->control.vif);
+
+	ieee80211_free_txskb(mq->mors->hw, skb);
+	MORSE_PAGE_STAT_INC(mq->mors, tx_aqm_dropped);
+}
+
+/*
+ * CoDel (RFC 8289) on the head of a data TX queue: drop from the head while the sojourn time has
+ * stayed above target, at an increasing rate until it falls back below.
+ *
+ * @note The MQ lock (mq->lock) must be held by the caller.
+ *
+ * Return: The head frame to send, or NULL if the queue is empty
+ */
+static struct sk_buff *__morse_skbq_aqm_dequeue_peek(struct morse_skbq *mq)
+{
+	struct sk_buff *skb = skb_peek(&mq->skbq);
+	u32 now = morse_skbq_now_us();
+	bool drop;
+	u32 delta;
+
+	if (!skb)
+		return NULL;
+
+	drop = __morse_skbq_aqm_ok_to_drop(mq, skb, now);
+
+	if (mq->aqm.dropping) {
+		if (!drop) {
+			mq->aqm.dropping = false;
+			return skb;
+		}
+
+		while (mq->aqm.dropping && (s32)(now - mq->aqm.drop_next) >= 0) {
+			__morse_skbq_aqm_drop(mq, skb);
+			mq->aqm.count++;
+			skb = skb_peek(&mq->skbq);
+			if (!skb || !__morse_skbq_aqm_ok_to_drop(mq, skb, now))
+				mq->aqm.dropping = false;
+			else
+				mq->aqm.drop_next = __morse_skbq_aqm_control_law(mq->aqm.drop_next,
+										 mq->aqm.count);
+		}
+
+		return skb;
+	}
+
+	if (!drop)
+		return skb;
+
+	__morse_skbq_aqm_drop(mq, skb);
+	skb = skb_peek(&mq->skbq);
+	mq->aqm.dropping = true;
+
+	/* Resume near the last drop rate if this is soon after the last dropping state */
+	delta = mq->aqm.count - mq->aqm.lastcount;
+	if (delta > 1 &&
+	    (s32)(now - mq->aqm.drop_next) < 16 * tx_aqm_interval_ms * USEC_PER_MSEC)
+		mq->aqm.count = delta;
+	else
+		mq->aqm.count = 1;
+	mq->aqm.lastcount = mq->aqm.count;
+	mq->aqm.drop_next = __morse_skbq_aqm_control_law(now, mq->aqm.count);
+
+	return skb;
 }
 
 int morse_skbq_purge(struct morse_skbq *mq, struct sk_buff_head *skbq)
@@ -577,6 +970,9 @@ int morse_skbq_purge(struct morse_skbq *mq, struct sk_buff_head *skbq)
 	if (mq)
 		spin_lock_bh(&mq->lock);
 
+	if (mq && skbq == &mq->pending)
+		memset(mq->pending_index, 0, sizeof(mq->pending_index));
+
 	while ((skb = __skb_dequeue(skbq))) {
 		cnt++;
 		dev_kfree_skb_any(skb);
@@ -614,6 +1010,17 @@ int morse_skbq_deq_num_items(struct morse_skbq *mq, struct sk_buff_head *skbq, i
 	struct sk_buff *pfirst, *pnext;
 
 	spin_lock_bh(&mq->lock);
+	morse_skbq_tx_collect(mq);
+	if (__morse_skbq_aqm_active(mq)) {
+		while (count < num_items && (pfirst = __morse_skbq_aqm_dequeue_peek(mq))) {
+			__morse_skbq_unlink(mq, &mq->skbq, pfirst);
+			__skb_queue_tail(skbq, pfirst);
+			++count;
+		}
+		spin_unlock_bh(&mq->lock);
+		return count;
+	}
+
 	skb_queue_walk_safe(&mq->skbq, pfirst, pnext) {
 		if (count >= num_items)
 			break;
@@ -631,6 +1038,8 @@ int morse_skbq_enq_prepend(struct morse_skbq *mq, struct sk_buff_head *skbq)
 	struct sk_buff *pfirst, *pnext;
 
 	spin_lock_bh(&mq->lock);
+	/* Anything still in the inbox was queued after the packets being returned */
+	morse_skbq_tx_collect(mq);
 	size = __morse_skbq_space(mq);
 
 	/*
@@ -653,7 +1062,11 @@ int morse_skbq_enq_prepend(struct morse_skbq *mq, struct sk_buff_head *skbq)
 void morse_skbq_show(const struct morse_skbq *mq, struct seq_file *file)
 {
 	seq_printf(file, "pkts:%d skbq:%d pending:%d\n",
-		   mq->skbq.qlen, mq->skbq_size, mq->pending.qlen);
+		   __morse_skbq_qlen(mq), __morse_skbq_size(mq), mq->pending.qlen);
+	if (mq->bql.enabled)
+		seq_printf(file, "limit:%u\n", READ_ONCE(mq->bql.limit));
+	if (__morse_skbq_aqm_active(mq))
+		seq_printf(file, "aqm dropping:%d count:%u\n", mq->aqm.dropping, mq->aqm.count);
 }
 
 void morse_skbq_stop_tx_queues(struct morse *mors)
@@ -666,13 +1079,18 @@ void morse_skbq_stop_tx_queues(struct morse *mors)
 	if (is_fullmac_mode())
 		return;
 
-	/* Wake/Stop mac80211 queues is not needed when using pull interface */
-	if (mors->custom_configs.enable_airtime_fairness)
-		return;
+	MORSE_PAGE_STAT_INC(mors, queue_stop);
+#ifdef CONFIG_MORSE_IPMON
+	atomic_inc(&mors->debug.ipmon_queue_stops);
+#endif
 
-	mors->debug.page_stats.queue_stop++;
-	for (queue = IEEE80211_AC_VO; queue <= IEEE80211_AC_BK; queue++)
-		ieee80211_stop_queue(mors->hw, queue);
+	/*
+	 * Stopping mac80211 queues is not needed when using the pull interface, the
+	 * state flag alone stops the TX queue scheduler from dequeuing more frames.
+	 */
+	if (!mors->custom_configs.enable_airtime_fairness)
+		for (queue = IEEE80211_AC_VO; queue <= IEEE80211_AC_BK; queue++)
+			ieee80211_stop_queue(mors->hw, queue);
 
 	set_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags);
 }
@@ -693,10 +1111,6 @@ void morse_skbq_may_wake_tx_queues(struct morse *mors)
 	if (is_fullmac_mode())
 		return;
 
-	/* Wake/Stop mac80211 queues is not needed when using pull interface */
-	if (mors->custom_configs.enable_airtime_fairness)
-		return;
-
 	could_wake = true;
 	mors->cfg->ops->skbq_get_tx_qs(mors, &qs, &num_qs);
 	for (queue = 0; queue < num_qs; queue++) {
@@ -713,53 +1127,28 @@ void morse_skbq_may_wake_tx_queues(struct morse *mors)
 	if (!could_wake)
 		return;
 
-	for (queue = IEEE80211_AC_VO; queue <= IEEE80211_AC_BK; queue++)
-		ieee80211_wake_queue(mors->hw, queue);
+	/* Waking mac80211 queues is not needed when using the pull interface */
+	if (!mors->custom_configs.enable_airtime_fairness)
+		for (queue = IEEE80211_AC_VO; queue <= IEEE80211_AC_BK; queue++)
+			ieee80211_wake_queue(mors->hw, queue);
 
 	clear_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags);
 }
 
-static int morse_skbq_tx(struct morse_skbq *mq, struct sk_buff *skb, u8 channel)
-{
-	struct morse *mors = mq->mors;
-	bool mq_over_threshold;
-	int rc;
-
-	/* TODO data Alignment */
-	spin_lock_bh(&mq->lock);
-	rc = __morse_skbq_put(mq, &mq->skbq, skb, false, NULL);
-	if (rc) {
-		MORSE_SKB_ERR(mors, "skb put chan %d failed (%d)\n", channel, rc);
-		if (channel == MORSE_SKB_CHAN_DATA) {
-			u16 queue = skb_get_queue_mapping(skb);
-
-			MORSE_SKB_ERR(mors, "skb put queue %d status %d\n",
-				      queue, ieee80211_queue_stopped(mors->hw, queue));
-		}
-	}
-
-	/* Fill packet ID in TX info */
-	__morse_skbq_pkt_id(mq, skb);
-
-	mq_over_threshold = __morse_skbq_over_threshold(mq);
-	spin_unlock_bh(&mq->lock);
-
-	/* For data packets stop queues */
-	if (channel == MORSE_SKB_CHAN_DATA && mq_over_threshold)
-		morse_skbq_stop_tx_queues(mors);
-
 #ifdef CONFIG_MORSE_IPMON
-	{
-		struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)skb->data;
-		static u64 time_start;
+static void morse_skbq_tx_ipmon(struct morse *mors, struct sk_buff *skb)
+{
+	struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)skb->data;
 
-		if (channel == MORSE_SKB_CHAN_DATA)
-			morse_ipmon(&time_start, skb, skb->data + sizeof(*hdr),
-				    le16_to_cpu(hdr->len), IPMON_LOC_CLIENT_DRV2,
-				    mors->debug.page_stats.queue_stop);
-	}
+	morse_ipmon(&mors->debug.ipmon_time_start[IPMON_LOC_CLIENT_DRV2], skb,
+		    skb->data + sizeof(*hdr), le16_to_cpu(hdr->len), IPMON_LOC_CLIENT_DRV2,
+		    atomic_read(&mors->debug.ipmon_queue_stops));
+}
 #endif
 
+/* Tell the chip interface there is something to send on @channel */
+static void morse_skbq_tx_kick(struct morse *mors, u8 channel)
+{
 	switch (channel) {
 	case MORSE_SKB_CHAN_DATA:
 	case MORSE_SKB_CHAN_WIPHY:
@@ -767,54 +1156,103 @@ static int morse_skbq_tx(struct morse_skbq *mq, struct sk_buff *skb, u8 channel)
 	case MORSE_SKB_CHAN_DATA_NOACK:
 		if (morse_is_data_tx_allowed(mors)) {
 			set_bit(MORSE_TX_DATA_PEND, &mors->chip_if->event_flags);
-			queue_work(mors->chip_wq, &mors->chip_if_work);
+			morse_hw_chip_if_queue_work(mors);
 		}
 		break;
 	case MORSE_SKB_CHAN_MGMT:
 		set_bit(MORSE_TX_MGMT_PEND, &mors->chip_if->event_flags);
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+		morse_hw_chip_if_queue_work(mors);
 		break;
 	case MORSE_SKB_CHAN_BEACON:
 		set_bit(MORSE_TX_BEACON_PEND, &mors->chip_if->event_flags);
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+		morse_hw_chip_if_queue_work(mors);
 		break;
 	case MORSE_SKB_CHAN_COMMAND:
 		set_bit(MORSE_TX_COMMAND_PEND, &mors->chip_if->event_flags);
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+		morse_hw_chip_if_queue_work(mors);
 		break;
 	default:
 		MORSE_SKB_ERR(mors, "Invalid SKB channel: %d\n", channel);
 		break;
 	}
-
-	return rc;
 }
 
-/**
- * Get tx_status driver data from skb control buffer. Only valid once packet has been sent to
- * the chip
- */
-static inline struct morse_tx_status_drv_data *__get_tx_status_driver_data(struct sk_buff *skb)
+static int morse_skbq_tx(struct morse_skbq *mq, struct sk_buff *skb, u8 channel)
 {
-	struct ieee80211_tx_info *tx_info = IEEE80211_SKB_CB(skb);
+	struct morse *mors = mq->mors;
+	bool mq_over_threshold;
+	int rc;
 
-	BUILD_BUG_ON(sizeof(struct morse_tx_status_drv_data) >
-		     sizeof(tx_info->status.status_driver_data));
-	return (struct morse_tx_status_drv_data *)&tx_info->status.status_driver_data[0];
-}
+	/* TODO data Alignment */
+	if (mq->tx_inbox_enabled) {
+		/* Packet ID is assigned when the consumer collects the inbox */
+		rc = morse_skbq_tx_inbox_push(mq, skb);
+		if (rc)
+			MORSE_SKB_ERR(mors, "skb put chan %d failed (%d)\n", channel, rc);
+		mq_over_threshold = __morse_skbq_over_threshold(mq);
+	} else {
+		spin_lock_bh(&mq->lock);
+		rc = __morse_skbq_put(mq, &mq->skbq, skb, false, NULL);
+		if (rc) {
+			MORSE_SKB_ERR(mors, "skb put chan %d failed (%d)\n", channel, rc);
+			if (channel == MORSE_SKB_CHAN_DATA) {
+				u16 queue = skb_get_queue_mapping(skb);
+
+				MORSE_SKB_ERR(mors, "skb put queue %d status %d\n",
+					      queue, ieee80211_queue_stopped(mors->hw, queue));
+			}
+		}
 
-/**
- * Move the skb to the pending queue, and take a timestamp of when we have waited too long for a
- * tx_status from the chip.
- */
-static inline void __skbq_tx_move_to_pending(struct morse_skbq *mq, struct sk_buff *skb)
-{
+		/* Fill packet ID in TX info */
+		__morse_skbq_pkt_id(mq, skb);
+
+		mq_over_threshold = __morse_skbq_over_threshold(mq);
+		spin_unlock_bh(&mq->lock);
+	}
+
+	/* For data packets stop queues */
+	if (channel == MORSE_SKB_CHAN_DATA && mq_over_threshold) {
+		WRITE_ONCE(mq->bql.throttled, true);
+		morse_skbq_stop_tx_queues(mors);
+	}
+
+#ifdef CONFIG_MORSE_IPMON
+	if (channel == MORSE_SKB_CHAN_DATA)
+		morse_skbq_tx_ipmon(mors, skb);
+#endif
+
+	/* The TX scheduler worker kicks once when it has filled the data queues */
+	if (channel != MORSE_SKB_CHAN_DATA || !READ_ONCE(mors->txq_defer_data_kick))
+		morse_skbq_tx_kick(mors, channel);
+
+	return rc;
+}
+
+void morse_skbq_data_tx_kick(struct morse *mors)
+{
+	morse_skbq_tx_kick(mors, MORSE_SKB_CHAN_DATA);
+}
+
+/**
+ * Move the skb to the tail of the pending queue, and take a timestamp of when it was given to
+ * the chip.
+ */
+static inline void __skbq_tx_move_to_pending(struct morse_skbq *mq, struct sk_buff *skb)
+{
 	struct morse_tx_status_drv_data *pend_info = __get_tx_status_driver_data(skb);
+	struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)skb->data;
+	/* The enqueue time shares the control buffer with the driver data, so read it first */
+	u32 enqueue_time = IEEE80211_SKB_CB(skb)->control.enqueue_time;
+	u32 now_us = morse_skbq_now_us();
 
-	/* Use coarse as we care more about this function being fast than being ms accurate.
-	 */
-	pend_info->tx_status_expiry = jiffies + msecs_to_jiffies(tx_status_lifetime_ms);
+	if (hdr->channel == MORSE_SKB_CHAN_DATA)
+		morse_skbq_mon_sojourn(mq->mors, skb, MORSE_SKBQ_MON_HIST_QUEUE,
+				       now_us - enqueue_time);
+
+	pend_info->tx_sent = now_us;
+	pend_info->pkt_id = le32_to_cpu(hdr->tx_info.pkt_id);
 	__morse_skbq_put(mq, &mq->pending, skb, false, NULL);
+	morse_pkt_lat_stamp(mq->mors, skb, MORSE_PKT_LAT_TX_BUS);
 }
 
 /**
@@ -824,8 +1262,19 @@ static inline bool __has_pending_tx_skb_timed_out(struct sk_buff *skb)
 {
 	struct morse_tx_status_drv_data *info = __get_tx_status_driver_data(skb);
 
-	/* If our timestamp value is in the past then we have timed out. */
-	return time_is_before_jiffies(info->tx_status_expiry);
+	/* The lifetime is applied here, so a change to it keeps the pending queue in expiry order */
+	return (u32)(morse_skbq_now_us() - info->tx_sent) >
+	       (u64)tx_status_lifetime_ms * USEC_PER_MSEC;
+}
+
+/* Microseconds until a pending skb times out, 0 if it already has */
+static u32 __pending_tx_skb_expires_in_us(struct sk_buff *skb)
+{
+	struct morse_tx_status_drv_data *info = __get_tx_status_driver_data(skb);
+	u64 lifetime_us = (u64)tx_status_lifetime_ms * USEC_PER_MSEC;
+	u32 elapsed_us = (u32)(morse_skbq_now_us() - info->tx_sent);
+
+	return (elapsed_us >= lifetime_us) ? 0 : (u32)min_t(u64, lifetime_us - elapsed_us, U32_MAX);
 }
 
 int morse_skbq_tx_complete(struct morse_skbq *mq, struct sk_buff_head *skbq)
@@ -862,6 +1311,7 @@ int morse_skbq_tx_complete(struct morse_skbq *mq, struct sk_buff_head *skbq)
 			fallthrough;
 		case MORSE_SKB_CHAN_LOOPBACK:
 		case MORSE_SKB_CHAN_WIPHY:
+			/* Beacons and wiphy frames come from mac80211, so are never recycled */
 			dev_kfree_skb_any(pfirst);
 			break;
 		default:
@@ -873,17 +1323,13 @@ int morse_skbq_tx_complete(struct morse_skbq *mq, struct sk_buff_head *skbq)
 			break;
 		}
 	}
+	if (__morse_skbq_qlen(mq) == 0)
+		mq->bql.starved = true;
 	spin_unlock_bh(&mq->lock);
 
-	if (skb_awaits_tx_status) {
-		spin_lock_bh(&mors->stale_status.lock);
-
-		if (mors->stale_status.enabled)
-			mod_timer(&mors->stale_status.timer, jiffies +
-				  msecs_to_jiffies(tx_status_lifetime_ms));
-
-		spin_unlock_bh(&mors->stale_status.lock);
-	}
+	/* Only the first frame to go pending arms the timer, the rest expire after it */
+	if (skb_awaits_tx_status)
+		morse_stale_tx_status_arm(mors, jiffies + msecs_to_jiffies(tx_status_lifetime_ms));
 
 	return 0;
 }
@@ -903,8 +1349,9 @@ struct sk_buff *morse_skbq_tx_pending(struct morse_skbq *mq)
 	return pfirst;
 }
 
-/* Get a pending frame by its ID. This will also drop frames with
- * older packet ids that are in the list
+/* Get a pending frame by its ID. Frames are normally found through the pending index; if the
+ * index misses, fall back to walking the list, which will also drop frames with older packet
+ * ids that have timed out.
  */
 static struct sk_buff *__skbq_get_pending_by_id(struct morse *mors,
 						struct morse_skbq *mq,
@@ -913,6 +1360,17 @@ static struct sk_buff *__skbq_get_pending_by_id(struct morse *mors,
 	struct sk_buff *pfirst, *pnext;
 	struct sk_buff *ret = NULL;
 
+	pfirst = mq->pending_index[le32_to_cpu((__force __le32)pkt_id) &
+				   (MORSE_SKBQ_PENDING_INDEX_SIZE - 1)];
+	if (pfirst) {
+		struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)pfirst->data;
+
+		if (hdr->tx_info.pkt_id == pkt_id)
+			return pfirst;
+	}
+
+	MORSE_PAGE_STAT_INC(mq->mors, tx_status_slow_lookup);
+
 	/* Move sent packets to pending list waiting for feedback */
 	skb_queue_walk_safe(&mq->pending, pfirst, pnext) {
 		struct morse_buff_skb_header *hdr;
@@ -928,14 +1386,14 @@ static struct sk_buff *__skbq_get_pending_by_id(struct morse *mors,
 				      "%s: pending TX SKB timed out [id:%d,chan:%d] (curr:%d)\n",
 				      __func__, hdr->tx_info.pkt_id, hdr->channel, pkt_id);
 			__skbq_drop_pending_skb(mq, pfirst, vif);
-			mq->mors->debug.page_stats.tx_status_flushed++;
+			MORSE_PAGE_STAT_INC(mq->mors, tx_status_flushed);
 		}
 	}
 
 	return ret;
 }
 
-int morse_skbq_check_for_stale_tx(struct morse *mors, struct morse_skbq *mq)
+int morse_skbq_check_for_stale_tx(struct morse *mors, struct morse_skbq *mq, u32 *next_us)
 {
 	int flushed = 0;
 	struct sk_buff *pfirst;
@@ -945,25 +1403,31 @@ int morse_skbq_check_for_stale_tx(struct morse *mors, struct morse_skbq *mq)
 		return 0;
 
 	/* Move sent packets to pending list waiting for feedback */
+	rcu_read_lock();
 	spin_lock_bh(&mq->lock);
 	skb_queue_walk_safe(&mq->pending, pfirst, pnext) {
 		struct ieee80211_vif *vif;
 		struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(pfirst);
 		struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)pfirst->data;
 
-		if (__has_pending_tx_skb_timed_out(pfirst)) {
-			MORSE_SKB_DBG(mors, "%s: TX SKB timed out [id:%d,chan:%d]\n",
-				      __func__, hdr->tx_info.pkt_id, hdr->channel);
-
-			vif = (txi->control.vif) ? txi->control.vif :
-			    morse_get_vif_from_vif_id(mors, MORSE_TX_CONF_FLAGS_VIF_ID_GET
-				      (le32_to_cpu(hdr->tx_info.flags)));
-			__skbq_drop_pending_skb(mq, pfirst, vif);
-			mq->mors->debug.page_stats.tx_status_flushed++;
-			flushed++;
+		/* Pending is in send order: everything after this one was sent later */
+		if (!__has_pending_tx_skb_timed_out(pfirst)) {
+			*next_us = min(*next_us, __pending_tx_skb_expires_in_us(pfirst));
+			break;
 		}
+
+		MORSE_SKB_DBG(mors, "%s: TX SKB timed out [id:%d,chan:%d]\n",
+			      __func__, hdr->tx_info.pkt_id, hdr->channel);
+
+		vif = (txi->control.vif) ? txi->control.vif :
+		    morse_get_vif_from_vif_id(mors, MORSE_TX_CONF_FLAGS_VIF_ID_GET
+			      (le32_to_cpu(hdr->tx_info.flags)));
+		__skbq_drop_pending_skb(mq, pfirst, vif);
+		MORSE_PAGE_STAT_INC(mq->mors, tx_status_flushed);
+		flushed++;
 	}
 	spin_unlock_bh(&mq->lock);
+	rcu_read_unlock();
 
 	return flushed;
 }
@@ -986,18 +1450,31 @@ static void __skbq_qosnullfunc_to_nullfunc(struct sk_buff *skb)
 }
 
 /* Remove commands from pending (or skbq if not sent) */
+static bool __skbq_contains(struct sk_buff_head *queue, struct sk_buff *skb)
+{
+	struct sk_buff *iter;
+
+	skb_queue_walk(queue, iter) {
+		if (iter == skb)
+			return true;
+	}
+
+	return false;
+}
+
 static int __skbq_cmd_finish(struct morse_skbq *mq, struct sk_buff *skb)
 {
 	struct morse *mors = mq->mors;
 
-	if (mq->pending.qlen > 0) {
+	/* Several commands may be in flight, so find the one being finished */
+	if (__skbq_contains(&mq->pending, skb)) {
 		__morse_skbq_unlink(mq, &mq->pending, skb);
-		dev_kfree_skb(skb);
-	} else if (mq->skbq.qlen > 0) {
+		morse_skb_cache_free(mors, skb);
+	} else if (__skbq_contains(&mq->skbq, skb)) {
 		/* Command was probably timed out before being sent */
-		MORSE_SKB_INFO(mors, "Command pending queue empty. Removing from SKBQ.\n");
+		MORSE_SKB_INFO(mors, "Command not pending. Removing from SKBQ.\n");
 		__morse_skbq_unlink(mq, &mq->skbq, skb);
-		dev_kfree_skb(skb);
+		morse_skb_cache_free(mors, skb);
 	} else {
 		MORSE_SKB_INFO(mors, "Command Q not found\n");
 	}
@@ -1005,20 +1482,162 @@ static int __skbq_cmd_finish(struct morse_skbq *mq, struct sk_buff *skb)
 	return 0;
 }
 
+/* Sojourn buckets (us): below 1, then doubling up to an open ended last bucket of 4s and over */
+#define MORSE_SKBQ_MON_SOJOURN_BUCKETS	(24)
+
+/* Per-CPU queue monitor counters, folded when the table is dumped */
+struct morse_skbq_mon_cnt {
+	u32 tot_sent;
+	/* May go negative on a CPU that completes frames sent from another */
+	s32 qsize_cur;
+	u32 sojourn[MORSE_SKBQ_MON_NUM_HIST][MORSE_SKBQ_MON_SOJOURN_BUCKETS];
+};
+
 struct morse_skbq_mon_ent {
 	u8 sa[ETH_ALEN];
 	u8 da[ETH_ALEN];
-	u32 tot_sent;
-	u32 qsize_cur;
+	/* High-water mark of the folded queue size, sampled every few sends */
 	u32 qsize_max;
 };
 
+/* Sample the folded queue size every this many sends on a CPU */
+#define MORSE_SKBQ_MON_MAX_SAMPLE_INTERVAL	8
+
 struct morse_skbq_mon_tbl {
 	struct morse_skbq_mon_ent ent_all;
 	struct morse_skbq_mon_ent ent_mcast;
-	struct morse_skbq_mon_ent ent[8];
+	struct morse_skbq_mon_ent ent[MORSE_SKBQ_MON_MAX_STATS - 2];
+	/* Counters for ent_all, ent_mcast then ent[], in that order */
+	struct morse_skbq_mon_cnt __percpu *cnt;
 } *morse_skbq_mon;
 
+#define MORSE_SKBQ_MON_NUM_ENT	(2 + ARRAY_SIZE(morse_skbq_mon->ent))
+
+static int morse_skbq_mon_idx(const struct morse_skbq_mon_ent *ent)
+{
+	if (ent == &morse_skbq_mon->ent_all)
+		return 0;
+	if (ent == &morse_skbq_mon->ent_mcast)
+		return 1;
+	return 2 + (ent - morse_skbq_mon->ent);
+}
+
+static void morse_skbq_mon_fold(const struct morse_skbq_mon_ent *ent,
+				u32 *tot_sent, u32 *qsize_cur)
+{
+	const int idx = morse_skbq_mon_idx(ent);
+	s32 cur = 0;
+	int cpu;
+
+	*tot_sent = 0;
+	for_each_possible_cpu(cpu) {
+		const struct morse_skbq_mon_cnt *cnt = per_cpu_ptr(morse_skbq_mon->cnt, cpu) + idx;
+
+		*tot_sent += cnt->tot_sent;
+		cur += cnt->qsize_cur;
+	}
+	*qsize_cur = max(cur, 0);
+}
+
+static void morse_skbq_mon_sample_max(struct morse_skbq_mon_ent *ent)
+{
+	u32 tot_sent, qsize_cur;
+
+	morse_skbq_mon_fold(ent, &tot_sent, &qsize_cur);
+	if (ent->qsize_max < qsize_cur)
+		ent->qsize_max = qsize_cur;
+}
+
+static const char * const morse_skbq_mon_hist_names[MORSE_SKBQ_MON_NUM_HIST] = {
+	[MORSE_SKBQ_MON_HIST_QUEUE] = "queue",
+	[MORSE_SKBQ_MON_HIST_AIR] = "air",
+};
+
+static void morse_skbq_mon_show_sojourn(struct seq_file *file,
+					const struct morse_skbq_mon_ent *ent)
+{
+	const int idx = morse_skbq_mon_idx(ent);
+	u32 sojourn[MORSE_SKBQ_MON_SOJOURN_BUCKETS];
+	int hist, cpu, i;
+
+	for (hist = 0; hist < MORSE_SKBQ_MON_NUM_HIST; hist++) {
+		memset(sojourn, 0, sizeof(sojourn));
+		for_each_possible_cpu(cpu) {
+			const struct morse_skbq_mon_cnt *cnt =
+				per_cpu_ptr(morse_skbq_mon->cnt, cpu) + idx;
+
+			for (i = 0; i < MORSE_SKBQ_MON_SOJOURN_BUCKETS; i++)
+				sojourn[i] += cnt->sojourn[hist][i];
+		}
+
+		if (!memchr_inv(sojourn, 0, sizeof(sojourn)))
+			continue;
+
+		seq_printf(file, "    %-5s", morse_skbq_mon_hist_names[hist]);
+		for (i = 0; i < MORSE_SKBQ_MON_SOJOURN_BUCKETS; i++)
+			seq_printf(file, " %u", sojourn[i]);
+		seq_puts(file, "\n");
+	}
+}
+
+static void morse_skbq_mon_show_ent(struct seq_file *file, struct morse_skbq_mon_ent *ent,
+				    int i, const char *name)
+{
+	u32 tot_sent, qsize_cur;
+
+	morse_skbq_mon_fold(ent, &tot_sent, &qsize_cur);
+	if (ent->qsize_max < qsize_cur)
+		ent->qsize_max = qsize_cur;
+
+	if (name)
+		seq_printf(file, "%3s %-35s %-8d %-8d %-8d\n",
+			   "-", name, tot_sent, qsize_cur, ent->qsize_max);
+	else
+		seq_printf(file, "%3d %pM %pM %-8d %-8d %-8d\n",
+			   i, ent->sa, ent->da, tot_sent, qsize_cur, ent->qsize_max);
+
+	morse_skbq_mon_show_sojourn(file, ent);
+}
+
+static void morse_skbq_mon_read_ent(struct morse_skbq_mon_ent *ent, enum morse_skbq_mon_type type,
+				    struct morse_skbq_mon_stats *stats)
+{
+	u32 qsize_cur;
+
+	morse_skbq_mon_fold(ent, &stats->tot_sent, &qsize_cur);
+	if (ent->qsize_max < qsize_cur)
+		ent->qsize_max = qsize_cur;
+
+	stats->type = type;
+	ether_addr_copy(stats->sa, ent->sa);
+	ether_addr_copy(stats->da, ent->da);
+	stats->qsize_cur = qsize_cur;
+	stats->qsize_max = ent->qsize_max;
+}
+
+int morse_skbq_mon_read(struct morse_skbq_mon_stats *stats, int max_stats)
+{
+	int num = 0;
+	int i;
+
+	if (!morse_skbq_mon || max_stats < 2)
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(morse_skbq_mon->ent) && num < max_stats - 2; i++) {
+		if (is_zero_ether_addr(morse_skbq_mon->ent[i].sa))
+			break;
+		morse_skbq_mon_read_ent(&morse_skbq_mon->ent[i], MORSE_SKBQ_MON_TYPE_STA,
+					&stats[num++]);
+	}
+
+	morse_skbq_mon_read_ent(&morse_skbq_mon->ent_mcast, MORSE_SKBQ_MON_TYPE_MCAST,
+				&stats[num++]);
+	morse_skbq_mon_read_ent(&morse_skbq_mon->ent_all, MORSE_SKBQ_MON_TYPE_ALL,
+				&stats[num++]);
+
+	return num;
+}
+
 /**
  * Dump the Per-station SKB queue monitor table
  * On first call the table is allocated.
@@ -1026,35 +1645,48 @@ struct morse_skbq_mon_tbl {
  */
 void morse_skbq_mon_dump(struct morse *mors, struct seq_file *file)
 {
-	struct morse_skbq_mon_ent *ent;
+	struct morse_skbq_mon_cnt __percpu *cnt;
+	int cpu;
 	int i;
 
 	if (!morse_skbq_mon) {
-		morse_skbq_mon = kcalloc(1, sizeof(*morse_skbq_mon), GFP_KERNEL);
+		struct morse_skbq_mon_tbl *tbl = kcalloc(1, sizeof(*tbl), GFP_KERNEL);
+
+		if (!tbl)
+			return;
+
+		tbl->cnt = __alloc_percpu(MORSE_SKBQ_MON_NUM_ENT * sizeof(*tbl->cnt),
+					  __alignof__(*tbl->cnt));
+		if (!tbl->cnt) {
+			kfree(tbl);
+			return;
+		}
+		morse_skbq_mon = tbl;
 		seq_puts(file, "Initialised per-station SKB queue monitoring\n");
 		return;
 	}
 
 	seq_puts(file, "Idx Source            Dest              Total    Q Size   Max Size\n");
+	seq_puts(file, "    Sojourn buckets (us): <1");
+	for (i = 1; i < MORSE_SKBQ_MON_SOJOURN_BUCKETS - 1; i++)
+		seq_printf(file, " <%u", 1U << i);
+	seq_printf(file, " >=%u\n", 1U << (MORSE_SKBQ_MON_SOJOURN_BUCKETS - 2));
 
 	for (i = 0; i < ARRAY_SIZE(morse_skbq_mon->ent); i++) {
-		ent = &morse_skbq_mon->ent[i];
-		if (is_zero_ether_addr(ent->sa))
+		if (is_zero_ether_addr(morse_skbq_mon->ent[i].sa))
 			break;
-		seq_printf(file, "%3d %pM %pM %-8d %-8d %-8d\n",
-			   i, ent->sa, ent->da, ent->tot_sent, ent->qsize_cur, ent->qsize_max);
+		morse_skbq_mon_show_ent(file, &morse_skbq_mon->ent[i], i, NULL);
 	}
 
-	ent = &morse_skbq_mon->ent_mcast;
-	seq_printf(file, "%3s %-35s %-8d %-8d %-8d\n",
-		   "-", "Multicast/Broadcast", ent->tot_sent, ent->qsize_cur, ent->qsize_max);
-
-	ent = &morse_skbq_mon->ent_all;
-	seq_printf(file, "%3s %-35s %-8d %-8d %-8d\n",
-		   "-", "All Tx", ent->tot_sent, ent->qsize_cur, ent->qsize_max);
+	morse_skbq_mon_show_ent(file, &morse_skbq_mon->ent_mcast, 0, "Multicast/Broadcast");
+	morse_skbq_mon_show_ent(file, &morse_skbq_mon->ent_all, 0, "All Tx");
 
 	/* reset the table */
+	cnt = morse_skbq_mon->cnt;
 	memset(morse_skbq_mon, 0, sizeof(*morse_skbq_mon));
+	morse_skbq_mon->cnt = cnt;
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(cnt, cpu), 0, MORSE_SKBQ_MON_NUM_ENT * sizeof(*cnt));
 }
 
 /**
@@ -1074,7 +1706,8 @@ static struct morse_skbq_mon_ent *morse_skbq_mon_get(struct morse *mors,
 
 	if (hdr->frame_control == 0xaa) {
 		/* Header has not been stripped */
-		hdr = (struct ieee80211_hdr *)(skb->data + sizeof(struct morse_buff_skb_header));
+		hdr = (struct ieee80211_hdr *)(skb->data + sizeof(struct morse_buff_skb_header) +
+			((struct morse_buff_skb_header *)skb->data)->offset);
 		sa = ieee80211_get_SA(hdr);
 		da = ieee80211_get_DA(hdr);
 	}
@@ -1092,11 +1725,9 @@ static struct morse_skbq_mon_ent *morse_skbq_mon_get(struct morse *mors,
 		if (is_zero_ether_addr(ent->sa)) {
 			if (!add)
 				break;
-			/* Not found - add entry */
+			/* Not found - add entry. Its counters were cleared with the table */
 			memcpy(&ent->sa[0], sa, ETH_ALEN);
 			memcpy(&ent->da[0], da, ETH_ALEN);
-			ent->tot_sent = 0;
-			ent->qsize_cur = 0;
 			ent->qsize_max = 0;
 			MORSE_SKB_INFO(mors, "%s: add i=%d [%pM->%pM]\n", __func__, i, sa, da);
 			return ent;
@@ -1118,39 +1749,63 @@ static void morse_skbq_mon_adjust(struct morse *mors, struct sk_buff *skb, bool
 {
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
 	struct morse_skbq_mon_ent *ent;
-	struct morse_skbq_mon_ent *ent_all = &morse_skbq_mon->ent_all;
+	struct morse_skbq_mon_cnt __percpu *cnt;
+	struct morse_skbq_mon_cnt __percpu *cnt_all;
 
-	if (!ieee80211_is_data(hdr->frame_control))
+	if (!morse_skbq_mon || !ieee80211_is_data(hdr->frame_control))
 		return;
 
 	ent = morse_skbq_mon_get(mors, skb, incr);
 	if (!ent)
 		return;
 
-	if (incr) {
-		ent->tot_sent++;
-		ent_all->tot_sent++;
-		ent->qsize_cur++;
-		ent_all->qsize_cur++;
-		if (ent->qsize_max < ent->qsize_cur)
-			ent->qsize_max = ent->qsize_cur;
-		if (ent_all->qsize_max < ent_all->qsize_cur)
-			ent_all->qsize_max = ent_all->qsize_cur;
-	} else {
-		if (ent->qsize_cur == 0 || ent_all->qsize_cur == 0) {
-			MORSE_SKB_ERR(mors,
-				      "%s: [%pM %pM] Unexpected ctr %d/%d %d/%d %d/%d\n",
-				      __func__, ent->sa, ent->da,
-				      ent->qsize_cur, ent_all->qsize_cur,
-				      ent->tot_sent, ent_all->tot_sent,
-				      ent->qsize_max, ent_all->qsize_max);
-			return;
-		}
-		ent->qsize_cur--;
-		ent_all->qsize_cur--;
+	cnt = morse_skbq_mon->cnt + morse_skbq_mon_idx(ent);
+	cnt_all = morse_skbq_mon->cnt;
+
+	if (!incr) {
+		this_cpu_dec(cnt->qsize_cur);
+		this_cpu_dec(cnt_all->qsize_cur);
+		return;
+	}
+
+	this_cpu_inc(cnt->tot_sent);
+	this_cpu_inc(cnt->qsize_cur);
+	this_cpu_inc(cnt_all->tot_sent);
+	this_cpu_inc(cnt_all->qsize_cur);
+
+	if (this_cpu_read(cnt_all->tot_sent) % MORSE_SKBQ_MON_MAX_SAMPLE_INTERVAL == 0) {
+		morse_skbq_mon_sample_max(ent);
+		morse_skbq_mon_sample_max(&morse_skbq_mon->ent_all);
 	}
 }
 
+/**
+ * Account the sojourn time of a data frame to its queue monitor entry and to the total, if
+ * monitoring is enabled.
+ *
+ * @skb - SKB, with or without its morse header
+ * @hist - Which sojourn time @us is
+ */
+static void morse_skbq_mon_sojourn(struct morse *mors, struct sk_buff *skb,
+				   enum morse_skbq_mon_hist hist, u32 us)
+{
+	struct morse_skbq_mon_ent *ent;
+	struct morse_skbq_mon_cnt __percpu *cnt_all;
+	unsigned int lat = morse_hist_bucket(us, MORSE_SKBQ_MON_SOJOURN_BUCKETS);
+
+	if (!morse_skbq_mon)
+		return;
+
+	ent = morse_skbq_mon_get(mors, skb, false);
+	cnt_all = morse_skbq_mon->cnt;
+	if (ent) {
+		struct morse_skbq_mon_cnt __percpu *cnt = cnt_all + morse_skbq_mon_idx(ent);
+
+		this_cpu_inc(cnt->sojourn[hist][lat]);
+	}
+	this_cpu_inc(cnt_all->sojourn[hist][lat]);
+}
+
 #ifndef CONFIG_MORSE_RC
 static void morse_skbq_tx_status_fill(struct morse *mors,
 				      struct sk_buff *skb, struct morse_skb_tx_status *tx_sts)
@@ -1188,30 +1843,54 @@ static void morse_skbq_tx_status_fill(struct morse *mors,
 }
 #endif /* CONFIG_MORSE_RC */
 
-/* TX status/Response received remove packet from pending TX finish */
-static int __skbq_data_tx_finish(struct morse_skbq *mq, struct sk_buff *skb,
-				 struct morse_skb_tx_status *tx_sts)
+/* Remove a data packet from pending, ahead of reporting its TX status */
+static void __skbq_data_tx_unlink(struct morse_skbq *mq, struct sk_buff *skb)
 {
-	struct morse *mors = mq->mors;
-
-	if (morse_skbq_mon)
-		morse_skbq_mon_adjust(mors, skb, 0);
+	if (morse_skbq_mon) {
+		morse_skbq_mon_adjust(mq->mors, skb, 0);
+		if (ieee80211_is_data(((struct ieee80211_hdr *)skb->data)->frame_control))
+			morse_skbq_mon_sojourn(mq->mors, skb, MORSE_SKBQ_MON_HIST_AIR,
+					       morse_skbq_now_us() -
+					       __get_tx_status_driver_data(skb)->tx_sent);
+	}
 
 	__morse_skbq_unlink(mq, &mq->pending, skb);
+	__morse_skbq_bql_completed(mq, skb->len);
+	morse_pkt_lat_stamp(mq->mors, skb, MORSE_PKT_LAT_TX_STATUS);
+}
+
+/*
+ * Report the TX status of an unlinked data packet to mac80211. Called without the skbq lock.
+ * Rate control feedback may be held back in @rc_batch, which may be NULL.
+ */
+static void __skbq_data_tx_report(struct morse *mors, struct sk_buff *skb,
+				  struct morse_skb_tx_status *tx_sts,
+				  struct morse_rc_feedback_batch *rc_batch)
+{
+	morse_pkt_lat_finish(mors, skb, MORSE_PKT_LAT_TX_DONE);
 
 	/* Workaround Linux */
 	__skbq_qosnullfunc_to_nullfunc(skb);
 
 	morse_mac_process_tx_finish(mors, skb);
+	morse_mac_tx_airtime_report(mors, skb, tx_sts);
 
 	if (mors->hw->conf.flags & IEEE80211_CONF_MONITOR)
 		dev_kfree_skb(skb);
 	else
 #ifdef CONFIG_MORSE_RC
-		morse_rc_sta_feedback_rates(mors, skb, tx_sts);
+		morse_rc_sta_feedback_rates(mors, skb, tx_sts, rc_batch);
 #else
 		morse_skbq_tx_status_fill(mors, skb, tx_sts);
 #endif
+}
+
+/* TX status/Response received remove packet from pending TX finish */
+static int __skbq_data_tx_finish(struct morse_skbq *mq, struct sk_buff *skb,
+				 struct morse_skb_tx_status *tx_sts)
+{
+	__skbq_data_tx_unlink(mq, skb);
+	__skbq_data_tx_report(mq->mors, skb, tx_sts, NULL);
 
 	return 0;
 }
@@ -1235,6 +1914,7 @@ int morse_skbq_tx_flush(struct morse_skbq *mq)
 	int cnt = 0;
 
 	spin_lock_bh(&mq->lock);
+	morse_skbq_tx_collect(mq);
 
 	skb_queue_walk_safe(&mq->pending, pfirst, pnext) {
 		cnt++;
@@ -1253,26 +1933,72 @@ int morse_skbq_tx_flush(struct morse_skbq *mq)
 	return cnt;
 }
 
+int morse_skbq_tx_flush_queued(struct morse_skbq *mq)
+{
+	struct sk_buff *pfirst, *pnext;
+	int cnt = 0;
+
+	spin_lock_bh(&mq->lock);
+	morse_skbq_tx_collect(mq);
+
+	skb_queue_walk_safe(&mq->skbq, pfirst, pnext) {
+		cnt++;
+		__morse_skbq_unlink(mq, &mq->skbq, pfirst);
+		morse_flush_txskb(mq->mors, pfirst);
+	}
+
+	spin_unlock_bh(&mq->lock);
+
+	return cnt;
+}
+
 void morse_skbq_init(struct morse *mors, bool from_chip, struct morse_skbq *mq, u16 flags)
 {
 	spin_lock_init(&mq->lock);
 	__skb_queue_head_init(&mq->skbq);
 	__skb_queue_head_init(&mq->pending);
+	memset(mq->pending_index, 0, sizeof(mq->pending_index));
 	mq->mors = mors;
 	mq->skbq_size = 0;
 	mq->flags = flags;
 	mq->pkt_seq = 0;
+	mq->tx_inbox_enabled = false;
+	mq->tx_inbox = NULL;
+	atomic_set(&mq->tx_inbox_len, 0);
+	atomic_set(&mq->tx_inbox_size, 0);
+	memset(&mq->bql, 0, sizeof(mq->bql));
+	memset(&mq->aqm, 0, sizeof(mq->aqm));
 	if (from_chip)
 		INIT_WORK(&mq->dispatch_work, morse_skbq_dispatch_work);
 }
 
+void morse_skbq_enable_tx_inbox(struct morse_skbq *mq)
+{
+	mq->tx_inbox_enabled = true;
+}
+
+void morse_skbq_enable_bql(struct morse_skbq *mq)
+{
+	mq->bql.limit = MORSE_SKBQ_BQL_MIN_LIMIT;
+	mq->bql.interval_start = jiffies;
+	mq->bql.enabled = true;
+}
+
+void morse_skbq_enable_aqm(struct morse_skbq *mq)
+{
+	mq->aqm.enabled = true;
+}
+
 void morse_skbq_finish(struct morse_skbq *mq)
 {
-	if (mq->skbq_size > 0)
+	if (__morse_skbq_size(mq) > 0)
 		MORSE_SKB_INFO(mq->mors, "Purging a non empty MorseQ. Dropping data!");
 
 	/* Clean up link to chip_if */
 	mq->mors->cfg->ops->skbq_close(mq);
+	spin_lock_bh(&mq->lock);
+	morse_skbq_tx_collect(mq);
+	spin_unlock_bh(&mq->lock);
 	morse_skbq_purge(mq, &mq->skbq);
 	morse_skbq_purge(mq, &mq->pending);
 	mq->skbq_size = 0;
@@ -1293,7 +2019,7 @@ u32 morse_skbq_count(struct morse_skbq *mq)
 	u32 count = 0;
 
 	spin_lock_bh(&mq->lock);
-	count += mq->skbq.qlen;
+	count += __morse_skbq_qlen(mq);
 	spin_unlock_bh(&mq->lock);
 	return count;
 }
@@ -1339,6 +2065,106 @@ static void morse_skb_header_put(const struct morse_buff_skb_header *hdr, u8 *bu
 	buf_hdr->len = cpu_to_le16(buf_hdr->len);
 }
 
+void morse_skb_cache_init(struct morse *mors)
+{
+	skb_queue_head_init(&mors->skb_cache.free);
+}
+
+void morse_skb_cache_finish(struct morse *mors)
+{
+	skb_queue_purge(&mors->skb_cache.free);
+}
+
+struct sk_buff *morse_skb_cache_alloc(struct morse *mors, unsigned int len)
+{
+	struct sk_buff *skb;
+
+	if (!skb_cache_depth || len > MORSE_SKB_CACHE_BUF_LEN)
+		return dev_alloc_skb(len);
+
+	skb = skb_dequeue(&mors->skb_cache.free);
+	if (skb) {
+		MORSE_PAGE_STAT_INC(mors, skb_cache_hit);
+		return skb;
+	}
+
+	MORSE_PAGE_STAT_INC(mors, skb_cache_miss);
+	return dev_alloc_skb(MORSE_SKB_CACHE_BUF_LEN);
+}
+
+int morse_skb_rx_tailroom(const void *pkt, int len)
+{
+	const struct morse_buff_skb_header *hdr = pkt;
+	const struct ieee80211_hdr *mac_hdr;
+
+	if (len < sizeof(*hdr) ||
+	    sizeof(*hdr) + hdr->offset + sizeof(mac_hdr->frame_control) > len)
+		return 0;
+
+	if (hdr->channel != MORSE_SKB_CHAN_DATA && hdr->channel != MORSE_SKB_CHAN_MGMT &&
+	    hdr->channel != MORSE_SKB_CHAN_BEACON)
+		return 0;
+
+	mac_hdr = (const struct ieee80211_hdr *)((const u8 *)pkt + sizeof(*hdr) + hdr->offset);
+	if (!ieee80211_is_mgmt(mac_hdr->frame_control) &&
+	    !ieee80211_is_s1g_beacon(mac_hdr->frame_control))
+		return 0;
+
+	return MORSE_SKB_RX_TAILROOM;
+}
+
+/* Return an skb to the state dev_alloc_skb() left it in, if it is one we can safely reuse */
+static bool morse_skb_cache_reset(struct sk_buff *skb)
+{
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	unsigned int room = skb_end_offset(skb) - NET_SKB_PAD;
+
+	if (skb_shared(skb) || skb_cloned(skb) || skb_is_nonlinear(skb) ||
+	    skb->sk || skb->destructor || skb_dst(skb))
+		return false;
+
+	/* Don't hold on to (much) larger buffers than were asked for */
+	if (skb_end_offset(skb) < NET_SKB_PAD || room < MORSE_SKB_CACHE_BUF_LEN ||
+	    room > 2 * MORSE_SKB_CACHE_BUF_LEN)
+		return false;
+
+	skb->data = skb->head + NET_SKB_PAD;
+	skb->len = 0;
+	skb_reset_tail_pointer(skb);
+	skb->mac_header = (typeof(skb->mac_header))~0U;
+	skb->transport_header = (typeof(skb->transport_header))~0U;
+	skb_reset_network_header(skb);
+	memset(skb->cb, 0, sizeof(skb->cb));
+	skb->dev = NULL;
+	skb->protocol = 0;
+	skb->priority = 0;
+	skb->mark = 0;
+	skb->pkt_type = PACKET_HOST;
+	skb->ip_summed = CHECKSUM_NONE;
+	skb->tstamp = ktime_set(0, 0);
+	skb_clear_hash(skb);
+	skb_set_queue_mapping(skb, 0);
+
+	shinfo->tx_flags = 0;
+	shinfo->gso_size = 0;
+	shinfo->gso_segs = 0;
+	shinfo->gso_type = 0;
+	memset(skb_hwtstamps(skb), 0, sizeof(*skb_hwtstamps(skb)));
+
+	return true;
+}
+
+void morse_skb_cache_free(struct morse *mors, struct sk_buff *skb)
+{
+	if (skb_queue_len(&mors->skb_cache.free) < skb_cache_depth &&
+	    morse_skb_cache_reset(skb)) {
+		skb_queue_tail(&mors->skb_cache.free, skb);
+		return;
+	}
+
+	dev_kfree_skb_any(skb);
+}
+
 struct sk_buff *morse_skbq_alloc_skb(struct morse_skbq *mq, unsigned int length)
 {
 	size_t offset = (length & 0x03) ? (4 - (unsigned long)(length & 3)) : 0;
@@ -1347,7 +2173,11 @@ struct sk_buff *morse_skbq_alloc_skb(struct morse_skbq *mq, unsigned int length)
 	int skb_len = tx_headroom + length + offset;
 	struct sk_buff *skb;
 
-	skb = dev_alloc_skb(skb_len);
+	/* Commands are freed by the driver once the response arrives */
+	if (mq->flags & MORSE_CHIP_IF_FLAGS_COMMAND)
+		skb = morse_skb_cache_alloc(mq->mors, skb_len);
+	else
+		skb = dev_alloc_skb(skb_len);
 	if (!skb)
 		return NULL;
 	skb_reserve(skb, tx_headroom);
@@ -1355,47 +2185,14 @@ struct sk_buff *morse_skbq_alloc_skb(struct morse_skbq *mq, unsigned int length)
 	return skb;
 }
 
-int morse_skbq_skb_tx(struct morse_skbq *mq, struct sk_buff **skb_orig,
-		      struct morse_skb_tx_info *tx_info, u8 channel)
+int morse_skbq_skb_push_header(struct morse *mors, struct sk_buff *skb,
+			       struct morse_skb_tx_info *tx_info, u8 channel)
 {
 	struct morse_buff_skb_header hdr;
-	struct morse *mors;
 	size_t offset;
-	struct sk_buff *skb = *skb_orig;
-	int ret = 0;
 	u8 *aligned_head;
 	u8 *data;
 
-	WARN_ON(!mq);
-
-	if (!skb)
-		return -EINVAL;
-
-	mors = mq->mors;
-
-	if (test_bit(MORSE_STATE_FLAG_CHIP_UNRESPONSIVE, &mors->state_flags)) {
-		dev_kfree_skb_any(skb);
-		return -ENODEV;
-	}
-
-	if (channel == MORSE_SKB_CHAN_COMMAND) {
-		if (test_bit(MORSE_STATE_FLAG_HOST_TO_CHIP_CMD_BLOCKED, &mors->state_flags)) {
-			dev_kfree_skb_any(skb);
-			return -EPERM;
-		}
-	} else {
-		/* All other channels that go through morse_skbq_skb_tx are for TX */
-		if (test_bit(MORSE_STATE_FLAG_HOST_TO_CHIP_TX_BLOCKED, &mors->state_flags)) {
-			dev_kfree_skb_any(skb);
-			return -EPERM;
-		}
-	}
-
-	set_queued_tx_skb_expiry(skb);
-
-	if (morse_skbq_mon)
-		morse_skbq_mon_adjust(mors, skb, 1);
-
 	data = skb->data;
 	aligned_head = align_down((data - sizeof(hdr) - mors->extra_tx_offset),
 				  mors->bus_ops->bulk_alignment);
@@ -1417,35 +2214,223 @@ int morse_skbq_skb_tx(struct morse_skbq *mq, struct sk_buff **skb_orig,
 
 	/* Align size to words */
 	if (offset && offset > skb_tailroom(skb)) {
-		/* TODO allocate new skb */
-		struct sk_buff *tmp;
-
-		MORSE_SKB_INFO(mors, "%s Unaligned SKB with not enough tailroom extending\n",
-			       __func__);
-		tmp = skb_copy_expand(skb, skb_headroom(skb),
-				      offset + skb_tailroom(skb), GFP_ATOMIC);
-		if (!tmp) {
+		/* Slow path, the tailroom requested from mac80211 is normally enough. Expand in
+		 * place so the skb (and its control buffer) is kept.
+		 */
+		MORSE_PAGE_STAT_INC(mors, tx_tailroom_expand);
+		MORSE_SKB_DBG(mors, "%s Unaligned SKB with not enough tailroom extending\n",
+			      __func__);
+		if (pskb_expand_head(skb, 0, offset, GFP_ATOMIC)) {
 			MORSE_SKB_ERR(mors,
 				      "%s Unaligned SKB with not enough tailroom to extend\n",
 				      __func__);
 			dev_kfree_skb_any(skb);
 			return -EINVAL;
 		}
-		dev_kfree_skb_any(skb);
-		skb = tmp;
-		*skb_orig = skb;
 	}
 
 	skb_put(skb, offset);
 
+	return 0;
+}
+
+/* Push the bus header and pad @skb for sending. Frees @skb on failure. */
+static int morse_skbq_skb_tx_prep(struct morse_skbq *mq, struct sk_buff *skb,
+				  struct morse_skb_tx_info *tx_info, u8 channel)
+{
+	struct morse *mors = mq->mors;
+
+	if (test_bit(MORSE_STATE_FLAG_CHIP_UNRESPONSIVE, &mors->state_flags)) {
+		dev_kfree_skb_any(skb);
+		return -ENODEV;
+	}
+
+	if (channel == MORSE_SKB_CHAN_COMMAND) {
+		if (test_bit(MORSE_STATE_FLAG_HOST_TO_CHIP_CMD_BLOCKED, &mors->state_flags)) {
+			dev_kfree_skb_any(skb);
+			return -EPERM;
+		}
+	} else {
+		/* All other channels that go through morse_skbq_skb_tx are for TX */
+		if (test_bit(MORSE_STATE_FLAG_HOST_TO_CHIP_TX_BLOCKED, &mors->state_flags)) {
+			dev_kfree_skb_any(skb);
+			return -EPERM;
+		}
+	}
+
+	set_queued_tx_skb_expiry(skb);
+
+	if (morse_skbq_mon)
+		morse_skbq_mon_adjust(mors, skb, 1);
+
+	return morse_skbq_skb_push_header(mors, skb, tx_info, channel);
+}
+
+int morse_skbq_skb_tx(struct morse_skbq *mq, struct sk_buff **skb_orig,
+		      struct morse_skb_tx_info *tx_info, u8 channel)
+{
+	struct sk_buff *skb = *skb_orig;
+	int ret;
+
+	WARN_ON(!mq);
+
+	if (!skb)
+		return -EINVAL;
+
+	ret = morse_skbq_skb_tx_prep(mq, skb, tx_info, channel);
+	if (ret)
+		return ret;
+
 	ret = morse_skbq_tx(mq, skb, channel);
 	if (ret) {
-		MORSE_SKB_ERR(mors, "morse_skbq_tx fail: %d\n", ret);
+		MORSE_SKB_ERR(mq->mors, "morse_skbq_tx fail: %d\n", ret);
 		dev_kfree_skb_any(skb);
 	}
 	return ret;
 }
 
+int morse_skbq_cmd_tx_batch(struct morse_skbq *mq, struct sk_buff **skbs, int num)
+{
+	struct morse *mors = mq->mors;
+	int ret = 0;
+	int queued = 0;
+	int rc;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (!skbs[i])
+			continue;
+
+		rc = morse_skbq_skb_tx_prep(mq, skbs[i], NULL, MORSE_SKB_CHAN_COMMAND);
+		if (rc) {
+			skbs[i] = NULL;
+			ret = rc;
+		}
+	}
+
+	/* Queue everything before the chip interface is kicked, so it is sent in one pass */
+	spin_lock_bh(&mq->lock);
+	for (i = 0; i < num; i++) {
+		if (!skbs[i])
+			continue;
+
+		rc = __morse_skbq_put(mq, &mq->skbq, skbs[i], false, NULL);
+		if (rc) {
+			MORSE_SKB_ERR(mors, "skb put chan %d failed (%d)\n",
+				      MORSE_SKB_CHAN_COMMAND, rc);
+			/* Safe under the lock, the skb was never queued */
+			dev_kfree_skb_any(skbs[i]);
+			skbs[i] = NULL;
+			ret = rc;
+			continue;
+		}
+
+		__morse_skbq_pkt_id(mq, skbs[i]);
+		queued++;
+	}
+	spin_unlock_bh(&mq->lock);
+
+	if (queued)
+		morse_skbq_tx_kick(mors, MORSE_SKB_CHAN_COMMAND);
+
+	return ret;
+}
+
+void morse_skbq_tx_batch_init(struct morse_skbq_tx_batch *batch, u8 channel)
+{
+	batch->mq = NULL;
+	batch->room = 0;
+	batch->channel = channel;
+	__skb_queue_head_init(&batch->skbs);
+}
+
+void morse_skbq_tx_batch_flush(struct morse_skbq_tx_batch *batch)
+{
+	struct morse_skbq *mq = batch->mq;
+	struct morse *mors;
+	struct sk_buff *skb;
+	bool mq_over_threshold;
+	int queued = 0;
+	int rc;
+
+	if (skb_queue_empty(&batch->skbs))
+		return;
+
+	mors = mq->mors;
+
+	if (mq->tx_inbox_enabled) {
+		/* The inbox is already lock free, frames go in one at a time */
+		while ((skb = __skb_dequeue(&batch->skbs))) {
+			if (morse_skbq_tx(mq, skb, batch->channel))
+				dev_kfree_skb_any(skb);
+		}
+		return;
+	}
+
+	spin_lock_bh(&mq->lock);
+	while ((skb = __skb_dequeue(&batch->skbs))) {
+		rc = __morse_skbq_put(mq, &mq->skbq, skb, false, NULL);
+		if (rc) {
+			MORSE_SKB_ERR(mors, "skb put chan %d failed (%d)\n", batch->channel, rc);
+			/* Safe under the lock, the skb was never queued */
+			dev_kfree_skb_any(skb);
+			continue;
+		}
+
+		__morse_skbq_pkt_id(mq, skb);
+#ifdef CONFIG_MORSE_IPMON
+		if (batch->channel == MORSE_SKB_CHAN_DATA)
+			morse_skbq_tx_ipmon(mors, skb);
+#endif
+		queued++;
+	}
+	mq_over_threshold = __morse_skbq_over_threshold(mq);
+	spin_unlock_bh(&mq->lock);
+
+	if (batch->channel != MORSE_SKB_CHAN_DATA) {
+		if (queued)
+			morse_skbq_tx_kick(mors, batch->channel);
+		return;
+	}
+
+	if (mq_over_threshold) {
+		WRITE_ONCE(mq->bql.throttled, true);
+		morse_skbq_stop_tx_queues(mors);
+	}
+
+	if (queued && !READ_ONCE(mors->txq_defer_data_kick))
+		morse_skbq_tx_kick(mors, MORSE_SKB_CHAN_DATA);
+}
+
+int morse_skbq_skb_tx_batched(struct morse_skbq *mq, struct sk_buff *skb,
+			      struct morse_skb_tx_info *tx_info, struct morse_skbq_tx_batch *batch)
+{
+	int ret;
+
+	if (!batch)
+		return morse_skbq_skb_tx(mq, &skb, tx_info, MORSE_SKB_CHAN_DATA);
+
+	if (batch->mq != mq) {
+		morse_skbq_tx_batch_flush(batch);
+		batch->mq = mq;
+		batch->room = morse_skbq_space(mq);
+	}
+
+	ret = morse_skbq_skb_tx_prep(mq, skb, tx_info, batch->channel);
+	if (ret)
+		return ret;
+
+	/* Queue what is held so far rather than let the batch overrun the skbq */
+	if (skb->len > batch->room) {
+		morse_skbq_tx_batch_flush(batch);
+		batch->room = morse_skbq_space(mq);
+	}
+
+	batch->room -= min(skb->len, batch->room);
+	__skb_queue_tail(&batch->skbs, skb);
+	return 0;
+}
+
 void morse_skbq_data_traffic_pause(struct morse *mors)
 {
 	set_bit(MORSE_STATE_FLAG_DATA_TX_STOPPED, &mors->state_flags);
@@ -1463,15 +2448,58 @@ void morse_skbq_data_traffic_resume(struct morse *mors)
 	set_bit(MORSE_TX_DATA_PEND, &mors->chip_if->event_flags);
 }
 
+/*
+ * XOR of the @words 32-bit words at @data. XOR is associative, so it is summed in independent
+ * lanes (64-bit where the buffer allows) and folded at the end.
+ */
+static u32 morse_skb_checksum_xor(const u8 *data, unsigned int words)
+{
+	const u32 *data32;
+	u32 xor = 0;
+
+#ifdef CONFIG_64BIT
+	if (IS_ALIGNED((unsigned long)data, sizeof(u64))) {
+		const u64 *data64 = (const u64 *)data;
+		u64 x0 = 0, x1 = 0, x2 = 0, x3 = 0;
+		unsigned int dwords = words / 2;
+
+		for (; dwords >= 4; dwords -= 4, data64 += 4) {
+			x0 ^= data64[0];
+			x1 ^= data64[1];
+			x2 ^= data64[2];
+			x3 ^= data64[3];
+		}
+		for (; dwords; dwords--)
+			x0 ^= *data64++;
+
+		x0 ^= x1 ^ x2 ^ x3;
+		xor = (u32)x0 ^ (u32)(x0 >> 32);
+		data = (const u8 *)data64;
+		words &= 1;
+	}
+#endif
+
+	data32 = (const u32 *)data;
+	for (; words >= 4; words -= 4, data32 += 4)
+		xor ^= data32[0] ^ data32[1] ^ data32[2] ^ data32[3];
+	for (; words; words--)
+		xor ^= *data32++;
+
+	return xor;
+}
+
 bool morse_validate_skb_checksum(u8 *data)
 {
 	struct morse_buff_skb_header *skb_hdr = (struct morse_buff_skb_header *)data;
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)(data + sizeof(*skb_hdr));
 	u16 len = le16_to_cpu(skb_hdr->len) + sizeof(*skb_hdr);
-	u32 *data_to_xor = (u32 *)data;
 	u32 header_xor = (le16_to_cpu(skb_hdr->checksum_upper) << 8) | (skb_hdr->checksum_lower);
-	u32 xor = 0;
-	int i;
+	u32 xor;
+
+	/* Frame channels can opt out of validation (e.g. heavy monitor or management RX) */
+	if (skb_hdr->channel <= MORSE_SKB_CHAN_WIPHY &&
+	    (rx_checksum_skip_chans & BIT(skb_hdr->channel)))
+		return true;
 
 	/*
 	 * For data frames the calculate the xor for skb header, mac header and ccmp header. For all
@@ -1491,10 +2519,7 @@ bool morse_validate_skb_checksum(u8 *data)
 	skb_hdr->checksum_upper = 0;
 	skb_hdr->checksum_lower = 0;
 
-	for (i = 0; i < len; i += 4) {
-		xor ^= *data_to_xor;
-		data_to_xor++;
-	}
+	xor = morse_skb_checksum_xor(data, DIV_ROUND_UP(len, 4));
 	xor = xor & 0x00FFFFFF;
 
 	return xor == header_xor;
@@ -17,6 +17,23 @@
 #define MORSE_SKBQ_SIZE			(4 * 128 * 1024)
 #endif
 
+/* Buffer size of skbs kept in the host-interface skb cache */
+#ifndef MORSE_SKB_CACHE_BUF_LEN
+#define MORSE_SKB_CACHE_BUF_LEN		2048
+#endif
+
+/* Tailroom reserved on received management frames so that the S1G to 11n translation, which
+ * adds the legacy beacon fields and HT/VHT elements, can usually rewrite them in place.
+ */
+#ifndef MORSE_SKB_RX_TAILROOM
+#define MORSE_SKB_RX_TAILROOM		512
+#endif
+
+/* Number of pending frames indexed by packet ID. Must be a power of 2 */
+#ifndef MORSE_SKBQ_PENDING_INDEX_SIZE
+#define MORSE_SKBQ_PENDING_INDEX_SIZE	256
+#endif
+
 struct morse;
 
 struct morse_skbq {
@@ -27,7 +44,51 @@ struct morse_skbq {
 	struct morse *mors;	/* mainly for debugging */
 	struct sk_buff_head skbq;
 	struct sk_buff_head pending;	/* packets sent pending feedback */
+	/* Pending packets indexed by the low bits of their packet ID, for tx_status lookup */
+	struct sk_buff *pending_index[MORSE_SKBQ_PENDING_INDEX_SIZE];
 	struct work_struct dispatch_work;
+	/*
+	 * Lock-free TX inbox (see morse_skbq_enable_tx_inbox()). Producers push onto a singly
+	 * linked LIFO of skbs without taking the lock; the consumer moves the whole inbox onto
+	 * skbq under the lock in morse_skbq_tx_collect().
+	 */
+	bool tx_inbox_enabled;
+	struct sk_buff *tx_inbox;
+	atomic_t tx_inbox_len;
+	atomic_t tx_inbox_size;
+	/*
+	 * Dynamic byte limit on queued TX data (see morse_skbq_enable_bql()), re-evaluated each
+	 * interval from the bytes completed by tx_status. Protected by the lock.
+	 */
+	struct {
+		bool enabled;
+		bool throttled;		/* went over the limit this interval */
+		bool starved;		/* drained empty to the chip this interval */
+		u32 limit;		/* bytes */
+		u32 completed;		/* bytes completed this interval */
+		unsigned long interval_start;	/* jiffies */
+	} bql;
+	/*
+	 * CoDel state of the optional sojourn time AQM (see morse_skbq_enable_aqm()). Times are
+	 * from morse_skbq_now_us(). Protected by the lock.
+	 */
+	struct {
+		bool enabled;
+		bool dropping;		/* in the dropping state */
+		bool above_target;	/* first_above is valid */
+		u32 first_above;	/* when the sojourn time will have been above target */
+		u32 drop_next;		/* next drop while dropping */
+		u32 count;		/* drops in this dropping state */
+		u32 lastcount;		/* count at the start of this dropping state */
+	} aqm;
+};
+
+/**
+ * Cache of host-interface skbs (commands, responses, tx_status, loopback) that the driver
+ * allocates and consumes itself, so they can be recycled rather than freed.
+ */
+struct morse_skb_cache {
+	struct sk_buff_head free;
 };
 
 /**
@@ -47,6 +108,82 @@ int morse_skbq_deq_num_items(struct morse_skbq *mq, struct sk_buff_head *skbq, i
 struct sk_buff *morse_skbq_alloc_skb(struct morse_skbq *mq, unsigned int length);
 int morse_skbq_skb_tx(struct morse_skbq *mq, struct sk_buff **skb,
 		      struct morse_skb_tx_info *tx_info, u8 channel);
+
+/**
+ * morse_skbq_skb_push_header() - Push the bus header and pad an skb for sending
+ *
+ * @mors The Morse chip instance.
+ * @skb The frame, freed on failure.
+ * @tx_info TX parameters to carry in the header, or NULL.
+ * @channel The bus channel the frame is for.
+ *
+ * Only builds the frame the bus writes out, it is not queued.
+ *
+ * Return: 0 on success, otherwise a negative error code
+ */
+int morse_skbq_skb_push_header(struct morse *mors, struct sk_buff *skb,
+			       struct morse_skb_tx_info *tx_info, u8 channel);
+
+/**
+ * morse_skbq_cmd_tx_batch() - Queue several command skbs to be sent in one pass
+ *
+ * @mq The command SKBQ.
+ * @skbs The command skbs, NULL entries are skipped. Entries that could not be queued are
+ *       freed and set to NULL.
+ * @num Number of entries in @skbs.
+ *
+ * The chip interface is kicked once, after all the commands are queued.
+ *
+ * Return: 0 if all were queued, otherwise the last error
+ */
+int morse_skbq_cmd_tx_batch(struct morse_skbq *mq, struct sk_buff **skbs, int num);
+
+/**
+ * struct morse_skbq_tx_batch - Data frames collected to be queued together
+ *
+ * @mq: The data SKBQ the frames are for, NULL until the first frame.
+ * @room: Space left in @mq when the batch started, less the frames held.
+ * @channel: The bus channel of the frames, MORSE_SKB_CHAN_DATA or MORSE_SKB_CHAN_WIPHY.
+ * @skbs: Frames with their bus header pushed, not yet queued.
+ */
+struct morse_skbq_tx_batch {
+	struct morse_skbq *mq;
+	u32 room;
+	u8 channel;
+	struct sk_buff_head skbs;
+};
+
+/**
+ * morse_skbq_tx_batch_init() - Start an empty data TX batch
+ *
+ * @batch The batch.
+ * @channel The bus channel the batch is for, MORSE_SKB_CHAN_DATA or MORSE_SKB_CHAN_WIPHY.
+ */
+void morse_skbq_tx_batch_init(struct morse_skbq_tx_batch *batch, u8 channel);
+
+/**
+ * morse_skbq_skb_tx_batched() - Prepare a data frame and add it to a batch
+ *
+ * @mq The data SKBQ to send on. A batch for another SKBQ is flushed first.
+ * @skb The frame, freed on failure.
+ * @tx_info TX parameters to carry in the header.
+ * @batch The batch, or NULL to queue the frame straight away on the data channel with
+ *        morse_skbq_skb_tx().
+ *
+ * Return: 0 on success, otherwise a negative error code
+ */
+int morse_skbq_skb_tx_batched(struct morse_skbq *mq, struct sk_buff *skb,
+			      struct morse_skb_tx_info *tx_info, struct morse_skbq_tx_batch *batch);
+
+/**
+ * morse_skbq_tx_batch_flush() - Queue every frame in a batch
+ *
+ * @batch The batch, empty on return.
+ *
+ * Takes the SKBQ lock and checks the queue threshold once for the whole batch, then kicks the
+ * chip interface once.
+ */
+void morse_skbq_tx_batch_flush(struct morse_skbq_tx_batch *batch);
 int morse_skbq_put(struct morse_skbq *mq, struct sk_buff *skb);
 int morse_skbq_enq(struct morse_skbq *mq, struct sk_buff_head *skbq);
 int morse_skbq_enq_prepend(struct morse_skbq *mq, struct sk_buff_head *skbq);
@@ -54,11 +191,126 @@ int morse_skbq_tx_complete(struct morse_skbq *mq, struct sk_buff_head *skbq);
 struct sk_buff *morse_skbq_tx_pending(struct morse_skbq *mq);
 void morse_skbq_show(const struct morse_skbq *mq, struct seq_file *file);
 void morse_skbq_init(struct morse *mors, bool from_chip, struct morse_skbq *mq, u16 flags);
+
+/**
+ * morse_skbq_enable_tx_inbox() - Queue TX packets on the lock-free inbox.
+ *
+ * Once enabled, morse_skbq_skb_tx() no longer takes mq->lock. Only suitable for TX queues
+ * drained by a single consumer (the chip_if worker). Must be called before the queue is used.
+ *
+ * @mq: SKB queue
+ */
+void morse_skbq_enable_tx_inbox(struct morse_skbq *mq);
+
+/**
+ * morse_skbq_enable_bql() - Gate TX queue stop/wake on a dynamic byte limit.
+ *
+ * Instead of the static max_txq_len / MORSE_SKBQ_SIZE thresholds, the queue is allowed to hold
+ * the bytes the air interface is observed to complete in tx_queue_target_ms. Only meaningful
+ * for data TX queues. Must be called before the queue is used.
+ *
+ * @mq: SKB queue
+ */
+void morse_skbq_enable_bql(struct morse_skbq *mq);
+
+/**
+ * morse_skbq_enable_aqm() - Apply CoDel style active queue management to the queue.
+ *
+ * When tx_aqm_target_ms is set, frames are dropped from the head of the queue as they are taken
+ * for the chip while the queue sojourn time has stayed above that target for a whole
+ * tx_aqm_interval_ms. Only meaningful for data TX queues. Must be called before the queue is
+ * used.
+ *
+ * @mq: SKB queue
+ */
+void morse_skbq_enable_aqm(struct morse_skbq *mq);
+
+/**
+ * morse_skbq_tx_collect() - Move packets from the TX inbox onto mq->skbq.
+ *
+ * Packet IDs are assigned here so they stay in queue order. Callers that look at mq->skbq
+ * directly must call this first.
+ *
+ * @note The MQ lock (mq->lock) must be held by the caller.
+ *
+ * @mq: SKB queue
+ */
+void morse_skbq_tx_collect(struct morse_skbq *mq);
 void morse_skbq_finish(struct morse_skbq *mq);
 void morse_skb_remove_hdr_after_sent_to_chip(struct sk_buff *skb);
 
 void morse_skbq_mon_dump(struct morse *mors, struct seq_file *file);
 
+/** SKB queue monitor entries: up to 8 source/destination pairs, then multicast and total */
+#define MORSE_SKBQ_MON_MAX_STATS	(10)
+
+/** Kind of a &struct morse_skbq_mon_stats entry */
+enum morse_skbq_mon_type {
+	MORSE_SKBQ_MON_TYPE_STA,
+	MORSE_SKBQ_MON_TYPE_MCAST,
+	MORSE_SKBQ_MON_TYPE_ALL,
+};
+
+/** Folded counters of one SKB queue monitor entry */
+struct morse_skbq_mon_stats {
+	enum morse_skbq_mon_type type;
+	/* Source and destination, for MORSE_SKBQ_MON_TYPE_STA only */
+	u8 sa[ETH_ALEN];
+	u8 da[ETH_ALEN];
+	u32 tot_sent;
+	u32 qsize_cur;
+	u32 qsize_max;
+};
+
+/**
+ * morse_skbq_mon_read() - Read the SKB queue monitor table without clearing it.
+ *
+ * @stats: Filled with the station entries, then the multicast and total entries
+ * @max_stats: Size of @stats
+ *
+ * Return: Number of entries filled, 0 if monitoring has not been initialised from debugfs
+ */
+int morse_skbq_mon_read(struct morse_skbq_mon_stats *stats, int max_stats);
+
+void morse_skb_cache_init(struct morse *mors);
+void morse_skb_cache_finish(struct morse *mors);
+
+/**
+ * morse_skb_cache_alloc() - Allocate a host-interface skb, reusing a cached one if possible.
+ *
+ * Requests up to MORSE_SKB_CACHE_BUF_LEN are rounded up to that size so the skb can be
+ * recycled by morse_skb_cache_free(). Only use this for skbs the driver will free itself.
+ *
+ * @mors: Morse chip struct
+ * @len: Data length required
+ *
+ * Return: skb with @len bytes of tailroom and the default headroom, or NULL
+ */
+struct sk_buff *morse_skb_cache_alloc(struct morse *mors, unsigned int len);
+
+/**
+ * morse_skb_rx_tailroom() - Tailroom to reserve for a received packet before it is copied.
+ *
+ * @pkt: Start of the packet, including its &struct morse_buff_skb_header
+ * @len: Bytes of @pkt available to inspect
+ *
+ * Return: MORSE_SKB_RX_TAILROOM for 802.11 management and S1G beacon frames, which grow when
+ * translated to 11n, otherwise 0
+ */
+int morse_skb_rx_tailroom(const void *pkt, int len);
+
+/**
+ * morse_skb_cache_free() - Free an skb, keeping it in the cache if it can be reused.
+ *
+ * Safe from any context. Falls back to dev_kfree_skb_any() for skbs that are shared, cloned,
+ * non-linear, owned by a socket or the wrong size, or when the cache is full. Only pass skbs the
+ * driver allocated itself, never ones that came from mac80211.
+ *
+ * @mors: Morse chip struct
+ * @skb: skb to free
+ */
+void morse_skb_cache_free(struct morse *mors, struct sk_buff *skb);
+
 /**
  * @brief Set the max SKB TX queue length.
  *
@@ -93,16 +345,28 @@ int morse_skbq_skb_finish(struct morse_skbq *mq, struct sk_buff *skb,
 int morse_skbq_tx_flush(struct morse_skbq *mq);
 
 /**
- * @brief For each pending SKB in the given SKBQ, check if its
- *        tx_status_lifetime has been reached. If so, remove it from the
- *        pending queue and free appropriately.
+ * @brief Flush tx SKBs which have not yet been given to the chip. SKBs the
+ *        chip holds stay pending for their tx_status, or the stale timeout.
  *
- * @param mors  Morse context
- * @param mq    SKB queue
+ * @param mq SKB queue
+ *
+ * @return number of elements flushed from the queue
+ */
+int morse_skbq_tx_flush_queued(struct morse_skbq *mq);
+
+/**
+ * @brief Remove pending SKBs of the given SKBQ whose tx_status_lifetime has
+ *        been reached, and free appropriately. The pending list is in send
+ *        order, so only the expired SKBs at its head are touched.
+ *
+ * @param mors    Morse context
+ * @param mq      SKB queue
+ * @param next_us Lowered to the microseconds until the oldest SKB left
+ *                pending times out, if that is sooner
  *
  * @return number of pending tx statuses that got removed
  */
-int morse_skbq_check_for_stale_tx(struct morse *mors, struct morse_skbq *mq);
+int morse_skbq_check_for_stale_tx(struct morse *mors, struct morse_skbq *mq, u32 *next_us);
 
 /**
  * @brief Stop the mac80211 TX data Qs.
@@ -163,6 +427,14 @@ void morse_skbq_data_traffic_pause(struct morse *mors);
  */
 void morse_skbq_data_traffic_resume(struct morse *mors);
 
+/**
+ * @brief Tell the chip interface there is data to send. Used to kick once after a batch of
+ *        data frames were queued with the per-frame kick deferred.
+ *
+ * @param mors Morse context
+ */
+void morse_skbq_data_tx_kick(struct morse *mors);
+
 /**
  * @brief Verify checksum for the SKB to catch SDIO bus read errors.
  *
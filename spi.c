@@ -14,6 +14,14 @@
 #include <linux/crc-itu-t.h>
 #include <linux/spi/spi.h>
 #include <linux/gpio.h>
+#include <linux/completion.h>
+#include <linux/random.h>
+#include <linux/version.h>
+#if KERNEL_VERSION(4, 11, 0) <= LINUX_VERSION_CODE
+#include <linux/sched/task_stack.h>
+#else
+#include <linux/sched.h>
+#endif
 
 #include "morse.h"
 #include "debug.h"
@@ -32,19 +40,49 @@
 #define MORSE_SPI_WARN(_m, _f, _a...)		morse_warn(FEATURE_ID_SPI, _m, _f, ##_a)
 #define MORSE_SPI_ERR(_m, _f, _a...)		morse_err(FEATURE_ID_SPI, _m, _f, ##_a)
 
+/** Number of transfer buffers, so one CMD53 can be prepared or checked while another is sent */
+#define MORSE_SPI_NUM_XBUFS		(2)
+/** Most blocks in one CMD53 transaction (SPI_MAX_TRANSACTION_SIZE / MMC_SPI_BLOCKSIZE) */
+#define MORSE_SPI_XBUF_MAX_BLOCKS	(16)
+/** A zero-copy block write alternates buffer and caller data transfers */
+#define MORSE_SPI_XBUF_MAX_XFERS	(2 * MORSE_SPI_XBUF_MAX_BLOCKS + 2)
+
+/**
+ * struct morse_spi_xbuf - A command/response buffer with its SPI message
+ *
+ * The buffer is allocated once at probe (DMA-safe) and mirrors the whole SPI stream of a
+ * transaction, so responses, tokens and acks are found at the same offsets whether or not
+ * the data phase was sent from the caller's buffer.
+ */
+struct morse_spi_xbuf {
+	u8 *data;
+	struct spi_transfer t[MORSE_SPI_XBUF_MAX_XFERS];
+	int num_t;
+	struct spi_message m;
+	struct completion done;
+
+	/* The CMD53 prepared in this buffer */
+	u8 *host_data;
+	u8 *resp;
+	u8 *ack;
+	u8 *end;
+	u32 address;
+	u16 count;
+	u8 fn;
+	bool block;
+};
+
 struct morse_spi {
 	bool enabled;
 	u32 bulk_addr_base;
 	u32 register_addr_base;
 	struct spi_device *spi;
 
-	/* Memory for command/response transfers */
+	/* Memory for command/response and bulk data transfers */
+	struct morse_spi_xbuf xbuf[MORSE_SPI_NUM_XBUFS];
+	/* Command buffer, the first transfer buffer */
 	u8 *data;
 
-	/* for bulk data transfers */
-	struct spi_transfer t;
-	struct spi_message m;
-
 	/* protects concurrent access */
 	struct mutex lock;
 
@@ -53,6 +91,8 @@ struct morse_spi {
 
 	/* Num of bytes to insert between reads and writes, depending on frequency */
 	u16 inter_block_delay_bytes;
+	/* Estimate of the chip's read latency in bytes, from observed token gaps */
+	u16 rx_delay_est_bytes;
 	/* Maximum number of blks to write per SPI transaction */
 	u8 max_block_count;
 };
@@ -146,6 +186,8 @@ struct uaccess *morse_spi_uaccess;
 #define SPI_CLK_PERIOD_NANO_S(clk_mhz)	(1000000000 / (clk_mhz))
 
 #define SPI_DEFAULT_MAX_INTER_BLOCK_DELAY_BYTES	250
+/* Slack allowed on top of the observed read latency */
+#define SPI_RX_DELAY_MARGIN_BYTES		16
 
 /* Value to indicate that the base address for bulk/register read/writes has yet to be set */
 #define MORSE_SPI_BASE_ADDR_UNSET 0xFFFFFFFF
@@ -166,6 +208,46 @@ static bool spi_use_edge_irq;
 module_param(spi_use_edge_irq, bool, 0644);
 MODULE_PARM_DESC(spi_use_edge_irq, "Enable compatibility for edge IRQs on SPI");
 
+/* Size CMD53 read over-reads from the observed chip latency */
+static bool spi_rx_adaptive_delay __read_mostly = true;
+module_param(spi_rx_adaptive_delay, bool, 0644);
+MODULE_PARM_DESC(spi_rx_adaptive_delay,
+		 "Shrink CMD53 read padding to the observed chip latency (falls back to the maximum on error)");
+
+/**
+ * enum morse_spi_crc_impl - Implementation of the CMD53 data block CRC16
+ *
+ * @MORSE_SPI_CRC_AUTO: Benchmark the available implementations at first probe
+ * @MORSE_SPI_CRC_DRIVER: Slicing-by-8 tables in crc16_xmodem.c
+ * @MORSE_SPI_CRC_LIB: Kernel crc_itu_t(), which is the same polynomial (0x1021 MSB first)
+ */
+enum morse_spi_crc_impl {
+	MORSE_SPI_CRC_AUTO,
+	MORSE_SPI_CRC_DRIVER,
+	MORSE_SPI_CRC_LIB,
+};
+
+static uint spi_crc_impl __read_mostly = MORSE_SPI_CRC_AUTO;
+module_param(spi_crc_impl, uint, 0444);
+MODULE_PARM_DESC(spi_crc_impl,
+		 "SPI data CRC: 0 = fastest at probe, 1 = driver tables, 2 = kernel crc_itu_t");
+
+/* Length of the buffer, and rounds over it, used to compare the CRC implementations */
+#define SPI_CRC_BENCHMARK_LEN		(8 * MMC_SPI_BLOCKSIZE)
+#define SPI_CRC_BENCHMARK_ROUNDS	(64)
+
+static DEFINE_STATIC_KEY_FALSE(morse_spi_crc_lib);
+
+static inline u16 morse_spi_crc16(const u8 *data, u32 len)
+{
+#if IS_REACHABLE(CONFIG_CRC_ITU_T)
+	if (static_branch_unlikely(&morse_spi_crc_lib))
+		return crc_itu_t(0, data, len);
+#endif
+	/* Calculate the CRC 8 bytes at a time to minimize the overhead and increase throughput */
+	return crc16xmodem_word(0, data, len);
+}
+
 static const struct spi_device_id morse_device_ids[] = {
 	{ MORSE_SPI_DEVICE("mm610x-spi", mm61xx_chip_series) },
 	{ MORSE_SPI_DEVICE("mm810x-spi", mm81xx_chip_series) },
@@ -205,43 +287,151 @@ static int morse_spi_setup(struct spi_device *spi, u32 max_speed_hz)
 	return ret;
 }
 
-/* Hack to shift bits for problematic SPI controllers */
+/*
+ * Hack to shift bits for problematic SPI controllers. The shift is the same for the whole
+ * transaction, so once the buffer is word aligned it is done 64 bits at a time, with only
+ * the unaligned head and the tail handled a byte at a time.
+ */
 static void morse_shift_buffer(u8 *data, unsigned int len, u8 right_shift_bits)
 {
-	int ii;
+	unsigned int ii = 0;
 	u8 next_overflow_bits;
 	u8 overflow_bits;
+	u64 carry;
+	u64 word;
 	static const u8 max_shift = 7;
 
 	right_shift_bits = min(right_shift_bits, max_shift);
+	if (!right_shift_bits)
+		return;
+
 	overflow_bits = (0xFF << (8 - right_shift_bits));
 
-	for (ii = 0; ii < len; ii++) {
+	for (; ii < len && !IS_ALIGNED((unsigned long)&data[ii], sizeof(u64)); ii++) {
 		next_overflow_bits = data[ii] << (8 - right_shift_bits);
 		data[ii] = (data[ii] >> right_shift_bits) | overflow_bits;
 		overflow_bits = next_overflow_bits;
 	}
+
+	carry = (u64)overflow_bits << 56;
+	for (; ii + sizeof(u64) <= len; ii += sizeof(u64)) {
+		__be64 *p = (__be64 *)&data[ii];
+
+		word = be64_to_cpu(*p);
+		*p = cpu_to_be64((word >> right_shift_bits) | carry);
+		carry = word << (64 - right_shift_bits);
+	}
+	overflow_bits = carry >> 56;
+
+	for (; ii < len; ii++) {
+		next_overflow_bits = data[ii] << (8 - right_shift_bits);
+		data[ii] = (data[ii] >> right_shift_bits) | overflow_bits;
+		overflow_bits = next_overflow_bits;
+	}
+}
+
+/* Describe the whole of @xb's buffer, up to @len bytes, as a single transfer */
+static void morse_spi_xbuf_linear(struct morse_spi_xbuf *xb, unsigned int len)
+{
+	memset(&xb->t[0], 0, sizeof(xb->t[0]));
+	xb->t[0].tx_buf = xb->data;
+	xb->t[0].rx_buf = xb->data;
+	xb->t[0].len = len;
+	xb->num_t = 1;
+	xb->end = xb->data + len;
+}
+
+/* Append a transfer sending @len bytes of @tx, receiving into the buffer at @rx */
+static void morse_spi_xbuf_add(struct morse_spi_xbuf *xb, const u8 *tx, u8 *rx, unsigned int len)
+{
+	struct spi_transfer *t;
+
+	if (!len)
+		return;
+
+	t = &xb->t[xb->num_t++];
+	memset(t, 0, sizeof(*t));
+	t->tx_buf = tx;
+	t->rx_buf = rx;
+	t->len = len;
+}
+
+static void morse_spi_xbuf_msg_init(struct morse_spi_xbuf *xb)
+{
+	int i;
+
+	spi_message_init(&xb->m);
+#if KERNEL_VERSION(6, 10, 0) > LINUX_VERSION_CODE
+	xb->m.is_dma_mapped = false;
+#endif
+	for (i = 0; i < xb->num_t; i++)
+		spi_message_add_tail(&xb->t[i], &xb->m);
+}
+
+static void morse_spi_xbuf_rx_fixup(struct morse_spi_xbuf *xb)
+{
+	if (is_rk3288)
+		morse_shift_buffer(xb->data, xb->end - xb->data, 1);
+}
+
+static int morse_spi_xbuf_sync(struct morse_spi *mspi, struct morse_spi_xbuf *xb)
+{
+	int ret;
+
+	morse_spi_xbuf_msg_init(xb);
+	ret = spi_sync_locked(mspi->spi, &xb->m);
+	morse_spi_xbuf_rx_fixup(xb);
+
+	return ret;
+}
+
+static void morse_spi_xbuf_complete(void *context)
+{
+	struct morse_spi_xbuf *xb = context;
+
+	complete(&xb->done);
+}
+
+/* Start @xb on the wire without waiting for it, see morse_spi_xbuf_wait() */
+static int morse_spi_xbuf_submit(struct morse_spi *mspi, struct morse_spi_xbuf *xb)
+{
+	morse_spi_xbuf_msg_init(xb);
+	xb->m.complete = morse_spi_xbuf_complete;
+	xb->m.context = xb;
+	reinit_completion(&xb->done);
+
+	return spi_async(mspi->spi, &xb->m);
+}
+
+static int morse_spi_xbuf_wait(struct morse_spi_xbuf *xb)
+{
+	wait_for_completion(&xb->done);
+	morse_spi_xbuf_rx_fixup(xb);
+
+	return xb->m.status;
+}
+
+/* Whether the controller may DMA straight from @data */
+static bool morse_spi_dma_safe(const void *data)
+{
+	return virt_addr_valid(data) && !object_is_on_stack(data);
 }
 
 static int morse_spi_xfer(struct morse_spi *mspi, unsigned int len)
 {
-	int ret = 0;
+	struct morse_spi_xbuf *xb = &mspi->xbuf[0];
 
 	if (!len)
-		return ret;
+		return 0;
 
 	if (len > SPI_MAX_TRANSACTION_SIZE) {
 		WARN_ON(1);
 		return -EIO;
 	}
 
-	mspi->t.len = len;
-	ret = spi_sync_locked(mspi->spi, &mspi->m);
+	morse_spi_xbuf_linear(xb, len);
 
-	if (is_rk3288)
-		morse_shift_buffer(mspi->data, len, 1);
-
-	return ret;
+	return morse_spi_xbuf_sync(mspi, xb);
 }
 
 /**
@@ -281,19 +471,22 @@ static void morse_spi_initsequence(struct morse_spi *mspi)
 	}
 }
 
-static void morse_spi_xfer_init(struct morse_spi *mspi)
+/* Skip the idle (all ones) bytes from @cp, a word at a time where possible */
+static u8 *morse_spi_skip_idle(u8 *cp, u8 *end)
 {
-	/* setup message from a single data buffer */
-	spi_message_init(&mspi->m);
+	while (cp < end && !IS_ALIGNED((unsigned long)cp, sizeof(unsigned long))) {
+		if (*cp != 0xff)
+			return cp;
+		cp++;
+	}
 
-#if KERNEL_VERSION(6, 10, 0) > LINUX_VERSION_CODE
-	mspi->m.is_dma_mapped = false;
-#endif
-	mspi->t.tx_buf = mspi->data;
-	mspi->t.rx_buf = mspi->data;
-	mspi->t.cs_change = 0;
+	while (cp + sizeof(unsigned long) <= end && *(unsigned long *)cp == ~0UL)
+		cp += sizeof(unsigned long);
+
+	while (cp < end && *cp == 0xff)
+		cp++;
 
-	spi_message_add_tail(&mspi->t, &mspi->m);
+	return cp;
 }
 
 /* Search for R1 response */
@@ -303,8 +496,7 @@ static int morse_spi_find_response(struct morse_spi *mspi, u8 *data, u8 *end, u8
 	struct spi_device *spi = mspi->spi;
 	struct morse *mors = spi_get_drvdata(spi);
 
-	while (cp < end && (*cp == 0xff))
-		cp++;
+	cp = morse_spi_skip_idle(cp, end);
 
 	/* Data block reads (R1 response types) may need more data... */
 	if (cp == end) {
@@ -430,10 +622,7 @@ static int morse_spi_cmd52(struct morse_spi *mspi, u8 fn, u8 data, u32 address)
 /* Search for block start token response */
 static u8 *morse_spi_find_token(struct morse_spi *mspi, u8 *data, u8 *end)
 {
-	u8 *cp = data;
-
-	while (cp < end && *cp == 0xff)
-		cp++;
+	u8 *cp = morse_spi_skip_idle(data, end);
 
 	if (cp == end)
 		goto exit;
@@ -454,10 +643,7 @@ exit:
 /* Search for data block response */
 static u8 *morse_spi_find_data_ack(struct morse_spi *mspi, u8 *data, u8 *end)
 {
-	u8 *cp = data;
-
-	while (cp < end && *cp == 0xff)
-		cp++;
+	u8 *cp = morse_spi_skip_idle(data, end);
 
 	if (cp == end)
 		goto exit;
@@ -479,8 +665,7 @@ static int morse_spi_crc_verify(u8 *data, u32 data_size)
 	/* crc be16 */
 	u8 *crcp = data + data_size;
 	u16 crc = ((u16)(*crcp) << 8) + (u16)(*(crcp + 1));
-	/* Calculate the CRC 8 bytes at a time to minimize the overhead and increase throughput */
-	u16 crc_val = crc16xmodem_word(0, data, data_size);
+	u16 crc_val = morse_spi_crc16(data, data_size);
 
 	if (crc == crc_val)
 		return 0;
@@ -526,22 +711,55 @@ static int morse_spi_put_cmd53(u8 fn, u32 address, u8 *data, u16 count, u8 write
 	return SPI_COMMAND_SIZE;
 }
 
-/* if block flags is set, count is the number of blocks to send, else it's the number of bytes */
-static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *data, u16 count,
-				bool block)
+/* Bytes to allow for the chip's latency ahead of each block read */
+static u16 morse_spi_rx_delay_bytes(struct morse_spi *mspi)
 {
-	u8 *cp = mspi->data;
-	u8 *resp;
-	u8 *end;
+	u32 delay;
+
+	if (!spi_rx_adaptive_delay)
+		return mspi->inter_block_delay_bytes;
+
+	delay = mspi->rx_delay_est_bytes + (mspi->rx_delay_est_bytes / 4) +
+	    SPI_RX_DELAY_MARGIN_BYTES;
+
+	return min_t(u32, delay, mspi->inter_block_delay_bytes);
+}
+
+/*
+ * Follow the largest token gap seen in a read: rise to it at once, decay slowly so a
+ * single quick transaction does not shrink the padding too far.
+ */
+static void morse_spi_rx_delay_update(struct morse_spi *mspi, u32 gap)
+{
+	u16 est = READ_ONCE(mspi->rx_delay_est_bytes);
+
+	est -= est / 8;
+	est = max_t(u32, est, min_t(u32, gap, mspi->inter_block_delay_bytes));
+	WRITE_ONCE(mspi->rx_delay_est_bytes, est);
+}
+
+static void morse_spi_rx_delay_reset(struct morse_spi *mspi)
+{
+	WRITE_ONCE(mspi->rx_delay_est_bytes, mspi->inter_block_delay_bytes);
+}
+
+/*
+ * Build a CMD53 read in @xb. If block flags is set, count is the number of blocks to read,
+ * else it's the number of bytes.
+ */
+static void morse_spi_cmd53_read_prep(struct morse_spi *mspi, struct morse_spi_xbuf *xb, u8 fn,
+				      u32 address, u8 *data, u16 count, bool block)
+{
+	u8 *cp = xb->data;
 	u32 data_size;
-	int i;
+	u16 delay_bytes = morse_spi_rx_delay_bytes(mspi);
 
-	memset(mspi->data, 0xFF, MM610X_BUF_SIZE);
+	memset(xb->data, 0xFF, MM610X_BUF_SIZE);
 
 	/* Insert command and argument */
 	cp += morse_spi_put_cmd53(fn, address, cp, count, 0, block);
 
-	resp = cp;
+	xb->resp = cp;
 
 	/*
 	 * Calculate number of clock cycles needed to get data.
@@ -554,7 +772,7 @@ static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *
 
 	if (!block) {
 		/* Scale bytes delay to block */
-		u32 extra_bytes = (count * mspi->inter_block_delay_bytes) / MMC_SPI_BLOCKSIZE;
+		u32 extra_bytes = (count * delay_bytes) / MMC_SPI_BLOCKSIZE;
 
 		/* Allow 4 bytes for CRC and another 10 bytes for start block token & chip delays
 		 * (usually comes in 2).
@@ -569,24 +787,39 @@ static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *
 	} else {
 		/* Each block need 512 bytes + Token + chip delays */
 		if (!is_rk3288)
-			data_size = count * (MMC_SPI_BLOCKSIZE + mspi->inter_block_delay_bytes + 2);
+			data_size = count * (MMC_SPI_BLOCKSIZE + delay_bytes + 2);
 		else
-			data_size = count *
-			    (MMC_SPI_BLOCKSIZE + (2 * mspi->inter_block_delay_bytes) + 2);
+			data_size = count * (MMC_SPI_BLOCKSIZE + (2 * delay_bytes) + 2);
 	}
 
-	if (data_size > (MM610X_BUF_SIZE - (cp - mspi->data))) {
+	if (data_size > (MM610X_BUF_SIZE - (cp - xb->data))) {
 		struct spi_device *spi = mspi->spi;
 		struct morse *mors = spi_get_drvdata(spi);
 
 		MORSE_SPI_INFO(mors, "%s: data buffer too big, truncating: %u",
 			       __func__, data_size);
 	}
-	data_size = min(data_size, (u32)(MM610X_BUF_SIZE - (cp - mspi->data)));
+	data_size = min(data_size, (u32)(MM610X_BUF_SIZE - (cp - xb->data)));
 	cp += data_size;
-	end = cp;
 
-	morse_spi_xfer(mspi, end - mspi->data);
+	morse_spi_xbuf_linear(xb, cp - xb->data);
+	xb->host_data = data;
+	xb->address = address;
+	xb->count = count;
+	xb->fn = fn;
+	xb->block = block;
+}
+
+/* Verify a completed CMD53 read and copy its data out */
+static int morse_spi_cmd53_read_check(struct morse_spi *mspi, struct morse_spi_xbuf *xb)
+{
+	u8 *data = xb->host_data;
+	u8 *end = xb->end;
+	u8 *cp;
+	u8 *token;
+	u32 data_size;
+	u32 gap = 0;
+	int i;
 
 	/*
 	 * Response will already be stored in the data buffer.  It's
@@ -595,15 +828,18 @@ static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *
 	 */
 
 	/* Time to verify */
-	if (morse_spi_find_response(mspi, resp, end, &cp))
+	if (morse_spi_find_response(mspi, xb->resp, end, &cp))
 		goto exit;
 
-	data_size = block ? MMC_SPI_BLOCKSIZE : count;
-	for (i = 0; i < (block ? count : 1); i++, data += data_size) {
-		cp = morse_spi_find_token(mspi, cp, end);
-		if (!cp)
+	data_size = xb->block ? MMC_SPI_BLOCKSIZE : xb->count;
+	for (i = 0; i < (xb->block ? xb->count : 1); i++, data += data_size) {
+		token = morse_spi_find_token(mspi, cp, end);
+		if (!token)
 			goto exit;
 
+		gap = max_t(u32, gap, token - cp - 1);
+		cp = token;
+
 		if (morse_spi_crc_verify(cp, data_size))
 			goto exit;
 
@@ -611,29 +847,81 @@ static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *
 		cp += data_size + 4;
 	}
 
-	return count;
+	if (xb->block || xb->count >= MMC_SPI_BLOCKSIZE / 2)
+		morse_spi_rx_delay_update(mspi, gap);
+
+	return xb->count;
 
 exit:
 	MORSE_PR_ERR(FEATURE_ID_SPI, "%s failed\n", __func__);
 	return -EPROTO;
 }
 
-static int morse_spi_cmd53_write(struct morse_spi *mspi, u8 fn, u32 address, u8 *data, u16 count,
-				 u8 block)
+/*
+ * A read sized from the latency estimate failed: it may simply have been cut short, so
+ * go back to the maximum padding and repeat it once.
+ */
+static int morse_spi_cmd53_read_retry(struct morse_spi *mspi, struct morse_spi_xbuf *xb)
 {
-	u8 *cp = mspi->data;
-	u8 *resp;
-	u8 *end;
-	u8 *ack = cp;
+	int ret;
+
+	if (!spi_rx_adaptive_delay ||
+	    READ_ONCE(mspi->rx_delay_est_bytes) >= mspi->inter_block_delay_bytes)
+		return -EPROTO;
+
+	morse_spi_rx_delay_reset(mspi);
+	morse_spi_cmd53_read_prep(mspi, xb, xb->fn, xb->address, xb->host_data, xb->count,
+				  xb->block);
+	ret = morse_spi_xbuf_sync(mspi, xb);
+	if (ret)
+		return ret;
+
+	return morse_spi_cmd53_read_check(mspi, xb);
+}
+
+static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *data, u16 count,
+				bool block)
+{
+	struct morse_spi_xbuf *xb = &mspi->xbuf[0];
+	int ret;
+
+	morse_spi_cmd53_read_prep(mspi, xb, fn, address, data, count, block);
+	morse_spi_xbuf_sync(mspi, xb);
+
+	ret = morse_spi_cmd53_read_check(mspi, xb);
+	if (ret < 0)
+		ret = morse_spi_cmd53_read_retry(mspi, xb);
+
+	return ret;
+}
+
+/*
+ * Build a CMD53 write in @xb. Block data that is DMA-safe is sent straight from the
+ * caller's buffer, with the bytes received meanwhile landing in @xb at the offsets they
+ * would have had if it had been copied.
+ */
+static int morse_spi_cmd53_write_prep(struct morse_spi *mspi, struct morse_spi_xbuf *xb, u8 fn,
+				      u32 address, u8 *data, u16 count, u8 block)
+{
+	u8 *cp = xb->data;
+	u8 *seg = xb->data;
 	u32 data_size;
+	bool zero_copy = block && count <= MORSE_SPI_XBUF_MAX_BLOCKS && morse_spi_dma_safe(data);
 	int i;
 
-	memset(mspi->data, 0xFF, MM610X_BUF_SIZE);
+	xb->host_data = data;
+	xb->address = address;
+	xb->count = count;
+	xb->fn = fn;
+	xb->block = block;
+	xb->num_t = 0;
+
+	memset(xb->data, 0xFF, MM610X_BUF_SIZE);
 	/* Insert command and argument */
 	cp += morse_spi_put_cmd53(fn, address, cp, count, 1, block);
 
 	/* Mark response point */
-	resp = cp;
+	xb->resp = cp;
 
 	/* Calculate number of clock cycles needed to get data.
 	 * Transactions are either one block of few bytes (i.e less than
@@ -645,12 +933,10 @@ static int morse_spi_cmd53_write(struct morse_spi *mspi, u8 fn, u32 address, u8
 	/* Allow 4 bytes to get 0xFF (i.e MISO ready) */
 	cp += 4;
 
+	xb->ack = cp;
 	data_size = block ? MMC_SPI_BLOCKSIZE : count;
 	for (i = 0; i < (block ? count : 1); i++, data += MMC_SPI_BLOCKSIZE) {
-		/*
-		 * Calculate the CRC 8 bytes at a time to minimize overhead and increase throughput
-		 */
-		u16 crc = crc16xmodem_word(0, data, data_size);
+		u16 crc = morse_spi_crc16(data, data_size);
 
 		/* WR: ACK should be set below (after sending the block). However for
 		 * seems the chip is providing the ACKs (some times) a bit too early.
@@ -658,23 +944,29 @@ static int morse_spi_cmd53_write(struct morse_spi *mspi, u8 fn, u32 address, u8
 		 */
 		/* Mark data ack point */
 		if (i == 0)
-			ack = cp;
+			xb->ack = cp;
 
 		/* tx token */
 		*cp = block ? SPI_TOKEN_MULTI_WRITE : SPI_TOKEN_SINGLE;
 		cp++;
 
 		/* data */
-		if (cp + data_size > mspi->data + MM610X_BUF_SIZE) {
+		if (cp + data_size > xb->data + MM610X_BUF_SIZE) {
 			struct spi_device *spi = mspi->spi;
 			struct morse *mors = spi_get_drvdata(spi);
 
 			MORSE_SPI_INFO(mors, "%s: data buffer too big (%u)",
-				       __func__, (u32)((cp + data_size) - mspi->data));
+				       __func__, (u32)((cp + data_size) - xb->data));
 
 			return -ENOMEM;
 		}
-		memcpy(cp, data, data_size);
+		if (zero_copy) {
+			morse_spi_xbuf_add(xb, seg, seg, cp - seg);
+			morse_spi_xbuf_add(xb, data, cp, data_size);
+			seg = cp + data_size;
+		} else {
+			memcpy(cp, data, data_size);
+		}
 		cp += data_size;
 
 		/* crc */
@@ -693,36 +985,66 @@ static int morse_spi_cmd53_write(struct morse_spi *mspi, u8 fn, u32 address, u8
 			cp += XTAL_TRANSFER_DELAY_BYTES;
 	}
 
-	/* Do the actual transfer */
-	end = cp;
+	if (zero_copy) {
+		morse_spi_xbuf_add(xb, seg, seg, cp - seg);
+		xb->end = cp;
+	} else {
+		morse_spi_xbuf_linear(xb, cp - xb->data);
+	}
 
-	morse_spi_xfer(mspi, end - mspi->data);
+	return 0;
+}
+
+/* Verify the response and data acks of a completed CMD53 write */
+static int morse_spi_cmd53_write_check(struct morse_spi *mspi, struct morse_spi_xbuf *xb)
+{
+	u8 *ack = xb->ack;
+	u8 *end = xb->end;
+	u8 *cp;
+	u32 data_size;
+	int i;
 
 	/* Time to verify */
-	if (morse_spi_find_response(mspi, resp, end, &cp))
+	if (morse_spi_find_response(mspi, xb->resp, end, &cp))
 		goto exit;
 
 	/* If in block mode, start searching for the data ack exactly where it is expected.
 	 * This will improve the throughput. For 14 * 512 Bytes of data transfer, the time
 	 * it takes to find the response is reduced from 33 uS to 1 uS
 	 */
-	ack += block ? (1 /* TOKEN */  + MMC_SPI_BLOCKSIZE /* data size */  + 2 /* crc */) : 0;
+	ack += xb->block ? (1 /* TOKEN */  + MMC_SPI_BLOCKSIZE /* data size */  + 2 /* crc */) : 0;
 	data_size =
 	    1 /* TOKEN */  + MMC_SPI_BLOCKSIZE + 2 /* crc */  + mspi->inter_block_delay_bytes;
-	for (i = 0; i < (block ? count : 1); i++, ack += data_size) {
+	for (i = 0; i < (xb->block ? xb->count : 1); i++, ack += data_size) {
 		cp = ack;
 		cp = morse_spi_find_data_ack(mspi, cp, end);
 		if (!cp)
 			goto exit;
 	}
 
-	return count;
+	return xb->count;
 
 exit:
 	MORSE_PR_ERR(FEATURE_ID_SPI, "%s failed\n", __func__);
 	return -EPROTO;
 }
 
+static int morse_spi_cmd53_write(struct morse_spi *mspi, u8 fn, u32 address, u8 *data, u16 count,
+				 u8 block)
+{
+	struct morse_spi_xbuf *xb = &mspi->xbuf[0];
+	int ret;
+
+	ret = morse_spi_cmd53_write_prep(mspi, xb, fn, address, data, count, block);
+	if (ret)
+		return ret;
+
+	/* Do the actual transfer */
+	morse_spi_xbuf_sync(mspi, xb);
+
+	return morse_spi_cmd53_write_check(mspi, xb);
+}
+
 static void spi_log_err(struct morse_spi *mspi, const char *operation, unsigned int fn,
 			unsigned int address, unsigned int len, int ret)
 {
@@ -736,6 +1058,71 @@ static void spi_log_err(struct morse_spi *mspi, const char *operation, unsigned
 		      mspi->bulk_addr_base, ret);
 }
 
+/*
+ * Transfer @blks blocks with CMD53, keeping two transactions in flight: the next one is
+ * prepared and queued to the controller before the previous one is checked, so the bus
+ * is not left idle while responses are parsed and data copied. Every queued transaction
+ * is waited for before returning, even on error.
+ */
+static int morse_spi_cmd53_blocks(struct morse_spi *mspi, u8 fn, u32 address, u8 *data,
+				  u32 blks, bool write)
+{
+	const char *op = write ? "cmd53_write" : "cmd53_read";
+	struct morse_spi_xbuf *prev = NULL;
+	struct morse_spi_xbuf *xb;
+	u32 blks_done = 0;
+	int idx = 0;
+	int ret = 0;
+	int err;
+
+	while (prev || (!ret && blks_done < blks)) {
+		xb = NULL;
+
+		if (!ret && blks_done < blks) {
+			u16 blk_count = min_t(u32, mspi->max_block_count, blks - blks_done);
+			u32 next_addr = address + blks_done * MMC_SPI_BLOCKSIZE;
+			u8 *next_data = data + blks_done * MMC_SPI_BLOCKSIZE;
+
+			xb = &mspi->xbuf[idx];
+			idx = (idx + 1) % MORSE_SPI_NUM_XBUFS;
+
+			err = 0;
+			if (write)
+				err = morse_spi_cmd53_write_prep(mspi, xb, fn, next_addr, next_data,
+								 blk_count, 1);
+			else
+				morse_spi_cmd53_read_prep(mspi, xb, fn, next_addr, next_data,
+							  blk_count, 1);
+			if (!err)
+				err = morse_spi_xbuf_submit(mspi, xb);
+			if (err) {
+				spi_log_err(mspi, op, fn, next_addr, blk_count, err);
+				ret = err;
+				xb = NULL;
+			} else {
+				blks_done += blk_count;
+			}
+		}
+
+		if (prev) {
+			err = morse_spi_xbuf_wait(prev);
+			if (!err)
+				err = write ? morse_spi_cmd53_write_check(mspi, prev) :
+				    morse_spi_cmd53_read_check(mspi, prev);
+			if (err == -EPROTO && !write)
+				err = morse_spi_cmd53_read_retry(mspi, prev);
+			if (err < 0 && !ret) {
+				spi_log_err(mspi, op, fn, prev->address, prev->count, err);
+				ret = err;
+			}
+		}
+
+		prev = xb;
+	}
+
+	return ret;
+}
+
 static u32 morse_spi_calculate_base_address(u32 address, u8 access)
 {
 	return (address & MORSE_SDIO_RW_ADDR_BOUNDARY_MASK) | (access & 0x3);
@@ -851,23 +1238,12 @@ static int morse_spi_mem_read(struct morse_spi *mspi, u32 address, u8 *data, u32
 
 	address &= 0xFFFF;	/* remove base and keep offset */
 	if (blks) {
-		/* we only have 4K per SPI transaction */
-		while (blks - blks_done) {
-			int blk_count = min_t(int, mspi->max_block_count, blks - blks_done);
-			u32 next_addr = address + blks_done * MMC_SPI_BLOCKSIZE;
-
-			ret = morse_spi_cmd53_read(mspi, func_to_use,
-						   next_addr,
-						   data + blks_done * MMC_SPI_BLOCKSIZE,
-						   blk_count, 1);
-			if (ret < 0) {
-				spi_log_err(mspi, "cmd53_read", func_to_use, next_addr, blk_count,
-					    ret);
-				goto exit;
-			}
+		/* we only have 8K per SPI transaction */
+		ret = morse_spi_cmd53_blocks(mspi, func_to_use, address, data, blks, false);
+		if (ret < 0)
+			goto exit;
 
-			blks_done += blk_count;
-		}
+		blks_done = blks;
 	}
 
 	if (bytes) {
@@ -923,23 +1299,12 @@ static int morse_spi_mem_write(struct morse_spi *mspi, u32 address, u8 *data, u3
 
 	address &= 0xFFFF;	/* remove base and keep offset */
 	if (blks) {
-		/* we only have 4K per SPI transaction */
-		while (blks - blks_done) {
-			int blk_count = min_t(int, mspi->max_block_count, blks - blks_done);
-			u32 next_addr = address + blks_done * MMC_SPI_BLOCKSIZE;
-
-			ret = morse_spi_cmd53_write(mspi, func_to_use,
-						    next_addr,
-						    data + blks_done * MMC_SPI_BLOCKSIZE,
-						    blk_count, 1);
-			if (ret < 0) {
-				spi_log_err(mspi, "cmd53_write", func_to_use, next_addr, blk_count,
-					    ret);
-				goto exit;
-			}
+		/* we only have 8K per SPI transaction */
+		ret = morse_spi_cmd53_blocks(mspi, func_to_use, address, data, blks, true);
+		if (ret < 0)
+			goto exit;
 
-			blks_done += blk_count;
-		}
+		blks_done = blks;
 	}
 
 	if (bytes) {
@@ -1176,6 +1541,17 @@ static int morse_spi_setup_irq(struct morse_spi *mspi)
 	return ret;
 }
 
+static void morse_spi_free_xbufs(struct morse_spi *mspi)
+{
+	int i;
+
+	for (i = 0; i < MORSE_SPI_NUM_XBUFS; i++) {
+		kfree(mspi->xbuf[i].data);
+		mspi->xbuf[i].data = NULL;
+	}
+	mspi->data = NULL;
+}
+
 static void morse_spi_remove_irq(struct morse_spi *mspi)
 {
 	struct spi_device *spi = mspi->spi;
@@ -1225,7 +1601,7 @@ static void morse_spi_remove(struct spi_device *spi)
 		}
 
 		morse_spi_remove_irq(mspi);
-		kfree(mspi->data);
+		morse_spi_free_xbufs(mspi);
 #ifdef CONFIG_MORSE_USER_ACCESS
 		uaccess_device_unregister(mors);
 		uaccess_cleanup(morse_spi_uaccess);
@@ -1304,6 +1680,7 @@ static void morse_spi_config_burst_mode(struct morse *mors, bool enable_burst)
 		mspi->max_block_count =
 			SPI_MAX_TRANSACTION_SIZE / (MMC_SPI_BLOCKSIZE +
 						mspi->inter_block_delay_bytes);
+		morse_spi_rx_delay_reset(mspi);
 	}
 }
 
@@ -1321,6 +1698,81 @@ static const struct morse_bus_ops morse_spi_ops = {
 	.bulk_alignment = MORSE_DEFAULT_BULK_ALIGNMENT
 };
 
+MORSE_BUS_DIRECT_OPS(morse_spi_dm_read, morse_spi_dm_write,
+		     morse_spi_reg32_read, morse_spi_reg32_write,
+		     morse_spi_claim_bus, morse_spi_release_bus)
+
+#if IS_REACHABLE(CONFIG_CRC_ITU_T)
+/* Time one CRC implementation over @buf, returning the throughput in MB/s */
+static u64 morse_spi_crc_benchmark(const u8 *buf, bool lib, u16 *crc)
+{
+	u64 start_ns = ktime_get_ns();
+	u64 elapsed_ns;
+	int i;
+
+	for (i = 0; i < SPI_CRC_BENCHMARK_ROUNDS; i++)
+		*crc = lib ? crc_itu_t(0, buf, SPI_CRC_BENCHMARK_LEN) :
+			     crc16xmodem_word(0, buf, SPI_CRC_BENCHMARK_LEN);
+	elapsed_ns = max_t(u64, ktime_get_ns() - start_ns, 1);
+
+	return div64_u64((u64)SPI_CRC_BENCHMARK_LEN * SPI_CRC_BENCHMARK_ROUNDS * 1000,
+			 elapsed_ns);
+}
+#endif
+
+/**
+ * morse_spi_crc_select() - Choose the data block CRC implementation.
+ * @mors: Morse chip instance, used for logging
+ *
+ * The choice is shared by all SPI devices and is made once. With spi_crc_impl set to auto
+ * both implementations are timed over the same buffer, checked to agree, and the faster one
+ * is used. This picks up any architecture acceleration behind crc_itu_t().
+ */
+static void morse_spi_crc_select(struct morse *mors)
+{
+#if IS_REACHABLE(CONFIG_CRC_ITU_T)
+	static bool selected;
+	u64 driver_mbps, lib_mbps;
+	u16 driver_crc, lib_crc;
+	u8 *buf;
+
+	if (selected)
+		return;
+	selected = true;
+
+	if (spi_crc_impl == MORSE_SPI_CRC_LIB) {
+		static_branch_enable(&morse_spi_crc_lib);
+		return;
+	}
+	if (spi_crc_impl != MORSE_SPI_CRC_AUTO)
+		return;
+
+	buf = kmalloc(SPI_CRC_BENCHMARK_LEN, GFP_KERNEL);
+	if (!buf)
+		return;
+	get_random_bytes(buf, SPI_CRC_BENCHMARK_LEN);
+
+	driver_mbps = morse_spi_crc_benchmark(buf, false, &driver_crc);
+	lib_mbps = morse_spi_crc_benchmark(buf, true, &lib_crc);
+	kfree(buf);
+
+	if (driver_crc != lib_crc) {
+		MORSE_SPI_WARN(mors, "crc_itu_t disagrees with driver CRC (0x%04x != 0x%04x)\n",
+			       lib_crc, driver_crc);
+		return;
+	}
+
+	if (lib_mbps > driver_mbps)
+		static_branch_enable(&morse_spi_crc_lib);
+
+	MORSE_SPI_INFO(mors, "Data CRC driver %llu MB/s, crc_itu_t %llu MB/s, using %s\n",
+		       driver_mbps, lib_mbps, lib_mbps > driver_mbps ? "crc_itu_t" : "driver");
+#else
+	if (spi_crc_impl == MORSE_SPI_CRC_LIB)
+		MORSE_SPI_WARN(mors, "crc_itu_t not available, using driver CRC\n");
+#endif
+}
+
 static int morse_spi_probe(struct spi_device *spi)
 {
 	int i, ret = 0;
@@ -1353,13 +1805,17 @@ static int morse_spi_probe(struct spi_device *spi)
 
 	/* preallocate dma buffers */
 	mspi = (struct morse_spi *)mors->drv_priv;
-	mspi->data = kmalloc(MM610X_BUF_SIZE, GFP_KERNEL);
-	if (!mspi->data) {
-		MORSE_SPI_ERR(mors, "%s Failed to allocate DMA buffers (size=%d bytes)\n",
-			      __func__, MM610X_BUF_SIZE);
-		ret = -ENOMEM;
-		goto err_nobuf;
+	for (i = 0; i < MORSE_SPI_NUM_XBUFS; i++) {
+		mspi->xbuf[i].data = kmalloc(MM610X_BUF_SIZE, GFP_KERNEL);
+		if (!mspi->xbuf[i].data) {
+			MORSE_SPI_ERR(mors, "%s Failed to allocate DMA buffers (size=%d bytes)\n",
+				      __func__, MM610X_BUF_SIZE);
+			ret = -ENOMEM;
+			goto err_cfg;
+		}
+		init_completion(&mspi->xbuf[i].done);
 	}
+	mspi->data = mspi->xbuf[0].data;
 
 	mspi->spi = spi;
 
@@ -1369,11 +1825,14 @@ static int morse_spi_probe(struct spi_device *spi)
 	mspi->inter_block_delay_bytes = SPI_DEFAULT_MAX_INTER_BLOCK_DELAY_BYTES;
 	mspi->max_block_count =
 	    SPI_MAX_TRANSACTION_SIZE / (MMC_SPI_BLOCKSIZE + mspi->inter_block_delay_bytes);
+	morse_spi_rx_delay_reset(mspi);
 
 	mutex_init(&mspi->lock);
 	mutex_init(&mspi->bus_lock);
 	spi_set_drvdata(spi, mors);
 
+	morse_spi_crc_select(mors);
+
 	if (enable_ext_xtal_init) {
 		/* Under usual init the morse chip series for a SPI device is derived
 		 * by reading the chip id address as part of `morse_chip_cfg_detect_and_init()`.
@@ -1404,7 +1863,6 @@ static int morse_spi_probe(struct spi_device *spi)
 #warning "SPI_CONTROLLER_ENABLE_CS_GPIOD macro not defined"
 #endif
 #endif
-	morse_spi_xfer_init(mspi);
 	if (!is_rk3288)
 		morse_spi_initsequence(mspi);
 
@@ -1585,8 +2043,7 @@ err_uaccess:
 	uaccess_cleanup(morse_spi_uaccess);
 #endif
 err_cfg:
-	kfree(mspi->data);
-err_nobuf:
+	morse_spi_free_xbufs(mspi);
 	morse_mac_destroy(mors);
 
 err_exit:
@@ -1601,6 +2058,8 @@ static struct spi_driver morse_spi_driver = {
 		   .name = "morse_spi",
 		   .owner = THIS_MODULE,
 		   .of_match_table = of_match_ptr(morse_spi_of_match),
+		   /* Firmware download is slow, let each radio come up alongside the others */
+		   .probe_type = PROBE_PREFER_ASYNCHRONOUS,
 		    },
 	.id_table = morse_device_ids,
 	.probe = morse_spi_probe,
@@ -1727,6 +2186,7 @@ int __init morse_spi_init(void)
 
 	BUILD_BUG_ON(SPI_COMMAND_BUF_SIZE < SPI_COMMAND_SIZE);
 	BUILD_BUG_ON(SPI_COMMAND_BUF_SIZE >= MM610X_BUF_SIZE);
+	BUILD_BUG_ON(SPI_MAX_TRANSACTION_SIZE / MMC_SPI_BLOCKSIZE > MORSE_SPI_XBUF_MAX_BLOCKS);
 
 	ret = spi_register_driver(&morse_spi_driver);
 	if (ret) {
@@ -11,6 +11,7 @@
 #include <linux/tracepoint.h>
 #include "morse.h"
 #include "debug.h"
+#include "bus_trace.h"
 
 #undef TRACE_SYSTEM
 #define TRACE_SYSTEM morse
@@ -49,8 +50,9 @@ DEFINE_EVENT(morse_log_event, morse_info,
 	TP_PROTO(const struct morse *mors, struct va_format *vaf), TP_ARGS(mors, vaf)
 );
 
-DEFINE_EVENT(morse_log_event, morse_dbg,
-	TP_PROTO(const struct morse *mors, struct va_format *vaf), TP_ARGS(mors, vaf)
+DEFINE_EVENT_FN(morse_log_event, morse_dbg,
+	TP_PROTO(const struct morse *mors, struct va_format *vaf), TP_ARGS(mors, vaf),
+	morse_log_dbg_trace_reg, morse_log_dbg_trace_unreg
 );
 
 DEFINE_EVENT(morse_log_event, morse_err_ratelimited,
@@ -65,8 +67,121 @@ DEFINE_EVENT(morse_log_event, morse_info_ratelimited,
 	TP_PROTO(const struct morse *mors, struct va_format *vaf), TP_ARGS(mors, vaf)
 );
 
-DEFINE_EVENT(morse_log_event, morse_dbg_ratelimited,
-	TP_PROTO(const struct morse *mors, struct va_format *vaf), TP_ARGS(mors, vaf)
+DEFINE_EVENT_FN(morse_log_event, morse_dbg_ratelimited,
+	TP_PROTO(const struct morse *mors, struct va_format *vaf), TP_ARGS(mors, vaf),
+	morse_log_dbg_trace_reg, morse_log_dbg_trace_unreg
+);
+
+TRACE_EVENT(morse_bus_event,
+	TP_PROTO(const struct morse *mors, u32 id, u32 fn, u32 address, u32 len),
+	TP_ARGS(mors, id, fn, address, len),
+	TP_STRUCT__entry(__string(device, mors ? dev_name(mors->dev) : "")
+			 __field(u32, id)
+			 __field(u32, fn)
+			 __field(u32, address)
+			 __field(u32, len)),
+#if KERNEL_VERSION(6, 10, 0) > LINUX_VERSION_CODE
+	TP_fast_assign(__assign_str(device, mors ? dev_name(mors->dev) : "");
+#else
+	TP_fast_assign(__assign_str(device);
+#endif
+		       __entry->id = id;
+		       __entry->fn = fn;
+		       __entry->address = address;
+		       __entry->len = len;),
+	TP_printk("%s fn=%u %s addr=0x%08x len=%u", __get_str(device), __entry->fn,
+		  __print_symbolic(__entry->id,
+				   { BUS_TRACE_EVENT_ID_SET_REG_BASE_ADDRESS, "set_reg_base" },
+				   { BUS_TRACE_EVENT_ID_SET_BULK_BASE_ADDRESS, "set_bulk_base" },
+				   { BUS_TRACE_EVENT_ID_RESET_BASE_ADDRESSES, "reset_base" },
+				   { BUS_TRACE_EVENT_ID_EN_IRQ, "en_irq" },
+				   { BUS_TRACE_EVENT_ID_HANDLE_IRQ, "irq" },
+				   { BUS_TRACE_EVENT_ID_REG_WRITE, "reg_write" },
+				   { BUS_TRACE_EVENT_ID_REG_READ, "reg_read" },
+				   { BUS_TRACE_EVENT_ID_BULK_WRITE, "bulk_write" },
+				   { BUS_TRACE_EVENT_ID_BULK_READ, "bulk_read" },
+				   { BUS_TRACE_EVENT_ID_BUS_EN, "bus_en" }),
+		  __entry->address, __entry->len)
+);
+
+TRACE_EVENT(morse_boot_phase,
+	TP_PROTO(const struct morse *mors, u32 phase, bool begin, u64 offset_us, int ret),
+	TP_ARGS(mors, phase, begin, offset_us, ret),
+	TP_STRUCT__entry(__string(device, dev_name(mors->dev))
+			 __field(u32, phase)
+			 __field(bool, begin)
+			 __field(u64, offset_us)
+			 __field(int, ret)),
+#if KERNEL_VERSION(6, 10, 0) > LINUX_VERSION_CODE
+	TP_fast_assign(__assign_str(device, dev_name(mors->dev));
+#else
+	TP_fast_assign(__assign_str(device);
+#endif
+		       __entry->phase = phase;
+		       __entry->begin = begin;
+		       __entry->offset_us = offset_us;
+		       __entry->ret = ret;),
+	TP_printk("%s %s %s at %llu us ret=%d", __get_str(device),
+		  __print_symbolic(__entry->phase,
+				   { MORSE_BOOT_PHASE_BUS_PROBE, "bus_probe" },
+				   { MORSE_BOOT_PHASE_RESTART, "restart" },
+				   { MORSE_BOOT_PHASE_FW_REQUEST, "fw_request" },
+				   { MORSE_BOOT_PHASE_CHIP_RESET, "chip_reset" },
+				   { MORSE_BOOT_PHASE_FW_DOWNLOAD, "fw_download" },
+				   { MORSE_BOOT_PHASE_BCF_LOAD, "bcf_load" },
+				   { MORSE_BOOT_PHASE_FW_BOOT, "fw_boot" },
+				   { MORSE_BOOT_PHASE_MAC_INIT, "mac_init" },
+				   { MORSE_BOOT_PHASE_MAC_REGISTER, "mac_register" },
+				   { MORSE_BOOT_PHASE_FIRST_LINK, "first_link" }),
+		  __entry->begin ? "begin" : "end", __entry->offset_us, __entry->ret)
+);
+
+TRACE_EVENT(morse_pkt_latency_tx,
+	TP_PROTO(const struct morse *mors, u8 aci, u64 driver_ns, u64 queue_ns, u64 air_ns,
+		 u64 report_ns, u64 total_ns),
+	TP_ARGS(mors, aci, driver_ns, queue_ns, air_ns, report_ns, total_ns),
+	TP_STRUCT__entry(__string(device, dev_name(mors->dev))
+			 __field(u8, aci)
+			 __field(u64, driver_ns)
+			 __field(u64, queue_ns)
+			 __field(u64, air_ns)
+			 __field(u64, report_ns)
+			 __field(u64, total_ns)),
+#if KERNEL_VERSION(6, 10, 0) > LINUX_VERSION_CODE
+	TP_fast_assign(__assign_str(device, dev_name(mors->dev));
+#else
+	TP_fast_assign(__assign_str(device);
+#endif
+		       __entry->aci = aci;
+		       __entry->driver_ns = driver_ns;
+		       __entry->queue_ns = queue_ns;
+		       __entry->air_ns = air_ns;
+		       __entry->report_ns = report_ns;
+		       __entry->total_ns = total_ns;),
+	TP_printk("%s aci=%u driver=%llu queue=%llu air=%llu report=%llu total=%llu ns",
+		  __get_str(device), __entry->aci, __entry->driver_ns, __entry->queue_ns,
+		  __entry->air_ns, __entry->report_ns, __entry->total_ns)
+);
+
+TRACE_EVENT(morse_pkt_latency_rx,
+	TP_PROTO(const struct morse *mors, u8 aci, u64 queue_ns, u64 driver_ns, u64 total_ns),
+	TP_ARGS(mors, aci, queue_ns, driver_ns, total_ns),
+	TP_STRUCT__entry(__string(device, dev_name(mors->dev))
+			 __field(u8, aci)
+			 __field(u64, queue_ns)
+			 __field(u64, driver_ns)
+			 __field(u64, total_ns)),
+#if KERNEL_VERSION(6, 10, 0) > LINUX_VERSION_CODE
+	TP_fast_assign(__assign_str(device, dev_name(mors->dev));
+#else
+	TP_fast_assign(__assign_str(device);
+#endif
+		       __entry->aci = aci;
+		       __entry->queue_ns = queue_ns;
+		       __entry->driver_ns = driver_ns;
+		       __entry->total_ns = total_ns;),
+	TP_printk("%s aci=%u queue=%llu driver=%llu total=%llu ns", __get_str(device),
+		  __entry->aci, __entry->queue_ns, __entry->driver_ns, __entry->total_ns)
 );
 
 #endif
@@ -6,6 +6,7 @@
  */
 
 #include <linux/math64.h>
+#include <linux/rbtree_augmented.h>
 
 #include "command.h"
 #include "twt.h"
@@ -19,6 +20,22 @@
 #define TWT_SETUP_CMD_UNKNOWN	(8)
 #define TWT_WAKE_DUR_UNIT_256	(256)
 
+/**
+ * enum morse_twt_schedule_policy - How the AP places service periods sharing a wake interval
+ *
+ * @MORSE_TWT_SCHEDULE_PACK: Earliest gap that fits, grouping service periods back to back
+ * @MORSE_TWT_SCHEDULE_SPREAD: Middle of the largest gap, spreading service periods evenly
+ */
+enum morse_twt_schedule_policy {
+	MORSE_TWT_SCHEDULE_PACK = 0,
+	MORSE_TWT_SCHEDULE_SPREAD = 1,
+};
+
+static uint twt_schedule_policy __read_mostly = MORSE_TWT_SCHEDULE_PACK;
+module_param(twt_schedule_policy, uint, 0644);
+MODULE_PARM_DESC(twt_schedule_policy,
+		 "Placement of TWT service periods in a wake interval (0: pack, 1: spread)");
+
 #define MORSE_TWT_DBG(_m, _f, _a...)		morse_dbg(FEATURE_ID_TWT, _m, _f, ##_a)
 #define MORSE_TWT_INFO(_m, _f, _a...)		morse_info(FEATURE_ID_TWT, _m, _f, ##_a)
 #define MORSE_TWT_WARN(_m, _f, _a...)		morse_warn(FEATURE_ID_TWT, _m, _f, ##_a)
@@ -187,6 +204,8 @@ void morse_twt_dump_wake_interval_tree(struct seq_file *file, struct morse_vif *
 	struct morse_twt *twt;
 	struct morse_twt_wake_interval *wi;
 	struct morse_twt_agreement *agr;
+	struct rb_node *wi_node;
+	struct rb_node *agr_node;
 
 	if (!file || !mors_vif)
 		return;
@@ -194,16 +213,14 @@ void morse_twt_dump_wake_interval_tree(struct seq_file *file, struct morse_vif *
 	seq_printf(file, "%s:\n", morse_vif_name(morse_vif_to_ieee80211_vif(mors_vif)));
 	twt = &mors_vif->twt;
 	spin_lock_bh(&twt->lock);
-	list_for_each_entry(wi, &twt->wake_intervals, list) {
-		agr = list_first_entry_or_null(&wi->agreements, struct morse_twt_agreement, list);
-		if (!agr) {
-			seq_puts(file, "Empty wake interval\n");
-			continue;
-		}
+	for (wi_node = rb_first(&twt->wake_intervals); wi_node; wi_node = rb_next(wi_node)) {
+		wi = rb_entry(wi_node, struct morse_twt_wake_interval, node);
 
-		seq_printf(file, "TWT Wake interval: %lluus\n", agr->data.wake_interval_us);
+		seq_printf(file, "TWT Wake interval: %lluus\n", wi->wake_interval_us);
 
-		list_for_each_entry(agr, &wi->agreements, list) {
+		for (agr_node = rb_first(&wi->agreements); agr_node;
+		     agr_node = rb_next(agr_node)) {
+			agr = rb_entry(agr_node, struct morse_twt_agreement, node);
 			seq_printf(file,
 				   "\tTWT Wake time: %llu us, Wake Duration: %u us, State: %u\n",
 				   agr->data.wake_time_us, agr->data.wake_duration_us, agr->state);
@@ -315,17 +332,12 @@ void morse_twt_dump_event(struct morse *mors, struct morse_twt_event *event)
 static struct morse_twt_sta *morse_twt_get_sta(struct morse *mors,
 					       struct morse_vif *mors_vif, u8 *addr)
 {
-	struct ieee80211_vif *vif;
 	struct morse_twt_sta *sta;
-	struct morse_twt_sta *temp;
 
 	if (!mors || !mors_vif)
 		return NULL;
 
-	vif = morse_vif_to_ieee80211_vif(mors_vif);
-
-	list_for_each_entry_safe(sta, temp, &mors_vif->twt.stas, list) {
-		MORSE_TWT_DBG(mors, "%s: STA addr %pM (want %pM)\n", __func__, sta->addr, addr);
+	hash_for_each_possible(mors_vif->twt.sta_hash, sta, hash_node, mac2uint64(addr)) {
 		if (ether_addr_equal(sta->addr, addr))
 			return sta;
 	}
@@ -363,7 +375,7 @@ static int morse_mac_send_twt_action_frame(struct morse *mors,
 
 	mors_vif = ieee80211_vif_to_morse_vif(vif);
 
-	mq = mors->cfg->ops->skbq_mgmt_tc_q(mors);
+	mq = morse_chip_if_mgmt_tc_q(mors);
 
 	skb = morse_skbq_alloc_skb(mq, sizeof(*twt_action) + twt_ie_size);
 	if (!skb)
@@ -646,53 +658,314 @@ static struct morse_twt_sta *morse_twt_add_sta(struct morse *mors, struct morse_
 	sta->dialog_token = 0;
 	sta->action_is_pending = false;
 
-	/* By initializing these agreements as list heads we can use list_empty() to see if they are
-	 * in a wake interval list or not.
-	 */
+	/* A cleared node and no wake interval means the agreement is not scheduled. */
 	for (i = 0; i < MORSE_TWT_AGREEMENTS_MAX_PER_STA; i++)
-		INIT_LIST_HEAD(&sta->agreements[i].list);
+		RB_CLEAR_NODE(&sta->agreements[i].node);
 
 	list_add_tail(&sta->list, &twt->stas);
+	hash_add(twt->sta_hash, &sta->hash_node, mac2uint64(addr));
 
 	return sta;
 }
 
 /**
- * morse_twt_agreement_remove() - Removes an agreement from a wake_interval list. Will also
- *					remove the wake interval list entry if the list becomes
- *					empty.
+ * morse_twt_wake_offset() - Offset of a wake time into its wake interval
+ *
+ * @wake_time_us	Wake time (us)
+ * @wake_interval_us	Wake interval (us)
+ *
+ * @return the offset (us) of the service period from the start of the wake interval
+ */
+static u64 morse_twt_wake_offset(u64 wake_time_us, u64 wake_interval_us)
+{
+	u64 offset_us;
+
+	if (!wake_interval_us)
+		return wake_time_us;
+
+	/* Time may have elapsed from the initial wake time so wrap values. */
+	div64_u64_rem(wake_time_us, wake_interval_us, &offset_us);
+	return offset_us;
+}
+
+static u64 morse_twt_agreement_compute_max_gap(struct morse_twt_agreement *agr)
+{
+	u64 max_gap_us = agr->gap_after_us;
+	struct morse_twt_agreement *child;
+
+	if (agr->node.rb_left) {
+		child = rb_entry(agr->node.rb_left, struct morse_twt_agreement, node);
+		max_gap_us = max(max_gap_us, child->subtree_max_gap_us);
+	}
+
+	if (agr->node.rb_right) {
+		child = rb_entry(agr->node.rb_right, struct morse_twt_agreement, node);
+		max_gap_us = max(max_gap_us, child->subtree_max_gap_us);
+	}
+
+	return max_gap_us;
+}
+
+static void morse_twt_agreement_gap_propagate(struct rb_node *rb, struct rb_node *stop)
+{
+	while (rb != stop) {
+		struct morse_twt_agreement *agr = rb_entry(rb, struct morse_twt_agreement, node);
+		u64 max_gap_us = morse_twt_agreement_compute_max_gap(agr);
+
+		if (agr->subtree_max_gap_us == max_gap_us)
+			break;
+
+		agr->subtree_max_gap_us = max_gap_us;
+		rb = rb_parent(&agr->node);
+	}
+}
+
+static void morse_twt_agreement_gap_copy(struct rb_node *rb_old, struct rb_node *rb_new)
+{
+	struct morse_twt_agreement *old = rb_entry(rb_old, struct morse_twt_agreement, node);
+	struct morse_twt_agreement *new = rb_entry(rb_new, struct morse_twt_agreement, node);
+
+	new->subtree_max_gap_us = old->subtree_max_gap_us;
+}
+
+static void morse_twt_agreement_gap_rotate(struct rb_node *rb_old, struct rb_node *rb_new)
+{
+	struct morse_twt_agreement *old = rb_entry(rb_old, struct morse_twt_agreement, node);
+	struct morse_twt_agreement *new = rb_entry(rb_new, struct morse_twt_agreement, node);
+
+	new->subtree_max_gap_us = old->subtree_max_gap_us;
+	old->subtree_max_gap_us = morse_twt_agreement_compute_max_gap(old);
+}
+
+/* Keeps the largest unallocated gap of each subtree up to date as the agreement tree changes */
+static const struct rb_augment_callbacks morse_twt_agreement_gap_callbacks = {
+	.propagate = morse_twt_agreement_gap_propagate,
+	.copy = morse_twt_agreement_gap_copy,
+	.rotate = morse_twt_agreement_gap_rotate,
+};
+
+/**
+ * morse_twt_agreement_update_gap() -	Recalculate the gap after an agreement's service period,
+ *					up to the start of the next one in the wake interval.
+ *
+ * @wi		The wake interval
+ * @agr		The TWT agreement, which must be in the agreement tree of @wi
+ */
+static void morse_twt_agreement_update_gap(struct morse_twt_wake_interval *wi,
+					   struct morse_twt_agreement *agr)
+{
+	struct rb_node *next = rb_next(&agr->node);
+	u64 end_us = agr->wake_offset_us + agr->data.wake_duration_us;
+	struct morse_twt_agreement *next_agr;
+	u64 next_start_us;
+
+	/* The last service period is followed by the first one of the next interval. */
+	if (next) {
+		next_agr = rb_entry(next, struct morse_twt_agreement, node);
+		next_start_us = next_agr->wake_offset_us;
+	} else {
+		next_agr = rb_entry(rb_first(&wi->agreements), struct morse_twt_agreement, node);
+		next_start_us = next_agr->wake_offset_us + wi->wake_interval_us;
+	}
+
+	agr->gap_after_us = next_start_us > end_us ? next_start_us - end_us : 0;
+
+	morse_twt_agreement_gap_propagate(&agr->node, NULL);
+}
+
+/**
+ * morse_twt_agreement_update_prev_gap() - Recalculate the gap before an agreement's service period
+ *
+ * @wi		The wake interval
+ * @node	The agreement tree node after the gap, or NULL for the last one
+ */
+static void morse_twt_agreement_update_prev_gap(struct morse_twt_wake_interval *wi,
+						struct rb_node *node)
+{
+	struct rb_node *prev = node ? rb_prev(node) : NULL;
+
+	/* The first service period follows the last one of the previous interval. */
+	if (!prev)
+		prev = rb_last(&wi->agreements);
+
+	if (prev)
+		morse_twt_agreement_update_gap(wi, rb_entry(prev, struct morse_twt_agreement, node));
+}
+
+/**
+ * morse_twt_agreement_tree_insert() - Insert an agreement into a wake interval's agreement tree
+ *
+ * @wi		The wake interval
+ * @agr		The TWT agreement, with its wake time set
+ */
+static void morse_twt_agreement_tree_insert(struct morse_twt_wake_interval *wi,
+					    struct morse_twt_agreement *agr)
+{
+	struct rb_node **link = &wi->agreements.rb_node;
+	struct rb_node *parent = NULL;
+	struct morse_twt_agreement *entry;
+
+	agr->wake_offset_us = morse_twt_wake_offset(agr->data.wake_time_us, wi->wake_interval_us);
+	/* The gap is filled in once the agreement is linked and its neighbours are known. */
+	agr->gap_after_us = 0;
+	agr->subtree_max_gap_us = 0;
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct morse_twt_agreement, node);
+
+		if (agr->wake_offset_us < entry->wake_offset_us)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&agr->node, parent, link);
+	rb_insert_augmented(&agr->node, &wi->agreements, &morse_twt_agreement_gap_callbacks);
+	agr->wi = wi;
+
+	morse_twt_agreement_update_gap(wi, agr);
+	morse_twt_agreement_update_prev_gap(wi, &agr->node);
+}
+
+/**
+ * morse_twt_agreement_first_fit() -	Find the earliest service period in a wake interval which
+ *					is followed by a gap of at least the requested duration.
+ *
+ * @wi		The wake interval, which must contain at least one agreement
+ * @duration_us	Duration (us) of the service period to fit
+ *
+ * @return The agreement to schedule after, or NULL if there is no gap large enough.
+ */
+static struct morse_twt_agreement *
+morse_twt_agreement_first_fit(struct morse_twt_wake_interval *wi, u64 duration_us)
+{
+	struct rb_node *node = wi->agreements.rb_node;
+	struct morse_twt_agreement *agr;
+	struct morse_twt_agreement *left;
+
+	while (node) {
+		agr = rb_entry(node, struct morse_twt_agreement, node);
+
+		if (node->rb_left) {
+			left = rb_entry(node->rb_left, struct morse_twt_agreement, node);
+			if (left->subtree_max_gap_us >= duration_us) {
+				node = node->rb_left;
+				continue;
+			}
+		}
+
+		if (agr->gap_after_us >= duration_us)
+			return agr;
+
+		node = node->rb_right;
+	}
+
+	return NULL;
+}
+
+/**
+ * morse_twt_agreement_largest_gap() -	Find the service period in a wake interval which is followed
+ *					by the largest gap.
+ *
+ * @wi		The wake interval, which must contain at least one agreement
+ *
+ * @return The agreement followed by the largest gap
+ */
+static struct morse_twt_agreement *
+morse_twt_agreement_largest_gap(struct morse_twt_wake_interval *wi)
+{
+	struct rb_node *node = wi->agreements.rb_node;
+	struct morse_twt_agreement *agr;
+	u64 max_gap_us;
+
+	agr = rb_entry(node, struct morse_twt_agreement, node);
+	max_gap_us = agr->subtree_max_gap_us;
+
+	while (agr->gap_after_us != max_gap_us) {
+		struct morse_twt_agreement *child;
+
+		child = node->rb_left ? rb_entry(node->rb_left, struct morse_twt_agreement, node) :
+					NULL;
+		if (child && child->subtree_max_gap_us == max_gap_us)
+			node = node->rb_left;
+		else
+			node = node->rb_right;
+
+		agr = rb_entry(node, struct morse_twt_agreement, node);
+	}
+
+	return agr;
+}
+
+static struct morse_twt_wake_interval *morse_twt_wake_interval_alloc(struct morse_twt *twt)
+{
+	struct morse_twt_wake_interval *wi;
+
+	wi = list_first_entry_or_null(&twt->wake_interval_pool, struct morse_twt_wake_interval,
+				      pool);
+	if (wi) {
+		list_del(&wi->pool);
+		return wi;
+	}
+
+	return kmalloc(sizeof(*wi), GFP_ATOMIC);
+}
+
+static void morse_twt_wake_interval_release(struct morse_twt *twt,
+					    struct morse_twt_wake_interval *wi)
+{
+	list_add(&wi->pool, &twt->wake_interval_pool);
+}
+
+static void morse_twt_wake_interval_pool_free(struct morse_twt *twt)
+{
+	struct morse_twt_wake_interval *wi;
+	struct morse_twt_wake_interval *temp;
+
+	list_for_each_entry_safe(wi, temp, &twt->wake_interval_pool, pool) {
+		list_del(&wi->pool);
+		kfree(wi);
+	}
+}
+
+/**
+ * morse_twt_agreement_remove() - Removes an agreement from a wake interval. Will also
+ *					remove the wake interval if it becomes empty.
  *
  * @mors	Morse device
+ * @twt		The TWT struct
  * @agr		The TWT agreement
  *
  * @return 0 on success, else error code
  */
-static int morse_twt_agreement_remove(struct morse *mors, struct morse_twt_agreement *agr)
+static int morse_twt_agreement_remove(struct morse *mors, struct morse_twt *twt,
+				      struct morse_twt_agreement *agr)
 {
-	struct list_head *prev;
 	struct morse_twt_wake_interval *wi;
+	struct rb_node *next;
 
 	if (!mors || !agr)
 		return -EINVAL;
 
-	if (list_empty(&agr->list)) {
-		MORSE_TWT_DBG(mors, "Agreement not in wake interval list - skipping\n");
+	wi = agr->wi;
+	if (!wi) {
+		MORSE_TWT_DBG(mors, "Agreement not in wake interval tree - skipping\n");
 		return 0;
 	}
 
-	prev = agr->list.prev;
-	/* list_del_init() is used so we can use list_empty() afterwards since the STA may still
-	 * exist.
-	 */
-	list_del_init(&agr->list);
+	next = rb_next(&agr->node);
+	rb_erase_augmented(&agr->node, &wi->agreements, &morse_twt_agreement_gap_callbacks);
+	/* The STA may still exist, so mark the agreement as no longer scheduled. */
+	RB_CLEAR_NODE(&agr->node);
+	agr->wi = NULL;
 
-	/* If the previous list entry is empty it must be the head. Remove wake interval head if it
-	 * is now empty.
-	 */
-	if (list_empty(prev)) {
-		wi = container_of(prev, struct morse_twt_wake_interval, agreements);
-		list_del(&wi->list);
-		kfree(wi);
+	morse_twt_agreement_update_prev_gap(wi, next);
+
+	/* Remove the wake interval if it is now empty. */
+	if (RB_EMPTY_ROOT(&wi->agreements)) {
+		rb_erase(&wi->node, &twt->wake_intervals);
+		morse_twt_wake_interval_release(twt, wi);
 	}
 
 	return 0;
@@ -725,7 +998,7 @@ static int morse_twt_sta_remove(struct morse *mors,
 	/* Remove each agreement from the wake interval linked list. */
 	for (i = 0; i < MORSE_TWT_AGREEMENTS_MAX_PER_STA; i++) {
 		MORSE_TWT_DBG(mors, "Remove TWT agreement %u\n", i);
-		morse_twt_agreement_remove(mors, &sta->agreements[i]);
+		morse_twt_agreement_remove(mors, twt, &sta->agreements[i]);
 	}
 	/* Clear STA VIF */
 	if (vif->type == NL80211_IFTYPE_STATION) {
@@ -736,6 +1009,7 @@ static int morse_twt_sta_remove(struct morse *mors,
 	/* Remove the agreements from the sta list and purge queues. */
 	morse_twt_tx_queue_purge(mors, twt, sta->addr);
 	list_del(&sta->list);
+	hash_del(&sta->hash_node);
 	kfree(sta);
 	return 0;
 }
@@ -753,6 +1027,71 @@ int morse_twt_sta_remove_addr(struct morse *mors, struct morse_vif *mors_vif, u8
 	return ret;
 }
 
+/**
+ * morse_twt_agreement_tx_hold_us() - Time until downlink for an agreement should be released
+ *
+ * @agr		The TWT agreement
+ * @now_us	Current time (us)
+ * @lead_us	How long before the start of the service period frames are released
+ *
+ * @return 0 if within the release window, otherwise the time (us) until it opens
+ */
+static u64 morse_twt_agreement_tx_hold_us(const struct morse_twt_agreement *agr, u64 now_us,
+					  u32 lead_us)
+{
+	const u64 interval_us = agr->data.wake_interval_us;
+	const u64 duration_us = agr->data.wake_duration_us;
+	u64 phase_us;
+
+	/* The station wakes continuously or more often than we could hold for */
+	if (!interval_us || duration_us + lead_us >= interval_us)
+		return 0;
+
+	if (now_us < agr->data.wake_time_us) {
+		u64 first_sp_us = agr->data.wake_time_us - now_us;
+
+		return first_sp_us > lead_us ? first_sp_us - lead_us : 0;
+	}
+
+	div64_u64_rem(now_us - agr->data.wake_time_us, interval_us, &phase_us);
+
+	/* Within the service period, or the lead in to the next one */
+	if (phase_us < duration_us || phase_us >= interval_us - lead_us)
+		return 0;
+
+	return interval_us - lead_us - phase_us;
+}
+
+u32 morse_twt_tx_hold_us(struct morse_vif *mors_vif, const u8 *addr, u64 now_us, u32 lead_us)
+{
+	struct morse *mors = morse_vif_to_morse(mors_vif);
+	struct morse_twt *twt = &mors_vif->twt;
+	struct morse_twt_sta *sta;
+	u64 hold_us = U64_MAX;
+	int i;
+
+	if (!twt->responder)
+		return 0;
+
+	spin_lock_bh(&twt->lock);
+	sta = morse_twt_get_sta(mors, mors_vif, (u8 *)addr);
+	for (i = 0; sta && i < MORSE_TWT_AGREEMENTS_MAX_PER_STA && hold_us; i++) {
+		const struct morse_twt_agreement *agr = &sta->agreements[i];
+
+		if (agr->state != MORSE_TWT_STATE_AGREEMENT)
+			continue;
+
+		hold_us = min(hold_us, morse_twt_agreement_tx_hold_us(agr, now_us, lead_us));
+	}
+	spin_unlock_bh(&twt->lock);
+
+	/* No agreements, nothing to wait for */
+	if (hold_us == U64_MAX)
+		return 0;
+
+	return min_t(u64, hold_us, U32_MAX);
+}
+
 /**
  * morse_twt_sta_remove_all() - Removes all of the stations from the TWT station list.
  *
@@ -803,7 +1142,7 @@ static int morse_twt_sta_agreement_remove(struct morse *mors,
 
 	agr = &sta->agreements[flow_id];
 	WARN_ON_ONCE(agr->state != MORSE_TWT_STATE_NO_AGREEMENT);
-	morse_twt_agreement_remove(mors, agr);
+	morse_twt_agreement_remove(mors, twt, agr);
 
 	/* Check if there are any agreements and remove STA if there aren't any. */
 	for (i = 0; i < MORSE_TWT_AGREEMENTS_MAX_PER_STA; i++) {
@@ -832,79 +1171,55 @@ static int morse_twt_sta_agreement_add(struct morse *mors,
 }
 
 /**
- * morse_twt_agreement_wake_interval_get() -	Get the wake interval list head. Creates one if it
+ * morse_twt_agreement_wake_interval_get() -	Get the wake interval node. Creates one if it
  *						doesn't exits already.
  *
  * @mors		Morse device
  * @twt			The TWT struct
  * @wake_interval_us	The wake interval (us) to search for
  *
- * @return A wake interval head struct on success otherwise NULL.
+ * @return A wake interval node on success otherwise NULL.
  */
 static struct morse_twt_wake_interval *morse_twt_agreement_wake_interval_get(struct morse *mors,
 									     struct morse_twt *twt,
 									     u64 wake_interval_us)
 {
-	struct list_head *head;
+	struct rb_node **link;
+	struct rb_node *parent = NULL;
 	struct morse_twt_wake_interval *wi;
-	struct morse_twt_wake_interval *temp;
-	struct morse_twt_agreement *agr;
 
 	if (!twt)
 		return NULL;
 
-	head = &twt->wake_intervals;
-
-	if (list_empty(&twt->wake_intervals)) {
-		wi = kmalloc(sizeof(*wi), GFP_ATOMIC);
-		if (!wi)
-			return NULL;
-		INIT_LIST_HEAD(&wi->agreements);
-		list_add(&wi->list, head);
-		return wi;
-	}
-
-	list_for_each_entry(wi, head, list) {
-		u64 wi_us;
-
-		/* Find this wake interval by looking at the first agreement */
-		agr = list_first_entry_or_null(&wi->agreements, struct morse_twt_agreement, list);
-		if (!agr)
-			return NULL;
-
-		wi_us = agr->data.wake_interval_us;
+	link = &twt->wake_intervals.rb_node;
+	while (*link) {
+		parent = *link;
+		wi = rb_entry(parent, struct morse_twt_wake_interval, node);
 
 		/* We found the exact value. */
-		if (wi_us == wake_interval_us) {
+		if (wake_interval_us == wi->wake_interval_us)
 			return wi;
-			/* The exact value doesn't exist but a larger one is in the list. */
-		} else if (wi_us > wake_interval_us) {
-			temp = kmalloc(sizeof(*temp), GFP_ATOMIC);
-			if (!temp)
-				return NULL;
-			INIT_LIST_HEAD(&temp->agreements);
-			if (wi->list.prev == head)
-				list_add(&temp->list, head);
-			else
-				list_add(&temp->list, &list_prev_entry(wi, list)->list);
-
-			return temp;
-			/* The exact value is not in the list and there are no larger ones. */
-		} else if (wi->list.next == head) {
-			temp = kmalloc(sizeof(*temp), GFP_ATOMIC);
-			if (!temp)
-				return NULL;
-			INIT_LIST_HEAD(&temp->agreements);
-			list_add_tail(&temp->list, head);
-			return temp;
-		}
+
+		if (wake_interval_us < wi->wake_interval_us)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
 	}
 
-	return NULL;
+	wi = morse_twt_wake_interval_alloc(twt);
+	if (!wi)
+		return NULL;
+
+	wi->wake_interval_us = wake_interval_us;
+	wi->agreements = RB_ROOT;
+	rb_link_node(&wi->node, parent, link);
+	rb_insert_color(&wi->node, &twt->wake_intervals);
+
+	return wi;
 }
 
 /**
- * morse_twt_agreement_wake_interval_add() -	Adds an agreement to a wake interval list.
+ * morse_twt_agreement_wake_interval_add() -	Adds an agreement to a wake interval.
  *
  * @mors	Morse device
  * @twt		The TWT struct
@@ -918,85 +1233,65 @@ static int morse_twt_agreement_wake_interval_add(struct morse *mors,
 {
 	struct morse_twt_wake_interval *wi;
 	struct morse_twt_agreement *ptr;
-	struct morse_twt_agreement *ptr_next;
+	u64 centre_us = 0;
 
 	/* Agreement is not accepted until the accept message is sent. */
 	if (!agr ||
 	    agr->state == MORSE_TWT_STATE_NO_AGREEMENT || agr->state == MORSE_TWT_STATE_AGREEMENT)
 		return -EINVAL;
 
-	MORSE_TWT_DBG(mors, "Get TWT wake interval head for %lluus\n", agr->data.wake_interval_us);
+	MORSE_TWT_DBG(mors, "Get TWT wake interval for %lluus\n", agr->data.wake_interval_us);
 
-	/* Obtain the wake interval list for the specified wake interval. */
+	/* Obtain the wake interval node for the specified wake interval. */
 	wi = morse_twt_agreement_wake_interval_get(mors, twt, agr->data.wake_interval_us);
 	if (!wi)
-		return -EINVAL;
+		return -ENOMEM;
 
-	if (list_empty(&wi->agreements)) {
+	if (RB_EMPTY_ROOT(&wi->agreements)) {
 		agr->data.wake_time_us = 0;
-		list_add(&agr->list, &wi->agreements);
+		morse_twt_agreement_tree_insert(wi, agr);
 		MORSE_TWT_DBG(mors, "First TWT entry for wake interval %lluus\n",
 			  agr->data.wake_interval_us);
 		return 0;
 	}
 
-	/* For now just add accepted 'Demand' agreements to the end. */
+	/* 'Demand' agreements keep their requested wake time. */
 	if (morse_twt_get_command(agr->data.params.req_type) == TWT_SETUP_CMD_DEMAND) {
-		list_add_tail(&agr->list, &wi->agreements);
-		MORSE_TWT_DBG(mors, "Demand TWT entry for wake time %lluus added to tail\n",
+		morse_twt_agreement_tree_insert(wi, agr);
+		MORSE_TWT_DBG(mors, "Demand TWT entry for wake time %lluus added\n",
 			  agr->data.wake_time_us);
 		return 0;
 	}
 
-	/* Iterate through the list of agreements with the same wake interval. Either insert into a
-	 * gap which is large enough or add to the end. The wake time of the first agreement is used
-	 * as the reference. The firmware is left to calculate the next service period based on the
-	 * wake time and wake interval.
+	/* Insert into a gap which is large enough, or after the last service period if there are
+	 * none. The firmware is left to calculate the next service period based on the wake time
+	 * and wake interval.
 	 */
-	list_for_each_entry(ptr, &wi->agreements, list) {
-		u64 cur_next_wake_offset_us;
-		u64 next_next_wake_offset_us;
-		u64 unalloc_dur_us;
-
-		if (list_is_last(&ptr->list, &wi->agreements)) {
-			agr->data.wake_time_us =
-			    ptr->data.wake_time_us + ptr->data.wake_duration_us;
-
-			list_add(&agr->list, &ptr->list);
-			return 0;
-		}
-
-		/* Time may have elapsed from the initial wake time so wrap values. */
-		ptr_next = list_next_entry(ptr, list);
-		div64_u64_rem(ptr->data.wake_time_us,
-			      ptr->data.wake_interval_us, &cur_next_wake_offset_us);
-		div64_u64_rem(ptr_next->data.wake_time_us,
-			      ptr_next->data.wake_interval_us, &next_next_wake_offset_us);
+	if (twt_schedule_policy == MORSE_TWT_SCHEDULE_SPREAD) {
+		ptr = morse_twt_agreement_largest_gap(wi);
+		centre_us = ptr->gap_after_us > agr->data.wake_duration_us ?
+			    (ptr->gap_after_us - agr->data.wake_duration_us) / 2 : 0;
+		if (ptr->gap_after_us < agr->data.wake_duration_us)
+			ptr = NULL;
+	} else {
+		ptr = morse_twt_agreement_first_fit(wi, agr->data.wake_duration_us);
+	}
 
-		/* If the next agreement offset is before the previous unwrap once to preserve
-		 * order.
-		 */
-		if (cur_next_wake_offset_us > next_next_wake_offset_us)
-			next_next_wake_offset_us += ptr->data.wake_interval_us;
-
-		/* Calculate gap between consecutive TWT service periods. */
-		unalloc_dur_us = next_next_wake_offset_us -
-		    (cur_next_wake_offset_us + ptr->data.wake_duration_us);
-
-		/* Service period fits between the current and next service periods. */
-		if (unalloc_dur_us >= agr->data.wake_duration_us) {
-			/* Adjust wake time to align with the end of the previous service period. */
-			agr->data.wake_time_us =
-			    ptr->data.wake_time_us + ptr->data.wake_duration_us;
-
-			list_add(&agr->list, &ptr->list);
-			MORSE_TWT_DBG(mors, "Added TWT entry for wake time %llu\n",
-				  agr->data.wake_time_us);
-			return 0;
-		}
+	if (!ptr) {
+		ptr = rb_entry(rb_last(&wi->agreements), struct morse_twt_agreement, node);
+		centre_us = 0;
+		MORSE_TWT_DBG(mors, "No gap for %uus in wake interval %lluus, SPs will overlap\n",
+			      agr->data.wake_duration_us, wi->wake_interval_us);
 	}
 
-	return -EBADSLT;
+	/* Adjust wake time to align with the end of the previous service period, or the middle
+	 * of the gap when spreading.
+	 */
+	agr->data.wake_time_us = ptr->data.wake_time_us + ptr->data.wake_duration_us + centre_us;
+	morse_twt_agreement_tree_insert(wi, agr);
+	MORSE_TWT_DBG(mors, "Added TWT entry for wake time %llu\n", agr->data.wake_time_us);
+
+	return 0;
 }
 
 /**
@@ -1990,12 +2285,23 @@ int morse_twt_init(struct morse *mors)
 
 int morse_twt_init_vif(struct morse *mors, struct morse_vif *mors_vif)
 {
+	int i;
+
 	if (!mors || !mors_vif)
 		return -EINVAL;
 
 	spin_lock_init(&mors_vif->twt.lock);
 	INIT_LIST_HEAD(&mors_vif->twt.stas);
-	INIT_LIST_HEAD(&mors_vif->twt.wake_intervals);
+	hash_init(mors_vif->twt.sta_hash);
+	mors_vif->twt.wake_intervals = RB_ROOT;
+	INIT_LIST_HEAD(&mors_vif->twt.wake_interval_pool);
+	for (i = 0; i < MORSE_TWT_WAKE_INTERVAL_PREALLOC; i++) {
+		struct morse_twt_wake_interval *wi = kmalloc(sizeof(*wi), GFP_KERNEL);
+
+		if (!wi)
+			break;
+		morse_twt_wake_interval_release(&mors_vif->twt, wi);
+	}
 	INIT_LIST_HEAD(&mors_vif->twt.events);
 	INIT_LIST_HEAD(&mors_vif->twt.tx);
 	mors_vif->twt.dialog_token = 0;
@@ -2024,6 +2330,7 @@ int morse_twt_finish_vif(struct morse *mors, struct morse_vif *mors_vif)
 	morse_twt_sta_remove_all(mors, twt);
 	morse_twt_tx_queue_purge(mors, twt, NULL);
 	morse_twt_to_install_queue_purge(mors, twt, NULL);
+	morse_twt_wake_interval_pool_free(twt);
 	spin_unlock_bh(&twt->lock);
 	morse_twt_event_queue_purge(mors, mors_vif, NULL);
 	return 0;
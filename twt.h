@@ -10,6 +10,7 @@
 
 #include <linux/types.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/workqueue.h>
 #include <net/netlink.h>
 
@@ -28,6 +29,9 @@
 #define TWT_AGREEMENT_WAKE_INTERVAL_MANTISSA_OFFSET	(12)
 #define TWT_TEARDOWN_FLOW_ID_MASK GENMASK(2, 0)
 
+/* Number of wake interval nodes preallocated per VIF */
+#define MORSE_TWT_WAKE_INTERVAL_PREALLOC		(8)
+
 enum morse_twt_state {
 	MORSE_TWT_STATE_NO_AGREEMENT,
 	MORSE_TWT_STATE_CONSIDER_REQUEST,
@@ -51,8 +55,19 @@ struct morse_twt_agreement_data {
 	struct ieee80211_twt_params params;
 } __packed;
 
+struct morse_twt_wake_interval;
+
 struct morse_twt_agreement {
-	struct list_head list;
+	/* Node in the wake interval agreement tree, cleared when not in a tree */
+	struct rb_node node;
+	/* Wake interval this agreement is scheduled in, NULL if none */
+	struct morse_twt_wake_interval *wi;
+	/* Offset of the service period into the wake interval, the key in the agreement tree */
+	u64 wake_offset_us;
+	/* Unallocated time between the end of this service period and the start of the next */
+	u64 gap_after_us;
+	/* Largest gap_after_us in the subtree rooted at this agreement */
+	u64 subtree_max_gap_us;
 	enum morse_twt_state state;
 	struct morse_twt_agreement_data data;
 };
@@ -106,6 +121,7 @@ struct morse_dot11ah_s1g_twt_action {
 
 struct morse_twt_sta {
 	struct list_head list;
+	struct hlist_node hash_node;
 	u8 addr[ETH_ALEN];
 	/* dialog token of pending action frame */
 	u8 dialog_token;
@@ -115,8 +131,16 @@ struct morse_twt_sta {
 };
 
 struct morse_twt_wake_interval {
-	struct list_head list;
-	struct list_head agreements;
+	union {
+		/* Node in the wake interval tree */
+		struct rb_node node;
+		/* Entry in the wake interval pool while unused */
+		struct list_head pool;
+	};
+	/* Wake interval of all agreements in this node, the key in the wake interval tree */
+	u64 wake_interval_us;
+	/* Agreements ordered by wake offset, augmented with the largest gap in each subtree */
+	struct rb_root agreements;
 };
 
 static inline struct morse_vif *morse_twt_to_morse_vif(struct morse_twt *twt)
@@ -144,6 +168,21 @@ void morse_twt_event_queue_purge(struct morse *mors, struct morse_vif *mors_vif,
  */
 int morse_twt_sta_remove_addr(struct morse *mors, struct morse_vif *mors_vif, u8 *addr);
 
+/**
+ * morse_twt_tx_hold_us() - Time until downlink to a TWT station should next be released
+ *
+ * Frames for a station with TWT agreements are released from @lead_us before the start of one
+ * of its service periods until the service period ends.
+ *
+ * @mors_vif	Morse virtual interface (AP)
+ * @addr	Address of the station
+ * @now_us	Current time (us), on the same time base as the agreement wake times
+ * @lead_us	How long before the start of a service period frames are released
+ *
+ * Return:	0 if frames for the station may be sent now, otherwise the time (us) until they may
+ */
+u32 morse_twt_tx_hold_us(struct morse_vif *mors_vif, const u8 *addr, u64 now_us, u32 lead_us);
+
 /**
  * morse_twt_insert_ie() - Insert a TWT IE into an sk_buff
  *
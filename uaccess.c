@@ -11,6 +11,8 @@
 #include <linux/device.h>
 #include <linux/mutex.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
 
 /* Char device */
 #include <linux/cdev.h>
@@ -23,10 +25,12 @@
 #define MORSE_DEV_FILE			MORSE_DEV_NAME "_io"
 #define MORSE_NUM_OF_UACCESS_DEVICES	4
 #define MORSE_DEV_PERMISSIONS		0666
-#define UACCESS_BUFFER_SIZE		((size_t)(64 * 512))
+/* Staging buffer per open file, also mapped into user space by mmap() */
+#define UACCESS_BUFFER_SIZE		((size_t)(8 * 64 * 512))
 
 struct uaccess_file_descriptor {
 	struct morse *mors;
+	/* Page aligned staging buffer of UACCESS_BUFFER_SIZE bytes */
 	u8 *data;
 	u32 address;
 	/* Serialise read and write access */
@@ -52,7 +56,7 @@ static int uaccess_open(struct inode *inode, struct file *filp)
 		ret = -ENOMEM;
 		goto exit;
 	}
-	des->data = kmalloc(UACCESS_BUFFER_SIZE, GFP_KERNEL);
+	des->data = vmalloc_user(UACCESS_BUFFER_SIZE);
 	if (!des->data) {
 		ret = -ENOMEM;
 		goto free_desc;
@@ -73,7 +77,7 @@ static int uaccess_release(struct inode *inode, struct file *filp)
 	int ret = 0;
 	struct uaccess_file_descriptor *des = filp->private_data;
 
-	kfree(des->data);
+	vfree(des->data);
 	mutex_destroy(&des->lock);
 	kfree(des);
 	return ret;
@@ -89,12 +93,11 @@ static ssize_t uaccess_write(struct file *filp, const char __user *buf, size_t c
 
 	if (mutex_lock_interruptible(&des->lock))
 		return -ERESTARTSYS;
+	count = min(count, UACCESS_BUFFER_SIZE);
 	if (copy_from_user(des->data, buf, count)) {
 		MORSE_PR_ERR(FEATURE_ID_DEFAULT, "copy_from_user failed\n");
 		ret = -EFAULT;
 	} else {
-		count = min(count, UACCESS_BUFFER_SIZE);
-
 		morse_claim_bus(des->mors);
 		if (count == sizeof(u32)) {
 			u32 value = *((u32 *)des->data);
@@ -150,13 +153,104 @@ static ssize_t uaccess_read(struct file *filp, char __user *buf, size_t count, l
 	return ret;
 }
 
+static int uaccess_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct uaccess_file_descriptor *des = filp->private_data;
+
+	if (vma->vm_pgoff || (vma->vm_end - vma->vm_start) > UACCESS_BUFFER_SIZE)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, des->data, 0);
+}
+
+/**
+ * Execute a vector of chip memory accesses against the staging buffer under one bus claim.
+ * Must be called with the descriptor lock held.
+ *
+ * @des File descriptor state
+ * @uxfer User pointer to a &struct uaccess_xfer
+ * @return Number of operations completed, or a negative error code if none were completed
+ */
+static long uaccess_xfer(struct uaccess_file_descriptor *des, const void __user *uxfer)
+{
+	struct uaccess_xfer xfer;
+	struct uaccess_xfer_op *ops;
+	long ret = 0;
+	u32 i;
+
+	if (copy_from_user(&xfer, uxfer, sizeof(xfer)))
+		return -EFAULT;
+
+	if (!xfer.n_ops || xfer.n_ops > UACCESS_XFER_MAX_OPS || xfer.reserved)
+		return -EINVAL;
+
+	ops = kmalloc_array(xfer.n_ops, sizeof(*ops), GFP_KERNEL);
+	if (!ops)
+		return -ENOMEM;
+
+	if (copy_from_user(ops, u64_to_user_ptr(xfer.ops), xfer.n_ops * sizeof(*ops))) {
+		ret = -EFAULT;
+		goto exit;
+	}
+
+	/* Validate everything up front so a bad vector does not touch the chip */
+	for (i = 0; i < xfer.n_ops; i++) {
+		if (!ops[i].length || ops[i].length > UACCESS_BUFFER_SIZE ||
+		    ops[i].offset > UACCESS_BUFFER_SIZE - ops[i].length ||
+		    (ops[i].flags & ~UACCESS_XFER_WRITE)) {
+			ret = -EINVAL;
+			goto exit;
+		}
+	}
+
+	morse_claim_bus(des->mors);
+	for (i = 0; i < xfer.n_ops; i++) {
+		struct uaccess_xfer_op *op = &ops[i];
+		u8 *data = des->data + op->offset;
+		int rc;
+
+		if (op->flags & UACCESS_XFER_WRITE) {
+			if (op->length == sizeof(u32))
+				rc = morse_reg32_write(des->mors, op->address,
+						       cpu_to_le32(get_unaligned((u32 *)data)));
+			else
+				rc = morse_dm_write(des->mors, op->address, data, op->length);
+		} else {
+			if (op->length == sizeof(u32)) {
+				u32 value;
+
+				rc = morse_reg32_read(des->mors, op->address, &value);
+				put_unaligned(value, (u32 *)data);
+			} else {
+				rc = morse_dm_read(des->mors, op->address, data, op->length);
+			}
+		}
+
+		if (rc < 0) {
+			MORSE_PR_ERR(FEATURE_ID_DEFAULT,
+				     "xfer op %u failed (errno=%d, address=0x%04X, length=%u)\n",
+				     i, rc, op->address, op->length);
+			if (!i)
+				ret = -EFAULT;
+			break;
+		}
+	}
+	morse_release_bus(des->mors);
+
+	if (i)
+		ret = i;
+exit:
+	kfree(ops);
+	return ret;
+}
+
 /*
  * The ioctl() implementation
  */
 static long uaccess_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	int err = 0;
-	int ret = 0;
+	long ret = 0;
 	struct uaccess_file_descriptor *des = filp->private_data;
 
 	/* Extract the type and number bitfields.
@@ -200,6 +294,9 @@ static long uaccess_ioctl(struct file *filp, unsigned int cmd, unsigned long arg
 	case UACCESS_IOC_SET_ADDRESS:
 		des->address = (u32)arg;
 		break;
+	case UACCESS_IOC_XFER:
+		ret = uaccess_xfer(des, (const void __user *)arg);
+		break;
 	default:		/*  redundant, as cmd was checked against MAXNR */
 		MORSE_PR_WARN(FEATURE_ID_DEFAULT, "Redundant IOCTL\n");
 		ret = -ENOTTY;
@@ -215,6 +312,7 @@ static const struct file_operations uaccess_fops = {
 	.read = uaccess_read,
 	.write = uaccess_write,
 	.unlocked_ioctl = uaccess_ioctl,
+	.mmap = uaccess_mmap,
 	.open = uaccess_open,
 	.release = uaccess_release,
 };
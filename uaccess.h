@@ -8,10 +8,47 @@
  *
  */
 #include <linux/cdev.h>
+#include <linux/types.h>
+
+/** Operation flag: write the staging buffer to chip memory rather than read into it */
+#define UACCESS_XFER_WRITE	BIT(0)
+
+/** Maximum number of operations in a single UACCESS_IOC_XFER request */
+#define UACCESS_XFER_MAX_OPS	(256)
+
+/**
+ * A single chip memory access performed by UACCESS_IOC_XFER.
+ *
+ * @address Chip address to access
+ * @length Number of bytes to transfer. A length of 4 is done as a single register access
+ * @offset Offset of the data in the staging buffer (see mmap on the device)
+ * @flags Bitmask of UACCESS_XFER_* flags
+ */
+struct uaccess_xfer_op {
+	__u32 address;
+	__u32 length;
+	__u32 offset;
+	__u32 flags;
+};
+
+/**
+ * A vector of chip memory accesses, executed in order under a single bus claim.
+ *
+ * @ops User pointer to an array of @n_ops &struct uaccess_xfer_op
+ * @n_ops Number of operations, at most UACCESS_XFER_MAX_OPS
+ * @reserved Must be zero
+ */
+struct uaccess_xfer {
+	__u64 ops;
+	__u32 n_ops;
+	__u32 reserved;
+};
 
 #define UACCESS_IOC_MAGIC	'k'
-#define UACCESS_IOC_MAXNR	1
+#define UACCESS_IOC_MAXNR	2
 #define UACCESS_IOC_SET_ADDRESS	_IO(UACCESS_IOC_MAGIC, 1)
+/* Returns the number of operations completed; stops at the first failure */
+#define UACCESS_IOC_XFER	_IOW(UACCESS_IOC_MAGIC, 2, struct uaccess_xfer)
 
 struct uaccess {
 	struct class *drv_class;
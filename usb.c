@@ -15,6 +15,8 @@
 #define MORSE_USB_INTERRUPT_INTERVAL	8		/* High speed USB 8 * 125usec = 1msec */
 #define USB_MAX_TRANSFER_SIZE		(16 * 1024)	/* Max bytes per USB read/write */
 #define MORSE_EP_INT_BUFFER_SIZE	8
+#define MORSE_USB_MAX_XFERS		8		/* Most memory transfers in flight */
+#define MORSE_USB_XFER_TIMEOUT_MS	1000		/* Wait for outstanding transfers */
 
 /* Define these values to match your devices */
 #define MORSE_VENDOR_ID			0x325b
@@ -22,7 +24,7 @@
 #define MORSE_MM810X_PRODUCT_ID		0x8100
 
 /** Power management runtime auto-suspend delay value in milliseconds */
-#define PM_RUNTIME_AUTOSUSPEND_DELAY_MS 100
+#define PM_RUNTIME_AUTOSUSPEND_DELAY_MS 50
 
 #define MORSE_USB_DBG(_m, _f, _a...)		morse_dbg(FEATURE_ID_USB, _m, _f, ##_a)
 #define MORSE_USB_INFO(_m, _f, _a...)		morse_info(FEATURE_ID_USB, _m, _f, ##_a)
@@ -39,6 +41,29 @@ enum morse_usb_endpoints {
 	MORSE_EP_EP_MAX,
 };
 
+/**
+ * struct morse_usb_xfer - A memory transfer slot: a command and its bulk data stage
+ *
+ * @cmd_urb: Carries the command on the memory OUT endpoint
+ * @data_urb: Carries the data on the memory IN or OUT endpoint
+ * @cmd: DMA-safe command buffer
+ * @buffer: DMA-safe data buffer of USB_MAX_TRANSFER_SIZE bytes
+ * @dest: Where read data is copied on completion, NULL for writes
+ * @len: Length of the data stage
+ * @pending: URBs of this slot that have not completed yet
+ * @musb: Owning device
+ */
+struct morse_usb_xfer {
+	struct urb *cmd_urb;
+	struct urb *data_urb;
+	struct morse_usb_command *cmd;
+	u8 *buffer;
+	u8 *dest;
+	u32 len;
+	atomic_t pending;
+	struct morse_usb *musb;
+};
+
 struct morse_usb_endpoint {
 	unsigned char *buffer;	/* the buffer to send/receive data */
 	struct urb *urb;	/* the urb to read/write data with */
@@ -47,7 +72,9 @@ struct morse_usb_endpoint {
 };
 
 enum morse_usb_flags {
-	MORSE_USB_FLAG_ATTACHED
+	MORSE_USB_FLAG_ATTACHED,
+	/* Runtime suspended, only the interrupt URB needs resubmitting on resume */
+	MORSE_USB_FLAG_AUTOSUSPENDED,
 };
 
 struct morse_usb {
@@ -75,6 +102,20 @@ struct morse_usb {
 
 	/* Bitmask of flags for state of USB device */
 	unsigned long flags;
+
+	/* Memory transfer slots, used round robin so several are in flight at once */
+	struct morse_usb_xfer xfers[MORSE_USB_MAX_XFERS];
+	int num_xfers;
+	/* All submitted memory transfer URBs */
+	struct usb_anchor xfer_anchor;
+	/* Woken when a memory transfer slot completes */
+	wait_queue_head_t xfer_wait;
+	/* First error reported by a memory transfer URB */
+	atomic_t xfer_error;
+
+	/* Runtime PM cycles taken, and when the last runtime suspend started */
+	u32 autosuspends;
+	u64 autosuspend_start_ns;
 };
 
 /*
@@ -102,6 +143,16 @@ static const struct usb_device_id morse_usb_table[] = {
 
 MODULE_DEVICE_TABLE(usb, morse_usb_table);
 
+static uint usb_max_in_flight __read_mostly = 1;
+module_param(usb_max_in_flight, uint, 0444);
+MODULE_PARM_DESC(usb_max_in_flight,
+		 "Memory transfers kept in flight on the bulk endpoints (1 to 8, 1 disables pipelining)");
+
+static uint usb_autosuspend_delay_ms __read_mostly = PM_RUNTIME_AUTOSUSPEND_DELAY_MS;
+module_param(usb_autosuspend_delay_ms, uint, 0644);
+MODULE_PARM_DESC(usb_autosuspend_delay_ms,
+		 "Idle time in milliseconds before the USB device is runtime suspended");
+
 #ifdef CONFIG_MORSE_USER_ACCESS
 struct uaccess *morse_usb_uaccess;
 #endif
@@ -320,178 +371,203 @@ int morse_usb_ndr_reset(struct morse *mors)
 	return ret;
 }
 
-static void morse_usb_mem_rw_callback(struct urb *urb)
+static void morse_usb_xfer_note_status(struct morse_usb_xfer *xf, const struct urb *urb)
 {
-	struct morse *mors = urb->context;
-	struct morse_usb *musb = (struct morse_usb *)mors->drv_priv;
+	struct morse *mors = usb_get_intfdata(xf->musb->interface);
 
 	MORSE_USB_DBG(mors, "%s status: %d\n", __func__, urb->status);
 	/* sync/async unlink faults aren't errors */
-	if (urb->status) {
-		if (!(urb->status == -ENOENT ||
-		      urb->status == -ECONNRESET || urb->status == -ESHUTDOWN))
-			MORSE_USB_ERR(mors,
-				      "%s - nonzero write bulk status received: %d\n",
-				      __func__, urb->status);
-		musb->errors = urb->status;
-	}
+	if (!(urb->status == -ENOENT ||
+	      urb->status == -ECONNRESET || urb->status == -ESHUTDOWN))
+		MORSE_USB_ERR(mors, "%s - nonzero bulk status received: %d\n",
+			      __func__, urb->status);
 
-	musb->ongoing_rw = 0;
-	wake_up(&musb->rw_in_wait);
+	atomic_cmpxchg(&xf->musb->xfer_error, 0, urb->status);
 }
 
-static int morse_usb_mem_read(struct morse_usb *musb, u32 address, u8 *data, ssize_t size)
+static void morse_usb_xfer_put(struct morse_usb_xfer *xf)
 {
-	int ret;
-	struct morse_usb_command cmd;
-	struct morse *mors = usb_get_intfdata(musb->interface);
+	if (atomic_dec_and_test(&xf->pending))
+		wake_up(&xf->musb->xfer_wait);
+}
 
-	if (!test_bit(MORSE_USB_FLAG_ATTACHED, &musb->flags))
-		return -ENODEV;
+static void morse_usb_xfer_cmd_callback(struct urb *urb)
+{
+	struct morse_usb_xfer *xf = urb->context;
 
-	mutex_lock(&musb->lock);
+	if (urb->status)
+		morse_usb_xfer_note_status(xf, urb);
 
-	musb->ongoing_rw = 1;
-	musb->errors = 0;
+	morse_usb_xfer_put(xf);
+}
 
-	/* Send command ahead to prepare for Tokens */
-	cmd.dir = cpu_to_le32(MORSE_USB_READ);
-	cmd.address = cpu_to_le32(address);
-	cmd.length = cpu_to_le32(size);
+static void morse_usb_xfer_data_callback(struct urb *urb)
+{
+	struct morse_usb_xfer *xf = urb->context;
 
-	morse_usb_buff_log(mors, (const char *)&cmd, sizeof(cmd), "CMDBUF: ");
+	if (urb->status)
+		morse_usb_xfer_note_status(xf, urb);
+	else if (urb->actual_length != xf->len)
+		atomic_cmpxchg(&xf->musb->xfer_error, 0, -EIO);
+	else if (xf->dest)
+		memcpy(xf->dest, xf->buffer, xf->len);
 
-	ret = morse_usb_cmd(musb, (const char *)&cmd, sizeof(cmd));
-	if (ret < 0) {
-		MORSE_USB_ERR(mors, "morse_usb_cmd error %d\n", ret);
-		goto error;
-	}
+	morse_usb_xfer_put(xf);
+}
 
-	/* Let's be fast push the next URB, don't wait until command is done */
-	usb_fill_bulk_urb(musb->endpoints[MORSE_EP_MEM_RD].urb,
-			  musb->udev,
-			  usb_rcvbulkpipe(musb->udev,
-					  musb->endpoints[MORSE_EP_MEM_RD].addr),
-			  musb->endpoints[MORSE_EP_MEM_RD].buffer,
-			  size, morse_usb_mem_rw_callback, mors);
+static bool morse_usb_xfer_idle(struct morse_usb_xfer *xf)
+{
+	return atomic_read(&xf->pending) == 0;
+}
 
-	/* do it */
-	ret = usb_submit_urb(musb->endpoints[MORSE_EP_MEM_RD].urb, GFP_ATOMIC);
-	if (ret < 0) {
-		MORSE_USB_ERR(mors, "%s - failed submitting read urb, error %d\n", __func__, ret);
-		ret = (ret == -ENOMEM) ? ret : -EIO;
-		goto error;
-	}
+/* Send the command and queue the data stage of @xf straight behind it */
+static int morse_usb_xfer_submit(struct morse_usb *musb, struct morse_usb_xfer *xf, u32 dir,
+				 u32 address, u8 *data, u32 len)
+{
+	int ret;
+	struct morse *mors = usb_get_intfdata(musb->interface);
+	struct morse_usb_endpoint *wr_ep = &musb->endpoints[MORSE_EP_MEM_WR];
+	struct morse_usb_endpoint *rd_ep = &musb->endpoints[MORSE_EP_MEM_RD];
+	bool read = (dir == MORSE_USB_READ);
 
-	ret = wait_event_interruptible(musb->rw_in_wait, (!musb->ongoing_rw));
-	if (ret < 0) {
-		MORSE_USB_ERR(mors, "%s: wait_event_interruptible: error %d\n", __func__, ret);
-		goto error;
-	}
+	xf->cmd->dir = cpu_to_le32(dir);
+	xf->cmd->address = cpu_to_le32(address);
+	xf->cmd->length = cpu_to_le32(len);
+	xf->len = len;
+	xf->dest = read ? data : NULL;
 
-	if (musb->errors) {
-		ret = musb->errors;
-		MORSE_USB_ERR(mors, "%s error %d\n", __func__, ret);
-		goto error;
+	morse_usb_buff_log(mors, (const char *)xf->cmd, sizeof(*xf->cmd), "CMDBUF: ");
+
+	if (!read) {
+		morse_usb_buff_log(mors, (const char *)data, len, "WR-DATA: ");
+		memcpy(xf->buffer, data, len);
 	}
 
-	memcpy(data, musb->endpoints[MORSE_EP_MEM_RD].buffer, size);
+	usb_fill_bulk_urb(xf->cmd_urb, musb->udev, usb_sndbulkpipe(musb->udev, wr_ep->addr),
+			  xf->cmd, sizeof(*xf->cmd), morse_usb_xfer_cmd_callback, xf);
+	if (read)
+		usb_fill_bulk_urb(xf->data_urb, musb->udev,
+				  usb_rcvbulkpipe(musb->udev, rd_ep->addr),
+				  xf->buffer, len, morse_usb_xfer_data_callback, xf);
+	else
+		usb_fill_bulk_urb(xf->data_urb, musb->udev,
+				  usb_sndbulkpipe(musb->udev, wr_ep->addr),
+				  xf->buffer, len, morse_usb_xfer_data_callback, xf);
 
-	morse_usb_buff_log(mors, (const char *)data, size, "RD-DATA: ");
+	atomic_set(&xf->pending, 2);
 
-	ret = size;
+	usb_anchor_urb(xf->cmd_urb, &musb->xfer_anchor);
+	ret = usb_submit_urb(xf->cmd_urb, GFP_KERNEL);
+	if (ret) {
+		usb_unanchor_urb(xf->cmd_urb);
+		atomic_set(&xf->pending, 0);
+		MORSE_USB_ERR(mors, "%s - failed submitting command urb, error %d\n",
+			      __func__, ret);
+		return (ret == -ENOMEM) ? ret : -EIO;
+	}
 
-error:
-	musb->ongoing_rw = 0;
-	mutex_unlock(&musb->lock);
+	usb_anchor_urb(xf->data_urb, &musb->xfer_anchor);
+	ret = usb_submit_urb(xf->data_urb, GFP_KERNEL);
+	if (ret) {
+		usb_unanchor_urb(xf->data_urb);
+		morse_usb_xfer_put(xf);
+		MORSE_USB_ERR(mors, "%s - failed submitting %s urb, error %d\n",
+			      __func__, read ? "read" : "write", ret);
+		return (ret == -ENOMEM) ? ret : -EIO;
+	}
 
-	return ret;
+	return 0;
 }
 
-static int morse_usb_mem_write(struct morse_usb *musb, u32 address, u8 *data, ssize_t size)
+/*
+ * Move @size bytes to or from chip memory, split into USB_MAX_TRANSFER_SIZE transfers.
+ * Up to num_xfers transfers are kept in flight; the command of the next one is queued
+ * while earlier data stages are still on the bus. Returns @size or a negative error,
+ * and only once every submitted URB has completed.
+ */
+static int morse_usb_mem_rw(struct morse_usb *musb, u32 dir, u32 address, u8 *data,
+			    ssize_t size)
 {
-	int ret;
-	struct morse_usb_command cmd;
+	int ret = 0;
+	int err;
+	int idx = 0;
+	ssize_t offset = 0;
 	struct morse *mors = usb_get_intfdata(musb->interface);
+	const long timeout = msecs_to_jiffies(MORSE_USB_XFER_TIMEOUT_MS);
 
 	if (!test_bit(MORSE_USB_FLAG_ATTACHED, &musb->flags))
 		return -ENODEV;
 
 	mutex_lock(&musb->lock);
 
-	musb->ongoing_rw = 1;
-	musb->errors = 0;
+	atomic_set(&musb->xfer_error, 0);
 
-	/* Send command ahead to prepare for Tokens */
-	cmd.dir = cpu_to_le32(MORSE_USB_WRITE);
-	cmd.address = cpu_to_le32(address);
-	cmd.length = cpu_to_le32(size);
-	ret = morse_usb_cmd(musb, (const char *)&cmd, sizeof(cmd));
-	if (ret < 0) {
-		MORSE_USB_ERR(mors, "morse_usb_mem_read error %d\n", ret);
-		goto error;
-	}
+	while (offset < size) {
+		struct morse_usb_xfer *xf = &musb->xfers[idx];
+		u32 len = min_t(ssize_t, size - offset, USB_MAX_TRANSFER_SIZE);
 
-	morse_usb_buff_log(mors, (const char *)data, size, "WR-DATA: ");
+		if (!wait_event_timeout(musb->xfer_wait, morse_usb_xfer_idle(xf), timeout)) {
+			ret = -ETIMEDOUT;
+			break;
+		}
 
-	memcpy(musb->endpoints[MORSE_EP_MEM_WR].buffer, data, size);
+		if (atomic_read(&musb->xfer_error))
+			break;
 
-	/* prepare a read */
-	usb_fill_bulk_urb(musb->endpoints[MORSE_EP_MEM_WR].urb,
-			  musb->udev,
-			  usb_sndbulkpipe(musb->udev,
-					  musb->endpoints[MORSE_EP_MEM_WR].addr),
-			  musb->endpoints[MORSE_EP_MEM_WR].buffer,
-			  size, morse_usb_mem_rw_callback, mors);
+		ret = morse_usb_xfer_submit(musb, xf, dir, address + offset, data + offset, len);
+		if (ret)
+			break;
 
-	/* do it */
-	ret = usb_submit_urb(musb->endpoints[MORSE_EP_MEM_WR].urb, GFP_ATOMIC);
-	if (ret < 0) {
-		MORSE_USB_ERR(mors, "%s - failed submitting write urb, error %d\n",
-			      __func__, ret);
-		ret = (ret == -ENOMEM) ? ret : -EIO;
-		goto error;
+		offset += len;
+		idx = (idx + 1) % musb->num_xfers;
 	}
 
-	ret = wait_event_interruptible(musb->rw_in_wait, (!musb->ongoing_rw));
-	if (ret < 0) {
-		MORSE_USB_ERR(mors, "%s error %d\n", __func__, ret);
-		goto error;
+	if (!usb_wait_anchor_empty_timeout(&musb->xfer_anchor, MORSE_USB_XFER_TIMEOUT_MS)) {
+		usb_kill_anchored_urbs(&musb->xfer_anchor);
+		if (!ret)
+			ret = -ETIMEDOUT;
 	}
 
-	if (musb->errors) {
-		ret = musb->errors;
-		MORSE_USB_ERR(mors, "%s error %d\n", __func__, ret);
-		goto error;
-	}
+	err = atomic_read(&musb->xfer_error);
+	if (!ret)
+		ret = err;
 
-	ret = size;
+	if (ret) {
+		MORSE_USB_ERR(mors, "%s %s error %d\n", __func__,
+			      dir == MORSE_USB_READ ? "read" : "write", ret);
+	} else {
+		if (dir == MORSE_USB_READ)
+			morse_usb_buff_log(mors, (const char *)data, size, "RD-DATA: ");
+		ret = size;
+	}
 
-error:
-	musb->ongoing_rw = 0;
 	mutex_unlock(&musb->lock);
+
 	return ret;
 }
 
+static int morse_usb_mem_read(struct morse_usb *musb, u32 address, u8 *data, ssize_t size)
+{
+	return morse_usb_mem_rw(musb, MORSE_USB_READ, address, data, size);
+}
+
+static int morse_usb_mem_write(struct morse_usb *musb, u32 address, u8 *data, ssize_t size)
+{
+	return morse_usb_mem_rw(musb, MORSE_USB_WRITE, address, data, size);
+}
+
 static int morse_usb_dm_write(struct morse *mors, u32 address, const u8 *data, int len)
 {
-	ssize_t offset = 0;
 	int ret;
 	struct morse_usb *musb = (struct morse_usb *)mors->drv_priv;
 
 	if (WARN_ON(len < 0))
 		return -EINVAL;
 
-	while (offset < len) {
-		/* cast to ssize_t is so x64 build doesn't complain. */
-		ret = morse_usb_mem_write(musb, address + offset, (u8 *)(data + offset),
-					  min((ssize_t)(len - offset),
-					      (ssize_t)USB_MAX_TRANSFER_SIZE));
-		if (ret < 0) {
-			MORSE_USB_ERR(mors, "%s failed (errno=%d)\n", __func__, ret);
-			return ret;
-		}
-		offset += ret;
+	ret = morse_usb_mem_write(musb, address, (u8 *)data, len);
+	if (ret < 0) {
+		MORSE_USB_ERR(mors, "%s failed (errno=%d)\n", __func__, ret);
+		return ret;
 	}
 
 	return 0;
@@ -499,24 +575,16 @@ static int morse_usb_dm_write(struct morse *mors, u32 address, const u8 *data, i
 
 static int morse_usb_dm_read(struct morse *mors, u32 address, u8 *data, int len)
 {
-	ssize_t offset = 0;
 	int ret;
 	struct morse_usb *musb = (struct morse_usb *)mors->drv_priv;
 
 	if (WARN_ON(len < 0))
 		return -EINVAL;
 
-	while (offset < len) {
-		/* cast to ssize_t is so x64 build doesn't complain. */
-		ret = morse_usb_mem_read(musb, address + offset, (u8 *)(data + offset),
-					 min((ssize_t)(len - offset),
-					     (ssize_t)USB_MAX_TRANSFER_SIZE));
-
-		if (ret < 0) {
-			MORSE_USB_ERR(mors, "%s failed (errno=%d)\n", __func__, ret);
-			return ret;
-		}
-		offset += ret;
+	ret = morse_usb_mem_read(musb, address, data, len);
+	if (ret < 0) {
+		MORSE_USB_ERR(mors, "%s failed (errno=%d)\n", __func__, ret);
+		return ret;
 	}
 
 	return 0;
@@ -599,6 +667,50 @@ static const struct morse_bus_ops morse_usb_ops = {
 	.bulk_alignment = MORSE_DEFAULT_BULK_ALIGNMENT,
 };
 
+MORSE_BUS_DIRECT_OPS(morse_usb_dm_read, morse_usb_dm_write,
+		     morse_usb_reg32_read, morse_usb_reg32_write,
+		     morse_usb_claim_bus, morse_usb_release_bus)
+
+static void morse_usb_xfers_free(struct morse_usb *musb)
+{
+	int i;
+
+	for (i = 0; i < MORSE_USB_MAX_XFERS; i++) {
+		struct morse_usb_xfer *xf = &musb->xfers[i];
+
+		usb_free_urb(xf->cmd_urb);
+		usb_free_urb(xf->data_urb);
+		kfree(xf->cmd);
+		kfree(xf->buffer);
+		memset(xf, 0, sizeof(*xf));
+	}
+	musb->num_xfers = 0;
+}
+
+static int morse_usb_xfers_alloc(struct morse_usb *musb)
+{
+	int i;
+
+	musb->num_xfers = clamp_t(uint, usb_max_in_flight, 1, MORSE_USB_MAX_XFERS);
+
+	for (i = 0; i < musb->num_xfers; i++) {
+		struct morse_usb_xfer *xf = &musb->xfers[i];
+
+		xf->musb = musb;
+		atomic_set(&xf->pending, 0);
+		xf->cmd_urb = usb_alloc_urb(0, GFP_KERNEL);
+		xf->data_urb = usb_alloc_urb(0, GFP_KERNEL);
+		xf->cmd = kmalloc(sizeof(*xf->cmd), GFP_KERNEL);
+		xf->buffer = kmalloc(USB_MAX_TRANSFER_SIZE, GFP_KERNEL);
+		if (!xf->cmd_urb || !xf->data_urb || !xf->cmd || !xf->buffer) {
+			morse_usb_xfers_free(musb);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
 static int morse_detect_endpoints(struct morse *mors, const struct usb_interface *intf)
 {
 	int ret;
@@ -669,29 +781,9 @@ static int morse_detect_endpoints(struct morse *mors, const struct usb_interface
 		goto err_ep;
 	}
 
-	musb->endpoints[MORSE_EP_MEM_RD].urb = usb_alloc_urb(0, GFP_KERNEL);
-	if (!musb->endpoints[MORSE_EP_MEM_RD].urb) {
-		ret = -ENOMEM;
-		goto err_ep;
-	}
-
-	musb->endpoints[MORSE_EP_MEM_WR].urb = usb_alloc_urb(0, GFP_KERNEL);
-	if (!musb->endpoints[MORSE_EP_MEM_WR].urb) {
-		ret = -ENOMEM;
-		goto err_ep;
-	}
-
-	musb->endpoints[MORSE_EP_MEM_RD].buffer = kmalloc(USB_MAX_TRANSFER_SIZE, GFP_KERNEL);
-	if (!musb->endpoints[MORSE_EP_MEM_RD].buffer) {
-		ret = -ENOMEM;
+	ret = morse_usb_xfers_alloc(musb);
+	if (ret)
 		goto err_ep;
-	}
-
-	musb->endpoints[MORSE_EP_MEM_WR].buffer = kmalloc(USB_MAX_TRANSFER_SIZE, GFP_KERNEL);
-	if (!musb->endpoints[MORSE_EP_MEM_RD].buffer) {
-		ret = -ENOMEM;
-		goto err_ep;
-	}
 
 	musb->endpoints[MORSE_EP_CMD].buffer =
 	    usb_alloc_coherent(musb->udev, sizeof(struct morse_usb_command), GFP_KERNEL,
@@ -712,11 +804,8 @@ err_ep:
 	usb_free_coherent(musb->udev, sizeof(struct morse_usb_command),
 			  musb->endpoints[MORSE_EP_CMD].buffer,
 			  musb->endpoints[MORSE_EP_CMD].urb->transfer_dma);
-	usb_free_urb(musb->endpoints[MORSE_EP_MEM_RD].urb);
 	usb_free_urb(musb->endpoints[MORSE_EP_CMD].urb);
-	usb_free_urb(musb->endpoints[MORSE_EP_MEM_WR].urb);
-	kfree(musb->endpoints[MORSE_EP_MEM_RD].buffer);
-	kfree(musb->endpoints[MORSE_EP_MEM_WR].buffer);
+	morse_usb_xfers_free(musb);
 
 	return ret;
 }
@@ -749,6 +838,8 @@ static int morse_usb_probe(struct usb_interface *interface, const struct usb_dev
 	mutex_init(&musb->lock);
 	mutex_init(&musb->bus_lock);
 	init_waitqueue_head(&musb->rw_in_wait);
+	init_waitqueue_head(&musb->xfer_wait);
+	init_usb_anchor(&musb->xfer_anchor);
 	usb_set_intfdata(interface, mors);
 
 	ret = morse_detect_endpoints(mors, interface);
@@ -857,7 +948,7 @@ static int morse_usb_probe(struct usb_interface *interface, const struct usb_dev
 	/* USB requires remote wakeup functionality for suspend */
 	musb->interface->needs_remote_wakeup = 1;
 	usb_enable_autosuspend(musb->udev);
-	pm_runtime_set_autosuspend_delay(&musb->udev->dev, PM_RUNTIME_AUTOSUSPEND_DELAY_MS);
+	pm_runtime_set_autosuspend_delay(&musb->udev->dev, usb_autosuspend_delay_ms);
 
 	usb_autopm_get_interface(interface);
 #ifdef CONFIG_MORSE_ENABLE_TEST_MODES
@@ -893,13 +984,9 @@ static void morse_urb_cleanup(struct morse *mors)
 {
 	struct morse_usb *musb = (struct morse_usb *)mors->drv_priv;
 	struct morse_usb_endpoint *int_ep = &musb->endpoints[MORSE_EP_INT];
-	struct morse_usb_endpoint *rd_ep = &musb->endpoints[MORSE_EP_MEM_RD];
-	struct morse_usb_endpoint *wr_ep = &musb->endpoints[MORSE_EP_MEM_WR];
 	struct morse_usb_endpoint *cmd_ep = &musb->endpoints[MORSE_EP_CMD];
 
-	usb_kill_urb(rd_ep->urb);
-
-	usb_kill_urb(wr_ep->urb);
+	usb_kill_anchored_urbs(&musb->xfer_anchor);
 
 	usb_kill_urb(cmd_ep->urb);
 
@@ -912,11 +999,7 @@ static void morse_urb_cleanup(struct morse *mors)
 		usb_free_coherent(musb->udev, MORSE_EP_INT_BUFFER_SIZE,
 				  int_ep->buffer, int_ep->urb->transfer_dma);
 
-	usb_free_urb(rd_ep->urb);
-	kfree(rd_ep->buffer);
-
-	usb_free_urb(wr_ep->urb);
-	kfree(wr_ep->buffer);
+	morse_usb_xfers_free(musb);
 
 	usb_free_urb(cmd_ep->urb);
 
@@ -975,18 +1058,83 @@ static void morse_usb_disconnect(struct usb_interface *interface)
 	usb_put_dev(udev);
 }
 
+/**
+ * morse_usb_autosuspend() - Runtime suspend, keeping all URBs and endpoint state
+ * @mors: Morse chip instance
+ *
+ * Runtime PM cycles each time the chip sleeps, so this only stops the interrupt URB. Rather than
+ * killing transfers and holding the bus across the suspend, it refuses while the bus is busy and
+ * lets the USB core retry after the autosuspend delay.
+ *
+ * Return: 0 on success, -EBUSY if the bus is in use
+ */
+static int morse_usb_autosuspend(struct morse *mors)
+{
+	struct morse_usb *musb = (struct morse_usb *)mors->drv_priv;
+	struct morse_usb_endpoint *int_ep = &musb->endpoints[MORSE_EP_INT];
+	int ret = 0;
+
+	if (!mutex_trylock(&musb->bus_lock))
+		return -EBUSY;
+
+	if (musb->ongoing_cmd || musb->ongoing_rw || !usb_anchor_empty(&musb->xfer_anchor)) {
+		ret = -EBUSY;
+		goto exit;
+	}
+
+	usb_kill_urb(int_ep->urb);
+
+	/* An interrupt which arrived before the kill must be handled first */
+	if (work_pending(&mors->usb_irq_work)) {
+		if (usb_submit_urb(int_ep->urb, GFP_NOIO))
+			MORSE_USB_ERR(mors, "Couldn't resubmit int urb\n");
+		ret = -EBUSY;
+		goto exit;
+	}
+
+	set_bit(MORSE_USB_FLAG_AUTOSUSPENDED, &musb->flags);
+	musb->autosuspend_start_ns = ktime_get_ns();
+	musb->autosuspends++;
+exit:
+	mutex_unlock(&musb->bus_lock);
+	return ret;
+}
+
+/**
+ * morse_usb_autoresume() - Resume from a runtime suspend taken by morse_usb_autosuspend()
+ * @mors: Morse chip instance
+ *
+ * Return: 0 on success, else the error from resubmitting the interrupt URB
+ */
+static int morse_usb_autoresume(struct morse *mors)
+{
+	struct morse_usb *musb = (struct morse_usb *)mors->drv_priv;
+	int ret;
+
+	clear_bit(MORSE_USB_FLAG_AUTOSUSPENDED, &musb->flags);
+
+	ret = usb_submit_urb(musb->endpoints[MORSE_EP_INT].urb, GFP_NOIO);
+	if (ret)
+		MORSE_USB_ERR(mors, "Couldn't submit urb. Error number %d\n", ret);
+
+	MORSE_USB_DBG(mors, "USB autoresume #%u after %llu us\n", musb->autosuspends,
+		      div_u64(ktime_get_ns() - musb->autosuspend_start_ns, NSEC_PER_USEC));
+
+	return ret;
+}
+
 static int morse_usb_suspend(struct usb_interface *intf, pm_message_t message)
 {
 	struct morse *mors = usb_get_intfdata(intf);
 	struct morse_usb *musb = (struct morse_usb *)mors->drv_priv;
 	struct morse_usb_endpoint *int_ep = &musb->endpoints[MORSE_EP_INT];
-	struct morse_usb_endpoint *rd_ep = &musb->endpoints[MORSE_EP_MEM_RD];
-	struct morse_usb_endpoint *wr_ep = &musb->endpoints[MORSE_EP_MEM_WR];
 	struct morse_usb_endpoint *cmd_ep = &musb->endpoints[MORSE_EP_CMD];
 
+	if (PMSG_IS_AUTO(message))
+		return morse_usb_autosuspend(mors);
+
 	usb_kill_urb(int_ep->urb);
-	usb_kill_urb(rd_ep->urb);
-	usb_kill_urb(wr_ep->urb);
+	usb_kill_anchored_urbs(&musb->xfer_anchor);
 	usb_kill_urb(cmd_ep->urb);
 
 	/* Locking the bus. No USB communication after this point */
@@ -1008,6 +1156,9 @@ static int morse_usb_resume(struct usb_interface *intf)
 	if (!test_bit(MORSE_USB_FLAG_ATTACHED, &musb->flags))
 		return -ENODEV;
 
+	if (test_bit(MORSE_USB_FLAG_AUTOSUSPENDED, &musb->flags))
+		return morse_usb_autoresume(mors);
+
 	ret = usb_submit_urb(int_ep->urb, GFP_KERNEL);
 	if (ret)
 		MORSE_USB_ERR(mors, "Couldn't submit urb. Error number %d\n", ret);
@@ -1032,6 +1183,10 @@ static int morse_usb_reset_resume(struct usb_interface *intf)
 
 	dev_err(&intf->dev, "Morse USB Reset resume");
 
+	/* The endpoints keep their configuration across the reset, the URBs are still valid */
+	if (test_bit(MORSE_USB_FLAG_AUTOSUSPENDED, &musb->flags))
+		return morse_usb_autoresume(mors);
+
 	ret = usb_submit_urb(int_ep->urb, GFP_KERNEL);
 	if (ret)
 		MORSE_USB_ERR(mors, "Couldn't submit urb. Error number %d\n", ret);
@@ -1064,6 +1219,12 @@ static struct usb_driver morse_usb_driver = {
 	.id_table = morse_usb_table,
 	.supports_autosuspend = 1,
 	.soft_unbind = 1,
+	/* Firmware download takes a while, let each radio come up alongside the others */
+#if KERNEL_VERSION(6, 8, 0) <= LINUX_VERSION_CODE
+	.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#else
+	.drvwrap.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
 };
 
 int __init morse_usb_init(void)
@@ -6,6 +6,7 @@
  */
 #include <net/mac80211.h>
 #include <net/netlink.h>
+#include <linux/vmalloc.h>
 
 #include "command.h"
 #include "mac.h"
@@ -75,6 +76,155 @@ morse_vendor_cmd_to_morse(struct wiphy *wiphy, struct wireless_dev *wdev,
 	return cfg80211_vendor_cmd_reply(skb);
 }
 
+/* Stations seen by the statistics snapshot, filled from an atomic station iteration */
+struct morse_vendor_stats_sta_iter {
+	struct morse_vendor_stats_sta *recs;
+	u16 max_stas;
+	u16 num_stas;
+};
+
+static void morse_vendor_stats_count_sta(void *data, struct ieee80211_sta *sta)
+{
+	struct morse_vendor_stats_sta_iter *iter = data;
+
+	if (iter->num_stas < U16_MAX)
+		iter->num_stas++;
+}
+
+static void morse_vendor_stats_fill_sta(void *data, struct ieee80211_sta *sta)
+{
+	struct morse_vendor_stats_sta_iter *iter = data;
+	struct morse_sta *msta = (struct morse_sta *)sta->drv_priv;
+	struct morse_vendor_stats_sta *rec;
+
+	/* Stations added since sizing are left out, they'll be in the next snapshot */
+	if (iter->num_stas >= iter->max_stas)
+		return;
+
+	rec = &iter->recs[iter->num_stas++];
+	ether_addr_copy(rec->addr, sta->addr);
+	rec->avg_rssi = cpu_to_le16(READ_ONCE(msta->avg_rssi));
+	rec->tx_pkts = cpu_to_le64(READ_ONCE(msta->tx_pkt_count));
+#ifdef CONFIG_MORSE_RC
+	rec->expected_tput_kbps = cpu_to_le32(morse_rc_sta_expected_throughput(msta));
+	rec->rc_best_changes = cpu_to_le32(READ_ONCE(msta->rc.best_changes));
+	rec->tx_mcs = msta->last_sta_tx_rate.rate;
+	rec->tx_bw_mhz = morse_ratecode_bw_index_to_s1g_bw_mhz(msta->last_sta_tx_rate.bw);
+	rec->tx_ss = msta->last_sta_tx_rate.ss;
+	rec->tx_sgi = msta->last_sta_tx_rate.guard;
+#endif
+}
+
+/* Fold the per-CPU page statistics into @out, in the order of struct morse_page_stats */
+static void morse_vendor_stats_fill_page(struct morse *mors, __le32 *out)
+{
+	const int num = sizeof(struct morse_page_stats) / sizeof(unsigned int);
+	u32 sum[sizeof(struct morse_page_stats) / sizeof(unsigned int)] = { 0 };
+	int cpu, i;
+
+	BUILD_BUG_ON(sizeof(struct morse_page_stats) % sizeof(unsigned int));
+
+	for_each_possible_cpu(cpu) {
+		const unsigned int *stats =
+			(const unsigned int *)per_cpu_ptr(mors->debug.page_stats, cpu);
+
+		for (i = 0; i < num; i++)
+			sum[i] += stats[i];
+	}
+
+	for (i = 0; i < num; i++)
+		out[i] = cpu_to_le32(sum[i]);
+}
+
+/*
+ * Reply with a binary snapshot of the driver counters. Everything is read without taking the
+ * driver lock, so this is cheap enough for a monitoring agent to poll every second.
+ */
+static int
+morse_vendor_cmd_get_stats(struct wiphy *wiphy, struct wireless_dev *wdev,
+			   const void *data, int data_len)
+{
+	struct morse *mors = morse_wiphy_to_morse(wiphy);
+	const int num_page_stats = sizeof(struct morse_page_stats) / sizeof(unsigned int);
+	struct morse_skbq_mon_stats mon[MORSE_SKBQ_MON_MAX_STATS];
+	struct morse_vendor_stats_sta_iter iter = { 0 };
+	struct morse_vendor_stats_skbq_mon *mon_rec;
+	struct morse_vendor_stats_hdr *hdr;
+	struct sk_buff *skb;
+	u16 flags = 0;
+	size_t len;
+	u8 *buf;
+	int num_mon;
+	int ret;
+	int i;
+
+	ieee80211_iterate_stations_atomic(mors->hw, morse_vendor_stats_count_sta, &iter);
+	iter.max_stas = iter.num_stas;
+	iter.num_stas = 0;
+
+	len = sizeof(*hdr) + num_page_stats * sizeof(__le32) +
+	      iter.max_stas * sizeof(*iter.recs) + ARRAY_SIZE(mon) * sizeof(*mon_rec);
+	buf = vzalloc(len);
+	if (!buf)
+		return -ENOMEM;
+
+	hdr = (struct morse_vendor_stats_hdr *)buf;
+	morse_vendor_stats_fill_page(mors, (__le32 *)(hdr + 1));
+
+	iter.recs = (struct morse_vendor_stats_sta *)((__le32 *)(hdr + 1) + num_page_stats);
+	ieee80211_iterate_stations_atomic(mors->hw, morse_vendor_stats_fill_sta, &iter);
+
+	mon_rec = (struct morse_vendor_stats_skbq_mon *)(iter.recs + iter.num_stas);
+	num_mon = morse_skbq_mon_read(mon, ARRAY_SIZE(mon));
+	for (i = 0; i < num_mon; i++) {
+		mon_rec[i].type = mon[i].type;
+		ether_addr_copy(mon_rec[i].sa, mon[i].sa);
+		ether_addr_copy(mon_rec[i].da, mon[i].da);
+		mon_rec[i].tot_sent = cpu_to_le32(mon[i].tot_sent);
+		mon_rec[i].qsize_cur = cpu_to_le32(mon[i].qsize_cur);
+		mon_rec[i].qsize_max = cpu_to_le32(mon[i].qsize_max);
+	}
+	len = (u8 *)(mon_rec + num_mon) - buf;
+
+#if defined(CONFIG_MORSE_DEBUG_IRQ)
+	BUILD_BUG_ON(ARRAY_SIZE(hdr->hostsync_irq_bits) !=
+		     ARRAY_SIZE(mors->debug.hostsync_stats.irq_bits));
+	flags |= MORSE_VENDOR_STATS_FLAGS_HOSTSYNC;
+	hdr->hostsync_irqs = cpu_to_le32(READ_ONCE(mors->debug.hostsync_stats.irq));
+	for (i = 0; i < ARRAY_SIZE(hdr->hostsync_irq_bits); i++)
+		hdr->hostsync_irq_bits[i] =
+			cpu_to_le32(READ_ONCE(mors->debug.hostsync_stats.irq_bits[i]));
+#endif
+#ifdef CONFIG_MORSE_RC
+	flags |= MORSE_VENDOR_STATS_FLAGS_RC;
+#endif
+
+	hdr->version = cpu_to_le16(MORSE_VENDOR_STATS_VERSION);
+	hdr->hdr_len = cpu_to_le16(sizeof(*hdr));
+	hdr->num_page_stats = cpu_to_le16(num_page_stats);
+	hdr->sta_len = cpu_to_le16(sizeof(*iter.recs));
+	hdr->num_stas = cpu_to_le16(iter.num_stas);
+	hdr->skbq_mon_len = cpu_to_le16(sizeof(*mon_rec));
+	hdr->num_skbq_mon = cpu_to_le16(num_mon);
+	hdr->flags = cpu_to_le16(flags);
+	hdr->timestamp_ns = cpu_to_le64(ktime_to_ns(ktime_get_boottime()));
+
+	skb = cfg80211_vendor_cmd_alloc_reply_skb(wiphy, nla_total_size(len));
+	if (!skb) {
+		vfree(buf);
+		return -ENOMEM;
+	}
+
+	ret = nla_put(skb, MORSE_VENDOR_ATTR_DATA, len, buf);
+	vfree(buf);
+	if (ret) {
+		kfree_skb(skb);
+		return ret;
+	}
+
+	return cfg80211_vendor_cmd_reply(skb);
+}
+
 static const struct wiphy_vendor_command morse_vendor_commands[] = {
 	{
 	 .info = {
@@ -98,6 +248,17 @@ static const struct wiphy_vendor_command morse_vendor_commands[] = {
 #endif
 	 .doit = morse_vendor_cmd_to_morse,
 	},
+	{
+	 .info = {
+		  .vendor_id = MORSE_OUI,
+		  .subcmd = MORSE_VENDOR_WIPHY_CMD_GET_STATS,
+		  },
+	 .flags = 0,
+#if KERNEL_VERSION(5, 3, 0) <= MAC80211_VERSION_CODE
+	 .policy = VENDOR_CMD_RAW_DATA,
+#endif
+	 .doit = morse_vendor_cmd_get_stats,
+	},
 };
 
 static const struct nl80211_vendor_cmd_info morse_vendor_events[] = {
@@ -115,6 +276,10 @@ static const struct nl80211_vendor_cmd_info morse_vendor_events[] = {
 	[MORSE_VENDOR_EVENT_MESH_PEER_ADDR] = {
 					       .vendor_id = MORSE_OUI,
 					       .subcmd = MORSE_VENDOR_EVENT_MESH_PEER_ADDR },
+	[MORSE_VENDOR_EVENT_MGMT_VENDOR_IES_FOUND] = {
+						      .vendor_id = MORSE_OUI,
+						      .subcmd =
+						      MORSE_VENDOR_EVENT_MGMT_VENDOR_IES_FOUND },
 };
 
 void morse_set_vendor_commands_and_events(struct wiphy *wiphy)
@@ -441,6 +606,42 @@ err:
 	return ret;
 }
 
+int morse_vendor_send_mgmt_vendor_ies_found_event(struct ieee80211_vif *vif, u16 frame_type,
+						  const struct ieee80211_vendor_ie **vies,
+						  int n_vies)
+{
+	struct wireless_dev *wdev = ieee80211_vif_to_wdev(vif);
+	struct sk_buff *skb;
+	int len = VENDOR_EVENT_OVERHEAD + nla_total_size(sizeof(frame_type));
+	int ret;
+	int i;
+
+	for (i = 0; i < n_vies; i++)
+		len += nla_total_size(vies[i]->len);
+
+	skb = cfg80211_vendor_event_alloc(wdev->wiphy, NULL, len,
+					  MORSE_VENDOR_EVENT_MGMT_VENDOR_IES_FOUND, GFP_ATOMIC);
+	if (!skb)
+		return -ENOMEM;
+
+	ret = nla_put_u16(skb, MORSE_VENDOR_ATTR_MGMT_FRAME_TYPE, frame_type);
+	if (ret)
+		goto err;
+
+	for (i = 0; i < n_vies; i++) {
+		ret = nla_put(skb, MORSE_VENDOR_ATTR_DATA, vies[i]->len, vies[i]->oui);
+		if (ret)
+			goto err;
+	}
+
+	cfg80211_vendor_event(skb, GFP_ATOMIC);
+	return 0;
+
+err:
+	kfree_skb(skb);
+	return ret;
+}
+
 int morse_vendor_send_ocs_done_event(struct ieee80211_vif *vif, struct morse_event *event)
 {
 	struct wireless_dev *wdev;
@@ -47,13 +47,17 @@ static const u8 morse_oui[] = { 0x0C, 0xBF, 0x74 };
 enum morse_vendor_cmds {
 	MORSE_VENDOR_CMD_TO_MORSE = 0,
 	MORSE_VENDOR_WIPHY_CMD_TO_MORSE = 1,
+	/* Reply carries a &struct morse_vendor_stats_hdr snapshot in MORSE_VENDOR_ATTR_DATA */
+	MORSE_VENDOR_WIPHY_CMD_GET_STATS = 2,
 };
 
 enum morse_vendor_events {
 	MORSE_VENDOR_EVENT_BCN_VENDOR_IE_FOUND = 0,	/* To be deprecated in a future version */
 	MORSE_VENDOR_EVENT_OCS_DONE = 1,
 	MORSE_VENDOR_EVENT_MGMT_VENDOR_IE_FOUND = 2,
-	MORSE_VENDOR_EVENT_MESH_PEER_ADDR = 3
+	MORSE_VENDOR_EVENT_MESH_PEER_ADDR = 3,
+	/* One MORSE_VENDOR_ATTR_DATA per filtered vendor IE found in a single frame */
+	MORSE_VENDOR_EVENT_MGMT_VENDOR_IES_FOUND = 4
 };
 
 enum morse_vendor_attributes {
@@ -77,6 +81,65 @@ struct dot11_morse_vendor_caps_ops_ie {
 	u8 ops0;
 } __packed;
 
+/*
+ * Driver statistics snapshot returned by MORSE_VENDOR_WIPHY_CMD_GET_STATS. The header is
+ * followed by the page statistics, then the station records and then the SKB queue monitor
+ * records. All fields are little endian, and the lengths in the header allow fields to be
+ * appended in later versions without breaking readers. Counters are never cleared by the
+ * snapshot, so pollers should work from differences between snapshots.
+ */
+#define MORSE_VENDOR_STATS_VERSION		(1)
+
+/** The hostsync fields of &struct morse_vendor_stats_hdr are valid */
+#define MORSE_VENDOR_STATS_FLAGS_HOSTSYNC	BIT(0)
+/** The rate control fields of &struct morse_vendor_stats_sta are valid */
+#define MORSE_VENDOR_STATS_FLAGS_RC		BIT(1)
+
+struct morse_vendor_stats_hdr {
+	__le16 version;
+	__le16 hdr_len;
+	/* Number of __le32 page statistics, in the order of &struct morse_page_stats */
+	__le16 num_page_stats;
+	__le16 sta_len;
+	__le16 num_stas;
+	__le16 skbq_mon_len;
+	__le16 num_skbq_mon;
+	/* MORSE_VENDOR_STATS_FLAGS_* */
+	__le16 flags;
+	/* Time of the snapshot, nanoseconds since boot */
+	__le64 timestamp_ns;
+	/* Chip interrupts, and the number seen for each interrupt status bit */
+	__le32 hostsync_irqs;
+	__le32 hostsync_irq_bits[32];
+} __packed;
+
+struct morse_vendor_stats_sta {
+	u8 addr[ETH_ALEN];
+	__le16 avg_rssi;
+	/* Frames passed from mac80211 since the last read of the tx_sta_summary debugfs file */
+	__le64 tx_pkts;
+	/* Expected throughput of the best rate, kbps */
+	__le32 expected_tput_kbps;
+	/* Times the best rate has changed */
+	__le32 rc_best_changes;
+	/* Last TX rate: MCS, bandwidth, MMRC spatial stream index and short guard interval */
+	u8 tx_mcs;
+	u8 tx_bw_mhz;
+	u8 tx_ss;
+	u8 tx_sgi;
+} __packed;
+
+struct morse_vendor_stats_skbq_mon {
+	/* enum morse_skbq_mon_type */
+	u8 type;
+	u8 reserved;
+	u8 sa[ETH_ALEN];
+	u8 da[ETH_ALEN];
+	__le32 tot_sent;
+	__le32 qsize_cur;
+	__le32 qsize_max;
+} __packed;
+
 /**
  * Get the IE length of the vendor IE for a given OUI type.
  *
@@ -131,6 +194,20 @@ void morse_vendor_reset_sta_transient_info(struct ieee80211_vif *vif, struct mor
 int morse_vendor_send_mgmt_vendor_ie_found_event(struct ieee80211_vif *vif, u16 frame_type,
 						 const struct ieee80211_vendor_ie *vie);
 
+/**
+ * Send a single netlink event carrying every filtered vendor IE found in one frame
+ *
+ * @vif Interface to send the event on
+ * @frame_type Frame type that the vendor IEs were found in
+ *		     of type @ref enum morse_vendor_ie_mgmt_type_flags
+ * @vies Vendor IEs which were found, in frame order
+ * @n_vies Number of entries in @vies
+ * @return int 0 on success else error code
+ */
+int morse_vendor_send_mgmt_vendor_ies_found_event(struct ieee80211_vif *vif, u16 frame_type,
+						  const struct ieee80211_vendor_ie **vies,
+						  int n_vies);
+
 /**
  * Send an Off Channel Scan (OCS) netlink event
  *
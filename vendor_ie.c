@@ -5,6 +5,7 @@
  *
  */
 #include <linux/ieee80211.h>
+#include <linux/jhash.h>
 #include <net/mac80211.h>
 
 #include "vendor_ie.h"
@@ -24,6 +25,36 @@ static uint max_total_vendor_ie_bytes = 2 * (U8_MAX + 2);
 module_param(max_total_vendor_ie_bytes, uint, 0644);
 MODULE_PARM_DESC(max_total_vendor_ie_bytes, "Max total bytes for runtime vendor IEs");
 
+/**
+ * Report all filtered vendor IEs of a received frame in one MGMT_VENDOR_IES_FOUND event, rather
+ * than one MGMT_VENDOR_IE_FOUND (and, for beacons, BCN_VENDOR_IE_FOUND) event per IE.
+ */
+static bool vendor_ie_batch_events __read_mostly;
+module_param(vendor_ie_batch_events, bool, 0644);
+MODULE_PARM_DESC(vendor_ie_batch_events, "Report the filtered vendor IEs of a frame in one event");
+
+/**
+ * Suppress vendor IE events for a beacon whose filtered vendor IEs are identical to those last
+ * reported for the same source, until this many milliseconds have passed. 0 disables this.
+ */
+static uint vendor_ie_bcn_refresh_ms __read_mostly;
+module_param(vendor_ie_bcn_refresh_ms, uint, 0644);
+MODULE_PARM_DESC(vendor_ie_bcn_refresh_ms,
+		 "Suppress unchanged beacon vendor IE events for this long (ms, 0 = report all)");
+
+/** Maximum number of beacon sources tracked for vendor IE event suppression */
+#define MORSE_VENDOR_IE_BCN_SEEN_MAX		(256)
+
+/** Maximum number of matched vendor IEs collected under the lock before they are reported */
+#define MORSE_VENDOR_IE_RX_MAX_MATCHES		(16)
+
+/** A filtered vendor IE found in a received frame, waiting to be reported */
+struct vendor_ie_rx_match {
+	const struct ieee80211_vendor_ie *vie;
+	int (*on_vendor_ie_match)(struct ieee80211_vif *vif,
+				  u16 frame_type, const struct ieee80211_vendor_ie *vie);
+};
+
 /**
  * Add a vendor IE to the vendor IE list, to be inserted in specified management frames
  *
@@ -64,6 +95,9 @@ static int morse_vendor_ie_add_to_ie_list(struct morse_vif *mors_vif, u16 mgmt_t
 	list_add_tail(&item->list, &mors_vif->vendor_ie.ie_list);
 	spin_unlock_bh(&mors_vif->vendor_ie.lock);
 
+	if (mgmt_type_mask & MORSE_VENDOR_IE_TYPE_BEACON)
+		morse_beacon_template_invalidate(mors_vif);
+
 	return 0;
 }
 
@@ -91,6 +125,9 @@ static int morse_vendor_ie_clear_ie_list(struct morse_vif *mors_vif, u16 mgmt_ty
 	}
 	spin_unlock_bh(&mors_vif->vendor_ie.lock);
 
+	if (mgmt_type_mask & MORSE_VENDOR_IE_TYPE_BEACON)
+		morse_beacon_template_invalidate(mors_vif);
+
 	return 0;
 }
 
@@ -99,58 +136,194 @@ static int morse_vendor_ie_clear_ie_list(struct morse_vif *mors_vif, u16 mgmt_ty
  * those in the virtual interface's OUI filter, and will call the call back for each match.
  *
  * @vif Virtual interface IEs were received on
- * @ies Information elements of the frame to process
- * @length total length of ies
+ * @ies_mask IEs parsed from the received frame
  * @mgmt_type_mask management frame type (+ S1G beacon) of the received frame
  *			 of type @ref enum morse_vendor_ie_mgmt_type_flags
  * @return 0 on success, else error code
  */
-static int morse_vendor_ie_process_rx_ies(struct ieee80211_vif *vif, const u8 *ies, u16 length,
-					  u16 mgmt_type)
+/** Filtered vendor IEs last reported for a beacon source */
+struct vendor_ie_bcn_seen {
+	struct hlist_node node;
+	u8 addr[ETH_ALEN];
+	/** jhash of the matched vendor IEs, in frame order */
+	u32 hash;
+	/** Time (jiffies) the vendor IEs were last reported */
+	unsigned long updated;
+};
+
+/**
+ * Remove beacon sources that have not been reported within @max_age.
+ * Must be called with the vendor IE lock held.
+ *
+ * @mors_vif Interface to prune
+ * @max_age Age in jiffies. 0 removes every entry
+ */
+static void morse_vendor_ie_bcn_seen_prune(struct morse_vif *mors_vif, unsigned long max_age)
 {
-	int ret = 0;
-	struct morse_vif *mors_vif = ieee80211_vif_to_morse_vif(vif);
-	const struct ieee80211_vendor_ie *vie = (const struct ieee80211_vendor_ie *)ies;
-	const u8 *pos = ies;
-	const u8 *const end = ies + length;
-	struct vendor_ie_oui_filter_list_item *item;
-	const u8 min_vendor_ie_length = sizeof(*vie) - sizeof(vie->element_id) - sizeof(vie->len);
+	struct vendor_ie_bcn_seen *seen;
+	struct hlist_node *tmp;
+	int bkt;
 
-	while ((pos < end) && (ret == 0)) {
-		pos = cfg80211_find_ie(WLAN_EID_VENDOR_SPECIFIC, pos, length);
-		if (!pos)
-			break;
+	hash_for_each_safe(mors_vif->vendor_ie.bcn_seen, bkt, tmp, seen, node) {
+		if (max_age && time_before(jiffies, seen->updated + max_age))
+			continue;
 
-		vie = (const struct ieee80211_vendor_ie *)pos;
+		hash_del(&seen->node);
+		kfree(seen);
+		mors_vif->vendor_ie.n_bcn_seen--;
+	}
+}
 
-		if (vie->len >= min_vendor_ie_length) {
-			spin_lock_bh(&mors_vif->vendor_ie.lock);
-			list_for_each_entry(item, &mors_vif->vendor_ie.oui_filter_list, list) {
-				if ((memcmp(item->oui, vie->oui, sizeof(vie->oui)) == 0) &&
-				    (item->mgmt_type_mask & mgmt_type)) {
-					ret = item->on_vendor_ie_match(vif, mgmt_type, vie);
-					if (ret)
-						break;
-				}
-			}
-			spin_unlock_bh(&mors_vif->vendor_ie.lock);
-		}
+/**
+ * Check whether the filtered vendor IEs of a beacon are unchanged since they were last reported
+ * for the same source, recording them if they are to be reported.
+ * Must be called with the vendor IE lock held.
+ *
+ * @mors_vif Interface the beacon was received on
+ * @addr Source address of the beacon
+ * @hash jhash of the matched vendor IEs
+ * @return true if the matches duplicate a recent report and should be dropped
+ */
+static bool morse_vendor_ie_bcn_is_duplicate(struct morse_vif *mors_vif, const u8 *addr,
+					     u32 hash)
+{
+	const unsigned long refresh = msecs_to_jiffies(vendor_ie_bcn_refresh_ms);
+	struct vendor_ie_bcn_seen *seen;
+
+	hash_for_each_possible(mors_vif->vendor_ie.bcn_seen, seen, node, mac2uint64(addr)) {
+		if (!ether_addr_equal(seen->addr, addr))
+			continue;
+
+		if (seen->hash == hash && time_before(jiffies, seen->updated + refresh))
+			return true;
+
+		seen->hash = hash;
+		seen->updated = jiffies;
+		return false;
+	}
+
+	if (mors_vif->vendor_ie.n_bcn_seen >= MORSE_VENDOR_IE_BCN_SEEN_MAX)
+		morse_vendor_ie_bcn_seen_prune(mors_vif, refresh);
+
+	/* Still full of live sources: report without tracking this one */
+	if (mors_vif->vendor_ie.n_bcn_seen >= MORSE_VENDOR_IE_BCN_SEEN_MAX)
+		return false;
+
+	seen = kmalloc(sizeof(*seen), GFP_ATOMIC);
+	if (!seen)
+		return false;
 
-		pos = (u8 *)vie + sizeof(vie->element_id) + sizeof(vie->len) + vie->len;
+	ether_addr_copy(seen->addr, addr);
+	seen->hash = hash;
+	seen->updated = jiffies;
+	hash_add(mors_vif->vendor_ie.bcn_seen, &seen->node, mac2uint64(addr));
+	mors_vif->vendor_ie.n_bcn_seen++;
+
+	return false;
+}
+
+/**
+ * Report vendor IE matches collected from a received frame. Called without the vendor IE lock
+ * held, so the callbacks are free to allocate and send netlink events.
+ *
+ * @vif Interface the frame was received on
+ * @mgmt_type Management frame type, of type @ref enum morse_vendor_ie_mgmt_type_flags
+ * @matches Matches to report, in frame order
+ * @n_matches Number of entries in @matches
+ * @return 0 on success, else the first error returned by a callback
+ */
+static int morse_vendor_ie_report_rx_matches(struct ieee80211_vif *vif, u16 mgmt_type,
+					     const struct vendor_ie_rx_match *matches,
+					     int n_matches)
+{
+	const struct ieee80211_vendor_ie *vies[MORSE_VENDOR_IE_RX_MAX_MATCHES];
+	int n_vies = 0;
+	int ret = 0;
+	int i;
+
+	for (i = 0; i < n_matches && !ret; i++) {
+		if (vendor_ie_batch_events &&
+		    matches[i].on_vendor_ie_match == morse_vendor_send_mgmt_vendor_ie_found_event)
+			vies[n_vies++] = matches[i].vie;
+		else
+			ret = matches[i].on_vendor_ie_match(vif, mgmt_type, matches[i].vie);
 	}
+
+	if (!ret && n_vies)
+		ret = morse_vendor_send_mgmt_vendor_ies_found_event(vif, mgmt_type, vies, n_vies);
+
 	return ret;
 }
 
 /**
- * Helper function to get a pointer to the information elements on a received S1G beacon
+ * Match the vendor elements of a received frame against the OUI filter and report them.
  *
- * @bcn S1G Beacon frame
- * @return pointer to start of information elements
+ * @vif Interface the frame was received on
+ * @ies_mask IEs parsed from the frame
+ * @mgmt_type Management frame type, of type @ref enum morse_vendor_ie_mgmt_type_flags
+ * @bcn_addr Source address if unchanged beacon matches should be suppressed, else NULL
+ * @return 0 on success, else error code
  */
-static inline u8 *get_elements_from_s1g_beacon(struct ieee80211_ext *bcn)
+static int morse_vendor_ie_process_rx_ies(struct ieee80211_vif *vif,
+					  const struct dot11ah_ies_mask *ies_mask, u16 mgmt_type,
+					  const u8 *bcn_addr)
 {
-	return (ieee80211_is_s1g_short_beacon(bcn->frame_control) ?
-		bcn->u.s1g_short_beacon.variable : bcn->u.s1g_beacon.variable);
+	int ret = 0;
+	struct morse_vif *mors_vif = ieee80211_vif_to_morse_vif(vif);
+	const struct ieee80211_vendor_ie *vie;
+	const struct ie_element *elem;
+	struct vendor_ie_oui_filter_list_item *item;
+	struct vendor_ie_rx_match matches[MORSE_VENDOR_IE_RX_MAX_MATCHES];
+	int n_matches = 0;
+	bool reported = false;
+	u32 hash = 0;
+	const u8 min_vendor_ie_length = sizeof(*vie) - sizeof(vie->element_id) - sizeof(vie->len);
+
+	/* Take the lock once per frame and only call out once it has been dropped */
+	spin_lock_bh(&mors_vif->vendor_ie.lock);
+	morse_dot11_ies_mask_for_each(elem, ies_mask, WLAN_EID_VENDOR_SPECIFIC) {
+		/* Elements parsed from the frame point at their body, just past the header */
+		if (elem->needs_free || elem->len < min_vendor_ie_length)
+			continue;
+
+		if (n_matches == ARRAY_SIZE(matches)) {
+			/* The element walk is not protected by the lock, so drop it here */
+			spin_unlock_bh(&mors_vif->vendor_ie.lock);
+			ret = morse_vendor_ie_report_rx_matches(vif, mgmt_type, matches, n_matches);
+			if (ret)
+				return ret;
+			n_matches = 0;
+			reported = true;
+			spin_lock_bh(&mors_vif->vendor_ie.lock);
+		}
+
+		vie = (const struct ieee80211_vendor_ie *)(elem->ptr - sizeof(vie->element_id) -
+							   sizeof(vie->len));
+
+		/* OUIs in the filter list are unique, so an element matches at most one entry */
+		list_for_each_entry(item, &mors_vif->vendor_ie.oui_filter_list, list) {
+			if ((item->mgmt_type_mask & mgmt_type) &&
+			    (memcmp(item->oui, vie->oui, sizeof(vie->oui)) == 0)) {
+				matches[n_matches].vie = vie;
+				matches[n_matches].on_vendor_ie_match = item->on_vendor_ie_match;
+				n_matches++;
+				if (bcn_addr)
+					hash = jhash(vie->oui, vie->len, hash);
+				break;
+			}
+		}
+	}
+
+	/* Matches already reported for this frame cannot be withdrawn, so only track it */
+	if (bcn_addr && n_matches &&
+	    morse_vendor_ie_bcn_is_duplicate(mors_vif, bcn_addr, hash) && !reported)
+		n_matches = 0;
+	spin_unlock_bh(&mors_vif->vendor_ie.lock);
+
+	if (n_matches)
+		ret = morse_vendor_ie_report_rx_matches(vif, mgmt_type, matches, n_matches);
+
+	return ret;
 }
 
 /**
@@ -290,6 +463,10 @@ static int morse_vendor_ie_clear_oui_filter(struct morse_vif *mors_vif, u16 mgmt
 	list_for_each_entry_safe(item, tmp, &mors_vif->vendor_ie.oui_filter_list, list)
 		try_remove_oui(mors_vif, item, mgmt_type_mask);
 
+	/* Report the next beacon from each source afresh once filters are reconfigured */
+	if (mgmt_type_mask & MORSE_VENDOR_IE_TYPE_BEACON)
+		morse_vendor_ie_bcn_seen_prune(mors_vif, 0);
+
 	spin_unlock_bh(&mors_vif->vendor_ie.lock);
 
 	if (!empty && (mgmt_type_mask & MORSE_VENDOR_IE_TYPE_BEACON))
@@ -303,6 +480,8 @@ void morse_vendor_ie_init_interface(struct morse_vif *mors_vif)
 {
 	INIT_LIST_HEAD(&mors_vif->vendor_ie.ie_list);
 	INIT_LIST_HEAD(&mors_vif->vendor_ie.oui_filter_list);
+	hash_init(mors_vif->vendor_ie.bcn_seen);
+	mors_vif->vendor_ie.n_bcn_seen = 0;
 	spin_lock_init(&mors_vif->vendor_ie.lock);
 }
 
@@ -356,44 +535,36 @@ int morse_vendor_ie_add_ies(struct morse_vif *mors_vif,
 	return 0;
 }
 
-void morse_vendor_ie_process_rx_mgmt(struct ieee80211_vif *vif, const struct sk_buff *skb)
+void morse_vendor_ie_process_rx_mgmt(struct ieee80211_vif *vif, const struct sk_buff *skb,
+				     const struct dot11ah_ies_mask *ies_mask)
 {
 	const struct ieee80211_mgmt *mgmt = (struct ieee80211_mgmt *)skb->data;
 	struct morse_vif *mors_vif = ieee80211_vif_to_morse_vif(vif);
 	enum morse_vendor_ie_mgmt_type_flags type;
-	const u8 *elements;
-	u16 elem_len;
+	const u8 *bcn_addr = NULL;
 
 	if (list_empty(&mors_vif->vendor_ie.oui_filter_list))
 		return;
 
-	if (ieee80211_is_s1g_beacon(mgmt->frame_control)) {
+	if (ieee80211_is_s1g_beacon(mgmt->frame_control))
 		type = MORSE_VENDOR_IE_TYPE_BEACON;
-		elements = get_elements_from_s1g_beacon((struct ieee80211_ext *)mgmt);
-	} else if (ieee80211_is_probe_req(mgmt->frame_control)) {
+	else if (ieee80211_is_probe_req(mgmt->frame_control))
 		type = MORSE_VENDOR_IE_TYPE_PROBE_REQ;
-		elements = mgmt->u.probe_req.variable;
-	} else if (ieee80211_is_probe_resp(mgmt->frame_control)) {
+	else if (ieee80211_is_probe_resp(mgmt->frame_control))
 		type = MORSE_VENDOR_IE_TYPE_PROBE_RESP;
-		elements = mgmt->u.probe_resp.variable;
-	} else if (ieee80211_is_assoc_req(mgmt->frame_control) ||
-			ieee80211_is_reassoc_req(mgmt->frame_control)) {
+	else if (ieee80211_is_assoc_req(mgmt->frame_control) ||
+		 ieee80211_is_reassoc_req(mgmt->frame_control))
 		type = MORSE_VENDOR_IE_TYPE_ASSOC_REQ;
-		elements = mgmt->u.assoc_req.variable;
-	} else if (ieee80211_is_assoc_resp(mgmt->frame_control) ||
-			    ieee80211_is_reassoc_resp(mgmt->frame_control)) {
-		struct morse_dot11ah_s1g_assoc_resp *s1g_assoc_resp =
-			(struct morse_dot11ah_s1g_assoc_resp *)mgmt;
-
+	else if (ieee80211_is_assoc_resp(mgmt->frame_control) ||
+		 ieee80211_is_reassoc_resp(mgmt->frame_control))
 		type = MORSE_VENDOR_IE_TYPE_ASSOC_RESP;
-		elements = s1g_assoc_resp->variable;
-	} else {
+	else
 		return;
-	}
 
-	elem_len = skb->len - (elements - (u8 *)skb->data);
+	if (type == MORSE_VENDOR_IE_TYPE_BEACON && vendor_ie_bcn_refresh_ms)
+		bcn_addr = ((const struct ieee80211_ext *)skb->data)->u.s1g_beacon.sa;
 
-	morse_vendor_ie_process_rx_ies(vif, elements, elem_len, type);
+	morse_vendor_ie_process_rx_ies(vif, ies_mask, type, bcn_addr);
 }
 
 int morse_vendor_ie_handle_config_cmd(struct morse_vif *mors_vif,
@@ -106,8 +106,10 @@ int morse_vendor_ie_add_ies(struct morse_vif *mors_vif,
  *
  * @vif virtual interface the beacon was received on
  * @skb the management frame SKB
+ * @ies_mask IEs already parsed from @skb, reused rather than walking the frame again
  */
-void morse_vendor_ie_process_rx_mgmt(struct ieee80211_vif *vif, const struct sk_buff *skb);
+void morse_vendor_ie_process_rx_mgmt(struct ieee80211_vif *vif, const struct sk_buff *skb,
+				     const struct dot11ah_ies_mask *ies_mask);
 
 /**
  * Handle a vendor IE config command
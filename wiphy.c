@@ -51,6 +51,17 @@ static const void *const morse_wiphy_privid = &morse_wiphy_privid;
  */
 static struct morse_vif *bound_mors_vif;
 
+/* Deliver fullmac RX frames to the stack through NAPI so they can be merged by GRO */
+static bool enable_wiphy_rx_gro __read_mostly;
+module_param(enable_wiphy_rx_gro, bool, 0444);
+MODULE_PARM_DESC(enable_wiphy_rx_gro, "Deliver fullmac RX frames through NAPI with GRO");
+
+/* Maximum number of frames handed to GRO per NAPI poll */
+#define MORSE_WIPHY_RX_NAPI_WEIGHT	64
+
+/* Granularity the shared scan result IE buffer grows in, so it settles after a few results */
+#define MORSE_WIPHY_SCAN_IES_BUF_ROUND	512
+
 struct morse *morse_wiphy_to_morse(struct wiphy *wiphy)
 {
 	struct ieee80211_hw *hw;
@@ -157,15 +168,27 @@ static netdev_tx_t morse_ndev_data_tx(struct sk_buff *skb, struct net_device *de
 	int ret;
 	struct morse_vif *mors_vif = netdev_priv(dev);
 	struct morse *mors = wiphy_priv(mors_vif->wdev.wiphy);
-	struct morse_skbq *mq = mors->cfg->ops->skbq_tc_q_from_aci(mors, MORSE_ACI_BE);
+	struct morse_skbq *mq = morse_chip_if_tc_q_from_aci(mors, MORSE_ACI_BE);
+#if KERNEL_VERSION(5, 2, 0) <= LINUX_VERSION_CODE
+	bool more = netdev_xmit_more();
+#else
+	bool more = skb->xmit_more;
+#endif
+
+	/* Hold frames while the stack has more to send, then queue the burst and kick once */
+	ret = morse_skbq_skb_tx_batched(mq, skb, NULL, &mors_vif->tx_batch);
+	if (ret >= 0) {
+		/* Counted before the flush, which may free the skb */
+		dev->stats.tx_packets++;
+		dev->stats.tx_bytes += skb->len;
+	}
+
+	if (!more || netif_xmit_stopped(netdev_get_tx_queue(dev, 0)))
+		morse_skbq_tx_batch_flush(&mors_vif->tx_batch);
 
-	ret = morse_skbq_skb_tx(mq, &skb, NULL, MORSE_SKB_CHAN_WIPHY);
 	if (ret < 0)
 		goto tx_err;
 
-	dev->stats.tx_packets++;
-	dev->stats.tx_bytes += skb->len;
-
 	return NETDEV_TX_OK;
 
 tx_err:
@@ -651,6 +674,53 @@ struct morse *morse_wiphy_create(size_t priv_size, struct device *dev)
 	return mors;
 }
 
+static int morse_wiphy_rx_napi_poll(struct napi_struct *napi, int budget)
+{
+	struct morse_vif *mors_vif = container_of(napi, struct morse_vif, rx_napi);
+	struct sk_buff *skb;
+	int done = 0;
+
+	while (done < budget) {
+		skb = skb_dequeue(&mors_vif->rx_napi_q);
+		if (!skb)
+			break;
+
+		napi_gro_receive(napi, skb);
+		done++;
+	}
+
+	if (done < budget)
+		napi_complete_done(napi, done);
+
+	return done;
+}
+
+static void morse_wiphy_rx_napi_add(struct morse_vif *mors_vif)
+{
+	skb_queue_head_init(&mors_vif->rx_napi_q);
+	if (!enable_wiphy_rx_gro)
+		return;
+
+#if KERNEL_VERSION(5, 19, 0) <= LINUX_VERSION_CODE
+	netif_napi_add_weight(mors_vif->ndev, &mors_vif->rx_napi, morse_wiphy_rx_napi_poll,
+			      MORSE_WIPHY_RX_NAPI_WEIGHT);
+#else
+	netif_napi_add(mors_vif->ndev, &mors_vif->rx_napi, morse_wiphy_rx_napi_poll,
+		       MORSE_WIPHY_RX_NAPI_WEIGHT);
+#endif
+	mors_vif->rx_napi_enabled = true;
+}
+
+static void morse_wiphy_rx_napi_del(struct morse_vif *mors_vif)
+{
+	if (mors_vif->rx_napi_enabled) {
+		mors_vif->rx_napi_enabled = false;
+		napi_disable(&mors_vif->rx_napi);
+		netif_napi_del(&mors_vif->rx_napi);
+	}
+	skb_queue_purge(&mors_vif->rx_napi_q);
+}
+
 static struct wireless_dev *morse_wiphy_interface_add(struct morse *mors, const char *name,
 						      unsigned char name_assign_type,
 						      enum nl80211_iftype type)
@@ -681,13 +751,22 @@ static struct wireless_dev *morse_wiphy_interface_add(struct morse *mors, const
 
 	morse_netdev_init(ndev, mors);
 	netdev_set_default_ethtool_ops(ndev, &mors_ethtool_ops);
+	morse_skbq_tx_batch_init(&mors_vif->tx_batch, MORSE_SKB_CHAN_WIPHY);
+	morse_wiphy_rx_napi_add(mors_vif);
 
 	if (register_netdevice(ndev))
 		goto err;
 
+	if (mors_vif->rx_napi_enabled)
+		napi_enable(&mors_vif->rx_napi);
+
 	return &mors_vif->wdev;
 
 err:
+	if (mors_vif->rx_napi_enabled) {
+		mors_vif->rx_napi_enabled = false;
+		netif_napi_del(&mors_vif->rx_napi);
+	}
 	free_netdev(ndev);
 	return NULL;
 }
@@ -840,8 +919,12 @@ void morse_wiphy_deinit(struct morse *mors)
 	morse_wiphy_cleanup(mors);
 	mutex_unlock(&mors->lock);
 
+	/* Events are no longer handled, so no scan result can be using the buffer */
+	morse_wiphy_scan_ies_free(mors);
+
 	netif_stop_queue(mors_vif->ndev);
 
+	morse_wiphy_rx_napi_del(mors_vif);
 	unregister_netdev(mors_vif->ndev);
 
 	if (wiphy->registered)
@@ -879,6 +962,13 @@ void morse_wiphy_rx(struct morse *mors, struct sk_buff *skb)
 	skb->protocol = eth_type_trans(skb, ndev);
 	ndev->stats.rx_packets++;
 	ndev->stats.rx_bytes += skb->len;
+
+	/* Delivered by morse_wiphy_rx_napi_schedule() at the end of the RX batch */
+	if (mors_vif->rx_napi_enabled) {
+		skb_queue_tail(&mors_vif->rx_napi_q, skb);
+		return;
+	}
+
 #if KERNEL_VERSION(5, 18, 0) <= LINUX_VERSION_CODE
 	netif_rx(skb);
 #else
@@ -886,9 +976,56 @@ void morse_wiphy_rx(struct morse *mors, struct sk_buff *skb)
 #endif
 }
 
-/* Caller must kfree() the returned value on success. */
-static u8 *morse_wiphy_translate_prob_resp_ies(u8 *ies_s1g, size_t ies_s1g_len,
-					       int *length_11n_out)
+void morse_wiphy_rx_napi_schedule(struct morse *mors)
+{
+	struct morse_vif *mors_vif = bound_mors_vif;
+
+	if (!mors_vif || !mors_vif->rx_napi_enabled || skb_queue_empty(&mors_vif->rx_napi_q))
+		return;
+
+	/* Called from process context; let the NAPI softirq run as soon as BHs are re-enabled */
+	local_bh_disable();
+	napi_schedule(&mors_vif->rx_napi);
+	local_bh_enable();
+}
+
+/**
+ * morse_wiphy_scan_ies_buf() - Get the translated IE buffer shared by the results of a scan
+ * @mors: Morse chip instance
+ * @len: Length needed
+ *
+ * cfg80211 copies the IEs of each result, so one buffer, grown as needed and freed when the scan
+ * is done, serves every result. Results and scan done are only handled from firmware events, which
+ * are serialised.
+ *
+ * Return: The buffer, or NULL if it could not be grown
+ */
+static u8 *morse_wiphy_scan_ies_buf(struct morse *mors, int len)
+{
+	if (len > mors->scan_ies.size) {
+		int size = roundup(len, MORSE_WIPHY_SCAN_IES_BUF_ROUND);
+
+		kfree(mors->scan_ies.buf);
+		mors->scan_ies.buf = kmalloc(size, GFP_KERNEL);
+		mors->scan_ies.size = mors->scan_ies.buf ? size : 0;
+		if (!mors->scan_ies.buf)
+			return NULL;
+	}
+
+	memset(mors->scan_ies.buf, 0, len);
+	return mors->scan_ies.buf;
+}
+
+static void morse_wiphy_scan_ies_free(struct morse *mors)
+{
+	kfree(mors->scan_ies.buf);
+	mors->scan_ies.buf = NULL;
+	mors->scan_ies.size = 0;
+}
+
+/* The returned buffer is only valid until the next scan result. */
+static u8 *morse_wiphy_translate_prob_resp_ies(struct morse *mors, u8 *ies_s1g,
+					       size_t ies_s1g_len, int *length_11n_out)
 {
 	struct dot11ah_ies_mask *ies_mask = NULL;
 	u8 *ies_11n = NULL;
@@ -906,20 +1043,19 @@ static u8 *morse_wiphy_translate_prob_resp_ies(u8 *ies_s1g, size_t ies_s1g_len,
 		goto err;
 
 	length_11n = morse_dot11ah_s1g_to_probe_resp_ies_size(ies_mask);
-	ies_11n = kzalloc(length_11n, GFP_KERNEL);
+	ies_11n = morse_wiphy_scan_ies_buf(mors, length_11n);
 	if (!ies_11n) {
 		ret = -ENOMEM;
 		goto err;
 	}
 	morse_dot11ah_s1g_to_probe_resp_ies(ies_11n, length_11n, ies_mask);
 
-	kfree(ies_mask);
+	morse_dot11ah_ies_mask_free(ies_mask);
 	*length_11n_out = length_11n;
 	return ies_11n;
 
 err:
-	kfree(ies_mask);
-	kfree(ies_11n);
+	morse_dot11ah_ies_mask_free(ies_mask);
 	return ERR_PTR(ret);
 }
 
@@ -964,7 +1100,7 @@ int morse_wiphy_scan_result(struct morse *mors, struct morse_evt_scan_result *re
 	/* cfg80211 wants the signal in mBm, even though we declare ourselves as SIGNAL_DBM. */
 	signal = DBM_TO_MBM((s32)signal_from_chip);
 
-	ies_11n = morse_wiphy_translate_prob_resp_ies(result->ies,
+	ies_11n = morse_wiphy_translate_prob_resp_ies(mors, result->ies,
 						      le16_to_cpu(result->ies_len), &ies_11n_len);
 	if (IS_ERR(ies_11n)) {
 		MORSE_INFO_RATELIMITED(mors, "invalid probe response IEs from BSS %pM\n",
@@ -985,7 +1121,6 @@ int morse_wiphy_scan_result(struct morse *mors, struct morse_evt_scan_result *re
 		ret = -ENOMEM;
 	}
 
-	kfree(ies_11n);
 	return ret;
 }
 
@@ -993,6 +1128,8 @@ void morse_wiphy_scan_done(struct morse *mors, bool aborted)
 {
 	struct cfg80211_scan_info info = { 0 };
 
+	morse_wiphy_scan_ies_free(mors);
+
 	mutex_lock(&mors->lock);
 
 	if (!mors->scan_req) {
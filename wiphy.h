@@ -92,6 +92,15 @@ void morse_wiphy_destroy(struct morse *mors);
  */
 void morse_wiphy_rx(struct morse *mors, struct sk_buff *skb);
 
+/**
+ * morse_wiphy_rx_napi_schedule() - Deliver the frames queued by morse_wiphy_rx() when
+ * enable_wiphy_rx_gro is set, through NAPI and GRO
+ * @mors: Morse state struct
+ *
+ * Called once per batch of received frames. Does nothing without GRO delivery.
+ */
+void morse_wiphy_rx_napi_schedule(struct morse *mors);
+
 /**
  * morse_wiphy_scan_result() -  Process a result from an in-progress scan
  * @mors: morse device instance
@@ -6,6 +6,8 @@
  */
 
 #include "linux/crc7.h"
+#include <linux/module.h>
+#include <linux/mm.h>
 
 #include "yaps-hw.h"
 #include "bus.h"
@@ -13,6 +15,7 @@
 #include "chip_if.h"
 #include "utils.h"
 #include "yaps.h"
+#include "ipmon.h"
 
 #define YAPS_HW_WINDOW_SIZE_BYTES	32768
 #define YAPS_MAX_PKT_SIZE_BYTES		16128
@@ -27,7 +30,30 @@
 #define YAPS_PAGE_SIZE	256
 #define SDIO_BLOCKSIZE	512
 
+/* Data packets no larger than this are always copied out of the RX window into a new skb */
+#define YAPS_RX_COPYBREAK_BYTES		256
+/* Bytes of a zero-copy RX packet copied to the skb linear area (morse header + 802.11 header) */
+#define YAPS_RX_ZC_LINEAR_BYTES		128
+/* Number of RX staging buffers */
+#define YAPS_RX_STAGING_BUFS		2
+
+static bool yaps_rx_zero_copy __read_mostly;
+module_param(yaps_rx_zero_copy, bool, 0444);
+MODULE_PARM_DESC(yaps_rx_zero_copy,
+		 "Deliver large RX data packets as page fragments of the YAPS RX window");
+
+/* Maximum number of packets gathered into a single TX bus transfer */
+#define YAPS_HW_TX_GATHER_MAX_SEGS	32
+
+static bool yaps_tx_gather __read_mostly;
+module_param(yaps_tx_gather, bool, 0644);
+MODULE_PARM_DESC(yaps_tx_gather,
+		 "Write TX packets straight from their skbs in one scatter-gather bus transfer");
+
 /* Calculate padding required for yaps transaction */
+/* Number of delimiter CRCs timed by each implementation in the CRC benchmark */
+#define YAPS_CRC_BENCHMARK_ROUNDS	(1 << 20)
+
 #define YAPS_CALC_PADDING(_bytes) ((_bytes) & 0x3 ? (4 - ((_bytes) & 0x3)) : 0)
 
 /*
@@ -131,7 +157,31 @@ struct morse_yaps_hw_aux_data {
 
 	/* Buffers to/from chip to support large contiguous reads/writes */
 	char *to_chip_buffer;
-	char *from_chip_buffer;
+
+	/*
+	 * Scatter-gather TX. Each segment is one skb carrying its delimiter in the headroom
+	 * and its padding in the tailroom, so nothing is copied into to_chip_buffer.
+	 */
+	struct kvec to_chip_vec[YAPS_HW_TX_GATHER_MAX_SEGS];
+	/* Set once the bus has declined a gathered write */
+	bool tx_gather_unsupported;
+
+	/* Double-buffered RX staging. The YAPS lock is only held for the bulk read into a
+	 * staging buffer; packets are then parsed out of it under rx_lock, leaving the bus free
+	 * for TX. A packet split across the end of a window is completed by reading into the
+	 * other buffer, so nothing still referencing the first one is overwritten.
+	 *
+	 * When zero-copy RX is enabled, each buffer is backed by a compound page. Packets handed
+	 * up as page fragments hold a reference, so a new page is swapped in before a buffer is
+	 * written again if any of those packets are still in flight.
+	 */
+	struct {
+		char *buf;
+		struct page *page;
+	} from_chip[YAPS_RX_STAGING_BUFS];
+	int from_chip_idx;
+	/* Serialise parsing of the RX staging buffers */
+	struct mutex rx_lock;
 
 	/* Status registers for queues and aloc pools on chip */
 	struct morse_yaps_status_registers status_regs;
@@ -173,20 +223,150 @@ static void morse_yaps_fill_aux_data_from_hw_tbl(struct morse_yaps_hw_aux_data *
 	aux_data->reserved_yaps_page_size = tbl_ptr->yaps_reserved_page_size;
 }
 
+/*
+ * CRC-7 (x^7 + x^3 + 1, as crc7_be) of the low 25 bits of a delimiter, fed most significant
+ * byte first. The CRC is linear with a zero seed, so the contribution of each byte can be
+ * looked up independently and XORed: row n holds the CRC of a byte followed by n zero bytes.
+ * Only bit 24 of the top byte is covered, which contributes YAPS_CRC_BIT24.
+ */
+static const u8 morse_yaps_crc_table[3][256] = {
+	{ /* bits 0-7 */
+		0x00, 0x09, 0x12, 0x1b, 0x24, 0x2d, 0x36, 0x3f, 0x48, 0x41, 0x5a, 0x53,
+		0x6c, 0x65, 0x7e, 0x77, 0x19, 0x10, 0x0b, 0x02, 0x3d, 0x34, 0x2f, 0x26,
+		0x51, 0x58, 0x43, 0x4a, 0x75, 0x7c, 0x67, 0x6e, 0x32, 0x3b, 0x20, 0x29,
+		0x16, 0x1f, 0x04, 0x0d, 0x7a, 0x73, 0x68, 0x61, 0x5e, 0x57, 0x4c, 0x45,
+		0x2b, 0x22, 0x39, 0x30, 0x0f, 0x06, 0x1d, 0x14, 0x63, 0x6a, 0x71, 0x78,
+		0x47, 0x4e, 0x55, 0x5c, 0x64, 0x6d, 0x76, 0x7f, 0x40, 0x49, 0x52, 0x5b,
+		0x2c, 0x25, 0x3e, 0x37, 0x08, 0x01, 0x1a, 0x13, 0x7d, 0x74, 0x6f, 0x66,
+		0x59, 0x50, 0x4b, 0x42, 0x35, 0x3c, 0x27, 0x2e, 0x11, 0x18, 0x03, 0x0a,
+		0x56, 0x5f, 0x44, 0x4d, 0x72, 0x7b, 0x60, 0x69, 0x1e, 0x17, 0x0c, 0x05,
+		0x3a, 0x33, 0x28, 0x21, 0x4f, 0x46, 0x5d, 0x54, 0x6b, 0x62, 0x79, 0x70,
+		0x07, 0x0e, 0x15, 0x1c, 0x23, 0x2a, 0x31, 0x38, 0x41, 0x48, 0x53, 0x5a,
+		0x65, 0x6c, 0x77, 0x7e, 0x09, 0x00, 0x1b, 0x12, 0x2d, 0x24, 0x3f, 0x36,
+		0x58, 0x51, 0x4a, 0x43, 0x7c, 0x75, 0x6e, 0x67, 0x10, 0x19, 0x02, 0x0b,
+		0x34, 0x3d, 0x26, 0x2f, 0x73, 0x7a, 0x61, 0x68, 0x57, 0x5e, 0x45, 0x4c,
+		0x3b, 0x32, 0x29, 0x20, 0x1f, 0x16, 0x0d, 0x04, 0x6a, 0x63, 0x78, 0x71,
+		0x4e, 0x47, 0x5c, 0x55, 0x22, 0x2b, 0x30, 0x39, 0x06, 0x0f, 0x14, 0x1d,
+		0x25, 0x2c, 0x37, 0x3e, 0x01, 0x08, 0x13, 0x1a, 0x6d, 0x64, 0x7f, 0x76,
+		0x49, 0x40, 0x5b, 0x52, 0x3c, 0x35, 0x2e, 0x27, 0x18, 0x11, 0x0a, 0x03,
+		0x74, 0x7d, 0x66, 0x6f, 0x50, 0x59, 0x42, 0x4b, 0x17, 0x1e, 0x05, 0x0c,
+		0x33, 0x3a, 0x21, 0x28, 0x5f, 0x56, 0x4d, 0x44, 0x7b, 0x72, 0x69, 0x60,
+		0x0e, 0x07, 0x1c, 0x15, 0x2a, 0x23, 0x38, 0x31, 0x46, 0x4f, 0x54, 0x5d,
+		0x62, 0x6b, 0x70, 0x79,
+	},
+	{ /* bits 8-15 */
+		0x00, 0x0b, 0x16, 0x1d, 0x2c, 0x27, 0x3a, 0x31, 0x58, 0x53, 0x4e, 0x45,
+		0x74, 0x7f, 0x62, 0x69, 0x39, 0x32, 0x2f, 0x24, 0x15, 0x1e, 0x03, 0x08,
+		0x61, 0x6a, 0x77, 0x7c, 0x4d, 0x46, 0x5b, 0x50, 0x72, 0x79, 0x64, 0x6f,
+		0x5e, 0x55, 0x48, 0x43, 0x2a, 0x21, 0x3c, 0x37, 0x06, 0x0d, 0x10, 0x1b,
+		0x4b, 0x40, 0x5d, 0x56, 0x67, 0x6c, 0x71, 0x7a, 0x13, 0x18, 0x05, 0x0e,
+		0x3f, 0x34, 0x29, 0x22, 0x6d, 0x66, 0x7b, 0x70, 0x41, 0x4a, 0x57, 0x5c,
+		0x35, 0x3e, 0x23, 0x28, 0x19, 0x12, 0x0f, 0x04, 0x54, 0x5f, 0x42, 0x49,
+		0x78, 0x73, 0x6e, 0x65, 0x0c, 0x07, 0x1a, 0x11, 0x20, 0x2b, 0x36, 0x3d,
+		0x1f, 0x14, 0x09, 0x02, 0x33, 0x38, 0x25, 0x2e, 0x47, 0x4c, 0x51, 0x5a,
+		0x6b, 0x60, 0x7d, 0x76, 0x26, 0x2d, 0x30, 0x3b, 0x0a, 0x01, 0x1c, 0x17,
+		0x7e, 0x75, 0x68, 0x63, 0x52, 0x59, 0x44, 0x4f, 0x53, 0x58, 0x45, 0x4e,
+		0x7f, 0x74, 0x69, 0x62, 0x0b, 0x00, 0x1d, 0x16, 0x27, 0x2c, 0x31, 0x3a,
+		0x6a, 0x61, 0x7c, 0x77, 0x46, 0x4d, 0x50, 0x5b, 0x32, 0x39, 0x24, 0x2f,
+		0x1e, 0x15, 0x08, 0x03, 0x21, 0x2a, 0x37, 0x3c, 0x0d, 0x06, 0x1b, 0x10,
+		0x79, 0x72, 0x6f, 0x64, 0x55, 0x5e, 0x43, 0x48, 0x18, 0x13, 0x0e, 0x05,
+		0x34, 0x3f, 0x22, 0x29, 0x40, 0x4b, 0x56, 0x5d, 0x6c, 0x67, 0x7a, 0x71,
+		0x3e, 0x35, 0x28, 0x23, 0x12, 0x19, 0x04, 0x0f, 0x66, 0x6d, 0x70, 0x7b,
+		0x4a, 0x41, 0x5c, 0x57, 0x07, 0x0c, 0x11, 0x1a, 0x2b, 0x20, 0x3d, 0x36,
+		0x5f, 0x54, 0x49, 0x42, 0x73, 0x78, 0x65, 0x6e, 0x4c, 0x47, 0x5a, 0x51,
+		0x60, 0x6b, 0x76, 0x7d, 0x14, 0x1f, 0x02, 0x09, 0x38, 0x33, 0x2e, 0x25,
+		0x75, 0x7e, 0x63, 0x68, 0x59, 0x52, 0x4f, 0x44, 0x2d, 0x26, 0x3b, 0x30,
+		0x01, 0x0a, 0x17, 0x1c,
+	},
+	{ /* bits 16-23 */
+		0x00, 0x2f, 0x5e, 0x71, 0x35, 0x1a, 0x6b, 0x44, 0x6a, 0x45, 0x34, 0x1b,
+		0x5f, 0x70, 0x01, 0x2e, 0x5d, 0x72, 0x03, 0x2c, 0x68, 0x47, 0x36, 0x19,
+		0x37, 0x18, 0x69, 0x46, 0x02, 0x2d, 0x5c, 0x73, 0x33, 0x1c, 0x6d, 0x42,
+		0x06, 0x29, 0x58, 0x77, 0x59, 0x76, 0x07, 0x28, 0x6c, 0x43, 0x32, 0x1d,
+		0x6e, 0x41, 0x30, 0x1f, 0x5b, 0x74, 0x05, 0x2a, 0x04, 0x2b, 0x5a, 0x75,
+		0x31, 0x1e, 0x6f, 0x40, 0x66, 0x49, 0x38, 0x17, 0x53, 0x7c, 0x0d, 0x22,
+		0x0c, 0x23, 0x52, 0x7d, 0x39, 0x16, 0x67, 0x48, 0x3b, 0x14, 0x65, 0x4a,
+		0x0e, 0x21, 0x50, 0x7f, 0x51, 0x7e, 0x0f, 0x20, 0x64, 0x4b, 0x3a, 0x15,
+		0x55, 0x7a, 0x0b, 0x24, 0x60, 0x4f, 0x3e, 0x11, 0x3f, 0x10, 0x61, 0x4e,
+		0x0a, 0x25, 0x54, 0x7b, 0x08, 0x27, 0x56, 0x79, 0x3d, 0x12, 0x63, 0x4c,
+		0x62, 0x4d, 0x3c, 0x13, 0x57, 0x78, 0x09, 0x26, 0x45, 0x6a, 0x1b, 0x34,
+		0x70, 0x5f, 0x2e, 0x01, 0x2f, 0x00, 0x71, 0x5e, 0x1a, 0x35, 0x44, 0x6b,
+		0x18, 0x37, 0x46, 0x69, 0x2d, 0x02, 0x73, 0x5c, 0x72, 0x5d, 0x2c, 0x03,
+		0x47, 0x68, 0x19, 0x36, 0x76, 0x59, 0x28, 0x07, 0x43, 0x6c, 0x1d, 0x32,
+		0x1c, 0x33, 0x42, 0x6d, 0x29, 0x06, 0x77, 0x58, 0x2b, 0x04, 0x75, 0x5a,
+		0x1e, 0x31, 0x40, 0x6f, 0x41, 0x6e, 0x1f, 0x30, 0x74, 0x5b, 0x2a, 0x05,
+		0x23, 0x0c, 0x7d, 0x52, 0x16, 0x39, 0x48, 0x67, 0x49, 0x66, 0x17, 0x38,
+		0x7c, 0x53, 0x22, 0x0d, 0x7e, 0x51, 0x20, 0x0f, 0x4b, 0x64, 0x15, 0x3a,
+		0x14, 0x3b, 0x4a, 0x65, 0x21, 0x0e, 0x7f, 0x50, 0x10, 0x3f, 0x4e, 0x61,
+		0x25, 0x0a, 0x7b, 0x54, 0x7a, 0x55, 0x24, 0x0b, 0x4f, 0x60, 0x11, 0x3e,
+		0x4d, 0x62, 0x13, 0x3c, 0x78, 0x57, 0x26, 0x09, 0x27, 0x08, 0x79, 0x56,
+		0x12, 0x3d, 0x4c, 0x63,
+	},
+};
+
+#define YAPS_CRC_BIT24		(0x03)
+
 static inline u8 morse_yaps_crc(u32 word)
+{
+	return morse_yaps_crc_table[0][word & 0xff] ^
+	       morse_yaps_crc_table[1][(word >> 8) & 0xff] ^
+	       morse_yaps_crc_table[2][(word >> 16) & 0xff] ^
+	       ((word & BIT(24)) ? YAPS_CRC_BIT24 : 0);
+}
+
+#ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
+/* Reference byte at a time implementation, kept to check and benchmark the table */
+static u8 morse_yaps_crc_bytewise(u32 word)
 {
 	u8 crc = 0;
-	int len = sizeof(word);
+	int shift;
 
 	/* Mask to look at only non-crc bits in both metadata word and delimiters */
-	word = cpu_to_be32(word & 0x1ffffff);
-	while (len--) {
-		crc = crc7_be_byte(crc, word & 0xff);
-		word >>= 8;
-	}
+	word &= 0x1ffffff;
+	for (shift = 24; shift >= 0; shift -= 8)
+		crc = crc7_be_byte(crc, (word >> shift) & 0xff);
 	return crc >> 1;
 }
 
+int morse_yaps_crc_benchmark(struct seq_file *file)
+{
+	u64 start_ns, table_ns, bytewise_ns;
+	u32 mismatches = 0;
+	u32 word;
+	u8 acc = 0;
+	int i;
+
+	/* Exhaustively check the 25 covered bits, this also warms both paths */
+	for (word = 0; word < BIT(25); word++) {
+		if (morse_yaps_crc(word) != morse_yaps_crc_bytewise(word))
+			mismatches++;
+		if (!(word & 0xffff))
+			cond_resched();
+	}
+
+	start_ns = ktime_get_ns();
+	for (i = 0; i < YAPS_CRC_BENCHMARK_ROUNDS; i++)
+		acc ^= morse_yaps_crc(i * 0x9e3779b1);
+	table_ns = ktime_get_ns() - start_ns;
+
+	start_ns = ktime_get_ns();
+	for (i = 0; i < YAPS_CRC_BENCHMARK_ROUNDS; i++)
+		acc ^= morse_yaps_crc_bytewise(i * 0x9e3779b1);
+	bytewise_ns = ktime_get_ns() - start_ns;
+
+	seq_printf(file, "delimiters: %d\n", YAPS_CRC_BENCHMARK_ROUNDS);
+	seq_printf(file, "table (ps per crc): %llu\n",
+		   div_u64(table_ns * 1000, YAPS_CRC_BENCHMARK_ROUNDS));
+	seq_printf(file, "bytewise (ps per crc): %llu\n",
+		   div_u64(bytewise_ns * 1000, YAPS_CRC_BENCHMARK_ROUNDS));
+	seq_printf(file, "mismatches: %u\n", mismatches);
+	/* Keep the loops from being optimised away */
+	seq_printf(file, "checksum: 0x%02x\n", acc);
+
+	return mismatches ? -EIO : 0;
+}
+#endif
+
 static inline u32 morse_yaps_delimiter(struct morse_yaps *yaps,
 				unsigned int size, u8 pool_id, bool irq)
 {
@@ -300,6 +480,95 @@ static int morse_yaps_hw_write_pkt_err_check(struct morse_yaps *yaps, struct mor
 	return 0;
 }
 
+static bool morse_yaps_hw_tx_gather_ok(struct morse_yaps *yaps, struct morse_yaps_pkt pkts[],
+					int num_pkts)
+{
+	struct morse *mors = yaps->mors;
+	int i;
+
+	if (!yaps_tx_gather || yaps->aux_data->tx_gather_unsupported ||
+	    !morse_bus_can_writev(mors))
+		return false;
+
+	for (i = 0; i < num_pkts; i++) {
+		struct sk_buff *skb = pkts[i].skb;
+
+		if (skb_cloned(skb) || skb_is_nonlinear(skb) ||
+		    skb_headroom(skb) < sizeof(u32) ||
+		    skb_tailroom(skb) < YAPS_CALC_PADDING(skb->len) ||
+		    !IS_ALIGNED((uintptr_t)skb->data - sizeof(u32),
+				mors->bus_ops->bulk_alignment))
+			return false;
+	}
+
+	return true;
+}
+
+/* Frame the packet in place: delimiter in the headroom, padding in the tailroom */
+static void morse_yaps_hw_tx_gather_push(struct sk_buff *skb, u32 delim)
+{
+	__skb_put(skb, YAPS_CALC_PADDING(skb->len));
+	*((__le32 *)__skb_push(skb, sizeof(delim))) = cpu_to_le32(delim);
+}
+
+/* Undo morse_yaps_hw_tx_gather_push() */
+static void morse_yaps_hw_tx_gather_pop(struct morse_yaps *yaps, struct sk_buff *skb)
+{
+	u32 delim = le32_to_cpu(*((__le32 *)skb->data));
+
+	__skb_pull(skb, sizeof(delim));
+	__skb_trim(skb, YAPS_DELIM_GET_PKT_SIZE(yaps->aux_data, delim));
+}
+
+/* Write a batch of packets framed in place by morse_yaps_hw_tx_gather_push() */
+static int morse_yaps_hw_write_gathered(struct morse_yaps *yaps, struct morse_yaps_pkt pkts[],
+					int num_pkts, int len)
+{
+	struct morse_yaps_hw_aux_data *aux_data = yaps->aux_data;
+	char *write_buf = aux_data->to_chip_buffer;
+	int ret = -EOPNOTSUPP;
+	int i;
+
+	for (i = 0; i < num_pkts; i++) {
+		aux_data->to_chip_vec[i].iov_base = pkts[i].skb->data;
+		aux_data->to_chip_vec[i].iov_len = pkts[i].skb->len;
+	}
+
+	if (!aux_data->tx_gather_unsupported) {
+		ret = morse_dm_writev(yaps->mors, aux_data->yds_addr, aux_data->to_chip_vec,
+				      num_pkts);
+		if (ret == -EOPNOTSUPP) {
+			MORSE_YAPS_INFO(yaps->mors,
+					"%s: bus cannot gather TX, copying packets instead\n",
+					__func__);
+			aux_data->tx_gather_unsupported = true;
+		}
+	}
+
+	if (ret == -EOPNOTSUPP) {
+		for (i = 0; i < num_pkts; i++) {
+			memcpy(write_buf, pkts[i].skb->data, pkts[i].skb->len);
+			write_buf += pkts[i].skb->len;
+		}
+		ret = morse_dm_write(yaps->mors, aux_data->yds_addr, aux_data->to_chip_buffer, len);
+	}
+
+	for (i = 0; i < num_pkts; i++)
+		morse_yaps_hw_tx_gather_pop(yaps, pkts[i].skb);
+
+	return ret;
+}
+
+static int morse_yaps_hw_write_batch(struct morse_yaps *yaps, struct morse_yaps_pkt pkts[],
+				     int num_pkts, int len, bool gather)
+{
+	if (gather)
+		return morse_yaps_hw_write_gathered(yaps, pkts, num_pkts, len);
+
+	return morse_dm_write(yaps->mors, yaps->aux_data->yds_addr,
+			      yaps->aux_data->to_chip_buffer, len);
+}
+
 static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 				    struct morse_yaps_pkt pkts[], int num_pkts, int *num_pkts_sent)
 {
@@ -309,8 +578,10 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 	char *write_buf = yaps->aux_data->to_chip_buffer;
 	int tx_len;
 	int batch_txn_len = 0;
+	int batch_first = 0;
 	int pkts_pending = 0;
 	bool delim_irq = false;
+	bool gather = false;
 
 	ret = yaps_hw_lock(yaps);
 	if (ret) {
@@ -325,14 +596,17 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 	if (ret)
 		goto exit;
 
+	gather = morse_yaps_hw_tx_gather_ok(yaps, pkts, num_pkts);
+
 	/* Batch packets into larger transactions. Send as many as we have space for. */
 	for (i = 0; i < num_pkts; ++i) {
 		tx_len = pkts[i].skb->len + YAPS_CALC_PADDING(pkts[i].skb->len) + sizeof(delim);
 
 		/* Send when we have reached window size, don't split pkt over boundary */
-		if ((batch_txn_len + tx_len) > YAPS_HW_WINDOW_SIZE_BYTES) {
-			ret = morse_dm_write(yaps->mors, yaps->aux_data->yds_addr,
-					     yaps->aux_data->to_chip_buffer, batch_txn_len);
+		if ((batch_txn_len + tx_len) > YAPS_HW_WINDOW_SIZE_BYTES ||
+		    (gather && pkts_pending == YAPS_HW_TX_GATHER_MAX_SEGS)) {
+			ret = morse_yaps_hw_write_batch(yaps, &pkts[batch_first], pkts_pending,
+							batch_txn_len, gather);
 
 			/*
 			 * No need to check for SDIO interrupt lock up here.
@@ -344,6 +618,7 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 				goto exit;
 			write_buf = yaps->aux_data->to_chip_buffer;
 			*num_pkts_sent += pkts_pending;
+			batch_first = i;
 			pkts_pending = 0;
 		}
 
@@ -364,10 +639,14 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 		/* Always set IRQ for the last packet so the chip doesn't miss it */
 		delim = morse_yaps_delimiter(yaps, pkts[i].skb->len, pkts[i].tc_queue,
 					     delim_irq);
-		*((u32 *)write_buf) = cpu_to_le32(delim);
-		memcpy(write_buf + sizeof(delim), pkts[i].skb->data, pkts[i].skb->len);
+		if (gather) {
+			morse_yaps_hw_tx_gather_push(pkts[i].skb, delim);
+		} else {
+			*((u32 *)write_buf) = cpu_to_le32(delim);
+			memcpy(write_buf + sizeof(delim), pkts[i].skb->data, pkts[i].skb->len);
+			write_buf += tx_len;
+		}
 
-		write_buf += tx_len;
 		batch_txn_len += tx_len;
 		pkts_pending++;
 
@@ -377,8 +656,8 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 
 exit:
 	if (batch_txn_len > 0) {
-		ret = morse_dm_write(yaps->mors, yaps->aux_data->yds_addr,
-				     yaps->aux_data->to_chip_buffer, batch_txn_len);
+		ret = morse_yaps_hw_write_batch(yaps, &pkts[batch_first], pkts_pending,
+						batch_txn_len, gather);
 		*num_pkts_sent += pkts_pending;
 
 		morse_yaps_hw_modify_status_pend_flag(yaps->mors, batch_txn_len);
@@ -426,13 +705,226 @@ static int morse_calc_bytes_remaining(struct morse_yaps *yaps)
 	return (int)bytes_in_queue;
 }
 
+static int morse_yaps_hw_rx_buf_alloc(struct morse_yaps_hw_aux_data *aux_data)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(aux_data->from_chip); i++) {
+		if (!yaps_rx_zero_copy) {
+			aux_data->from_chip[i].buf = kzalloc(YAPS_HW_WINDOW_SIZE_BYTES, GFP_KERNEL);
+			if (!aux_data->from_chip[i].buf)
+				return -ENOMEM;
+			continue;
+		}
+
+		aux_data->from_chip[i].page = alloc_pages(GFP_KERNEL | __GFP_COMP,
+							  get_order(YAPS_HW_WINDOW_SIZE_BYTES));
+		if (!aux_data->from_chip[i].page)
+			return -ENOMEM;
+		aux_data->from_chip[i].buf = page_address(aux_data->from_chip[i].page);
+	}
+
+	aux_data->from_chip_idx = 0;
+	mutex_init(&aux_data->rx_lock);
+	return 0;
+}
+
+static void morse_yaps_hw_rx_buf_free(struct morse_yaps_hw_aux_data *aux_data)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(aux_data->from_chip); i++) {
+		if (aux_data->from_chip[i].page)
+			put_page(aux_data->from_chip[i].page);
+		else
+			kfree(aux_data->from_chip[i].buf);
+
+		aux_data->from_chip[i].page = NULL;
+		aux_data->from_chip[i].buf = NULL;
+	}
+}
+
+/*
+ * Advance to the next RX staging buffer and make sure it can be overwritten. In zero-copy mode,
+ * packets from an earlier read may still reference its page, in which case a fresh page is
+ * allocated and the old one is left to be freed with the last skb that uses it.
+ *
+ * Must be called with rx_lock held. Returns the index of the buffer to read into, or a
+ * negative errno.
+ */
+static int morse_yaps_hw_rx_buf_next(struct morse_yaps *yaps)
+{
+	struct morse_yaps_hw_aux_data *aux_data = yaps->aux_data;
+	int idx = (aux_data->from_chip_idx + 1) % ARRAY_SIZE(aux_data->from_chip);
+	struct page *page = aux_data->from_chip[idx].page;
+
+	lockdep_assert_held(&aux_data->rx_lock);
+
+	if (page && page_ref_count(page) != 1) {
+		page = alloc_pages(GFP_KERNEL | __GFP_COMP, get_order(YAPS_HW_WINDOW_SIZE_BYTES));
+		if (!page) {
+			MORSE_YAPS_ERR(yaps->mors, "yaps no mem for rx window\n");
+			return -ENOMEM;
+		}
+
+		put_page(aux_data->from_chip[idx].page);
+		aux_data->from_chip[idx].page = page;
+		aux_data->from_chip[idx].buf = page_address(page);
+		MORSE_PAGE_STAT_INC(yaps->mors, rx_window_realloc);
+	}
+
+	aux_data->from_chip_idx = idx;
+	return idx;
+}
+
+/*
+ * Walk the delimiters of a window read into buf, stopping where morse_yaps_hw_read_pkts()
+ * would. Returns the number of bytes that must still be read to complete a packet that runs
+ * off the end of the window, or 0 if there is none.
+ */
+static int morse_yaps_hw_rx_overhang_len(struct morse_yaps *yaps, const char *buf, int len,
+					 int num_pkts_max)
+{
+	int i;
+
+	for (i = 0; i < num_pkts_max && len > 0; i++) {
+		u32 delim = le32_to_cpu(*((u32 *)buf));
+		int total_len;
+
+		buf += sizeof(delim);
+		len -= sizeof(delim);
+
+		if (delim == 0x0 || !morse_yaps_is_valid_delimiter(delim))
+			break;
+
+		total_len = YAPS_DELIM_GET_PKT_SIZE(yaps->aux_data, delim) +
+			    YAPS_DELIM_GET_PADDING(delim);
+		if (total_len > len)
+			return total_len - len;
+
+		buf += total_len;
+		len -= total_len;
+	}
+
+	return 0;
+}
+
+/*
+ * Bulk read the YSL into an RX staging buffer. If the last packet runs off the end of the
+ * window, the rest of it is read into the next staging buffer, whose index is returned in
+ * overhang_idx (otherwise -1). The YAPS lock is held once across both reads and the status
+ * pending flag update, so TX cannot use the bus in between; it is released before the
+ * packets are parsed out of the buffers.
+ *
+ * Must be called with rx_lock held.
+ */
+static int morse_yaps_hw_rx_bulk_read(struct morse_yaps *yaps, char *buf, int len,
+				      int num_pkts_max, int *overhang_idx)
+{
+	int overhang_len;
+	int ret;
+
+	*overhang_idx = -1;
+
+	ret = yaps_hw_lock(yaps);
+	if (ret) {
+		MORSE_YAPS_DBG(yaps->mors, "%s yaps lock failed %d\n", __func__, ret);
+		return ret;
+	}
+
+	ret = morse_dm_read(yaps->mors, yaps->aux_data->ysl_addr, buf, len);
+	if (ret)
+		goto exit;
+
+	overhang_len = morse_yaps_hw_rx_overhang_len(yaps, buf, len, num_pkts_max);
+	if (overhang_len) {
+		*overhang_idx = morse_yaps_hw_rx_buf_next(yaps);
+		if (*overhang_idx < 0) {
+			ret = *overhang_idx;
+			goto exit;
+		}
+
+		len = overhang_len;
+		ret = morse_dm_read(yaps->mors,
+				    /* Offset by 4 to avoid retry logic */
+				    yaps->aux_data->ysl_addr + 4,
+				    yaps->aux_data->from_chip[*overhang_idx].buf, len);
+		if (ret)
+			goto exit;
+	}
+
+	morse_yaps_hw_modify_status_pend_flag(yaps->mors, len);
+
+exit:
+	yaps_hw_unlock(yaps);
+	return ret;
+}
+
+/*
+ * Build an skb for a packet that lies entirely within the RX window. Large data packets are
+ * attached as a fragment of the window page with only the headers copied to the linear area;
+ * everything else is copied.
+ */
+static struct sk_buff *morse_yaps_hw_rx_build_skb(struct morse_yaps *yaps, struct page *page,
+						  char *pkt, int pkt_size)
+{
+	const struct morse_buff_skb_header *hdr = (const struct morse_buff_skb_header *)pkt;
+	struct sk_buff *skb;
+	int linear_len = pkt_size;
+	int tailroom = 0;
+	bool zero_copy = false;
+
+	/* Only 802.11 data frames are eligible. Their checksum only covers the headers and the
+	 * driver does not need to look at the payload before handing them to mac80211.
+	 */
+	if (page && pkt_size > YAPS_RX_COPYBREAK_BYTES &&
+	    hdr->channel == MORSE_SKB_CHAN_DATA &&
+	    sizeof(*hdr) + hdr->offset + QOS_HDR_SIZE + IEEE80211_CCMP_HDR_LEN <=
+	    YAPS_RX_ZC_LINEAR_BYTES) {
+		const struct ieee80211_hdr *mac_hdr =
+			(const struct ieee80211_hdr *)(pkt + sizeof(*hdr) + hdr->offset);
+
+		if (ieee80211_is_data(mac_hdr->frame_control)) {
+			linear_len = YAPS_RX_ZC_LINEAR_BYTES;
+			zero_copy = true;
+		}
+	}
+
+	if (!zero_copy)
+		tailroom = morse_skb_rx_tailroom(pkt, pkt_size);
+
+	/* Frames the driver consumes itself are recycled through the skb cache */
+	if (hdr->channel == MORSE_SKB_CHAN_TX_STATUS || hdr->channel == MORSE_SKB_CHAN_COMMAND ||
+	    hdr->channel == MORSE_SKB_CHAN_LOOPBACK)
+		skb = morse_skb_cache_alloc(yaps->mors, linear_len);
+	else
+		skb = dev_alloc_skb(linear_len + tailroom);
+	if (!skb)
+		return NULL;
+
+	memcpy(skb_put(skb, linear_len), pkt, linear_len);
+
+	if (zero_copy) {
+		int offset = (pkt + linear_len) - (char *)page_address(page);
+
+		get_page(page);
+		skb_add_rx_frag(skb, 0, page, offset, pkt_size - linear_len,
+				pkt_size - linear_len);
+		MORSE_PAGE_STAT_INC(yaps->mors, rx_zero_copy);
+	}
+
+	return skb;
+}
+
 static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 				   struct morse_yaps_pkt pkts[],
 				   int num_pkts_max, int *num_pkts_received)
 {
 	int ret;
 	int i = 0;
-	char *read_ptr = yaps->aux_data->from_chip_buffer;
+	int idx;
+	int overhang_idx;
+	char *read_ptr;
 	int bytes_remaining = morse_calc_bytes_remaining(yaps);
 	bool again = false;
 
@@ -448,23 +940,18 @@ static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 		again = true;
 	}
 
-	/* This is more coarse-grained than it needs to be -
-	 * once the data is read into a local buffer the lock can be released,
-	 * however access to from_chip_buffer will need to be protected with
-	 * its own lock
-	 */
-	ret = yaps_hw_lock(yaps);
-	if (ret) {
-		MORSE_YAPS_DBG(yaps->mors, "%s yaps lock failed %d\n", __func__, ret);
-		return ret;
+	mutex_lock(&yaps->aux_data->rx_lock);
+
+	idx = morse_yaps_hw_rx_buf_next(yaps);
+	if (idx < 0) {
+		ret = idx;
+		goto exit;
 	}
+	read_ptr = yaps->aux_data->from_chip[idx].buf;
 
 	/* Read all available packets to the buffer */
-	ret = morse_dm_read(yaps->mors, yaps->aux_data->ysl_addr,
-			    yaps->aux_data->from_chip_buffer, bytes_remaining);
-
-	morse_yaps_hw_modify_status_pend_flag(yaps->mors, bytes_remaining);
-
+	ret = morse_yaps_hw_rx_bulk_read(yaps, read_ptr, bytes_remaining, num_pkts_max,
+					 &overhang_idx);
 	if (ret)
 		goto exit;
 
@@ -498,18 +985,18 @@ static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 		if (pkts[i].skb)
 			MORSE_YAPS_ERR(yaps->mors, "yaps packet leak\n");
 
-		/* SKB doesn't want padding */
-		pkts[i].skb = dev_alloc_skb(pkt_size);
-		if (!pkts[i].skb) {
-			ret = -ENOMEM;
-			MORSE_YAPS_ERR(yaps->mors, "yaps no mem for skb\n");
-			goto exit;
-		}
-		skb_put(pkts[i].skb, pkt_size);
-
 		if (total_len <= bytes_remaining) {
-			/* Case where entire packet fits in the remaining window */
-			memcpy(pkts[i].skb->data, read_ptr, pkt_size);
+			/* Case where entire packet fits in the remaining window.
+			 * SKB doesn't want padding.
+			 */
+			pkts[i].skb = morse_yaps_hw_rx_build_skb(yaps,
+								 yaps->aux_data->from_chip[idx].page,
+								 read_ptr, pkt_size);
+			if (!pkts[i].skb) {
+				ret = -ENOMEM;
+				MORSE_YAPS_ERR(yaps->mors, "yaps no mem for skb\n");
+				goto exit;
+			}
 			read_ptr += total_len;
 			bytes_remaining -= total_len;
 		} else {
@@ -517,21 +1004,27 @@ static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 			const int read_overhang_len = total_len - bytes_remaining;
 			const int pkt_overhang_len = pkt_size - bytes_remaining;
 
-			yaps->mors->debug.page_stats.rx_split++;
+			/* SKB doesn't want padding */
+			pkts[i].skb = dev_alloc_skb(pkt_size +
+						    morse_skb_rx_tailroom(read_ptr, bytes_remaining));
+			if (!pkts[i].skb) {
+				ret = -ENOMEM;
+				MORSE_YAPS_ERR(yaps->mors, "yaps no mem for skb\n");
+				goto exit;
+			}
+			skb_put(pkts[i].skb, pkt_size);
+
+			MORSE_PAGE_STAT_INC(yaps->mors, rx_split);
 			/* TODO remove the warning, this is not a kernel bug */
 			MORSE_DBG_RATELIMITED(yaps->mors, "yaps split pkt\n");
 			memcpy(pkts[i].skb->data, read_ptr, bytes_remaining);
-			read_ptr = yaps->aux_data->from_chip_buffer;
 
-			ret = morse_dm_read(yaps->mors,
-					    /* Offset by 4 to avoid retry logic */
-					    yaps->aux_data->ysl_addr + 4,
-					    read_ptr, read_overhang_len);
-
-			morse_yaps_hw_modify_status_pend_flag(yaps->mors, read_overhang_len);
-
-			if (ret)
+			/* The rest was read into the other staging buffer with the window */
+			if (WARN_ON_ONCE(overhang_idx < 0)) {
+				ret = -EIO;
 				goto exit;
+			}
+			read_ptr = yaps->aux_data->from_chip[overhang_idx].buf;
 
 			memcpy(pkts[i].skb->data + bytes_remaining, read_ptr, pkt_overhang_len);
 			read_ptr += read_overhang_len;
@@ -546,7 +1039,7 @@ static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 		ret = -EAGAIN;
 
 exit:
-	yaps_hw_unlock(yaps);
+	mutex_unlock(&yaps->aux_data->rx_lock);
 	return ret;
 }
 
@@ -634,6 +1127,12 @@ static int morse_yaps_hw_update_status(struct morse_yaps *yaps)
 		ret = -EIO;
 	}
 
+	/* Release a stalled data path as soon as a full sized data packet would fit */
+	if (!ret && status_regs->tc_tx_num_pkts < yaps->aux_data->tc_tx_q_size &&
+	    status_regs->tc_tx_pool_num_pages >=
+	    morse_yaps_pages_required(yaps, IEEE80211_MAX_DATA_LEN))
+		morse_yaps_chip_queue_has_space(yaps);
+
 exit_unlock:
 	yaps_hw_unlock(yaps);
 
@@ -711,11 +1210,9 @@ int morse_yaps_hw_init(struct morse *mors)
 		goto err_exit;
 	}
 
-	yaps->aux_data->from_chip_buffer = kzalloc(YAPS_HW_WINDOW_SIZE_BYTES, GFP_KERNEL);
-	if (!yaps->aux_data->from_chip_buffer) {
-		ret = -ENOMEM;
+	ret = morse_yaps_hw_rx_buf_alloc(yaps->aux_data);
+	if (ret)
 		goto err_exit;
-	}
 
 	yaps->ops = &morse_yaps_hw_ops;
 
@@ -731,7 +1228,8 @@ int morse_yaps_hw_init(struct morse *mors)
 		goto err_exit;
 	}
 
-	INIT_WORK(&mors->chip_if_work, morse_yaps_work);
+	morse_hw_chip_if_work_init(mors);
+	morse_hw_irq_coalesce_init(mors);
 	INIT_WORK(&mors->tx_stale_work, morse_yaps_stale_tx_work);
 
 	/* yaps irq will claim and release the bus */
@@ -766,12 +1264,12 @@ void morse_yaps_hw_finish(struct morse *mors)
 
 	yaps = mors->chip_if->yaps;
 	morse_yaps_hw_enable_irqs(mors, false);
-	cancel_work_sync(&mors->chip_if_work);
+	morse_hw_irq_coalesce_finish(mors);
+	morse_hw_chip_if_work_finish(mors);
 	morse_yaps_finish(yaps);
 	cancel_work_sync(&mors->tx_stale_work);
 	if (yaps->aux_data) {
-		kfree(yaps->aux_data->from_chip_buffer);
-		yaps->aux_data->from_chip_buffer = NULL;
+		morse_yaps_hw_rx_buf_free(yaps->aux_data);
 		kfree(yaps->aux_data->to_chip_buffer);
 		yaps->aux_data->to_chip_buffer = NULL;
 		kfree(yaps->aux_data);
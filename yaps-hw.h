@@ -44,10 +44,21 @@ struct morse_yaps_hw_table {
 } __packed;
 
 struct morse;
+struct seq_file;
 
 int morse_yaps_hw_init(struct morse *mors);
 void morse_yaps_hw_yaps_flush_tx_data(struct morse *mors);
 void morse_yaps_hw_finish(struct morse *mors);
 void morse_yaps_hw_read_table(struct morse *mors, struct morse_yaps_hw_table *tbl_ptr);
 
+/**
+ * Check the table driven delimiter CRC against the byte at a time implementation for every
+ * covered delimiter value, then time both and print the results to a file.
+ *
+ * @file: Pointer to file to print to
+ *
+ * @return: 0 on success, -EIO if the implementations disagree
+ */
+int morse_yaps_crc_benchmark(struct seq_file *file);
+
 #endif /* !_MORSE_YAPS_HW_H_ */
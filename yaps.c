@@ -7,6 +7,8 @@
 #include <linux/gpio.h>
 #include <linux/random.h>
 #include <linux/timer.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
 
 #include "morse.h"
 #include "debug.h"
@@ -16,24 +18,81 @@
 #include "bus.h"
 #include "command.h"
 #include "skbq.h"
+#include "mac.h"
 #include "yaps-hw.h"
 
 #define BENCHMARK_PKT_LEN		(1496)
+#define BENCHMARK_PKT_LEN_MAX		(IEEE80211_MAX_DATA_LEN)
 #define BENCHMARK_WAIT_MS		(5000)
+/* Time allowed for outstanding loopback packets to return at the end of a benchmark step */
+#define BENCHMARK_DRAIN_MS		(500)
+/* Number of round trip latency samples kept per benchmark step */
+#define BENCHMARK_LAT_SAMPLES		(16 * 1024)
+#define BENCHMARK_MAGIC			(0x4d4f5253)
+
+#ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
+static uint yaps_benchmark_min_len __read_mostly = BENCHMARK_PKT_LEN;
+module_param(yaps_benchmark_min_len, uint, 0644);
+MODULE_PARM_DESC(yaps_benchmark_min_len, "Smallest packet size (bytes) of the yaps benchmark");
+
+static uint yaps_benchmark_max_len __read_mostly = BENCHMARK_PKT_LEN;
+module_param(yaps_benchmark_max_len, uint, 0644);
+MODULE_PARM_DESC(yaps_benchmark_max_len,
+		 "Largest packet size (bytes) of the yaps benchmark. Sizes double from the minimum");
+
+static uint yaps_benchmark_duration_ms __read_mostly = BENCHMARK_WAIT_MS;
+module_param(yaps_benchmark_duration_ms, uint, 0644);
+MODULE_PARM_DESC(yaps_benchmark_duration_ms, "Duration (ms) of each yaps benchmark step");
+
+static uint yaps_benchmark_queue_depth __read_mostly;
+module_param(yaps_benchmark_queue_depth, uint, 0644);
+MODULE_PARM_DESC(yaps_benchmark_queue_depth,
+		 "Maximum yaps benchmark packets in flight (0 = limited by TX queue space)");
+
+static bool yaps_benchmark_bidir __read_mostly = true;
+module_param(yaps_benchmark_bidir, bool, 0644);
+MODULE_PARM_DESC(yaps_benchmark_bidir,
+		 "Measure looped back traffic and latency (0 = to chip throughput only)");
+
+/* Prefix of each benchmark packet payload, returned untouched by the chip */
+struct morse_yaps_benchmark_stamp {
+	__le32 magic;
+	__le32 run;
+	__le64 tx_ns;
+} __packed;
+#endif
 
 /* This is a fail safe timeout */
 #define CHIP_FULL_RECOVERY_TIMEOUT_MS 30
 
+/* Weight (as a power of two) of each new sample in the chip free time average */
+#define CHIP_FULL_AVG_WEIGHT_SHIFT	3
+
 /* Defined as the most number of MPDUs per AMPDU */
 #ifndef MAX_PKTS_PER_TX_TXN
 #define MAX_PKTS_PER_TX_TXN	16
 #endif
 
+/* Data bursts may span all of the AC queues, so allow one full AMPDU from each */
+#ifndef MAX_PKTS_PER_TX_BURST
+#define MAX_PKTS_PER_TX_BURST	(MAX_PKTS_PER_TX_TXN * YAPS_TX_SKBQ_MAX)
+#endif
+
 /* 2 full AMPDUs (and also more than the number of RX pages in chip) */
 #ifndef MAX_PKTS_PER_RX_TXN
 #define MAX_PKTS_PER_RX_TXN	32
 #endif
 
+static uint yaps_chip_full_retry_min_us __read_mostly = 1000;
+module_param(yaps_chip_full_retry_min_us, uint, 0644);
+MODULE_PARM_DESC(yaps_chip_full_retry_min_us,
+		 "Shortest retry interval (us) when the chip TX queue is full");
+
+static uint yaps_chip_full_retry_pkts __read_mostly = MAX_PKTS_PER_TX_TXN;
+module_param(yaps_chip_full_retry_pkts, uint, 0644);
+MODULE_PARM_DESC(yaps_chip_full_retry_pkts,
+		 "Packets the chip is expected to free before retrying a full TX queue");
+
 #define MORSE_YAPS_DBG(_m, _f, _a...)		morse_dbg(FEATURE_ID_YAPS, _m, _f, ##_a)
 #define MORSE_YAPS_INFO(_m, _f, _a...)		morse_info(FEATURE_ID_YAPS, _m, _f, ##_a)
 #define MORSE_YAPS_WARN(_m, _f, _a...)		morse_warn(FEATURE_ID_YAPS, _m, _f, ##_a)
@@ -43,11 +102,11 @@
 	morse_dbg_ratelimited(FEATURE_ID_YAPS, _m, _f, ##_a)
 
 /* Used to communicate with lower yaps_hw layer */
-static struct morse_yaps_pkt to_chip_pkts[MAX_PKTS_PER_TX_TXN];
+static struct morse_yaps_pkt to_chip_pkts[MAX_PKTS_PER_TX_BURST];
 static struct morse_yaps_pkt from_chip_pkts[MAX_PKTS_PER_RX_TXN];
 
 /* Mappings between sk_buff, skbq and yaps */
-static struct morse_skbq *skbq_yaps_tc_q_from_aci(struct morse *mors, int aci)
+struct morse_skbq *skbq_yaps_tc_q_from_aci(struct morse *mors, int aci)
 {
 	struct morse_yaps *yaps = mors->chip_if->yaps;
 
@@ -73,12 +132,12 @@ static struct morse_skbq *skbq_yaps_bcn_q(struct morse *mors)
 	return &mors->chip_if->yaps->beacon_q;
 }
 
-static struct morse_skbq *skbq_yaps_mgmt_q(struct morse *mors)
+struct morse_skbq *skbq_yaps_mgmt_q(struct morse *mors)
 {
 	return &mors->chip_if->yaps->mgmt_q;
 }
 
-static struct morse_skbq *skbq_yaps_cmd_q(struct morse *mors)
+struct morse_skbq *skbq_yaps_cmd_q(struct morse *mors)
 {
 	return &mors->chip_if->yaps->cmd_q;
 }
@@ -94,7 +153,7 @@ static int yaps_irq_handler(struct morse *mors, u32 status)
 		set_bit(MORSE_TX_PACKET_FREED_UP_PEND, &mors->chip_if->event_flags);
 	}
 
-	queue_work(mors->chip_wq, &mors->chip_if_work);
+	morse_hw_irq_queue_chip_if_work(mors);
 	return 0;
 }
 
@@ -110,9 +169,94 @@ const struct chip_if_ops morse_yaps_ops = {
 	.skbq_mgmt_tc_q = skbq_yaps_mgmt_q,
 	.skbq_cmd_tc_q = skbq_yaps_cmd_q,
 	.skbq_tc_q_from_aci = skbq_yaps_tc_q_from_aci,
-	.chip_if_handle_irq = yaps_irq_handler
+	.chip_if_handle_irq = yaps_irq_handler,
+	.chip_if_handle_events = morse_yaps_handle_events
 };
 
+#ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
+static void morse_yaps_benchmark_rx(struct morse_yaps *yaps, struct sk_buff *skb,
+				    const struct morse_buff_skb_header *hdr)
+{
+	struct morse_yaps_benchmark_stamp stamp;
+	u64 now_ns = ktime_to_ns(ktime_get());
+	u64 lat_us;
+	int idx;
+
+	if (le16_to_cpu(hdr->len) < sizeof(stamp) ||
+	    skb_copy_bits(skb, sizeof(*hdr) + le16_to_cpu(hdr->offset), &stamp, sizeof(stamp)))
+		return;
+
+	/* Ignore stragglers from an earlier step */
+	if (le32_to_cpu(stamp.magic) != BENCHMARK_MAGIC ||
+	    le32_to_cpu(stamp.run) != READ_ONCE(yaps->benchmark.run))
+		return;
+
+	atomic_inc(&yaps->benchmark.cnt_fc);
+
+	idx = atomic_inc_return(&yaps->benchmark.lat_cnt) - 1;
+	if (!yaps->benchmark.lat_us || idx >= BENCHMARK_LAT_SAMPLES)
+		return;
+
+	lat_us = div_u64(now_ns - le64_to_cpu(stamp.tx_ns), NSEC_PER_USEC);
+	yaps->benchmark.lat_us[idx] = min_t(u64, lat_us, U32_MAX);
+}
+#endif
+
+void morse_yaps_chip_queue_has_space(struct morse_yaps *yaps)
+{
+	if (!yaps->chip_queue_full.is_full)
+		return;
+
+	yaps->chip_queue_full.is_full = false;
+	/* The timer only queues chip_if work, so it does not need to be waited for */
+	del_timer(&yaps->chip_queue_full.timer);
+}
+
+/* Track how quickly the chip returns TX statuses, each of which frees one packet */
+static void morse_yaps_chip_queue_freed(struct morse_yaps *yaps, u32 num_freed)
+{
+	ktime_t now = ktime_get();
+	ktime_t last = yaps->chip_queue_full.last_tx_status;
+	u32 *avg_us = &yaps->chip_queue_full.avg_free_us;
+	s64 delta_us;
+	s32 sample_us;
+
+	if (!num_freed)
+		return;
+
+	yaps->chip_queue_full.last_tx_status = now;
+	morse_yaps_chip_queue_has_space(yaps);
+
+	if (!ktime_to_ns(last))
+		return;
+
+	/* Gaps longer than the fail safe timeout are idle time, not the chip draining */
+	delta_us = ktime_us_delta(now, last);
+	if (delta_us < 0 || delta_us > CHIP_FULL_RECOVERY_TIMEOUT_MS * USEC_PER_MSEC)
+		return;
+
+	sample_us = div_u64(delta_us, num_freed);
+	if (!*avg_us)
+		*avg_us = max_t(s32, sample_us, 1);
+	else
+		*avg_us += (sample_us - (s32)*avg_us) >> CHIP_FULL_AVG_WEIGHT_SHIFT;
+}
+
+/* Retry a full chip queue once it should have freed a useful amount of space */
+static unsigned long morse_yaps_chip_full_retry_jiffies(struct morse_yaps *yaps)
+{
+	u32 retry_us = CHIP_FULL_RECOVERY_TIMEOUT_MS * USEC_PER_MSEC;
+	u64 expected_us;
+
+	if (yaps->chip_queue_full.avg_free_us) {
+		expected_us = (u64)yaps->chip_queue_full.avg_free_us * yaps_chip_full_retry_pkts;
+		expected_us = max_t(u64, expected_us, yaps_chip_full_retry_min_us);
+		retry_us = min_t(u64, expected_us, retry_us);
+	}
+
+	return usecs_to_jiffies(retry_us);
+}
+
 static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb)
 {
 	struct morse *mors = yaps->mors;
@@ -141,7 +285,7 @@ static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb)
 	}
 
 	if (yaps->mors->chip_if->validate_skb_checksum && !morse_validate_skb_checksum(skb->data)) {
-		mors->debug.page_stats.invalid_checksum++;
+		MORSE_PAGE_STAT_INC(mors, invalid_checksum);
 		MORSE_YAPS_DBG(yaps->mors, "SKB checksum is invalid hdr:[c:%02X s:%02X len:%d]",
 			       hdr->channel, hdr->sync, hdr->len);
 
@@ -152,7 +296,7 @@ static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb)
 			ret = -EIO;
 			goto exit;
 		}
-		mors->debug.page_stats.invalid_tx_status_checksum++;
+		MORSE_PAGE_STAT_INC(mors, invalid_tx_status_checksum);
 	}
 
 	/* Get correct skbq for the data based on the declared channel */
@@ -176,13 +320,17 @@ static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb)
 		goto exit_return_page;
 	}
 
+	if (hdr->channel == MORSE_SKB_CHAN_TX_STATUS)
+		morse_yaps_chip_queue_freed(yaps, le16_to_cpu(hdr->len) /
+					    sizeof(struct morse_skb_tx_status));
+
 	/* Check there is room in the skbq */
 	skb_len = sizeof(*hdr) + le16_to_cpu(hdr->offset) + le16_to_cpu(hdr->len);
 	skb_bytes_remaining = morse_skbq_space(mq);
 
 #ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
 	if (hdr->channel == MORSE_SKB_CHAN_LOOPBACK)
-		atomic_inc(&yaps->benchmark_cnt_fc);
+		morse_yaps_benchmark_rx(yaps, skb, hdr);
 #endif
 
 	/* if skb queue full, don't read */
@@ -195,7 +343,12 @@ static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb)
 		goto exit_return_page;
 	}
 
-	skb_trim(skb, skb_len);
+	/* skb may carry its payload as a page fragment of the RX window */
+	if (pskb_trim(skb, skb_len)) {
+		ret = -ENOMEM;
+		goto exit_return_page;
+	}
+	morse_pkt_lat_rx_begin(mors, skb, hdr->channel);
 	__skb_queue_tail(&skbq, skb);
 
 	if (skbq.qlen)
@@ -220,143 +373,185 @@ exit:
 	return ret;
 }
 
-static int morse_yaps_tx(struct morse_yaps *yaps, struct morse_skbq *mq)
+/*
+ * Send packets from one or more skbqs to the chip in a single burst. Queues are drained in the
+ * order given (highest priority first) until either max_pkts packets have been collected or the
+ * queues are empty, so that one status register read and one bulk write covers the whole batch.
+ * Packets that do not fit in the chip are returned to the head of the queue they came from.
+ */
+static int morse_yaps_tx_burst(struct morse_yaps *yaps, struct morse_skbq *mqs[], int num_mqs,
+			       int max_pkts)
 {
 	int ret = 0;
 	int num_items = 0;
 	int tc_pkt_idx = 0;
 	int num_pkts_sent = 0;
 	int i;
-	struct sk_buff *skb;
-	struct sk_buff_head skbq_to_send;
+	int q;
+	struct sk_buff_head skbq_to_send[YAPS_TX_SKBQ_MAX];
 	struct sk_buff_head skbq_sent;
 	struct sk_buff_head skbq_failed;
 	struct sk_buff *pfirst, *pnext;
 	struct morse *mors = yaps->mors;
 	struct morse_buff_skb_header *hdr;
 
-	/* Check there is something on the queue */
-	spin_lock_bh(&mq->lock);
-	skb = skb_peek(&mq->skbq);
-	spin_unlock_bh(&mq->lock);
-	if (!skb)
-		return 0;
+	if (WARN_ON(num_mqs > ARRAY_SIZE(skbq_to_send)))
+		num_mqs = ARRAY_SIZE(skbq_to_send);
+	max_pkts = min_t(int, max_pkts, ARRAY_SIZE(to_chip_pkts));
 
-	__skb_queue_head_init(&skbq_to_send);
-	__skb_queue_head_init(&skbq_sent);
-	__skb_queue_head_init(&skbq_failed);
+	for (q = 0; q < num_mqs; q++) {
+		struct morse_skbq *mq = mqs[q];
 
-	if (mq == &yaps->cmd_q)
-		/* Purge timed-out commands (this should not happen) */
-		morse_skbq_purge(mq, &mq->pending);
-	else if (mq == &yaps->mgmt_q && mq->skbq.qlen > 0)
-		/* Purge old mgmt frames that have not been sent due to congestion */
-		morse_skbq_purge_aged(mors, mq);
+		__skb_queue_head_init(&skbq_to_send[q]);
 
-	/* We should replace MAX_PKTS_PER_TX_TXN with some heuristic that takes
-	 * into account free space in the queue and free pages in the pool
-	 */
-	num_items = morse_skbq_deq_num_items(mq, &skbq_to_send, MAX_PKTS_PER_TX_TXN);
+		/* Check there is something on the queue */
+		spin_lock_bh(&mq->lock);
+		morse_skbq_tx_collect(mq);
+		pfirst = skb_peek(&mq->skbq);
+		spin_unlock_bh(&mq->lock);
+		if (!pfirst)
+			continue;
 
-	skb_queue_walk_safe(&skbq_to_send, pfirst, pnext) {
-		enum morse_yaps_to_chip_q tc_queue;
+		if (mq == &yaps->cmd_q)
+			/* Purge timed-out commands (this should not happen) */
+			morse_skbq_purge(mq, &mq->pending);
+		else if (mq == &yaps->mgmt_q && mq->skbq.qlen > 0)
+			/* Purge old mgmt frames that have not been sent due to congestion */
+			morse_skbq_purge_aged(mors, mq);
 
-		hdr = (struct morse_buff_skb_header *)pfirst->data;
-		switch (hdr->channel) {
-		case MORSE_SKB_CHAN_COMMAND:
-			tc_queue = MORSE_YAPS_CMD_Q;
-			break;
-		case MORSE_SKB_CHAN_BEACON:
-			tc_queue = MORSE_YAPS_BEACON_Q;
-			break;
-		case MORSE_SKB_CHAN_MGMT:
-			tc_queue = MORSE_YAPS_MGMT_Q;
-			break;
-		default:
-			tc_queue = MORSE_YAPS_TX_Q;
-			break;
+		if (num_items >= max_pkts)
+			continue;
+
+		/* We should replace max_pkts with some heuristic that takes
+		 * into account free space in the queue and free pages in the pool
+		 */
+		num_items += morse_skbq_deq_num_items(mq, &skbq_to_send[q], max_pkts - num_items);
+
+		skb_queue_walk(&skbq_to_send[q], pfirst) {
+			enum morse_yaps_to_chip_q tc_queue;
+
+			hdr = (struct morse_buff_skb_header *)pfirst->data;
+			switch (hdr->channel) {
+			case MORSE_SKB_CHAN_COMMAND:
+				tc_queue = MORSE_YAPS_CMD_Q;
+				break;
+			case MORSE_SKB_CHAN_BEACON:
+				tc_queue = MORSE_YAPS_BEACON_Q;
+				break;
+			case MORSE_SKB_CHAN_MGMT:
+				tc_queue = MORSE_YAPS_MGMT_Q;
+				break;
+			default:
+				tc_queue = MORSE_YAPS_TX_Q;
+				break;
+			}
+			to_chip_pkts[tc_pkt_idx].tc_queue = tc_queue;
+			to_chip_pkts[tc_pkt_idx].skb = pfirst;
+			tc_pkt_idx++;
 		}
-		to_chip_pkts[tc_pkt_idx].tc_queue = tc_queue;
-		to_chip_pkts[tc_pkt_idx].skb = pfirst;
-		tc_pkt_idx++;
 	}
 
+	/* Check there is something to send */
+	if (num_items == 0)
+		return 0;
+
 	/* Send queued packets to chip */
 	ret = yaps->ops->update_status(yaps);
-	if (ret)
-		return ret;
-
-	ret = yaps->ops->write_pkts(yaps, to_chip_pkts, tc_pkt_idx, &num_pkts_sent);
+	if (!ret)
+		ret = yaps->ops->write_pkts(yaps, to_chip_pkts, tc_pkt_idx, &num_pkts_sent);
+	else
+		num_pkts_sent = 0;
 
-	/* Move sent packets to done queue and update stats */
-	for (i = 0; i < num_pkts_sent; ++i) {
-		switch (to_chip_pkts[i].tc_queue) {
-		case MORSE_YAPS_CMD_Q:
-			mors->debug.page_stats.cmd_tx++;
-			break;
-		case MORSE_YAPS_BEACON_Q:
-			mors->debug.page_stats.bcn_tx++;
-			break;
-		case MORSE_YAPS_MGMT_Q:
-			mors->debug.page_stats.mgmt_tx++;
-			break;
-		default:
-			mors->debug.page_stats.data_tx++;
-			break;
-		}
-		pfirst = __skb_dequeue(&skbq_to_send);
+	/* Move sent packets to done queue and update stats. The packets in to_chip_pkts are in
+	 * the same order as the per-queue lists, so walk the queues in turn.
+	 */
+	i = 0;
+	for (q = 0; q < num_mqs; q++) {
+		struct morse_skbq *mq = mqs[q];
+
+		__skb_queue_head_init(&skbq_sent);
+		__skb_queue_head_init(&skbq_failed);
+
+		skb_queue_walk_safe(&skbq_to_send[q], pfirst, pnext) {
+			__skb_unlink(pfirst, &skbq_to_send[q]);
+
+			if (i >= num_pkts_sent) {
+				MORSE_PAGE_STAT_INC(mors, no_page);
+				__skb_queue_tail(&skbq_failed, pfirst);
+				i++;
+				continue;
+			}
+
+			switch (to_chip_pkts[i].tc_queue) {
+			case MORSE_YAPS_CMD_Q:
+				MORSE_PAGE_STAT_INC(mors, cmd_tx);
+				break;
+			case MORSE_YAPS_BEACON_Q:
+				MORSE_PAGE_STAT_INC(mors, bcn_tx);
+				break;
+			case MORSE_YAPS_MGMT_Q:
+				MORSE_PAGE_STAT_INC(mors, mgmt_tx);
+				break;
+			default:
+				MORSE_PAGE_STAT_INC(mors, data_tx);
+				break;
+			}
 #ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
-		hdr = (struct morse_buff_skb_header *)pfirst->data;
-		if (hdr->channel == MORSE_SKB_CHAN_LOOPBACK)
-			atomic_inc(&yaps->benchmark_cnt_tc);
+			hdr = (struct morse_buff_skb_header *)pfirst->data;
+			if (hdr->channel == MORSE_SKB_CHAN_LOOPBACK)
+				atomic_inc(&yaps->benchmark.cnt_tc);
 #endif
-		__skb_queue_tail(&skbq_sent, pfirst);
-	}
-
-	for (i = num_pkts_sent; i < num_items; ++i) {
-		mors->debug.page_stats.no_page++;
-		pfirst = __skb_dequeue(&skbq_to_send);
-		__skb_queue_tail(&skbq_failed, pfirst);
-	}
-
-	if (skbq_failed.qlen > 0) {
-		morse_skbq_enq_prepend(mq, &skbq_failed);
+			__skb_queue_tail(&skbq_sent, pfirst);
+			i++;
+		}
 
-		/* queue full, cant requeue */
-		mors->debug.page_stats.write_fail += skbq_failed.qlen;
 		if (skbq_failed.qlen > 0) {
-			MORSE_YAPS_WARN(mors, "cant requeue failed pkts, skbq full, purging\n");
-			__skb_queue_purge(&skbq_failed);
+			morse_skbq_enq_prepend(mq, &skbq_failed);
+
+			/* queue full, cant requeue */
+			MORSE_PAGE_STAT_ADD(mors, write_fail, skbq_failed.qlen);
+			if (skbq_failed.qlen > 0) {
+				MORSE_YAPS_WARN(mors, "cant requeue failed pkts, skbq full, purging\n");
+				__skb_queue_purge(&skbq_failed);
+			}
 		}
+
+		if (skbq_sent.qlen > 0)
+			morse_skbq_tx_complete(mq, &skbq_sent);
 	}
 
-	if (skbq_sent.qlen > 0)
-		morse_skbq_tx_complete(mq, &skbq_sent);
+	if (num_pkts_sent > 1)
+		MORSE_PAGE_STAT_INC(mors, tx_burst);
 
 	return ret;
 }
 
+static int morse_yaps_tx(struct morse_yaps *yaps, struct morse_skbq *mq)
+{
+	return morse_yaps_tx_burst(yaps, &mq, 1, MAX_PKTS_PER_TX_TXN);
+}
+
 /* Returns true if there are TX data pages waiting to be sent */
 static bool morse_yaps_tx_data_handler(struct morse_yaps *yaps)
 {
 	s16 aci;
+	int num_qs = 0;
 	u32 count = 0;
+	struct morse_skbq *data_qs[YAPS_TX_SKBQ_MAX];
 	struct morse *mors = yaps->mors;
 
-	for (aci = MORSE_ACI_VO; aci >= 0; aci--) {
-		struct morse_skbq *data_q = skbq_yaps_tc_q_from_aci(mors, aci);
+	/* Collect the data queues in priority order so that they can all be sent in one burst */
+	for (aci = MORSE_ACI_VO; aci >= 0; aci--)
+		data_qs[num_qs++] = skbq_yaps_tc_q_from_aci(mors, aci);
 
-		if (!morse_is_data_tx_allowed(mors))
-			break;
+	if (morse_is_data_tx_allowed(mors)) {
+		int i;
 
-		yaps->chip_queue_full.is_full = morse_yaps_tx(yaps, data_q);
-		count += morse_skbq_count(data_q);
+		yaps->chip_queue_full.is_full = morse_yaps_tx_burst(yaps, data_qs, num_qs,
+								    MAX_PKTS_PER_TX_BURST);
 
-		if (yaps->chip_queue_full.is_full)
-			break;
-
-		if (aci == MORSE_ACI_BE)
-			break;
+		for (i = 0; i < num_qs; i++)
+			count += morse_skbq_count(data_qs[i]);
 	}
 
 	/* Data has potentially been transmitted from the data SKBQs.
@@ -366,7 +561,7 @@ static bool morse_yaps_tx_data_handler(struct morse_yaps *yaps)
 	morse_skbq_may_wake_tx_queues(mors);
 	if (mors->custom_configs.enable_airtime_fairness &&
 	    !test_bit(MORSE_STATE_FLAG_DATA_QS_STOPPED, &mors->state_flags))
-		tasklet_schedule(&mors->tasklet_txq);
+		morse_mac_schedule_txq(mors);
 
 	return (count > 0) && morse_is_data_tx_allowed(mors);
 }
@@ -419,7 +614,7 @@ static bool morse_yaps_rx_handler(struct morse_yaps *yaps)
 	}
 
 	if (num_pks_received == 0)
-		yaps->mors->debug.page_stats.rx_empty++;
+		MORSE_PAGE_STAT_INC(yaps->mors, rx_empty);
 
 	for (i = 0; i < num_pks_received; ++i) {
 		morse_yaps_read_pkt(yaps, from_chip_pkts[i].skb);
@@ -437,6 +632,7 @@ void morse_yaps_stale_tx_work(struct work_struct *work)
 {
 	int i;
 	int flushed = 0;
+	u32 next_us = U32_MAX;
 	struct morse *mors = container_of(work, struct morse, tx_stale_work);
 	struct morse_yaps *yaps;
 
@@ -444,11 +640,15 @@ void morse_yaps_stale_tx_work(struct work_struct *work)
 		return;
 
 	yaps = mors->chip_if->yaps;
-	flushed += morse_skbq_check_for_stale_tx(mors, &yaps->beacon_q);
-	flushed += morse_skbq_check_for_stale_tx(mors, &yaps->mgmt_q);
+	flushed += morse_skbq_check_for_stale_tx(mors, &yaps->beacon_q, &next_us);
+	flushed += morse_skbq_check_for_stale_tx(mors, &yaps->mgmt_q, &next_us);
 
 	for (i = 0; i < ARRAY_SIZE(yaps->data_tx_qs); i++)
-		flushed += morse_skbq_check_for_stale_tx(mors, &yaps->data_tx_qs[i]);
+		flushed += morse_skbq_check_for_stale_tx(mors, &yaps->data_tx_qs[i], &next_us);
+
+	/* Wake again for the oldest frame still pending, rather than on a fixed period */
+	if (next_us != U32_MAX)
+		morse_stale_tx_status_arm(mors, jiffies + usecs_to_jiffies(next_us) + 1);
 
 	if (flushed) {
 		MORSE_YAPS_DBG(mors, "%s: Flushed %d stale TX SKBs\n", __func__, flushed);
@@ -461,15 +661,15 @@ void morse_yaps_stale_tx_work(struct work_struct *work)
 	}
 }
 
-void morse_yaps_work(struct work_struct *work)
+void morse_yaps_handle_events(struct morse *mors, unsigned long events)
 {
-	struct morse *mors = container_of(work,
-					  struct morse, chip_if_work);
 	int ps_bus_timeout_ms = 0;
 	unsigned long *flags = &mors->chip_if->event_flags;
 	struct morse_yaps *yaps = mors->chip_if->yaps;
 
-	if (!*flags)
+	morse_hw_irq_coalesce_done(mors);
+
+	if (!(*flags & events))
 		return;
 
 	/* Disable power save in case it is running */
@@ -480,7 +680,7 @@ void morse_yaps_work(struct work_struct *work)
 	 * avoid dropping pkts due to full on-chip buffers.
 	 * Check if all pages were removed, set event flags if not.
 	 */
-	if (test_and_clear_bit(MORSE_RX_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_RX_PEND, events, flags)) {
 		int buffered = yaps->data_rx_q.skbq.qlen;
 
 		if (morse_yaps_rx_handler(yaps))
@@ -491,27 +691,27 @@ void morse_yaps_work(struct work_struct *work)
 	}
 
 	/* TX any commands before considering data */
-	if (test_and_clear_bit(MORSE_TX_COMMAND_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_COMMAND_PEND, events, flags)) {
 		if (morse_yaps_tx_cmd_handler(yaps))
 			set_bit(MORSE_TX_COMMAND_PEND, flags);
 	}
 
 	/* TX beacons before considering mgmt/data */
-	if (test_and_clear_bit(MORSE_TX_BEACON_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_BEACON_PEND, events, flags)) {
 		if (morse_yaps_tx_beacon_handler(yaps))
 			set_bit(MORSE_TX_BEACON_PEND, flags);
 	}
 
 	/* TX mgmt before considering data */
-	if (test_and_clear_bit(MORSE_TX_MGMT_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_MGMT_PEND, events, flags)) {
 		ps_bus_timeout_ms = max(ps_bus_timeout_ms, NETWORK_BUS_TIMEOUT_MS);
 		if (morse_yaps_tx_mgmt_handler(yaps))
 			set_bit(MORSE_TX_MGMT_PEND, flags);
 	}
 
 	/* Pause TX data Qs */
-	if (test_and_clear_bit(MORSE_DATA_TRAFFIC_PAUSE_PEND, flags)) {
-		if (test_and_clear_bit(MORSE_DATA_TRAFFIC_RESUME_PEND, flags))
+	if (morse_chip_if_test_and_clear_event(MORSE_DATA_TRAFFIC_PAUSE_PEND, events, flags)) {
+		if (morse_chip_if_test_and_clear_event(MORSE_DATA_TRAFFIC_RESUME_PEND, events, flags))
 			MORSE_ERR_RATELIMITED(mors,
 					      "Latency to handle twt traffic pause is too great\n");
 
@@ -519,7 +719,7 @@ void morse_yaps_work(struct work_struct *work)
 	}
 
 	/* Resume TX data Qs  */
-	if (test_and_clear_bit(MORSE_DATA_TRAFFIC_RESUME_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_DATA_TRAFFIC_RESUME_PEND, events, flags)) {
 		if (test_bit(MORSE_DATA_TRAFFIC_PAUSE_PEND, flags))
 			MORSE_ERR_RATELIMITED(mors,
 					      "Latency to handle twt traffic resume is too great\n");
@@ -528,32 +728,35 @@ void morse_yaps_work(struct work_struct *work)
 	}
 
 	/* Handle chip queue status */
-	if (test_and_clear_bit(MORSE_TX_PACKET_FREED_UP_PEND, flags))
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_PACKET_FREED_UP_PEND, events, flags))
 		yaps->chip_queue_full.is_full = false;
 
 	/* Check to see if the queue is full or
 	 * long enough has past since the queue was full
 	 */
+	if (!(events & BIT(MORSE_TX_DATA_PEND)))
+		goto exit;
+
 	if (yaps->chip_queue_full.is_full &&
 	    time_before(jiffies, yaps->chip_queue_full.retry_expiry))
 		goto exit;
 
 	/* Finally TX any data */
-	if (test_and_clear_bit(MORSE_TX_DATA_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_TX_DATA_PEND, events, flags)) {
 		ps_bus_timeout_ms = max(ps_bus_timeout_ms, NETWORK_BUS_TIMEOUT_MS);
 		if (morse_yaps_tx_data_handler(yaps))
 			set_bit(MORSE_TX_DATA_PEND, flags);
 
 		if (yaps->chip_queue_full.is_full) {
 			yaps->chip_queue_full.retry_expiry =
-			    jiffies + msecs_to_jiffies(CHIP_FULL_RECOVERY_TIMEOUT_MS);
+			    jiffies + morse_yaps_chip_full_retry_jiffies(yaps);
 			mod_timer(&yaps->chip_queue_full.timer, yaps->chip_queue_full.retry_expiry);
 		}
 	}
 
 exit:
 	/* This bit is set when the SDIO interrupt lock up is detected */
-	if (test_and_clear_bit(MORSE_YAPS_STATUS_REG_READ_PEND, flags)) {
+	if (morse_chip_if_test_and_clear_event(MORSE_YAPS_STATUS_REG_READ_PEND, events, flags)) {
 		/* This operation will clear the SDIO interrupt lock up */
 		yaps->ops->update_status(yaps);
 	}
@@ -566,11 +769,11 @@ exit:
 	morse_ps_enable(mors);
 
 	/* Evaluate all events except MORSE_TX_DATA_PEND in case data tx queue is full */
-	if ((*flags) & ~(1 << MORSE_TX_DATA_PEND))
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+	if ((*flags & events) & ~(1 << MORSE_TX_DATA_PEND))
+		morse_hw_chip_if_queue_work(mors);
 	/* if data tx queue is not full and the work hasn't been queued let's queue it */
-	else if (!yaps->chip_queue_full.is_full && *flags)
-		queue_work(mors->chip_wq, &mors->chip_if_work);
+	else if (!yaps->chip_queue_full.is_full && (*flags & events))
+		morse_hw_chip_if_queue_work(mors);
 }
 
 int morse_yaps_get_tx_status_pending_count(struct morse *mors)
@@ -628,7 +831,7 @@ static void morse_tx_chip_full_timer(struct timer_list *t)
 		return;
 
 	/* Haven't received anything from the chip indicating the queue might have room */
-	queue_work(yaps->mors->chip_wq, &yaps->mors->chip_if_work);
+	morse_hw_chip_if_queue_work(yaps->mors);
 }
 
 static int morse_tx_chip_full_timer_init(struct morse_yaps *yaps)
@@ -665,9 +868,13 @@ int morse_yaps_init(struct morse *mors, struct morse_yaps *yaps, u8 flags)
 		morse_skbq_init(mors, true, &yaps->data_rx_q, MORSE_CHIP_IF_FLAGS_DATA);
 		morse_skbq_init(mors, true, &yaps->beacon_q, MORSE_CHIP_IF_FLAGS_DATA);
 		morse_skbq_init(mors, true, &yaps->mgmt_q, MORSE_CHIP_IF_FLAGS_DATA);
-		for (i = 0; i < ARRAY_SIZE(yaps->data_tx_qs); i++)
+		for (i = 0; i < ARRAY_SIZE(yaps->data_tx_qs); i++) {
 			morse_skbq_init(mors, false, &yaps->data_tx_qs[i],
 					MORSE_CHIP_IF_FLAGS_DATA);
+			morse_skbq_enable_tx_inbox(&yaps->data_tx_qs[i]);
+			morse_skbq_enable_bql(&yaps->data_tx_qs[i]);
+			morse_skbq_enable_aqm(&yaps->data_tx_qs[i]);
+		}
 	}
 
 	if (yaps->flags & MORSE_CHIP_IF_FLAGS_COMMAND) {
@@ -678,6 +885,10 @@ int morse_yaps_init(struct morse *mors, struct morse_yaps *yaps, u8 flags)
 
 	morse_tx_chip_full_timer_init(yaps);
 
+#ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
+	mutex_init(&yaps->benchmark.lock);
+#endif
+
 	return 0;
 }
 
@@ -699,6 +910,11 @@ void morse_yaps_finish(struct morse_yaps *yaps)
 	}
 
 	morse_tx_chip_full_timer_finish(yaps);
+
+#ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
+	vfree(yaps->benchmark.lat_us);
+	yaps->benchmark.lat_us = NULL;
+#endif
 }
 
 void morse_yaps_flush_tx_data(struct morse_yaps *yaps)
@@ -723,81 +939,177 @@ void morse_yaps_show(struct morse_yaps *yaps, struct seq_file *file)
 	morse_skbq_show(&yaps->cmd_q, file);
 	morse_skbq_show(&yaps->cmd_resp_q, file);
 
+	seq_printf(file, "chip queue full:%d avg free:%uus retry:%uus\n",
+		   yaps->chip_queue_full.is_full, yaps->chip_queue_full.avg_free_us,
+		   jiffies_to_usecs(morse_yaps_chip_full_retry_jiffies(yaps)));
+
 	yaps->ops->show(yaps, file);
 }
 
 #ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
-int morse_yaps_benchmark(struct morse *mors, struct seq_file *file)
+static void morse_yaps_benchmark_show_latency(struct morse_yaps *yaps, struct seq_file *file)
+{
+	u32 num = min_t(u32, atomic_read(&yaps->benchmark.lat_cnt), BENCHMARK_LAT_SAMPLES);
+	u32 *lat_us = yaps->benchmark.lat_us;
+
+	seq_puts(file, "round trip latency (us):\n");
+	seq_printf(file, "\tsamples: %u\n", num);
+	if (!num)
+		return;
+
+	morse_bus_bench_sort_u32(lat_us, num);
+	seq_printf(file, "\tmin: %u\n", lat_us[0]);
+	seq_printf(file, "\tp50: %u\n", morse_bus_bench_percentile(lat_us, num, 500));
+	seq_printf(file, "\tp99: %u\n", morse_bus_bench_percentile(lat_us, num, 990));
+	seq_printf(file, "\tp999: %u\n", morse_bus_bench_percentile(lat_us, num, 999));
+	seq_printf(file, "\tmax: %u\n", lat_us[num - 1]);
+}
+
+static int morse_yaps_benchmark_step(struct morse_yaps *yaps, struct seq_file *file,
+				     const char *body, u32 len, u32 duration_ms, u32 depth,
+				     bool bidir)
 {
 	int rc = 0;
-	const int pkt_len = BENCHMARK_PKT_LEN + sizeof(struct morse_buff_skb_header);
+	struct morse *mors = yaps->mors;
+	const int pkt_len = len + sizeof(struct morse_buff_skb_header);
 	struct sk_buff *skb;
-	struct morse_yaps *yaps = mors->chip_if->yaps;
 	struct morse_skb_tx_info tx_info = { 0 };
 	struct morse_skbq *mq = skbq_yaps_tc_q_from_aci(mors, MORSE_ACI_VO);
+	struct morse_yaps_benchmark_stamp *stamp;
+	/* Packets are complete once sent to the chip (one-way) or looped back (bidirectional) */
+	atomic_t *done_cnt = bidir ? &yaps->benchmark.cnt_fc : &yaps->benchmark.cnt_tc;
 	unsigned long start_time, end_time, max_time;
-	unsigned long time_taken_sec, time_taken_msec;
-	char *body = kmalloc(BENCHMARK_PKT_LEN, GFP_KERNEL);
+	unsigned long time_taken_msec;
+	u32 run = yaps->benchmark.run + 1;
+	u32 queued = 0;
 	int fc_cnt, tc_cnt;
 
-	if (!body)
-		return -EFAULT;
-
-#if KERNEL_VERSION(4, 10, 0) <= LINUX_VERSION_CODE
-	get_random_bytes_wait(body, BENCHMARK_PKT_LEN);
-#endif
+	atomic_set(&yaps->benchmark.cnt_tc, 0);
+	atomic_set(&yaps->benchmark.cnt_fc, 0);
+	atomic_set(&yaps->benchmark.lat_cnt, 0);
+	WRITE_ONCE(yaps->benchmark.run, run);
 
-	/* Kick off sending benchmark results */
-	atomic_set(&yaps->benchmark_cnt_tc, 0);
-	atomic_set(&yaps->benchmark_cnt_fc, 0);
 	start_time = jiffies;
-	max_time = start_time + msecs_to_jiffies(BENCHMARK_WAIT_MS);
+	max_time = start_time + msecs_to_jiffies(duration_ms);
 	while (time_before(jiffies, max_time)) {
-		skb = dev_alloc_skb(BENCHMARK_PKT_LEN);
-		if (!skb)
-			goto exit;
-		skb_put(skb, BENCHMARK_PKT_LEN);
-		memcpy(skb->data, body, BENCHMARK_PKT_LEN);
-		skb_set_queue_mapping(skb, IEEE80211_AC_VO);
+		/* Bound the number of packets in flight */
+		while (depth && (queued - atomic_read(done_cnt)) >= depth &&
+		       time_before(jiffies, max_time))
+			usleep_range(100, 200);
 
 		/* Wait for space and don't hold the spinlock too much */
 		while (morse_skbq_space(mq) < (2 * pkt_len) && time_before(jiffies, max_time))
 			usleep_range(5000, 6000);
 
+		if (!time_before(jiffies, max_time))
+			break;
+
+		skb = morse_skb_cache_alloc(mors, len);
+		if (!skb) {
+			rc = -ENOMEM;
+			break;
+		}
+		skb_put(skb, len);
+		memcpy(skb->data, body, len);
+		stamp = (struct morse_yaps_benchmark_stamp *)skb->data;
+		stamp->magic = cpu_to_le32(BENCHMARK_MAGIC);
+		stamp->run = cpu_to_le32(run);
+		stamp->tx_ns = cpu_to_le64(ktime_to_ns(ktime_get()));
+		skb_set_queue_mapping(skb, IEEE80211_AC_VO);
+
 		rc = morse_skbq_skb_tx(mq, &skb, &tx_info, MORSE_SKB_CHAN_LOOPBACK);
+		if (!rc)
+			queued++;
 	}
 
 	end_time = jiffies;
-	fc_cnt = atomic_read(&yaps->benchmark_cnt_fc);
-	tc_cnt = atomic_read(&yaps->benchmark_cnt_tc);
+	fc_cnt = atomic_read(&yaps->benchmark.cnt_fc);
+	tc_cnt = atomic_read(&yaps->benchmark.cnt_tc);
+
+	/* Let outstanding packets complete so their latency is included */
+	max_time = end_time + msecs_to_jiffies(BENCHMARK_DRAIN_MS);
+	while (atomic_read(done_cnt) < queued && time_before(jiffies, max_time))
+		usleep_range(1000, 2000);
+	/* Stop recording samples from late packets */
+	WRITE_ONCE(yaps->benchmark.run, run + 1);
+
+	seq_printf(file, "packet size (bytes): %u\n", len);
 
 	if (tc_cnt == 0) {
 		seq_printf(file, "error %d running benchmark\n", rc);
 		seq_printf(file, "bytes sent %d\n", tc_cnt);
 		seq_printf(file, "bytes received %d\n", fc_cnt);
-		goto exit;
+		return rc ? rc : -EIO;
 	}
 
-	time_taken_msec = jiffies_to_msecs(end_time - start_time);
-	time_taken_sec = time_taken_msec / 1000;
-	seq_printf(file, "time taken (ms): %ld\n", time_taken_msec);
-	seq_puts(file, "to chip:\n");
-	seq_printf(file, "\tpackets per sec: %ld\n", tc_cnt / time_taken_sec);
-	seq_printf(file, "\tgoodput (kbit): %ld\n",
-		   (tc_cnt * BENCHMARK_PKT_LEN * 8) / time_taken_msec);
+	time_taken_msec = max(jiffies_to_msecs(end_time - start_time), 1U);
+	seq_printf(file, "time taken (ms): %lu\n", time_taken_msec);
+	morse_bus_bench_show_rate(file, "to chip", tc_cnt, len, time_taken_msec);
 
-	seq_puts(file, "from chip:\n");
-	seq_printf(file, "\tpackets per sec: %ld\n", fc_cnt / time_taken_sec);
-	seq_printf(file, "\tgoodput (kbit): %ld\n",
-		   (fc_cnt * BENCHMARK_PKT_LEN * 8) / time_taken_msec);
+	if (!bidir)
+		return 0;
 
-	seq_puts(file, "combined:\n");
-	seq_printf(file, "\tpackets per sec: %ld\n", (tc_cnt + fc_cnt) / time_taken_sec);
-	seq_printf(file, "\tgoodput (kbit): %ld\n",
-		   ((tc_cnt + fc_cnt) * BENCHMARK_PKT_LEN * 8) / time_taken_msec);
+	morse_bus_bench_show_rate(file, "from chip", fc_cnt, len, time_taken_msec);
+	morse_bus_bench_show_rate(file, "combined", tc_cnt + fc_cnt, len, time_taken_msec);
+	morse_yaps_benchmark_show_latency(yaps, file);
 
-exit:
-	kfree(body);
 	return 0;
 }
+
+int morse_yaps_benchmark(struct morse *mors, struct seq_file *file)
+{
+	int rc = 0;
+	struct morse_yaps *yaps = mors->chip_if->yaps;
+	const u32 min_len = clamp_t(u32, yaps_benchmark_min_len,
+				    sizeof(struct morse_yaps_benchmark_stamp), BENCHMARK_PKT_LEN_MAX);
+	const u32 max_len = clamp_t(u32, yaps_benchmark_max_len, min_len, BENCHMARK_PKT_LEN_MAX);
+	const u32 duration_ms = max_t(u32, yaps_benchmark_duration_ms, 1);
+	const u32 depth = yaps_benchmark_queue_depth;
+	const bool bidir = yaps_benchmark_bidir;
+	char *body;
+	u32 len;
+
+	if (!mutex_trylock(&yaps->benchmark.lock)) {
+		seq_puts(file, "benchmark already running\n");
+		return -EBUSY;
+	}
+
+	if (!yaps->benchmark.lat_us) {
+		yaps->benchmark.lat_us = vmalloc(BENCHMARK_LAT_SAMPLES *
+						 sizeof(*yaps->benchmark.lat_us));
+		if (!yaps->benchmark.lat_us) {
+			rc = -ENOMEM;
+			goto exit_unlock;
+		}
+	}
+
+	body = kmalloc(max_len, GFP_KERNEL);
+	if (!body) {
+		rc = -ENOMEM;
+		goto exit_unlock;
+	}
+
+#if KERNEL_VERSION(4, 10, 0) <= LINUX_VERSION_CODE
+	get_random_bytes_wait(body, max_len);
+#endif
+
+	seq_printf(file, "mode: %s\n", bidir ? "bidirectional" : "one-way");
+	seq_printf(file, "step duration (ms): %u\n", duration_ms);
+	if (depth)
+		seq_printf(file, "queue depth: %u\n", depth);
+	else
+		seq_puts(file, "queue depth: unlimited\n");
+
+	for (len = min_len; ; len = min(len * 2, max_len)) {
+		seq_puts(file, "\n");
+		rc = morse_yaps_benchmark_step(yaps, file, body, len, duration_ms, depth, bidir);
+		if (rc || len == max_len)
+			break;
+	}
+
+	kfree(body);
+exit_unlock:
+	mutex_unlock(&yaps->benchmark.lock);
+	return rc;
+}
 #endif
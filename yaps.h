@@ -6,6 +6,7 @@
 #ifndef _MORSE_YAPS_H_
 #define _MORSE_YAPS_H_
 
+#include <linux/ktime.h>
 #include <linux/skbuff.h>
 #include <linux/workqueue.h>
 #include "chip_if.h"
@@ -71,13 +72,26 @@ struct morse_yaps {
 	struct morse_skbq cmd_resp_q;
 
 #ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
-	atomic_t benchmark_cnt_fc;
-	atomic_t benchmark_cnt_tc;
+	struct {
+		/* Serialises benchmark runs */
+		struct mutex lock;
+		/* Identifies loopback packets belonging to the current benchmark step */
+		u32 run;
+		atomic_t cnt_fc;
+		atomic_t cnt_tc;
+		/* Round trip latency samples (us) of the current benchmark step */
+		u32 *lat_us;
+		atomic_t lat_cnt;
+	} benchmark;
 #endif
 
 	struct {
 		struct timer_list timer;
 		unsigned long retry_expiry;
+		/* Arrival time of the last TX status from the chip */
+		ktime_t last_tx_status;
+		/* Moving average of the time (us) the chip takes to free one TX packet */
+		u32 avg_free_us;
 		bool is_full;
 	} chip_queue_full;
 
@@ -174,11 +188,12 @@ void morse_yaps_finish(struct morse_yaps *yaps);
 void morse_yaps_flush_tx_data(struct morse_yaps *yaps);
 
 /**
- * Work function executed to perform yaps operations
+ * Perform yaps operations for pending chip_if events
  *
- * @work: Pointer to work struct.
+ * @mors: Morse chip instance
+ * @events: Mask of the events to handle (BIT(enum morse_chip_if_event_flags))
  */
-void morse_yaps_work(struct work_struct *work);
+void morse_yaps_handle_events(struct morse *mors, unsigned long events);
 
 /**
  * Work function to remove stale pending tx SKBs
@@ -196,6 +211,16 @@ void morse_yaps_stale_tx_work(struct work_struct *work);
  */
 int morse_yaps_get_tx_status_pending_count(struct morse *mors);
 
+/**
+ * morse_yaps_chip_queue_has_space - Note that the chip has room for more TX data
+ *
+ * @yaps: Pointer to yaps instance
+ *
+ * Clears the chip queue full state and cancels its retry timer so the next chip_if
+ * work pass sends data straight away. Must be called from the chip_if work context.
+ */
+void morse_yaps_chip_queue_has_space(struct morse_yaps *yaps);
+
 /**
  * Return a count of all the TX SKBs buffered
  *
@@ -205,11 +230,23 @@ int morse_yaps_get_tx_status_pending_count(struct morse *mors);
  */
 int morse_yaps_get_tx_buffered_count(struct morse *mors);
 
+/* chip_if_ops queue lookups, exposed so the TX path can call them directly */
+struct morse_skbq *skbq_yaps_tc_q_from_aci(struct morse *mors, int aci);
+struct morse_skbq *skbq_yaps_mgmt_q(struct morse *mors);
+struct morse_skbq *skbq_yaps_cmd_q(struct morse *mors);
+
 /**
- * Runs a benchmark and prints info about the yaps performance to a file.
+ * Runs a loopback benchmark and prints info about the yaps performance to a file.
  *
- * @yaps: Pointer to yaps struct
+ * The benchmark sweeps the packet size from yaps_benchmark_min_len to yaps_benchmark_max_len
+ * (doubling each step), running each size for yaps_benchmark_duration_ms. For each step the
+ * throughput in each direction and, in bidirectional mode, the round trip latency percentiles
+ * of the looped back packets are reported.
+ *
+ * @mors: Morse chip instance
  * @file: Pointer to file to print to
+ *
+ * @return: 0 on success, else error code
  */
 int morse_yaps_benchmark(struct morse *mors, struct seq_file *file);
 